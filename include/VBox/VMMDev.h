@@ -213,6 +213,7 @@ typedef enum
     VMMDevReq_WriteCoreDump              = 218,
     VMMDevReq_GuestHeartbeat             = 219,
     VMMDevReq_HeartbeatConfigure         = 220,
+    VMMDevReq_ReportFreePages            = 221,
     VMMDevReq_SizeHack                   = 0x7fffffff
 } VMMDevRequestType;
 
@@ -1013,6 +1014,48 @@ AssertCompileSize(VMMDevChangeMemBalloon, 24+16);
 /** @} */
 
 
+/**
+ * A range of free guest pages.
+ *
+ * Used by VMMDevReportFreePages.
+ */
+typedef struct
+{
+    /** The guest physical address of the first page, page aligned. */
+    RTGCPHYS64          GCPhys;
+    /** The number of pages. */
+    uint32_t            cPages;
+    /** Reserved, MBZ. */
+    uint32_t            u32Reserved;
+} VMMDevFreePageRange;
+AssertCompileSize(VMMDevFreePageRange, 16);
+
+/**
+ * Report free guest pages so the host can release the memory backing them.
+ *
+ * The guest must not touch the pages until the request has completed.  After
+ * that they read as zero and get new backing when written to.  Unlike
+ * ballooning, the pages remain the guest's to use as it pleases.
+ *
+ * Used by VMMDevReq_ReportFreePages.
+ */
+typedef struct
+{
+    /** Header. */
+    VMMDevRequestHeader header;
+    /** The number of ranges in the array. */
+    uint32_t            cRanges;
+    /** Reserved, MBZ. */
+    uint32_t            u32Reserved;
+    /** The free page ranges, variable size. */
+    VMMDevFreePageRange aRanges[1];
+} VMMDevReportFreePages;
+AssertCompileSize(VMMDevReportFreePages, 24+8+16);
+
+/** The max number of ranges in a VMMDevReq_ReportFreePages request. */
+#define VMMDEV_FREE_PAGES_MAX_RANGES                 256
+
+
 /**
  * Guest statistics interval change request structure.
  *
@@ -2037,6 +2080,8 @@ DECLINLINE(size_t) vmmdevGetRequestSize(VMMDevRequestType requestType)
             return sizeof(VMMDevReqHeartbeat);
         case VMMDevReq_GuestHeartbeat:
             return sizeof(VMMDevRequestHeader);
+        case VMMDevReq_ReportFreePages:
+            return sizeof(VMMDevReportFreePages);
         default:
             break;
     }
@@ -590,6 +590,9 @@
 /** Internal processing error in the PGM physial page mapping code dealing
  * with MMIO2 pages. */
 #define VERR_PGM_PHYS_PAGE_MAP_MMIO2_IPE        (-1684)
+/** Post-copy was aborted before all the guest pages were received, the VM
+ * memory is incomplete. */
+#define VERR_PGM_POST_COPY_ABORTED              (-1685)
 /** @} */
 
 
@@ -1976,6 +1979,9 @@
 /** The size of the one or more regions in the shared module was out of
  * range. */
 #define VERR_GMM_SHARED_MODULE_BAD_REGIONS_SIZE     (-3831)
+/** The seeded chunk is physically contiguous and aligned, so it can back
+ * large pages. */
+#define VINF_GMM_SEEDED_CHUNK_CONTIGUOUS            (3832)
 /** @} */
 
 
@@ -1222,6 +1222,34 @@ SUPR3DECL(int) SUPR3PageAlloc(size_t cPages, void **ppvPages);
  */
 SUPR3DECL(int) SUPR3PageFree(void *pvPages, size_t cPages);
 
+/**
+ * Allocate zero-filled pages backed by host large pages.
+ *
+ * This is a variant of SUPR3PageAlloc() for seeding ring-0 with memory that
+ * can be used for large guest pages.  The memory is 2MB aligned.  With
+ * SUP_PAGE_ALLOC_HUGE_F_THP the host is only asked to use transparent huge
+ * pages, so it may still end up (partially) backed by small pages.  Call
+ * SUPR3PageFree() to free the pages once done with them.
+ *
+ * @returns VBox status.
+ * @retval  VERR_NOT_SUPPORTED if the host or the requested method isn't
+ *          supported.
+ * @retval  VERR_NO_MEMORY if no large pages are available.
+ * @param   cPages          Number of pages to allocate, multiple of 2MB.
+ * @param   fFlags          How to get the large pages, one of the
+ *                          SUP_PAGE_ALLOC_HUGE_F_XXX values.
+ * @param   ppvPages        Where to store the base pointer to the allocated pages.
+ */
+SUPR3DECL(int) SUPR3PageAllocHuge(size_t cPages, uint32_t fFlags, void **ppvPages);
+
+/** @name SUP_PAGE_ALLOC_HUGE_F_XXX - SUPR3PageAllocHuge flags.
+ * @{ */
+/** Use transparent huge pages (madvise). */
+#define SUP_PAGE_ALLOC_HUGE_F_THP           RT_BIT_32(0)
+/** Use the reserved huge page pool (hugetlbfs). */
+#define SUP_PAGE_ALLOC_HUGE_F_HUGETLBFS     RT_BIT_32(1)
+/** @} */
+
 /**
  * Allocate non-zeroed, locked, pages with user and, optionally, kernel
  * mappings.
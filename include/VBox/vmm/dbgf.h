@@ -2154,6 +2154,15 @@ VMMR3DECL(void *)   DBGFR3OSQueryInterface(PUVM pUVM, DBGFOSINTERFACE enmIf);
 VMMR3DECL(int)      DBGFR3CoreWrite(PUVM pUVM, const char *pszFilename, bool fReplaceFile);
 
 
+/** @name Guest sampling profiler.
+ * @{ */
+VMMR3DECL(int)      DBGFR3ProfilerStart(PUVM pUVM, uint32_t uHz, uint32_t cMaxDepth);
+VMMR3DECL(int)      DBGFR3ProfilerStop(PUVM pUVM);
+VMMR3DECL(int)      DBGFR3ProfilerReset(PUVM pUVM);
+VMMR3DECL(int)      DBGFR3ProfilerDumpFolded(PUVM pUVM, const char *pszFilename);
+/** @} */
+
+
 #ifdef IN_RING3
 /** @defgroup grp_dbgf_plug_in      The DBGF Plug-in Interface
  * @{
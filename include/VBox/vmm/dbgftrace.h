@@ -27,6 +27,7 @@
 #define ___VBox_vmm_dbgftrace_h
 
 #include <iprt/trace.h>
+#include <iprt/assert.h>
 #include <VBox/types.h>
 
 RT_C_DECLS_BEGIN
@@ -137,6 +138,210 @@ VMMDECL(int) DBGFR3TraceConfig(PVM pVM, const char *pszConfig);
 /** @} */
 
 
+/** @defgroup grp_dbgf_trace_bin  Binary Tracing
+ *
+ * The binary tracing records typed, fixed-size events with a TSC time stamp
+ * into per-VCPU rings, so it can be left compiled in and be used at high
+ * event rates.  The rings can be streamed to a file while the VM runs or be
+ * dumped on demand, the file format is described by DBGFTRACEFILEHDR and
+ * DBGFTRACEFILECHUNK.  The VBoxTraceDecode tool converts such files into
+ * the Chrome trace event format understood by chrome://tracing and Perfetto.
+ *
+ * Define DBGFTRACE_BIN_DISABLED to compile out the trace points.
+ *
+ * @{
+ */
+
+/**
+ * Binary trace event types.
+ *
+ * The meaning of the arguments is given for the begin and end phases.
+ */
+typedef enum DBGFTRACEEVT
+{
+    /** Invalid zero entry. */
+    DBGFTRACEEVT_INVALID = 0,
+    /** I/O port read: begin = port, size; end = value, status code. */
+    DBGFTRACEEVT_IOPORT_READ,
+    /** I/O port write: begin = port, size; end = value, status code. */
+    DBGFTRACEEVT_IOPORT_WRITE,
+    /** MMIO read: begin = address, size; end = value (up to 8 bytes), status code. */
+    DBGFTRACEEVT_MMIO_READ,
+    /** MMIO write: begin = address, size; end = value (up to 8 bytes), status code. */
+    DBGFTRACEEVT_MMIO_WRITE,
+    /** Hardware assisted guest execution in ring-0: begin = RIP; end = RIP, status code. */
+    DBGFTRACEEVT_HM_RUN,
+    /** The end of the VMM event types. */
+    DBGFTRACEEVT_END,
+    /** The first event type available to devices.  The device and decoder
+     * have to agree on the meaning of the arguments. */
+    DBGFTRACEEVT_DEV_FIRST = 0x1000,
+    /** The last event type available to devices. */
+    DBGFTRACEEVT_DEV_LAST  = 0xffff
+} DBGFTRACEEVT;
+
+/** @name Binary trace event phases (DBGFTRACEREC::bPhase).
+ * @{ */
+/** A single point in time. */
+#define DBGFTRACEPHASE_INSTANT          UINT8_C(0)
+/** The start of a span. */
+#define DBGFTRACEPHASE_BEGIN            UINT8_C(1)
+/** The end of a span. */
+#define DBGFTRACEPHASE_END              UINT8_C(2)
+/** @} */
+
+/** @name Binary trace groups (VMCPU::fTraceBinGroups).
+ * @{ */
+/** I/O port accesses. */
+#define DBGFTRACEGRP_IOPORT             RT_BIT_32(0)
+/** MMIO accesses. */
+#define DBGFTRACEGRP_MMIO               RT_BIT_32(1)
+/** Hardware assisted execution. */
+#define DBGFTRACEGRP_HM                 RT_BIT_32(2)
+/** Device specific events. */
+#define DBGFTRACEGRP_DEV                RT_BIT_32(3)
+/** All groups. */
+#define DBGFTRACEGRP_ALL                UINT32_C(0x0000000f)
+/** @} */
+
+/**
+ * Binary trace record.
+ */
+typedef struct DBGFTRACEREC
+{
+    /** The host TSC when the event was recorded. */
+    uint64_t            u64Tsc;
+    /** The low 32 bits of the ring index plus one, zero while being written.
+     * Used to detect records that were overwritten while being read. */
+    uint32_t            u32Seq;
+    /** The event type (DBGFTRACEEVT). */
+    uint16_t            uEvent;
+    /** The event phase (DBGFTRACEPHASE_XXX). */
+    uint8_t             bPhase;
+    /** Reserved, MBZ. */
+    uint8_t             bReserved;
+    /** Event specific arguments. */
+    uint64_t            au64Args[2];
+} DBGFTRACEREC;
+AssertCompileSize(DBGFTRACEREC, 32);
+/** Pointer to a binary trace record. */
+typedef DBGFTRACEREC *PDBGFTRACEREC;
+/** Pointer to a const binary trace record. */
+typedef DBGFTRACEREC const *PCDBGFTRACEREC;
+
+/**
+ * Binary trace file header.
+ *
+ * The header is followed by any number of chunks (DBGFTRACEFILECHUNK), each
+ * followed by its records.
+ */
+typedef struct DBGFTRACEFILEHDR
+{
+    /** Magic (DBGFTRACEFILEHDR_MAGIC). */
+    char                szMagic[8];
+    /** The file format version (DBGFTRACEFILEHDR_VERSION). */
+    uint32_t            uVersion;
+    /** The size of this header. */
+    uint32_t            cbHdr;
+    /** The size of a record (sizeof(DBGFTRACEREC)). */
+    uint32_t            cbRecord;
+    /** The number of virtual CPUs. */
+    uint32_t            cCpus;
+    /** The host TSC frequency. */
+    uint64_t            u64TscHz;
+    /** The host TSC when the file was started. */
+    uint64_t            u64TscStart;
+    /** The wall clock time when the file was started, nanoseconds since the
+     * unix epoch. */
+    int64_t             i64UnixNanoStart;
+} DBGFTRACEFILEHDR;
+AssertCompileSize(DBGFTRACEFILEHDR, 48);
+/** Pointer to a binary trace file header. */
+typedef DBGFTRACEFILEHDR *PDBGFTRACEFILEHDR;
+/** Pointer to a const binary trace file header. */
+typedef DBGFTRACEFILEHDR const *PCDBGFTRACEFILEHDR;
+/** DBGFTRACEFILEHDR::szMagic value. */
+#define DBGFTRACEFILEHDR_MAGIC          "VBoxTrB"
+/** DBGFTRACEFILEHDR::uVersion value. */
+#define DBGFTRACEFILEHDR_VERSION        UINT32_C(0x00010000)
+
+/**
+ * Binary trace file chunk header.
+ */
+typedef struct DBGFTRACEFILECHUNK
+{
+    /** The ID of the virtual CPU the records belong to, NIL_VMCPUID for
+     * events raised by other threads. */
+    VMCPUID             idCpu;
+    /** The number of records following this header. */
+    uint32_t            cRecords;
+    /** The number of records lost in this ring before the first one of this
+     * chunk because the reader didn't keep up. */
+    uint64_t            cLost;
+} DBGFTRACEFILECHUNK;
+AssertCompileSize(DBGFTRACEFILECHUNK, 16);
+/** Pointer to a binary trace file chunk header. */
+typedef DBGFTRACEFILECHUNK *PDBGFTRACEFILECHUNK;
+/** Pointer to a const binary trace file chunk header. */
+typedef DBGFTRACEFILECHUNK const *PCDBGFTRACEFILECHUNK;
+
+
+/**
+ * Gets the name of a binary trace event type.
+ *
+ * @returns Read only name string, NULL for device specific and unknown types.
+ * @param   uEvent      The event type (DBGFTRACEEVT).
+ */
+DECLINLINE(const char *) DBGFTraceBinEventName(uint16_t uEvent)
+{
+    switch (uEvent)
+    {
+        case DBGFTRACEEVT_IOPORT_READ:  return "ioport-read";
+        case DBGFTRACEEVT_IOPORT_WRITE: return "ioport-write";
+        case DBGFTRACEEVT_MMIO_READ:    return "mmio-read";
+        case DBGFTRACEEVT_MMIO_WRITE:   return "mmio-write";
+        case DBGFTRACEEVT_HM_RUN:       return "hm-run";
+        default:                        return NULL;
+    }
+}
+
+
+VMMDECL(void) DBGFTraceBinAdd(PVMCPU pVCpu, uint16_t uEvent, uint8_t bPhase, uint64_t uArg0, uint64_t uArg1);
+VMMDECL(void) DBGFTraceBinAddVM(PVM pVM, uint16_t uEvent, uint8_t bPhase, uint64_t uArg0, uint64_t uArg1);
+#ifdef IN_RING3
+VMMR3DECL(int) DBGFR3TraceBinSetGroups(PVM pVM, uint32_t fGroups);
+VMMR3DECL(int) DBGFR3TraceBinDump(PVM pVM, const char *pszFilename);
+#endif
+
+/**
+ * Records a binary trace event if the group is enabled for the VCPU.
+ *
+ * @remarks The user of this macro is responsible of including VBox/vmm/vm.h.
+ */
+#ifndef DBGFTRACE_BIN_DISABLED
+# define DBGFTRACE_BIN(a_pVCpu, a_fGroup, a_uEvent, a_bPhase, a_uArg0, a_uArg1) \
+    do { \
+        if (RT_UNLIKELY((a_pVCpu)->fTraceBinGroups & (a_fGroup))) \
+            DBGFTraceBinAdd((a_pVCpu), (a_uEvent), (a_bPhase), (a_uArg0), (a_uArg1)); \
+    } while (0)
+#else
+# define DBGFTRACE_BIN(a_pVCpu, a_fGroup, a_uEvent, a_bPhase, a_uArg0, a_uArg1) do { } while (0)
+#endif
+
+/**
+ * Records a device specific binary trace event.
+ *
+ * This can be used from any thread and context.
+ */
+#ifndef DBGFTRACE_BIN_DISABLED
+# define DBGFTRACE_PDMDEV_BIN(a_pDevIns, a_uEvent, a_bPhase, a_uArg0, a_uArg1) \
+    do { DBGFTraceBinAddVM(PDMDevHlpGetVM(a_pDevIns), (a_uEvent), (a_bPhase), (a_uArg0), (a_uArg1)); } while (0)
+#else
+# define DBGFTRACE_PDMDEV_BIN(a_pDevIns, a_uEvent, a_bPhase, a_uArg0, a_uArg1) do { } while (0)
+#endif
+/** @} */
+
+
 /** @} */
 RT_C_DECLS_END
 
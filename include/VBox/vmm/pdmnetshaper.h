@@ -55,7 +55,17 @@ typedef struct PDMNSFILTER
     /** Set when the filter fails to obtain bandwidth. */
     bool                                fChoked;
     /** Aligment padding. */
-    bool                                afPadding[HC_ARCH_BITS == 32 ? 3 : 7];
+    bool                                afPadding[3];
+    /** Number of bytes taken from the bandwidth group in advance and not yet
+     * consumed.  Only accessed by the owner's serialized transmit path. */
+    uint32_t                            cbCredit;
+    /** The bandwidth group limit generation cbCredit was obtained under. */
+    uint32_t                            uCreditGen;
+    /** Aligment padding. */
+    uint32_t                            u32Padding;
+    /** When choked, the time (RTTimeSystemNanoTS) at which the bandwidth
+     * group is able to satisfy the request that was denied. */
+    volatile uint64_t                   tsWakeup;
     /** The driver this filter is aggregated into (ring-3). */
     R3PTRTYPE(PPDMINETWORKDOWN)         pIDrvNetR3;
 } PDMNSFILTER;
@@ -311,6 +311,24 @@ typedef DECLCALLBACK(int) FNPGMENUMDIRTYFTPAGES(PVM pVM, RTGCPHYS GCPhys, uint8_
 typedef FNPGMENUMDIRTYFTPAGES *PFNPGMENUMDIRTYFTPAGES;
 
 
+/**
+ * PGMR3PostCopyTrgStart callback for requesting a page from the source.
+ *
+ * The callback shall not wait for the page, it is handed to
+ * PGMR3PostCopyTrgDeliverPage by whoever receives it.  It is called while
+ * owning an internal PGM lock, so it must not block or call back into PGM.
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ * @param   GCPhys          The guest physical address of the page.
+ * @param   pvUser          User argument.
+ * @thread  Any, usually an EMT.
+ */
+typedef DECLCALLBACK(int) FNPGMPOSTCOPYREQUEST(PUVM pUVM, RTGCPHYS GCPhys, void *pvUser);
+/** Pointer to PGMR3PostCopyTrgStart callback. */
+typedef FNPGMPOSTCOPYREQUEST *PFNPGMPOSTCOPYREQUEST;
+
+
 /**
  * Paging mode.
  */
@@ -498,6 +516,21 @@ typedef enum PGMPAGETYPE
 } PGMPAGETYPE;
 AssertCompile(PGMPAGETYPE_END == 8);
 
+/**
+ * A range of guest pages reported free, see PGMR3PhysReportFreePages.
+ */
+typedef struct PGMPHYSFREERANGE
+{
+    /** The guest physical address of the first page, page aligned. */
+    RTGCPHYS        GCPhys;
+    /** The number of pages. */
+    uint32_t        cPages;
+    /** Reserved, MBZ. */
+    uint32_t        u32Reserved;
+} PGMPHYSFREERANGE;
+/** Pointer to a const free page range. */
+typedef PGMPHYSFREERANGE const *PCPGMPHYSFREERANGE;
+
 VMM_INT_DECL(PGMPAGETYPE) PGMPhysGetPageType(PVM pVM, RTGCPHYS GCPhys);
 
 VMM_INT_DECL(int)   PGMPhysGCPhys2HCPhys(PVM pVM, RTGCPHYS GCPhys, PRTHCPHYS pHCPhys);
@@ -657,6 +690,7 @@ VMMR0_INT_DECL(int) PGMR0PhysFlushHandyPages(PVM pVM, PVMCPU pVCpu);
 VMMR0_INT_DECL(int) PGMR0PhysAllocateLargeHandyPage(PVM pVM, PVMCPU pVCpu);
 VMMR0_INT_DECL(int) PGMR0PhysSetupIommu(PVM pVM);
 VMMR0DECL(int)      PGMR0SharedModuleCheck(PVM pVM, PGVM pGVM, VMCPUID idCpu, PGMMSHAREDMODULE pModule, PCRTGCPTR64 paRegionsGCPtrs);
+VMMR0DECL(int)      PGMR0PageFusionScan(PVM pVM, PGVM pGVM, VMCPUID idCpu, uint32_t cMaxPages);
 VMMR0DECL(int)      PGMR0Trap0eHandlerNestedPaging(PVM pVM, PVMCPU pVCpu, PGMMODE enmShwPagingMode, RTGCUINT uErr, PCPUMCTXCORE pRegFrame, RTGCPHYS pvFault);
 VMMR0DECL(VBOXSTRICTRC) PGMR0Trap0eHandlerNPMisconfig(PVM pVM, PVMCPU pVCpu, PGMMODE enmShwPagingMode, PCPUMCTXCORE pRegFrame, RTGCPHYS GCPhysFault, uint32_t uErr);
 # ifdef VBOX_WITH_2X_4GB_ADDR_SPACE
@@ -692,6 +726,7 @@ VMMR3DECL(int)      PGMR3ChangeMode(PVM pVM, PVMCPU pVCpu, PGMMODE enmGuestMode)
 
 VMMR3DECL(int)      PGMR3PhysRegisterRam(PVM pVM, RTGCPHYS GCPhys, RTGCPHYS cb, const char *pszDesc);
 VMMR3DECL(int)      PGMR3PhysChangeMemBalloon(PVM pVM, bool fInflate, unsigned cPages, RTGCPHYS *paPhysPage);
+VMMR3DECL(int)      PGMR3PhysReportFreePages(PVM pVM, uint32_t cRanges, PCPGMPHYSFREERANGE paRanges);
 VMMR3DECL(int)      PGMR3PhysWriteProtectRAM(PVM pVM);
 VMMR3DECL(int)      PGMR3PhysEnumDirtyFTPages(PVM pVM, PFNPGMENUMDIRTYFTPAGES pfnEnum, void *pvUser);
 VMMR3DECL(uint32_t) PGMR3PhysGetRamRangeCount(PVM pVM);
@@ -700,6 +735,17 @@ VMMR3DECL(int)      PGMR3PhysGetRange(PVM pVM, uint32_t iRange, PRTGCPHYS pGCPhy
 VMMR3DECL(int)      PGMR3QueryMemoryStats(PUVM pUVM, uint64_t *pcbTotalMem, uint64_t *pcbPrivateMem, uint64_t *pcbSharedMem, uint64_t *pcbZeroMem);
 VMMR3DECL(int)      PGMR3QueryGlobalMemoryStats(PUVM pUVM, uint64_t *pcbAllocMem, uint64_t *pcbFreeMem, uint64_t *pcbBallonedMem, uint64_t *pcbSharedMem);
 
+VMMR3DECL(int)      PGMR3PostCopySrcEnable(PUVM pUVM, bool fEnable);
+VMMR3DECL(int)      PGMR3PostCopySrcNextPage(PUVM pUVM, PRTGCPHYS pGCPhys);
+VMMR3DECL(int)      PGMR3PostCopySrcReadPage(PUVM pUVM, RTGCPHYS GCPhys, void *pvBuf, bool *pfZero);
+VMMR3DECL(int)      PGMR3PostCopyTrgStart(PUVM pUVM, PFNPGMPOSTCOPYREQUEST pfnRequest, void *pvUser);
+VMMR3DECL(int)      PGMR3PostCopyTrgDeliverPage(PUVM pUVM, RTGCPHYS GCPhys, const void *pvPage);
+VMMR3DECL(int)      PGMR3PostCopyTrgAbort(PUVM pUVM);
+VMMR3DECL(uint32_t) PGMR3PostCopyGetPendingPages(PUVM pUVM);
+VMMR3DECL(int)      PGMR3PostCopyEnd(PUVM pUVM);
+VMMR3_INT_DECL(int) PGMR3PostCopyTrgFetchPage(PVM pVM, RTGCPHYS GCPhys);
+VMMR3DECL(int)      PGMR3DeltaSetParent(PUVM pUVM, const char *pszParent);
+
 VMMR3DECL(int)      PGMR3PhysMMIORegister(PVM pVM, RTGCPHYS GCPhys, RTGCPHYS cb, PGMPHYSHANDLERTYPE hType,
                                           RTR3PTR pvUserR3, RTR0PTR pvUserR0, RTRCPTR pvUserRC, const char *pszDesc);
 VMMR3DECL(int)      PGMR3PhysMMIODeregister(PVM pVM, RTGCPHYS GCPhys, RTGCPHYS cb);
@@ -1155,6 +1155,21 @@ typedef struct SSMSTRMOPS
 #define SSMSTRMOPS_VERSION      UINT32_C(0x55aa0001)
 
 
+/**
+ * Callback for SSMR3EnumUnitPasses.
+ *
+ * @returns VBox status code, failures stop the enumeration.
+ * @param   pSSM            The SSM handle, positioned at the start of the data
+ *                          unit pass.  The getters can be used on it.
+ * @param   uVersion        The data unit version.
+ * @param   uPass           The data pass, SSM_PASS_FINAL for the final one.
+ * @param   pvUser          The user argument.
+ */
+typedef DECLCALLBACK(int) FNSSMENUMUNITPASS(PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass, void *pvUser);
+/** Pointer to a FNSSMENUMUNITPASS() function. */
+typedef FNSSMENUMUNITPASS *PFNSSMENUMUNITPASS;
+
+
 VMMR3_INT_DECL(void)    SSMR3Term(PVM pVM);
 VMMR3_INT_DECL(int)
 SSMR3RegisterDevice(PVM pVM, PPDMDEVINS pDevIns, const char *pszName, uint32_t uInstance, uint32_t uVersion,
@@ -1202,6 +1217,8 @@ VMMR3DECL(int)          SSMR3ValidateFile(const char *pszFilename, bool fChecksu
 VMMR3DECL(int)          SSMR3Open(const char *pszFilename, unsigned fFlags, PSSMHANDLE *ppSSM);
 VMMR3DECL(int)          SSMR3Close(PSSMHANDLE pSSM);
 VMMR3DECL(int)          SSMR3Seek(PSSMHANDLE pSSM, const char *pszUnit, uint32_t iInstance, uint32_t *piVersion);
+VMMR3DECL(int)          SSMR3EnumUnitPasses(PSSMHANDLE pSSM, const char *pszUnit, uint32_t iInstance,
+                                            PFNSSMENUMUNITPASS pfnCallback, void *pvUser);
 VMMR3DECL(int)          SSMR3HandleGetStatus(PSSMHANDLE pSSM);
 VMMR3DECL(int)          SSMR3HandleSetStatus(PSSMHANDLE pSSM, int iStatus);
 VMMR3DECL(SSMAFTER)     SSMR3HandleGetAfter(PSSMHANDLE pSSM);
@@ -1211,6 +1228,7 @@ VMMR3DECL(uint32_t)     SSMR3HandleHostBits(PSSMHANDLE pSSM);
 VMMR3DECL(uint32_t)     SSMR3HandleRevision(PSSMHANDLE pSSM);
 VMMR3DECL(uint32_t)     SSMR3HandleVersion(PSSMHANDLE pSSM);
 VMMR3DECL(const char *) SSMR3HandleHostOSAndArch(PSSMHANDLE pSSM);
+VMMR3DECL(const char *) SSMR3HandleGetFilename(PSSMHANDLE pSSM);
 VMMR3_INT_DECL(int)     SSMR3HandleSetGCPtrSize(PSSMHANDLE pSSM, unsigned cbGCPtr);
 VMMR3DECL(void)         SSMR3HandleReportLivePercent(PSSMHANDLE pSSM, unsigned uPercent);
 VMMR3DECL(int)          SSMR3Cancel(PUVM pUVM);
@@ -1245,6 +1263,7 @@ VMMR3DECL(int) SSMR3PutRCPtr(PSSMHANDLE pSSM, RTRCPTR RCPtr);
 VMMR3DECL(int) SSMR3PutIOPort(PSSMHANDLE pSSM, RTIOPORT IOPort);
 VMMR3DECL(int) SSMR3PutSel(PSSMHANDLE pSSM, RTSEL Sel);
 VMMR3DECL(int) SSMR3PutMem(PSSMHANDLE pSSM, const void *pv, size_t cb);
+VMMR3DECL(int) SSMR3PutMemUncompressed(PSSMHANDLE pSSM, const void *pv, size_t cb, uint64_t *poffStream);
 VMMR3DECL(int) SSMR3PutStrZ(PSSMHANDLE pSSM, const char *psz);
 /** @} */
 
@@ -1284,6 +1303,7 @@ VMMR3DECL(int) SSMR3GetStrZEx(PSSMHANDLE pSSM, char *psz, size_t cbMax, size_t *
 VMMR3DECL(int) SSMR3GetTimer(PSSMHANDLE pSSM, PTMTIMER pTimer);
 VMMR3DECL(int) SSMR3Skip(PSSMHANDLE pSSM, size_t cb);
 VMMR3DECL(int) SSMR3SkipToEndOfUnit(PSSMHANDLE pSSM);
+VMMR3DECL(int) SSMR3SkipToEndOfUnitAt(PSSMHANDLE pSSM, uint64_t offStream);
 VMMR3DECL(int) SSMR3SetLoadError(PSSMHANDLE pSSM, int rc, RT_SRC_POS_DECL, const char *pszFormat, ...) RT_IPRT_FORMAT_ATTR(6, 7);
 VMMR3DECL(int) SSMR3SetLoadErrorV(PSSMHANDLE pSSM, int rc, RT_SRC_POS_DECL, const char *pszFormat, va_list va) RT_IPRT_FORMAT_ATTR(6, 0);
 VMMR3DECL(int) SSMR3SetCfgError(PSSMHANDLE pSSM, RT_SRC_POS_DECL, const char *pszFormat, ...) RT_IPRT_FORMAT_ATTR(5, 6);
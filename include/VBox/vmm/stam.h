@@ -27,6 +27,7 @@
 #define ___VBox_vmm_stam_h
 
 #include <VBox/types.h>
+#include <iprt/assert.h>
 #include <iprt/stdarg.h>
 #ifdef _MSC_VER
 # if _MSC_VER >= 1400
@@ -1097,6 +1098,166 @@ typedef const STAMRATIOU32 *PCSTAMRATIOU32;
 
 
 
+/** @defgroup grp_stam_bin  Binary Snapshots and Export
+ *
+ * The binary snapshot API resolves a pattern once into a list of samples and
+ * hands out a name table describing them.  Each collection after that is just
+ * a vector of 64-bit values in name table order, optionally reduced to the
+ * values that changed since the previous collection.
+ *
+ * The same format is used by the export file (STAMR3ExportStart), which lets
+ * a monitor process read the statistics without talking to the VM process.
+ *
+ * Each sample contributes STAMBINNAME::cValues values:
+ *      - STAMTYPE_COUNTER and the integer/boolean types: the value.
+ *      - STAMTYPE_PROFILE and STAMTYPE_PROFILE_ADV: cPeriods, cTicks,
+ *        cTicksMin and cTicksMax.
+ *      - STAMTYPE_RATIO_U32 and STAMTYPE_RATIO_U32_RESET: u32A and u32B.
+ *      - STAMTYPE_CALLBACK: none, use STAMR3Snapshot for these.
+ * @{
+ */
+
+/**
+ * Binary snapshot name table header.
+ *
+ * This is followed by STAMBINNAMES::cSamples STAMBINNAME entries and the
+ * zero terminated sample names.
+ */
+typedef struct STAMBINNAMES
+{
+    /** Magic value (STAMBINNAMES_MAGIC). */
+    uint32_t            u32Magic;
+    /** The STAM registration generation this table was made for. */
+    uint32_t            uGeneration;
+    /** The number of samples (STAMBINNAME entries). */
+    uint32_t            cSamples;
+    /** The number of values in a full value vector. */
+    uint32_t            cValues;
+    /** The offset of the names relative to this header. */
+    uint32_t            offStrings;
+    /** The size of the whole table, including this header. */
+    uint32_t            cbTotal;
+} STAMBINNAMES;
+AssertCompileSize(STAMBINNAMES, 24);
+/** Pointer to a binary snapshot name table header. */
+typedef STAMBINNAMES *PSTAMBINNAMES;
+/** Pointer to a const binary snapshot name table header. */
+typedef STAMBINNAMES const *PCSTAMBINNAMES;
+
+/** STAMBINNAMES::u32Magic value (Charles Babbage). */
+#define STAMBINNAMES_MAGIC      UINT32_C(0x17911226)
+
+/**
+ * Binary snapshot name table entry.
+ */
+typedef struct STAMBINNAME
+{
+    /** The offset of the sample name relative to STAMBINNAMES::offStrings. */
+    uint32_t            offName;
+    /** The index of the first value of this sample in a full value vector. */
+    uint32_t            idxValue;
+    /** The sample type (STAMTYPE). */
+    uint8_t             enmType;
+    /** The sample unit (STAMUNIT). */
+    uint8_t             enmUnit;
+    /** The sample visibility (STAMVISIBILITY). */
+    uint8_t             enmVisibility;
+    /** The number of values this sample contributes. */
+    uint8_t             cValues;
+} STAMBINNAME;
+AssertCompileSize(STAMBINNAME, 12);
+/** Pointer to a binary snapshot name table entry. */
+typedef STAMBINNAME *PSTAMBINNAME;
+/** Pointer to a const binary snapshot name table entry. */
+typedef STAMBINNAME const *PCSTAMBINNAME;
+
+/**
+ * Binary snapshot value vector header.
+ *
+ * Without STAMBINVALUES_F_DELTA this is followed by STAMBINVALUES::cValues
+ * 64-bit values.  With it, it is followed by a bitmap of
+ * RT_ALIGN_32(cValues, 64) bits marking the values that changed, and then the
+ * changed values in ascending index order.
+ */
+typedef struct STAMBINVALUES
+{
+    /** Magic value (STAMBINVALUES_MAGIC). */
+    uint32_t            u32Magic;
+    /** The name table generation (STAMBINNAMES::uGeneration) this goes with. */
+    uint32_t            uGeneration;
+    /** Flags, STAMBINVALUES_F_XXX. */
+    uint32_t            fFlags;
+    /** The number of values in a full value vector. */
+    uint32_t            cValues;
+    /** The collection sequence number (one based). */
+    uint64_t            uSeqNo;
+    /** When the values were collected, RTTimeNanoTS. */
+    uint64_t            u64NanoTS;
+} STAMBINVALUES;
+AssertCompileSize(STAMBINVALUES, 32);
+/** Pointer to a binary snapshot value vector header. */
+typedef STAMBINVALUES *PSTAMBINVALUES;
+/** Pointer to a const binary snapshot value vector header. */
+typedef STAMBINVALUES const *PCSTAMBINVALUES;
+
+/** STAMBINVALUES::u32Magic value (Ada Lovelace). */
+#define STAMBINVALUES_MAGIC     UINT32_C(0x18151210)
+/** Only the values that changed since the previous collection are included. */
+#define STAMBINVALUES_F_DELTA   RT_BIT_32(0)
+
+/**
+ * The export file header.
+ *
+ * The export file consists of this header, a full STAMBINVALUES vector and a
+ * STAMBINNAMES table.  The header is updated seqlock style: STAMEXPORTHDR::uSeq
+ * is odd while an update is in progress.  A reader reads the header, the
+ * sections and then the sequence number again, retrying if it was odd or
+ * changed.  Put the file on a memory file system (/dev/shm for instance) to
+ * keep it off the disk.
+ */
+typedef struct STAMEXPORTHDR
+{
+    /** Magic string (STAMEXPORTHDR_MAGIC). */
+    char                szMagic[8];
+    /** The format version (STAMEXPORTHDR_VERSION). */
+    uint32_t            uVersion;
+    /** The size of this header. */
+    uint32_t            cbHdr;
+    /** The update sequence number, odd while an update is in progress. */
+    uint64_t volatile   uSeq;
+    /** When the values were last updated, nanoseconds since the Unix epoch. */
+    int64_t             i64UnixNano;
+    /** The file offset of the value vector (STAMBINVALUES). */
+    uint32_t            offValues;
+    /** The size of the value vector. */
+    uint32_t            cbValues;
+    /** The file offset of the name table (STAMBINNAMES). */
+    uint32_t            offNames;
+    /** The size of the name table. */
+    uint32_t            cbNames;
+    /** The update interval in milliseconds. */
+    uint32_t            cMsInterval;
+    /** The ID of the VM process. */
+    uint32_t            uPid;
+    /** Reserved, zero. */
+    uint64_t            au64Reserved[1];
+} STAMEXPORTHDR;
+AssertCompileSize(STAMEXPORTHDR, 64);
+/** Pointer to an export file header. */
+typedef STAMEXPORTHDR *PSTAMEXPORTHDR;
+
+/** STAMEXPORTHDR::szMagic value. */
+#define STAMEXPORTHDR_MAGIC     "VBoxStE"
+/** STAMEXPORTHDR::uVersion value. */
+#define STAMEXPORTHDR_VERSION   UINT32_C(0x00010000)
+
+/** Binary snapshot handle. */
+typedef struct STAMBINSNAP *PSTAMBINSNAP;
+
+/** @} */
+
+
+
 
 /** @defgroup grp_stam_r3   The STAM Host Context Ring 3 API
  * @{
@@ -1234,6 +1395,14 @@ typedef FNSTAMR3ENUM *PFNSTAMR3ENUM;
 VMMR3DECL(int)  STAMR3Enum(PUVM pUVM, const char *pszPat, PFNSTAMR3ENUM pfnEnum, void *pvUser);
 VMMR3DECL(const char *) STAMR3GetUnit(STAMUNIT enmUnit);
 
+VMMR3DECL(int)  STAMR3SnapshotBinCreate(PUVM pUVM, const char *pszPat, PSTAMBINSNAP *phSnap);
+VMMR3DECL(int)  STAMR3SnapshotBinDestroy(PSTAMBINSNAP hSnap);
+VMMR3DECL(int)  STAMR3SnapshotBinGetNames(PSTAMBINSNAP hSnap, void const **ppvNames, size_t *pcbNames);
+VMMR3DECL(int)  STAMR3SnapshotBinCollect(PSTAMBINSNAP hSnap, bool fDelta, void const **ppvValues, size_t *pcbValues);
+VMMR3DECL(int)  STAMR3ExportStart(PUVM pUVM, const char *pszFilename, const char *pszPat, uint32_t cMsInterval);
+VMMR3DECL(int)  STAMR3ExportStop(PUVM pUVM);
+VMMR3_INT_DECL(int) STAMR3InitCompleted(PVM pVM);
+
 /** @} */
 
 /** @} */
@@ -123,6 +123,8 @@ typedef struct VMCPU
 
     /** Trace groups enable flags.  */
     uint32_t                fTraceGroups;                           /* 64 / 44 */
+    /** Binary trace groups enable flags (DBGFTRACEGRP_XXX). */
+    uint32_t                fTraceBinGroups;                        /* 68 / 48 */
     /** Align the structures below bit on a 64-byte boundary and make sure it starts
      * at the same offset in both 64-bit and 32-bit builds.
      *
@@ -131,7 +133,7 @@ typedef struct VMCPU
      *          data could be lumped together at the end with a < 64 byte padding
      *          following it (to grow into and align the struct size).
      *   */
-    uint8_t                 abAlignment1[HC_ARCH_BITS == 64 ? 56 : 12+64];
+    uint8_t                 abAlignment1[HC_ARCH_BITS == 64 ? 52 : 8+64];
     /** State data for use by ad hoc profiling. */
     uint32_t                uAdHoc;
     /** Profiling samples for use by ad hoc profiling. */
@@ -161,7 +163,7 @@ typedef struct VMCPU
 #ifdef ___IEMInternal_h
         struct IEMCPU       s;
 #endif
-        uint8_t             padding[3072];      /* multiple of 64 */
+        uint8_t             padding[6144];      /* multiple of 64 */
     } iem;
 
     /** TRPM part. */
@@ -229,7 +231,7 @@ typedef struct VMCPU
     } gim;
 
     /** Align the following members on page boundary. */
-    uint8_t                 abAlignment2[3392];
+    uint8_t                 abAlignment2[320];
 
     /** PGM part. */
     union
@@ -1065,7 +1067,7 @@ typedef struct VM
 #ifdef ___IOMInternal_h
         struct IOM s;
 #endif
-        uint8_t     padding[896];       /* multiple of 64 */
+        uint8_t     padding[960];       /* multiple of 64 */
     } iom;
 
     /** PATM part. */
@@ -1190,7 +1192,7 @@ typedef struct VM
 
 
     /** Padding for aligning the cpu array on a page boundary. */
-    uint8_t         abAlignment2[3998];
+    uint8_t         abAlignment2[3934];
 
     /* ---- end small stuff ---- */
 
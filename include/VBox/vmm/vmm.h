@@ -104,6 +104,8 @@ typedef enum VMMCALLRING3
     VMMCALLRING3_PGM_ALLOCATE_HANDY_PAGES,
     /** Allocates a large (2MB) page. */
     VMMCALLRING3_PGM_ALLOCATE_LARGE_HANDY_PAGE,
+    /** Fetches a page still missing on a post-copy teleportation target. */
+    VMMCALLRING3_PGM_POSTCOPY_FETCH,
     /** Acquire the MM hypervisor heap lock. */
     VMMCALLRING3_MMHYPER_LOCK,
     /** Replay the REM handler notifications. */
@@ -438,6 +440,8 @@ typedef enum VMMR0OPERATION
     VMMR0_DO_GMM_RESET_SHARED_MODULES,
     /** Call GMMR0CheckSharedModules. */
     VMMR0_DO_GMM_CHECK_SHARED_MODULES,
+    /** Call GMMR0FusionScan. */
+    VMMR0_DO_GMM_FUSION_SCAN,
     /** Call GMMR0FindDuplicatePage. */
     VMMR0_DO_GMM_FIND_DUPLICATE_PAGE,
     /** Call GMMR0QueryStatistics(). */
@@ -26,6 +26,7 @@
 
 #include <VBox/vmm/pdmdev.h>
 #include <VBox/vmm/pdmnetifs.h>
+#include <VBox/vmm/pdmnetinline.h>
 #include <iprt/asm.h>
 #include <iprt/net.h>
 #include <iprt/semaphore.h>
@@ -48,7 +49,7 @@
 #ifdef IN_RING3
 
 #define VNET_PCI_CLASS               0x0200
-#define VNET_N_QUEUES                3
+#define VNET_N_QUEUES(cPairs)        (2 * (cPairs) + 1)
 #define VNET_NAME_FMT                "VNet%d"
 
 #if 0
@@ -63,10 +64,13 @@
 #endif /* VBOX_DEVICE_STRUCT_TESTCASE */
 
 
-#define VNET_TX_DELAY           150   /**< 150 microseconds */
 #define VNET_MAX_FRAME_SIZE     65535 + 18  /**< Max IP packet size + Ethernet header with VLAN tag */
 #define VNET_MAC_FILTER_LEN     32
 #define VNET_MAX_VID            (1 << 12)
+#define VNET_MAX_QUEUE_PAIRS    ((VIRTIO_MAX_NQUEUES - 1) / 2) /**< Upper limit for the 'QueuePairs' setting. */
+#define VNET_GRO_MAX_FRAME      65535       /**< Max size of a frame assembled by the RX coalescing stage. */
+#define VNET_GRO_MIN_RX_BUF     1514        /**< What we assume a mergeable RX buffer holds at the very least. */
+#define VNET_TX_DRV_BUSY_WAIT_MS 1          /**< How long a transmit worker waits for a busy driver before retrying. */
 
 /** @name Virtio net features
  * @{  */
@@ -87,6 +91,7 @@
 #define VNET_F_CTRL_VQ    0x00020000  /**< Control channel available */
 #define VNET_F_CTRL_RX    0x00040000  /**< Control channel RX mode support */
 #define VNET_F_CTRL_VLAN  0x00080000  /**< Control channel VLAN filtering */
+#define VNET_F_MQ         0x00400000  /**< Multiple RX/TX queue pairs, control channel steering */
 /** @} */
 
 #define VNET_S_LINK_UP    1
@@ -103,8 +108,102 @@ struct __attribute__ ((__packed__)) VNetPCIConfig /** @todo r=bird: Use #pragma
 {
     RTMAC    mac;
     uint16_t uStatus;
+    uint16_t uMaxVirtqueuePairs;
 };
 AssertCompileMemberOffset(struct VNetPCIConfig, uStatus, 6);
+AssertCompileMemberOffset(struct VNetPCIConfig, uMaxVirtqueuePairs, 8);
+
+/**
+ * RX/TX queue pair state.
+ *
+ * Each pair has its own connection to an attached network driver (LUN number
+ * equals the pair index) and its own transmit worker thread.  Pairs without a
+ * driver of their own transmit through the driver attached to pair 0.
+ *
+ * @implements  PDMIBASE
+ * @implements  PDMINETWORKDOWN
+ */
+typedef struct VNetQueuePair
+{
+    /** Pointer to the device state - R3. */
+    R3PTRTYPE(struct VNetState_st *) pThisR3;
+    /** The index of this pair (also the LUN of its network driver). */
+    uint32_t                iPair;
+    /** Indicates transmission in progress -- only one thread is allowed. */
+    uint32_t volatile       uIsTransmitting;
+
+    /** LUN base interface (pair 0 uses VPCISTATE::IBase instead). */
+    PDMIBASE                IBase;
+    /** The network port interface exposed to the driver of this pair. */
+    PDMINETWORKDOWN         INetworkDown;
+    /** Attached network driver. */
+    R3PTRTYPE(PPDMIBASE)    pDrvBase;
+    /** Connector of attached network driver. */
+    R3PTRTYPE(PPDMINETWORKUP) pDrv;
+
+    R3PTRTYPE(PVQUEUE)      pRxQueue;
+    R3PTRTYPE(PVQUEUE)      pTxQueue;
+
+    /** The transmit worker thread. */
+    R3PTRTYPE(PPDMTHREAD)   pTxThread;
+    /** Signalled by the queue notification to kick the transmit worker. */
+    RTSEMEVENT              hTxEvent;
+    /** Set when the transmit worker needs to run another round. */
+    bool volatile           fTxPending;
+    /** Set while the transmit worker is blocked on hTxEvent. */
+    bool volatile           fTxSleeping;
+    /** Set while the transmit worker is trying to get hold of a driver shared
+     * with other queue pairs, so they wake it up when done with it. */
+    bool volatile           fTxDrvWait;
+    /** RX thread of the driver is waiting for RX descriptors. */
+    bool volatile           fMaybeOutOfSpace;
+    bool                    afAlignment[4];
+    /** Gets signalled when more RX descriptors become available. */
+    RTSEMEVENT              hEventMoreRxDescAvail;
+    /** Serializes the drivers delivering into the RX queue of this pair. */
+    PDMCRITSECT             csRx;
+    /** Serializes the transmit worker against reset and saved state
+     * operations touching the TX queue of this pair.  Taken before csRx. */
+    PDMCRITSECT             csTx;
+
+    /** @name RX coalescing (GRO) state, protected by csRx.
+     * @{ */
+    /** The frame being assembled (VNET_GRO_MAX_FRAME bytes). */
+    R3PTRTYPE(uint8_t *)    pbGro;
+    /** Number of bytes held in pbGro, 0 if nothing is held. */
+    uint32_t                cbGro;
+    /** Number of TCP segments merged into pbGro. */
+    uint32_t                cGroSegs;
+    /** The TCP sequence number the next segment must have to be merged. */
+    uint32_t                uGroNextSeq;
+    /** Set if pbGro holds a frame that arrived when the RX queue was out of
+     * buffers, it is delivered as is and nothing is merged into it. */
+    bool                    fGroParked;
+    bool                    afGroAlignment[3];
+    /** The GSO context of the held frame, cbMaxSeg is the MSS.  For a parked
+     * frame this is the context it came with (u8Type is invalid if none). */
+    PDMNETWORKGSO           GroGso;
+    /** Delivers the held frame when no more segments arrive in time. */
+    PTMTIMERR3              pGroTimerR3;
+    /** @} */
+
+    /** Queue names for logging. */
+    char                    szRxName[8];
+    char                    szTxName[8];
+
+    /** @name Statistic
+     * @{ */
+    STAMCOUNTER             StatReceivePackets;
+    STAMCOUNTER             StatTransmitPackets;
+    STAMCOUNTER             StatTransmitWakeups;
+    STAMCOUNTER             StatTransmitBusy;
+    STAMCOUNTER             StatGroSegments;
+    STAMCOUNTER             StatGroFrames;
+    STAMCOUNTER             StatGroTimerFlushes;
+    /** @}  */
+} VNETQUEUEPAIR;
+/** Pointer to a RX/TX queue pair. */
+typedef VNETQUEUEPAIR *PVNETQUEUEPAIR;
 
 /**
  * Device state structure. Holds the current state of device.
@@ -118,12 +217,7 @@ typedef struct VNetState_st
     /* VPCISTATE must be the first member! */
     VPCISTATE               VPCI;
 
-//    PDMCRITSECT             csRx;                           /**< Protects RX queue. */
-
-    PDMINETWORKDOWN         INetworkDown;
     PDMINETWORKCONFIG       INetworkConfig;
-    R3PTRTYPE(PPDMIBASE)    pDrvBase;                 /**< Attached network driver. */
-    R3PTRTYPE(PPDMINETWORKUP) pDrv;    /**< Connector of attached network driver. */
 
     R3PTRTYPE(PPDMQUEUE)    pCanRxQueueR3;           /**< Rx wakeup signaller - R3. */
     R0PTRTYPE(PPDMQUEUE)    pCanRxQueueR0;           /**< Rx wakeup signaller - R0. */
@@ -135,27 +229,15 @@ typedef struct VNetState_st
     /**< Link Up(/Restore) Timer. */
     PTMTIMERR3              pLinkUpTimer;
 
-#ifdef VNET_TX_DELAY
-    /**< Transmit Delay Timer - R3. */
-    PTMTIMERR3              pTxTimerR3;
-    /**< Transmit Delay Timer - R0. */
-    PTMTIMERR0              pTxTimerR0;
-    /**< Transmit Delay Timer - GC. */
-    PTMTIMERRC              pTxTimerRC;
-
-# if HC_ARCH_BITS == 64
-    uint32_t                padding2;
-# endif
-
-    uint32_t                u32i;
-    uint32_t                u32AvgDiff;
-    uint32_t                u32MinDiff;
-    uint32_t                u32MaxDiff;
-    uint64_t                u64NanoTS;
-#endif /* VNET_TX_DELAY */
-
-    /** Indicates transmission in progress -- only one thread is allowed. */
-    uint32_t                uIsTransmitting;
+    /** Number of RX/TX queue pairs the device offers (the 'QueuePairs' setting). */
+    uint32_t                cMaxQueuePairs;
+    /** Number of RX/TX queue pairs enabled by the guest (VQ_PAIRS_SET). */
+    uint32_t volatile       cCurQueuePairs;
+    /** Whether to coalesce received TCP segments for TSO capable guests ('GRO'). */
+    bool                    fGro;
+    bool                    afGroAlignment[3];
+    /** How long a partially coalesced frame is held back, in microseconds ('GroFlushUs'). */
+    uint32_t                cUsGroFlush;
 
     /** PCI config area holding MAC address as well as TBD. */
     struct VNetPCIConfig    config;
@@ -171,9 +253,6 @@ typedef struct VNetState_st
     /** Number of packet being sent/received to show in debug log. */
     uint32_t                u32PktNo;
 
-    /** N/A: */
-    bool volatile           fMaybeOutOfSpace;
-
     /** Promiscuous mode -- RX filter accepts all packets. */
     bool                    fPromiscuous;
     /** AllMulti mode -- RX filter accepts all multicast packets. */
@@ -185,13 +264,10 @@ typedef struct VNetState_st
     /** Bit array of VLAN filter, one bit per VLAN ID. */
     uint8_t                 aVlanFilter[VNET_MAX_VID / sizeof(uint8_t)];
 
-    R3PTRTYPE(PVQUEUE)      pRxQueue;
-    R3PTRTYPE(PVQUEUE)      pTxQueue;
     R3PTRTYPE(PVQUEUE)      pCtlQueue;
-    /* Receive-blocking-related fields ***************************************/
 
-    /** EMT: Gets signalled when more RX descriptors become available. */
-    RTSEMEVENT              hEventMoreRxDescAvail;
+    /** The RX/TX queue pairs, cMaxQueuePairs of them are used. */
+    VNETQUEUEPAIR           aQueuePairs[VNET_MAX_QUEUE_PAIRS];
 
     /** @name Statistic
      * @{ */
@@ -263,6 +339,9 @@ typedef uint8_t VNETCTLACK;
 #define VNET_CTRL_CMD_VLAN_ADD         0
 #define VNET_CTRL_CMD_VLAN_DEL         1
 
+#define VNET_CTRL_CLS_MQ               4
+#define VNET_CTRL_CMD_MQ_VQ_PAIRS_SET  0
+
 
 struct VNetCtlHdr
 {
@@ -289,20 +368,143 @@ DECLINLINE(void) vnetCsLeave(PVNETSTATE pThis)
     vpciCsLeave(&pThis->VPCI);
 }
 
-DECLINLINE(int) vnetCsRxEnter(PVNETSTATE pThis, int rcBusy)
+#ifdef IN_RING3
+
+DECLINLINE(int) vnetCsRxEnter(PVNETQUEUEPAIR pPair, int rcBusy)
+{
+    return PDMCritSectEnter(&pPair->csRx, rcBusy);
+}
+
+DECLINLINE(void) vnetCsRxLeave(PVNETQUEUEPAIR pPair)
+{
+    PDMCritSectLeave(&pPair->csRx);
+}
+
+/**
+ * Enters the RX critical sections of all queue pairs, serializing against
+ * every driver that may be delivering packets.
+ *
+ * @returns VBox status code.
+ * @param   pThis      The device state structure.
+ * @param   rcBusy     Status code to return when a critical section is busy.
+ */
+static int vnetCsRxEnterAll(PVNETSTATE pThis, int rcBusy)
 {
-    // STAM_PROFILE_START(&pThis->CTXSUFF(StatCsRx), a);
-    // int rc = PDMCritSectEnter(&pThis->csRx, rcBusy);
-    // STAM_PROFILE_STOP(&pThis->CTXSUFF(StatCsRx), a);
-    // return rc;
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        int rc = vnetCsRxEnter(&pThis->aQueuePairs[i], rcBusy);
+        if (RT_UNLIKELY(rc != VINF_SUCCESS))
+        {
+            while (i-- > 0)
+                vnetCsRxLeave(&pThis->aQueuePairs[i]);
+            return rc;
+        }
+    }
     return VINF_SUCCESS;
 }
 
-DECLINLINE(void) vnetCsRxLeave(PVNETSTATE pThis)
+static void vnetCsRxLeaveAll(PVNETSTATE pThis)
 {
-    // PDMCritSectLeave(&pThis->csRx);
+    for (uint32_t i = pThis->cMaxQueuePairs; i-- > 0; )
+        vnetCsRxLeave(&pThis->aQueuePairs[i]);
 }
 
+/**
+ * Enters the TX critical sections of all queue pairs, waiting for the
+ * transmit workers to finish the round they are in.
+ *
+ * @returns VBox status code.
+ * @param   pThis      The device state structure.
+ * @param   rcBusy     Status code to return when a critical section is busy.
+ */
+static int vnetCsTxEnterAll(PVNETSTATE pThis, int rcBusy)
+{
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        int rc = PDMCritSectEnter(&pThis->aQueuePairs[i].csTx, rcBusy);
+        if (RT_UNLIKELY(rc != VINF_SUCCESS))
+        {
+            while (i-- > 0)
+                PDMCritSectLeave(&pThis->aQueuePairs[i].csTx);
+            return rc;
+        }
+    }
+    return VINF_SUCCESS;
+}
+
+static void vnetCsTxLeaveAll(PVNETSTATE pThis)
+{
+    for (uint32_t i = pThis->cMaxQueuePairs; i-- > 0; )
+        PDMCritSectLeave(&pThis->aQueuePairs[i].csTx);
+}
+
+/**
+ * Returns the driver connector a queue pair transmits through.
+ *
+ * @returns Pointer to the connector, NULL if no driver is attached at all.
+ * @param   pThis      The device state structure.
+ * @param   pPair      The queue pair.
+ */
+DECLINLINE(PPDMINETWORKUP) vnetQueuePairDrv(PVNETSTATE pThis, PVNETQUEUEPAIR pPair)
+{
+    return pPair->pDrv ? pPair->pDrv : pThis->aQueuePairs[0].pDrv;
+}
+
+/**
+ * Returns the queue pair that receives packets delivered by the driver
+ * attached to @a pPair, taking the number of pairs enabled by the guest into
+ * account.
+ *
+ * @param   pThis      The device state structure.
+ * @param   pPair      The queue pair the driver is attached to.
+ */
+DECLINLINE(PVNETQUEUEPAIR) vnetRxQueuePair(PVNETSTATE pThis, PVNETQUEUEPAIR pPair)
+{
+    uint32_t cCurQueuePairs = ASMAtomicReadU32(&pThis->cCurQueuePairs);
+    return &pThis->aQueuePairs[pPair->iPair < cCurQueuePairs ? pPair->iPair : pPair->iPair % cCurQueuePairs];
+}
+
+/**
+ * Maps a virtqueue of the device to the RX/TX pair it belongs to.
+ *
+ * @param   pThis      The device state structure.
+ * @param   pQueue     The RX or TX queue.
+ */
+DECLINLINE(PVNETQUEUEPAIR) vnetQueuePairFromQueue(PVNETSTATE pThis, PVQUEUE pQueue)
+{
+    uint32_t iQueue = (uint32_t)(pQueue - &pThis->VPCI.Queues[0]);
+    Assert(iQueue < 2 * pThis->cMaxQueuePairs);
+    return &pThis->aQueuePairs[iQueue / 2];
+}
+
+/**
+ * Calls pfnSetPromiscuousMode on every attached driver.
+ *
+ * @param   pThis          The device state structure.
+ * @param   fPromiscuous   The new mode.
+ */
+static void vnetDrvSetPromiscuousMode(PVNETSTATE pThis, bool fPromiscuous)
+{
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+        if (pThis->aQueuePairs[i].pDrv)
+            pThis->aQueuePairs[i].pDrv->pfnSetPromiscuousMode(pThis->aQueuePairs[i].pDrv, fPromiscuous);
+}
+
+/**
+ * Calls pfnNotifyLinkChanged on every attached driver.
+ *
+ * @param   pThis          The device state structure.
+ * @param   enmState       The new link state.
+ */
+static void vnetDrvNotifyLinkChanged(PVNETSTATE pThis, PDMNETWORKLINKSTATE enmState)
+{
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+        if (pThis->aQueuePairs[i].pDrv)
+            pThis->aQueuePairs[i].pDrv->pfnNotifyLinkChanged(pThis->aQueuePairs[i].pDrv, enmState);
+}
+
+#endif /* IN_RING3 */
+
 /**
  * Dump a packet to debug log.
  *
@@ -352,7 +554,8 @@ DECLINLINE(void) vnetPrintFeatures(PVNETSTATE pThis, uint32_t fFeatures, const c
         { VNET_F_STATUS,     "virtio_net_config.status available" },
         { VNET_F_CTRL_VQ,    "control channel available" },
         { VNET_F_CTRL_RX,    "control channel RX mode support" },
-        { VNET_F_CTRL_VLAN,  "control channel VLAN filtering" }
+        { VNET_F_CTRL_VLAN,  "control channel VLAN filtering" },
+        { VNET_F_MQ,         "multiple RX/TX queue pairs" }
     };
 
     Log3(("%s %s:\n", INSTANCE(pThis), pcszText));
@@ -366,6 +569,7 @@ DECLINLINE(void) vnetPrintFeatures(PVNETSTATE pThis, uint32_t fFeatures, const c
 
 static DECLCALLBACK(uint32_t) vnetIoCb_GetHostFeatures(void *pvState)
 {
+    PVNETSTATE pThis = (PVNETSTATE)pvState;
     /* We support:
      * - Host-provided MAC address
      * - Link status reporting in config space
@@ -373,8 +577,10 @@ static DECLCALLBACK(uint32_t) vnetIoCb_GetHostFeatures(void *pvState)
      * - RX mode setting
      * - MAC filter table
      * - VLAN filter
+     * - Multiple queue pairs (if configured)
      */
-    return VNET_F_MAC
+    return (pThis->cMaxQueuePairs > 1 ? VNET_F_MQ : 0)
+        | VNET_F_MAC
         | VNET_F_STATUS
         | VNET_F_CTRL_VQ
         | VNET_F_CTRL_RX
@@ -443,16 +649,42 @@ static DECLCALLBACK(int) vnetIoCb_SetConfig(void *pvState, uint32_t offCfg, uint
 static DECLCALLBACK(int) vnetIoCb_Reset(void *pvState)
 {
     PVNETSTATE pThis = (PVNETSTATE)pvState;
+#ifndef IN_RING3
+    /* The queue pairs are ring-3 only, do the whole thing there. */
+    NOREF(pThis);
+    return VINF_IOM_R3_IOPORT_WRITE;
+#else
     Log(("%s Reset triggered\n", INSTANCE(pThis)));
 
-    int rc = vnetCsRxEnter(pThis, VERR_SEM_BUSY);
+    /* The transmit workers must not be walking the TX queues we're about to clear. */
+    int rc = vnetCsTxEnterAll(pThis, VERR_SEM_BUSY);
     if (RT_UNLIKELY(rc != VINF_SUCCESS))
     {
+        LogRel(("vnetIoCb_Reset failed to enter TX critical section!\n"));
+        return rc;
+    }
+    rc = vnetCsRxEnterAll(pThis, VERR_SEM_BUSY);
+    if (RT_UNLIKELY(rc != VINF_SUCCESS))
+    {
+        vnetCsTxLeaveAll(pThis);
         LogRel(("vnetIoCb_Reset failed to enter RX critical section!\n"));
         return rc;
     }
     vpciReset(&pThis->VPCI);
-    vnetCsRxLeave(pThis);
+    ASMAtomicWriteU32(&pThis->cCurQueuePairs, 1);
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        /* Whatever was held back was meant for buffers the guest no longer owns. */
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        pPair->cbGro      = 0;
+        pPair->fGroParked = false;
+        if (pPair->pGroTimerR3)
+            TMTimerStop(pPair->pGroTimerR3);
+    }
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+        ASMAtomicWriteU32(&pThis->aQueuePairs[i].uIsTransmitting, 0);
+    vnetCsRxLeaveAll(pThis);
+    vnetCsTxLeaveAll(pThis);
 
     // TODO: Implement reset
     if (pThis->fCableConnected)
@@ -470,12 +702,7 @@ static DECLCALLBACK(int) vnetIoCb_Reset(void *pvState)
     pThis->nMacFilterEntries = 0;
     memset(pThis->aMacFilter,  0, VNET_MAC_FILTER_LEN * sizeof(RTMAC));
     memset(pThis->aVlanFilter, 0, sizeof(pThis->aVlanFilter));
-    pThis->uIsTransmitting   = 0;
-#ifndef IN_RING3
-    return VINF_IOM_R3_IOPORT_WRITE;
-#else
-    if (pThis->pDrv)
-        pThis->pDrv->pfnSetPromiscuousMode(pThis->pDrv, true);
+    vnetDrvSetPromiscuousMode(pThis, true);
     return VINF_SUCCESS;
 #endif
 }
@@ -483,17 +710,39 @@ static DECLCALLBACK(int) vnetIoCb_Reset(void *pvState)
 #ifdef IN_RING3
 
 /**
- * Wakeup the RX thread.
+ * Wakeup the RX threads of all drivers waiting for receive buffers.
  */
 static void vnetWakeupReceive(PPDMDEVINS pDevIns)
 {
     PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
-    if (    pThis->fMaybeOutOfSpace
-        &&  pThis->hEventMoreRxDescAvail != NIL_RTSEMEVENT)
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        if (    pPair->fMaybeOutOfSpace
+            &&  pPair->hEventMoreRxDescAvail != NIL_RTSEMEVENT)
+        {
+            STAM_COUNTER_INC(&pThis->StatRxOverflowWakeup);
+            Log(("%s Waking up Out-of-RX-space semaphore of pair %u\n",  INSTANCE(pThis), i));
+            RTSemEventSignal(pPair->hEventMoreRxDescAvail);
+        }
+    }
+}
+
+
+/**
+ * Kicks the transmit worker thread of a queue pair.
+ *
+ * @param   pPair      The queue pair.
+ */
+static void vnetWakeupTransmit(PVNETQUEUEPAIR pPair)
+{
+    ASMAtomicWriteBool(&pPair->fTxPending, true);
+    if (   ASMAtomicReadBool(&pPair->fTxSleeping)
+        && pPair->hTxEvent != NIL_RTSEMEVENT)
     {
-        STAM_COUNTER_INC(&pThis->StatRxOverflowWakeup);
-        Log(("%s Waking up Out-of-RX-space semaphore\n",  INSTANCE(pThis)));
-        RTSemEventSignal(pThis->hEventMoreRxDescAvail);
+        STAM_REL_COUNTER_INC(&pPair->StatTransmitWakeups);
+        int rc = RTSemEventSignal(pPair->hTxEvent);
+        AssertRC(rc);
     }
 }
 
@@ -538,8 +787,7 @@ static DECLCALLBACK(void) vnetLinkUpTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, v
     vnetWakeupReceive(pDevIns);
     vnetCsLeave(pThis);
     Log(("%s vnetLinkUpTimer: Link is up\n", INSTANCE(pThis)));
-    if (pThis->pDrv)
-        pThis->pDrv->pfnNotifyLinkChanged(pThis->pDrv, PDMNETWORKLINKSTATE_UP);
+    vnetDrvNotifyLinkChanged(pThis, PDMNETWORKLINKSTATE_UP);
 }
 
 
@@ -617,32 +865,51 @@ PDMBOTHCBDECL(int) vnetIOPortOut(PPDMDEVINS pDevIns, void *pvUser, RTIOPORT port
  *          It disables notification if it can receive.
  *
  * @returns VERR_NET_NO_BUFFER_SPACE if it cannot.
- * @param   pInterface      Pointer to the interface structure containing the called function pointer.
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair to receive into, the caller owns
+ *                          its RX critical section.
  * @thread  RX
  */
-static int vnetCanReceive(PVNETSTATE pThis)
+static int vnetCanReceive(PVNETSTATE pThis, PVNETQUEUEPAIR pPair)
 {
-    int rc = vnetCsRxEnter(pThis, VERR_SEM_BUSY);
-    AssertRCReturn(rc, rc);
+    int rc;
 
-    LogFlow(("%s vnetCanReceive\n", INSTANCE(pThis)));
+    LogFlow(("%s vnetCanReceive: pair=%u\n", INSTANCE(pThis), pPair->iPair));
     if (!(pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK))
         rc = VERR_NET_NO_BUFFER_SPACE;
-    else if (!vqueueIsReady(&pThis->VPCI, pThis->pRxQueue))
+    else if (!vqueueIsReady(&pThis->VPCI, pPair->pRxQueue))
         rc = VERR_NET_NO_BUFFER_SPACE;
-    else if (vqueueIsEmpty(&pThis->VPCI, pThis->pRxQueue))
+    else if (vqueueIsEmpty(&pThis->VPCI, pPair->pRxQueue))
     {
-        vringSetNotification(&pThis->VPCI, &pThis->pRxQueue->VRing, true);
+        vringSetNotification(&pThis->VPCI, &pPair->pRxQueue->VRing, true);
         rc = VERR_NET_NO_BUFFER_SPACE;
     }
     else
     {
-        vringSetNotification(&pThis->VPCI, &pThis->pRxQueue->VRing, false);
+        vringSetNotification(&pThis->VPCI, &pPair->pRxQueue->VRing, false);
         rc = VINF_SUCCESS;
     }
 
     LogFlow(("%s vnetCanReceive -> %Rrc\n", INSTANCE(pThis), rc));
-    vnetCsRxLeave(pThis);
+    return rc;
+}
+
+/**
+ * Locked version of vnetCanReceive for the queue pair the driver attached to
+ * @a pDrvPair currently delivers to.
+ *
+ * @returns VERR_NET_NO_BUFFER_SPACE if it cannot.
+ * @param   pThis           The device state structure.
+ * @param   pDrvPair        The queue pair of the calling driver.
+ * @thread  RX
+ */
+static int vnetCanReceiveLocked(PVNETSTATE pThis, PVNETQUEUEPAIR pDrvPair)
+{
+    PVNETQUEUEPAIR pPair = vnetRxQueuePair(pThis, pDrvPair);
+    int rc = vnetCsRxEnter(pPair, VERR_SEM_BUSY);
+    AssertRCReturn(rc, rc);
+    rc = vnetCanReceive(pThis, pPair);
+    vnetCsRxLeave(pPair);
     return rc;
 }
 
@@ -651,9 +918,10 @@ static int vnetCanReceive(PVNETSTATE pThis)
  */
 static DECLCALLBACK(int) vnetNetworkDown_WaitReceiveAvail(PPDMINETWORKDOWN pInterface, RTMSINTERVAL cMillies)
 {
-    PVNETSTATE pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
+    PVNETQUEUEPAIR pDrvPair = RT_FROM_MEMBER(pInterface, VNETQUEUEPAIR, INetworkDown);
+    PVNETSTATE     pThis    = pDrvPair->pThisR3;
     LogFlow(("%s vnetNetworkDown_WaitReceiveAvail(cMillies=%u)\n", INSTANCE(pThis), cMillies));
-    int rc = vnetCanReceive(pThis);
+    int rc = vnetCanReceiveLocked(pThis, pDrvPair);
 
     if (RT_SUCCESS(rc))
         return VINF_SUCCESS;
@@ -661,24 +929,24 @@ static DECLCALLBACK(int) vnetNetworkDown_WaitReceiveAvail(PPDMINETWORKDOWN pInte
         return VERR_NET_NO_BUFFER_SPACE;
 
     rc = VERR_INTERRUPTED;
-    ASMAtomicXchgBool(&pThis->fMaybeOutOfSpace, true);
+    ASMAtomicXchgBool(&pDrvPair->fMaybeOutOfSpace, true);
     STAM_PROFILE_START(&pThis->StatRxOverflow, a);
 
     VMSTATE enmVMState;
     while (RT_LIKELY(   (enmVMState = PDMDevHlpVMState(pThis->VPCI.CTX_SUFF(pDevIns))) == VMSTATE_RUNNING
                      ||  enmVMState == VMSTATE_RUNNING_LS))
     {
-        int rc2 = vnetCanReceive(pThis);
+        int rc2 = vnetCanReceiveLocked(pThis, pDrvPair);
         if (RT_SUCCESS(rc2))
         {
             rc = VINF_SUCCESS;
             break;
         }
         Log(("%s vnetNetworkDown_WaitReceiveAvail: waiting cMillies=%u...\n", INSTANCE(pThis), cMillies));
-        RTSemEventWait(pThis->hEventMoreRxDescAvail, cMillies);
+        RTSemEventWait(pDrvPair->hEventMoreRxDescAvail, cMillies);
     }
     STAM_PROFILE_STOP(&pThis->StatRxOverflow, a);
-    ASMAtomicXchgBool(&pThis->fMaybeOutOfSpace, false);
+    ASMAtomicXchgBool(&pDrvPair->fMaybeOutOfSpace, false);
 
     LogFlow(("%s vnetNetworkDown_WaitReceiveAvail -> %d\n", INSTANCE(pThis), rc));
     return rc;
@@ -693,11 +961,26 @@ static DECLCALLBACK(void *) vnetQueryInterface(struct PDMIBASE *pInterface, cons
     PVNETSTATE pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, VPCI.IBase);
     Assert(&pThis->VPCI.IBase == pInterface);
 
-    PDMIBASE_RETURN_INTERFACE(pszIID, PDMINETWORKDOWN, &pThis->INetworkDown);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMINETWORKDOWN, &pThis->aQueuePairs[0].INetworkDown);
     PDMIBASE_RETURN_INTERFACE(pszIID, PDMINETWORKCONFIG, &pThis->INetworkConfig);
     return vpciQueryInterface(pInterface, pszIID);
 }
 
+
+/**
+ * @interface_method_impl{PDMIBASE,pfnQueryInterface,
+ *      For the LUNs of queue pairs other than the first one.}
+ */
+static DECLCALLBACK(void *) vnetQueuePairQueryInterface(struct PDMIBASE *pInterface, const char *pszIID)
+{
+    PVNETQUEUEPAIR pPair = RT_FROM_MEMBER(pInterface, VNETQUEUEPAIR, IBase);
+
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMIBASE, &pPair->IBase);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMINETWORKDOWN, &pPair->INetworkDown);
+    PDMIBASE_RETURN_INTERFACE(pszIID, PDMINETWORKCONFIG, &pPair->pThisR3->INetworkConfig);
+    return NULL;
+}
+
 /**
  * Returns true if it is a broadcast packet.
  *
@@ -773,11 +1056,13 @@ static bool vnetAddressFilter(PVNETSTATE pThis, const void *pvBuf, size_t cb)
  *
  * @returns VBox status code.
  * @param   pThis          The device state structure.
+ * @param   pPair          The queue pair to store the packet in, the caller
+ *                         owns its RX critical section.
  * @param   pvBuf           The available data.
  * @param   cb              Number of bytes available in the buffer.
  * @thread  RX
  */
-static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
+static int vnetHandleRxPacket(PVNETSTATE pThis, PVNETQUEUEPAIR pPair, const void *pvBuf, size_t cb,
                               PCPDMNETWORKGSO pGso)
 {
     VNETHDRMRX   Hdr;
@@ -831,7 +1116,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
         VQUEUEELEM elem;
         unsigned int nSeg = 0, uElemSize = 0, cbReserved = 0;
 
-        if (!vqueueGet(&pThis->VPCI, pThis->pRxQueue, &elem))
+        if (!vqueueGet(&pThis->VPCI, pPair->pRxQueue, &elem))
         {
             /*
              * @todo: It is possible to run out of RX buffers if only a few
@@ -875,7 +1160,7 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
             uElemSize += uSize;
         }
         STAM_PROFILE_START(&pThis->StatReceiveStore, a);
-        vqueuePut(&pThis->VPCI, pThis->pRxQueue, &elem, uElemSize, cbReserved);
+        vqueuePut(&pThis->VPCI, pPair->pRxQueue, &elem, uElemSize, cbReserved);
         STAM_PROFILE_STOP(&pThis->StatReceiveStore, a);
         if (!vnetMergeableRxBuffers(pThis))
             break;
@@ -892,7 +1177,8 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
             return rc;
         }
     }
-    vqueueSync(&pThis->VPCI, pThis->pRxQueue);
+    vqueueSync(&pThis->VPCI, pPair->pRxQueue);
+    STAM_REL_COUNTER_INC(&pPair->StatReceivePackets);
     if (uOffset < cb)
     {
         Log(("%s vnetHandleRxPacket: Packet did not fit into RX queue (packet size=%u)!\n", INSTANCE(pThis), cb));
@@ -902,6 +1188,367 @@ static int vnetHandleRxPacket(PVNETSTATE pThis, const void *pvBuf, size_t cb,
     return VINF_SUCCESS;
 }
 
+/**
+ * Checks whether a received frame is a TCP segment the RX coalescing stage
+ * can merge.
+ *
+ * Only untagged, unfragmented TCP segments without IP options which carry
+ * payload and nothing but ACK (and optionally PSH) qualify.  The checksums are
+ * verified since the guest will not do that for a coalesced frame.
+ *
+ * @returns The GSO type of the resulting frame, PDMNETWORKGSOTYPE_INVALID if
+ *          the frame cannot be merged.
+ * @param   pThis           The device state structure.
+ * @param   pbFrame         The frame.
+ * @param   cbFrame         The size of the frame.
+ * @param   poffTcp         Where to return the offset of the TCP header.
+ * @param   pcbHdrs         Where to return the size of all headers.
+ */
+static PDMNETWORKGSOTYPE vnetGroParseFrame(PVNETSTATE pThis, const uint8_t *pbFrame, size_t cbFrame,
+                                           uint32_t *poffTcp, uint32_t *pcbHdrs)
+{
+    PDMNETWORKGSOTYPE enmType;
+    uint32_t          offTcp;
+    PCRTNETTCP        pTcp;
+
+    if (   cbFrame > VNET_GRO_MAX_FRAME
+        || cbFrame < sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN + RTNETTCP_MIN_LEN)
+        return PDMNETWORKGSOTYPE_INVALID;
+
+    uint16_t const uEtherType = RT_MAKE_U16(pbFrame[13], pbFrame[12]);
+    if (   uEtherType == RTNET_ETHERTYPE_IPV4
+        && (pThis->VPCI.uGuestFeatures & VNET_F_GUEST_TSO4))
+    {
+        PCRTNETIPV4 pIp = (PCRTNETIPV4)(pbFrame + sizeof(RTNETETHERHDR));
+        offTcp = sizeof(RTNETETHERHDR) + RTNETIPV4_MIN_LEN;
+        if (   pIp->ip_v != 4
+            || pIp->ip_hl != RTNETIPV4_MIN_LEN / 4
+            || pIp->ip_p  != RTNETIPV4_PROT_TCP
+            || (RT_N2H_U16(pIp->ip_off) & ~RTNETIPV4_FLAGS_DF)
+            || sizeof(RTNETETHERHDR) + RT_N2H_U16(pIp->ip_len) != cbFrame)
+            return PDMNETWORKGSOTYPE_INVALID;
+        pTcp = (PCRTNETTCP)(pbFrame + offTcp);
+        size_t const cbTcp = cbFrame - offTcp;
+        if (   !RTNetIPv4IsHdrValid(pIp, RTNETIPV4_MIN_LEN, RTNETIPV4_MIN_LEN + cbTcp, true /*fChecksum*/)
+            || !RTNetIPv4IsTCPValid(pIp, pTcp, cbTcp, pTcp, cbTcp, true /*fChecksum*/))
+            return PDMNETWORKGSOTYPE_INVALID;
+        enmType = PDMNETWORKGSOTYPE_IPV4_TCP;
+    }
+    else if (   uEtherType == RTNET_ETHERTYPE_IPV6
+             && (pThis->VPCI.uGuestFeatures & VNET_F_GUEST_TSO6))
+    {
+        PCRTNETIPV6 pIp6 = (PCRTNETIPV6)(pbFrame + sizeof(RTNETETHERHDR));
+        offTcp = sizeof(RTNETETHERHDR) + RTNETIPV6_MIN_LEN;
+        if (   cbFrame < offTcp + RTNETTCP_MIN_LEN
+            || (pbFrame[sizeof(RTNETETHERHDR)] >> 4) != 6
+            || pIp6->ip6_nxt != RTNETIPV4_PROT_TCP
+            || offTcp + RT_N2H_U16(pIp6->ip6_plen) != cbFrame)
+            return PDMNETWORKGSOTYPE_INVALID;
+        pTcp = (PCRTNETTCP)(pbFrame + offTcp);
+        uint32_t const cbTcpHdr = pTcp->th_off * 4;
+        if (   cbTcpHdr < RTNETTCP_MIN_LEN
+            || offTcp + cbTcpHdr > cbFrame
+            || RTNetTCPChecksum(RTNetIPv6PseudoChecksum(pIp6), pTcp, (const uint8_t *)pTcp + cbTcpHdr,
+                                cbFrame - offTcp - cbTcpHdr) != pTcp->th_sum)
+            return PDMNETWORKGSOTYPE_INVALID;
+        enmType = PDMNETWORKGSOTYPE_IPV6_TCP;
+    }
+    else
+        return PDMNETWORKGSOTYPE_INVALID;
+
+    /* A plain data segment (the TCP header size was checked above). */
+    uint32_t const cbHdrs = offTcp + pTcp->th_off * 4;
+    if (   (pTcp->th_flags & ~RTNETTCP_F_PSH) != RTNETTCP_F_ACK
+        || cbHdrs >= cbFrame)
+        return PDMNETWORKGSOTYPE_INVALID;
+
+    *poffTcp = offTcp;
+    *pcbHdrs = cbHdrs;
+    return enmType;
+}
+
+/**
+ * Checks whether a segment, already vetted by vnetGroParseFrame, continues
+ * the frame held by the queue pair.
+ *
+ * @returns true if it can be appended, false if the held frame must be
+ *          delivered first.
+ * @param   pPair           The queue pair, the caller owns its RX critical section.
+ * @param   enmType         The GSO type returned by vnetGroParseFrame.
+ * @param   pbFrame         The segment.
+ * @param   cbFrame         The size of the segment.
+ * @param   cbHdrs          The size of the segment headers.
+ */
+static bool vnetGroCanAppend(PVNETQUEUEPAIR pPair, PDMNETWORKGSOTYPE enmType,
+                             const uint8_t *pbFrame, size_t cbFrame, uint32_t cbHdrs)
+{
+    const uint8_t *pbHeld  = pPair->pbGro;
+    uint32_t const offTcp  = pPair->GroGso.offHdr2;
+    uint32_t const cbPayload = (uint32_t)cbFrame - cbHdrs;
+
+    if (   enmType        != (PDMNETWORKGSOTYPE)pPair->GroGso.u8Type
+        || cbHdrs         != pPair->GroGso.cbHdrsTotal
+        || cbPayload      >  pPair->GroGso.cbMaxSeg
+        || pPair->cbGro + cbPayload > VNET_GRO_MAX_FRAME
+        || memcmp(pbHeld, pbFrame, sizeof(RTNETETHERHDR)))
+        return false;
+
+    /* The network header must only differ in the fields changing per segment. */
+    if (enmType == PDMNETWORKGSOTYPE_IPV4_TCP)
+    {
+        PCRTNETIPV4 pIpHeld = (PCRTNETIPV4)(pbHeld  + sizeof(RTNETETHERHDR));
+        PCRTNETIPV4 pIp     = (PCRTNETIPV4)(pbFrame + sizeof(RTNETETHERHDR));
+        if (   pIp->ip_tos         != pIpHeld->ip_tos
+            || pIp->ip_off         != pIpHeld->ip_off
+            || pIp->ip_ttl         != pIpHeld->ip_ttl
+            || pIp->ip_src.u       != pIpHeld->ip_src.u
+            || pIp->ip_dst.u       != pIpHeld->ip_dst.u)
+            return false;
+    }
+    else
+    {
+        /* Version, traffic class, flow label, next header, hop limit and addresses. */
+        PCRTNETIPV6 pIp6Held = (PCRTNETIPV6)(pbHeld  + sizeof(RTNETETHERHDR));
+        PCRTNETIPV6 pIp6     = (PCRTNETIPV6)(pbFrame + sizeof(RTNETETHERHDR));
+        if (   pIp6->ip6_vfc  != pIp6Held->ip6_vfc
+            || pIp6->ip6_hlim != pIp6Held->ip6_hlim
+            || memcmp(&pIp6->ip6_src, &pIp6Held->ip6_src, 2 * sizeof(RTNETADDRIPV6)))
+            return false;
+    }
+
+    /* Same connection, in sequence, same ACK state and byte identical options. */
+    PCRTNETTCP pTcpHeld = (PCRTNETTCP)(pbHeld  + offTcp);
+    PCRTNETTCP pTcp     = (PCRTNETTCP)(pbFrame + offTcp);
+    return pTcp->th_sport == pTcpHeld->th_sport
+        && pTcp->th_dport == pTcpHeld->th_dport
+        && RT_N2H_U32(pTcp->th_seq) == pPair->uGroNextSeq
+        && pTcp->th_ack   == pTcpHeld->th_ack
+        && pTcp->th_win   == pTcpHeld->th_win
+        && !memcmp(pTcp + 1, pTcpHeld + 1, cbHdrs - offTcp - RTNETTCP_MIN_LEN);
+}
+
+/**
+ * Delivers the frame held by the RX coalescing stage of a queue pair.
+ *
+ * A single segment is passed on untouched, several are handed to the guest
+ * as one GSO frame.  The caller must have made sure there is room in the RX
+ * queue.
+ *
+ * @returns VBox status code.
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair, the caller owns its RX critical section.
+ * @thread  RX, EMT
+ */
+static int vnetGroFlush(PVNETSTATE pThis, PVNETQUEUEPAIR pPair)
+{
+    uint32_t const cbFrame = pPair->cbGro;
+    if (!cbFrame)
+        return VINF_SUCCESS;
+    pPair->cbGro = 0;
+    TMTimerStop(pPair->pGroTimerR3);
+
+    if (pPair->fGroParked)
+    {
+        pPair->fGroParked = false;
+        return vnetHandleRxPacket(pThis, pPair, pPair->pbGro, cbFrame,
+                                  pPair->GroGso.u8Type != PDMNETWORKGSOTYPE_INVALID ? &pPair->GroGso : NULL);
+    }
+    if (pPair->cGroSegs == 1)
+        return vnetHandleRxPacket(pThis, pPair, pPair->pbGro, cbFrame, NULL);
+
+    Log2(("%s vnetGroFlush: pair=%u %u segments, %u bytes\n", INSTANCE(pThis), pPair->iPair, pPair->cGroSegs, cbFrame));
+    STAM_REL_COUNTER_INC(&pPair->StatGroFrames);
+    /* Fixes up the IP length (and checksum) and leaves the TCP pseudo header checksum as the guest expects. */
+    PDMNetGsoPrepForDirectUse(&pPair->GroGso, pPair->pbGro, cbFrame, PDMNETCSUMTYPE_PSEUDO);
+    return vnetHandleRxPacket(pThis, pPair, pPair->pbGro, cbFrame, &pPair->GroGso);
+}
+
+/**
+ * Returns how large the held frame of a queue pair may grow before it no
+ * longer fits into the RX buffers the guest has posted.
+ *
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair, the caller owns its RX critical section.
+ */
+static uint32_t vnetGroMaxFrame(PVNETSTATE pThis, PVNETQUEUEPAIR pPair)
+{
+    if (!vnetMergeableRxBuffers(pThis))
+        return VNET_GRO_MAX_FRAME; /* The guest posts buffers large enough for a full TSO frame. */
+    uint16_t const cAvail = vringReadAvailIndex(&pThis->VPCI, &pPair->pRxQueue->VRing) - pPair->pRxQueue->uNextAvailIndex;
+    return RT_MIN((uint32_t)cAvail * VNET_GRO_MIN_RX_BUF, VNET_GRO_MAX_FRAME);
+}
+
+/**
+ * Holds on to a frame that cannot be delivered because the held frame that
+ * had to go first took the last RX buffers.  The flush timer delivers it once
+ * the guest has posted more.
+ *
+ * @returns VBox status code.
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair, the caller owns its RX critical
+ *                          section and has just flushed the held frame.
+ * @param   pvBuf           The frame.
+ * @param   cb              The size of the frame.
+ * @param   pGso            The GSO context of the frame, NULL if none.
+ * @thread  RX
+ */
+static int vnetGroPark(PVNETSTATE pThis, PVNETQUEUEPAIR pPair, const void *pvBuf, size_t cb, PCPDMNETWORKGSO pGso)
+{
+    Assert(!pPair->cbGro);
+    if (cb > VNET_GRO_MAX_FRAME)
+    {
+        Log(("%s vnetGroPark: No room left after flushing and %u bytes are too much to hold\n", INSTANCE(pThis), cb));
+        return VERR_NET_NO_BUFFER_SPACE;
+    }
+
+    memcpy(pPair->pbGro, pvBuf, cb);
+    pPair->cbGro      = (uint32_t)cb;
+    pPair->cGroSegs   = 1;
+    pPair->fGroParked = true;
+    if (pGso)
+        pPair->GroGso = *pGso;
+    else
+        pPair->GroGso.u8Type = PDMNETWORKGSOTYPE_INVALID;
+    TMTimerSetMicro(pPair->pGroTimerR3, pThis->cUsGroFlush);
+    return VINF_SUCCESS;
+}
+
+/**
+ * Passes a received frame through the RX coalescing stage.
+ *
+ * In-order TCP segments of the same connection are collected and handed to
+ * the guest as one GSO frame when the sender pushes, a short segment arrives,
+ * the frame is full, something else arrives or the flush timer fires.
+ * Everything else flushes the held frame and is delivered as is, so the
+ * frame order is never changed.
+ *
+ * @returns VBox status code.
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair, the caller owns its RX critical
+ *                          section and has checked that there is room.
+ * @param   pvBuf           The frame.
+ * @param   cb              The size of the frame.
+ * @param   pGso            The GSO context of the frame, NULL if none.
+ * @thread  RX
+ */
+static int vnetGroReceive(PVNETSTATE pThis, PVNETQUEUEPAIR pPair, const void *pvBuf, size_t cb, PCPDMNETWORKGSO pGso)
+{
+    const uint8_t    *pbFrame = (const uint8_t *)pvBuf;
+    uint32_t          offTcp  = 0;
+    uint32_t          cbHdrs  = 0;
+    PDMNETWORKGSOTYPE enmType = pGso ? PDMNETWORKGSOTYPE_INVALID : vnetGroParseFrame(pThis, pbFrame, cb, &offTcp, &cbHdrs);
+    bool              fRoom   = true;
+
+    if (   pPair->cbGro
+        && (   enmType == PDMNETWORKGSOTYPE_INVALID
+            || pPair->fGroParked
+            || !vnetGroCanAppend(pPair, enmType, pbFrame, cb, cbHdrs)))
+    {
+        int rc = vnetGroFlush(pThis, pPair);
+        if (RT_FAILURE(rc))
+            return rc;
+        if (RT_FAILURE(vnetCanReceive(pThis, pPair)))
+        {
+            /* The held frame took the last buffers.  Hold this one back too, a
+               segment that starts a new frame needs no buffers until it is flushed. */
+            if (enmType == PDMNETWORKGSOTYPE_INVALID)
+                return vnetGroPark(pThis, pPair, pvBuf, cb, pGso);
+            fRoom = false;
+        }
+    }
+
+    if (enmType == PDMNETWORKGSOTYPE_INVALID)
+        return vnetHandleRxPacket(pThis, pPair, pvBuf, cb, pGso);
+
+    PCRTNETTCP     pTcp      = (PCRTNETTCP)(pbFrame + offTcp);
+    uint32_t const cbPayload = (uint32_t)cb - cbHdrs;
+    if (!pPair->cbGro)
+    {
+        memcpy(pPair->pbGro, pbFrame, cb);
+        pPair->cbGro              = (uint32_t)cb;
+        pPair->cGroSegs           = 1;
+        pPair->GroGso.u8Type      = (uint8_t)enmType;
+        pPair->GroGso.cbHdrsTotal = (uint8_t)cbHdrs;
+        pPair->GroGso.cbHdrsSeg   = (uint8_t)cbHdrs;
+        pPair->GroGso.cbMaxSeg    = (uint16_t)cbPayload;
+        pPair->GroGso.offHdr1     = sizeof(RTNETETHERHDR);
+        pPair->GroGso.offHdr2     = (uint8_t)offTcp;
+        pPair->GroGso.u8Unused    = 0;
+        TMTimerSetMicro(pPair->pGroTimerR3, pThis->cUsGroFlush);
+    }
+    else
+    {
+        memcpy(pPair->pbGro + pPair->cbGro, pbFrame + cbHdrs, cbPayload);
+        pPair->cbGro += cbPayload;
+        pPair->cGroSegs++;
+        ((PRTNETTCP)(pPair->pbGro + offTcp))->th_flags |= pTcp->th_flags;
+        STAM_REL_COUNTER_INC(&pPair->StatGroSegments);
+    }
+    pPair->uGroNextSeq = RT_N2H_U32(pTcp->th_seq) + cbPayload;
+
+    /* The end of a burst or no room for another full sized segment.  Without
+       any RX buffers the flush timer delivers it once the guest posts some. */
+    if (   fRoom
+        && (   (pTcp->th_flags & RTNETTCP_F_PSH)
+            || cbPayload < pPair->GroGso.cbMaxSeg
+            || pPair->cbGro + pPair->GroGso.cbMaxSeg > vnetGroMaxFrame(pThis, pPair)))
+        return vnetGroFlush(pThis, pPair);
+    return VINF_SUCCESS;
+}
+
+/**
+ * @callback_method_impl{FNTMTIMERDEV, Delivers a frame the RX coalescing stage
+ *                      held back for too long.}
+ */
+static DECLCALLBACK(void) vnetGroFlushTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, void *pvUser)
+{
+    PVNETQUEUEPAIR pPair = (PVNETQUEUEPAIR)pvUser;
+    PVNETSTATE     pThis = pPair->pThisR3;
+    NOREF(pDevIns);
+
+    int rc = vnetCsRxEnter(pPair, VERR_SEM_BUSY);
+    if (RT_UNLIKELY(rc != VINF_SUCCESS))
+        return;
+    if (pPair->cbGro)
+    {
+        if (RT_SUCCESS(vnetCanReceive(pThis, pPair)))
+        {
+            STAM_REL_COUNTER_INC(&pPair->StatGroTimerFlushes);
+            vnetGroFlush(pThis, pPair);
+        }
+        else /* Try again once the guest has posted buffers. */
+            TMTimerSetMicro(pTimer, pThis->cUsGroFlush);
+    }
+    vnetCsRxLeave(pPair);
+}
+
+/**
+ * Delivers the frames held by the RX coalescing stage of all queue pairs, as
+ * far as the guest has posted buffers for them.
+ *
+ * Used when the VM stops running, whatever remains held is saved with the
+ * device state.
+ *
+ * @param   pThis           The device state structure.
+ * @thread  EMT
+ */
+static void vnetGroFlushAll(PVNETSTATE pThis)
+{
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        if (!pPair->pbGro)
+            continue;
+        int rc = vnetCsRxEnter(pPair, VERR_SEM_BUSY);
+        if (RT_UNLIKELY(rc != VINF_SUCCESS))
+            continue;
+        if (   pPair->cbGro
+            && RT_SUCCESS(vnetCanReceive(pThis, pPair)))
+            vnetGroFlush(pThis, pPair);
+        vnetCsRxLeave(pPair);
+    }
+}
+
 /**
  * @interface_method_impl{PDMINETWORKDOWN,pfnReceiveGso}
  */
@@ -909,7 +1556,8 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
                                                     const void *pvBuf, size_t cb,
                                                     PCPDMNETWORKGSO pGso)
 {
-    PVNETSTATE pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
+    PVNETQUEUEPAIR pDrvPair = RT_FROM_MEMBER(pInterface, VNETQUEUEPAIR, INetworkDown);
+    PVNETSTATE     pThis    = pDrvPair->pThisR3;
 
     if (pGso)
     {
@@ -939,7 +1587,7 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
     }
 
     Log2(("%s vnetNetworkDown_ReceiveGso: pvBuf=%p cb=%u pGso=%p\n", INSTANCE(pThis), pvBuf, cb, pGso));
-    int rc = vnetCanReceive(pThis);
+    int rc = vnetCanReceiveLocked(pThis, pDrvPair);
     if (RT_FAILURE(rc))
         return rc;
 
@@ -954,12 +1602,22 @@ static DECLCALLBACK(int) vnetNetworkDown_ReceiveGso(PPDMINETWORKDOWN pInterface,
     vpciSetReadLed(&pThis->VPCI, true);
     if (vnetAddressFilter(pThis, pvBuf, cb))
     {
-        rc = vnetCsRxEnter(pThis, VERR_SEM_BUSY);
+        PVNETQUEUEPAIR pPair = vnetRxQueuePair(pThis, pDrvPair);
+        rc = vnetCsRxEnter(pPair, VERR_SEM_BUSY);
         if (RT_SUCCESS(rc))
         {
-            rc = vnetHandleRxPacket(pThis, pvBuf, cb, pGso);
-            STAM_REL_COUNTER_ADD(&pThis->StatReceiveBytes, cb);
-            vnetCsRxLeave(pThis);
+            /* Another driver sharing this queue pair may have used up the buffers. */
+            rc = vnetCanReceive(pThis, pPair);
+            if (RT_SUCCESS(rc))
+            {
+                if (   pThis->fGro
+                    && (pThis->VPCI.uGuestFeatures & (VNET_F_GUEST_TSO4 | VNET_F_GUEST_TSO6)))
+                    rc = vnetGroReceive(pThis, pPair, pvBuf, cb, pGso);
+                else
+                    rc = vnetHandleRxPacket(pThis, pPair, pvBuf, cb, pGso);
+                STAM_REL_COUNTER_ADD(&pThis->StatReceiveBytes, cb);
+            }
+            vnetCsRxLeave(pPair);
         }
     }
     vpciSetReadLed(&pThis->VPCI, false);
@@ -1029,8 +1687,7 @@ static DECLCALLBACK(int) vnetSetLinkState(PPDMINETWORKCONFIG pInterface, PDMNETW
              * notification will be sent when the link actually goes up in vnetLinkUpTimer().
              */
             vnetTempLinkDown(pThis);
-            if (pThis->pDrv)
-                pThis->pDrv->pfnNotifyLinkChanged(pThis->pDrv, enmState);
+            vnetDrvNotifyLinkChanged(pThis, enmState);
         }
     }
     else if (fNewUp != fOldUp)
@@ -1049,8 +1706,7 @@ static DECLCALLBACK(int) vnetSetLinkState(PPDMINETWORKCONFIG pInterface, PDMNETW
             STATUS &= ~VNET_S_LINK_UP;
             vpciRaiseInterrupt(&pThis->VPCI, VERR_SEM_BUSY, VPCI_ISR_CONFIG);
         }
-        if (pThis->pDrv)
-            pThis->pDrv->pfnNotifyLinkChanged(pThis->pDrv, enmState);
+        vnetDrvNotifyLinkChanged(pThis, enmState);
     }
     return VINF_SUCCESS;
 }
@@ -1129,32 +1785,50 @@ DECLINLINE(void) vnetCompleteChecksum(uint8_t *pBuf, unsigned cbSize, uint16_t u
     *(uint16_t*)(pBuf + uStart + uOffset) = vnetCSum16(pBuf + uStart, cbSize - uStart);
 }
 
-static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fOnWorkerThread)
+/**
+ * Transmits the packets pending in the TX queue of a queue pair.
+ *
+ * @returns VERR_TRY_AGAIN if the driver is busy transmitting on behalf of
+ *          another queue pair, VINF_SUCCESS otherwise.
+ * @param   pThis           The device state structure.
+ * @param   pPair           The queue pair to transmit for.
+ * @param   fOnWorkerThread Whether we're on the transmit worker thread.
+ */
+static int vnetTransmitPendingPackets(PVNETSTATE pThis, PVNETQUEUEPAIR pPair, bool fOnWorkerThread)
 {
+    PVQUEUE pQueue = pPair->pTxQueue;
+
     /*
      * Only one thread is allowed to transmit at a time, others should skip
      * transmission as the packets will be picked up by the transmitting
      * thread.
      */
-    if (!ASMAtomicCmpXchgU32(&pThis->uIsTransmitting, 1, 0))
-        return;
+    if (!ASMAtomicCmpXchgU32(&pPair->uIsTransmitting, 1, 0))
+        return VINF_SUCCESS;
 
     if ((pThis->VPCI.uStatus & VPCI_STATUS_DRV_OK) == 0)
     {
         Log(("%s Ignoring transmit requests from non-existent driver (status=0x%x).\n", INSTANCE(pThis), pThis->VPCI.uStatus));
-        return;
+        ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+        return VINF_SUCCESS;
     }
 
-    PPDMINETWORKUP pDrv = pThis->pDrv;
+    PPDMINETWORKUP pDrv = vnetQueuePairDrv(pThis, pPair);
     if (pDrv)
     {
+        /* Announce the interest before trying, so whoever holds the driver
+           can't release it between our attempt and the flag going up. */
+        if (fOnWorkerThread)
+            ASMAtomicWriteBool(&pPair->fTxDrvWait, true);
         int rc = pDrv->pfnBeginXmit(pDrv, fOnWorkerThread);
         Assert(rc == VINF_SUCCESS || rc == VERR_TRY_AGAIN);
         if (rc == VERR_TRY_AGAIN)
         {
-            ASMAtomicWriteU32(&pThis->uIsTransmitting, 0);
-            return;
+            STAM_REL_COUNTER_INC(&pPair->StatTransmitBusy);
+            ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+            return rc;
         }
+        ASMAtomicWriteBool(&pPair->fTxDrvWait, false);
     }
 
     unsigned int uHdrLen;
@@ -1163,8 +1837,8 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
     else
         uHdrLen = sizeof(VNETHDR);
 
-    Log3(("%s vnetTransmitPendingPackets: About to transmit %d pending packets\n",
-          INSTANCE(pThis), vringReadAvailIndex(&pThis->VPCI, &pThis->pTxQueue->VRing) - pThis->pTxQueue->uNextAvailIndex));
+    Log3(("%s vnetTransmitPendingPackets: About to transmit %d pending packets on pair %u\n",
+          INSTANCE(pThis), vringReadAvailIndex(&pThis->VPCI, &pQueue->VRing) - pQueue->uNextAvailIndex, pPair->iPair));
 
     vpciSetWriteLed(&pThis->VPCI, true);
 
@@ -1191,7 +1865,7 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
                 uSize += elem.aSegsOut[i].cb;
             Log5(("%s vnetTransmitPendingPackets: complete frame is %u bytes.\n", INSTANCE(pThis), uSize));
             Assert(uSize <= VNET_MAX_FRAME_SIZE);
-            if (pThis->pDrv)
+            if (pDrv)
             {
                 VNETHDR Hdr;
                 PDMNETWORKGSO Gso, *pGso;
@@ -1200,13 +1874,14 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
                                   &Hdr, sizeof(Hdr));
 
                 STAM_REL_COUNTER_INC(&pThis->StatTransmitPackets);
+                STAM_REL_COUNTER_INC(&pPair->StatTransmitPackets);
 
                 STAM_PROFILE_START(&pThis->StatTransmitSend, a);
 
                 pGso = vnetSetupGsoCtx(&Gso, &Hdr);
                 /** @todo Optimize away the extra copying! (lazy bird) */
                 PPDMSCATTERGATHER pSgBuf;
-                int rc = pThis->pDrv->pfnAllocBuf(pThis->pDrv, uSize, pGso, &pSgBuf);
+                int rc = pDrv->pfnAllocBuf(pDrv, uSize, pGso, &pSgBuf);
                 if (RT_SUCCESS(rc))
                 {
                     Assert(pSgBuf->cSegs == 1);
@@ -1264,7 +1939,7 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
                                              Hdr.u16CSumStart, Hdr.u16CSumOffset);
                     }
 
-                    rc = pThis->pDrv->pfnSendBuf(pThis->pDrv, pSgBuf, false);
+                    rc = pDrv->pfnSendBuf(pDrv, pSgBuf, fOnWorkerThread);
                 }
                 else
                 {
@@ -1288,8 +1963,21 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
     vpciSetWriteLed(&pThis->VPCI, false);
 
     if (pDrv)
+    {
         pDrv->pfnEndXmit(pDrv);
-    ASMAtomicWriteU32(&pThis->uIsTransmitting, 0);
+
+        /* Wake up the workers of the other pairs waiting for this driver. */
+        for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+        {
+            PVNETQUEUEPAIR pOther = &pThis->aQueuePairs[i];
+            if (   pOther != pPair
+                && ASMAtomicReadBool(&pOther->fTxDrvWait)
+                && vnetQueuePairDrv(pThis, pOther) == pDrv)
+                vnetWakeupTransmit(pOther);
+        }
+    }
+    ASMAtomicWriteU32(&pPair->uIsTransmitting, 0);
+    return VINF_SUCCESS;
 }
 
 /**
@@ -1297,82 +1985,109 @@ static void vnetTransmitPendingPackets(PVNETSTATE pThis, PVQUEUE pQueue, bool fO
  */
 static DECLCALLBACK(void) vnetNetworkDown_XmitPending(PPDMINETWORKDOWN pInterface)
 {
-    PVNETSTATE pThis = RT_FROM_MEMBER(pInterface, VNETSTATE, INetworkDown);
-    vnetTransmitPendingPackets(pThis, pThis->pTxQueue, false /*fOnWorkerThread*/);
-}
+    PVNETQUEUEPAIR pDrvPair = RT_FROM_MEMBER(pInterface, VNETQUEUEPAIR, INetworkDown);
+    PVNETSTATE     pThis    = pDrvPair->pThisR3;
 
-#ifdef VNET_TX_DELAY
+    /* Pairs without a driver of their own share the one attached to pair 0. */
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+        if (   &pThis->aQueuePairs[i] == pDrvPair
+            || (pDrvPair->iPair == 0 && !pThis->aQueuePairs[i].pDrv))
+            vnetWakeupTransmit(&pThis->aQueuePairs[i]);
+}
 
+/**
+ * TX queue notification: hands the work over to the transmit worker of the
+ * queue pair, suppressing further notifications until it is done.
+ */
 static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
 {
-    PVNETSTATE pThis = (PVNETSTATE)pvState;
+    PVNETSTATE     pThis = (PVNETSTATE)pvState;
+    PVNETQUEUEPAIR pPair = vnetQueuePairFromQueue(pThis, pQueue);
+
+    vringSetNotification(&pThis->VPCI, &pQueue->VRing, false);
+    vnetWakeupTransmit(pPair);
+}
+
+/**
+ * @callback_method_impl{FNPDMTHREADDEV, Transmit worker of a queue pair.}
+ */
+static DECLCALLBACK(int) vnetTxThread(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
+{
+    PVNETQUEUEPAIR pPair = (PVNETQUEUEPAIR)pThread->pvUser;
+    PVNETSTATE     pThis = pPair->pThisR3;
 
-    if (TMTimerIsActive(pThis->CTX_SUFF(pTxTimer)))
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
     {
-        int rc = TMTimerStop(pThis->CTX_SUFF(pTxTimer));
-        Log3(("%s vnetQueueTransmit: Got kicked with notification disabled, re-enable notification and flush TX queue\n", INSTANCE(pThis)));
-        vnetTransmitPendingPackets(pThis, pQueue, false /*fOnWorkerThread*/);
-        if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
-            LogRel(("vnetQueueTransmit: Failed to enter critical section!/n"));
-        else
+        ASMAtomicWriteBool(&pPair->fTxSleeping, true);
+        if (!ASMAtomicXchgBool(&pPair->fTxPending, false))
         {
-            vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, true);
-            vnetCsLeave(pThis);
+            int rc = RTSemEventWait(pPair->hTxEvent, RT_INDEFINITE_WAIT);
+            AssertLogRelMsgReturn(RT_SUCCESS(rc) || rc == VERR_INTERRUPTED, ("%Rrc\n", rc), rc);
+            if (RT_UNLIKELY(pThread->enmState != PDMTHREADSTATE_RUNNING))
+                break;
+            ASMAtomicWriteBool(&pPair->fTxPending, false);
         }
-    }
-    else
-    {
-        if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
-            LogRel(("vnetQueueTransmit: Failed to enter critical section!/n"));
-        else
+        ASMAtomicWriteBool(&pPair->fTxSleeping, false);
+
+        /* Reset and the saved state code change the queue under our feet otherwise. */
+        int rc = PDMCritSectEnter(&pPair->csTx, VERR_IGNORED);
+        AssertRCReturn(rc, rc);
+
+        if (!vqueueIsReady(&pThis->VPCI, pPair->pTxQueue))
         {
-            vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, false);
-            TMTimerSetMicro(pThis->CTX_SUFF(pTxTimer), VNET_TX_DELAY);
-            pThis->u64NanoTS = RTTimeNanoTS();
-            vnetCsLeave(pThis);
+            PDMCritSectLeave(&pPair->csTx);
+            continue;
         }
-    }
-}
 
-/**
- * @callback_method_impl{FNTMTIMERDEV, Transmit Delay Timer handler.}
- */
-static DECLCALLBACK(void) vnetTxTimer(PPDMDEVINS pDevIns, PTMTIMER pTimer, void *pvUser)
-{
-    PVNETSTATE pThis = (PVNETSTATE)pvUser;
+        rc = vnetTransmitPendingPackets(pThis, pPair, true /*fOnWorkerThread*/);
+        if (rc == VERR_TRY_AGAIN)
+        {
+            /*
+             * The shared driver is busy.  If it's another queue pair, it wakes
+             * us up when done.  The timeout covers the driver itself or the
+             * EMT holding it, neither of which will tell us.
+             */
+            PDMCritSectLeave(&pPair->csTx);
+            ASMAtomicWriteBool(&pPair->fTxSleeping, true);
+            if (!ASMAtomicXchgBool(&pPair->fTxPending, false))
+            {
+                rc = RTSemEventWait(pPair->hTxEvent, VNET_TX_DRV_BUSY_WAIT_MS);
+                AssertLogRelMsgReturn(RT_SUCCESS(rc) || rc == VERR_TIMEOUT || rc == VERR_INTERRUPTED, ("%Rrc\n", rc), rc);
+            }
+            ASMAtomicWriteBool(&pPair->fTxSleeping, false);
+            ASMAtomicWriteBool(&pPair->fTxDrvWait, false);
+            ASMAtomicWriteBool(&pPair->fTxPending, true);
+            continue;
+        }
 
-    uint32_t u32MicroDiff = (uint32_t)((RTTimeNanoTS() - pThis->u64NanoTS)/1000);
-    if (u32MicroDiff < pThis->u32MinDiff)
-        pThis->u32MinDiff = u32MicroDiff;
-    if (u32MicroDiff > pThis->u32MaxDiff)
-        pThis->u32MaxDiff = u32MicroDiff;
-    pThis->u32AvgDiff = (pThis->u32AvgDiff * pThis->u32i + u32MicroDiff) / (pThis->u32i + 1);
-    pThis->u32i++;
-    Log3(("vnetTxTimer: Expired, diff %9d usec, avg %9d usec, min %9d usec, max %9d usec\n",
-          u32MicroDiff, pThis->u32AvgDiff, pThis->u32MinDiff, pThis->u32MaxDiff));
-
-//    Log3(("%s vnetTxTimer: Expired\n", INSTANCE(pThis)));
-    vnetTransmitPendingPackets(pThis, pThis->pTxQueue, false /*fOnWorkerThread*/);
-    if (RT_FAILURE(vnetCsEnter(pThis, VERR_SEM_BUSY)))
-    {
-        LogRel(("vnetTxTimer: Failed to enter critical section!/n"));
-        return;
+        /*
+         * Re-enable notifications and check for packets that may have been
+         * queued by the guest in the meantime.
+         */
+        vringSetNotification(&pThis->VPCI, &pPair->pTxQueue->VRing, true);
+        if (!vqueueIsEmpty(&pThis->VPCI, pPair->pTxQueue))
+        {
+            vringSetNotification(&pThis->VPCI, &pPair->pTxQueue->VRing, false);
+            ASMAtomicWriteBool(&pPair->fTxPending, true);
+        }
+        PDMCritSectLeave(&pPair->csTx);
     }
-    vringSetNotification(&pThis->VPCI, &pThis->pTxQueue->VRing, true);
-    vnetCsLeave(pThis);
-}
 
-#else /* !VNET_TX_DELAY */
+    return VINF_SUCCESS;
+}
 
-static DECLCALLBACK(void) vnetQueueTransmit(void *pvState, PVQUEUE pQueue)
+/**
+ * @callback_method_impl{FNPDMTHREADWAKEUPDEV}
+ */
+static DECLCALLBACK(int) vnetTxThreadWakeUp(PPDMDEVINS pDevIns, PPDMTHREAD pThread)
 {
-    PVNETSTATE pThis = (PVNETSTATE)pvState;
-
-    vnetTransmitPendingPackets(pThis, pQueue, false /*fOnWorkerThread*/);
+    PVNETQUEUEPAIR pPair = (PVNETQUEUEPAIR)pThread->pvUser;
+    return RTSemEventSignal(pPair->hTxEvent);
 }
 
-#endif /* !VNET_TX_DELAY */
-
 static uint8_t vnetControlRx(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELEM pElem)
 {
     uint8_t u8Ack = VNET_OK;
@@ -1392,9 +2107,8 @@ static uint8_t vnetControlRx(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELEM
         default:
             u8Ack = VNET_ERROR;
     }
-    if (fDrvWasPromisc != (pThis->fPromiscuous | pThis->fAllMulti) && pThis->pDrv)
-        pThis->pDrv->pfnSetPromiscuousMode(pThis->pDrv,
-            (pThis->fPromiscuous | pThis->fAllMulti));
+    if (fDrvWasPromisc != (pThis->fPromiscuous | pThis->fAllMulti))
+        vnetDrvSetPromiscuousMode(pThis, pThis->fPromiscuous | pThis->fAllMulti);
 
     return u8Ack;
 }
@@ -1519,6 +2233,45 @@ static uint8_t vnetControlVlan(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELE
     return u8Ack;
 }
 
+static uint8_t vnetControlMq(PVNETSTATE pThis, PVNETCTLHDR pCtlHdr, PVQUEUEELEM pElem)
+{
+    uint16_t cPairs;
+
+    if (   pCtlHdr->u8Command != VNET_CTRL_CMD_MQ_VQ_PAIRS_SET
+        || !(pThis->VPCI.uGuestFeatures & VNET_F_MQ)
+        || pElem->nOut != 2
+        || pElem->aSegsOut[1].cb != sizeof(cPairs))
+    {
+        Log(("%s vnetControlMq: Bad request (u8Command=%u nOut=%u cb=%u)\n",
+             INSTANCE(pThis), pCtlHdr->u8Command, pElem->nOut, pElem->aSegsOut[1].cb));
+        return VNET_ERROR;
+    }
+
+    PDMDevHlpPhysRead(pThis->VPCI.CTX_SUFF(pDevIns),
+                      pElem->aSegsOut[1].addr,
+                      &cPairs, sizeof(cPairs));
+
+    if (cPairs < 1 || cPairs > pThis->cMaxQueuePairs)
+    {
+        Log(("%s vnetControlMq: Number of queue pairs is out of range (%u, max %u)\n",
+             INSTANCE(pThis), cPairs, pThis->cMaxQueuePairs));
+        return VNET_ERROR;
+    }
+
+    Log(("%s vnetControlMq: %u queue pairs enabled\n", INSTANCE(pThis), cPairs));
+
+    /* Serialize against packets being stored, the steering changes. */
+    int rc = vnetCsRxEnterAll(pThis, VERR_SEM_BUSY);
+    if (RT_FAILURE(rc))
+        return VNET_ERROR;
+    ASMAtomicWriteU32(&pThis->cCurQueuePairs, cPairs);
+    vnetCsRxLeaveAll(pThis);
+
+    /* Drivers may be waiting on a queue they are no longer steered to. */
+    vnetWakeupReceive(pThis->VPCI.CTX_SUFF(pDevIns));
+    return VNET_OK;
+}
+
 
 static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
 {
@@ -1558,6 +2311,9 @@ static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
                 case VNET_CTRL_CLS_VLAN:
                     u8Ack = vnetControlVlan(pThis, &CtlHdr, &elem);
                     break;
+                case VNET_CTRL_CLS_MQ:
+                    u8Ack = vnetControlMq(pThis, &CtlHdr, &elem);
+                    break;
                 default:
                     u8Ack = VNET_ERROR;
             }
@@ -1583,6 +2339,7 @@ static DECLCALLBACK(void) vnetQueueControl(void *pvState, PVQUEUE pQueue)
 static void vnetSaveConfig(PVNETSTATE pThis, PSSMHANDLE pSSM)
 {
     SSMR3PutMem(pSSM, &pThis->macConfigured, sizeof(pThis->macConfigured));
+    SSMR3PutU32(pSSM, pThis->cMaxQueuePairs);
 }
 
 
@@ -1604,10 +2361,17 @@ static DECLCALLBACK(int) vnetSavePrep(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
 {
     PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
 
-    int rc = vnetCsRxEnter(pThis, VERR_SEM_BUSY);
+    int rc = vnetCsTxEnterAll(pThis, VERR_SEM_BUSY);
     if (RT_UNLIKELY(rc != VINF_SUCCESS))
         return rc;
-    vnetCsRxLeave(pThis);
+    vnetCsTxLeaveAll(pThis);
+    rc = vnetCsRxEnterAll(pThis, VERR_SEM_BUSY);
+    if (RT_UNLIKELY(rc != VINF_SUCCESS))
+        return rc;
+    vnetCsRxLeaveAll(pThis);
+
+    /* Hand the guest what the RX coalescing stage is still holding on to. */
+    vnetGroFlushAll(pThis);
     return VINF_SUCCESS;
 }
 
@@ -1622,8 +2386,11 @@ static DECLCALLBACK(int) vnetSaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     /* Save config first */
     vnetSaveConfig(pThis, pSSM);
 
-    /* Save the common part */
-    int rc = vpciSaveExec(&pThis->VPCI, pSSM);
+    /* Save the common part, keeping the transmit workers off the TX queues. */
+    int rc = vnetCsTxEnterAll(pThis, VERR_SEM_BUSY);
+    AssertRCReturn(rc, rc);
+    rc = vpciSaveExec(&pThis->VPCI, pSSM);
+    vnetCsTxLeaveAll(pThis);
     AssertRCReturn(rc, rc);
     /* Save device-specific part */
     rc = SSMR3PutMem( pSSM, pThis->config.mac.au8, sizeof(pThis->config.mac));
@@ -1639,6 +2406,24 @@ static DECLCALLBACK(int) vnetSaveExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     AssertRCReturn(rc, rc);
     rc = SSMR3PutMem( pSSM, pThis->aVlanFilter, sizeof(pThis->aVlanFilter));
     AssertRCReturn(rc, rc);
+    rc = SSMR3PutU32( pSSM, pThis->cCurQueuePairs);
+    AssertRCReturn(rc, rc);
+    /* Frames the RX coalescing stage could not deliver for lack of buffers. */
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        rc = SSMR3PutU32(pSSM, pPair->cbGro);
+        AssertRCReturn(rc, rc);
+        if (pPair->cbGro)
+        {
+            SSMR3PutU32( pSSM, pPair->cGroSegs);
+            SSMR3PutU32( pSSM, pPair->uGroNextSeq);
+            SSMR3PutBool(pSSM, pPair->fGroParked);
+            SSMR3PutMem( pSSM, &pPair->GroGso, sizeof(pPair->GroGso));
+            rc = SSMR3PutMem(pSSM, pPair->pbGro, pPair->cbGro);
+            AssertRCReturn(rc, rc);
+        }
+    }
     Log(("%s State has been saved\n", INSTANCE(pThis)));
     return VINF_SUCCESS;
 }
@@ -1652,10 +2437,14 @@ static DECLCALLBACK(int) vnetLoadPrep(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
 {
     PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
 
-    int rc = vnetCsRxEnter(pThis, VERR_SEM_BUSY);
+    int rc = vnetCsTxEnterAll(pThis, VERR_SEM_BUSY);
     if (RT_UNLIKELY(rc != VINF_SUCCESS))
         return rc;
-    vnetCsRxLeave(pThis);
+    vnetCsTxLeaveAll(pThis);
+    rc = vnetCsRxEnterAll(pThis, VERR_SEM_BUSY);
+    if (RT_UNLIKELY(rc != VINF_SUCCESS))
+        return rc;
+    vnetCsRxLeaveAll(pThis);
     return VINF_SUCCESS;
 }
 
@@ -1675,8 +2464,20 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
     if (memcmp(&macConfigured, &pThis->macConfigured, sizeof(macConfigured))
         && (uPass == 0 || !PDMDevHlpVMTeleportedAndNotFullyResumedYet(pDevIns)))
         LogRel(("%s: The mac address differs: config=%RTmac saved=%RTmac\n", INSTANCE(pThis), &pThis->macConfigured, &macConfigured));
+    uint32_t cMaxQueuePairs = 1;
+    if (uVersion > VIRTIO_SAVEDSTATE_VERSION_PRE_MQ)
+    {
+        rc = SSMR3GetU32(pSSM, &cMaxQueuePairs);
+        AssertRCReturn(rc, rc);
+    }
+    if (cMaxQueuePairs != pThis->cMaxQueuePairs)
+        return SSMR3SetCfgError(pSSM, RT_SRC_POS, N_("The number of queue pairs differs: config=%u saved=%u"),
+                                pThis->cMaxQueuePairs, cMaxQueuePairs);
 
-    rc = vpciLoadExec(&pThis->VPCI, pSSM, uVersion, uPass, VNET_N_QUEUES);
+    rc = vnetCsTxEnterAll(pThis, VERR_SEM_BUSY);
+    AssertRCReturn(rc, rc);
+    rc = vpciLoadExec(&pThis->VPCI, pSSM, uVersion, uPass, VNET_N_QUEUES(pThis->cMaxQueuePairs));
+    vnetCsTxLeaveAll(pThis);
     AssertRCReturn(rc, rc);
 
     if (uPass == SSM_PASS_FINAL)
@@ -1713,8 +2514,48 @@ static DECLCALLBACK(int) vnetLoadExec(PPDMDEVINS pDevIns, PSSMHANDLE pSSM, uint3
             pThis->nMacFilterEntries = 0;
             memset(pThis->aMacFilter, 0, VNET_MAC_FILTER_LEN * sizeof(RTMAC));
             memset(pThis->aVlanFilter, 0, sizeof(pThis->aVlanFilter));
-            if (pThis->pDrv)
-                pThis->pDrv->pfnSetPromiscuousMode(pThis->pDrv, true);
+            vnetDrvSetPromiscuousMode(pThis, true);
+        }
+
+        uint32_t cCurQueuePairs = 1;
+        if (uVersion > VIRTIO_SAVEDSTATE_VERSION_PRE_MQ)
+        {
+            rc = SSMR3GetU32(pSSM, &cCurQueuePairs);
+            AssertRCReturn(rc, rc);
+            AssertLogRelMsgReturn(cCurQueuePairs >= 1 && cCurQueuePairs <= pThis->cMaxQueuePairs,
+                                  ("%u\n", cCurQueuePairs), VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+        }
+        ASMAtomicWriteU32(&pThis->cCurQueuePairs, cCurQueuePairs);
+
+        for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+        {
+            PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+            pPair->cbGro      = 0;
+            pPair->fGroParked = false;
+            if (uVersion <= VIRTIO_SAVEDSTATE_VERSION_PRE_GRO)
+                continue;
+
+            uint32_t cbGro;
+            rc = SSMR3GetU32(pSSM, &cbGro);
+            AssertRCReturn(rc, rc);
+            if (!cbGro)
+                continue;
+            AssertLogRelMsgReturn(cbGro <= VNET_GRO_MAX_FRAME, ("%u\n", cbGro), VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+            if (!pPair->pbGro)
+            {
+                /* Coalescing is off in this configuration, there is nowhere to keep it. */
+                LogRel(("%s: Dropping a %u byte frame held for queue pair %u\n", INSTANCE(pThis), cbGro, i));
+                rc = SSMR3Skip(pSSM, sizeof(uint32_t) * 2 + sizeof(bool) + sizeof(PDMNETWORKGSO) + cbGro);
+                AssertRCReturn(rc, rc);
+                continue;
+            }
+            SSMR3GetU32( pSSM, &pPair->cGroSegs);
+            SSMR3GetU32( pSSM, &pPair->uGroNextSeq);
+            SSMR3GetBool(pSSM, &pPair->fGroParked);
+            SSMR3GetMem( pSSM, &pPair->GroGso, sizeof(pPair->GroGso));
+            rc = SSMR3GetMem(pSSM, pPair->pbGro, cbGro);
+            AssertRCReturn(rc, rc);
+            pPair->cbGro = cbGro;
         }
     }
 
@@ -1730,9 +2571,7 @@ static DECLCALLBACK(int) vnetLoadDone(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
 {
     PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
 
-    if (pThis->pDrv)
-        pThis->pDrv->pfnSetPromiscuousMode(pThis->pDrv,
-            (pThis->fPromiscuous | pThis->fAllMulti));
+    vnetDrvSetPromiscuousMode(pThis, pThis->fPromiscuous | pThis->fAllMulti);
     /*
      * Indicate link down to the guest OS that all network connections have
      * been lost, unless we've been teleported here.
@@ -1740,6 +2579,15 @@ static DECLCALLBACK(int) vnetLoadDone(PPDMDEVINS pDevIns, PSSMHANDLE pSSM)
     if (!PDMDevHlpVMTeleportedAndNotFullyResumedYet(pDevIns))
         vnetTempLinkDown(pThis);
 
+    /* Let the transmit workers pick up whatever is left in the TX queues on resume
+       and the flush timers deliver the frames restored into the coalescing stage. */
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        vnetWakeupTransmit(&pThis->aQueuePairs[i]);
+        if (pThis->aQueuePairs[i].cbGro)
+            TMTimerSetMicro(pThis->aQueuePairs[i].pGroTimerR3, pThis->cUsGroFlush);
+    }
+
     return VINF_SUCCESS;
 }
 
@@ -1789,9 +2637,9 @@ static DECLCALLBACK(int) vnetMap(PPCIDEVICE pPciDev, int iRegion,
 static DECLCALLBACK(void) vnetDetach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_t fFlags)
 {
     PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
-    Log(("%s vnetDetach:\n", INSTANCE(pThis)));
+    Log(("%s vnetDetach: iLUN=%u\n", INSTANCE(pThis), iLUN));
 
-    AssertLogRelReturnVoid(iLUN == 0);
+    AssertLogRelReturnVoid(iLUN < pThis->cMaxQueuePairs);
 
     int rc = vnetCsEnter(pThis, VERR_SEM_BUSY);
     if (RT_FAILURE(rc))
@@ -1803,34 +2651,29 @@ static DECLCALLBACK(void) vnetDetach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_t
     /*
      * Zero some important members.
      */
-    pThis->pDrvBase = NULL;
-    pThis->pDrv = NULL;
+    pThis->aQueuePairs[iLUN].pDrvBase = NULL;
+    pThis->aQueuePairs[iLUN].pDrv = NULL;
 
     vnetCsLeave(pThis);
 }
 
 
 /**
- * @interface_method_impl{PDMDEVREG,pfnAttach}
+ * Attaches the network driver of a queue pair.
+ *
+ * @returns VBox status code, VERR_PDM_NO_ATTACHED_DRIVER or
+ *          VERR_PDM_CFG_MISSING_DRIVER_NAME if there is nothing to attach.
+ * @param   pDevIns     The device instance.
+ * @param   pThis       The device state structure.
+ * @param   pPair       The queue pair, its index is the LUN.
  */
-static DECLCALLBACK(int) vnetAttach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_t fFlags)
+static int vnetAttachQueuePair(PPDMDEVINS pDevIns, PVNETSTATE pThis, PVNETQUEUEPAIR pPair)
 {
-    PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
-    LogFlow(("%s vnetAttach:\n",  INSTANCE(pThis)));
+    char szDesc[32];
+    RTStrPrintf(szDesc, sizeof(szDesc), pPair->iPair ? "Network Port %u" : "Network Port", pPair->iPair);
+    PPDMIBASE pIBase = pPair->iPair ? &pPair->IBase : &pThis->VPCI.IBase;
 
-    AssertLogRelReturn(iLUN == 0, VERR_PDM_NO_SUCH_LUN);
-
-    int rc = vnetCsEnter(pThis, VERR_SEM_BUSY);
-    if (RT_FAILURE(rc))
-    {
-        LogRel(("vnetAttach failed to enter critical section!\n"));
-        return rc;
-    }
-
-    /*
-     * Attach the driver.
-     */
-    rc = PDMDevHlpDriverAttach(pDevIns, 0, &pThis->VPCI.IBase, &pThis->pDrvBase, "Network Port");
+    int rc = PDMDevHlpDriverAttach(pDevIns, pPair->iPair, pIBase, &pPair->pDrvBase, szDesc);
     if (RT_SUCCESS(rc))
     {
         if (rc == VINF_NAT_DNS)
@@ -1843,12 +2686,37 @@ static DECLCALLBACK(int) vnetAttach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_t
                                        N_("A Domain Name Server (DNS) for NAT networking could not be determined. Ensure that your host is correctly connected to an ISP. If you ignore this warning the guest will not be able to perform nameserver lookups and it will probably observe delays if trying so"));
 #endif
         }
-        pThis->pDrv = PDMIBASE_QUERY_INTERFACE(pThis->pDrvBase, PDMINETWORKUP);
-        AssertMsgStmt(pThis->pDrv, ("Failed to obtain the PDMINETWORKUP interface!\n"),
+        pPair->pDrv = PDMIBASE_QUERY_INTERFACE(pPair->pDrvBase, PDMINETWORKUP);
+        AssertMsgStmt(pPair->pDrv, ("Failed to obtain the PDMINETWORKUP interface!\n"),
                       rc = VERR_PDM_MISSING_INTERFACE_BELOW);
     }
-    else if (   rc == VERR_PDM_NO_ATTACHED_DRIVER
-             || rc == VERR_PDM_CFG_MISSING_DRIVER_NAME)
+    return rc;
+}
+
+
+/**
+ * @interface_method_impl{PDMDEVREG,pfnAttach}
+ */
+static DECLCALLBACK(int) vnetAttach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_t fFlags)
+{
+    PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
+    LogFlow(("%s vnetAttach: iLUN=%u\n",  INSTANCE(pThis), iLUN));
+
+    AssertLogRelReturn(iLUN < pThis->cMaxQueuePairs, VERR_PDM_NO_SUCH_LUN);
+
+    int rc = vnetCsEnter(pThis, VERR_SEM_BUSY);
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("vnetAttach failed to enter critical section!\n"));
+        return rc;
+    }
+
+    /*
+     * Attach the driver.
+     */
+    rc = vnetAttachQueuePair(pDevIns, pThis, &pThis->aQueuePairs[iLUN]);
+    if (   rc == VERR_PDM_NO_ATTACHED_DRIVER
+        || rc == VERR_PDM_CFG_MISSING_DRIVER_NAME)
     {
         /* This should never happen because this function is not called
          * if there is no driver to attach! */
@@ -1874,7 +2742,8 @@ static DECLCALLBACK(int) vnetAttach(PPDMDEVINS pDevIns, unsigned iLUN, uint32_t
  */
 static DECLCALLBACK(void) vnetSuspend(PPDMDEVINS pDevIns)
 {
-    /* Poke thread waiting for buffer space. */
+    /* Deliver held frames while the guest can still see them, then poke thread waiting for buffer space. */
+    vnetGroFlushAll(PDMINS_2_DATA(pDevIns, PVNETSTATE));
     vnetWakeupReceive(pDevIns);
 }
 
@@ -1884,7 +2753,8 @@ static DECLCALLBACK(void) vnetSuspend(PPDMDEVINS pDevIns)
  */
 static DECLCALLBACK(void) vnetPowerOff(PPDMDEVINS pDevIns)
 {
-    /* Poke thread waiting for buffer space. */
+    /* Deliver held frames, then poke thread waiting for buffer space. */
+    vnetGroFlushAll(PDMINS_2_DATA(pDevIns, PVNETSTATE));
     vnetWakeupReceive(pDevIns);
 }
 
@@ -1897,9 +2767,6 @@ static DECLCALLBACK(void) vnetRelocate(PPDMDEVINS pDevIns, RTGCINTPTR offDelta)
     PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
     vpciRelocate(pDevIns, offDelta);
     pThis->pCanRxQueueRC = PDMQueueRCPtr(pThis->pCanRxQueueR3);
-#ifdef VNET_TX_DELAY
-    pThis->pTxTimerRC    = TMTimerRCPtr(pThis->pTxTimerR3);
-#endif /* VNET_TX_DELAY */
     // TBD
 }
 
@@ -1912,19 +2779,38 @@ static DECLCALLBACK(int) vnetDestruct(PPDMDEVINS pDevIns)
     PVNETSTATE pThis = PDMINS_2_DATA(pDevIns, PVNETSTATE);
     PDMDEV_CHECK_VERSIONS_RETURN_QUIET(pDevIns);
 
-    LogRel(("TxTimer stats (avg/min/max): %7d usec %7d usec %7d usec\n",
-            pThis->u32AvgDiff, pThis->u32MinDiff, pThis->u32MaxDiff));
     Log(("%s Destroying instance\n", INSTANCE(pThis)));
-    if (pThis->hEventMoreRxDescAvail != NIL_RTSEMEVENT)
+    for (uint32_t i = 0; i < RT_ELEMENTS(pThis->aQueuePairs); i++)
     {
-        RTSemEventSignal(pThis->hEventMoreRxDescAvail);
-        RTSemEventDestroy(pThis->hEventMoreRxDescAvail);
-        pThis->hEventMoreRxDescAvail = NIL_RTSEMEVENT;
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        if (pPair->hEventMoreRxDescAvail != NIL_RTSEMEVENT)
+        {
+            RTSemEventSignal(pPair->hEventMoreRxDescAvail);
+            RTSemEventDestroy(pPair->hEventMoreRxDescAvail);
+            pPair->hEventMoreRxDescAvail = NIL_RTSEMEVENT;
+        }
+        if (pPair->pTxThread)
+        {
+            int rc = PDMR3ThreadDestroy(pPair->pTxThread, NULL);
+            AssertRC(rc);
+            pPair->pTxThread = NULL;
+        }
+        if (pPair->hTxEvent != NIL_RTSEMEVENT)
+        {
+            RTSemEventDestroy(pPair->hTxEvent);
+            pPair->hTxEvent = NIL_RTSEMEVENT;
+        }
+        if (PDMCritSectIsInitialized(&pPair->csRx))
+            PDMR3CritSectDelete(&pPair->csRx);
+        if (PDMCritSectIsInitialized(&pPair->csTx))
+            PDMR3CritSectDelete(&pPair->csTx);
+        if (pPair->pbGro)
+        {
+            RTMemFree(pPair->pbGro);
+            pPair->pbGro = NULL;
+        }
     }
 
-    // if (PDMCritSectIsInitialized(&pThis->csRx))
-    //     PDMR3CritSectDelete(&pThis->csRx);
-
     return vpciDestruct(&pThis->VPCI);
 }
 
@@ -1939,29 +2825,63 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     PDMDEV_CHECK_VERSIONS_RETURN(pDevIns);
 
     /* Initialize the instance data suffiencently for the destructor not to blow up. */
-    pThis->hEventMoreRxDescAvail = NIL_RTSEMEVENT;
+    for (uint32_t i = 0; i < RT_ELEMENTS(pThis->aQueuePairs); i++)
+    {
+        pThis->aQueuePairs[i].hEventMoreRxDescAvail = NIL_RTSEMEVENT;
+        pThis->aQueuePairs[i].hTxEvent              = NIL_RTSEMEVENT;
+    }
 
     /* Do our own locking. */
     rc = PDMDevHlpSetDeviceCritSect(pDevIns, PDMDevHlpCritSectGetNop(pDevIns));
     AssertRCReturn(rc, rc);
 
+    /*
+     * Validate configuration.
+     */
+    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "LineSpeed\0" "LinkUpDelay\0" "QueuePairs\0" "GRO\0" "GroFlushUs\0"))
+                    return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
+                                            N_("Invalid configuration for VirtioNet device"));
+
+    /* The queue layout depends on the number of queue pairs, so get it first. */
+    /** @cfgm{QueuePairs, uint32_t, 1}
+     * The number of RX/TX queue pairs offered to the guest.  Pairs without a
+     * driver attached to their LUN share the one on LUN#0.  Main doesn't set
+     * this nor attach the extra LUNs, so it is only reachable through CFGM
+     * (VBoxInternal/Devices/virtio-net/N/Config/QueuePairs). */
+    rc = CFGMR3QueryU32Def(pCfg, "QueuePairs", &pThis->cMaxQueuePairs, 1);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'QueuePairs'"));
+    if (pThis->cMaxQueuePairs < 1 || pThis->cMaxQueuePairs > VNET_MAX_QUEUE_PAIRS)
+        return PDMDevHlpVMSetError(pDevIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("Configuration error: 'QueuePairs' must be between 1 and %u"), VNET_MAX_QUEUE_PAIRS);
+    pThis->cCurQueuePairs = 1;
+
     /* Initialize PCI part. */
     pThis->VPCI.IBase.pfnQueryInterface    = vnetQueryInterface;
     rc = vpciConstruct(pDevIns, &pThis->VPCI, iInstance,
                        VNET_NAME_FMT, VIRTIO_NET_ID,
-                       VNET_PCI_CLASS, VNET_N_QUEUES);
-    pThis->pRxQueue  = vpciAddQueue(&pThis->VPCI, 256, vnetQueueReceive,  "RX ");
-    pThis->pTxQueue  = vpciAddQueue(&pThis->VPCI, 256, vnetQueueTransmit, "TX ");
+                       VNET_PCI_CLASS, VNET_N_QUEUES(pThis->cMaxQueuePairs));
+    AssertRCReturn(rc, rc);
+    /* The guest expects RX0, TX0, RX1, TX1, ... with the control queue last. */
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        pPair->pThisR3 = pThis;
+        pPair->iPair   = i;
+        pPair->IBase.pfnQueryInterface          = vnetQueuePairQueryInterface;
+        pPair->INetworkDown.pfnWaitReceiveAvail = vnetNetworkDown_WaitReceiveAvail;
+        pPair->INetworkDown.pfnReceive          = vnetNetworkDown_Receive;
+        pPair->INetworkDown.pfnReceiveGso       = vnetNetworkDown_ReceiveGso;
+        pPair->INetworkDown.pfnXmitPending      = vnetNetworkDown_XmitPending;
+        RTStrPrintf(pPair->szRxName, sizeof(pPair->szRxName), "RX%u", i);
+        RTStrPrintf(pPair->szTxName, sizeof(pPair->szTxName), "TX%u", i);
+        pPair->pRxQueue = vpciAddQueue(&pThis->VPCI, 256, vnetQueueReceive,  pPair->szRxName);
+        pPair->pTxQueue = vpciAddQueue(&pThis->VPCI, 256, vnetQueueTransmit, pPair->szTxName);
+    }
     pThis->pCtlQueue = vpciAddQueue(&pThis->VPCI, 16,  vnetQueueControl,  "CTL");
 
-    Log(("%s Constructing new instance\n", INSTANCE(pThis)));
-
-    /*
-     * Validate configuration.
-     */
-    if (!CFGMR3AreValuesValid(pCfg, "MAC\0" "CableConnected\0" "LineSpeed\0" "LinkUpDelay\0"))
-                    return PDMDEV_SET_ERROR(pDevIns, VERR_PDM_DEVINS_UNKNOWN_CFG_VALUES,
-                                            N_("Invalid configuration for VirtioNet device"));
+    Log(("%s Constructing new instance with %u queue pair(s)\n", INSTANCE(pThis), pThis->cMaxQueuePairs));
 
     /* Get config params */
     rc = CFGMR3QueryBytes(pCfg, "MAC", pThis->macConfigured.au8,
@@ -1986,32 +2906,52 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     Log(("%s Link up delay is set to %u seconds\n",
          INSTANCE(pThis), pThis->cMsLinkUpDelay / 1000));
 
+    /** @cfgm{GRO, boolean, false}
+     * Whether to coalesce in-order TCP segments into large GSO frames before
+     * passing them to a guest which can receive TSO frames.  This holds frames
+     * back for up to GroFlushUs and thus changes the receive latency, so it is
+     * off unless asked for (VBoxInternal/Devices/virtio-net/N/Config/GRO). */
+    rc = CFGMR3QueryBoolDef(pCfg, "GRO", &pThis->fGro, false);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'GRO'"));
+    /** @cfgm{GroFlushUs, uint32_t, 50}
+     * The maximum time in microseconds a partially coalesced frame is held back
+     * waiting for more segments. */
+    rc = CFGMR3QueryU32Def(pCfg, "GroFlushUs", &pThis->cUsGroFlush, 50);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed to get the value of 'GroFlushUs'"));
+    if (pThis->cUsGroFlush < 1 || pThis->cUsGroFlush > RT_US_1SEC)
+        return PDMDevHlpVMSetError(pDevIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("Configuration error: 'GroFlushUs' must be between 1 and 1000000"));
+
 
     vnetPrintFeatures(pThis, vnetIoCb_GetHostFeatures(pThis), "Device supports the following features");
 
     /* Initialize PCI config space */
     memcpy(pThis->config.mac.au8, pThis->macConfigured.au8, sizeof(pThis->config.mac.au8));
     pThis->config.uStatus = 0;
+    pThis->config.uMaxVirtqueuePairs = (uint16_t)pThis->cMaxQueuePairs;
 
     /* Initialize state structure */
     pThis->u32PktNo     = 1;
 
     /* Interfaces */
-    pThis->INetworkDown.pfnWaitReceiveAvail = vnetNetworkDown_WaitReceiveAvail;
-    pThis->INetworkDown.pfnReceive          = vnetNetworkDown_Receive;
-    pThis->INetworkDown.pfnReceiveGso       = vnetNetworkDown_ReceiveGso;
-    pThis->INetworkDown.pfnXmitPending      = vnetNetworkDown_XmitPending;
-
     pThis->INetworkConfig.pfnGetMac         = vnetGetMac;
     pThis->INetworkConfig.pfnGetLinkState   = vnetGetLinkState;
     pThis->INetworkConfig.pfnSetLinkState   = vnetSetLinkState;
 
-    /* Initialize critical section. */
-    // char szTmp[sizeof(pThis->VPCI.szInstance) + 2];
-    // RTStrPrintf(szTmp, sizeof(szTmp), "%sRX", pThis->VPCI.szInstance);
-    // rc = PDMDevHlpCritSectInit(pDevIns, &pThis->csRx, szTmp);
-    // if (RT_FAILURE(rc))
-    //     return rc;
+    /* Initialize the per queue pair critical sections. */
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        rc = PDMDevHlpCritSectInit(pDevIns, &pThis->aQueuePairs[i].csRx, RT_SRC_POS, "%sRX%u", pThis->VPCI.szInstance, i);
+        if (RT_FAILURE(rc))
+            return rc;
+        rc = PDMDevHlpCritSectInit(pDevIns, &pThis->aQueuePairs[i].csTx, RT_SRC_POS, "%sTX%u", pThis->VPCI.szInstance, i);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
 
     /* Map our ports to IO space. */
     rc = PDMDevHlpPCIIORegionRegister(pDevIns, 0,
@@ -2044,44 +2984,52 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     if (RT_FAILURE(rc))
         return rc;
 
-#ifdef VNET_TX_DELAY
-    /* Create Transmit Delay Timer */
-    rc = PDMDevHlpTMTimerCreate(pDevIns, TMCLOCK_VIRTUAL, vnetTxTimer, pThis,
-                                TMTIMER_FLAGS_NO_CRIT_SECT,
-                                "VirtioNet TX Delay Timer", &pThis->pTxTimerR3);
-    if (RT_FAILURE(rc))
-        return rc;
-    pThis->pTxTimerR0 = TMTimerR0Ptr(pThis->pTxTimerR3);
-    pThis->pTxTimerRC = TMTimerRCPtr(pThis->pTxTimerR3);
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
 
-    pThis->u32i = pThis->u32AvgDiff = pThis->u32MaxDiff = 0;
-    pThis->u32MinDiff = ~0;
-#endif /* VNET_TX_DELAY */
+        /* Attach the driver of this queue pair, only the first one is mandatory. */
+        rc = vnetAttachQueuePair(pDevIns, pThis, pPair);
+        if (   rc == VERR_PDM_NO_ATTACHED_DRIVER
+            || rc == VERR_PDM_CFG_MISSING_DRIVER_NAME )
+        {
+             /* No error! */
+            if (i == 0)
+                Log(("%s This adapter is not attached to any network!\n", INSTANCE(pThis)));
+            else
+                Log(("%s Queue pair %u shares the network connection of the first one\n", INSTANCE(pThis), i));
+        }
+        else if (RT_FAILURE(rc))
+            return PDMDEV_SET_ERROR(pDevIns, rc, N_("Failed to attach the network LUN"));
 
-    rc = PDMDevHlpDriverAttach(pDevIns, 0, &pThis->VPCI.IBase, &pThis->pDrvBase, "Network Port");
-    if (RT_SUCCESS(rc))
-    {
-        if (rc == VINF_NAT_DNS)
+        rc = RTSemEventCreate(&pPair->hEventMoreRxDescAvail);
+        if (RT_FAILURE(rc))
+            return rc;
+
+        /* The RX coalescing stage. */
+        if (pThis->fGro)
         {
-            PDMDevHlpVMSetRuntimeError(pDevIns, 0 /*fFlags*/, "NoDNSforNAT",
-                                       N_("A Domain Name Server (DNS) for NAT networking could not be determined. Ensure that your host is correctly connected to an ISP. If you ignore this warning the guest will not be able to perform nameserver lookups and it will probably observe delays if trying so"));
+            pPair->pbGro = (uint8_t *)RTMemAlloc(VNET_GRO_MAX_FRAME);
+            if (!pPair->pbGro)
+                return VERR_NO_MEMORY;
+            rc = PDMDevHlpTMTimerCreate(pDevIns, TMCLOCK_VIRTUAL, vnetGroFlushTimer, pPair,
+                                        TMTIMER_FLAGS_NO_CRIT_SECT, "VirtioNet GRO Flush Timer", &pPair->pGroTimerR3);
+            if (RT_FAILURE(rc))
+                return rc;
         }
-        pThis->pDrv = PDMIBASE_QUERY_INTERFACE(pThis->pDrvBase, PDMINETWORKUP);
-        AssertMsgReturn(pThis->pDrv, ("Failed to obtain the PDMINETWORKUP interface!\n"),
-                        VERR_PDM_MISSING_INTERFACE_BELOW);
-    }
-    else if (   rc == VERR_PDM_NO_ATTACHED_DRIVER
-             || rc == VERR_PDM_CFG_MISSING_DRIVER_NAME )
-    {
-         /* No error! */
-        Log(("%s This adapter is not attached to any network!\n", INSTANCE(pThis)));
-    }
-    else
-        return PDMDEV_SET_ERROR(pDevIns, rc, N_("Failed to attach the network LUN"));
 
-    rc = RTSemEventCreate(&pThis->hEventMoreRxDescAvail);
-    if (RT_FAILURE(rc))
-        return rc;
+        /* Create the transmit worker. */
+        rc = RTSemEventCreate(&pPair->hTxEvent);
+        if (RT_FAILURE(rc))
+            return rc;
+        char szName[16];
+        RTStrPrintf(szName, sizeof(szName), "VNet%d-Tx%u", iInstance, i);
+        rc = PDMDevHlpThreadCreate(pDevIns, &pPair->pTxThread, pPair, vnetTxThread,
+                                   vnetTxThreadWakeUp, 0, RTTHREADTYPE_IO, szName);
+        if (RT_FAILURE(rc))
+            return PDMDevHlpVMSetError(pDevIns, rc, RT_SRC_POS,
+                                       N_("VirtioNet: Failed to create transmit thread %s"), szName);
+    }
 
     rc = vnetIoCb_Reset(pThis);
     AssertRC(rc);
@@ -2103,6 +3051,17 @@ static DECLCALLBACK(int) vnetConstruct(PPDMDEVINS pDevIns, int iInstance, PCFGMN
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTransmit,           STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling transmits in HC",          "/Devices/VNet%d/Transmit/Total", iInstance);
     PDMDevHlpSTAMRegisterF(pDevIns, &pThis->StatTransmitSend,       STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL, "Profiling send transmit in HC",      "/Devices/VNet%d/Transmit/Send", iInstance);
 #endif /* VBOX_WITH_STATISTICS */
+    for (uint32_t i = 0; i < pThis->cMaxQueuePairs; i++)
+    {
+        PVNETQUEUEPAIR pPair = &pThis->aQueuePairs[i];
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatReceivePackets,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of received packets",         "/Devices/VNet%d/Queue%u/Receive", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatTransmitPackets, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of sent packets",             "/Devices/VNet%d/Queue%u/Transmit", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatTransmitWakeups, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Nr of transmit thread wakeups",      "/Devices/VNet%d/Queue%u/TransmitWakeups", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatTransmitBusy,    STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Nr of times the shared driver was busy", "/Devices/VNet%d/Queue%u/TransmitBusy", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatGroSegments,     STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of segments appended to a coalesced frame", "/Devices/VNet%d/Queue%u/GroSegments", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatGroFrames,       STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,          "Number of coalesced frames delivered", "/Devices/VNet%d/Queue%u/GroFrames", iInstance, i);
+        PDMDevHlpSTAMRegisterF(pDevIns, &pPair->StatGroTimerFlushes, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,     "Nr of held frames delivered by the flush timer", "/Devices/VNet%d/Queue%u/GroTimerFlushes", iInstance, i);
+    }
 
     return VINF_SUCCESS;
 }
@@ -23,11 +23,17 @@
 #include <VBox/vmm/pdmdrv.h>
 #include <VBox/vmm/pdmnetifs.h>
 
+#include <VBox/vmm/pdmnetinline.h>
+
 #include <VBox/log.h>
+#include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/critsect.h>
 #include <iprt/file.h>
+#include <iprt/mem.h>
 #include <iprt/process.h>
+#include <iprt/semaphore.h>
+#include <iprt/stream.h>
 #include <iprt/string.h>
 #include <iprt/time.h>
 #include <iprt/uuid.h>
@@ -38,9 +44,71 @@
 #include "VBoxDD.h"
 
 
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The default snap length. */
+#define NETSNIFFER_DEFAULT_SNAPLEN          UINT32_C(65535)
+/** The default capture ring size (per direction). */
+#define NETSNIFFER_DEFAULT_RING_SIZE        (_2M)
+/** The default number of rotated capture files to keep. */
+#define NETSNIFFER_DEFAULT_MAX_FILES        UINT32_C(10)
+
+/** @name Capture directions, indexes into DRVNETSNIFFER::aRings.
+ * @{ */
+/** Guest to wire (pfnSendBuf). */
+#define NETSNIFFER_DIR_OUT                  0
+/** Wire to guest (pfnReceive). */
+#define NETSNIFFER_DIR_IN                   1
+/** @} */
+
+
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
 *********************************************************************************************************************************/
+/**
+ * Capture ring record header, followed by the captured bytes.
+ */
+typedef struct NETSNIFFERREC
+{
+    /** Size of the record including this header, 8 byte aligned.
+     * Zero marks the unused space at the end of the ring. */
+    uint32_t                cbRec;
+    /** The original size of the frame. */
+    uint32_t                cbFrame;
+    /** The capture time (RTTimeNanoTS). */
+    uint64_t                u64NanoTS;
+    /** Number of bytes captured (at most the snap length). */
+    uint32_t                cbData;
+    /** Reserved. */
+    uint32_t                u32Reserved;
+} NETSNIFFERREC;
+AssertCompileSizeAlignment(NETSNIFFERREC, 8);
+/** Pointer to a capture ring record. */
+typedef NETSNIFFERREC *PNETSNIFFERREC;
+
+/**
+ * Single producer, single consumer capture ring.
+ *
+ * The datapath produces records and the writer thread consumes them; neither
+ * side ever blocks the other.  When the ring is full the frame is dropped.
+ */
+typedef struct NETSNIFFERRING
+{
+    /** The ring buffer. */
+    uint8_t                *pbBuf;
+    /** The size of the ring buffer (power of two). */
+    uint32_t                cbBuf;
+    /** Set while a producer is busy, a second producer drops instead of waiting. */
+    bool volatile           fBusy;
+    /** The write offset (free running, producer owned). */
+    uint32_t volatile       offWrite;
+    /** The read offset (free running, writer thread owned). */
+    uint32_t volatile       offRead;
+} NETSNIFFERRING;
+/** Pointer to a capture ring. */
+typedef NETSNIFFERRING *PNETSNIFFERRING;
+
 /**
  * Block driver instance data.
  *
@@ -75,11 +143,379 @@ typedef struct DRVNETSNIFFER
     PPDMDRVINS              pDrvIns;
     /** For when we're the leaf driver. */
     RTCRITSECT              XmitLock;
-
+    /** The max number of bytes captured per frame. */
+    uint32_t                cbSnapLen;
+
+    /** @name Asynchronous capture
+     * @{ */
+    /** Whether frames are captured into the rings and written by the writer
+     * thread instead of being written on the datapath. */
+    bool                    fAsync;
+    /** Whether to write pcapng rather than classic pcap. */
+    bool                    fPcapNg;
+    /** Set while the writer thread is waiting for work. */
+    bool volatile           fWriterSleeping;
+    /** Number of rotated files to keep. */
+    uint32_t                cMaxFiles;
+    /** Rotate the capture file when it grows beyond this size, 0 to never rotate. */
+    uint64_t                cbMaxFile;
+    /** Number of bytes written to the current capture file. */
+    uint64_t                cbFile;
+    /** What to add to RTTimeNanoTS to get nanoseconds since the epoch. */
+    uint64_t                u64EpochNanoTSDelta;
+    /** The capture stream (writer thread). */
+    PRTSTREAM               pStrm;
+    /** The writer thread. */
+    PPDMTHREAD              pWriterThread;
+    /** Event the writer thread waits on. */
+    RTSEMEVENT              hEvtWriter;
+    /** Whether a write error has been logged already. */
+    bool                    fWriteErrorLogged;
+    /** The capture rings, indexed by NETSNIFFER_DIR_XXX. */
+    NETSNIFFERRING          aRings[2];
+    /** @} */
+
+    /** Number of frames captured. */
+    STAMCOUNTER             StatCaptured;
+    /** Number of frames dropped because the ring was full. */
+    STAMCOUNTER             StatDropped;
+    /** Number of bytes dropped because the ring was full. */
+    STAMCOUNTER             StatDroppedBytes;
+    /** Number of capture file rotations. */
+    STAMCOUNTER             StatRotations;
+    /** Number of failed writes. */
+    STAMCOUNTER             StatWriteErrors;
 } DRVNETSNIFFER, *PDRVNETSNIFFER;
 
 
 
+/**
+ * Puts a captured frame into a capture ring.
+ *
+ * Never blocks; the frame is dropped and counted if there is no room.
+ *
+ * @returns true if queued, false if dropped.
+ * @param   pThis           The sniffer instance.
+ * @param   pRing           The ring for the capture direction.
+ * @param   u64NanoTS       The capture time.
+ * @param   pvHdrs          Headers to prepend (carved GSO segment), optional.
+ * @param   cbHdrs          The size of the headers.
+ * @param   pvData          The frame data (following the headers).
+ * @param   cbData          The size of the frame data.
+ */
+static bool drvNetSnifferRingPut(PDRVNETSNIFFER pThis, PNETSNIFFERRING pRing, uint64_t u64NanoTS,
+                                 const void *pvHdrs, uint32_t cbHdrs, const void *pvData, uint32_t cbData)
+{
+    uint32_t const cbFrame = cbHdrs + cbData;
+    uint32_t const cbCap   = RT_MIN(cbFrame, pThis->cbSnapLen);
+    uint32_t const cbRec   = RT_ALIGN_32(sizeof(NETSNIFFERREC) + cbCap, 8);
+
+    if (RT_UNLIKELY(ASMAtomicXchgBool(&pRing->fBusy, true)))
+    {
+        STAM_REL_COUNTER_INC(&pThis->StatDropped);
+        STAM_REL_COUNTER_ADD(&pThis->StatDroppedBytes, cbFrame);
+        return false;
+    }
+
+    uint32_t       offWrite = pRing->offWrite;
+    uint32_t const offRead  = ASMAtomicReadU32(&pRing->offRead);
+    uint32_t const cbFree   = pRing->cbBuf - (offWrite - offRead);
+    uint32_t       off      = offWrite & (pRing->cbBuf - 1);
+    uint32_t const cbToEnd  = pRing->cbBuf - off;
+    if (RT_UNLIKELY(cbRec + (cbToEnd < cbRec ? cbToEnd : 0) > cbFree))
+    {
+        ASMAtomicWriteBool(&pRing->fBusy, false);
+        STAM_REL_COUNTER_INC(&pThis->StatDropped);
+        STAM_REL_COUNTER_ADD(&pThis->StatDroppedBytes, cbFrame);
+        return false;
+    }
+
+    /* Skip the unusable space at the end of the ring. */
+    if (cbToEnd < cbRec)
+    {
+        ((PNETSNIFFERREC)&pRing->pbBuf[off])->cbRec = 0;
+        offWrite += cbToEnd;
+        off       = 0;
+    }
+
+    PNETSNIFFERREC pRec = (PNETSNIFFERREC)&pRing->pbBuf[off];
+    pRec->cbRec       = cbRec;
+    pRec->cbFrame     = cbFrame;
+    pRec->u64NanoTS   = u64NanoTS;
+    pRec->cbData      = cbCap;
+    pRec->u32Reserved = 0;
+    uint8_t *pbDst = (uint8_t *)(pRec + 1);
+    uint32_t cbCopy = RT_MIN(cbHdrs, cbCap);
+    if (cbCopy)
+        memcpy(pbDst, pvHdrs, cbCopy);
+    if (cbCap > cbCopy)
+        memcpy(pbDst + cbCopy, pvData, cbCap - cbCopy);
+
+    /* Publish the record. */
+    ASMAtomicWriteU32(&pRing->offWrite, offWrite + cbRec);
+    ASMAtomicWriteBool(&pRing->fBusy, false);
+
+    STAM_REL_COUNTER_INC(&pThis->StatCaptured);
+    if (ASMAtomicXchgBool(&pThis->fWriterSleeping, false))
+        RTSemEventSignal(pThis->hEvtWriter);
+    return true;
+}
+
+
+/**
+ * Captures a frame, splitting GSO frames into the segments that go on the wire.
+ *
+ * @param   pThis           The sniffer instance.
+ * @param   iDir            The direction, NETSNIFFER_DIR_XXX.
+ * @param   pGso            The GSO context, NULL if not a GSO frame.
+ * @param   pvFrame         The start of the frame.
+ * @param   cbFrame         The size of the frame.
+ * @param   cbMax           The max number of frame bytes available at pvFrame.
+ */
+static void drvNetSnifferCapture(PDRVNETSNIFFER pThis, unsigned iDir, PCPDMNETWORKGSO pGso,
+                                 const void *pvFrame, size_t cbFrame, size_t cbMax)
+{
+    if (!pThis->fAsync)
+    {
+        /* output to sniffer */
+        RTCritSectEnter(&pThis->Lock);
+        if (!pGso)
+            PcapFileFrame(pThis->hFile, pThis->StartNanoTS, pvFrame, cbFrame, RT_MIN(cbMax, pThis->cbSnapLen));
+        else
+            PcapFileGsoFrame(pThis->hFile, pThis->StartNanoTS, pGso, pvFrame, cbFrame, RT_MIN(cbMax, pThis->cbSnapLen));
+        RTCritSectLeave(&pThis->Lock);
+        STAM_REL_COUNTER_INC(&pThis->StatCaptured);
+        return;
+    }
+
+    PNETSNIFFERRING pRing     = &pThis->aRings[iDir];
+    uint64_t const  u64NanoTS = RTTimeNanoTS();
+    if (!pGso)
+        drvNetSnifferRingPut(pThis, pRing, u64NanoTS, NULL, 0, pvFrame, (uint32_t)RT_MIN(cbFrame, cbMax));
+    else
+    {
+        uint8_t const  *pbFrame = (uint8_t const *)pvFrame;
+        uint8_t         abHdrs[256];
+        uint32_t const  cSegs   = PDMNetGsoCalcSegmentCount(pGso, cbFrame);
+        for (uint32_t iSeg = 0; iSeg < cSegs; iSeg++)
+        {
+            uint32_t cbSegPayload, cbHdrs;
+            uint32_t offSegPayload = PDMNetGsoCarveSegment(pGso, pbFrame, cbFrame, iSeg, cSegs, abHdrs, &cbHdrs, &cbSegPayload);
+            if (!drvNetSnifferRingPut(pThis, pRing, u64NanoTS, abHdrs, cbHdrs, pbFrame + offSegPayload, cbSegPayload))
+                break;
+        }
+    }
+}
+
+
+/**
+ * Writes the capture file header for the configured format.
+ *
+ * @returns IPRT status code.
+ * @param   pThis           The sniffer instance.
+ */
+static int drvNetSnifferWriteHdr(PDRVNETSNIFFER pThis)
+{
+    int rc;
+    if (pThis->fPcapNg)
+        rc = PcapNgStreamHdr(pThis->pStrm, pThis->cbSnapLen);
+    else
+        rc = PcapStreamHdr(pThis->pStrm, pThis->StartNanoTS);
+    pThis->cbFile = 0;
+    return rc;
+}
+
+
+/**
+ * Rotates the capture files: file -> file.1 -> ... -> file.<cMaxFiles>.
+ *
+ * @returns IPRT status code.
+ * @param   pThis           The sniffer instance.
+ * @thread  The writer thread.
+ */
+static int drvNetSnifferRotate(PDRVNETSNIFFER pThis)
+{
+    RTStrmClose(pThis->pStrm);
+    pThis->pStrm = NULL;
+
+    char szOld[RTPATH_MAX];
+    char szNew[RTPATH_MAX];
+    if (pThis->cMaxFiles > 0)
+    {
+        for (uint32_t i = pThis->cMaxFiles - 1; i > 0; i--)
+        {
+            RTStrPrintf(szOld, sizeof(szOld), "%s.%u", pThis->szFilename, i);
+            RTStrPrintf(szNew, sizeof(szNew), "%s.%u", pThis->szFilename, i + 1);
+            RTFileRename(szOld, szNew, RTFILEMOVE_FLAGS_REPLACE);
+        }
+        RTStrPrintf(szNew, sizeof(szNew), "%s.1", pThis->szFilename);
+        RTFileRename(pThis->szFilename, szNew, RTFILEMOVE_FLAGS_REPLACE);
+    }
+
+    int rc = RTStrmOpen(pThis->szFilename, "wb", &pThis->pStrm);
+    if (RT_SUCCESS(rc))
+        rc = drvNetSnifferWriteHdr(pThis);
+    STAM_REL_COUNTER_INC(&pThis->StatRotations);
+    return rc;
+}
+
+
+/**
+ * Returns the oldest record of the two capture rings.
+ *
+ * @returns Pointer to the record, NULL if both rings are empty.
+ * @param   pThis           The sniffer instance.
+ * @param   ppRing          Where to return the ring the record belongs to.
+ * @thread  The writer thread.
+ */
+static PNETSNIFFERREC drvNetSnifferRingPeekOldest(PDRVNETSNIFFER pThis, PNETSNIFFERRING *ppRing)
+{
+    PNETSNIFFERREC pOldest = NULL;
+    for (unsigned iDir = 0; iDir < RT_ELEMENTS(pThis->aRings); iDir++)
+    {
+        PNETSNIFFERRING pRing    = &pThis->aRings[iDir];
+        uint32_t const  offWrite = ASMAtomicReadU32(&pRing->offWrite);
+        uint32_t        offRead  = pRing->offRead;
+        if (offRead == offWrite)
+            continue;
+
+        uint32_t off = offRead & (pRing->cbBuf - 1);
+        PNETSNIFFERREC pRec = (PNETSNIFFERREC)&pRing->pbBuf[off];
+        if (!pRec->cbRec)
+        {
+            /* Wrap around, skipping the unused space at the end of the ring. */
+            offRead += pRing->cbBuf - off;
+            ASMAtomicWriteU32(&pRing->offRead, offRead);
+            if (offRead == offWrite)
+                continue;
+            pRec = (PNETSNIFFERREC)&pRing->pbBuf[0];
+        }
+
+        if (!pOldest || pRec->u64NanoTS < pOldest->u64NanoTS)
+        {
+            pOldest = pRec;
+            *ppRing = pRing;
+        }
+    }
+    return pOldest;
+}
+
+
+/**
+ * Checks whether both capture rings are empty.
+ *
+ * @returns true if empty, false if there is something to write.
+ * @param   pThis           The sniffer instance.
+ */
+static bool drvNetSnifferRingsEmpty(PDRVNETSNIFFER pThis)
+{
+    for (unsigned iDir = 0; iDir < RT_ELEMENTS(pThis->aRings); iDir++)
+        if (ASMAtomicReadU32(&pThis->aRings[iDir].offRead) != ASMAtomicReadU32(&pThis->aRings[iDir].offWrite))
+            return false;
+    return true;
+}
+
+
+/**
+ * Writes out the records in the capture rings in capture order.
+ *
+ * @returns Number of records written.
+ * @param   pThis           The sniffer instance.
+ * @param   cMax            The max number of records to write.
+ * @thread  The writer thread.
+ */
+static uint32_t drvNetSnifferDrain(PDRVNETSNIFFER pThis, uint32_t cMax)
+{
+    uint32_t        cWritten = 0;
+    PNETSNIFFERRING pRing    = NULL;
+    PNETSNIFFERREC  pRec;
+    while (   cWritten < cMax
+           && (pRec = drvNetSnifferRingPeekOldest(pThis, &pRing)) != NULL)
+    {
+        if (pThis->pStrm)
+        {
+            int rc;
+            if (pThis->fPcapNg)
+            {
+                rc = PcapNgStreamFrame(pThis->pStrm, pRec->u64NanoTS + pThis->u64EpochNanoTSDelta,
+                                       pRing == &pThis->aRings[NETSNIFFER_DIR_IN] ? PCAPNG_EPB_FLAGS_INBOUND : PCAPNG_EPB_FLAGS_OUTBOUND,
+                                       pRec + 1, pRec->cbFrame, pRec->cbData);
+                pThis->cbFile += PcapNgCalcFrameSize(pRec->cbFrame, pRec->cbData);
+            }
+            else
+            {
+                rc = PcapStreamFrameTS(pThis->pStrm, pRec->u64NanoTS - pThis->StartNanoTS,
+                                       pRec + 1, pRec->cbFrame, pRec->cbData);
+                pThis->cbFile += 16 + pRec->cbData;
+            }
+
+            if (   RT_SUCCESS(rc)
+                && pThis->cbMaxFile
+                && pThis->cbFile >= pThis->cbMaxFile)
+                rc = drvNetSnifferRotate(pThis);
+            if (RT_FAILURE(rc))
+            {
+                STAM_REL_COUNTER_INC(&pThis->StatWriteErrors);
+                if (!pThis->fWriteErrorLogged)
+                {
+                    pThis->fWriteErrorLogged = true;
+                    LogRel(("NetSniffer#%u: Writing to '%s' failed: %Rrc\n", pThis->pDrvIns->iInstance, pThis->szFilename, rc));
+                }
+            }
+        }
+
+        ASMAtomicWriteU32(&pRing->offRead, pRing->offRead + pRec->cbRec);
+        cWritten++;
+    }
+    return cWritten;
+}
+
+
+/**
+ * @callback_method_impl{FNPDMTHREADDRV, Writes the captured frames to the file.}
+ */
+static DECLCALLBACK(int) drvNetSnifferWriterThread(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PDRVNETSNIFFER pThis = PDMINS_2_DATA(pDrvIns, PDRVNETSNIFFER);
+
+    if (pThread->enmState == PDMTHREADSTATE_INITIALIZING)
+        return VINF_SUCCESS;
+
+    while (pThread->enmState == PDMTHREADSTATE_RUNNING)
+    {
+        if (drvNetSnifferDrain(pThis, 256))
+            continue;
+
+        /* Idle: make the file current for whoever looks at it, then wait. */
+        if (pThis->pStrm)
+            RTStrmFlush(pThis->pStrm);
+        ASMAtomicWriteBool(&pThis->fWriterSleeping, true);
+        if (drvNetSnifferRingsEmpty(pThis))
+            RTSemEventWait(pThis->hEvtWriter, RT_MS_1SEC);
+        ASMAtomicWriteBool(&pThis->fWriterSleeping, false);
+    }
+
+    /* Write out what is left. */
+    while (drvNetSnifferDrain(pThis, UINT32_MAX))
+    { /* nothing */ }
+    if (pThis->pStrm)
+        RTStrmFlush(pThis->pStrm);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNPDMTHREADWAKEUPDRV}
+ */
+static DECLCALLBACK(int) drvNetSnifferWriterWakeup(PPDMDRVINS pDrvIns, PPDMTHREAD pThread)
+{
+    PDRVNETSNIFFER pThis = PDMINS_2_DATA(pDrvIns, PDRVNETSNIFFER);
+    NOREF(pThread);
+    return RTSemEventSignal(pThis->hEvtWriter);
+}
+
+
+
 /**
  * @interface_method_impl{PDMINETWORKUP,pfnBeginXmit}
  */
@@ -132,18 +568,10 @@ static DECLCALLBACK(int) drvNetSnifferUp_SendBuf(PPDMINETWORKUP pInterface, PPDM
         return VERR_NET_DOWN;
 
     /* output to sniffer */
-    RTCritSectEnter(&pThis->Lock);
-    if (!pSgBuf->pvUser)
-        PcapFileFrame(pThis->hFile, pThis->StartNanoTS,
-                      pSgBuf->aSegs[0].pvSeg,
-                      pSgBuf->cbUsed,
-                      RT_MIN(pSgBuf->cbUsed, pSgBuf->aSegs[0].cbSeg));
-    else
-        PcapFileGsoFrame(pThis->hFile, pThis->StartNanoTS, (PCPDMNETWORKGSO)pSgBuf->pvUser,
+    drvNetSnifferCapture(pThis, NETSNIFFER_DIR_OUT, (PCPDMNETWORKGSO)pSgBuf->pvUser,
                          pSgBuf->aSegs[0].pvSeg,
                          pSgBuf->cbUsed,
                          RT_MIN(pSgBuf->cbUsed, pSgBuf->aSegs[0].cbSeg));
-    RTCritSectLeave(&pThis->Lock);
 
     return pThis->pIBelowNet->pfnSendBuf(pThis->pIBelowNet, pSgBuf, fOnWorkerThread);
 }
@@ -205,9 +633,7 @@ static DECLCALLBACK(int) drvNetSnifferDown_Receive(PPDMINETWORKDOWN pInterface,
     PDRVNETSNIFFER pThis = RT_FROM_MEMBER(pInterface, DRVNETSNIFFER, INetworkDown);
 
     /* output to sniffer */
-    RTCritSectEnter(&pThis->Lock);
-    PcapFileFrame(pThis->hFile, pThis->StartNanoTS, pvBuf, cb, cb);
-    RTCritSectLeave(&pThis->Lock);
+    drvNetSnifferCapture(pThis, NETSNIFFER_DIR_IN, NULL, pvBuf, cb, cb);
 
     /* pass up */
     int rc = pThis->pIAboveNet->pfnReceive(pThis->pIAboveNet, pvBuf, cb);
@@ -352,6 +778,42 @@ static DECLCALLBACK(void) drvNetSnifferDestruct(PPDMDRVINS pDrvIns)
     PDRVNETSNIFFER pThis = PDMINS_2_DATA(pDrvIns, PDRVNETSNIFFER);
     PDMDRV_CHECK_VERSIONS_RETURN_VOID(pDrvIns);
 
+    /* Let the writer thread write out what was captured before closing the file. */
+    if (pThis->pWriterThread)
+    {
+        int rcThread;
+        int rc = PDMR3ThreadDestroy(pThis->pWriterThread, &rcThread);
+        AssertRC(rc);
+        pThis->pWriterThread = NULL;
+    }
+
+    if (pThis->fAsync)
+    {
+        uint64_t const cDropped = pThis->StatDropped.c;
+        if (cDropped)
+            LogRel(("NetSniffer#%u: %llu frames were dropped because the capture ring was full\n",
+                    pDrvIns->iInstance, cDropped));
+    }
+
+    if (pThis->pStrm)
+    {
+        RTStrmClose(pThis->pStrm);
+        pThis->pStrm = NULL;
+    }
+
+    for (unsigned iDir = 0; iDir < RT_ELEMENTS(pThis->aRings); iDir++)
+        if (pThis->aRings[iDir].pbBuf)
+        {
+            RTMemPageFree(pThis->aRings[iDir].pbBuf, pThis->aRings[iDir].cbBuf);
+            pThis->aRings[iDir].pbBuf = NULL;
+        }
+
+    if (pThis->hEvtWriter != NIL_RTSEMEVENT)
+    {
+        RTSemEventDestroy(pThis->hEvtWriter);
+        pThis->hEvtWriter = NIL_RTSEMEVENT;
+    }
+
     if (RTCritSectIsInitialized(&pThis->Lock))
         RTCritSectDelete(&pThis->Lock);
 
@@ -381,6 +843,7 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
      */
     pThis->pDrvIns                                  = pDrvIns;
     pThis->hFile                                    = NIL_RTFILE;
+    pThis->hEvtWriter                               = NIL_RTSEMEVENT;
     /* The pcap file *must* start at time offset 0,0. */
     pThis->StartNanoTS                              = RTTimeNanoTS() - RTTimeProgramNanoTS();
     /* IBase */
@@ -413,7 +876,13 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
     /*
      * Validate the config.
      */
-    if (!CFGMR3AreValuesValid(pCfg, "File\0"))
+    if (!CFGMR3AreValuesValid(pCfg, "File\0"
+                                    "SnapLen\0"
+                                    "Async\0"
+                                    "Format\0"
+                                    "RingSize\0"
+                                    "MaxFileSize\0"
+                                    "MaxFiles\0"))
         return VERR_PDM_DRVINS_UNKNOWN_CFG_VALUES;
 
     if (CFGMR3GetFirstChild(pCfg))
@@ -437,6 +906,67 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
         return rc;
     }
 
+    /** @cfgm{SnapLen, uint32_t, 65535}
+     * The max number of bytes captured per frame. */
+    rc = CFGMR3QueryU32Def(pCfg, "SnapLen", &pThis->cbSnapLen, NETSNIFFER_DEFAULT_SNAPLEN);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"SnapLen\" value"));
+    if (pThis->cbSnapLen < 64 || pThis->cbSnapLen > NETSNIFFER_DEFAULT_SNAPLEN)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("Configuration error: \"SnapLen\" must be between 64 and 65535, not %u"), pThis->cbSnapLen);
+
+    /** @cfgm{Async, boolean, false}
+     * Capture into a ring buffer that is written to the file by a separate
+     * thread, dropping frames when the ring is full instead of slowing down
+     * the network. */
+    rc = CFGMR3QueryBoolDef(pCfg, "Async", &pThis->fAsync, false);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"Async\" value"));
+
+    /** @cfgm{Format, string, "pcap"}
+     * The capture file format, "pcap" or "pcapng" (requires Async). The pcapng
+     * files carry nanosecond timestamps and the direction of each frame. */
+    char szFormat[16];
+    rc = CFGMR3QueryStringDef(pCfg, "Format", szFormat, sizeof(szFormat), "pcap");
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"Format\" value"));
+    if (!RTStrICmp(szFormat, "pcapng"))
+        pThis->fPcapNg = true;
+    else if (RTStrICmp(szFormat, "pcap"))
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("Configuration error: Unknown capture \"Format\" '%s'"), szFormat);
+
+    /** @cfgm{MaxFileSize, uint64_t, 0}
+     * Rotate the capture file when it grows beyond this many bytes (requires
+     * Async).  The previous files are kept as File.1, File.2 and so on. 0 means
+     * never rotate. */
+    rc = CFGMR3QueryU64Def(pCfg, "MaxFileSize", &pThis->cbMaxFile, 0);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"MaxFileSize\" value"));
+
+    /** @cfgm{MaxFiles, uint32_t, 10}
+     * The number of rotated capture files to keep. */
+    rc = CFGMR3QueryU32Def(pCfg, "MaxFiles", &pThis->cMaxFiles, NETSNIFFER_DEFAULT_MAX_FILES);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"MaxFiles\" value"));
+
+    /** @cfgm{RingSize, uint32_t, 2MB}
+     * The size of the capture ring for each direction (power of two). */
+    uint32_t cbRing;
+    rc = CFGMR3QueryU32Def(pCfg, "RingSize", &cbRing, NETSNIFFER_DEFAULT_RING_SIZE);
+    if (RT_FAILURE(rc))
+        return PDMDRV_SET_ERROR(pDrvIns, rc, N_("Configuration error: Failed to get the \"RingSize\" value"));
+    if (   !RT_IS_POWER_OF_TWO(cbRing)
+        || cbRing < _128K
+        || cbRing > _256M)
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                   N_("Configuration error: \"RingSize\" must be a power of two between 128KB and 256MB, not %#x"), cbRing);
+
+    if (   !pThis->fAsync
+        && (pThis->fPcapNg || pThis->cbMaxFile))
+        return PDMDrvHlpVMSetError(pDrvIns, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                   N_("Configuration error: The pcapng format and file rotation require \"Async\" to be enabled"));
+
     /*
      * Query the network port interface.
      */
@@ -483,8 +1013,11 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
     /*
      * Open output file / pipe.
      */
-    rc = RTFileOpen(&pThis->hFile, pThis->szFilename,
-                    RTFILE_O_WRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_WRITE);
+    if (pThis->fAsync)
+        rc = RTStrmOpen(pThis->szFilename, "wb", &pThis->pStrm);
+    else
+        rc = RTFileOpen(&pThis->hFile, pThis->szFilename,
+                        RTFILE_O_WRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_WRITE);
     if (RT_FAILURE(rc))
         return PDMDrvHlpVMSetError(pDrvIns, rc, RT_SRC_POS,
                                    N_("Netsniffer cannot open '%s' for writing. The directory must exist and it must be writable for the current user"), pThis->szFilename);
@@ -498,13 +1031,50 @@ static DECLCALLBACK(int) drvNetSnifferConstruct(PPDMDRVINS pDrvIns, PCFGMNODE pC
     else
         LogRel(("NetSniffer: Sniffing to '%s'\n", pThis->szFilename));
 
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatCaptured,     STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES, "Number of frames captured.",                   "/Drivers/NetSniffer%d/Captured", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatDropped,      STAMTYPE_COUNTER, STAMVISIBILITY_USED,   STAMUNIT_OCCURENCES, "Number of frames dropped, capture ring full.",  "/Drivers/NetSniffer%d/Dropped", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatDroppedBytes, STAMTYPE_COUNTER, STAMVISIBILITY_USED,   STAMUNIT_BYTES,      "Number of bytes dropped, capture ring full.",   "/Drivers/NetSniffer%d/DroppedBytes", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatRotations,    STAMTYPE_COUNTER, STAMVISIBILITY_USED,   STAMUNIT_OCCURENCES, "Number of capture file rotations.",             "/Drivers/NetSniffer%d/Rotations", pDrvIns->iInstance);
+    PDMDrvHlpSTAMRegisterF(pDrvIns, &pThis->StatWriteErrors,  STAMTYPE_COUNTER, STAMVISIBILITY_USED,   STAMUNIT_OCCURENCES, "Number of failed capture file writes.",         "/Drivers/NetSniffer%d/WriteErrors", pDrvIns->iInstance);
+
+    if (!pThis->fAsync)
+    {
+        /*
+         * Write pcap header.
+         * Some time has gone by since capturing pThis->StartNanoTS so get the
+         * current time again.
+         */
+        PcapFileHdr(pThis->hFile, RTTimeNanoTS());
+        return VINF_SUCCESS;
+    }
+
     /*
-     * Write pcap header.
-     * Some time has gone by since capturing pThis->StartNanoTS so get the
-     * current time again.
+     * Asynchronous capture: set up the rings and the writer thread.
      */
-    PcapFileHdr(pThis->hFile, RTTimeNanoTS());
+    RTTIMESPEC Now;
+    pThis->u64EpochNanoTSDelta = RTTimeSpecGetNano(RTTimeNow(&Now)) - RTTimeNanoTS();
+    pThis->StartNanoTS         = RTTimeNanoTS();
+    rc = drvNetSnifferWriteHdr(pThis);
+    if (RT_FAILURE(rc))
+        return PDMDrvHlpVMSetError(pDrvIns, rc, RT_SRC_POS, N_("Netsniffer cannot write to '%s'"), pThis->szFilename);
+
+    for (unsigned iDir = 0; iDir < RT_ELEMENTS(pThis->aRings); iDir++)
+    {
+        pThis->aRings[iDir].pbBuf = (uint8_t *)RTMemPageAlloc(cbRing);
+        if (!pThis->aRings[iDir].pbBuf)
+            return VERR_NO_MEMORY;
+        pThis->aRings[iDir].cbBuf = cbRing;
+    }
+
+    rc = RTSemEventCreate(&pThis->hEvtWriter);
+    AssertRCReturn(rc, rc);
+
+    rc = PDMDrvHlpThreadCreate(pDrvIns, &pThis->pWriterThread, pThis, drvNetSnifferWriterThread,
+                               drvNetSnifferWriterWakeup, 0, RTTHREADTYPE_IO, "NetSniff");
+    AssertRCReturn(rc, rc);
 
+    LogRel(("NetSniffer: Asynchronous %s capture, snaplen %u, %u KB ring per direction, max file size %llu bytes\n",
+            pThis->fPcapNg ? "pcapng" : "pcap", pThis->cbSnapLen, cbRing / _1K, pThis->cbMaxFile));
     return VINF_SUCCESS;
 }
 
@@ -61,6 +61,69 @@ struct pcaprec_hdr_init
     struct pcap_hdr     pcap;
 };
 
+/* pcapng block types. */
+#define PCAPNG_BT_SHB   UINT32_C(0x0a0d0d0a)    /* section header block */
+#define PCAPNG_BT_IDB   UINT32_C(0x00000001)    /* interface description block */
+#define PCAPNG_BT_EPB   UINT32_C(0x00000006)    /* enhanced packet block */
+
+/* pcapng option codes. */
+#define PCAPNG_OPT_ENDOFOPT     0
+#define PCAPNG_OPT_IF_TSRESOL   9
+#define PCAPNG_OPT_EPB_FLAGS    2
+
+/* pcapng section header block (without options). */
+struct pcapng_shb
+{
+    uint32_t    block_type;     /* PCAPNG_BT_SHB */
+    uint32_t    block_len;      /* total block length */
+    uint32_t    byte_order;     /* 0x1a2b3c4d */
+    uint16_t    version_major;  /* 1 */
+    uint16_t    version_minor;  /* 0 */
+    uint32_t    section_len_lo; /* -1 (64-bit), not specified */
+    uint32_t    section_len_hi;
+    uint32_t    block_len2;     /* total block length again */
+};
+
+/* pcapng interface description block with the timestamp resolution option. */
+struct pcapng_idb
+{
+    uint32_t    block_type;     /* PCAPNG_BT_IDB */
+    uint32_t    block_len;      /* total block length */
+    uint16_t    link_type;      /* 1 = ethernet */
+    uint16_t    reserved;
+    uint32_t    snaplen;        /* max length of captured packets, in octets */
+    uint16_t    tsresol_code;   /* PCAPNG_OPT_IF_TSRESOL */
+    uint16_t    tsresol_len;    /* 1 */
+    uint8_t     tsresol;        /* 9 = nanoseconds */
+    uint8_t     tsresol_pad[3];
+    uint16_t    end_code;       /* PCAPNG_OPT_ENDOFOPT */
+    uint16_t    end_len;        /* 0 */
+    uint32_t    block_len2;     /* total block length again */
+};
+
+/* pcapng enhanced packet block header, followed by the padded packet data. */
+struct pcapng_epb
+{
+    uint32_t    block_type;     /* PCAPNG_BT_EPB */
+    uint32_t    block_len;      /* total block length */
+    uint32_t    interface_id;   /* 0 */
+    uint32_t    ts_high;        /* upper 32 bits of the timestamp */
+    uint32_t    ts_low;         /* lower 32 bits of the timestamp */
+    uint32_t    cap_len;        /* number of octets of packet saved in file */
+    uint32_t    orig_len;       /* actual length of packet */
+};
+
+/* pcapng enhanced packet block trailer: the flags option and the block length. */
+struct pcapng_epb_trailer
+{
+    uint16_t    flags_code;     /* PCAPNG_OPT_EPB_FLAGS */
+    uint16_t    flags_len;      /* 4 */
+    uint32_t    flags;          /* PCAPNG_EPB_FLAGS_XXX */
+    uint16_t    end_code;       /* PCAPNG_OPT_ENDOFOPT */
+    uint16_t    end_len;        /* 0 */
+    uint32_t    block_len2;     /* total block length again */
+};
+
 
 /*********************************************************************************************************************************
 *   Global Variables                                                                                                             *
@@ -72,6 +135,7 @@ static pcaprec_hdr_init const s_Hdr =
 };
 
 static const char s_szDummyData[] = { 0, 0, 0, 0 };
+static const uint8_t s_abZeroPad[4] = { 0, 0, 0, 0 };
 
 /**
  * Internal helper.
@@ -86,6 +150,18 @@ static void pcapCalcHeader(struct pcaprec_hdr *pHdr, uint64_t StartNanoTS, size_
 }
 
 
+/**
+ * Internal helper.
+ */
+static void pcapCalcHeaderTS(struct pcaprec_hdr *pHdr, uint64_t u64RelNanoTS, size_t cbFrame, size_t cbMax)
+{
+    pHdr->ts_sec   = (uint32_t)(u64RelNanoTS / 1000000000);
+    pHdr->ts_usec  = (uint32_t)((u64RelNanoTS / 1000) % 1000000);
+    pHdr->incl_len = (uint32_t)RT_MIN(cbFrame, cbMax);
+    pHdr->orig_len = (uint32_t)cbFrame;
+}
+
+
 /**
  * Internal helper.
  */
@@ -133,6 +209,27 @@ int PcapStreamFrame(PRTSTREAM pStream, uint64_t StartNanoTS, const void *pvFrame
 }
 
 
+/**
+ * Writes a frame captured at an earlier time to a stream.
+ *
+ * @returns IPRT status code, @see RTStrmWrite.
+ *
+ * @param   pStream         The stream handle.
+ * @param   u64RelNanoTS    The capture time relative to the start of the capture.
+ * @param   pvFrame         The start of the frame.
+ * @param   cbFrame         The size of the frame.
+ * @param   cbMax           The max number of bytes to include in the file.
+ */
+int PcapStreamFrameTS(PRTSTREAM pStream, uint64_t u64RelNanoTS, const void *pvFrame, size_t cbFrame, size_t cbMax)
+{
+    struct pcaprec_hdr Hdr;
+    pcapCalcHeaderTS(&Hdr, u64RelNanoTS, cbFrame, cbMax);
+    int rc1 = RTStrmWrite(pStream, &Hdr, sizeof(Hdr));
+    int rc2 = RTStrmWrite(pStream, pvFrame, Hdr.incl_len);
+    return RT_SUCCESS(rc1) ? rc2 : rc1;
+}
+
+
 /**
  * Writes a GSO frame to a stream.
  *
@@ -176,6 +273,107 @@ int PcapStreamGsoFrame(PRTSTREAM pStream, uint64_t StartNanoTS, PCPDMNETWORKGSO
 }
 
 
+/**
+ * Writes the pcapng section header and interface description blocks.
+ *
+ * The interface uses nanosecond timestamp resolution.
+ *
+ * @returns IPRT status code, @see RTStrmWrite.
+ *
+ * @param   pStream         The stream handle.
+ * @param   cbSnapLen       The max number of bytes captured per frame.
+ */
+int PcapNgStreamHdr(PRTSTREAM pStream, uint32_t cbSnapLen)
+{
+    struct pcapng_shb Shb;
+    Shb.block_type      = PCAPNG_BT_SHB;
+    Shb.block_len       = sizeof(Shb);
+    Shb.byte_order      = UINT32_C(0x1a2b3c4d);
+    Shb.version_major   = 1;
+    Shb.version_minor   = 0;
+    Shb.section_len_lo  = UINT32_MAX;
+    Shb.section_len_hi  = UINT32_MAX;
+    Shb.block_len2      = sizeof(Shb);
+    AssertCompile(sizeof(Shb) == 28);
+
+    struct pcapng_idb Idb;
+    RT_ZERO(Idb);
+    Idb.block_type      = PCAPNG_BT_IDB;
+    Idb.block_len       = sizeof(Idb);
+    Idb.link_type       = 1;
+    Idb.snaplen         = cbSnapLen;
+    Idb.tsresol_code    = PCAPNG_OPT_IF_TSRESOL;
+    Idb.tsresol_len     = 1;
+    Idb.tsresol         = 9;
+    Idb.end_code        = PCAPNG_OPT_ENDOFOPT;
+    Idb.block_len2      = sizeof(Idb);
+    AssertCompile(sizeof(Idb) == 32);
+
+    int rc1 = RTStrmWrite(pStream, &Shb, sizeof(Shb));
+    int rc2 = RTStrmWrite(pStream, &Idb, sizeof(Idb));
+    return RT_SUCCESS(rc1) ? rc2 : rc1;
+}
+
+
+/**
+ * Calculates the size of a pcapng enhanced packet block.
+ *
+ * @returns Size in bytes.
+ * @param   cbFrame         The size of the frame.
+ * @param   cbMax           The max number of bytes to include in the file.
+ */
+size_t PcapNgCalcFrameSize(size_t cbFrame, size_t cbMax)
+{
+    return sizeof(struct pcapng_epb) + RT_ALIGN_Z(RT_MIN(cbFrame, cbMax), 4) + sizeof(struct pcapng_epb_trailer);
+}
+
+
+/**
+ * Writes a frame to a pcapng stream as an enhanced packet block.
+ *
+ * @returns IPRT status code, @see RTStrmWrite.
+ *
+ * @param   pStream         The stream handle.
+ * @param   u64EpochNanoTS  The capture time in nanoseconds since the epoch.
+ * @param   fFlags          PCAPNG_EPB_FLAGS_XXX.
+ * @param   pvFrame         The start of the frame.
+ * @param   cbFrame         The size of the frame.
+ * @param   cbMax           The max number of bytes to include in the file.
+ */
+int PcapNgStreamFrame(PRTSTREAM pStream, uint64_t u64EpochNanoTS, uint32_t fFlags,
+                      const void *pvFrame, size_t cbFrame, size_t cbMax)
+{
+    uint32_t const cbCap   = (uint32_t)RT_MIN(cbFrame, cbMax);
+    uint32_t const cbBlock = (uint32_t)PcapNgCalcFrameSize(cbFrame, cbMax);
+
+    struct pcapng_epb Epb;
+    Epb.block_type      = PCAPNG_BT_EPB;
+    Epb.block_len       = cbBlock;
+    Epb.interface_id    = 0;
+    Epb.ts_high         = (uint32_t)(u64EpochNanoTS >> 32);
+    Epb.ts_low          = (uint32_t)u64EpochNanoTS;
+    Epb.cap_len         = cbCap;
+    Epb.orig_len        = (uint32_t)cbFrame;
+
+    struct pcapng_epb_trailer Trailer;
+    Trailer.flags_code  = PCAPNG_OPT_EPB_FLAGS;
+    Trailer.flags_len   = sizeof(Trailer.flags);
+    Trailer.flags       = fFlags;
+    Trailer.end_code    = PCAPNG_OPT_ENDOFOPT;
+    Trailer.end_len     = 0;
+    Trailer.block_len2  = cbBlock;
+
+    int rc = RTStrmWrite(pStream, &Epb, sizeof(Epb));
+    if (RT_SUCCESS(rc))
+        rc = RTStrmWrite(pStream, pvFrame, cbCap);
+    if (RT_SUCCESS(rc) && (cbCap & 3))
+        rc = RTStrmWrite(pStream, s_abZeroPad, 4 - (cbCap & 3));
+    if (RT_SUCCESS(rc))
+        rc = RTStrmWrite(pStream, &Trailer, sizeof(Trailer));
+    return rc;
+}
+
+
 /**
  * Writes the file header.
  *
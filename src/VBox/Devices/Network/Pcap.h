@@ -28,6 +28,19 @@ int PcapStreamFrame(PRTSTREAM pStream, uint64_t StartNanoTS, const void *pvFrame
 int PcapStreamGsoFrame(PRTSTREAM pStream, uint64_t StartNanoTS, PCPDMNETWORKGSO pGso,
                        const void *pvFrame, size_t cbFrame, size_t cbMax);
 
+int PcapStreamFrameTS(PRTSTREAM pStream, uint64_t u64RelNanoTS, const void *pvFrame, size_t cbFrame, size_t cbMax);
+
+/** @name pcapng enhanced packet block flags (direction).
+ * @{ */
+#define PCAPNG_EPB_FLAGS_INBOUND    UINT32_C(0x00000001)
+#define PCAPNG_EPB_FLAGS_OUTBOUND   UINT32_C(0x00000002)
+/** @} */
+
+int PcapNgStreamHdr(PRTSTREAM pStream, uint32_t cbSnapLen);
+int PcapNgStreamFrame(PRTSTREAM pStream, uint64_t u64EpochNanoTS, uint32_t fFlags,
+                      const void *pvFrame, size_t cbFrame, size_t cbMax);
+size_t PcapNgCalcFrameSize(size_t cbFrame, size_t cbMax);
+
 int PcapFileHdr(RTFILE File, uint64_t StartNanoTS);
 int PcapFileFrame(RTFILE File, uint64_t StartNanoTS, const void *pvFrame, size_t cbFrame, size_t cbMax);
 int PcapFileGsoFrame(RTFILE File, uint64_t StartNanoTS, PCPDMNETWORKGSO pGso,
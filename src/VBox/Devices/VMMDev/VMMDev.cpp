@@ -1986,6 +1986,33 @@ static int vmmdevReqHandler_ChangeMemBalloon(PVMMDEV pThis, VMMDevRequestHeader
 }
 
 
+/**
+ * Handles VMMDevReq_ReportFreePages.
+ *
+ * @returns VBox status code that the guest should see.
+ * @param   pThis           The VMMDev instance data.
+ * @param   pReqHdr         The header of the request to handle.
+ */
+static int vmmdevReqHandler_ReportFreePages(PVMMDEV pThis, VMMDevRequestHeader *pReqHdr)
+{
+    VMMDevReportFreePages *pReq = (VMMDevReportFreePages *)pReqHdr;
+    AssertMsgReturn(pReq->header.size >= sizeof(*pReq), ("%u\n", pReq->header.size), VERR_INVALID_PARAMETER);
+    AssertMsgReturn(pReq->cRanges > 0 && pReq->cRanges <= VMMDEV_FREE_PAGES_MAX_RANGES, ("%u\n", pReq->cRanges),
+                    VERR_INVALID_PARAMETER);
+    AssertMsgReturn(pReq->header.size == (uint32_t)RT_OFFSETOF(VMMDevReportFreePages, aRanges[pReq->cRanges]),
+                    ("%u\n", pReq->header.size), VERR_INVALID_PARAMETER);
+
+    if (!pThis->fFreePageReporting)
+        return VERR_NOT_SUPPORTED;
+
+    Log(("VMMDevReq_ReportFreePages: %u ranges\n", pReq->cRanges));
+    AssertCompileSize(VMMDevFreePageRange, sizeof(PGMPHYSFREERANGE));
+    AssertCompileMembersSameSizeAndOffset(VMMDevFreePageRange, GCPhys, PGMPHYSFREERANGE, GCPhys);
+    AssertCompileMembersSameSizeAndOffset(VMMDevFreePageRange, cPages, PGMPHYSFREERANGE, cPages);
+    return PGMR3PhysReportFreePages(PDMDevHlpGetVM(pThis->pDevIns), pReq->cRanges, (PCPGMPHYSFREERANGE)&pReq->aRanges[0]);
+}
+
+
 /**
  * Handles VMMDevReq_GetStatisticsChangeRequest.
  *
@@ -2664,6 +2691,10 @@ static int vmmdevReqDispatcher(PVMMDEV pThis, VMMDevRequestHeader *pReqHdr, RTGC
             pReqHdr->rc = vmmdevReqHandler_ChangeMemBalloon(pThis, pReqHdr);
             break;
 
+        case VMMDevReq_ReportFreePages:
+            pReqHdr->rc = vmmdevReqHandler_ReportFreePages(pThis, pReqHdr);
+            break;
+
         case VMMDevReq_GetStatisticsChangeRequest:
             pReqHdr->rc = vmmdevReqHandler_GetStatisticsChangeRequest(pThis, pReqHdr);
             break;
@@ -4012,6 +4043,7 @@ static DECLCALLBACK(int) vmmdevConstruct(PPDMDEVINS pDevIns, int iInstance, PCFG
                                   "GuestCoreDumpEnabled|"
                                   "GuestCoreDumpDir|"
                                   "GuestCoreDumpCount|"
+                                  "FreePageReporting|"
                                   "HeartbeatInterval|"
                                   "HeartbeatTimeout|"
                                   "TestingEnabled|"
@@ -4069,6 +4101,11 @@ static DECLCALLBACK(int) vmmdevConstruct(PPDMDEVINS pDevIns, int iInstance, PCFG
         return PDMDEV_SET_ERROR(pDevIns, rc,
                                 N_("Configuration error: Failed querying \"GuestCoreDumpCount\" as a 32-bit unsigned integer"));
 
+    rc = CFGMR3QueryBoolDef(pCfg, "FreePageReporting", &pThis->fFreePageReporting, false);
+    if (RT_FAILURE(rc))
+        return PDMDEV_SET_ERROR(pDevIns, rc,
+                                N_("Configuration error: Failed querying \"FreePageReporting\" as a boolean"));
+
     rc = CFGMR3QueryU64Def(pCfg, "HeartbeatInterval", &pThis->cNsHeartbeatInterval, VMMDEV_HEARTBEAT_DEFAULT_INTERVAL);
     if (RT_FAILURE(rc))
         return PDMDEV_SET_ERROR(pDevIns, rc,
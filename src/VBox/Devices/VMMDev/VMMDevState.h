@@ -266,6 +266,10 @@ typedef struct VMMDevState
     /** Guest Core Dumping enabled. */
     bool fGuestCoreDumpEnabled;
 
+    /** Whether the guest may report free pages (VMMDevReq_ReportFreePages).
+     * Off by default, as long as no guest additions make use of it. */
+    bool fFreePageReporting;
+
     /** Guest Core Dump location. */
     char szGuestCoreDumpDir[RTPATH_MAX];
 
@@ -739,6 +739,8 @@ int vpciLoadExec(PVPCISTATE pState, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
         {
             rc = SSMR3GetU32(pSSM, &pState->nQueues);
             AssertRCReturn(rc, rc);
+            AssertLogRelMsgReturn(pState->nQueues <= VIRTIO_MAX_NQUEUES, ("%u\n", pState->nQueues),
+                                  VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
         }
         else
             pState->nQueues = nQueues;
@@ -28,7 +28,9 @@
  * for example.
  */
 #define VIRTIO_SAVEDSTATE_VERSION_3_1_BETA1 1
-#define VIRTIO_SAVEDSTATE_VERSION           2
+#define VIRTIO_SAVEDSTATE_VERSION_PRE_MQ    2
+#define VIRTIO_SAVEDSTATE_VERSION_PRE_GRO   3
+#define VIRTIO_SAVEDSTATE_VERSION           4
 /** @} */
 
 #define DEVICE_PCI_VENDOR_ID                0x1AF4
@@ -36,7 +38,8 @@
 #define DEVICE_PCI_SUBSYSTEM_VENDOR_ID      0x1AF4
 #define DEVICE_PCI_SUBSYSTEM_BASE_ID       1
 
-#define VIRTIO_MAX_NQUEUES                  3
+/** Enough for a virtio-net device with 8 RX/TX queue pairs plus the control queue. */
+#define VIRTIO_MAX_NQUEUES                  17
 
 #define VPCI_HOST_FEATURES                  0x0
 #define VPCI_GUEST_FEATURES                 0x4
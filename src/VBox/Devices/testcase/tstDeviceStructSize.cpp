@@ -299,6 +299,7 @@ int main()
 #endif
 #ifdef VBOX_WITH_VIRTIO
     CHECK_MEMBER_ALIGNMENT(VNETSTATE, StatReceiveBytes, 8);
+    CHECK_MEMBER_ALIGNMENT(VNETQUEUEPAIR, csRx, 8);
 #endif
     //CHECK_MEMBER_ALIGNMENT(E1KSTATE, csTx, 8);
 #ifdef VBOX_WITH_USB
@@ -1550,29 +1550,40 @@ int main()
     GEN_CHECK_OFF(VPCISTATE, Queues);
     GEN_CHECK_OFF(VPCISTATE, Queues[VIRTIO_MAX_NQUEUES]);
     GEN_CHECK_OFF(VNETSTATE, VPCI);
-    GEN_CHECK_OFF(VNETSTATE, INetworkDown);
     GEN_CHECK_OFF(VNETSTATE, INetworkConfig);
-    GEN_CHECK_OFF(VNETSTATE, pDrvBase);
     GEN_CHECK_OFF(VNETSTATE, pCanRxQueueR3);
     GEN_CHECK_OFF(VNETSTATE, pCanRxQueueR0);
     GEN_CHECK_OFF(VNETSTATE, pCanRxQueueRC);
     GEN_CHECK_OFF(VNETSTATE, pLinkUpTimer);
-# ifdef VNET_TX_DELAY
-    GEN_CHECK_OFF(VNETSTATE, pTxTimerR3);
-    GEN_CHECK_OFF(VNETSTATE, pTxTimerR0);
-    GEN_CHECK_OFF(VNETSTATE, pTxTimerRC);
-# endif /* VNET_TX_DELAY */
+    GEN_CHECK_OFF(VNETSTATE, cMaxQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, cCurQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, fGro);
+    GEN_CHECK_OFF(VNETSTATE, cUsGroFlush);
     GEN_CHECK_OFF(VNETSTATE, config);
     GEN_CHECK_OFF(VNETSTATE, macConfigured);
     GEN_CHECK_OFF(VNETSTATE, fCableConnected);
     GEN_CHECK_OFF(VNETSTATE, u32PktNo);
     GEN_CHECK_OFF(VNETSTATE, fPromiscuous);
     GEN_CHECK_OFF(VNETSTATE, fAllMulti);
-    GEN_CHECK_OFF(VNETSTATE, pRxQueue);
-    GEN_CHECK_OFF(VNETSTATE, pTxQueue);
     GEN_CHECK_OFF(VNETSTATE, pCtlQueue);
-    GEN_CHECK_OFF(VNETSTATE, fMaybeOutOfSpace);
-    GEN_CHECK_OFF(VNETSTATE, hEventMoreRxDescAvail);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs);
+    GEN_CHECK_OFF(VNETSTATE, aQueuePairs[1]);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, pThisR3);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, iPair);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, uIsTransmitting);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, INetworkDown);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, pDrvBase);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, pRxQueue);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, pTxQueue);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, pTxThread);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, hTxEvent);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, fMaybeOutOfSpace);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, hEventMoreRxDescAvail);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, csRx);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, pbGro);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, cbGro);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, GroGso);
+    GEN_CHECK_OFF(VNETQUEUEPAIR, pGroTimerR3);
 #endif /* VBOX_WITH_VIRTIO */
 
 #ifdef VBOX_WITH_SCSI
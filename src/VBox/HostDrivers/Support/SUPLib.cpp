@@ -920,6 +920,27 @@ SUPR3DECL(int) SUPR3PageAlloc(size_t cPages, void **ppvPages)
 }
 
 
+SUPR3DECL(int) SUPR3PageAllocHuge(size_t cPages, uint32_t fFlags, void **ppvPages)
+{
+    /*
+     * Validate.
+     */
+    AssertPtrReturn(ppvPages, VERR_INVALID_POINTER);
+    *ppvPages = NULL;
+    AssertReturn(cPages > 0 && !(cPages & ((_2M >> PAGE_SHIFT) - 1)), VERR_PAGE_COUNT_OUT_OF_RANGE);
+    AssertReturn(fFlags == SUP_PAGE_ALLOC_HUGE_F_THP || fFlags == SUP_PAGE_ALLOC_HUGE_F_HUGETLBFS, VERR_INVALID_FLAGS);
+
+    /*
+     * Call OS specific worker.
+     */
+#ifdef RT_OS_LINUX
+    return suplibOsPageAllocHuge(&g_supLibData, cPages, fFlags, ppvPages);
+#else
+    return VERR_NOT_SUPPORTED;
+#endif
+}
+
+
 SUPR3DECL(int) SUPR3PageFree(void *pvPages, size_t cPages)
 {
     /*
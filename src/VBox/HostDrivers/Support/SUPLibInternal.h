@@ -360,6 +360,7 @@ int     suplibOsIOCtlFast(PSUPLIBDATA pThis, uintptr_t uFunction, uintptr_t idCp
 int     suplibOsPageAlloc(PSUPLIBDATA pThis, size_t cPages, void **ppvPages);
 int     suplibOsPageFree(PSUPLIBDATA pThis, void *pvPages, size_t cPages);
 int     suplibOsQueryVTxSupported(void);
+int     suplibOsPageAllocHuge(PSUPLIBDATA pThis, size_t cPages, uint32_t fFlags, void **ppvPages);
 
 
 /**
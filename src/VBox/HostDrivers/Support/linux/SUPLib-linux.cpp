@@ -70,6 +70,13 @@
 #ifndef MADV_DONTFORK
 # define MADV_DONTFORK  10
 #endif
+/* define MADV_HUGEPAGE and MAP_HUGETLB if they're missing from the system headers. */
+#ifndef MADV_HUGEPAGE
+# define MADV_HUGEPAGE  14
+#endif
+#ifndef MAP_HUGETLB
+# define MAP_HUGETLB    0x40000
+#endif
 
 
 
@@ -255,6 +262,53 @@ int suplibOsPageFree(PSUPLIBDATA pThis, void *pvPages, size_t cPages)
 }
 
 
+int suplibOsPageAllocHuge(PSUPLIBDATA pThis, size_t cPages, uint32_t fFlags, void **ppvPages)
+{
+    size_t const cb = cPages << PAGE_SHIFT;
+    char        *pvPages;
+    if (fFlags & SUP_PAGE_ALLOC_HUGE_F_HUGETLBFS)
+    {
+        /*
+         * Take the pages from the reserved pool.  The mapping is aligned to
+         * the huge page size by the kernel and the pages are zeroed.
+         */
+        pvPages = (char *)mmap(NULL, cb, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pvPages == MAP_FAILED)
+            return errno == EINVAL ? VERR_NOT_SUPPORTED : VERR_NO_MEMORY;
+    }
+    else
+    {
+        /*
+         * Map 2MB more than we need and trim it down to an aligned range, then
+         * ask for transparent huge pages before touching anything.
+         */
+        char *pvMap = (char *)mmap(NULL, cb + _2M, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pvMap == MAP_FAILED)
+            return VERR_NO_MEMORY;
+        pvPages = (char *)RT_ALIGN_P(pvMap, _2M);
+        if (pvPages != pvMap)
+            munmap(pvMap, pvPages - pvMap);
+        if (pvPages + cb != pvMap + cb + _2M)
+            munmap(pvPages + cb, pvMap + cb + _2M - (pvPages + cb));
+
+        if (madvise(pvPages, cb, MADV_HUGEPAGE))
+        {
+            munmap(pvPages, cb);
+            return VERR_NOT_SUPPORTED;
+        }
+    }
+
+    /* See suplibOsPageAlloc. */
+    if (pThis->fSysMadviseWorks && madvise(pvPages, cb, MADV_DONTFORK))
+        LogRel(("SUPLib: madvise %p-%p failed\n", pvPages, cb));
+
+    /* Touch all the pages so they are faulted in as huge pages now. */
+    memset(pvPages, 0, cb);
+    *ppvPages = pvPages;
+    return VINF_SUCCESS;
+}
+
+
 /** Check if the host kernel supports VT-x or not.
  *
  * Older Linux kernels clear the VMXE bit in the CR4 register (function
@@ -819,6 +819,7 @@ private:
     HRESULT                     i_teleporterTrg(PUVM pUVM, IMachine *pMachine, Utf8Str *pErrorMsg, bool fStartPaused,
                                               Progress *pProgress, bool *pfPowerOffOnFailure);
     static DECLCALLBACK(int)    i_teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser);
+    static DECLCALLBACK(int)    i_teleporterTrgPostCopyThread(RTTHREAD hThreadSelf, void *pvUser);
     /** @} */
 
     void i_reportDriverVersions(void);
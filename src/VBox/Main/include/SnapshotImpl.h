@@ -88,6 +88,8 @@ public:
 
     bool i_sharesSavedStateFile(const Utf8Str &strPath,
                                 Snapshot *pSnapshotToIgnore);
+    void i_getSavedStateFiles(std::list<Utf8Str> &llFilenames,
+                              Snapshot *pSnapshotToIgnore);
 
     HRESULT i_saveSnapshot(settings::Snapshot &data) const;
     HRESULT i_saveSnapshotImpl(settings::Snapshot &data) const;
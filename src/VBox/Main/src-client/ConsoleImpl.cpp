@@ -105,6 +105,7 @@
 #endif /* VBOX_WITH_NETSHAPER */
 #include <VBox/vmm/mm.h>
 #include <VBox/vmm/ftm.h>
+#include <VBox/vmm/pgm.h>
 #include <VBox/vmm/ssm.h>
 #include <VBox/err.h>
 #include <VBox/param.h>
@@ -6404,6 +6405,30 @@ HRESULT Console::i_saveState(Reason_T aReason, const ComPtr<IProgress> &aProgres
         fPaused = true;
     }
 
+    /*
+     * Only save the RAM pages which changed since the state of the current
+     * snapshot if PGM is still tracking the changes relative to it.  PGM
+     * checks that, we just get a full save if it isn't.
+     */
+    ComPtr<ISnapshot> pCurrentSnapshot;
+    HRESULT hrc = mMachine->COMGETTER(CurrentSnapshot)(pCurrentSnapshot.asOutParam());
+    if (SUCCEEDED(hrc) && !pCurrentSnapshot.isNull())
+    {
+        ComPtr<IMachine> pSnapshotMachine;
+        Bstr bstrParent;
+        hrc = pCurrentSnapshot->COMGETTER(Machine)(pSnapshotMachine.asOutParam());
+        if (SUCCEEDED(hrc))
+            hrc = pSnapshotMachine->COMGETTER(StateFilePath)(bstrParent.asOutParam());
+        if (SUCCEEDED(hrc) && !bstrParent.isEmpty())
+        {
+            int vrc = PGMR3DeltaSetParent(ptrVM.rawUVM(), Utf8Str(bstrParent).c_str());
+            if (RT_SUCCESS(vrc))
+                LogRel(("Saving the state as a delta against '%ls'\n", bstrParent.raw()));
+            else if (vrc != VERR_NOT_SUPPORTED)
+                LogRel(("Saving the full state, cannot save a delta against '%ls' (%Rrc)\n", bstrParent.raw(), vrc));
+        }
+    }
+
     LogFlowFunc(("Saving the state to '%s'...\n", aStateFilePath.c_str()));
 
     mptrCancelableProgress = aProgress;
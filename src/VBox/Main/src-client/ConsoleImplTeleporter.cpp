@@ -28,23 +28,106 @@
 #include "HashedPw.h"
 
 #include <iprt/asm.h>
+#include <iprt/critsect.h>
 #include <iprt/err.h>
+#include <iprt/mem.h>
+#include <iprt/param.h>
+#include <iprt/pipe.h>
+#include <iprt/poll.h>
 #include <iprt/rand.h>
+#include <iprt/semaphore.h>
 #include <iprt/socket.h>
 #include <iprt/tcp.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
 #include <iprt/timer.h>
 
 #include <VBox/vmm/vmapi.h>
 #include <VBox/vmm/ssm.h>
+#include <VBox/vmm/pgm.h>
 #include <VBox/err.h>
 #include <VBox/version.h>
 #include <VBox/com/string.h>
 #include "VBox/com/ErrorInfo.h"
 
 
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The max number of TCP connections the stream can be striped over. */
+#define TELEPORTER_MAX_STREAMS              16
+/** The number of blocks each sender thread can have queued up (source). */
+#define TELEPORTER_SEND_QUEUE_DEPTH         8
+/** How long the live save must go without progress before we throttle the
+ * guest CPUs down another notch (milliseconds). */
+#define TELEPORTER_THROTTLE_STALL_MS        5000
+/** How much to lower the CPU execution cap for each throttle step (percent). */
+#define TELEPORTER_THROTTLE_STEP            20
+/** The lowest CPU execution cap we will throttle down to (percent). */
+#define TELEPORTER_THROTTLE_MIN_CAP         30
+
+/** @name Post-copy protocol.
+ * Once the VM has been handed over, the target sends the guest physical
+ * addresses of the pages it's missing as 64-bit requests.  The source
+ * replies with a 64-bit header (page address + flags) followed by the page
+ * content, and pushes the other pages it has to send in between.  When it
+ * has sent them all, it sends TELEPORTER_POSTCOPY_END and the target answers
+ * with the same value once it's done with the connection.
+ * @{ */
+/** End marker (both directions). */
+#define TELEPORTER_POSTCOPY_END             UINT64_MAX
+/** Page header flag: zero page, no content follows. */
+#define TELEPORTER_POSTCOPY_F_ZERO          RT_BIT_64(0)
+/** The max number of page requests queued up for sending (target). */
+#define TELEPORTER_POSTCOPY_MAX_REQS        256
+/** Poll set ID of the socket (target). */
+#define TELEPORTER_POSTCOPY_POLL_ID_SOCKET  0
+/** Poll set ID of the wakeup pipe (target). */
+#define TELEPORTER_POSTCOPY_POLL_ID_PIPE    1
+/** @} */
+
+
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
 *********************************************************************************************************************************/
+class TeleporterState;
+
+/**
+ * One of the TCP connections the stream is striped over.
+ *
+ * Block number N of the stream always travels on connection N modulo the
+ * connection count, so the receiver can reassemble the stream by reading the
+ * connections in a round robin fashion.  On the source each connection has a
+ * sender thread and a small queue of blocks, so a connection waiting for
+ * window space doesn't hold up the others.
+ */
+typedef struct TELEPORTERSTREAM
+{
+    /** The socket.  For connection 0 this is the command socket. */
+    RTSOCKET            hSocket;
+    /** The sender thread (source only). */
+    RTTHREAD            hThread;
+    /** Signalled when a block is queued or the thread should terminate. */
+    RTSEMEVENT          hEvtQueued;
+    /** Signalled by the sender thread when a block has been sent. */
+    RTSEMEVENT          hEvtSent;
+    /** The producer index (free running). */
+    uint32_t volatile   iHead;
+    /** The consumer index (free running). */
+    uint32_t volatile   iTail;
+    /** Tells the sender thread to terminate once the queue is empty. */
+    bool volatile       fTerminate;
+    /** The status of the first failed send, VINF_SUCCESS if none. */
+    int32_t volatile    rcSend;
+    /** The queued blocks (heap copies). */
+    void               *apvQueue[TELEPORTER_SEND_QUEUE_DEPTH];
+    /** The size of each queued block. */
+    uint32_t            acbQueue[TELEPORTER_SEND_QUEUE_DEPTH];
+    /** The owning state. */
+    TeleporterState    *pState;
+} TELEPORTERSTREAM;
+
+
 /**
  * Base class for the teleporter state.
  *
@@ -67,6 +150,19 @@ public:
     bool volatile       mfStopReading;
     bool volatile       mfEndOfStream;
     bool volatile       mfIOError;
+    /** Bytes sent or received on the stream connections, headers included. */
+    uint64_t volatile   mcbOnWire;
+    /** @} */
+
+    /** @name multi-connection stuff
+     * @{  */
+    /** The number of connections the stream is striped over, 1 if only
+     *  mhSocket is used (no maStreams). */
+    uint32_t            mcStreams;
+    /** The connection carrying the next (or current) block. */
+    uint32_t            miCurStream;
+    /** The connections, only used when mcStreams > 1. */
+    TELEPORTERSTREAM    maStreams[TELEPORTER_MAX_STREAMS];
     /** @} */
 
     TeleporterState(Console *pConsole, PUVM pUVM, Progress *pProgress, bool fIsSource)
@@ -80,7 +176,19 @@ public:
         , mfStopReading(false)
         , mfEndOfStream(false)
         , mfIOError(false)
+        , mcbOnWire(0)
+        , mcStreams(1)
+        , miCurStream(0)
     {
+        RT_ZERO(maStreams);
+        for (unsigned i = 0; i < RT_ELEMENTS(maStreams); i++)
+        {
+            maStreams[i].hSocket    = NIL_RTSOCKET;
+            maStreams[i].hThread    = NIL_RTTHREAD;
+            maStreams[i].hEvtQueued = NIL_RTSEMEVENT;
+            maStreams[i].hEvtSent   = NIL_RTSEMEVENT;
+            maStreams[i].pState     = this;
+        }
         VMR3RetainUVM(mpUVM);
     }
 
@@ -105,6 +213,31 @@ public:
     bool                mfSuspendedByUs;
     bool                mfUnlockedMedia;
 
+    /** @name throttling and statistics
+     * @{  */
+    /** Whether to throttle the guest CPUs when the live save stalls.  Off
+     *  unless VBoxInternal2/TeleporterThrottle is set. */
+    bool                mfThrottle;
+    /** Set when the throttling is over, the timer must no longer touch the
+     *  CPU execution cap then.  Protected by mThrottleCritSect. */
+    bool                mfThrottleStopped;
+    /** Serializes the throttle timer and the restoring of the cap. */
+    RTCRITSECT          mThrottleCritSect;
+    /** The CPU execution cap configured for the VM. */
+    uint32_t            muCpuCapOrg;
+    /** The CPU execution cap currently in effect. */
+    uint32_t volatile   muCpuCap;
+    /** RTTimeMilliTS of the last progress report. */
+    uint64_t volatile   mmsLastProgress;
+    /** RTTimeMilliTS of when the VM was suspended for the final pass, 0 if
+     *  not (yet) suspended. */
+    uint64_t volatile   mmsSuspended;
+    /** @} */
+
+    /** Whether to leave the pages dirtied too fast for the pre-copy passes
+     *  for after the target has resumed the VM (post-copy). */
+    bool                mfPostCopy;
+
     TeleporterStateSrc(Console *pConsole, PUVM pUVM, Progress *pProgress, MachineState_T enmOldMachineState)
         : TeleporterState(pConsole, pUVM, pProgress, true /*fIsSource*/)
         , muPort(UINT32_MAX)
@@ -112,7 +245,21 @@ public:
         , menmOldMachineState(enmOldMachineState)
         , mfSuspendedByUs(false)
         , mfUnlockedMedia(false)
+        , mfThrottle(false)
+        , mfThrottleStopped(false)
+        , muCpuCapOrg(100)
+        , muCpuCap(100)
+        , mmsLastProgress(0)
+        , mmsSuspended(0)
+        , mfPostCopy(false)
     {
+        int rc = RTCritSectInit(&mThrottleCritSect);
+        AssertLogRelRC(rc);
+    }
+
+    ~TeleporterStateSrc()
+    {
+        RTCritSectDelete(&mThrottleCritSect);
     }
 };
 
@@ -128,6 +275,10 @@ public:
     PRTTCPSERVER                mhServer;
     PRTTIMERLR                  mphTimerLR;
     bool                        mfLockedMedia;
+    /** Set if the source will send pages after the hand over. */
+    bool                        mfPostCopy;
+    /** Set if mhSocket has been handed to the post-copy thread. */
+    bool                        mfSocketHandedOver;
     int                         mRc;
     Utf8Str                     mErrorText;
 
@@ -140,6 +291,8 @@ public:
         , mhServer(NULL)
         , mphTimerLR(phTimerLR)
         , mfLockedMedia(false)
+        , mfPostCopy(false)
+        , mfSocketHandedOver(false)
         , mRc(VINF_SUCCESS)
         , mErrorText()
     {
@@ -147,6 +300,95 @@ public:
 };
 
 
+/**
+ * Post-copy state used by the destination side.
+ *
+ * This is owned by the post-copy thread, which is the only one using the
+ * socket after the hand over.  The EMTs queue their page requests here and
+ * poke the thread thru the wakeup pipe.
+ */
+class TeleporterPostCopyTrg
+{
+public:
+    ComPtr<Console>     mptrConsole;
+    PUVM                mpUVM;
+    RTSOCKET            mhSocket;
+    RTPOLLSET           mhPollSet;
+    RTPIPE              mhWakeupPipeR;
+    RTPIPE              mhWakeupPipeW;
+    /** Signalled once PGMR3PostCopyTrgStart has returned. */
+    RTSEMEVENT          mhEvtStarted;
+    /** Protects the request queue. */
+    RTCRITSECT          mCritSect;
+    /** The request queue producer index (free running). */
+    uint32_t            miReqHead;
+    /** The request queue consumer index (free running). */
+    uint32_t            miReqTail;
+    /** The queued page requests. */
+    RTGCPHYS            maReqs[TELEPORTER_POSTCOPY_MAX_REQS];
+
+    /** @name statistics
+     * @{ */
+    uint64_t            mcPages;
+    uint64_t            mcRequests;
+    uint64_t            mcRequestsDropped;
+    /** @} */
+
+    TeleporterPostCopyTrg(Console *pConsole, PUVM pUVM, RTSOCKET hSocket)
+        : mptrConsole(pConsole)
+        , mpUVM(pUVM)
+        , mhSocket(hSocket)
+        , mhPollSet(NIL_RTPOLLSET)
+        , mhWakeupPipeR(NIL_RTPIPE)
+        , mhWakeupPipeW(NIL_RTPIPE)
+        , mhEvtStarted(NIL_RTSEMEVENT)
+        , miReqHead(0)
+        , miReqTail(0)
+        , mcPages(0)
+        , mcRequests(0)
+        , mcRequestsDropped(0)
+    {
+        RT_ZERO(mCritSect);
+        VMR3RetainUVM(mpUVM);
+    }
+
+    /**
+     * Creates the synchronization objects and the poll set.
+     *
+     * @returns VBox status code.
+     */
+    int init()
+    {
+        int rc = RTCritSectInit(&mCritSect);
+        if (RT_SUCCESS(rc))
+            rc = RTSemEventCreate(&mhEvtStarted);
+        if (RT_SUCCESS(rc))
+            rc = RTPipeCreate(&mhWakeupPipeR, &mhWakeupPipeW, 0 /*fFlags*/);
+        if (RT_SUCCESS(rc))
+            rc = RTPollSetCreate(&mhPollSet);
+        if (RT_SUCCESS(rc))
+            rc = RTPollSetAddPipe(mhPollSet, mhWakeupPipeR, RTPOLL_EVT_READ, TELEPORTER_POSTCOPY_POLL_ID_PIPE);
+        if (RT_SUCCESS(rc))
+            rc = RTPollSetAddSocket(mhPollSet, mhSocket, RTPOLL_EVT_READ | RTPOLL_EVT_ERROR, TELEPORTER_POSTCOPY_POLL_ID_SOCKET);
+        return rc;
+    }
+
+    /** The socket is not closed here, the thread takes care of that. */
+    ~TeleporterPostCopyTrg()
+    {
+        if (mhPollSet != NIL_RTPOLLSET)
+            RTPollSetDestroy(mhPollSet);
+        RTPipeClose(mhWakeupPipeR);
+        RTPipeClose(mhWakeupPipeW);
+        RTSemEventDestroy(mhEvtStarted);
+        if (RTCritSectIsInitialized(&mCritSect))
+            RTCritSectDelete(&mCritSect);
+        VMR3ReleaseUVM(mpUVM);
+        mpUVM = NULL;
+    }
+};
+
+
 /**
  * TCP stream header.
  *
@@ -179,15 +421,14 @@ static const char g_szWelcome[] = "VirtualBox-Teleporter-1.0\n";
  *
  * @returns VBox status code.
  *
- * @param   pState      The teleporter state structure.
+ * @param   Sock        The socket to read from.
  * @param   pszBuf      The output buffer.
  * @param   cchBuf      The size of the output buffer.
  *
  */
-static int teleporterTcpReadLine(TeleporterState *pState, char *pszBuf, size_t cchBuf)
+static int teleporterTcpReadLine(RTSOCKET Sock, char *pszBuf, size_t cchBuf)
 {
     char       *pszStart = pszBuf;
-    RTSOCKET    Sock     = pState->mhSocket;
 
     AssertReturn(cchBuf > 1, VERR_INTERNAL_ERROR);
     *pszBuf = '\0';
@@ -232,7 +473,7 @@ Console::i_teleporterSrcReadACK(TeleporterStateSrc *pState, const char *pszWhich
                                 const char *pszNAckMsg /*= NULL*/)
 {
     char szMsg[256];
-    int vrc = teleporterTcpReadLine(pState, szMsg, sizeof(szMsg));
+    int vrc = teleporterTcpReadLine(pState->mhSocket, szMsg, sizeof(szMsg));
     if (RT_FAILURE(vrc))
         return setError(E_FAIL, tr("Failed reading ACK(%s): %Rrc"), pszWhich, vrc);
 
@@ -303,6 +544,200 @@ HRESULT Console::i_teleporterSrcSubmitCommand(TeleporterStateSrc *pState, const
 }
 
 
+/**
+ * Gets the socket carrying the current block.
+ *
+ * @returns Socket handle.
+ * @param   pState          The teleporter state data.
+ */
+DECLINLINE(RTSOCKET) teleporterTcpCurSocket(TeleporterState *pState)
+{
+    return pState->mcStreams > 1 ? pState->maStreams[pState->miCurStream].hSocket : pState->mhSocket;
+}
+
+
+/**
+ * Sender thread for one of the striped connections (source).
+ *
+ * @returns VINF_SUCCESS (ignored).
+ * @param   hThreadSelf     The thread handle.
+ * @param   pvUser          The TELEPORTERSTREAM.
+ */
+static DECLCALLBACK(int) teleporterTcpSendThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    TELEPORTERSTREAM *pStream = (TELEPORTERSTREAM *)pvUser;
+    NOREF(hThreadSelf);
+
+    for (;;)
+    {
+        uint32_t const iTail = pStream->iTail;
+        if (iTail == ASMAtomicReadU32(&pStream->iHead))
+        {
+            if (ASMAtomicReadBool(&pStream->fTerminate))
+                break;
+            RTSemEventWait(pStream->hEvtQueued, RT_INDEFINITE_WAIT);
+            continue;
+        }
+
+        uint32_t const   idx = iTail % TELEPORTER_SEND_QUEUE_DEPTH;
+        TELEPORTERTCPHDR Hdr;
+        Hdr.u32Magic = TELEPORTERTCPHDR_MAGIC;
+        Hdr.cb       = pStream->acbQueue[idx];
+
+        /* After a failure we only drain the queue, the producer picks up the
+           status and fails the save. */
+        if (RT_SUCCESS(pStream->rcSend))
+        {
+            int rc = RTTcpSgWriteL(pStream->hSocket, 2, &Hdr, sizeof(Hdr), pStream->apvQueue[idx], (size_t)Hdr.cb);
+            if (RT_SUCCESS(rc))
+                ASMAtomicAddU64(&pStream->pState->mcbOnWire, sizeof(Hdr) + Hdr.cb);
+            else
+            {
+                LogRel(("Teleporter/TCP: Write error on connection #%u: %Rrc (cb=%#x)\n",
+                        (unsigned)(pStream - &pStream->pState->maStreams[0]), rc, Hdr.cb));
+                ASMAtomicWriteS32(&pStream->rcSend, rc);
+            }
+        }
+        RTMemFree(pStream->apvQueue[idx]);
+        pStream->apvQueue[idx] = NULL;
+
+        ASMAtomicWriteU32(&pStream->iTail, iTail + 1);
+        RTSemEventSignal(pStream->hEvtSent);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Starts the sender threads for the striped connections (source).
+ *
+ * @returns VBox status code.
+ * @param   pState          The teleporter state data.
+ */
+static int teleporterTcpStartSenders(TeleporterState *pState)
+{
+    for (uint32_t i = 0; i < pState->mcStreams; i++)
+    {
+        TELEPORTERSTREAM *pStream = &pState->maStreams[i];
+        int rc = RTSemEventCreate(&pStream->hEvtQueued);
+        if (RT_SUCCESS(rc))
+            rc = RTSemEventCreate(&pStream->hEvtSent);
+        if (RT_SUCCESS(rc))
+            rc = RTThreadCreateF(&pStream->hThread, teleporterTcpSendThread, pStream, 0 /*cbStack*/,
+                                 RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "TeleSend%u", i);
+        if (RT_FAILURE(rc))
+        {
+            pStream->hThread = NIL_RTTHREAD;
+            return rc;
+        }
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Waits for the sender threads to empty their queues (source).
+ *
+ * @returns VBox status code, the first send failure if any.
+ * @param   pState          The teleporter state data.
+ */
+static int teleporterTcpFlushSenders(TeleporterState *pState)
+{
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = 0; i < pState->mcStreams; i++)
+    {
+        TELEPORTERSTREAM *pStream = &pState->maStreams[i];
+        while (ASMAtomicReadU32(&pStream->iTail) != pStream->iHead)
+            RTSemEventWait(pStream->hEvtSent, 1000);
+        if (RT_FAILURE(pStream->rcSend) && RT_SUCCESS(rc))
+            rc = pStream->rcSend;
+    }
+    return rc;
+}
+
+
+/**
+ * Terminates the sender threads and closes the extra connections.
+ *
+ * This is used on both sides, connection 0 is the command socket and is left
+ * for the caller to close.
+ *
+ * @param   pState          The teleporter state data.
+ */
+static void teleporterTcpDestroyStreams(TeleporterState *pState)
+{
+    for (uint32_t i = 0; i < RT_ELEMENTS(pState->maStreams); i++)
+    {
+        TELEPORTERSTREAM *pStream = &pState->maStreams[i];
+        if (pStream->hThread != NIL_RTTHREAD)
+        {
+            ASMAtomicWriteBool(&pStream->fTerminate, true);
+            RTSemEventSignal(pStream->hEvtQueued);
+            int rc = RTThreadWait(pStream->hThread, RT_MS_1SEC, NULL);
+            if (rc == VERR_TIMEOUT)
+            {
+                /* Stuck in a send, pull the rug out from under it. */
+                RTSocketShutdown(pStream->hSocket, true /*fRead*/, true /*fWrite*/);
+                rc = RTThreadWait(pStream->hThread, RT_INDEFINITE_WAIT, NULL);
+            }
+            AssertLogRelRC(rc);
+            pStream->hThread = NIL_RTTHREAD;
+        }
+        RTSemEventDestroy(pStream->hEvtQueued);
+        pStream->hEvtQueued = NIL_RTSEMEVENT;
+        RTSemEventDestroy(pStream->hEvtSent);
+        pStream->hEvtSent = NIL_RTSEMEVENT;
+        while (pStream->iTail != pStream->iHead)
+            RTMemFree(pStream->apvQueue[pStream->iTail++ % TELEPORTER_SEND_QUEUE_DEPTH]);
+
+        if (i > 0 && pStream->hSocket != NIL_RTSOCKET)
+        {
+            if (pState->mfIsSource)
+                RTTcpClientClose(pStream->hSocket);
+            else
+                RTTcpServerDisconnectClient2(pStream->hSocket);
+        }
+        pStream->hSocket = NIL_RTSOCKET;
+    }
+    pState->mcStreams = 1;
+}
+
+
+/**
+ * Queues a block on the next striped connection (source).
+ *
+ * @returns VBox status code.
+ * @param   pState          The teleporter state data.
+ * @param   pvBuf           The block data.
+ * @param   cb              The block size.
+ */
+static int teleporterTcpQueueBlock(TeleporterState *pState, const void *pvBuf, uint32_t cb)
+{
+    TELEPORTERSTREAM *pStream = &pState->maStreams[pState->miCurStream];
+    while (pStream->iHead - ASMAtomicReadU32(&pStream->iTail) >= TELEPORTER_SEND_QUEUE_DEPTH)
+    {
+        if (RT_FAILURE(pStream->rcSend))
+            break;
+        RTSemEventWait(pStream->hEvtSent, 1000);
+    }
+    int rc = pStream->rcSend;
+    if (RT_FAILURE(rc))
+        return rc;
+
+    void *pvCopy = RTMemDup(pvBuf, cb);
+    if (!pvCopy)
+        return VERR_NO_MEMORY;
+    uint32_t const idx = pStream->iHead % TELEPORTER_SEND_QUEUE_DEPTH;
+    pStream->apvQueue[idx] = pvCopy;
+    pStream->acbQueue[idx] = cb;
+    ASMAtomicWriteU32(&pStream->iHead, pStream->iHead + 1);
+    RTSemEventSignal(pStream->hEvtQueued);
+
+    pState->miCurStream = (pState->miCurStream + 1) % pState->mcStreams;
+    return VINF_SUCCESS;
+}
+
+
 /**
  * @copydoc SSMSTRMOPS::pfnWrite
  */
@@ -319,11 +754,24 @@ static DECLCALLBACK(int) teleporterTcpOpWrite(void *pvUser, uint64_t offStream,
         TELEPORTERTCPHDR Hdr;
         Hdr.u32Magic = TELEPORTERTCPHDR_MAGIC;
         Hdr.cb       = RT_MIN((uint32_t)cbToWrite, TELEPORTERTCPHDR_MAX_SIZE);
-        int rc = RTTcpSgWriteL(pState->mhSocket, 2, &Hdr, sizeof(Hdr), pvBuf, (size_t)Hdr.cb);
-        if (RT_FAILURE(rc))
+        if (pState->mcStreams > 1)
         {
-            LogRel(("Teleporter/TCP: Write error: %Rrc (cb=%#x)\n", rc, Hdr.cb));
-            return rc;
+            int rc = teleporterTcpQueueBlock(pState, pvBuf, Hdr.cb);
+            if (RT_FAILURE(rc))
+            {
+                LogRel(("Teleporter/TCP: Queue error: %Rrc (cb=%#x)\n", rc, Hdr.cb));
+                return rc;
+            }
+        }
+        else
+        {
+            int rc = RTTcpSgWriteL(pState->mhSocket, 2, &Hdr, sizeof(Hdr), pvBuf, (size_t)Hdr.cb);
+            if (RT_FAILURE(rc))
+            {
+                LogRel(("Teleporter/TCP: Write error: %Rrc (cb=%#x)\n", rc, Hdr.cb));
+                return rc;
+            }
+            pState->mcbOnWire += sizeof(Hdr) + Hdr.cb;
         }
         pState->moffStream += Hdr.cb;
         if (Hdr.cb == cbToWrite)
@@ -346,13 +794,14 @@ static DECLCALLBACK(int) teleporterTcpOpWrite(void *pvUser, uint64_t offStream,
  * @returns VBox status code.
  *
  * @param   pState          The teleporter state data.
+ * @param   hSocket         The socket to poll.
  */
-static int teleporterTcpReadSelect(TeleporterState *pState)
+static int teleporterTcpReadSelect(TeleporterState *pState, RTSOCKET hSocket)
 {
     int rc;
     do
     {
-        rc = RTTcpSelectOne(pState->mhSocket, 1000);
+        rc = RTTcpSelectOne(hSocket, 1000);
         if (RT_FAILURE(rc) && rc != VERR_TIMEOUT)
         {
             pState->mfIOError = true;
@@ -395,13 +844,14 @@ static DECLCALLBACK(int) teleporterTcpOpRead(void *pvUser, uint64_t offStream, v
          * If there is no more data in the current block, read the next
          * block header.
          */
+        RTSOCKET const hSocket = teleporterTcpCurSocket(pState);
         if (!pState->mcbReadBlock)
         {
-            rc = teleporterTcpReadSelect(pState);
+            rc = teleporterTcpReadSelect(pState, hSocket);
             if (RT_FAILURE(rc))
                 return rc;
             TELEPORTERTCPHDR Hdr;
-            rc = RTTcpRead(pState->mhSocket, &Hdr, sizeof(Hdr), NULL);
+            rc = RTTcpRead(hSocket, &Hdr, sizeof(Hdr), NULL);
             if (RT_FAILURE(rc))
             {
                 pState->mfIOError = true;
@@ -428,6 +878,7 @@ static DECLCALLBACK(int) teleporterTcpOpRead(void *pvUser, uint64_t offStream, v
             }
 
             pState->mcbReadBlock = Hdr.cb;
+            pState->mcbOnWire   += sizeof(Hdr) + Hdr.cb;
             if (pState->mfStopReading)
                 return VERR_EOF;
         }
@@ -435,11 +886,11 @@ static DECLCALLBACK(int) teleporterTcpOpRead(void *pvUser, uint64_t offStream, v
         /*
          * Read more data.
          */
-        rc = teleporterTcpReadSelect(pState);
+        rc = teleporterTcpReadSelect(pState, hSocket);
         if (RT_FAILURE(rc))
             return rc;
         uint32_t cb = (uint32_t)RT_MIN(pState->mcbReadBlock, cbToRead);
-        rc = RTTcpRead(pState->mhSocket, pvBuf, cb, pcbRead);
+        rc = RTTcpRead(hSocket, pvBuf, cb, pcbRead);
         if (RT_FAILURE(rc))
         {
             pState->mfIOError = true;
@@ -447,15 +898,15 @@ static DECLCALLBACK(int) teleporterTcpOpRead(void *pvUser, uint64_t offStream, v
             return rc;
         }
         if (pcbRead)
-        {
             cb = (uint32_t)*pcbRead;
-            pState->moffStream   += cb;
-            pState->mcbReadBlock -= cb;
-            return VINF_SUCCESS;
-        }
         pState->moffStream   += cb;
         pState->mcbReadBlock -= cb;
-        if (cbToRead == cb)
+
+        /* The next block comes in on the next connection. */
+        if (!pState->mcbReadBlock && pState->mcStreams > 1)
+            pState->miCurStream = (pState->miCurStream + 1) % pState->mcStreams;
+
+        if (pcbRead || cbToRead == cb)
             return VINF_SUCCESS;
 
         /* Advance to the next block. */
@@ -530,15 +981,28 @@ static DECLCALLBACK(int) teleporterTcpOpClose(void *pvUser, bool fCanceled)
 
     if (pState->mfIsSource)
     {
+        /* When striping, everything queued must be on the wire before the
+           EOF header.  It goes out on the connection the next block is due
+           on, which is where the receiver is looking for it.  Sending it on
+           the others would leave unread headers behind, on the command
+           connection in particular. */
+        if (pState->mcStreams > 1)
+        {
+            int rc = teleporterTcpFlushSenders(pState);
+            if (RT_FAILURE(rc) && !fCanceled)
+                return rc;
+        }
+
         TELEPORTERTCPHDR EofHdr;
         EofHdr.u32Magic = TELEPORTERTCPHDR_MAGIC;
         EofHdr.cb       = fCanceled ? UINT32_MAX : 0;
-        int rc = RTTcpWrite(pState->mhSocket, &EofHdr, sizeof(EofHdr));
+        int rc = RTTcpWrite(teleporterTcpCurSocket(pState), &EofHdr, sizeof(EofHdr));
         if (RT_FAILURE(rc))
         {
             LogRel(("Teleporter/TCP: EOF Header write error: %Rrc\n", rc));
             return rc;
         }
+        pState->mcbOnWire += sizeof(EofHdr);
     }
     else
     {
@@ -586,6 +1050,8 @@ static void teleporterProgressCancelCallback(void *pvUser)
 static DECLCALLBACK(int) teleporterProgressCallback(PUVM pUVM, unsigned uPercent, void *pvUser)
 {
     TeleporterState *pState = (TeleporterState *)pvUser;
+    if (pState->mfIsSource)
+        ASMAtomicWriteU64(&((TeleporterStateSrc *)pState)->mmsLastProgress, RTTimeMilliTS());
     if (pState->mptrProgress)
     {
         HRESULT hrc = pState->mptrProgress->SetCurrentOperationProgress(uPercent);
@@ -607,6 +1073,65 @@ static DECLCALLBACK(int) teleporterProgressCallback(PUVM pUVM, unsigned uPercent
 }
 
 
+/**
+ * @copydoc FNRTTIMERLR
+ *
+ * Throttles the guest CPUs of the source VM a notch when the live save hasn't
+ * made any progress for a while, i.e. when the guest dirties memory faster
+ * than we can ship it across.
+ */
+static DECLCALLBACK(void) teleporterSrcThrottleTimer(RTTIMERLR hTimerLR, void *pvUser, uint64_t iTick)
+{
+    TeleporterStateSrc *pState = (TeleporterStateSrc *)pvUser;
+    NOREF(hTimerLR); NOREF(iTick);
+
+    if (ASMAtomicReadU64(&pState->mmsSuspended))
+        return;
+    uint64_t const msNow = RTTimeMilliTS();
+    uint64_t const msLast = ASMAtomicReadU64(&pState->mmsLastProgress);
+    if (msNow - msLast < TELEPORTER_THROTTLE_STALL_MS)
+        return;
+
+    RTCritSectEnter(&pState->mThrottleCritSect);
+    if (pState->mfThrottleStopped)
+    {
+        RTCritSectLeave(&pState->mThrottleCritSect);
+        return;
+    }
+    uint32_t const uOldCap = pState->muCpuCap;
+    if (uOldCap > TELEPORTER_THROTTLE_MIN_CAP)
+    {
+        uint32_t const uNewCap = uOldCap > TELEPORTER_THROTTLE_MIN_CAP + TELEPORTER_THROTTLE_STEP
+                               ? uOldCap - TELEPORTER_THROTTLE_STEP : TELEPORTER_THROTTLE_MIN_CAP;
+        int rc = VMR3SetCpuExecutionCap(pState->mpUVM, uNewCap);
+        if (RT_SUCCESS(rc))
+        {
+            LogRel(("Teleporter: No progress for %RU64 ms, throttling the guest CPUs to %u%%\n", msNow - msLast, uNewCap));
+            ASMAtomicWriteU32(&pState->muCpuCap, uNewCap);
+        }
+    }
+    RTCritSectLeave(&pState->mThrottleCritSect);
+    ASMAtomicWriteU64(&pState->mmsLastProgress, msNow);
+}
+
+
+/**
+ * @copydoc FNVMATSTATE
+ *
+ * Records when the source VM is suspended for the final pass so we can report
+ * the actual downtime.
+ */
+static DECLCALLBACK(void) teleporterSrcAtState(PUVM pUVM, VMSTATE enmState, VMSTATE enmOldState, void *pvUser)
+{
+    TeleporterStateSrc *pState = (TeleporterStateSrc *)pvUser;
+    NOREF(pUVM); NOREF(enmOldState);
+
+    if (   enmState == VMSTATE_SUSPENDING_LS
+        || enmState == VMSTATE_SUSPENDING_EXT_LS)
+        ASMAtomicCmpXchgU64(&pState->mmsSuspended, RTTimeMilliTS(), 0);
+}
+
+
 /**
  * @copydoc FNRTTIMERLR
  */
@@ -617,6 +1142,179 @@ static DECLCALLBACK(void) teleporterDstTimeout(RTTIMERLR hTimerLR, void *pvUser,
 }
 
 
+/**
+ * Reads an ACK from one of the additional data connections.
+ *
+ * @returns VBox status code.
+ * @param   hSocket             The data connection.
+ */
+static int teleporterSrcReadStreamACK(RTSOCKET hSocket)
+{
+    char szMsg[128];
+    int vrc = teleporterTcpReadLine(hSocket, szMsg, sizeof(szMsg));
+    if (RT_SUCCESS(vrc) && strcmp(szMsg, "ACK"))
+    {
+        LogRel(("Teleporter: Expected ACK on data connection, got '%s'\n", szMsg));
+        int32_t vrc2;
+        if (   strncmp(szMsg, RT_STR_TUPLE("NACK="))
+            || RTStrToInt32Full(&szMsg[sizeof("NACK=") - 1], 10, &vrc2) != VINF_SUCCESS
+            || RT_SUCCESS(vrc2))
+            vrc2 = VERR_WRONG_ORDER;
+        vrc = vrc2;
+    }
+    return vrc;
+}
+
+
+/**
+ * Connects and authenticates one of the additional data connections used for
+ * striping the stream.
+ *
+ * @returns VBox status code.
+ * @param   pState              The teleporter source state.
+ * @param   iStream             The connection number (1 based).
+ */
+static int teleporterSrcConnectStream(TeleporterStateSrc *pState, uint32_t iStream)
+{
+    RTSOCKET hSocket;
+    int vrc = RTTcpClientConnect(pState->mstrHostname.c_str(), pState->muPort, &hSocket);
+    if (RT_FAILURE(vrc))
+        return vrc;
+    pState->maStreams[iStream].hSocket = hSocket; /* The caller cleans up. */
+    vrc = RTTcpSetSendCoalescing(hSocket, false /*fEnable*/);
+    AssertRC(vrc);
+
+    char szLine[RT_MAX(128, sizeof(g_szWelcome))];
+    RT_ZERO(szLine);
+    vrc = RTTcpRead(hSocket, szLine, sizeof(g_szWelcome) - 1, NULL);
+    if (RT_FAILURE(vrc))
+        return vrc;
+    if (strcmp(szLine, g_szWelcome))
+        return VERR_WRONG_ORDER;
+
+    /* Note! mstrPassword has a trailing newline at this point. */
+    vrc = RTTcpWrite(hSocket, pState->mstrPassword.c_str(), pState->mstrPassword.length());
+    if (RT_SUCCESS(vrc))
+        vrc = teleporterSrcReadStreamACK(hSocket);
+    if (RT_FAILURE(vrc))
+        return vrc;
+
+    size_t cch = RTStrPrintf(szLine, sizeof(szLine), "stream=%u\n", iStream);
+    vrc = RTTcpWrite(hSocket, szLine, cch);
+    if (RT_SUCCESS(vrc))
+        vrc = teleporterSrcReadStreamACK(hSocket);
+    return vrc;
+}
+
+
+/**
+ * Sends a post-copy page to the target (source).
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_FOUND if the page has been sent already.
+ * @param   pState          The teleporter source state.
+ * @param   GCPhys          The page address.
+ * @param   pbBuf           Buffer of sizeof(uint64_t) + PAGE_SIZE bytes.
+ */
+static int teleporterSrcPostCopySendPage(TeleporterStateSrc *pState, RTGCPHYS GCPhys, uint8_t *pbBuf)
+{
+    bool fZero = false;
+    int vrc = PGMR3PostCopySrcReadPage(pState->mpUVM, GCPhys, pbBuf + sizeof(uint64_t), &fZero);
+    if (RT_SUCCESS(vrc))
+    {
+        uint64_t const u64Hdr = GCPhys | (fZero ? TELEPORTER_POSTCOPY_F_ZERO : 0);
+        memcpy(pbBuf, &u64Hdr, sizeof(u64Hdr));
+        vrc = RTTcpWrite(pState->mhSocket, pbBuf, sizeof(u64Hdr) + (fZero ? 0 : PAGE_SIZE));
+    }
+    return vrc;
+}
+
+
+/**
+ * Serves the post-copy phase after the VM has been handed over (source).
+ *
+ * Pages the target asks for are sent ahead of the remaining ones, which are
+ * pushed in guest physical address order.
+ *
+ * @returns VBox status code.
+ * @param   pState          The teleporter source state.
+ */
+static int teleporterSrcPostCopy(TeleporterStateSrc *pState)
+{
+    uint8_t *pbBuf = (uint8_t *)RTMemTmpAlloc(sizeof(uint64_t) + PAGE_SIZE);
+    if (!pbBuf)
+        return VERR_NO_TMP_MEMORY;
+
+    uint32_t const cPages     = PGMR3PostCopyGetPendingPages(pState->mpUVM);
+    uint64_t const msStart    = RTTimeMilliTS();
+    uint64_t       cRequested = 0;
+    uint64_t       cPushed    = 0;
+    bool           fEndSent   = false;
+    int            vrc;
+    for (;;)
+    {
+        /*
+         * Serve requests first.  Once we've sent everything we only wait for
+         * the target to say it's done, ignoring requests for pages in flight.
+         */
+        vrc = RTTcpSelectOne(pState->mhSocket, fEndSent ? 60 * RT_MS_1SEC : 0);
+        if (RT_SUCCESS(vrc))
+        {
+            uint64_t u64Req;
+            vrc = RTTcpRead(pState->mhSocket, &u64Req, sizeof(u64Req), NULL);
+            if (RT_FAILURE(vrc))
+                break;
+            if (u64Req == TELEPORTER_POSTCOPY_END)
+                break;
+            if (u64Req & PAGE_OFFSET_MASK)
+            {
+                vrc = VERR_INVALID_PARAMETER;
+                break;
+            }
+            vrc = teleporterSrcPostCopySendPage(pState, u64Req, pbBuf);
+            if (vrc == VERR_NOT_FOUND)
+                vrc = VINF_SUCCESS;
+            else if (RT_SUCCESS(vrc))
+                cRequested++;
+            else
+                break;
+            continue;
+        }
+        if (vrc != VERR_TIMEOUT || fEndSent)
+            break;
+
+        /*
+         * Push the next page, or the end marker.
+         */
+        RTGCPHYS GCPhys;
+        vrc = PGMR3PostCopySrcNextPage(pState->mpUVM, &GCPhys);
+        if (RT_SUCCESS(vrc))
+        {
+            vrc = teleporterSrcPostCopySendPage(pState, GCPhys, pbBuf);
+            if (RT_SUCCESS(vrc))
+                cPushed++;
+            else if (vrc != VERR_NOT_FOUND)
+                break;
+        }
+        else if (vrc == VERR_NOT_FOUND)
+        {
+            uint64_t const u64End = TELEPORTER_POSTCOPY_END;
+            vrc = RTTcpWrite(pState->mhSocket, &u64End, sizeof(u64End));
+            if (RT_FAILURE(vrc))
+                break;
+            fEndSent = true;
+        }
+        else
+            break;
+    }
+
+    RTMemTmpFree(pbBuf);
+    LogRel(("Teleporter: Post-copy sent %'RU64 requested and %'RU64 pushed pages (of %u) in %'RU64 ms: %Rrc\n",
+            cRequested, cPushed, cPages, RTTimeMilliTS() - msStart, vrc));
+    return vrc;
+}
+
+
 /**
  * Do the teleporter.
  *
@@ -671,6 +1369,43 @@ HRESULT Console::i_teleporterSrc(TeleporterStateSrc *pState)
     if (FAILED(hrc))
         return hrc;
 
+    /*
+     * Set up the additional data connections if we're striping the stream.
+     * (Note. The caller cleans these up too.)
+     */
+    if (pState->mcStreams > 1)
+    {
+        hrc = i_teleporterSrcSubmitCommand(pState, Utf8StrFmt("streams=%u", pState->mcStreams).c_str());
+        if (FAILED(hrc))
+            return hrc;
+        pState->maStreams[0].hSocket = pState->mhSocket;
+        for (uint32_t iStream = 1; iStream < pState->mcStreams; iStream++)
+        {
+            vrc = teleporterSrcConnectStream(pState, iStream);
+            if (RT_FAILURE(vrc))
+                return setError(E_FAIL, tr("Failed to set up data connection #%u to port %u on '%s': %Rrc"),
+                                iStream, pState->muPort, pState->mstrHostname.c_str(), vrc);
+        }
+        vrc = teleporterTcpStartSenders(pState);
+        if (RT_FAILURE(vrc))
+            return setError(E_FAIL, tr("Failed to start the sender threads: %Rrc"), vrc);
+        LogRel(("Teleporter: Striping the stream over %u connections\n", pState->mcStreams));
+    }
+
+    /*
+     * Ask for post-copy.  Like striping, the target must support it.
+     */
+    if (pState->mfPostCopy)
+    {
+        hrc = i_teleporterSrcSubmitCommand(pState, "post-copy");
+        if (FAILED(hrc))
+            return hrc;
+        vrc = PGMR3PostCopySrcEnable(pState->mpUVM, true /*fEnable*/);
+        if (RT_FAILURE(vrc))
+            return setError(E_FAIL, tr("Failed to enable post-copy: %Rrc"), vrc);
+        LogRel(("Teleporter: Post-copy enabled\n"));
+    }
+
     /*
      * Start loading the state.
      *
@@ -682,6 +1417,28 @@ HRESULT Console::i_teleporterSrc(TeleporterStateSrc *pState)
     if (FAILED(hrc))
         return hrc;
 
+    /* Watch for stalls and for the final suspend while the live save runs. */
+    uint64_t const offStart = pState->moffStream;
+    uint64_t const msStart  = RTTimeMilliTS();
+    pState->mmsLastProgress = msStart;
+    RTTIMERLR hThrottleTimer = NIL_RTTIMERLR;
+    if (pState->mfThrottle)
+    {
+        vrc = RTTimerLRCreateEx(&hThrottleTimer, RT_NS_1SEC_64 / 2, RTTIMER_FLAGS_CPU_ANY, teleporterSrcThrottleTimer, pState);
+        if (RT_SUCCESS(vrc))
+        {
+            vrc = RTTimerLRStart(hThrottleTimer, 0 /*u64First*/);
+            if (RT_FAILURE(vrc))
+            {
+                RTTimerLRDestroy(hThrottleTimer);
+                hThrottleTimer = NIL_RTTIMERLR;
+            }
+        }
+        if (RT_FAILURE(vrc))
+            LogRel(("Teleporter: Failed to start the throttle timer: %Rrc\n", vrc));
+    }
+    int vrc2 = VMR3AtStateRegister(pState->mpUVM, teleporterSrcAtState, pState); AssertRC(vrc2);
+
     RTSocketRetain(pState->mhSocket);
     void *pvUser = static_cast<void *>(static_cast<TeleporterState *>(pState));
     vrc = VMR3Teleport(pState->mpUVM,
@@ -690,6 +1447,23 @@ HRESULT Console::i_teleporterSrc(TeleporterStateSrc *pState)
                        teleporterProgressCallback,  pvUser,
                        &pState->mfSuspendedByUs);
     RTSocketRelease(pState->mhSocket);
+
+    vrc2 = VMR3AtStateDeregister(pState->mpUVM, teleporterSrcAtState, pState); AssertRC(vrc2);
+
+    /* Put the CPU execution cap back, whichever way the teleport went.  The
+       timer might still be running (RTTimerLRDestroy doesn't wait for long),
+       so stop it from touching the cap first. */
+    RTCritSectEnter(&pState->mThrottleCritSect);
+    pState->mfThrottleStopped = true;
+    if (pState->muCpuCap != pState->muCpuCapOrg)
+    {
+        LogRel(("Teleporter: Restoring the CPU execution cap to %u%%\n", pState->muCpuCapOrg));
+        vrc2 = VMR3SetCpuExecutionCap(pState->mpUVM, pState->muCpuCapOrg); AssertLogRelRC(vrc2);
+        pState->muCpuCap = pState->muCpuCapOrg;
+    }
+    RTCritSectLeave(&pState->mThrottleCritSect);
+    RTTimerLRDestroy(hThrottleTimer);
+
     if (RT_FAILURE(vrc))
     {
         if (   vrc == VERR_SSM_CANCELLED
@@ -741,6 +1515,25 @@ HRESULT Console::i_teleporterSrc(TeleporterStateSrc *pState)
     if (FAILED(hrc))
         return hrc;
 
+    uint64_t const msDone = RTTimeMilliTS();
+    uint64_t const msSuspended = pState->mmsSuspended;
+    LogRel(("Teleporter: Sent %'RU64 bytes (%'RU64 on the wire) over %u connection(s) in %'RU64 ms\n",
+            pState->moffStream - offStart, pState->mcbOnWire, pState->mcStreams, msDone - msStart));
+    if (msSuspended)
+        LogRel(("Teleporter: Downtime %'RU64 ms (%u ms requested)\n", msDone - msSuspended, pState->mcMsMaxDowntime));
+
+    /*
+     * Send the pages left for post-copy.  The VM runs on the target now, so
+     * there is no going back; a failure here leaves the target suspended
+     * with a runtime error and we power off as usual.
+     */
+    if (pState->mfPostCopy)
+    {
+        vrc = teleporterSrcPostCopy(pState);
+        if (RT_FAILURE(vrc))
+            LogRel(("Teleporter: Post-copy failed, the VM on the target is lost: %Rrc\n", vrc));
+    }
+
     /*
      * teleporterSrcThreadWrapper will do the automatic power off because it
      * has to release the AutoVMCaller.
@@ -771,7 +1564,15 @@ Console::i_teleporterSrcThreadWrapper(RTTHREAD hThread, void *pvUser)
     if (SUCCEEDED(hrc))
         hrc = pState->mptrConsole->i_teleporterSrc(pState);
 
+    /* Forget about post-copy, whether we got to send the pages or not. */
+    if (pState->mfPostCopy && SUCCEEDED(ptrVM.rc()))
+    {
+        int vrc2 = PGMR3PostCopyEnd(pState->mpUVM);
+        AssertLogRelRC(vrc2);
+    }
+
     /* Close the connection ASAP on so that the other side can complete. */
+    teleporterTcpDestroyStreams(pState);
     if (pState->mhSocket != NIL_RTSOCKET)
     {
         RTTcpClientClose(pState->mhSocket);
@@ -976,11 +1777,43 @@ HRESULT Console::teleport(const com::Utf8Str &aHostname, ULONG aTcpport, const c
     if (FAILED(hrc))
         return hrc;
 
+    /*
+     * Get the transport tuning knobs.  Striping must be supported by the
+     * target, so it's not enabled by default.  Stronger compression is
+     * configured via the SSM/ZipCodec and SSM/ZipThreads CFGM keys.
+     */
+    Bstr bstrValue;
+    hrc = mMachine->GetExtraData(Bstr("VBoxInternal2/TeleporterStreams").raw(), bstrValue.asOutParam());
+    uint32_t cStreams = SUCCEEDED(hrc) ? Utf8Str(bstrValue).toUInt32() : 0;
+    if (cStreams > TELEPORTER_MAX_STREAMS)
+    {
+        LogRel(("Teleporter: Limiting the number of connections to %u (requested %u)\n", TELEPORTER_MAX_STREAMS, cStreams));
+        cStreams = TELEPORTER_MAX_STREAMS;
+    }
+    else if (!cStreams)
+        cStreams = 1;
+
+    hrc = mMachine->GetExtraData(Bstr("VBoxInternal2/TeleporterThrottle").raw(), bstrValue.asOutParam());
+    bool const fThrottle = SUCCEEDED(hrc) && Utf8Str(bstrValue).toUInt32() != 0;
+
+    hrc = mMachine->GetExtraData(Bstr("VBoxInternal2/TeleporterPostCopy").raw(), bstrValue.asOutParam());
+    bool const fPostCopy = SUCCEEDED(hrc) && Utf8Str(bstrValue).toUInt32() != 0;
+
+    ULONG uCpuCap = 100;
+    hrc = mMachine->COMGETTER(CPUExecutionCap)(&uCpuCap);
+    if (FAILED(hrc) || uCpuCap < 1 || uCpuCap > 100)
+        uCpuCap = 100;
+
     TeleporterStateSrc *pState = new TeleporterStateSrc(this, mpUVM, ptrProgress, mMachineState);
     pState->mstrPassword    = strPassword;
     pState->mstrHostname    = aHostname;
     pState->muPort          = aTcpport;
     pState->mcMsMaxDowntime = aMaxDowntime;
+    pState->mcStreams       = cStreams;
+    pState->mfThrottle      = fThrottle;
+    pState->mfPostCopy      = fPostCopy;
+    pState->muCpuCapOrg     = uCpuCap;
+    pState->muCpuCap        = uCpuCap;
 
     void *pvUser = static_cast<void *>(static_cast<TeleporterState *>(pState));
     ptrProgress->i_setCancelCallback(teleporterProgressCancelCallback, pvUser);
@@ -1016,6 +1849,10 @@ HRESULT Console::teleport(const com::Utf8Str &aHostname, ULONG aTcpport, const c
  * Creates a TCP server that listens for the source machine and passes control
  * over to Console::teleporterTrgServeConnection().
  *
+ * The connections are accepted one by one using RTTcpServerListen2 so that
+ * the command connection can accept the additional data connections used for
+ * striping the stream on the same port.
+ *
  * @returns VBox status code.
  * @param   pUVM                The user-mode VM handle
  * @param   pMachine            The IMachine for the virtual machine.
@@ -1112,7 +1949,18 @@ HRESULT Console::i_teleporterTrg(PUVM pUVM, IMachine *pMachine, Utf8Str *pErrorM
                 hrc = pProgress->SetNextOperation(Bstr(tr("Waiting for incoming VM")).raw(), 1);
                 if (SUCCEEDED(hrc))
                 {
-                    vrc = RTTcpServerListen(hServer, Console::i_teleporterTrgServeConnection, &theState);
+                    for (;;)
+                    {
+                        RTSOCKET hSocket;
+                        vrc = RTTcpServerListen2(hServer, &hSocket);
+                        if (RT_FAILURE(vrc))
+                            break;
+                        vrc = Console::i_teleporterTrgServeConnection(hSocket, &theState);
+                        if (!theState.mfSocketHandedOver)
+                            RTTcpServerDisconnectClient2(hSocket);
+                        if (vrc == VERR_TCP_SERVER_STOP)
+                            break;
+                    }
                     pProgress->i_setCancelCallback(NULL, NULL);
 
                     if (vrc == VERR_TCP_SERVER_STOP)
@@ -1145,12 +1993,12 @@ HRESULT Console::i_teleporterTrg(PUVM pUVM, IMachine *pMachine, Utf8Str *pErrorM
                             hrc = setError(E_FAIL, tr("Teleporting canceled"));
                         else
                             hrc = setError(E_FAIL, tr("Teleporter timed out waiting for incoming connection"));
-                        LogRel(("Teleporter: RTTcpServerListen aborted - %Rrc\n", vrc));
+                        LogRel(("Teleporter: RTTcpServerListen2 aborted - %Rrc\n", vrc));
                     }
                     else
                     {
-                        hrc = setError(E_FAIL, tr("Unexpected RTTcpServerListen status code %Rrc"), vrc);
-                        LogRel(("Teleporter: Unexpected RTTcpServerListen rc: %Rrc\n", vrc));
+                        hrc = setError(E_FAIL, tr("Unexpected RTTcpServerListen2 status code %Rrc"), vrc);
+                        LogRel(("Teleporter: Unexpected RTTcpServerListen2 rc: %Rrc\n", vrc));
                     }
                 }
                 else
@@ -1242,26 +2090,25 @@ static int teleporterTcpWriteNACK(TeleporterStateTrg *pState, int32_t rc2, const
 
 
 /**
- * @copydoc FNRTTCPSERVE
+ * Says hello to a new connection and checks the password.
  *
- * @returns VINF_SUCCESS or VERR_TCP_SERVER_STOP.
+ * @returns VBox status code.  The password has been ACKed on success and
+ *          NACKed if it didn't match.
+ * @param   pState          The teleporter state.
+ * @param   Sock            The new connection.
  */
-/*static*/ DECLCALLBACK(int)
-Console::i_teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
+static int teleporterTrgWelcome(TeleporterStateTrg *pState, RTSOCKET Sock)
 {
-    TeleporterStateTrg *pState = (TeleporterStateTrg *)pvUser;
-    pState->mhSocket = Sock;
-
     /*
      * Disable Nagle and say hello.
      */
-    int vrc = RTTcpSetSendCoalescing(pState->mhSocket, false /*fEnable*/);
+    int vrc = RTTcpSetSendCoalescing(Sock, false /*fEnable*/);
     AssertRC(vrc);
     vrc = RTTcpWrite(Sock, g_szWelcome, sizeof(g_szWelcome) - 1);
     if (RT_FAILURE(vrc))
     {
         LogRel(("Teleporter: Failed to write welcome message: %Rrc\n", vrc));
-        return VINF_SUCCESS;
+        return vrc;
     }
 
     /*
@@ -1280,14 +2127,161 @@ Console::i_teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
                 LogRel(("Teleporter: Password read failure (off=%u): %Rrc\n", off, vrc));
             else
                 LogRel(("Teleporter: Invalid password (off=%u)\n", off));
-            teleporterTcpWriteNACK(pState, VERR_AUTHENTICATION_FAILURE);
-            return VINF_SUCCESS;
+            char   szMsg[32];
+            size_t cch = RTStrPrintf(szMsg, sizeof(szMsg), "NACK=%d\n", VERR_AUTHENTICATION_FAILURE);
+            RTTcpWrite(Sock, szMsg, cch);
+            return VERR_AUTHENTICATION_FAILURE;
         }
         off++;
     }
-    vrc = teleporterTcpWriteACK(pState);
+    vrc = RTTcpWrite(Sock, "ACK\n", sizeof("ACK\n") - 1);
+    if (RT_FAILURE(vrc))
+        LogRel(("Teleporter: RTTcpWrite(,ACK,) -> %Rrc\n", vrc));
+    return vrc;
+}
+
+
+/**
+ * Stops accepting connections and cancels the timeout timer.
+ *
+ * @param   pState          The teleporter state.
+ */
+static void teleporterTrgStopListening(TeleporterStateTrg *pState)
+{
+    if (*pState->mphTimerLR != NIL_RTTIMERLR)
+    {
+        RTTcpServerShutdown(pState->mhServer);
+        RTTimerLRDestroy(*pState->mphTimerLR);
+        *pState->mphTimerLR = NIL_RTTIMERLR;
+    }
+}
+
+
+/**
+ * Accepts the additional data connections the source stripes the stream over.
+ *
+ * Connections failing the password check or not identifying themselves as
+ * the expected data connection are dropped and we wait for the next one; the
+ * timeout timer and cancellation get us out of here if nothing shows up.
+ *
+ * @returns VBox status code.
+ * @param   pState          The teleporter state.
+ * @param   cStreams        The total number of connections, including the
+ *                          command connection.
+ */
+static int teleporterTrgAcceptStreams(TeleporterStateTrg *pState, uint32_t cStreams)
+{
+    pState->maStreams[0].hSocket = pState->mhSocket;
+    uint32_t iStream = 1;
+    while (iStream < cStreams)
+    {
+        RTSOCKET hSocket;
+        int vrc = RTTcpServerListen2(pState->mhServer, &hSocket);
+        if (RT_FAILURE(vrc))
+        {
+            LogRel(("Teleporter: Failed to accept data connection #%u: %Rrc\n", iStream, vrc));
+            return vrc;
+        }
+
+        vrc = teleporterTrgWelcome(pState, hSocket);
+        if (RT_SUCCESS(vrc))
+        {
+            char szCmd[32];
+            char szExpect[32];
+            RTStrPrintf(szExpect, sizeof(szExpect), "stream=%u", iStream);
+            vrc = teleporterTcpReadLine(hSocket, szCmd, sizeof(szCmd));
+            if (RT_SUCCESS(vrc) && strcmp(szCmd, szExpect))
+            {
+                LogRel(("Teleporter: Expected '%s' on data connection, got '%s'\n", szExpect, szCmd));
+                vrc = VERR_WRONG_ORDER;
+            }
+            if (RT_SUCCESS(vrc))
+                vrc = RTTcpWrite(hSocket, "ACK\n", sizeof("ACK\n") - 1);
+        }
+        if (RT_SUCCESS(vrc))
+            pState->maStreams[iStream++].hSocket = hSocket;
+        else
+            RTTcpServerDisconnectClient2(hSocket);
+    }
+    pState->mcStreams = cStreams;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNPGMPOSTCOPYREQUEST,
+ *      Queues a page request for the post-copy thread to send (target).}
+ */
+static DECLCALLBACK(int) teleporterTrgPostCopyRequest(PUVM pUVM, RTGCPHYS GCPhys, void *pvUser)
+{
+    TeleporterPostCopyTrg *pPostCopy = (TeleporterPostCopyTrg *)pvUser;
+    NOREF(pUVM);
+
+    RTCritSectEnter(&pPostCopy->mCritSect);
+    bool const fWasEmpty = pPostCopy->miReqHead == pPostCopy->miReqTail;
+    if (pPostCopy->miReqHead - pPostCopy->miReqTail < RT_ELEMENTS(pPostCopy->maReqs))
+        pPostCopy->maReqs[pPostCopy->miReqHead++ % RT_ELEMENTS(pPostCopy->maReqs)] = GCPhys;
+    else
+        pPostCopy->mcRequestsDropped++; /* The source pushes it sooner or later. */
+    RTCritSectLeave(&pPostCopy->mCritSect);
+
+    if (fWasEmpty)
+    {
+        size_t cbWritten;
+        RTPipeWrite(pPostCopy->mhWakeupPipeW, "", 1, &cbWritten);
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Sends the queued page requests to the source (target).
+ *
+ * @returns VBox status code.
+ * @param   pPostCopy       The post-copy state.
+ */
+static int teleporterTrgPostCopySendRequests(TeleporterPostCopyTrg *pPostCopy)
+{
+    for (;;)
+    {
+        uint64_t au64Reqs[32];
+        uint32_t cReqs = 0;
+        RTCritSectEnter(&pPostCopy->mCritSect);
+        while (   cReqs < RT_ELEMENTS(au64Reqs)
+               && pPostCopy->miReqTail != pPostCopy->miReqHead)
+            au64Reqs[cReqs++] = pPostCopy->maReqs[pPostCopy->miReqTail++ % RT_ELEMENTS(pPostCopy->maReqs)];
+        RTCritSectLeave(&pPostCopy->mCritSect);
+        if (!cReqs)
+            return VINF_SUCCESS;
+
+        pPostCopy->mcRequests += cReqs;
+        int vrc = RTTcpWrite(pPostCopy->mhSocket, au64Reqs, cReqs * sizeof(au64Reqs[0]));
+        if (RT_FAILURE(vrc))
+            return vrc;
+    }
+}
+
+
+/**
+ * @copydoc FNRTTCPSERVE
+ *
+ * @returns VINF_SUCCESS or VERR_TCP_SERVER_STOP.
+ */
+/*static*/ DECLCALLBACK(int)
+Console::i_teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
+{
+    TeleporterStateTrg *pState = (TeleporterStateTrg *)pvUser;
+    pState->mhSocket = Sock;
+
+    /*
+     * Say hello and check the password.
+     */
+    int vrc = teleporterTrgWelcome(pState, Sock);
     if (RT_FAILURE(vrc))
+    {
+        pState->mhSocket = NIL_RTSOCKET;
         return VINF_SUCCESS;
+    }
 
     /*
      * Update the progress bar, with peer name if available.
@@ -1308,31 +2302,54 @@ Console::i_teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
     AssertMsg(SUCCEEDED(hrc) || hrc == E_FAIL, ("%Rhrc\n", hrc));
 
     /*
-     * Stop the server and cancel the timeout timer.
+     * Command processing loop.
      *
-     * Note! After this point we must return VERR_TCP_SERVER_STOP, while prior
+     * Note! From here on we must return VERR_TCP_SERVER_STOP, while prior
      *       to it we must not return that value!
      */
-    RTTcpServerShutdown(pState->mhServer);
-    RTTimerLRDestroy(*pState->mphTimerLR);
-    *pState->mphTimerLR = NIL_RTTIMERLR;
-
-    /*
-     * Command processing loop.
-     */
     bool fDone = false;
     for (;;)
     {
         char szCmd[128];
-        vrc = teleporterTcpReadLine(pState, szCmd, sizeof(szCmd));
+        vrc = teleporterTcpReadLine(pState->mhSocket, szCmd, sizeof(szCmd));
         if (RT_FAILURE(vrc))
             break;
 
-        if (!strcmp(szCmd, "load"))
+        /*
+         * Stop the server and cancel the timeout timer unless we're about to
+         * accept the additional data connections.
+         */
+        if (strncmp(szCmd, RT_STR_TUPLE("streams=")))
+            teleporterTrgStopListening(pState);
+
+        if (!strncmp(szCmd, RT_STR_TUPLE("streams=")))
+        {
+            uint32_t cStreams;
+            vrc = RTStrToUInt32Full(&szCmd[sizeof("streams=") - 1], 10, &cStreams);
+            if (   vrc != VINF_SUCCESS
+                || cStreams < 2
+                || cStreams > TELEPORTER_MAX_STREAMS
+                || pState->mcStreams != 1)
+            {
+                LogRel(("Teleporter: Invalid command '%s'\n", szCmd));
+                vrc = VERR_INVALID_PARAMETER;
+                teleporterTcpWriteNACK(pState, vrc);
+                break;
+            }
+
+            vrc = teleporterTcpWriteACK(pState);
+            if (RT_SUCCESS(vrc))
+                vrc = teleporterTrgAcceptStreams(pState, cStreams);
+            teleporterTrgStopListening(pState);
+            if (RT_SUCCESS(vrc))
+                LogRel(("Teleporter: Receiving the stream over %u connections\n", cStreams));
+        }
+        else if (!strcmp(szCmd, "load"))
         {
             vrc = teleporterTcpWriteACK(pState);
             if (RT_FAILURE(vrc))
                 break;
+            uint64_t const msStart = RTTimeMilliTS();
 
             int vrc2 = VMR3AtErrorRegister(pState->mpUVM,
                                            Console::i_genericVMSetErrorCallback, &pState->mErrorText); AssertRC(vrc2);
@@ -1366,6 +2383,16 @@ Console::i_teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
                 break;
             }
 
+            uint64_t const cMsElapsed = RTTimeMilliTS() - msStart;
+            LogRel(("Teleporter: Received %'RU64 bytes (%'RU64 on the wire) over %u connection(s) in %'RU64 ms (%'RU64 KB/s)\n",
+                    pState->moffStream, pState->mcbOnWire, pState->mcStreams, cMsElapsed,
+                    pState->mcbOnWire / RT_MAX(cMsElapsed, 1) * 1000 / _1K));
+
+            vrc = teleporterTcpWriteACK(pState);
+        }
+        else if (!strcmp(szCmd, "post-copy"))
+        {
+            pState->mfPostCopy = true;
             vrc = teleporterTcpWriteACK(pState);
         }
         else if (!strcmp(szCmd, "cancel"))
@@ -1405,16 +2432,58 @@ Console::i_teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
             if (   pState->mptrProgress->i_notifyPointOfNoReturn()
                 && pState->mfLockedMedia)
             {
-                vrc = teleporterTcpWriteACK(pState);
+                /* Get the post-copy resources ready while we can still say no. */
+                TeleporterPostCopyTrg *pPostCopy = NULL;
+                if (pState->mfPostCopy)
+                {
+                    pPostCopy = new TeleporterPostCopyTrg(pState->mptrConsole, pState->mpUVM, pState->mhSocket);
+                    vrc = pPostCopy->init();
+                    if (RT_FAILURE(vrc))
+                    {
+                        LogRel(("Teleporter: Failed to prepare for post-copy: %Rrc\n", vrc));
+                        delete pPostCopy;
+                        pPostCopy = NULL;
+                        teleporterTcpWriteNACK(pState, vrc);
+                    }
+                }
+                if (RT_SUCCESS(vrc))
+                    vrc = teleporterTcpWriteACK(pState);
                 if (RT_SUCCESS(vrc))
                 {
-                    if (!strcmp(szCmd, "hand-over-resume"))
-                        vrc = VMR3Resume(pState->mpUVM, VMRESUMEREASON_TELEPORTED);
-                    else
-                        pState->mptrConsole->i_setMachineState(MachineState_Paused);
+                    /* Start receiving the pages we lack and fetch those the
+                       VM cannot run without.  The VM is lost if this fails. */
+                    if (pPostCopy)
+                    {
+                        vrc = RTThreadCreate(NULL, Console::i_teleporterTrgPostCopyThread, pPostCopy, 0 /*cbStack*/,
+                                             RTTHREADTYPE_IO, 0 /*fFlags*/, "TelePostCopy");
+                        if (RT_SUCCESS(vrc))
+                        {
+                            pState->mfSocketHandedOver = true;
+                            vrc = PGMR3PostCopyTrgStart(pState->mpUVM, teleporterTrgPostCopyRequest, pPostCopy);
+                            if (RT_FAILURE(vrc))
+                            {
+                                LogRel(("Teleporter: PGMR3PostCopyTrgStart -> %Rrc\n", vrc));
+                                PGMR3PostCopyTrgAbort(pState->mpUVM);
+                            }
+                            RTSemEventSignal(pPostCopy->mhEvtStarted); /* Don't touch pPostCopy after this. */
+                        }
+                        else
+                        {
+                            LogRel(("Teleporter: Failed to create the post-copy thread: %Rrc\n", vrc));
+                            delete pPostCopy;
+                        }
+                    }
+                    if (RT_SUCCESS(vrc))
+                    {
+                        if (!strcmp(szCmd, "hand-over-resume"))
+                            vrc = VMR3Resume(pState->mpUVM, VMRESUMEREASON_TELEPORTED);
+                        else
+                            pState->mptrConsole->i_setMachineState(MachineState_Paused);
+                    }
                     fDone = true;
                     break;
                 }
+                delete pPostCopy;
             }
             else
             {
@@ -1438,9 +2507,117 @@ Console::i_teleporterTrgServeConnection(RTSOCKET Sock, void *pvUser)
     if (RT_FAILURE(vrc))
         teleporterTrgUnlockMedia(pState);
 
+    teleporterTrgStopListening(pState);
+    teleporterTcpDestroyStreams(pState);
     pState->mRc = vrc;
     pState->mhSocket = NIL_RTSOCKET;
     LogFlowFunc(("returns mRc=%Rrc\n", vrc));
     return VERR_TCP_SERVER_STOP;
 }
 
+
+/**
+ * Post-copy thread (target).
+ *
+ * Receives the pages the source sends after the hand over and forwards the
+ * page requests of the EMTs, until the source says it has sent everything.
+ * The VM is suspended with a runtime error (by PGM) if this fails before all
+ * the pages have arrived.
+ *
+ * @returns VINF_SUCCESS (ignored).
+ * @param   hThreadSelf         The thread.
+ * @param   pvUser              Pointer to a TeleporterPostCopyTrg instance.
+ */
+/*static*/ DECLCALLBACK(int)
+Console::i_teleporterTrgPostCopyThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    TeleporterPostCopyTrg *pPostCopy = (TeleporterPostCopyTrg *)pvUser;
+    NOREF(hThreadSelf);
+
+    /*
+     * Keep the VM around while we feed it, checking regularly that nobody
+     * wants to power it off.
+     */
+    SafeVMPtr ptrVM(pPostCopy->mptrConsole);
+    int       vrc    = SUCCEEDED(ptrVM.rc()) ? VINF_SUCCESS : VERR_INVALID_STATE;
+    uint8_t  *pbPage = (uint8_t *)RTMemTmpAlloc(PAGE_SIZE);
+    if (!pbPage && RT_SUCCESS(vrc))
+        vrc = VERR_NO_TMP_MEMORY;
+    uint64_t const msStart = RTTimeMilliTS();
+    bool fEnd = false;
+    while (RT_SUCCESS(vrc))
+    {
+        vrc = teleporterTrgPostCopySendRequests(pPostCopy);
+        if (RT_FAILURE(vrc))
+            break;
+        if (pPostCopy->mptrConsole->mVMDestroying)
+        {
+            vrc = VERR_CANCELLED;
+            break;
+        }
+
+        uint32_t fEvents  = 0;
+        uint32_t idHandle = UINT32_MAX;
+        vrc = RTPoll(pPostCopy->mhPollSet, 250, &fEvents, &idHandle);
+        if (vrc == VERR_TIMEOUT)
+        {
+            vrc = VINF_SUCCESS;
+            continue;
+        }
+        if (RT_FAILURE(vrc))
+            break;
+        if (idHandle == TELEPORTER_POSTCOPY_POLL_ID_PIPE)
+        {
+            uint8_t abBuf[16];
+            size_t  cbRead;
+            RTPipeRead(pPostCopy->mhWakeupPipeR, abBuf, sizeof(abBuf), &cbRead);
+            continue;
+        }
+
+        /*
+         * A page or the end marker.
+         */
+        uint64_t u64Hdr;
+        vrc = RTTcpRead(pPostCopy->mhSocket, &u64Hdr, sizeof(u64Hdr), NULL);
+        if (RT_FAILURE(vrc))
+            break;
+        if (u64Hdr == TELEPORTER_POSTCOPY_END)
+        {
+            fEnd = true;
+            break;
+        }
+        bool const fZero = RT_BOOL(u64Hdr & TELEPORTER_POSTCOPY_F_ZERO);
+        if (!fZero)
+            vrc = RTTcpRead(pPostCopy->mhSocket, pbPage, PAGE_SIZE, NULL);
+        if (RT_SUCCESS(vrc))
+            vrc = PGMR3PostCopyTrgDeliverPage(pPostCopy->mpUVM, u64Hdr & ~(uint64_t)PAGE_OFFSET_MASK,
+                                              fZero ? NULL : pbPage);
+        pPostCopy->mcPages++;
+    }
+    RTMemTmpFree(pbPage);
+
+    /*
+     * Wrap up.  PGMR3PostCopyTrgStart may still be waiting on the pages
+     * needed before resuming, so abort before waiting for it on failure.
+     */
+    if (!fEnd)
+    {
+        LogRel(("Teleporter: Post-copy failed after %'RU64 pages: %Rrc\n", pPostCopy->mcPages, vrc));
+        PGMR3PostCopyTrgAbort(pPostCopy->mpUVM);
+    }
+    RTSemEventWait(pPostCopy->mhEvtStarted, RT_INDEFINITE_WAIT);
+    if (fEnd)
+    {
+        vrc = PGMR3PostCopyEnd(pPostCopy->mpUVM);
+        uint64_t const u64Done = TELEPORTER_POSTCOPY_END;
+        int vrc2 = RTTcpWrite(pPostCopy->mhSocket, &u64Done, sizeof(u64Done));
+        LogRel(("Teleporter: Post-copy received %'RU64 pages in %'RU64 ms, %'RU64 requested (%'RU64 dropped): %Rrc / %Rrc\n",
+                pPostCopy->mcPages, RTTimeMilliTS() - msStart, pPostCopy->mcRequests, pPostCopy->mcRequestsDropped,
+                vrc, vrc2));
+    }
+
+    RTTcpServerDisconnectClient2(pPostCopy->mhSocket);
+    ptrVM.release();
+    delete pPostCopy;
+    return VINF_SUCCESS;
+}
@@ -14278,10 +14278,49 @@ HRESULT SessionMachine::i_onUSBDeviceDetach(IN_BSTR aId,
 // protected methods
 /////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Returns the saved state file the given saved state is a delta against.
+ *
+ * A VM configured with VBoxInternal/PGM/DeltaSavedStates only saves the RAM
+ * pages which changed since the saved state of the current snapshot, the rest
+ * is loaded from that file (see PGMR3DeltaSetParent).  This reads the "pgmdelta"
+ * unit written by PGMSavedState.cpp: own UUID, parent UUID, parent file name.
+ *
+ * @returns The fully qualified parent file name, empty if the saved state
+ *          isn't a delta or cannot be read.
+ * @param strStateFile  The saved state file.
+ */
+static Utf8Str getDeltaSavedStateParent(const Utf8Str &strStateFile)
+{
+    Utf8Str strParent;
+    PSSMHANDLE pSSM;
+    int vrc = SSMR3Open(strStateFile.c_str(), 0 /*fFlags*/, &pSSM);
+    if (RT_SUCCESS(vrc))
+    {
+        uint32_t uVersion;
+        vrc = SSMR3Seek(pSSM, "pgmdelta", 0 /*iInstance*/, &uVersion);
+        if (RT_SUCCESS(vrc) && uVersion == 1)
+        {
+            RTUUID aUuids[2];
+            char szParent[RTPATH_MAX];
+            vrc = SSMR3GetMem(pSSM, &aUuids[0], sizeof(aUuids));
+            if (RT_SUCCESS(vrc))
+                vrc = SSMR3GetStrZ(pSSM, szParent, sizeof(szParent));
+            if (RT_SUCCESS(vrc))
+                strParent = szParent;
+        }
+        SSMR3Close(pSSM);
+    }
+    return strParent;
+}
+
 /**
  * Deletes the given file if it is no longer in use by either the current machine state
  * (if the machine is "saved") or any of the machine's snapshots.
  *
+ * A file which is still needed as the parent of a delta saved state in use is kept,
+ * and parents which are no longer needed after deleting the file are deleted too.
+ *
  * Note: This checks mSSData->strStateFilePath, which is shared by the Machine and SessionMachine
  * but is different for each SnapshotMachine. When calling this, the order of calling this
  * function on the one hand and changing that variable OR the snapshots tree on the other hand
@@ -14303,7 +14342,44 @@ void SessionMachine::i_releaseSavedStateFile(const Utf8Str &strStateFile,
              || !mData->mFirstSnapshot->i_sharesSavedStateFile(strStateFile, pSnapshotToIgnore)
                                 // this checks the SnapshotMachine's state file paths
            )
+        {
+            // ... and no delta saved state in use may depend on it
+            std::list<Utf8Str> llInUse;
+            if (mSSData->strStateFilePath.isNotEmpty())
+                llInUse.push_back(mSSData->strStateFilePath);
+            if (mData->mFirstSnapshot)
+                mData->mFirstSnapshot->i_getSavedStateFiles(llInUse, pSnapshotToIgnore);
+
+            std::list<Utf8Str> llNeeded;
+            for (std::list<Utf8Str>::const_iterator it = llInUse.begin();
+                 it != llInUse.end();
+                 ++it)
+            {
+                Utf8Str strParent = getDeltaSavedStateParent(*it);
+                while (   strParent.isNotEmpty()
+                       && std::find(llNeeded.begin(), llNeeded.end(), strParent) == llNeeded.end())
+                {
+                    llNeeded.push_back(strParent);
+                    strParent = getDeltaSavedStateParent(strParent);
+                }
+            }
+            if (std::find(llNeeded.begin(), llNeeded.end(), strStateFile) != llNeeded.end())
+                return;
+
+            Utf8Str strParent = getDeltaSavedStateParent(strStateFile);
             RTFileDelete(strStateFile.c_str());
+
+            // the parents only this file depended on are orphans now
+            while (   strParent.isNotEmpty()
+                   && std::find(llInUse.begin(), llInUse.end(), strParent) == llInUse.end()
+                   && std::find(llNeeded.begin(), llNeeded.end(), strParent) == llNeeded.end())
+            {
+                Utf8Str strOrphan = strParent;
+                strParent = getDeltaSavedStateParent(strOrphan);
+                LogRel(("Deleting '%s' which is no longer needed by a delta saved state\n", strOrphan.c_str()));
+                RTFileDelete(strOrphan.c_str());
+            }
+        }
 }
 
 /**
@@ -14562,12 +14638,11 @@ HRESULT SessionMachine::i_setMachineState(MachineState_T aMachineState)
         {
             Assert(!mSSData->strStateFilePath.isEmpty());
 
-            // it is safe to delete the saved state file if ...
-            if (    !mData->mFirstSnapshot      // ... we have no snapshots or
-                 || !mData->mFirstSnapshot->i_sharesSavedStateFile(mSSData->strStateFilePath, NULL /* pSnapshotToIgnore */)
-                                                // ... none of the snapshots share the saved state file
-               )
-                RTFileDelete(mSSData->strStateFilePath.c_str());
+            // release the saved state file AFTER unsetting the member variable
+            // so that releaseSavedStateFile() won't think it's still in use
+            Utf8Str strStateFile(mSSData->strStateFilePath);
+            mSSData->strStateFilePath.setNull();
+            i_releaseSavedStateFile(strStateFile, NULL /* pSnapshotToIgnore */);
         }
 
         mSSData->strStateFilePath.setNull();
@@ -705,6 +705,33 @@ bool Snapshot::i_sharesSavedStateFile(const Utf8Str &strPath,
     return false;
 }
 
+/**
+ * Adds the saved state files of this snapshot and its (grand-)children to the
+ * given list.  When invoked on a machine's first snapshot, this gives all the
+ * saved state files the snapshots are using.
+ *
+ * Caller must hold the machine lock, which protects the snapshots tree.
+ *
+ * @param llFilenames       Where to add the fully qualified file names.
+ * @param pSnapshotToIgnore If != NULL, the saved state of this snapshot is not
+ *                          added (its children are).
+ */
+void Snapshot::i_getSavedStateFiles(std::list<Utf8Str> &llFilenames,
+                                    Snapshot *pSnapshotToIgnore)
+{
+    AutoReadLock alock(this COMMA_LOCKVAL_SRC_POS);
+    const Utf8Str &path = m->pMachine->mSSData->strStateFilePath;
+
+    if (   path.isNotEmpty()
+        && pSnapshotToIgnore != this)
+        llFilenames.push_back(path);
+
+    for (SnapshotsList::const_iterator it = m->llChildren.begin();
+         it != m->llChildren.end();
+         ++it)
+        (*it)->i_getSavedStateFiles(llFilenames, pSnapshotToIgnore);
+}
+
 
 /**
  *  Checks if the specified path change affects the saved state file path of
@@ -133,17 +133,47 @@ RootConfigEntity::RootConfigEntity(std::string name, uint32_t expPeriod):
     m_u32ExpirationPeriod = expPeriod;
 }
 
+/** Pools with more addresses than this are searched without a bitmap. */
+#define DHCP_MAX_BITMAP_POOL    _1M
+
+/**
+ * Free address bitmap of the address range of a network config entity.
+ */
+struct AddressPool
+{
+    /** The first address of the pool, host byte order. */
+    uint32_t              u32Lower;
+    /** The number of addresses in the pool. */
+    uint32_t              cAddresses;
+    /** One bit per address, set if taken.  The bits beyond cAddresses are set. */
+    std::vector<uint32_t> bitmap;
+};
+typedef std::map<const NetworkConfigEntity *, AddressPool> MapConfig2AddressPool;
+typedef MapConfig2AddressPool::iterator MapConfig2AddressPoolIterator;
+
+
+/**
+ * Turns a MAC address into the client index key.
+ */
+static uint64_t dhcpMacToKey(const RTMAC& mac)
+{
+    return RT_MAKE_U64(RT_MAKE_U32(mac.au16[0], mac.au16[1]), mac.au16[2]);
+}
+
+
 /* Configuration Manager */
 struct ConfigurationManager::Data
 {
     Data():fFileExists(false){}
 
-    MapLease2Ip4Address  m_allocations;
+    MapIp4Address2Lease  m_allocations;
+    /** Lazily created free address bitmaps, kept in sync with m_allocations. */
+    MapConfig2AddressPool m_pools;
     Ipv4AddressContainer m_nameservers;
     Ipv4AddressContainer m_routers;
 
     std::string          m_domainName;
-    VecClient            m_clients;
+    MapMac2Client        m_clients;
     com::Utf8Str         m_leaseStorageFilename;
     bool                 fFileExists;
 };
@@ -231,7 +261,7 @@ int ConfigurationManager::loadFromFile(const com::Utf8Str& leaseStorageFileName)
         if (l.fromXML(lease))
         {
 
-            m->m_allocations.insert(MapLease2Ip4AddressPair(l, l.getAddress()));
+            addAllocation(l);
 
 
             NetworkConfigEntity *pNetCfg = NULL;
@@ -241,7 +271,7 @@ int ConfigurationManager::loadFromFile(const com::Utf8Str& leaseStorageFileName)
 
             l.setConfig(pNetCfg);
 
-            m->m_clients.push_back(c);
+            m->m_clients.insert(MapMac2ClientPair(dhcpMacToKey(c.getMacAddress()), c));
         }
     }
 
@@ -262,11 +292,11 @@ int ConfigurationManager::saveToFile()
 
     root->setAttribute(tagXMLLeasesAttributeVersion.c_str(), tagXMLLeasesVersion_1_0.c_str());
 
-    for(MapLease2Ip4AddressConstIterator it = m->m_allocations.begin();
+    for(MapIp4Address2LeaseConstIterator it = m->m_allocations.begin();
         it != m->m_allocations.end(); ++it)
     {
         xml::ElementNode *lease = root->createChild(tagXMLLease.c_str());
-        if (!it->first.toXML(lease))
+        if (!it->second.toXML(lease))
         {
             /* XXX: todo logging + error handling */
         }
@@ -290,7 +320,6 @@ int ConfigurationManager::extractRequestList(PCRTNETBOOTP pDhcpMsg, size_t cbDhc
 Client ConfigurationManager::getClientByDhcpPacket(const RTNETBOOTP *pDhcpMsg, size_t cbDhcpMsg)
 {
 
-    VecClientIterator it;
     bool fDhcpValid = false;
     uint8_t uMsgType = 0;
 
@@ -299,28 +328,20 @@ Client ConfigurationManager::getClientByDhcpPacket(const RTNETBOOTP *pDhcpMsg, s
 
     LogFlowFunc(("dhcp:mac:%RTmac\n", &pDhcpMsg->bp_chaddr.Mac));
     /* 1st. client IDs */
-    for ( it = m->m_clients.begin();
-         it != m->m_clients.end();
-         ++it)
+    uint64_t const uKey = dhcpMacToKey(pDhcpMsg->bp_chaddr.Mac);
+    MapMac2ClientIterator it = m->m_clients.find(uKey);
+    if (it != m->m_clients.end())
     {
-        if ((*it) == pDhcpMsg->bp_chaddr.Mac)
-        {
-            LogFlowFunc(("client:mac:%RTmac\n",  it->getMacAddress()));
-            /* check timestamp that request wasn't expired. */
-            return (*it);
-        }
+        LogFlowFunc(("client:mac:%RTmac\n", &it->second.getMacAddress()));
+        /* check timestamp that request wasn't expired. */
+        return it->second;
     }
 
-    if (it == m->m_clients.end())
-    {
-        /* We hasn't got any session for this client */
-        Client c;
-        c.initWithMac(pDhcpMsg->bp_chaddr.Mac);
-        m->m_clients.push_back(c);
-        return m->m_clients.back();
-    }
-
-    return Client::NullClient;
+    /* We hasn't got any session for this client */
+    Client c;
+    c.initWithMac(pDhcpMsg->bp_chaddr.Mac);
+    m->m_clients.insert(MapMac2ClientPair(uKey, c));
+    return c;
 }
 
 /**
@@ -367,7 +388,7 @@ ConfigurationManager::findOption(uint8_t uOption, PCRTNETBOOTP pDhcpMsg, size_t
             cbLeft--;
             pb++;
         }
-        else if (cbLeft <= 1)
+        else if (uCur == RTNET_DHCP_OPT_END || cbLeft <= 1)
             break;
         else
         {
@@ -382,7 +403,7 @@ ConfigurationManager::findOption(uint8_t uOption, PCRTNETBOOTP pDhcpMsg, size_t
                 return VINF_SUCCESS;
             }
             pb     += cbCur + 2;
-            cbLeft -= cbCur - 2;
+            cbLeft -= cbCur + 2;
         }
     }
 
@@ -446,25 +467,18 @@ Lease ConfigurationManager::allocateLease4Client(const Client& client, PCRTNETBO
         Lease l(cl);
         l.setConfig(pNetCfg);
         l.setAddress(hintAddress);
-        m->m_allocations.insert(MapLease2Ip4AddressPair(l, hintAddress));
+        addAllocation(l);
         return l;
     }
 
-    uint32_t u32 = 0;
-    for(u32 = RT_H2N_U32(pNetCfg->lowerIp().u);
-        u32 <= RT_H2N_U32(pNetCfg->upperIp().u);
-        ++u32)
+    RTNETADDRIPV4 address;
+    if (findFreeAddress(pNetCfg, address))
     {
-        RTNETADDRIPV4 address;
-        address.u = RT_H2N_U32(u32);
-        if (!isAddressTaken(address))
-        {
-            Lease l(cl);
-            l.setConfig(pNetCfg);
-            l.setAddress(address);
-            m->m_allocations.insert(MapLease2Ip4AddressPair(l, address));
-            return l;
-        }
+        Lease l(cl);
+        l.setConfig(pNetCfg);
+        l.setAddress(address);
+        addAllocation(l);
+        return l;
     }
 
     return Lease::NullLease;
@@ -497,13 +511,13 @@ int ConfigurationManager::expireLease4Client(Client& client)
     if (l.isInBindingPhase())
     {
 
-        MapLease2Ip4AddressIterator it = m->m_allocations.find(l);
-        AssertReturn(it != m->m_allocations.end(), VERR_NOT_FOUND);
+        MapIp4Address2LeaseIterator it = m->m_allocations.find(RT_N2H_U32(l.getAddress().u));
+        AssertReturn(it != m->m_allocations.end() && it->second == l, VERR_NOT_FOUND);
 
         /*
          * XXX: perhaps it better to keep this allocation ????
          */
-        m->m_allocations.erase(it);
+        removeAllocation(it);
 
         l.expire();
         return VINF_SUCCESS;
@@ -516,19 +530,13 @@ int ConfigurationManager::expireLease4Client(Client& client)
 
 bool ConfigurationManager::isAddressTaken(const RTNETADDRIPV4& addr, Lease& lease)
 {
-    MapLease2Ip4AddressIterator it;
-
-    for (it = m->m_allocations.begin();
-         it != m->m_allocations.end();
-         ++it)
+    MapIp4Address2LeaseIterator it = m->m_allocations.find(RT_N2H_U32(addr.u));
+    if (it != m->m_allocations.end())
     {
-        if (it->second.u == addr.u)
-        {
-            if (lease != Lease::NullLease)
-                lease = it->first;
+        if (lease != Lease::NullLease)
+            lease = it->second;
 
-            return true;
-        }
+        return true;
     }
     lease = Lease::NullLease;
     return false;
@@ -542,6 +550,109 @@ bool ConfigurationManager::isAddressTaken(const RTNETADDRIPV4& addr)
 }
 
 
+/**
+ * Records the address of a lease as taken.
+ */
+void ConfigurationManager::addAllocation(const Lease& lease)
+{
+    uint32_t const u32Address = RT_N2H_U32(lease.getAddress().u);
+    if (m->m_allocations.insert(MapIp4Address2LeasePair(u32Address, lease)).second)
+        updateAddressPools(u32Address, true);
+}
+
+
+/**
+ * Drops an allocation, making its address available again.
+ */
+void ConfigurationManager::removeAllocation(MapIp4Address2LeaseIterator it)
+{
+    uint32_t const u32Address = it->first;
+    m->m_allocations.erase(it);
+    updateAddressPools(u32Address, false);
+}
+
+
+/**
+ * Updates the bit of an address (host byte order) in all the free address
+ * bitmaps covering it.
+ */
+void ConfigurationManager::updateAddressPools(uint32_t u32Address, bool fTaken)
+{
+    for (MapConfig2AddressPoolIterator it = m->m_pools.begin();
+         it != m->m_pools.end();
+         ++it)
+    {
+        AddressPool& pool = it->second;
+        uint32_t const iBit = u32Address - pool.u32Lower; /* wraps around when below the pool */
+        if (iBit < pool.cAddresses)
+        {
+            if (fTaken)
+                ASMBitSet(&pool.bitmap[0], (int32_t)iBit);
+            else
+                ASMBitClear(&pool.bitmap[0], (int32_t)iBit);
+        }
+    }
+}
+
+
+/**
+ * Finds the lowest free address in the range of a network config entity.
+ *
+ * Ranges of a sane size get a free address bitmap on first use, larger
+ * ones are searched by skipping the run of taken addresses at the bottom of
+ * the range in the (ordered) allocation index.
+ *
+ * @returns true if found, false if the range is exhausted.
+ * @param   pNetCfg     The network config entity.
+ * @param   address     Where to return the address.
+ */
+bool ConfigurationManager::findFreeAddress(const NetworkConfigEntity *pNetCfg, RTNETADDRIPV4& address)
+{
+    uint32_t const u32Lower = RT_N2H_U32(pNetCfg->lowerIp().u);
+    uint32_t const u32Upper = RT_N2H_U32(pNetCfg->upperIp().u);
+    if (u32Upper < u32Lower)
+        return false;
+
+    if (u32Upper - u32Lower < DHCP_MAX_BITMAP_POOL)
+    {
+        MapConfig2AddressPoolIterator itPool = m->m_pools.find(pNetCfg);
+        if (itPool == m->m_pools.end())
+        {
+            AddressPool pool;
+            pool.u32Lower   = u32Lower;
+            pool.cAddresses = u32Upper - u32Lower + 1;
+            pool.bitmap.resize(RT_ALIGN_32(pool.cAddresses, 32) / 32, 0);
+            for (uint32_t iBit = pool.cAddresses; iBit < pool.bitmap.size() * 32; iBit++)
+                ASMBitSet(&pool.bitmap[0], (int32_t)iBit);
+            for (MapIp4Address2LeaseIterator it = m->m_allocations.lower_bound(u32Lower);
+                 it != m->m_allocations.end() && it->first <= u32Upper;
+                 ++it)
+                ASMBitSet(&pool.bitmap[0], (int32_t)(it->first - u32Lower));
+            itPool = m->m_pools.insert(MapConfig2AddressPool::value_type(pNetCfg, pool)).first;
+        }
+
+        AddressPool& pool = itPool->second;
+        int iBit = ASMBitFirstClear(&pool.bitmap[0], (uint32_t)pool.bitmap.size() * 32);
+        if (iBit < 0)
+            return false;
+        address.u = RT_H2N_U32(u32Lower + (uint32_t)iBit);
+        return true;
+    }
+
+    uint32_t u32 = u32Lower;
+    for (MapIp4Address2LeaseIterator it = m->m_allocations.lower_bound(u32Lower);
+         it != m->m_allocations.end() && it->first == u32;
+         ++it)
+    {
+        if (u32 == u32Upper)
+            return false;
+        u32++;
+    }
+    address.u = RT_H2N_U32(u32);
+    return true;
+}
+
+
 NetworkConfigEntity *ConfigurationManager::addNetwork(NetworkConfigEntity *,
                                     const RTNETADDRIPV4& networkId,
                                     const RTNETADDRIPV4& netmask,
@@ -149,9 +149,10 @@ class Lease
 };
 
 
-typedef std::vector<Client> VecClient;
-typedef VecClient::iterator VecClientIterator;
-typedef VecClient::const_iterator VecClientConstIterator;
+/** Clients indexed by their MAC address (see dhcpMacToKey). */
+typedef std::map<uint64_t, Client> MapMac2Client;
+typedef MapMac2Client::iterator MapMac2ClientIterator;
+typedef MapMac2Client::value_type MapMac2ClientPair;
 
 typedef std::vector<RTMAC> MacAddressContainer;
 typedef MacAddressContainer::iterator MacAddressIterator;
@@ -160,10 +161,11 @@ typedef std::vector<RTNETADDRIPV4> Ipv4AddressContainer;
 typedef Ipv4AddressContainer::iterator Ipv4AddressIterator;
 typedef Ipv4AddressContainer::const_iterator Ipv4AddressConstIterator;
 
-typedef std::map<Lease, RTNETADDRIPV4> MapLease2Ip4Address;
-typedef MapLease2Ip4Address::iterator MapLease2Ip4AddressIterator;
-typedef MapLease2Ip4Address::const_iterator MapLease2Ip4AddressConstIterator;
-typedef MapLease2Ip4Address::value_type MapLease2Ip4AddressPair;
+/** Leases indexed by their address in host byte order, so address ranges can be walked. */
+typedef std::map<uint32_t, Lease> MapIp4Address2Lease;
+typedef MapIp4Address2Lease::iterator MapIp4Address2LeaseIterator;
+typedef MapIp4Address2Lease::const_iterator MapIp4Address2LeaseConstIterator;
+typedef MapIp4Address2Lease::value_type MapIp4Address2LeasePair;
 
 /**
  *
@@ -478,6 +480,11 @@ private:
     bool isAddressTaken(const RTNETADDRIPV4& addr, Lease& lease);
     bool isAddressTaken(const RTNETADDRIPV4& addr);
 
+    void addAllocation(const Lease& lease);
+    void removeAllocation(MapIp4Address2LeaseIterator it);
+    void updateAddressPools(uint32_t u32Address, bool fTaken);
+    bool findFreeAddress(const NetworkConfigEntity *pNetCfg, RTNETADDRIPV4& address);
+
 public:
     /* nulls */
     const Ipv4AddressContainer m_empty;
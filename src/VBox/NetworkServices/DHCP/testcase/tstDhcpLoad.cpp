@@ -0,0 +1,257 @@
+/* $Id$ */
+/** @file
+ * VBoxNetDHCP load generator - Runs many interleaved DISCOVER/REQUEST
+ * exchanges against the lease logic and measures the cost per message.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <iprt/asm.h>
+#include <iprt/getopt.h>
+#include <iprt/net.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/time.h>
+
+#include <VBox/err.h>
+
+#define BASE_SERVICES_ONLY
+#include "../../NetLib/VBoxNetBaseService.h"
+#include "../../NetLib/shared_ptr.h"
+
+#include <vector>
+#include <map>
+#include <string>
+
+#include "../Config.h"
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/**
+ * Stands in for the wire, keeps the last reply of the server.
+ */
+class TstDhcpWire: public VBoxNetHlpUDPService
+{
+public:
+    TstDhcpWire() : m_cReplies(0), m_cbReply(0) { RT_ZERO(m_abReply); }
+
+    virtual int hlpUDPBroadcast(unsigned uSrcPort, unsigned uDstPort, void const *pvData, size_t cbData) const
+    {
+        RTTESTI_CHECK(uSrcPort == RTNETIPV4_PORT_BOOTPS && uDstPort == RTNETIPV4_PORT_BOOTPC);
+        RTTESTI_CHECK_RET(cbData <= sizeof(m_abReply), VERR_BUFFER_OVERFLOW);
+        memcpy(m_abReply, pvData, cbData);
+        m_cbReply = cbData;
+        m_cReplies++;
+        return VINF_SUCCESS;
+    }
+
+    /** Number of replies sent so far. */
+    mutable uint32_t m_cReplies;
+    /** The size of the last reply. */
+    mutable size_t   m_cbReply;
+    /** The last reply. */
+    mutable uint8_t  m_abReply[RTNET_DHCP_NORMAL_SIZE];
+};
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** The server side wire. */
+static TstDhcpWire g_Wire;
+
+
+/**
+ * Builds a DHCP request message of a client.
+ *
+ * @returns The message size.
+ * @param   pDhcp           The message buffer, RTNET_DHCP_NORMAL_SIZE bytes.
+ * @param   iClient         The client number, determines the MAC and xid.
+ * @param   uMsgType        The message type (RTNET_DHCP_MT_XXX).
+ */
+static size_t tstDhcpBuildMsg(PRTNETBOOTP pDhcp, uint32_t iClient, uint8_t uMsgType)
+{
+    memset(pDhcp, 0, RTNET_DHCP_NORMAL_SIZE);
+    pDhcp->bp_op    = RTNETBOOTP_OP_REQUEST;
+    pDhcp->bp_htype = RTNET_ARP_ETHER;
+    pDhcp->bp_hlen  = sizeof(RTMAC);
+    pDhcp->bp_xid   = RT_H2N_U32(iClient);
+    pDhcp->bp_chaddr.Mac.au8[0] = 0x08;
+    pDhcp->bp_chaddr.Mac.au8[1] = 0x00;
+    pDhcp->bp_chaddr.Mac.au8[2] = 0x27;
+    pDhcp->bp_chaddr.Mac.au8[3] = (uint8_t)(iClient >> 16);
+    pDhcp->bp_chaddr.Mac.au8[4] = (uint8_t)(iClient >> 8);
+    pDhcp->bp_chaddr.Mac.au8[5] = (uint8_t)iClient;
+    pDhcp->bp_vend.Dhcp.dhcp_cookie = RT_H2N_U32_C(RTNET_DHCP_COOKIE);
+
+    uint8_t *pb = &pDhcp->bp_vend.Dhcp.dhcp_opts[0];
+    *pb++ = RTNET_DHCP_OPT_MSG_TYPE;
+    *pb++ = 1;
+    *pb++ = uMsgType;
+    *pb++ = RTNET_DHCP_OPT_PARAM_REQ_LIST;
+    *pb++ = 3;
+    *pb++ = RTNET_DHCP_OPT_SUBNET_MASK;
+    *pb++ = RTNET_DHCP_OPT_ROUTERS;
+    *pb++ = RTNET_DHCP_OPT_DNS;
+    *pb++ = RTNET_DHCP_OPT_END;
+    return RTNET_DHCP_NORMAL_SIZE;
+}
+
+
+/**
+ * Checks the type of the last reply and returns the address it hands out.
+ *
+ * @returns The offered/acknowledged address, 0 on failure.
+ * @param   cRepliesBefore  The reply count before the request was handled.
+ * @param   uMsgType        The expected reply type.
+ */
+static uint32_t tstDhcpCheckReply(uint32_t cRepliesBefore, uint8_t uMsgType)
+{
+    RTTESTI_CHECK_RET(g_Wire.m_cReplies == cRepliesBefore + 1, 0);
+
+    PCRTNETBOOTP pReply = (PCRTNETBOOTP)&g_Wire.m_abReply[0];
+    RawOption opt;
+    int rc = ConfigurationManager::findOption(RTNET_DHCP_OPT_MSG_TYPE, pReply, g_Wire.m_cbReply, opt);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, 0);
+    RTTESTI_CHECK_MSG_RET(opt.cbRawOpt == 1 && opt.au8RawOpt[0] == uMsgType,
+                          ("got type %u, expected %u\n", opt.au8RawOpt[0], uMsgType), 0);
+    return RT_N2H_U32(pReply->bp_yiaddr.u);
+}
+
+
+/**
+ * Runs @a cClients clients through DISCOVER/OFFER and REQUEST/ACK, all of
+ * them having an exchange in flight at the same time, then lets them all
+ * come back (reboot) and checks that they keep their addresses.
+ */
+static void tstDhcpLoad(NetworkManager *pNetMgr, uint32_t cClients, uint32_t u32Lower)
+{
+    std::vector<uint32_t> aOffered(cClients, 0);
+    std::map<uint32_t, uint32_t> mapTaken;
+    union
+    {
+        RTNETBOOTP  BootP;
+        uint8_t     ab[RTNET_DHCP_NORMAL_SIZE];
+    } Msg;
+
+    /*
+     * Everyone discovers before anyone requests, so all the bound leases
+     * are outstanding at the same time.
+     */
+    RTTestISubF("%u clients, DISCOVER", cClients);
+    uint64_t nsStart = RTTimeNanoTS();
+    for (uint32_t i = 0; i < cClients; i++)
+    {
+        size_t cb = tstDhcpBuildMsg(&Msg.BootP, i, RTNET_DHCP_MT_DISCOVER);
+        uint32_t cReplies = g_Wire.m_cReplies;
+        pNetMgr->handleDhcpReqDiscover(&Msg.BootP, cb);
+        aOffered[i] = tstDhcpCheckReply(cReplies, RTNET_DHCP_MT_OFFER);
+        if (!aOffered[i])
+            return;
+        RTTESTI_CHECK_MSG_RETV(aOffered[i] >= u32Lower, ("client %u: %#x is outside the pool\n", i, aOffered[i]));
+        RTTESTI_CHECK_MSG_RETV(mapTaken.insert(std::make_pair(aOffered[i], i)).second,
+                               ("client %u: %#x was already offered to client %u\n", i, aOffered[i], mapTaken[aOffered[i]]));
+    }
+    RTTestIValue("DISCOVER", (RTTimeNanoTS() - nsStart) / cClients, RTTESTUNIT_NS_PER_CALL);
+
+    /* Request in the reverse order, the last one to be offered is the first to come back. */
+    RTTestISubF("%u clients, REQUEST", cClients);
+    nsStart = RTTimeNanoTS();
+    for (uint32_t i = cClients; i-- > 0;)
+    {
+        size_t cb = tstDhcpBuildMsg(&Msg.BootP, i, RTNET_DHCP_MT_REQUEST);
+        uint32_t cReplies = g_Wire.m_cReplies;
+        pNetMgr->handleDhcpReqRequest(&Msg.BootP, cb);
+        uint32_t u32Acked = tstDhcpCheckReply(cReplies, RTNET_DHCP_MT_ACK);
+        RTTESTI_CHECK_MSG_RETV(u32Acked == aOffered[i], ("client %u: acked %#x, offered %#x\n", i, u32Acked, aOffered[i]));
+    }
+    RTTestIValue("REQUEST", (RTTimeNanoTS() - nsStart) / cClients, RTTESTUNIT_NS_PER_CALL);
+
+    /* Everyone comes back and must get the same address again. */
+    RTTestISubF("%u clients, reboot", cClients);
+    nsStart = RTTimeNanoTS();
+    for (uint32_t i = 0; i < cClients; i++)
+    {
+        size_t cb = tstDhcpBuildMsg(&Msg.BootP, i, RTNET_DHCP_MT_DISCOVER);
+        uint32_t cReplies = g_Wire.m_cReplies;
+        pNetMgr->handleDhcpReqDiscover(&Msg.BootP, cb);
+        uint32_t u32Offered = tstDhcpCheckReply(cReplies, RTNET_DHCP_MT_OFFER);
+        RTTESTI_CHECK_MSG_RETV(u32Offered == aOffered[i], ("client %u: got %#x, had %#x\n", i, u32Offered, aOffered[i]));
+    }
+    RTTestIValue("DISCOVER (known client)", (RTTimeNanoTS() - nsStart) / cClients, RTTESTUNIT_NS_PER_CALL);
+}
+
+
+int main(int argc, char **argv)
+{
+    RTTEST hTest;
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstDhcpLoad", &hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+
+    uint32_t cClients = 2048;
+    static const RTGETOPTDEF s_aOptions[] =
+    {
+        { "--clients", 'n', RTGETOPT_REQ_UINT32 },
+    };
+    RTGETOPTSTATE GetState;
+    RTGetOptInit(&GetState, argc, argv, s_aOptions, RT_ELEMENTS(s_aOptions), 1, 0 /*fFlags*/);
+    int ch;
+    RTGETOPTUNION ValueUnion;
+    while ((ch = RTGetOpt(&GetState, &ValueUnion)))
+    {
+        switch (ch)
+        {
+            case 'n':
+                cClients = ValueUnion.u32;
+                break;
+            default:
+                return RTGetOptPrintError(ch, &ValueUnion);
+        }
+    }
+    RTTestBanner(hTest);
+
+    /*
+     * A /16 network with the pool covering all of it but the first /24,
+     * no lease file.
+     */
+    RTNETADDRIPV4 NetworkId, Netmask, Lower, Upper, Server;
+    NetworkId.u = RT_H2N_U32_C(UINT32_C(0x0a000000)); /* 10.0.0.0 */
+    Netmask.u   = RT_H2N_U32_C(UINT32_C(0xffff0000));
+    Lower.u     = RT_H2N_U32_C(UINT32_C(0x0a000100)); /* 10.0.1.0 */
+    Upper.u     = RT_H2N_U32_C(UINT32_C(0x0a00fffe)); /* 10.0.255.254 */
+    Server.u    = RT_H2N_U32_C(UINT32_C(0x0a000001));
+    RTTESTI_CHECK_RET(cClients > 0 && cClients <= RT_N2H_U32(Upper.u) - RT_N2H_U32(Lower.u) + 1, RTTestSummaryAndDestroy(hTest));
+
+    ConfigurationManager *pCfgMgr = ConfigurationManager::getConfigurationManager();
+    RTTESTI_CHECK_RET(pCfgMgr != NULL, RTTestSummaryAndDestroy(hTest));
+    pCfgMgr->addNetwork(NULL, NetworkId, Netmask, Lower, Upper);
+
+    NetworkManager *pNetMgr = NetworkManager::getNetworkManager();
+    RTTESTI_CHECK_RET(pNetMgr != NULL, RTTestSummaryAndDestroy(hTest));
+    RTMAC ServerMac = {{ 0x08, 0x00, 0x27, 0xff, 0xff, 0xff }};
+    pNetMgr->setOurAddress(Server);
+    pNetMgr->setOurNetmask(Netmask);
+    pNetMgr->setOurMac(ServerMac);
+    pNetMgr->setService(&g_Wire);
+
+    tstDhcpLoad(pNetMgr, cClients, RT_N2H_U32(Lower.u));
+
+    return RTTestSummaryAndDestroy(hTest);
+}
@@ -68,6 +68,13 @@
 #endif
 
 
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The max number of received frames processed before queued replies are flushed. */
+#define VBOXNET_RECV_BATCH_MAX  64
+
+
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
 *********************************************************************************************************************************/
@@ -86,7 +93,9 @@ struct VBoxNetBaseService::Data
       m_fNeedMain(false),
       m_EventQ(NULL),
       m_hThrRecv(NIL_RTTHREAD),
-      fShutdown(false)
+      fShutdown(false),
+      m_fDeferFlush(false),
+      m_fFlushPending(false)
     {
         int rc = RTCritSectInit(&m_csThis);
         AssertRC(rc);
@@ -123,6 +132,11 @@ struct VBoxNetBaseService::Data
     RTTHREAD m_hThrRecv;
 
     bool fShutdown;
+    /** Set while a batch of received frames is processed, replies are only
+     * queued and get flushed when the batch is done. */
+    bool m_fDeferFlush;
+    /** Set if replies were queued since the last flush. */
+    bool m_fFlushPending;
     static DECLCALLBACK(int) recvLoop(RTTHREAD, void *);
 };
 
@@ -575,9 +589,12 @@ void VBoxNetBaseService::flushWire()
 int VBoxNetBaseService::hlpUDPBroadcast(unsigned uSrcPort, unsigned uDstPort,
                                          void const *pvData, size_t cbData) const
 {
-    return VBoxNetUDPBroadcast(m->m_pSession, m->m_hIf, m->m_pIfBuf,
-                        m->m_Ipv4Address, &m->m_MacAddress, uSrcPort,
-                        uDstPort, pvData, cbData);
+    int rc = VBoxNetUDPBroadcast(m->m_pSession, m->m_hIf, m->m_pIfBuf,
+                                 m->m_Ipv4Address, &m->m_MacAddress, uSrcPort,
+                                 uDstPort, pvData, cbData, !m->m_fDeferFlush);
+    if (RT_SUCCESS(rc) && m->m_fDeferFlush)
+        m->m_fFlushPending = true;
+    return rc;
 
 }
 
@@ -711,9 +728,12 @@ void VBoxNetBaseService::doReceiveLoop()
         }
 
         /*
-         * Process the receive buffer.
+         * Process the receive buffer.  The replies to a batch of frames are
+         * pushed onto the wire with a single ring-0 call when the batch is done.
          */
         PCINTNETHDR pHdr;
+        unsigned    cFrames = 0;
+        m->m_fDeferFlush = true;
         while ((pHdr = IntNetRingGetNextFrameToRead(pRingBuf)) != NULL)
         {
             uint8_t const u8Type = pHdr->u8Type;
@@ -758,7 +778,21 @@ void VBoxNetBaseService::doReceiveLoop()
                     break;
             }
             IntNetRingSkipFrame(&m->m_pIfBuf->Recv);
+
+            /* Don't let a steady stream of requests hold back the replies. */
+            if (   ++cFrames % VBOXNET_RECV_BATCH_MAX == 0
+                && m->m_fFlushPending)
+            {
+                m->m_fFlushPending = false;
+                flushWire();
+            }
         } /* loop */
+        m->m_fDeferFlush = false;
+        if (m->m_fFlushPending)
+        {
+            m->m_fFlushPending = false;
+            flushWire();
+        }
     }
 }
 
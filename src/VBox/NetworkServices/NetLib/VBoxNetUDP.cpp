@@ -183,7 +183,7 @@ void *VBoxNetUDPMatch(PINTNETBUF pBuf, unsigned uDstPort, PCRTMAC pDstMac, uint3
 static int vboxnetudpSend(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNETBUF pBuf,
                           RTNETADDRIPV4 SrcIPv4Addr, PCRTMAC pSrcMacAddr, unsigned uSrcPort,
                           RTNETADDRIPV4 DstIPv4Addr, PCRTMAC pDstMacAddr, unsigned uDstPort,
-                          void const *pvData, size_t cbData)
+                          void const *pvData, size_t cbData, bool fFlush)
 {
     INTNETSEG aSegs[4];
 
@@ -240,7 +240,7 @@ static int vboxnetudpSend(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNETBU
 
 
     /* send it */
-    return VBoxNetIntIfSend(pSession, hIf, pBuf, RT_ELEMENTS(aSegs), &aSegs[0], true /* fFlush */);
+    return VBoxNetIntIfSend(pSession, hIf, pBuf, RT_ELEMENTS(aSegs), &aSegs[0], fFlush);
 }
 
 
@@ -268,7 +268,7 @@ int     VBoxNetUDPUnicast(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNETBU
     return vboxnetudpSend(pSession, hIf, pBuf,
                           SrcIPv4Addr, pSrcMacAddr, uSrcPort,
                           DstIPv4Addr, pDstMacAddr, uDstPort,
-                          pvData, cbData);
+                          pvData, cbData, true /* fFlush */);
 }
 
 
@@ -285,11 +285,13 @@ int     VBoxNetUDPUnicast(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNETBU
  * @param   uDstPort        The destination port number.
  * @param   pvData          The data payload.
  * @param   cbData          The size of the data payload.
+ * @param   fFlush          Whether to flush the send buffer, pass false when
+ *                          the caller flushes after queueing several packets.
  */
 int     VBoxNetUDPBroadcast(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNETBUF pBuf,
                             RTNETADDRIPV4 SrcIPv4Addr, PCRTMAC pSrcMacAddr, unsigned uSrcPort,
                             unsigned uDstPort,
-                            void const *pvData, size_t cbData)
+                            void const *pvData, size_t cbData, bool fFlush)
 {
     RTNETADDRIPV4   IPv4AddrBrdCast;
     IPv4AddrBrdCast.u = UINT32_C(0xffffffff);
@@ -299,6 +301,6 @@ int     VBoxNetUDPBroadcast(PSUPDRVSESSION pSession, INTNETIFHANDLE hIf, PINTNET
     return vboxnetudpSend(pSession, hIf, pBuf,
                           SrcIPv4Addr, pSrcMacAddr, uSrcPort,
                           IPv4AddrBrdCast, &MacBrdCast, uDstPort,
-                          pvData, cbData);
+                          pvData, cbData, fFlush);
 }
 
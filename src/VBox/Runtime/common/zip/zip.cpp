@@ -1818,6 +1818,49 @@ RTDECL(int) RTZipBlockCompress(RTZIPTYPE enmType, RTZIPLEVEL enmLevel, uint32_t
         }
 
         case RTZIPTYPE_ZLIB:
+        {
+#ifdef RTZIP_USE_ZLIB
+            AssertReturn(cbSrc == (uInt)cbSrc, VERR_TOO_MUCH_DATA);
+            AssertReturn(cbDst == (uInt)cbDst, VERR_OUT_OF_RANGE);
+
+            int iLevel = Z_DEFAULT_COMPRESSION;
+            switch (enmLevel)
+            {
+                case RTZIPLEVEL_STORE:      iLevel = 0; break;
+                case RTZIPLEVEL_FAST:       iLevel = 2; break;
+                case RTZIPLEVEL_DEFAULT:    iLevel = Z_DEFAULT_COMPRESSION; break;
+                case RTZIPLEVEL_MAX:        iLevel = 9; break;
+            }
+
+            z_stream ZStrm;
+            RT_ZERO(ZStrm);
+            ZStrm.next_in   = (Bytef *)pvSrc;
+            ZStrm.avail_in  = (uInt)cbSrc;
+            ZStrm.next_out  = (Bytef *)pvDst;
+            ZStrm.avail_out = (uInt)cbDst;
+
+            int rc = deflateInit(&ZStrm, iLevel);
+            if (RT_UNLIKELY(rc != Z_OK))
+                return zipErrConvertFromZlib(rc, true /*fCompressing*/);
+            rc = deflate(&ZStrm, Z_FINISH);
+            if (rc != Z_STREAM_END)
+            {
+                deflateEnd(&ZStrm);
+                if (rc == Z_OK || rc == Z_BUF_ERROR)
+                    return VERR_BUFFER_OVERFLOW;
+                return zipErrConvertFromZlib(rc, true /*fCompressing*/);
+            }
+            rc = deflateEnd(&ZStrm);
+            if (rc != Z_OK)
+                return zipErrConvertFromZlib(rc, true /*fCompressing*/);
+
+            *pcbDstActual = ZStrm.total_out;
+            break;
+#else
+            return VERR_NOT_SUPPORTED;
+#endif
+        }
+
         case RTZIPTYPE_BZLIB:
             return VERR_NOT_SUPPORTED;
 
@@ -21,8 +21,14 @@
 *********************************************************************************************************************************/
 #define LOG_GROUP LOG_GROUP_DBGF
 #include <VBox/vmm/dbgf.h>
+#include <VBox/vmm/dbgftrace.h>
+#include <VBox/vmm/vmm.h>
 #include "DBGFInternal.h"
+#include "DBGFTraceRing.h"
 #include <VBox/vmm/vm.h>
+#ifdef IN_RING3
+# include <VBox/vmm/uvm.h>
+#endif
 #include <VBox/err.h>
 #include <iprt/assert.h>
 #include <iprt/asm.h>
@@ -375,3 +381,58 @@ VMM_INT_DECL(VBOXSTRICTRC) DBGFEventGenericWithArg(PVM pVM, PVMCPU pVCpu, DBGFEV
     return VINF_SUCCESS;
 }
 
+
+/**
+ * Records a binary trace event in the ring of the given VCPU.
+ *
+ * Use DBGFTRACE_BIN instead of calling this directly, it checks the trace
+ * group before making the call.
+ *
+ * @param   pVCpu       The cross context virtual CPU structure of the calling
+ *                      EMT.
+ * @param   uEvent      The event type (DBGFTRACEEVT).
+ * @param   bPhase      The event phase (DBGFTRACEPHASE_XXX).
+ * @param   uArg0       The first event argument.
+ * @param   uArg1       The second event argument.
+ */
+VMMDECL(void) DBGFTraceBinAdd(PVMCPU pVCpu, uint16_t uEvent, uint8_t bPhase, uint64_t uArg0, uint64_t uArg1)
+{
+    PDBGFTRACERING pRing = pVCpu->dbgf.s.CTX_SUFF(pTraceRing);
+    if (pRing)
+        dbgfTraceRingAdd(pRing, uEvent, bPhase, uArg0, uArg1);
+}
+
+
+/**
+ * Records a device specific binary trace event.
+ *
+ * Events raised on an EMT go into the ring of that VCPU, in ring-3 events
+ * raised by other threads go into a separate ring.  Nothing is recorded
+ * unless the DBGFTRACEGRP_DEV group is enabled.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   uEvent      The event type, DBGFTRACEEVT_DEV_FIRST thru
+ *                      DBGFTRACEEVT_DEV_LAST.
+ * @param   bPhase      The event phase (DBGFTRACEPHASE_XXX).
+ * @param   uArg0       The first event argument.
+ * @param   uArg1       The second event argument.
+ * @thread  Any.
+ */
+VMMDECL(void) DBGFTraceBinAddVM(PVM pVM, uint16_t uEvent, uint8_t bPhase, uint64_t uArg0, uint64_t uArg1)
+{
+    Assert(uEvent >= DBGFTRACEEVT_DEV_FIRST);
+    if (RT_LIKELY(!(pVM->aCpus[0].fTraceBinGroups & DBGFTRACEGRP_DEV)))
+        return;
+
+    PVMCPU pVCpu = VMMGetCpu(pVM);
+    if (pVCpu)
+        DBGFTraceBinAdd(pVCpu, uEvent, bPhase, uArg0, uArg1);
+#ifdef IN_RING3
+    else
+    {
+        PDBGFTRACERING pRing = pVM->pUVM->dbgf.s.pTraceRingOther;
+        if (pRing)
+            dbgfTraceRingAdd(pRing, uEvent, bPhase, uArg0, uArg1);
+    }
+#endif
+}
@@ -761,6 +761,140 @@ IEM_STATIC int iemSetPassUpStatus(PIEMCPU pIemCpu, VBOXSTRICTRC rcPassUp)
 }
 
 
+/** @name IEM TLB helpers.
+ * @{ */
+AssertCompile(X86_PTE_RW == IEMTLBE_F_PT_NO_WRITE);
+AssertCompile(X86_PTE_US == IEMTLBE_F_PT_NO_USER);
+AssertCompile(X86_PTE_A  == IEMTLBE_F_PT_NO_ACCESSED);
+AssertCompile(X86_PTE_D  == IEMTLBE_F_PT_NO_DIRTY);
+AssertCompile((X86_PTE_PAE_NX >> 63) == IEMTLBE_F_PT_NO_EXEC);
+
+
+/**
+ * Makes sure the TLBs can be trusted before we start executing.
+ *
+ * We only keep the TLB content across calls while IEM (or REM) is in charge
+ * of the guest.  When running in HM or raw-mode the guest may reload CR3 or
+ * invalidate pages without PGM being told, so EM flushes the TLBs when it
+ * switches to IEM and we flush them here for all other callers.  The
+ * exception is the instructions following the first one in an
+ * iemExecForExitsWorker run, as nobody else can have touched the guest state.
+ *
+ * When the TLBs are disabled they're flushed here every time, so that each
+ * instruction walks the page tables again (for testing and benchmarking).
+ *
+ * @param   pIemCpu             The per CPU IEM state.
+ */
+DECLINLINE(void) iemTlbValidateTrust(PIEMCPU pIemCpu)
+{
+    EMSTATE const enmEmState = EMGetState(IEMCPU_TO_VMCPU(pIemCpu));
+    if (   (   enmEmState == EMSTATE_IEM
+            || enmEmState == EMSTATE_IEM_THEN_REM
+            || pIemCpu->fTlbTrusted)
+        && !pIemCpu->fTlbDisabled)
+    { /* likely */ }
+    else
+        IEMTlbInvalidateAll(IEMCPU_TO_VMCPU(pIemCpu));
+}
+
+
+/**
+ * Looks up a virtual address in a TLB, walking the guest page tables on a
+ * miss.
+ *
+ * @returns VBox status code from PGMGstGetPage on failure, in which case the
+ *          TLB isn't updated.
+ * @param   pIemCpu             The per CPU IEM state.
+ * @param   pTlb                The TLB (CodeTlb or DataTlb).
+ * @param   GCPtr               The virtual address.
+ * @param   ppTlbe              Where to return the TLB entry.
+ */
+DECLINLINE(int) iemTlbLookup(PIEMCPU pIemCpu, PIEMTLB pTlb, RTGCPTR GCPtr, PIEMTLBENTRY *ppTlbe)
+{
+    uint64_t const uTag  = IEMTLB_CALC_TAG(pTlb, GCPtr);
+    PIEMTLBENTRY   pTlbe = IEMTLB_TAG_TO_ENTRY(pTlb, uTag);
+    if (pTlbe->uTag == uTag)
+        pTlb->cTlbHits++;
+    else
+    {
+        pTlb->cTlbMisses++;
+
+        /** @todo Need a different PGM interface here.  We're currently using
+         *        generic / REM interfaces. this won't cut it for R0 & RC. */
+        RTGCPHYS    GCPhys;
+        uint64_t    fFlags;
+        int rc = PGMGstGetPage(IEMCPU_TO_VMCPU(pIemCpu), GCPtr, &fFlags, &GCPhys);
+        if (RT_FAILURE(rc))
+            return rc;
+
+        /* The physical revision is left zero, so pbMappingR3 won't be used. */
+        pTlbe->uTag             = uTag;
+        pTlbe->fFlagsAndPhysRev = (~fFlags & (X86_PTE_RW | X86_PTE_US | X86_PTE_A | X86_PTE_D))
+                                | (fFlags >> 63) /* NX */
+                                | IEMTLBE_F_PG_NO_WRITE;
+        pTlbe->GCPhys           = GCPhys & ~(RTGCPHYS)PAGE_OFFSET_MASK;
+    }
+    *ppTlbe = pTlbe;
+    return VINF_SUCCESS;
+}
+
+
+#ifdef IEM_WITH_TLB_MAPPING
+/**
+ * Gets the ring-3 mapping of the guest page a TLB entry refers to.
+ *
+ * The mapping is cached in the TLB entry and reused for as long as the
+ * physical revision of the TLB doesn't change.  The PGM page mapping lock is
+ * released right away, since everything that may change what backs a guest
+ * page or which handlers are on it (page allocation, freeing and sharing,
+ * chunk unmapping, handler and write monitoring changes) bumps the physical
+ * revision of all the TLBs.
+ *
+ * @returns VBox status code, see PGMPhysIemGCPhys2Ptr.
+ * @param   pIemCpu             The per CPU IEM state.
+ * @param   pTlb                The TLB @a pTlbe belongs to.
+ * @param   pTlbe               The TLB entry.
+ * @param   fAccess             The intended access (IEM_ACCESS_XXX).
+ * @param   ppvPage             Where to return the address of the page.
+ */
+IEM_STATIC int iemTlbMapR3(PIEMCPU pIemCpu, PIEMTLB pTlb, PIEMTLBENTRY pTlbe, uint32_t fAccess, void **ppvPage)
+{
+    bool const     fWrite      = RT_BOOL(fAccess & IEM_ACCESS_TYPE_WRITE);
+    uint64_t const uTlbPhysRev = ASMAtomicUoReadU64(&pTlb->uTlbPhysRev);
+    if (   (pTlbe->fFlagsAndPhysRev & (IEMTLBE_F_PHYS_REV | (fWrite ? IEMTLBE_F_PG_NO_WRITE : 0)))
+        == uTlbPhysRev)
+    {
+        *ppvPage = pTlbe->pbMappingR3;
+        return VINF_SUCCESS;
+    }
+
+    pTlb->cTlbMapMisses++;
+    PGMPAGEMAPLOCK  Lock;
+    void           *pvPage;
+    int rc = PGMPhysIemGCPhys2Ptr(IEMCPU_TO_VM(pIemCpu), IEMCPU_TO_VMCPU(pIemCpu), pTlbe->GCPhys, fWrite,
+                                  pIemCpu->fBypassHandlers, &pvPage, &Lock);
+    AssertMsg(rc == VINF_SUCCESS || RT_FAILURE_NP(rc), ("%Rrc\n", rc));
+    if (rc != VINF_SUCCESS)
+        return rc;
+    PGMPhysReleasePageMappingLock(IEMCPU_TO_VM(pIemCpu), &Lock);
+
+    /* Only cache it if the handlers were taken into account.  Note that we
+       use the revision from before the call, so if PGM changed something
+       while mapping the page, we'll just end up here again next time. */
+    if (!pIemCpu->fBypassHandlers)
+    {
+        pTlbe->pbMappingR3      = (uint8_t *)pvPage;
+        pTlbe->fFlagsAndPhysRev = (pTlbe->fFlagsAndPhysRev & ~(IEMTLBE_F_PHYS_REV | IEMTLBE_F_PG_NO_WRITE))
+                                | uTlbPhysRev
+                                | (fWrite ? 0 : IEMTLBE_F_PG_NO_WRITE);
+    }
+    *ppvPage = pvPage;
+    return VINF_SUCCESS;
+}
+#endif /* IEM_WITH_TLB_MAPPING */
+/** @} */
+
+
 /**
  * Initializes the execution state.
  *
@@ -822,6 +956,7 @@ DECLINLINE(void) iemInitExec(PIEMCPU pIemCpu, bool fBypassHandlers)
     if (!pIemCpu->fInPatchCode)
         CPUMRawLeave(pVCpu, VINF_SUCCESS);
 #endif
+    iemTlbValidateTrust(pIemCpu);
 }
 
 
@@ -895,6 +1030,7 @@ DECLINLINE(void) iemInitDecoder(PIEMCPU pIemCpu, bool fBypassHandlers)
     if (!pIemCpu->fInPatchCode)
         CPUMRawLeave(pVCpu, VINF_SUCCESS);
 #endif
+    iemTlbValidateTrust(pIemCpu);
 
 #ifdef DBGFTRACE_ENABLED
     switch (enmMode)
@@ -972,25 +1108,24 @@ IEM_STATIC VBOXSTRICTRC iemInitDecoderAndPrefetchOpcodes(PIEMCPU pIemCpu, bool f
     }
 #endif /* VBOX_WITH_RAW_MODE_NOT_R0 */
 
-    RTGCPHYS    GCPhys;
-    uint64_t    fFlags;
-    int rc = PGMGstGetPage(IEMCPU_TO_VMCPU(pIemCpu), GCPtrPC, &fFlags, &GCPhys);
+    PIEMTLBENTRY pTlbe;
+    int rc = iemTlbLookup(pIemCpu, &pIemCpu->CodeTlb, GCPtrPC, &pTlbe);
     if (RT_FAILURE(rc))
     {
         Log(("iemInitDecoderAndPrefetchOpcodes: %RGv - rc=%Rrc\n", GCPtrPC, rc));
         return iemRaisePageFault(pIemCpu, GCPtrPC, IEM_ACCESS_INSTRUCTION, rc);
     }
-    if (!(fFlags & X86_PTE_US) && pIemCpu->uCpl == 3)
+    if ((pTlbe->fFlagsAndPhysRev & IEMTLBE_F_PT_NO_USER) && pIemCpu->uCpl == 3)
     {
         Log(("iemInitDecoderAndPrefetchOpcodes: %RGv - supervisor page\n", GCPtrPC));
         return iemRaisePageFault(pIemCpu, GCPtrPC, IEM_ACCESS_INSTRUCTION, VERR_ACCESS_DENIED);
     }
-    if ((fFlags & X86_PTE_PAE_NX) && (pCtx->msrEFER & MSR_K6_EFER_NXE))
+    if ((pTlbe->fFlagsAndPhysRev & IEMTLBE_F_PT_NO_EXEC) && (pCtx->msrEFER & MSR_K6_EFER_NXE))
     {
         Log(("iemInitDecoderAndPrefetchOpcodes: %RGv - NX\n", GCPtrPC));
         return iemRaisePageFault(pIemCpu, GCPtrPC, IEM_ACCESS_INSTRUCTION, VERR_ACCESS_DENIED);
     }
-    GCPhys |= GCPtrPC & PAGE_OFFSET_MASK;
+    RTGCPHYS const GCPhys = pTlbe->GCPhys | (GCPtrPC & PAGE_OFFSET_MASK);
     /** @todo Check reserved bits and such stuff. PGM is better at doing
      *        that, so do it when implementing the guest virtual address
      *        TLB... */
@@ -1035,6 +1170,12 @@ IEM_STATIC VBOXSTRICTRC iemInitDecoderAndPrefetchOpcodes(PIEMCPU pIemCpu, bool f
         if (cbToTryRead > sizeof(pIemCpu->abOpcode))
             cbToTryRead = sizeof(pIemCpu->abOpcode);
 
+#ifdef IEM_WITH_TLB_MAPPING
+        void *pvPage;
+        if (iemTlbMapR3(pIemCpu, &pIemCpu->CodeTlb, pTlbe, IEM_ACCESS_INSTRUCTION, &pvPage) == VINF_SUCCESS)
+            memcpy(pIemCpu->abOpcode, (uint8_t const *)pvPage + (GCPhys & PAGE_OFFSET_MASK), cbToTryRead);
+        else
+#endif
         if (!pIemCpu->fBypassHandlers)
         {
             VBOXSTRICTRC rcStrict = PGMPhysRead(pVM, GCPhys, pIemCpu->abOpcode, cbToTryRead, PGMACCESSORIGIN_IEM);
@@ -1143,25 +1284,24 @@ IEM_STATIC VBOXSTRICTRC iemOpcodeFetchMoreBytes(PIEMCPU pIemCpu, size_t cbMin)
     }
 #endif /* VBOX_WITH_RAW_MODE_NOT_R0 */
 
-    RTGCPHYS    GCPhys;
-    uint64_t    fFlags;
-    int rc = PGMGstGetPage(IEMCPU_TO_VMCPU(pIemCpu), GCPtrNext, &fFlags, &GCPhys);
+    PIEMTLBENTRY pTlbe;
+    int rc = iemTlbLookup(pIemCpu, &pIemCpu->CodeTlb, GCPtrNext, &pTlbe);
     if (RT_FAILURE(rc))
     {
         Log(("iemOpcodeFetchMoreBytes: %RGv - rc=%Rrc\n", GCPtrNext, rc));
         return iemRaisePageFault(pIemCpu, GCPtrNext, IEM_ACCESS_INSTRUCTION, rc);
     }
-    if (!(fFlags & X86_PTE_US) && pIemCpu->uCpl == 3)
+    if ((pTlbe->fFlagsAndPhysRev & IEMTLBE_F_PT_NO_USER) && pIemCpu->uCpl == 3)
     {
         Log(("iemOpcodeFetchMoreBytes: %RGv - supervisor page\n", GCPtrNext));
         return iemRaisePageFault(pIemCpu, GCPtrNext, IEM_ACCESS_INSTRUCTION, VERR_ACCESS_DENIED);
     }
-    if ((fFlags & X86_PTE_PAE_NX) && (pCtx->msrEFER & MSR_K6_EFER_NXE))
+    if ((pTlbe->fFlagsAndPhysRev & IEMTLBE_F_PT_NO_EXEC) && (pCtx->msrEFER & MSR_K6_EFER_NXE))
     {
         Log(("iemOpcodeFetchMoreBytes: %RGv - NX\n", GCPtrNext));
         return iemRaisePageFault(pIemCpu, GCPtrNext, IEM_ACCESS_INSTRUCTION, VERR_ACCESS_DENIED);
     }
-    GCPhys |= GCPtrNext & PAGE_OFFSET_MASK;
+    RTGCPHYS const GCPhys = pTlbe->GCPhys | (GCPtrNext & PAGE_OFFSET_MASK);
     Log5(("GCPtrNext=%RGv GCPhys=%RGp cbOpcodes=%#x\n",  GCPtrNext,  GCPhys,  pIemCpu->cbOpcode));
     /** @todo Check reserved bits and such stuff. PGM is better at doing
      *        that, so do it when implementing the guest virtual address
@@ -1174,6 +1314,12 @@ IEM_STATIC VBOXSTRICTRC iemOpcodeFetchMoreBytes(PIEMCPU pIemCpu, size_t cbMin)
      * and since PATM should only patch the start of an instruction there
      * should be no need to check again here.
      */
+#ifdef IEM_WITH_TLB_MAPPING
+    void *pvPage;
+    if (iemTlbMapR3(pIemCpu, &pIemCpu->CodeTlb, pTlbe, IEM_ACCESS_INSTRUCTION, &pvPage) == VINF_SUCCESS)
+        memcpy(&pIemCpu->abOpcode[pIemCpu->cbOpcode], (uint8_t const *)pvPage + (GCPhys & PAGE_OFFSET_MASK), cbToTryRead);
+    else
+#endif
     if (!pIemCpu->fBypassHandlers)
     {
         VBOXSTRICTRC rcStrict = PGMPhysRead(IEMCPU_TO_VM(pIemCpu), GCPhys, &pIemCpu->abOpcode[pIemCpu->cbOpcode],
@@ -6249,21 +6395,21 @@ iemMemApplySegment(PIEMCPU pIemCpu, uint32_t fAccess, uint8_t iSegReg, size_t cb
 
 /**
  * Translates a virtual address to a physical physical address and checks if we
- * can access the page as specified.
+ * can access the page as specified, returning the TLB entry used.
  *
  * @param   pIemCpu             The IEM per CPU data.
  * @param   GCPtrMem            The virtual address.
  * @param   fAccess             The intended access.
  * @param   pGCPhysMem          Where to return the physical address.
+ * @param   ppTlbe              Where to return the TLB entry.  Optional.
  */
 IEM_STATIC VBOXSTRICTRC
-iemMemPageTranslateAndCheckAccess(PIEMCPU pIemCpu, RTGCPTR GCPtrMem, uint32_t fAccess, PRTGCPHYS pGCPhysMem)
+iemMemPageTranslateAndCheckAccessEx(PIEMCPU pIemCpu, RTGCPTR GCPtrMem, uint32_t fAccess, PRTGCPHYS pGCPhysMem,
+                                    PIEMTLBENTRY *ppTlbe)
 {
-    /** @todo Need a different PGM interface here.  We're currently using
-     *        generic / REM interfaces. this won't cut it for R0 & RC. */
-    RTGCPHYS    GCPhys;
-    uint64_t    fFlags;
-    int rc = PGMGstGetPage(IEMCPU_TO_VMCPU(pIemCpu), GCPtrMem, &fFlags, &GCPhys);
+    PIEMTLB      pTlb = fAccess & IEM_ACCESS_TYPE_EXEC ? &pIemCpu->CodeTlb : &pIemCpu->DataTlb;
+    PIEMTLBENTRY pTlbe;
+    int rc = iemTlbLookup(pIemCpu, pTlb, GCPtrMem, &pTlbe);
     if (RT_FAILURE(rc))
     {
         /** @todo Check unassigned memory in unpaged mode. */
@@ -6274,11 +6420,12 @@ iemMemPageTranslateAndCheckAccess(PIEMCPU pIemCpu, RTGCPTR GCPtrMem, uint32_t fA
 
     /* If the page is writable and does not have the no-exec bit set, all
        access is allowed.  Otherwise we'll have to check more carefully... */
-    if ((fFlags & (X86_PTE_RW | X86_PTE_US | X86_PTE_PAE_NX)) != (X86_PTE_RW | X86_PTE_US))
+    uint64_t const fFlags = pTlbe->fFlagsAndPhysRev;
+    if (fFlags & (IEMTLBE_F_PT_NO_WRITE | IEMTLBE_F_PT_NO_USER | IEMTLBE_F_PT_NO_EXEC))
     {
         /* Write to read only memory? */
         if (   (fAccess & IEM_ACCESS_TYPE_WRITE)
-            && !(fFlags & X86_PTE_RW)
+            && (fFlags & IEMTLBE_F_PT_NO_WRITE)
             && (   pIemCpu->uCpl != 0
                 || (pIemCpu->CTX_SUFF(pCtx)->cr0 & X86_CR0_WP)))
         {
@@ -6288,7 +6435,7 @@ iemMemPageTranslateAndCheckAccess(PIEMCPU pIemCpu, RTGCPTR GCPtrMem, uint32_t fA
         }
 
         /* Kernel memory accessed by userland? */
-        if (   !(fFlags & X86_PTE_US)
+        if (   (fFlags & IEMTLBE_F_PT_NO_USER)
             && pIemCpu->uCpl == 3
             && !(fAccess & IEM_ACCESS_WHAT_SYS))
         {
@@ -6299,7 +6446,7 @@ iemMemPageTranslateAndCheckAccess(PIEMCPU pIemCpu, RTGCPTR GCPtrMem, uint32_t fA
 
         /* Executing non-executable memory? */
         if (   (fAccess & IEM_ACCESS_TYPE_EXEC)
-            && (fFlags & X86_PTE_PAE_NX)
+            && (fFlags & IEMTLBE_F_PT_NO_EXEC)
             && (pIemCpu->CTX_SUFF(pCtx)->msrEFER & MSR_K6_EFER_NXE) )
         {
             Log(("iemMemPageTranslateAndCheckAccess: GCPtrMem=%RGv - NX -> #PF\n", GCPtrMem));
@@ -6315,18 +6462,36 @@ iemMemPageTranslateAndCheckAccess(PIEMCPU pIemCpu, RTGCPTR GCPtrMem, uint32_t fA
      */
     /** @todo testcase: check when A and D bits are actually set by the CPU.  */
     uint32_t fAccessedDirty = fAccess & IEM_ACCESS_TYPE_WRITE ? X86_PTE_D | X86_PTE_A : X86_PTE_A;
-    if ((fFlags & fAccessedDirty) != fAccessedDirty)
+    if (fFlags & fAccessedDirty) /* inverted: IEMTLBE_F_PT_NO_ACCESSED / IEMTLBE_F_PT_NO_DIRTY */
     {
         int rc2 = PGMGstModifyPage(IEMCPU_TO_VMCPU(pIemCpu), GCPtrMem, 1, fAccessedDirty, ~(uint64_t)fAccessedDirty);
         AssertRC(rc2);
+        pTlbe->fFlagsAndPhysRev &= ~(uint64_t)fAccessedDirty;
     }
 
-    GCPhys |= GCPtrMem & PAGE_OFFSET_MASK;
-    *pGCPhysMem = GCPhys;
+    *pGCPhysMem = pTlbe->GCPhys | (GCPtrMem & PAGE_OFFSET_MASK);
+    if (ppTlbe)
+        *ppTlbe = pTlbe;
     return VINF_SUCCESS;
 }
 
 
+/**
+ * Translates a virtual address to a physical physical address and checks if we
+ * can access the page as specified.
+ *
+ * @param   pIemCpu             The IEM per CPU data.
+ * @param   GCPtrMem            The virtual address.
+ * @param   fAccess             The intended access.
+ * @param   pGCPhysMem          Where to return the physical address.
+ */
+IEM_STATIC VBOXSTRICTRC
+iemMemPageTranslateAndCheckAccess(PIEMCPU pIemCpu, RTGCPTR GCPtrMem, uint32_t fAccess, PRTGCPHYS pGCPhysMem)
+{
+    return iemMemPageTranslateAndCheckAccessEx(pIemCpu, GCPtrMem, fAccess, pGCPhysMem, NULL);
+}
+
+
 
 /**
  * Maps a physical page.
@@ -6990,15 +7155,26 @@ iemMemMap(PIEMCPU pIemCpu, void **ppvMem, size_t cbMem, uint8_t iSegReg, RTGCPTR
     if ((GCPtrMem & PAGE_OFFSET_MASK) + cbMem > PAGE_SIZE) /* Crossing a page boundary? */
         return iemMemBounceBufferMapCrossPage(pIemCpu, iMemMap, ppvMem, cbMem, GCPtrMem, fAccess);
 
-    RTGCPHYS GCPhysFirst;
-    rcStrict = iemMemPageTranslateAndCheckAccess(pIemCpu, GCPtrMem, fAccess, &GCPhysFirst);
+    RTGCPHYS     GCPhysFirst;
+    PIEMTLBENTRY pTlbe;
+    rcStrict = iemMemPageTranslateAndCheckAccessEx(pIemCpu, GCPtrMem, fAccess, &GCPhysFirst, &pTlbe);
     if (rcStrict != VINF_SUCCESS)
         return rcStrict;
 
     void *pvMem;
+#ifdef IEM_WITH_TLB_MAPPING
+    PIEMTLB pTlb = fAccess & IEM_ACCESS_TYPE_EXEC ? &pIemCpu->CodeTlb : &pIemCpu->DataTlb;
+    rcStrict = iemTlbMapR3(pIemCpu, pTlb, pTlbe, fAccess, &pvMem);
+    if (rcStrict != VINF_SUCCESS)
+        return iemMemBounceBufferMapPhys(pIemCpu, iMemMap, ppvMem, cbMem, GCPhysFirst, fAccess, rcStrict);
+    pvMem = (uint8_t *)pvMem + (GCPhysFirst & PAGE_OFFSET_MASK);
+    fAccess |= IEM_ACCESS_NOT_LOCKED;
+#else
+    NOREF(pTlbe);
     rcStrict = iemMemPageMap(pIemCpu, GCPhysFirst, fAccess, &pvMem, &pIemCpu->aMemMappingLocks[iMemMap].Lock);
     if (rcStrict != VINF_SUCCESS)
         return iemMemBounceBufferMapPhys(pIemCpu, iMemMap, ppvMem, cbMem, GCPhysFirst, fAccess, rcStrict);
+#endif
 
     /*
      * Fill in the mapping table entry.
@@ -7034,7 +7210,7 @@ IEM_STATIC VBOXSTRICTRC iemMemCommitAndUnmap(PIEMCPU pIemCpu, void *pvMem, uint3
             return iemMemBounceBufferCommitAndUnmap(pIemCpu, iMemMap);
     }
     /* Otherwise unlock it. */
-    else
+    else if (!(pIemCpu->aMemMappings[iMemMap].fAccess & IEM_ACCESS_NOT_LOCKED))
         PGMPhysReleasePageMappingLock(IEMCPU_TO_VM(pIemCpu), &pIemCpu->aMemMappingLocks[iMemMap].Lock);
 
     /* Free the entry. */
@@ -7064,7 +7240,7 @@ IEM_STATIC void iemMemRollback(PIEMCPU pIemCpu)
         if (fAccess != IEM_ACCESS_INVALID)
         {
             pIemCpu->aMemMappings[iMemMap].fAccess = IEM_ACCESS_INVALID;
-            if (!(fAccess & IEM_ACCESS_BOUNCE_BUFFERED))
+            if (!(fAccess & (IEM_ACCESS_BOUNCE_BUFFERED | IEM_ACCESS_NOT_LOCKED)))
                 PGMPhysReleasePageMappingLock(IEMCPU_TO_VM(pIemCpu), &pIemCpu->aMemMappingLocks[iMemMap].Lock);
             Assert(pIemCpu->cActiveMappings > 0);
             pIemCpu->cActiveMappings--;
@@ -11000,6 +11176,121 @@ VMMDECL(VBOXSTRICTRC)       IEMExecOneBypassWithPrefetchedByPC(PVMCPU pVCpu, PCP
 }
 
 
+/**
+ * The instruction loop of IEMExecForExits.
+ *
+ * Going back to EM after each instruction costs a lot more than decoding and
+ * executing the average instruction, so we keep at it for as long as the
+ * instructions complete with VINF_SUCCESS, no forced actions are pending and
+ * no timers have expired.  Pending interrupts only stop us when the guest can
+ * take them.
+ *
+ * @return  Strict VBox status code.
+ * @param   pVCpu               The cross context virtual CPU structure of the calling EMT.
+ * @param   pIemCpu             The IEM per CPU data.
+ * @param   cMaxInstructions    The maximum number of instructions to execute,
+ *                              must be at least one.
+ * @param   cMaxInstructionsWithoutExits
+ *                              Stop after this many instructions in a row
+ *                              without any potential exits (I/O port and MMIO
+ *                              accesses).
+ */
+IEM_STATIC VBOXSTRICTRC iemExecForExitsWorker(PVMCPU pVCpu, PIEMCPU pIemCpu, uint32_t cMaxInstructions,
+                                              uint32_t cMaxInstructionsWithoutExits)
+{
+    Assert(cMaxInstructions > 0);
+    Assert(cMaxInstructionsWithoutExits > 0);
+    Assert(!pIemCpu->fTlbTrusted);
+
+    VBOXSTRICTRC rcStrict = iemInitDecoderAndPrefetchOpcodes(pIemCpu, false);
+    if (rcStrict == VINF_SUCCESS)
+        rcStrict = iemExecOneInner(pVCpu, pIemCpu, true);
+
+#if !defined(IEM_VERIFICATION_MODE_FULL) || !defined(IN_RING3)
+    /*
+     * Keep going.  (The verification mode compares each instruction with REM,
+     * so it has to stick to one at a time.)
+     */
+    if (   rcStrict == VINF_SUCCESS
+        && cMaxInstructions > 1)
+    {
+        PVM      pVM                   = IEMCPU_TO_VM(pIemCpu);
+        PCPUMCTX pCtx                  = pIemCpu->CTX_SUFF(pCtx);
+        uint32_t cLeft                 = cMaxInstructions - 1;
+        uint32_t cLeftWithoutExits     = cMaxInstructionsWithoutExits;
+        uint32_t cPotentialExitsAtLast = pIemCpu->cPotentialExits;
+
+        /* The first instruction made sure we can trust the TLBs and nobody
+           else gets to run the guest until we return. */
+        pIemCpu->fTlbTrusted = true;
+        for (;;)
+        {
+            /* Check for forced actions.  The interrupt ones are ignored
+               while the guest has interrupts disabled, as EM can't do
+               anything about them then anyway. */
+            uint32_t fCpu = pVCpu->fLocalForcedActions
+                          & (VMCPU_FF_ALL_REM_MASK & ~(VMCPU_FF_UNHALT | VMCPU_FF_BLOCK_NMIS));
+            if (!pCtx->eflags.Bits.u1IF)
+                fCpu &= ~(VMCPU_FF_INTERRUPT_APIC | VMCPU_FF_INTERRUPT_PIC);
+            if (RT_LIKELY(   !fCpu
+                          && !VM_FF_IS_PENDING(pVM, VM_FF_ALL_REM_MASK)))
+            { /* likely */ }
+            else
+            {
+                pIemCpu->cExecForExitsFFBreaks++;
+                break;
+            }
+
+            /* Poll the timers every now and then (sets VMCPU_FF_TIMER). */
+            if (   (cLeft & IEM_EXEC_FOR_EXITS_TIMER_POLL_MASK)
+                || !TMTimerPollBool(pVM, pVCpu))
+            { /* likely */ }
+            else
+            {
+                pIemCpu->cExecForExitsFFBreaks++;
+                break;
+            }
+
+            /* Has the guest stopped doing the stuff the caller is after? */
+            if (pIemCpu->cPotentialExits != cPotentialExitsAtLast)
+            {
+                cPotentialExitsAtLast = pIemCpu->cPotentialExits;
+                cLeftWithoutExits     = cMaxInstructionsWithoutExits;
+            }
+            else if (--cLeftWithoutExits == 0)
+                break;
+
+# ifdef LOG_ENABLED
+            iemLogCurInstr(pVCpu, pCtx, true);
+# endif
+            rcStrict = iemInitDecoderAndPrefetchOpcodes(pIemCpu, false);
+            if (rcStrict == VINF_SUCCESS)
+                rcStrict = iemExecOneInner(pVCpu, pIemCpu, true);
+            if (   rcStrict == VINF_SUCCESS
+                && --cLeft > 0)
+            { /* likely */ }
+            else
+                break;
+        }
+        pIemCpu->fTlbTrusted = false;
+    }
+#else
+    NOREF(cMaxInstructions); NOREF(cMaxInstructionsWithoutExits);
+#endif
+    return rcStrict;
+}
+
+
+/**
+ * Injects any pending TRPM trap and executes a single instruction.
+ *
+ * @return  Strict VBox status code.
+ * @param   pVCpu       The cross context virtual CPU structure of the calling EMT.
+ *
+ * @todo    A threaded-code tier (decode a block once, cache and chain the
+ *          blocks, invalidate them on guest code writes) would go here.  It
+ *          needs the decoding split out of the FNIEMOP handlers first.
+ */
 VMMDECL(VBOXSTRICTRC) IEMExecLots(PVMCPU pVCpu)
 {
     PIEMCPU  pIemCpu = &pVCpu->iem.s;
@@ -11064,6 +11355,63 @@ VMMDECL(VBOXSTRICTRC) IEMExecLots(PVMCPU pVCpu)
 }
 
 
+/**
+ * Executes instructions on behalf of a frequently exiting piece of guest code.
+ *
+ * This is for EM's exit history, which calls it after handling an exit from
+ * hardware assisted execution at a hot exit site.  It keeps executing for as
+ * long as nothing needs EM's attention, and also stops once the guest has gone @a
+ * cMaxInstructionsWithoutExits instructions without doing any I/O port or
+ * MMIO accesses, as it's then probably better off back in HM.
+ *
+ * The caller must make sure there is no event pending in TRPM.
+ *
+ * @return  Strict VBox status code.
+ * @param   pVCpu               The cross context virtual CPU structure of the calling EMT.
+ * @param   cMaxInstructions    The maximum number of instructions to execute,
+ *                              must be at least one.
+ * @param   cMaxInstructionsWithoutExits
+ *                              The maximum number of instructions in a row
+ *                              without potential exits.
+ * @param   pcInstructions      Where to return the number of instructions
+ *                              executed successfully.
+ * @param   pcPotentialExits    Where to return the number of I/O port and
+ *                              MMIO accesses performed (each of which would
+ *                              likely have been an exit in HM).
+ */
+VMMDECL(VBOXSTRICTRC) IEMExecForExits(PVMCPU pVCpu, uint32_t cMaxInstructions, uint32_t cMaxInstructionsWithoutExits,
+                                      uint32_t *pcInstructions, uint32_t *pcPotentialExits)
+{
+    PIEMCPU         pIemCpu = &pVCpu->iem.s;
+    uint32_t const  cInstructionsAtStart   = pIemCpu->cInstructions;
+    uint32_t const  cPotentialExitsAtStart = pIemCpu->cPotentialExits;
+    Assert(!TRPMHasTrap(pVCpu));
+
+#if defined(IEM_VERIFICATION_MODE_FULL) && defined(IN_RING3)
+    iemExecVerificationModeSetup(pIemCpu);
+#endif
+#ifdef LOG_ENABLED
+    iemLogCurInstr(pVCpu, pIemCpu->CTX_SUFF(pCtx), true);
+#endif
+
+    pIemCpu->cExecForExitsRuns++;
+    VBOXSTRICTRC rcStrict = iemExecForExitsWorker(pVCpu, pIemCpu, cMaxInstructions, cMaxInstructionsWithoutExits);
+
+#if defined(IEM_VERIFICATION_MODE_FULL) && defined(IN_RING3)
+    iemExecVerificationModeCheck(pIemCpu);
+#endif
+#ifdef IN_RC
+    rcStrict = iemRCRawMaybeReenter(pIemCpu, pVCpu, pIemCpu->CTX_SUFF(pCtx), rcStrict);
+#endif
+    if (rcStrict != VINF_SUCCESS)
+        LogFlow(("IEMExecForExits: cs:rip=%04x:%08RX64 - rcStrict=%Rrc\n",
+                 pIemCpu->CTX_SUFF(pCtx)->cs.Sel, pIemCpu->CTX_SUFF(pCtx)->rip, VBOXSTRICTRC_VAL(rcStrict)));
+    *pcInstructions   = pIemCpu->cInstructions   - cInstructionsAtStart;
+    *pcPotentialExits = pIemCpu->cPotentialExits - cPotentialExitsAtStart;
+    return rcStrict;
+}
+
+
 
 /**
  * Injects a trap, fault, abort, software interrupt or external interrupt.
@@ -11179,6 +11527,87 @@ VMM_INT_DECL(int) IEMBreakpointClear(PVM pVM, RTGCPTR GCPtrBp)
 }
 
 
+/**
+ * Invalidates all the entries of a TLB by bumping its revision.
+ *
+ * @param   pTlb        The TLB.
+ */
+DECLINLINE(void) iemTlbInvalidateAllOne(PIEMTLB pTlb)
+{
+    pTlb->uTlbRevision += IEMTLB_REVISION_INCR;
+    if (RT_LIKELY(pTlb->uTlbRevision != 0))
+    { /* very likely */ }
+    else
+    {
+        /* Wrapped around, zero all the tags so old entries can't match. */
+        pTlb->uTlbRevision = IEMTLB_REVISION_INCR;
+        for (unsigned i = 0; i < RT_ELEMENTS(pTlb->aEntries); i++)
+            pTlb->aEntries[i].uTag = 0;
+    }
+}
+
+
+/**
+ * Invalidates the code and data TLBs of a virtual CPU.
+ *
+ * This is called by PGM when CR3 is reloaded or the paging mode changes, and by
+ * EM when switching to IEM execution.
+ *
+ * @param   pVCpu       Pointer to the VMCPU.
+ * @thread  EMT(pVCpu)
+ */
+VMM_INT_DECL(void) IEMTlbInvalidateAll(PVMCPU pVCpu)
+{
+    iemTlbInvalidateAllOne(&pVCpu->iem.s.CodeTlb);
+    iemTlbInvalidateAllOne(&pVCpu->iem.s.DataTlb);
+}
+
+
+/**
+ * Invalidates a page in the code and data TLBs of a virtual CPU (INVLPG).
+ *
+ * @param   pVCpu       Pointer to the VMCPU.
+ * @param   GCPtr       The address of the page to invalidate.
+ * @thread  EMT(pVCpu)
+ */
+VMM_INT_DECL(void) IEMTlbInvalidatePage(PVMCPU pVCpu, RTGCPTR GCPtr)
+{
+    uint64_t const uTag  = IEMTLB_CALC_TAG_NO_REV(GCPtr);
+    PIEMTLB        pTlb  = &pVCpu->iem.s.CodeTlb;
+    PIEMTLBENTRY   pTlbe = IEMTLB_TAG_TO_ENTRY(pTlb, uTag);
+    if (pTlbe->uTag == (uTag | pTlb->uTlbRevision))
+        pTlbe->uTag = 0;
+
+    pTlb  = &pVCpu->iem.s.DataTlb;
+    pTlbe = IEMTLB_TAG_TO_ENTRY(pTlb, uTag);
+    if (pTlbe->uTag == (uTag | pTlb->uTlbRevision))
+        pTlbe->uTag = 0;
+}
+
+
+/**
+ * Invalidates the cached host mappings and physical page info in the TLBs of
+ * all the virtual CPUs.
+ *
+ * PGM calls this whenever it changes what backs a guest physical page or
+ * which access handlers are active on it.  The virtual address translations
+ * are left alone.
+ *
+ * @param   pVM         Pointer to the VM.
+ * @thread  Any.
+ */
+VMM_INT_DECL(void) IEMTlbInvalidateAllPhysicalAllCpus(PVM pVM)
+{
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+    {
+        PVMCPU pVCpu = &pVM->aCpus[idCpu];
+        /* The revision is 56 bits wide, so wrapping around isn't a practical concern. */
+        ASMAtomicAddU64(&pVCpu->iem.s.CodeTlb.uTlbPhysRev, IEMTLB_PHYS_REV_INCR);
+        ASMAtomicAddU64(&pVCpu->iem.s.DataTlb.uTlbPhysRev, IEMTLB_PHYS_REV_INCR);
+    }
+}
+
+
 #if 0 /* The IRET-to-v8086 mode in PATM is very optimistic, so I don't dare do this yet. */
 /**
  * Executes a IRET instruction with default operand size.
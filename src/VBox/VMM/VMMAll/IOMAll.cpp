@@ -34,6 +34,7 @@
 #include <VBox/vmm/pdmdev.h>
 #include <VBox/vmm/pgm.h>
 #include <VBox/vmm/cpum.h>
+#include <VBox/vmm/dbgftrace.h>
 #include <VBox/err.h>
 #include <VBox/log.h>
 #include <iprt/assert.h>
@@ -80,13 +81,6 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortRead(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32
 {
 /** @todo should initialize *pu32Value here because it can happen that some
  *        handle is buggy and doesn't handle all cases. */
-    /* Take the IOM lock before performing any device I/O. */
-    int rc2 = IOM_LOCK_SHARED(pVM);
-#ifndef IN_RING3
-    if (rc2 == VERR_SEM_BUSY)
-        return VINF_IOM_R3_IOPORT_READ;
-#endif
-    AssertRC(rc2);
 #if defined(IEM_VERIFICATION_MODE) && defined(IN_RING3)
     IEMNotifyIOPortRead(pVM, Port, cbValue);
 #endif
@@ -95,31 +89,20 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortRead(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32
     /*
      * Get the statistics record.
      */
-    PIOMIOPORTSTATS  pStats = pVCpu->iom.s.CTX_SUFF(pStatsLastRead);
-    if (!pStats || pStats->Core.Key != Port)
-    {
-        pStats = (PIOMIOPORTSTATS)RTAvloIOPortGet(&pVM->iom.s.CTX_SUFF(pTrees)->IOPortStatTree, Port);
-        if (pStats)
-            pVCpu->iom.s.CTX_SUFF(pStatsLastRead) = pStats;
-    }
+    PIOMIOPORTSTATS  pStats = iomIOPortGetStats(pVM, &pVCpu->iom.s.CTX_SUFF(pStatsLastRead), Port);
 #endif
 
     /*
-     * Get handler for current context.
+     * Get handler for current context.  The lookup does not take the IOM
+     * lock, see @ref sec_iom_lookup.
      */
-    CTX_SUFF(PIOMIOPORTRANGE) pRange = pVCpu->iom.s.CTX_SUFF(pRangeLastRead);
-    if (    !pRange
-        ||   (unsigned)Port - (unsigned)pRange->Port >= (unsigned)pRange->cPorts)
-    {
-        pRange = iomIOPortGetRange(pVM, Port);
-        if (pRange)
-            pVCpu->iom.s.CTX_SUFF(pRangeLastRead) = pRange;
-    }
+    iomLookupEnter(pVM, pVCpu);
+    CTX_SUFF(PIOMIOPORTRANGE) pRange = iomIOPortGetRange(pVM, pVCpu, Port);
     MMHYPER_RC_ASSERT_RCPTR(pVM, pRange);
     if (pRange)
     {
         /*
-         * Found a range, get the data in case we leave the IOM lock.
+         * Found a range, get the data before leaving the lookup section.
          */
         PFNIOMIOPORTIN  pfnInCallback = pRange->pfnInCallback;
 #ifndef IN_RING3
@@ -128,13 +111,13 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortRead(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32
         else
         {
             STAM_STATS({ if (pStats) STAM_COUNTER_INC(&pStats->InRZToR3); });
-            IOM_UNLOCK_SHARED(pVM);
+            iomLookupLeave(pVCpu);
             return VINF_IOM_R3_IOPORT_READ;
         }
 #endif
         void           *pvUser    = pRange->pvUser;
         PPDMDEVINS      pDevIns   = pRange->pDevIns;
-        IOM_UNLOCK_SHARED(pVM);
+        iomLookupLeave(pVCpu);
 
         /*
          * Call the device.
@@ -147,6 +130,7 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortRead(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32
             STAM_STATS({ if (pStats) STAM_COUNTER_INC(&pStats->InRZToR3); });
             return rcStrict;
         }
+        DBGFTRACE_BIN(pVCpu, DBGFTRACEGRP_IOPORT, DBGFTRACEEVT_IOPORT_READ, DBGFTRACEPHASE_BEGIN, Port, cbValue);
 #ifdef VBOX_WITH_STATISTICS
         if (pStats)
         {
@@ -158,6 +142,8 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortRead(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32
 #endif
             rcStrict = pfnInCallback(pDevIns, pvUser, Port, pu32Value, (unsigned)cbValue);
         PDMCritSectLeave(pDevIns->CTX_SUFF(pCritSectRo));
+        DBGFTRACE_BIN(pVCpu, DBGFTRACEGRP_IOPORT, DBGFTRACEEVT_IOPORT_READ, DBGFTRACEPHASE_END, *pu32Value,
+                      VBOXSTRICTRC_VAL(rcStrict));
 
 #ifdef VBOX_WITH_STATISTICS
         if (rcStrict == VINF_SUCCESS && pStats)
@@ -189,17 +175,17 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortRead(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32
     /*
      * Handler in ring-3?
      */
-    PIOMIOPORTRANGER3 pRangeR3 = iomIOPortGetRangeR3(pVM, Port);
-    if (pRangeR3)
+    if (iomIOPortHasRangeR3(pVM, pVCpu, Port))
     {
 # ifdef VBOX_WITH_STATISTICS
         if (pStats)
             STAM_COUNTER_INC(&pStats->InRZToR3);
 # endif
-        IOM_UNLOCK_SHARED(pVM);
+        iomLookupLeave(pVCpu);
         return VINF_IOM_R3_IOPORT_READ;
     }
 #endif
+    iomLookupLeave(pVCpu);
 
     /*
      * Ok, no handler for this port.
@@ -217,11 +203,9 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortRead(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32
         case 4: *(uint32_t *)pu32Value = UINT32_C(0xffffffff); break;
         default:
             AssertMsgFailed(("Invalid I/O port size %d. Port=%d\n", cbValue, Port));
-            IOM_UNLOCK_SHARED(pVM);
             return VERR_IOM_INVALID_IOPORT_SIZE;
     }
     Log3(("IOMIOPortRead: Port=%RTiop *pu32=%08RX32 cb=%d rc=VINF_SUCCESS\n", Port, *pu32Value, cbValue));
-    IOM_UNLOCK_SHARED(pVM);
     return VINF_SUCCESS;
 }
 
@@ -247,13 +231,6 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortRead(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32
 VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortReadString(PVM pVM, PVMCPU pVCpu, RTIOPORT uPort,
                                                void *pvDst, uint32_t *pcTransfers, unsigned cb)
 {
-    /* Take the IOM lock before performing any device I/O. */
-    int rc2 = IOM_LOCK_SHARED(pVM);
-#ifndef IN_RING3
-    if (rc2 == VERR_SEM_BUSY)
-        return VINF_IOM_R3_IOPORT_READ;
-#endif
-    AssertRC(rc2);
 #if defined(IEM_VERIFICATION_MODE) && defined(IN_RING3)
     IEMNotifyIOPortReadString(pVM, uPort, pvDst, *pcTransfers, cb);
 #endif
@@ -265,26 +242,15 @@ VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortReadString(PVM pVM, PVMCPU pVCpu, RTIOPORT u
     /*
      * Get the statistics record.
      */
-    PIOMIOPORTSTATS pStats = pVCpu->iom.s.CTX_SUFF(pStatsLastRead);
-    if (!pStats || pStats->Core.Key != uPort)
-    {
-        pStats = (PIOMIOPORTSTATS)RTAvloIOPortGet(&pVM->iom.s.CTX_SUFF(pTrees)->IOPortStatTree, uPort);
-        if (pStats)
-            pVCpu->iom.s.CTX_SUFF(pStatsLastRead) = pStats;
-    }
+    PIOMIOPORTSTATS pStats = iomIOPortGetStats(pVM, &pVCpu->iom.s.CTX_SUFF(pStatsLastRead), uPort);
 #endif
 
     /*
-     * Get handler for current context.
+     * Get handler for current context.  The lookup does not take the IOM
+     * lock, see @ref sec_iom_lookup.
      */
-    CTX_SUFF(PIOMIOPORTRANGE) pRange = pVCpu->iom.s.CTX_SUFF(pRangeLastRead);
-    if (    !pRange
-        ||   (unsigned)uPort - (unsigned)pRange->Port >= (unsigned)pRange->cPorts)
-    {
-        pRange = iomIOPortGetRange(pVM, uPort);
-        if (pRange)
-            pVCpu->iom.s.CTX_SUFF(pRangeLastRead) = pRange;
-    }
+    iomLookupEnter(pVM, pVCpu);
+    CTX_SUFF(PIOMIOPORTRANGE) pRange = iomIOPortGetRange(pVM, pVCpu, uPort);
     MMHYPER_RC_ASSERT_RCPTR(pVM, pRange);
     if (pRange)
     {
@@ -299,13 +265,13 @@ VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortReadString(PVM pVM, PVMCPU pVCpu, RTIOPORT u
         else
         {
             STAM_STATS({ if (pStats) STAM_COUNTER_INC(&pStats->InRZToR3); });
-            IOM_UNLOCK_SHARED(pVM);
+            iomLookupLeave(pVCpu);
             return VINF_IOM_R3_IOPORT_READ;
         }
 #endif
         void           *pvUser    = pRange->pvUser;
         PPDMDEVINS      pDevIns   = pRange->pDevIns;
-        IOM_UNLOCK_SHARED(pVM);
+        iomLookupLeave(pVCpu);
 
         /*
          * Call the device.
@@ -394,17 +360,17 @@ VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortReadString(PVM pVM, PVMCPU pVCpu, RTIOPORT u
     /*
      * Handler in ring-3?
      */
-    PIOMIOPORTRANGER3 pRangeR3 = iomIOPortGetRangeR3(pVM, uPort);
-    if (pRangeR3)
+    if (iomIOPortHasRangeR3(pVM, pVCpu, uPort))
     {
 # ifdef VBOX_WITH_STATISTICS
         if (pStats)
             STAM_COUNTER_INC(&pStats->InRZToR3);
 # endif
-        IOM_UNLOCK_SHARED(pVM);
+        iomLookupLeave(pVCpu);
         return VINF_IOM_R3_IOPORT_READ;
     }
 #endif
+    iomLookupLeave(pVCpu);
 
     /*
      * Ok, no handler for this port.
@@ -417,7 +383,6 @@ VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortReadString(PVM pVM, PVMCPU pVCpu, RTIOPORT u
 #endif
     Log3(("IOMIOPortReadStr: uPort=%RTiop (unused) pvDst=%p pcTransfer=%p:{%#x->%#x} cb=%d rc=VINF_SUCCESS\n",
           uPort, pvDst, pcTransfers, cRequestedTransfers, *pcTransfers, cb));
-    IOM_UNLOCK_SHARED(pVM);
     return VINF_SUCCESS;
 }
 
@@ -440,13 +405,6 @@ VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortReadString(PVM pVM, PVMCPU pVCpu, RTIOPORT u
  */
 VMMDECL(VBOXSTRICTRC) IOMIOPortWrite(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint32_t u32Value, size_t cbValue)
 {
-    /* Take the IOM lock before performing any device I/O. */
-    int rc2 = IOM_LOCK_SHARED(pVM);
-#ifndef IN_RING3
-    if (rc2 == VERR_SEM_BUSY)
-        return VINF_IOM_R3_IOPORT_WRITE;
-#endif
-    AssertRC(rc2);
 #if defined(IEM_VERIFICATION_MODE) && defined(IN_RING3)
     IEMNotifyIOPortWrite(pVM, Port, u32Value, cbValue);
 #endif
@@ -455,28 +413,17 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortWrite(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint3
  *        entries to the ring-3 node. */
 #ifdef VBOX_WITH_STATISTICS
     /*
-     * Find the statistics record.
+     * Get the statistics record.
      */
-    PIOMIOPORTSTATS pStats = pVCpu->iom.s.CTX_SUFF(pStatsLastWrite);
-    if (!pStats || pStats->Core.Key != Port)
-    {
-        pStats = (PIOMIOPORTSTATS)RTAvloIOPortGet(&pVM->iom.s.CTX_SUFF(pTrees)->IOPortStatTree, Port);
-        if (pStats)
-            pVCpu->iom.s.CTX_SUFF(pStatsLastWrite) = pStats;
-    }
+    PIOMIOPORTSTATS pStats = iomIOPortGetStats(pVM, &pVCpu->iom.s.CTX_SUFF(pStatsLastWrite), Port);
 #endif
 
     /*
-     * Get handler for current context.
+     * Get handler for current context.  The lookup does not take the IOM
+     * lock, see @ref sec_iom_lookup.
      */
-    CTX_SUFF(PIOMIOPORTRANGE) pRange = pVCpu->iom.s.CTX_SUFF(pRangeLastWrite);
-    if (    !pRange
-        ||   (unsigned)Port - (unsigned)pRange->Port >= (unsigned)pRange->cPorts)
-    {
-        pRange = iomIOPortGetRange(pVM, Port);
-        if (pRange)
-            pVCpu->iom.s.CTX_SUFF(pRangeLastWrite) = pRange;
-    }
+    iomLookupEnter(pVM, pVCpu);
+    CTX_SUFF(PIOMIOPORTRANGE) pRange = iomIOPortGetRange(pVM, pVCpu, Port);
     MMHYPER_RC_ASSERT_RCPTR(pVM, pRange);
     if (pRange)
     {
@@ -490,13 +437,13 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortWrite(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint3
         else
         {
             STAM_STATS({ if (pStats) STAM_COUNTER_INC(&pStats->OutRZToR3); });
-            IOM_UNLOCK_SHARED(pVM);
+            iomLookupLeave(pVCpu);
             return VINF_IOM_R3_IOPORT_WRITE;
         }
 #endif
         void           *pvUser    = pRange->pvUser;
         PPDMDEVINS      pDevIns   = pRange->pDevIns;
-        IOM_UNLOCK_SHARED(pVM);
+        iomLookupLeave(pVCpu);
 
         /*
          * Call the device.
@@ -509,6 +456,7 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortWrite(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint3
             STAM_STATS({ if (pStats) STAM_COUNTER_INC(&pStats->OutRZToR3); });
             return rcStrict;
         }
+        DBGFTRACE_BIN(pVCpu, DBGFTRACEGRP_IOPORT, DBGFTRACEEVT_IOPORT_WRITE, DBGFTRACEPHASE_BEGIN, Port, cbValue);
 #ifdef VBOX_WITH_STATISTICS
         if (pStats)
         {
@@ -520,6 +468,8 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortWrite(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint3
 #endif
             rcStrict = pfnOutCallback(pDevIns, pvUser, Port, u32Value, (unsigned)cbValue);
         PDMCritSectLeave(pDevIns->CTX_SUFF(pCritSectRo));
+        DBGFTRACE_BIN(pVCpu, DBGFTRACEGRP_IOPORT, DBGFTRACEEVT_IOPORT_WRITE, DBGFTRACEPHASE_END, u32Value,
+                      VBOXSTRICTRC_VAL(rcStrict));
 
 #ifdef VBOX_WITH_STATISTICS
         if (rcStrict == VINF_SUCCESS && pStats)
@@ -537,17 +487,17 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortWrite(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint3
     /*
      * Handler in ring-3?
      */
-    PIOMIOPORTRANGER3 pRangeR3 = iomIOPortGetRangeR3(pVM, Port);
-    if (pRangeR3)
+    if (iomIOPortHasRangeR3(pVM, pVCpu, Port))
     {
 # ifdef VBOX_WITH_STATISTICS
         if (pStats)
             STAM_COUNTER_INC(&pStats->OutRZToR3);
 # endif
-        IOM_UNLOCK_SHARED(pVM);
+        iomLookupLeave(pVCpu);
         return VINF_IOM_R3_IOPORT_WRITE;
     }
 #endif
+    iomLookupLeave(pVCpu);
 
     /*
      * Ok, no handler for that port.
@@ -558,7 +508,6 @@ VMMDECL(VBOXSTRICTRC) IOMIOPortWrite(PVM pVM, PVMCPU pVCpu, RTIOPORT Port, uint3
         STAM_COUNTER_INC(&pStats->CTX_SUFF_Z(Out));
 #endif
     Log3(("IOMIOPortWrite: Port=%RTiop u32=%08RX32 cb=%d nop\n", Port, u32Value, cbValue));
-    IOM_UNLOCK_SHARED(pVM);
     return VINF_SUCCESS;
 }
 
@@ -587,13 +536,6 @@ VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortWriteString(PVM pVM, PVMCPU pVCpu, RTIOPORT
 {
     Assert(cb == 1 || cb == 2 || cb == 4);
 
-    /* Take the IOM lock before performing any device I/O. */
-    int rc2 = IOM_LOCK_SHARED(pVM);
-#ifndef IN_RING3
-    if (rc2 == VERR_SEM_BUSY)
-        return VINF_IOM_R3_IOPORT_WRITE;
-#endif
-    AssertRC(rc2);
 #if defined(IEM_VERIFICATION_MODE) && defined(IN_RING3)
     IEMNotifyIOPortWriteString(pVM, uPort, pvSrc, *pcTransfers, cb);
 #endif
@@ -605,26 +547,15 @@ VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortWriteString(PVM pVM, PVMCPU pVCpu, RTIOPORT
     /*
      * Get the statistics record.
      */
-    PIOMIOPORTSTATS     pStats = pVCpu->iom.s.CTX_SUFF(pStatsLastWrite);
-    if (!pStats || pStats->Core.Key != uPort)
-    {
-        pStats = (PIOMIOPORTSTATS)RTAvloIOPortGet(&pVM->iom.s.CTX_SUFF(pTrees)->IOPortStatTree, uPort);
-        if (pStats)
-            pVCpu->iom.s.CTX_SUFF(pStatsLastWrite) = pStats;
-    }
+    PIOMIOPORTSTATS     pStats = iomIOPortGetStats(pVM, &pVCpu->iom.s.CTX_SUFF(pStatsLastWrite), uPort);
 #endif
 
     /*
-     * Get handler for current context.
+     * Get handler for current context.  The lookup does not take the IOM
+     * lock, see @ref sec_iom_lookup.
      */
-    CTX_SUFF(PIOMIOPORTRANGE) pRange = pVCpu->iom.s.CTX_SUFF(pRangeLastWrite);
-    if (    !pRange
-        ||   (unsigned)uPort - (unsigned)pRange->Port >= (unsigned)pRange->cPorts)
-    {
-        pRange = iomIOPortGetRange(pVM, uPort);
-        if (pRange)
-            pVCpu->iom.s.CTX_SUFF(pRangeLastWrite) = pRange;
-    }
+    iomLookupEnter(pVM, pVCpu);
+    CTX_SUFF(PIOMIOPORTRANGE) pRange = iomIOPortGetRange(pVM, pVCpu, uPort);
     MMHYPER_RC_ASSERT_RCPTR(pVM, pRange);
     if (pRange)
     {
@@ -639,13 +570,13 @@ VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortWriteString(PVM pVM, PVMCPU pVCpu, RTIOPORT
         else
         {
             STAM_STATS({ if (pStats) STAM_COUNTER_INC(&pStats->OutRZToR3); });
-            IOM_UNLOCK_SHARED(pVM);
+            iomLookupLeave(pVCpu);
             return VINF_IOM_R3_IOPORT_WRITE;
         }
 #endif
         void           *pvUser    = pRange->pvUser;
         PPDMDEVINS      pDevIns   = pRange->pDevIns;
-        IOM_UNLOCK_SHARED(pVM);
+        iomLookupLeave(pVCpu);
 
         /*
          * Call the device.
@@ -728,17 +659,17 @@ VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortWriteString(PVM pVM, PVMCPU pVCpu, RTIOPORT
     /*
      * Handler in ring-3?
      */
-    PIOMIOPORTRANGER3 pRangeR3 = iomIOPortGetRangeR3(pVM, uPort);
-    if (pRangeR3)
+    if (iomIOPortHasRangeR3(pVM, pVCpu, uPort))
     {
 # ifdef VBOX_WITH_STATISTICS
         if (pStats)
             STAM_COUNTER_INC(&pStats->OutRZToR3);
 # endif
-        IOM_UNLOCK_SHARED(pVM);
+        iomLookupLeave(pVCpu);
         return VINF_IOM_R3_IOPORT_WRITE;
     }
 #endif
+    iomLookupLeave(pVCpu);
 
     /*
      * Ok, no handler for this port.
@@ -750,7 +681,6 @@ VMM_INT_DECL(VBOXSTRICTRC) IOMIOPortWriteString(PVM pVM, PVMCPU pVCpu, RTIOPORT
 #endif
     Log3(("IOMIOPortWriteStr: uPort=%RTiop (unused) pvSrc=%p pcTransfer=%p:{%#x->%#x} cb=%d rc=VINF_SUCCESS\n",
           uPort, pvSrc, pcTransfers, cRequestedTransfers, *pcTransfers, cb));
-    IOM_UNLOCK_SHARED(pVM);
     return VINF_SUCCESS;
 }
 
@@ -33,6 +33,7 @@
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/vmm.h>
 #include <VBox/vmm/hm.h>
+#include <VBox/vmm/dbgftrace.h>
 #include "IOMInline.h"
 
 #include <VBox/dis.h>
@@ -430,6 +431,29 @@ static VBOXSTRICTRC iomMMIODoComplicatedWrite(PVM pVM, PIOMMMIORANGE pRange, RTG
 }
 
 
+/**
+ * Gets the value of an MMIO access for the binary trace, the first 8 bytes
+ * of it for larger accesses.
+ *
+ * @returns The value.
+ * @param   pvValue     The value buffer.
+ * @param   cbValue     The access size.
+ */
+DECLINLINE(uint64_t) iomMmioTraceValue(void const *pvValue, unsigned cbValue)
+{
+    switch (cbValue)
+    {
+        case 1:  return *(uint8_t const *)pvValue;
+        case 2:  return *(uint16_t const *)pvValue;
+        case 4:  return *(uint32_t const *)pvValue;
+        default:
+        {
+            uint64_t u64Value = 0;
+            memcpy(&u64Value, pvValue, RT_MIN(cbValue, sizeof(u64Value)));
+            return u64Value;
+        }
+    }
+}
 
 
 /**
@@ -455,6 +479,7 @@ static VBOXSTRICTRC iomMMIODoWrite(PVM pVM, PVMCPU pVCpu, PIOMMMIORANGE pRange,
     NOREF(pVCpu);
 #endif
 
+    DBGFTRACE_BIN(pVCpu, DBGFTRACEGRP_MMIO, DBGFTRACEEVT_MMIO_WRITE, DBGFTRACEPHASE_BEGIN, GCPhysFault, cb);
     VBOXSTRICTRC rcStrict;
     if (RT_LIKELY(pRange->CTX_SUFF(pfnWriteCallback)))
     {
@@ -468,6 +493,8 @@ static VBOXSTRICTRC iomMMIODoWrite(PVM pVM, PVMCPU pVCpu, PIOMMMIORANGE pRange,
     }
     else
         rcStrict = VINF_SUCCESS;
+    DBGFTRACE_BIN(pVCpu, DBGFTRACEGRP_MMIO, DBGFTRACEEVT_MMIO_WRITE, DBGFTRACEPHASE_END, iomMmioTraceValue(pvData, cb),
+                  VBOXSTRICTRC_VAL(rcStrict));
 
     STAM_PROFILE_STOP(&pStats->CTX_SUFF_Z(ProfWrite), a);
     STAM_COUNTER_INC(&pStats->Accesses);
@@ -674,6 +701,7 @@ DECLINLINE(VBOXSTRICTRC) iomMMIODoRead(PVM pVM, PVMCPU pVCpu, PIOMMMIORANGE pRan
     NOREF(pVCpu);
 #endif
 
+    DBGFTRACE_BIN(pVCpu, DBGFTRACEGRP_MMIO, DBGFTRACEEVT_MMIO_READ, DBGFTRACEPHASE_BEGIN, GCPhys, cbValue);
     VBOXSTRICTRC rcStrict;
     if (RT_LIKELY(pRange->CTX_SUFF(pfnReadCallback)))
     {
@@ -698,6 +726,8 @@ DECLINLINE(VBOXSTRICTRC) iomMMIODoRead(PVM pVM, PVMCPU pVCpu, PIOMMMIORANGE pRan
             case VINF_IOM_MMIO_UNUSED_00: rcStrict = iomMMIODoRead00s(pvValue, cbValue); break;
         }
     }
+    DBGFTRACE_BIN(pVCpu, DBGFTRACEGRP_MMIO, DBGFTRACEEVT_MMIO_READ, DBGFTRACEPHASE_END, iomMmioTraceValue(pvValue, cbValue),
+                  VBOXSTRICTRC_VAL(rcStrict));
 
     STAM_PROFILE_STOP(&pStats->CTX_SUFF_Z(ProfRead), a);
     STAM_COUNTER_INC(&pStats->Accesses);
@@ -79,6 +79,129 @@ DECL_FORCE_INLINE(RTNATIVETHREAD) pdmCritSectGetNativeSelf(PCPDMCRITSECT pCritSe
 }
 
 
+/**
+ * Gets a critical section contention profile.
+ *
+ * @returns Pointer to the profile.
+ * @param   pVM             The cross context VM structure.
+ * @param   idxProfile      The profile index (1-based).
+ */
+PPDMCRITSECTPROFILE pdmCritSectProfileGet(PVM pVM, uint16_t idxProfile)
+{
+    Assert(idxProfile > 0 && idxProfile <= pVM->pdm.s.cCritSectProfiles);
+    return (PPDMCRITSECTPROFILE)(  (uint8_t *)MMHyperHeapOffsetToPtr(pVM, pVM->pdm.s.offCritSectProfiles)
+                                 + (uint32_t)(idxProfile - 1) * pVM->pdm.s.cbCritSectProfile);
+}
+
+
+/**
+ * Calculates the histogram bucket for a wait or hold time.
+ *
+ * @returns Bucket index.
+ * @param   cTicks          The time in ticks.
+ */
+DECLINLINE(uint32_t) pdmCritSectProfileBucket(uint64_t cTicks)
+{
+    unsigned const iBit = ASMBitLastSetU64(cTicks);
+    if (iBit <= 10)
+        return 0;
+    return RT_MIN((iBit - 9) / 2, PDMCRITSECTPROF_HIST_BUCKETS - 1);
+}
+
+
+/**
+ * Records a contended enter in the profile.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   idxProfile      The profile index (1-based).
+ * @param   uWaitStartTsc   The TSC when the wait started.
+ * @param   uCaller         The return address of the caller, 0 if not known.
+ * @param   fOwner          Set if the caller now owns the critical section
+ *                          exclusively, clear if it's a shared owner.  Only
+ *                          the histogram and per-VCPU counts are updated for
+ *                          shared owners.
+ */
+void pdmCritSectProfileWaitDone(PVM pVM, uint16_t idxProfile, uint64_t uWaitStartTsc, RTHCUINTPTR uCaller, bool fOwner)
+{
+    PPDMCRITSECTPROFILE pProf  = pdmCritSectProfileGet(pVM, idxProfile);
+    uint64_t const      cTicks = ASMReadTSC() - uWaitStartTsc;
+
+    ASMAtomicIncU32(&pProf->acWaitHist[pdmCritSectProfileBucket(cTicks)]);
+    VMCPUID idCpu = VMMGetCpuId(pVM);
+    if (idCpu >= pVM->pdm.s.cCritSectProfileCpus)
+        idCpu = pVM->pdm.s.cCritSectProfileCpus;
+    ASMAtomicIncU32(&pProf->acWaitsByCpu[idCpu]);
+    if (!fOwner)
+        return;
+
+    STAM_REL_PROFILE_ADD_PERIOD(&pProf->StatWait, cTicks);
+
+    /*
+     * Attribute the wait to the call site.  When the table is full, the entry
+     * with the least wait time is taken over and the new caller inherits its
+     * numbers, so the figures for the top entries are upper bounds.
+     */
+    if (uCaller)
+    {
+#ifdef IN_RING3
+        uint32_t const          iCtx = PDMCRITSECTPROF_CTX_R3;
+#elif defined(IN_RING0)
+        uint32_t const          iCtx = PDMCRITSECTPROF_CTX_R0;
+#else
+        uint32_t const          iCtx = PDMCRITSECTPROF_CTX_RC;
+#endif
+        PPDMCRITSECTPROFCALLER  pMin = &pProf->aCallers[0];
+        for (unsigned i = 0; i < RT_ELEMENTS(pProf->aCallers); i++)
+        {
+            PPDMCRITSECTPROFCALLER pCur = &pProf->aCallers[i];
+            if (pCur->uCaller == uCaller && pCur->iCtx == iCtx)
+            {
+                pCur->cWaits++;
+                pCur->cTicksWaited += cTicks;
+                return;
+            }
+            if (pCur->cTicksWaited < pMin->cTicksWaited)
+                pMin = pCur;
+        }
+        pMin->uCaller       = uCaller;
+        pMin->iCtx          = iCtx;
+        pMin->cWaits++;
+        pMin->cTicksWaited += cTicks;
+    }
+}
+
+
+/**
+ * Starts timing the hold of a profiled critical section.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   idxProfile      The profile index (1-based).
+ */
+void pdmCritSectProfileHoldStart(PVM pVM, uint16_t idxProfile)
+{
+    pdmCritSectProfileGet(pVM, idxProfile)->uHoldStartTsc = ASMReadTSC();
+}
+
+
+/**
+ * Stops timing the hold of a profiled critical section.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   idxProfile      The profile index (1-based).
+ */
+void pdmCritSectProfileHoldDone(PVM pVM, uint16_t idxProfile)
+{
+    PPDMCRITSECTPROFILE pProf = pdmCritSectProfileGet(pVM, idxProfile);
+    if (pProf->uHoldStartTsc)
+    {
+        uint64_t const cTicks = ASMReadTSC() - pProf->uHoldStartTsc;
+        pProf->uHoldStartTsc = 0;
+        pProf->acHoldHist[pdmCritSectProfileBucket(cTicks)]++;
+        STAM_REL_PROFILE_ADD_PERIOD(&pProf->StatHold, cTicks);
+    }
+}
+
+
 /**
  * Tail code called when we've won the battle for the lock.
  *
@@ -104,10 +227,32 @@ DECL_FORCE_INLINE(int) pdmCritSectEnterFirst(PPDMCRITSECT pCritSect, RTNATIVETHR
 # endif
 
     STAM_PROFILE_ADV_START(&pCritSect->s.StatLocked, l);
+    if (RT_UNLIKELY(pCritSect->s.idxProfile))
+        pdmCritSectProfileHoldStart(pCritSect->s.CTX_SUFF(pVM), pCritSect->s.idxProfile);
     return VINF_SUCCESS;
 }
 
 
+/**
+ * Tail code called when we've won the battle for the lock after contention.
+ *
+ * @returns VINF_SUCCESS.
+ *
+ * @param   pCritSect       The critical section.
+ * @param   hNativeSelf     The native handle of this thread.
+ * @param   pSrcPos         The source position of the lock operation.
+ * @param   uWaitStartTsc   The TSC when the wait started, 0 if not profiling.
+ * @param   uCaller         The return address of the caller.
+ */
+DECL_FORCE_INLINE(int) pdmCritSectEnterFirstContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD hNativeSelf, PCRTLOCKVALSRCPOS pSrcPos,
+                                                      uint64_t uWaitStartTsc, RTHCUINTPTR uCaller)
+{
+    if (RT_UNLIKELY(uWaitStartTsc))
+        pdmCritSectProfileWaitDone(pCritSect->s.CTX_SUFF(pVM), pCritSect->s.idxProfile, uWaitStartTsc, uCaller, true /*fOwner*/);
+    return pdmCritSectEnterFirst(pCritSect, hNativeSelf, pSrcPos);
+}
+
+
 #if defined(IN_RING3) || defined(IN_RING0)
 /**
  * Deals with the contended case in ring-3 and ring-0.
@@ -118,14 +263,17 @@ DECL_FORCE_INLINE(int) pdmCritSectEnterFirst(PPDMCRITSECT pCritSect, RTNATIVETHR
  * @param   pCritSect           The critsect.
  * @param   hNativeSelf         The native thread handle.
  * @param   pSrcPos             The source position of the lock operation.
+ * @param   uWaitStartTsc       The TSC when the wait started, 0 if not profiling.
+ * @param   uCaller             The return address of the caller.
  */
-static int pdmR3R0CritSectEnterContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD hNativeSelf, PCRTLOCKVALSRCPOS pSrcPos)
+static int pdmR3R0CritSectEnterContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD hNativeSelf, PCRTLOCKVALSRCPOS pSrcPos,
+                                         uint64_t uWaitStartTsc, RTHCUINTPTR uCaller)
 {
     /*
      * Start waiting.
      */
     if (ASMAtomicIncS32(&pCritSect->s.Core.cLockers) == 0)
-        return pdmCritSectEnterFirst(pCritSect, hNativeSelf, pSrcPos);
+        return pdmCritSectEnterFirstContended(pCritSect, hNativeSelf, pSrcPos, uWaitStartTsc, uCaller);
 # ifdef IN_RING3
     STAM_COUNTER_INC(&pCritSect->s.StatContentionR3);
 # else
@@ -181,7 +329,7 @@ static int pdmR3R0CritSectEnterContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD
         if (RT_UNLIKELY(pCritSect->s.Core.u32Magic != RTCRITSECT_MAGIC))
             return VERR_SEM_DESTROYED;
         if (rc == VINF_SUCCESS)
-            return pdmCritSectEnterFirst(pCritSect, hNativeSelf, pSrcPos);
+            return pdmCritSectEnterFirstContended(pCritSect, hNativeSelf, pSrcPos, uWaitStartTsc, uCaller);
         AssertMsg(rc == VERR_INTERRUPTED, ("rc=%Rrc\n", rc));
 
 # ifdef IN_RING0
@@ -213,8 +361,10 @@ static int pdmR3R0CritSectEnterContended(PPDMCRITSECT pCritSect, RTNATIVETHREAD
  * @param   pCritSect           The PDM critical section to enter.
  * @param   rcBusy              The status code to return when we're in GC or R0
  * @param   pSrcPos             The source position of the lock operation.
+ * @param   uCaller             The return address of the caller, for contention
+ *                              profiling.
  */
-DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRTLOCKVALSRCPOS pSrcPos)
+DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRTLOCKVALSRCPOS pSrcPos, RTHCUINTPTR uCaller)
 {
     Assert(pCritSect->s.Core.cNestings < 8);  /* useful to catch incorrect locking */
     Assert(pCritSect->s.Core.cNestings >= 0);
@@ -247,6 +397,11 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
         return VINF_SUCCESS;
     }
 
+    /*
+     * Note down when we started waiting if the section is being profiled.
+     */
+    uint64_t const uWaitStartTsc = RT_LIKELY(!pCritSect->s.idxProfile) ? 0 : ASMReadTSC();
+
     /*
      * Spin for a bit without incrementing the counter.
      */
@@ -256,7 +411,7 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
     while (cSpinsLeft-- > 0)
     {
         if (ASMAtomicCmpXchgS32(&pCritSect->s.Core.cLockers, 0, -1))
-            return pdmCritSectEnterFirst(pCritSect, hNativeSelf, pSrcPos);
+            return pdmCritSectEnterFirstContended(pCritSect, hNativeSelf, pSrcPos, uWaitStartTsc, uCaller);
         ASMNopPause();
         /** @todo Should use monitor/mwait on e.g. &cLockers here, possibly with a
            cli'ed pendingpreemption check up front using sti w/ instruction fusing
@@ -270,7 +425,7 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
      * Take the slow path.
      */
     NOREF(rcBusy);
-    return pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos);
+    return pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos, uWaitStartTsc, uCaller);
 
 #else
 # ifdef IN_RING0
@@ -292,7 +447,7 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
         if (RTThreadPreemptIsEnabled(NIL_RTTHREAD))
         {
             STAM_REL_COUNTER_ADD(&pCritSect->s.StatContentionRZLock,    1000000);
-            rc = pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos);
+            rc = pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos, uWaitStartTsc, uCaller);
         }
         else
         {
@@ -302,7 +457,7 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
             HMR0Leave(pVM, pVCpu);
             RTThreadPreemptRestore(NIL_RTTHREAD, XXX);
 
-            rc = pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos);
+            rc = pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos, uWaitStartTsc, uCaller);
 
             RTThreadPreemptDisable(NIL_RTTHREAD, XXX);
             HMR0Enter(pVM, pVCpu);
@@ -315,7 +470,7 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
      */
     if (   RTThreadPreemptIsEnabled(NIL_RTTHREAD)
         && ASMIntAreEnabled())
-        return pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos);
+        return pdmR3R0CritSectEnterContended(pCritSect, hNativeSelf, pSrcPos, uWaitStartTsc, uCaller);
 #  endif
 #endif /* IN_RING0 */
 
@@ -357,10 +512,10 @@ DECL_FORCE_INLINE(int) pdmCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy, PCRT
 VMMDECL(int) PDMCritSectEnter(PPDMCRITSECT pCritSect, int rcBusy)
 {
 #ifndef PDMCRITSECT_STRICT
-    return pdmCritSectEnter(pCritSect, rcBusy, NULL);
+    return pdmCritSectEnter(pCritSect, rcBusy, NULL, (RTHCUINTPTR)ASMReturnAddress());
 #else
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_NORMAL_API();
-    return pdmCritSectEnter(pCritSect, rcBusy, &SrcPos);
+    return pdmCritSectEnter(pCritSect, rcBusy, &SrcPos, (RTHCUINTPTR)ASMReturnAddress());
 #endif
 }
 
@@ -387,10 +542,10 @@ VMMDECL(int) PDMCritSectEnterDebug(PPDMCRITSECT pCritSect, int rcBusy, RTHCUINTP
 {
 #ifdef PDMCRITSECT_STRICT
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_DEBUG_API();
-    return pdmCritSectEnter(pCritSect, rcBusy, &SrcPos);
+    return pdmCritSectEnter(pCritSect, rcBusy, &SrcPos, uId ? uId : (RTHCUINTPTR)ASMReturnAddress());
 #else
-    NOREF(uId); RT_SRC_POS_NOREF();
-    return pdmCritSectEnter(pCritSect, rcBusy, NULL);
+    RT_SRC_POS_NOREF();
+    return pdmCritSectEnter(pCritSect, rcBusy, NULL, uId ? uId : (RTHCUINTPTR)ASMReturnAddress());
 #endif
 }
 
@@ -597,6 +752,8 @@ VMMDECL(int) PDMCritSectLeave(PPDMCRITSECT pCritSect)
 
         /* stop and decrement lockers. */
         STAM_PROFILE_ADV_STOP(&pCritSect->s.StatLocked, l);
+        if (RT_UNLIKELY(pCritSect->s.idxProfile))
+            pdmCritSectProfileHoldDone(pCritSect->s.CTX_SUFF(pVM), pCritSect->s.idxProfile);
         ASMCompilerBarrier();
         if (ASMAtomicDecS32(&pCritSect->s.Core.cLockers) >= 0)
         {
@@ -634,6 +791,8 @@ VMMDECL(int) PDMCritSectLeave(PPDMCRITSECT pCritSect)
             RTNATIVETHREAD hNativeThread = pCritSect->s.Core.NativeThreadOwner;
             ASMAtomicAndU32(&pCritSect->s.Core.fFlags, ~PDMCRITSECT_FLAGS_PENDING_UNLOCK);
             STAM_PROFILE_ADV_STOP(&pCritSect->s.StatLocked, l);
+            if (RT_UNLIKELY(pCritSect->s.idxProfile))
+                pdmCritSectProfileHoldDone(pCritSect->s.CTX_SUFF(pVM), pCritSect->s.idxProfile);
 
             ASMAtomicWriteHandle(&pCritSect->s.Core.NativeThreadOwner, NIL_RTNATIVETHREAD);
             if (ASMAtomicCmpXchgS32(&pCritSect->s.Core.cLockers, -1, 0))
@@ -642,6 +801,8 @@ VMMDECL(int) PDMCritSectLeave(PPDMCRITSECT pCritSect)
             /* darn, someone raced in on us. */
             ASMAtomicWriteHandle(&pCritSect->s.Core.NativeThreadOwner, hNativeThread);
             STAM_PROFILE_ADV_START(&pCritSect->s.StatLocked, l);
+            if (RT_UNLIKELY(pCritSect->s.idxProfile))
+                pdmCritSectProfileHoldStart(pCritSect->s.CTX_SUFF(pVM), pCritSect->s.idxProfile);
             Assert(pCritSect->s.Core.cNestings == 0);
             ASMAtomicWriteS32(&pCritSect->s.Core.cNestings, 1);
         }
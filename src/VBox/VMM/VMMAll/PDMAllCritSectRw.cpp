@@ -180,8 +180,9 @@ static int pdmCritSectRwEnterShared(PPDMCRITSECTRW pThis, int rcBusy, bool fTryO
     /*
      * Get cracking...
      */
-    uint64_t u64State    = ASMAtomicReadU64(&pThis->s.Core.u64State);
-    uint64_t u64OldState = u64State;
+    uint64_t u64State      = ASMAtomicReadU64(&pThis->s.Core.u64State);
+    uint64_t u64OldState   = u64State;
+    uint64_t uWaitStartTsc = 0;
 
     for (;;)
     {
@@ -257,6 +258,8 @@ static int pdmCritSectRwEnterShared(PPDMCRITSECTRW pThis, int rcBusy, bool fTryO
                 /*
                  * Add ourselves to the queue and wait for the direction to change.
                  */
+                if (RT_UNLIKELY(PDMCRITSECTRWINT_PROFILE_IDX(&pThis->s)) && !uWaitStartTsc)
+                    uWaitStartTsc = ASMReadTSC();
                 uint64_t c = (u64State & RTCSRW_CNT_RD_MASK) >> RTCSRW_CNT_RD_SHIFT;
                 c++;
                 Assert(c < RTCSRW_CNT_MASK / 2);
@@ -397,6 +400,8 @@ static int pdmCritSectRwEnterShared(PPDMCRITSECTRW pThis, int rcBusy, bool fTryO
     /* got it! */
     STAM_REL_COUNTER_INC(&pThis->s.CTX_MID_Z(Stat,EnterShared));
     Assert((ASMAtomicReadU64(&pThis->s.Core.u64State) & RTCSRW_DIR_MASK) == (RTCSRW_DIR_READ << RTCSRW_DIR_SHIFT));
+    if (RT_UNLIKELY(uWaitStartTsc))
+        pdmCritSectProfileWaitDone(pThis->s.CTX_SUFF(pVM), PDMCRITSECTRWINT_PROFILE_IDX(&pThis->s), uWaitStartTsc, 0 /*uCaller*/, false /*fOwner*/);
     return VINF_SUCCESS;
 
 }
@@ -697,8 +702,11 @@ void pdmCritSectRwLeaveSharedQueued(PPDMCRITSECTRW pThis)
  * @param   fTryOnly    Only try enter it, don't wait.
  * @param   pSrcPos     The source position. (Can be NULL.)
  * @param   fNoVal      No validation records.
+ * @param   uCaller     The return address of the caller, for contention
+ *                      profiling.  0 if not known.
  */
-static int pdmCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy, bool fTryOnly, PCRTLOCKVALSRCPOS pSrcPos, bool fNoVal)
+static int pdmCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy, bool fTryOnly, PCRTLOCKVALSRCPOS pSrcPos, bool fNoVal,
+                                  RTHCUINTPTR uCaller)
 {
     /*
      * Validate input.
@@ -811,6 +819,7 @@ static int pdmCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy, bool fTryOnl
                ;
     if (fDone)
         ASMAtomicCmpXchgHandle(&pThis->s.Core.hNativeWriter, hNativeSelf, NIL_RTNATIVETHREAD, fDone);
+    uint64_t uWaitStartTsc = 0;
     if (!fDone)
     {
         STAM_REL_COUNTER_INC(&pThis->s.CTX_MID_Z(StatContention,EnterExcl));
@@ -827,6 +836,8 @@ static int pdmCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy, bool fTryOnl
             /*
              * Wait for our turn.
              */
+            if (RT_UNLIKELY(PDMCRITSECTRWINT_PROFILE_IDX(&pThis->s)))
+                uWaitStartTsc = ASMReadTSC();
             for (uint32_t iLoop = 0; ; iLoop++)
             {
                 int rc;
@@ -938,6 +949,12 @@ static int pdmCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy, bool fTryOnl
 #endif
     STAM_REL_COUNTER_INC(&pThis->s.CTX_MID_Z(Stat,EnterExcl));
     STAM_PROFILE_ADV_START(&pThis->s.StatWriteLocked, swl);
+    if (RT_UNLIKELY(PDMCRITSECTRWINT_PROFILE_IDX(&pThis->s)))
+    {
+        if (uWaitStartTsc)
+            pdmCritSectProfileWaitDone(pThis->s.CTX_SUFF(pVM), PDMCRITSECTRWINT_PROFILE_IDX(&pThis->s), uWaitStartTsc, uCaller, true /*fOwner*/);
+        pdmCritSectProfileHoldStart(pThis->s.CTX_SUFF(pVM), PDMCRITSECTRWINT_PROFILE_IDX(&pThis->s));
+    }
 
     return VINF_SUCCESS;
 }
@@ -965,10 +982,10 @@ static int pdmCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy, bool fTryOnl
 VMMDECL(int) PDMCritSectRwEnterExcl(PPDMCRITSECTRW pThis, int rcBusy)
 {
 #if !defined(PDMCRITSECTRW_STRICT) || !defined(IN_RING3)
-    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, NULL,    false /*fNoVal*/);
+    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, NULL,    false /*fNoVal*/, (RTHCUINTPTR)ASMReturnAddress());
 #else
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_NORMAL_API();
-    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, &SrcPos, false /*fNoVal*/);
+    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, &SrcPos, false /*fNoVal*/, (RTHCUINTPTR)ASMReturnAddress());
 #endif
 }
 
@@ -998,10 +1015,10 @@ VMMDECL(int) PDMCritSectRwEnterExclDebug(PPDMCRITSECTRW pThis, int rcBusy, RTHCU
 {
     NOREF(uId); NOREF(pszFile); NOREF(iLine); NOREF(pszFunction);
 #if !defined(PDMCRITSECTRW_STRICT) || !defined(IN_RING3)
-    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, NULL,    false /*fNoVal*/);
+    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, NULL,    false /*fNoVal*/, uId ? uId : (RTHCUINTPTR)ASMReturnAddress());
 #else
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_DEBUG_API();
-    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, &SrcPos, false /*fNoVal*/);
+    return pdmCritSectRwEnterExcl(pThis, rcBusy, false /*fTryAgain*/, &SrcPos, false /*fNoVal*/, uId ? uId : (RTHCUINTPTR)ASMReturnAddress());
 #endif
 }
 
@@ -1024,10 +1041,10 @@ VMMDECL(int) PDMCritSectRwEnterExclDebug(PPDMCRITSECTRW pThis, int rcBusy, RTHCU
 VMMDECL(int) PDMCritSectRwTryEnterExcl(PPDMCRITSECTRW pThis)
 {
 #if !defined(PDMCRITSECTRW_STRICT) || !defined(IN_RING3)
-    return pdmCritSectRwEnterExcl(pThis, VERR_SEM_BUSY, true /*fTryAgain*/, NULL,    false /*fNoVal*/);
+    return pdmCritSectRwEnterExcl(pThis, VERR_SEM_BUSY, true /*fTryAgain*/, NULL,    false /*fNoVal*/, 0 /*uCaller*/);
 #else
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_NORMAL_API();
-    return pdmCritSectRwEnterExcl(pThis, VERR_SEM_BUSY, true /*fTryAgain*/, &SrcPos, false /*fNoVal*/);
+    return pdmCritSectRwEnterExcl(pThis, VERR_SEM_BUSY, true /*fTryAgain*/, &SrcPos, false /*fNoVal*/, 0 /*uCaller*/);
 #endif
 }
 
@@ -1053,10 +1070,10 @@ VMMDECL(int) PDMCritSectRwTryEnterExclDebug(PPDMCRITSECTRW pThis, RTHCUINTPTR uI
 {
     NOREF(uId); NOREF(pszFile); NOREF(iLine); NOREF(pszFunction);
 #if !defined(PDMCRITSECTRW_STRICT) || !defined(IN_RING3)
-    return pdmCritSectRwEnterExcl(pThis, VERR_SEM_BUSY, true /*fTryAgain*/, NULL,    false /*fNoVal*/);
+    return pdmCritSectRwEnterExcl(pThis, VERR_SEM_BUSY, true /*fTryAgain*/, NULL,    false /*fNoVal*/, 0 /*uCaller*/);
 #else
     RTLOCKVALSRCPOS SrcPos = RTLOCKVALSRCPOS_INIT_DEBUG_API();
-    return pdmCritSectRwEnterExcl(pThis, VERR_SEM_BUSY, true /*fTryAgain*/, &SrcPos, false /*fNoVal*/);
+    return pdmCritSectRwEnterExcl(pThis, VERR_SEM_BUSY, true /*fTryAgain*/, &SrcPos, false /*fNoVal*/, 0 /*uCaller*/);
 #endif
 }
 
@@ -1074,7 +1091,7 @@ VMMDECL(int) PDMCritSectRwTryEnterExclDebug(PPDMCRITSECTRW pThis, RTHCUINTPTR uI
  */
 VMMR3DECL(int) PDMR3CritSectRwEnterExclEx(PPDMCRITSECTRW pThis, bool fCallRing3)
 {
-    return pdmCritSectRwEnterExcl(pThis, VERR_SEM_BUSY, false /*fTryAgain*/, NULL, fCallRing3 /*fNoVal*/);
+    return pdmCritSectRwEnterExcl(pThis, VERR_SEM_BUSY, false /*fTryAgain*/, NULL, fCallRing3 /*fNoVal*/, 0 /*uCaller*/);
 }
 #endif /* IN_RING3 */
 
@@ -1133,6 +1150,8 @@ static int pdmCritSectRwLeaveExclWorker(PPDMCRITSECTRW pThis, bool fNoVal)
         {
             ASMAtomicWriteU32(&pThis->s.Core.cWriteRecursions, 0);
             STAM_PROFILE_ADV_STOP(&pThis->s.StatWriteLocked, swl);
+            if (RT_UNLIKELY(PDMCRITSECTRWINT_PROFILE_IDX(&pThis->s)))
+                pdmCritSectProfileHoldDone(pThis->s.CTX_SUFF(pVM), PDMCRITSECTRWINT_PROFILE_IDX(&pThis->s));
             ASMAtomicWriteHandle(&pThis->s.Core.hNativeWriter, NIL_RTNATIVETHREAD);
 
             for (;;)
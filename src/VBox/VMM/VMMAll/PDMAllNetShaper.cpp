@@ -22,15 +22,88 @@
 #define LOG_GROUP LOG_GROUP_NET_SHAPER
 #include <VBox/vmm/pdm.h>
 #include <VBox/log.h>
+#include <iprt/asm.h>
 #include <iprt/time.h>
 
 #include <VBox/vmm/pdmnetshaper.h>
 #include "PDMNetShaperInternal.h"
 
 
+/**
+ * Takes bandwidth from the group's token bucket without taking any locks.
+ *
+ * @returns true if the bandwidth was taken, false if the bucket does not hold
+ *          enough tokens.
+ * @param   pBwGroup        The bandwidth group.
+ * @param   cbTake          Number of bytes to take.
+ * @param   cbPerSecMax     The rate limit of the group (non-zero).
+ * @param   tsNow           The current RTTimeSystemNanoTS.
+ * @param   ptsDeadline     Where to return the time at which the request can be
+ *                          satisfied when returning false.
+ */
+DECLINLINE(bool) pdmNsBwGroupTakeTokens(PPDMNSBWGROUP pBwGroup, uint64_t cbTake, uint64_t cbPerSecMax,
+                                        uint64_t tsNow, uint64_t *ptsDeadline)
+{
+    uint64_t const cNsCost   = cbTake * RT_NS_1SEC / cbPerSecMax;
+    uint64_t const cNsBucket = ASMAtomicUoReadU64(&pBwGroup->cNsBucket);
+    for (;;)
+    {
+        uint64_t const tsTatOld = ASMAtomicReadU64(&pBwGroup->tsTat);
+        uint64_t const tsBase   = RT_MAX(tsTatOld, tsNow);
+        uint64_t const tsTatNew = tsBase + cNsCost;
+
+        /* A full bucket always grants the request so that transfers larger
+           than the bucket (GSO frames) cannot stall the filter forever. */
+        if (   tsTatNew - tsNow > cNsBucket
+            && tsBase != tsNow)
+        {
+            *ptsDeadline = RT_MIN(tsTatNew - cNsBucket, tsTatOld);
+            return false;
+        }
+
+        if (ASMAtomicCmpXchgU64(&pBwGroup->tsTat, tsTatNew, tsTatOld))
+            return true;
+        ASMNopPause();
+    }
+}
+
+
+/**
+ * Records the deadline of a choked filter in the group's wakeup schedule.
+ *
+ * @param   pBwGroup        The bandwidth group.
+ * @param   pFilter         The choked filter.
+ * @param   tsDeadline      When the filter should be woken up again.
+ */
+static void pdmNsFilterChoke(PPDMNSBWGROUP pBwGroup, PPDMNSFILTER pFilter, uint64_t tsDeadline)
+{
+    ASMAtomicWriteU64(&pFilter->tsWakeup, tsDeadline);
+    ASMAtomicWriteBool(&pFilter->fChoked, true);
+
+    uint64_t tsNextWakeup = ASMAtomicReadU64(&pBwGroup->tsNextWakeup);
+    while (tsDeadline < tsNextWakeup)
+    {
+        if (ASMAtomicCmpXchgExU64(&pBwGroup->tsNextWakeup, tsDeadline, tsNextWakeup, &tsNextWakeup))
+        {
+#ifdef IN_RING3
+            /* Make sure the TX thread doesn't oversleep the new deadline. */
+            if (pBwGroup->pShaperR3)
+                pdmR3NsTxKick(pBwGroup->pShaperR3, tsDeadline);
+#endif
+            break;
+        }
+    }
+}
+
+
 /**
  * Obtain bandwidth in a bandwidth group.
  *
+ * The filter takes a small chunk of credit in advance whenever it has to go to
+ * the shared bucket, so most small frames are granted without touching the
+ * bandwidth group at all.  The caller must serialize calls for the same filter
+ * (the transmit lock of the driver does that).
+ *
  * @returns True if bandwidth was allocated, false if not.
  * @param   pFilter         Pointer to the filter that allocates bandwidth.
  * @param   cbTransfer      Number of bytes to allocate.
@@ -41,37 +114,60 @@ VMMDECL(bool) PDMNsAllocateBandwidth(PPDMNSFILTER pFilter, size_t cbTransfer)
     if (!VALID_PTR(pFilter->CTX_SUFF(pBwGroup)))
         return true;
 
-    PPDMNSBWGROUP pBwGroup = ASMAtomicReadPtrT(&pFilter->CTX_SUFF(pBwGroup), PPDMNSBWGROUP);
-    int rc = PDMCritSectEnter(&pBwGroup->Lock, VERR_SEM_BUSY); AssertRC(rc);
-    if (RT_UNLIKELY(rc == VERR_SEM_BUSY))
+    PPDMNSBWGROUP  pBwGroup    = ASMAtomicReadPtrT(&pFilter->CTX_SUFF(pBwGroup), PPDMNSBWGROUP);
+    uint64_t const cbPerSecMax = ASMAtomicReadU64(&pBwGroup->cbPerSecMax);
+    if (!cbPerSecMax)
+    {
+        Log2(("pdmNsAllocateBandwidth: BwGroup=%#p{%s} disabled fAllowed=true\n",
+              pBwGroup, R3STRING(pBwGroup->pszNameR3)));
         return true;
+    }
 
-    bool fAllowed = true;
-    if (pBwGroup->cbPerSecMax)
+    /*
+     * Consume the cached credit first, dropping it if the limit has changed.
+     */
+    uint32_t const uGeneration = ASMAtomicReadU32(&pBwGroup->uGeneration);
+    if (RT_LIKELY(pFilter->uCreditGen == uGeneration))
     {
-        /* Re-fill the bucket first */
-        uint64_t tsNow        = RTTimeSystemNanoTS();
-        uint32_t uTokensAdded = (tsNow - pBwGroup->tsUpdatedLast) * pBwGroup->cbPerSecMax / (1000 * 1000 * 1000);
-        uint32_t uTokens      = RT_MIN(pBwGroup->cbBucket, uTokensAdded + pBwGroup->cbTokensLast);
-
-        if (cbTransfer > uTokens)
+        if (cbTransfer <= pFilter->cbCredit)
         {
-            fAllowed = false;
-            ASMAtomicWriteBool(&pFilter->fChoked, true);
+            pFilter->cbCredit -= (uint32_t)cbTransfer;
+            return true;
         }
-        else
-        {
-            pBwGroup->tsUpdatedLast = tsNow;
-            pBwGroup->cbTokensLast = uTokens - (uint32_t)cbTransfer;
-        }
-        Log2(("pdmNsAllocateBandwidth: BwGroup=%#p{%s} cbTransfer=%u uTokens=%u uTokensAdded=%u fAllowed=%RTbool\n",
-              pBwGroup, R3STRING(pBwGroup->pszNameR3), cbTransfer, uTokens, uTokensAdded, fAllowed));
     }
     else
-        Log2(("pdmNsAllocateBandwidth: BwGroup=%#p{%s} disabled fAllowed=%RTbool\n",
-              pBwGroup, R3STRING(pBwGroup->pszNameR3), fAllowed));
+    {
+        pFilter->cbCredit   = 0;
+        pFilter->uCreditGen = uGeneration;
+    }
+
+    /*
+     * Take the missing bytes plus a new chunk of credit from the bucket,
+     * falling back on just the missing bytes if the bucket runs low.
+     */
+    uint64_t const cbMissing     = cbTransfer - pFilter->cbCredit;
+    uint32_t const cbCreditChunk = ASMAtomicUoReadU32(&pBwGroup->cbCreditChunk);
+    uint64_t const tsNow         = RTTimeSystemNanoTS();
+    uint64_t       tsDeadline    = 0;
+    bool           fAllowed;
+    if (   cbCreditChunk
+        && pdmNsBwGroupTakeTokens(pBwGroup, cbMissing + cbCreditChunk, cbPerSecMax, tsNow, &tsDeadline))
+    {
+        pFilter->cbCredit = cbCreditChunk;
+        fAllowed = true;
+    }
+    else if (pdmNsBwGroupTakeTokens(pBwGroup, cbMissing, cbPerSecMax, tsNow, &tsDeadline))
+    {
+        pFilter->cbCredit = 0;
+        fAllowed = true;
+    }
+    else
+    {
+        pdmNsFilterChoke(pBwGroup, pFilter, tsDeadline);
+        fAllowed = false;
+    }
 
-    rc = PDMCritSectLeave(&pBwGroup->Lock); AssertRC(rc);
+    Log2(("pdmNsAllocateBandwidth: BwGroup=%#p{%s} cbTransfer=%u cbMissing=%llu cbCredit=%u fAllowed=%RTbool\n",
+          pBwGroup, R3STRING(pBwGroup->pszNameR3), cbTransfer, cbMissing, pFilter->cbCredit, fAllowed));
     return fAllowed;
 }
-
@@ -34,6 +34,7 @@
 # include <VBox/vmm/rem.h>
 #endif
 #include <VBox/vmm/em.h>
+#include <VBox/vmm/iem.h>
 #include <VBox/vmm/hm.h>
 #include <VBox/vmm/hm_vmx.h>
 #include "PGMInternal.h"
@@ -724,6 +725,8 @@ VMMDECL(int) PGMInvalidatePage(PVMCPU pVCpu, RTGCPTR GCPtrPage)
     int rc;
     Log3(("PGMInvalidatePage: GCPtrPage=%RGv\n", GCPtrPage));
 
+    IEMTlbInvalidatePage(pVCpu, GCPtrPage);
+
 #if !defined(IN_RING3) && defined(VBOX_WITH_REM)
     /*
      * Notify the recompiler so it can record this instruction.
@@ -1940,6 +1943,9 @@ VMMDECL(int) PGMFlushTLB(PVMCPU pVCpu, uint64_t cr3, bool fGlobal)
 
     VMCPU_ASSERT_EMT(pVCpu);
 
+    /* IEM doesn't track global pages, so drop everything. */
+    IEMTlbInvalidateAll(pVCpu);
+
     /*
      * Always flag the necessary updates; necessary for hardware acceleration
      */
@@ -2247,6 +2253,9 @@ VMMDECL(int) PGMChangeMode(PVMCPU pVCpu, uint64_t cr0, uint64_t cr4, uint64_t ef
 
     VMCPU_ASSERT_EMT(pVCpu);
 
+    /* Paging may have been turned on or off, or changed format. */
+    IEMTlbInvalidateAll(pVCpu);
+
     /*
      * Calc the new guest mode.
      */
@@ -2575,6 +2584,8 @@ int pgmRZDynMapGCPageCommon(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys, void **ppv R
     PPGMPAGE pPage = pgmPhysGetPage(pVM, GCPhys);
     if (RT_LIKELY(pPage))
     {
+        if (RT_UNLIKELY(pVM->pgm.s.fPostCopyTrgArmed) && PGM_PAGE_HAS_ACTIVE_ALL_HANDLERS(pPage))
+            pgmPhysPostCopyFetch(pVM, GCPhys);
         rc = pgmPhysPageMakeWritable(pVM, pPage, GCPhys);
         if (RT_SUCCESS(rc))
         {
@@ -25,6 +25,7 @@
 #include <VBox/vmm/iom.h>
 #include <VBox/vmm/mm.h>
 #include <VBox/vmm/em.h>
+#include <VBox/vmm/iem.h>
 #include <VBox/vmm/stam.h>
 #ifdef VBOX_WITH_REM
 # include <VBox/vmm/rem.h>
@@ -299,6 +300,9 @@ static int pgmHandlerPhysicalSetRamFlagsAndFlushShadowPTs(PVM pVM, PPGMPHYSHANDL
         i++;
     }
 
+    /* IEM may have cached mappings of the pages. */
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
+
     if (fFlushTLBs)
     {
         PGM_INVL_ALL_VCPU_TLBS(pVM);
@@ -464,6 +468,7 @@ DECLINLINE(void) pgmHandlerPhysicalRecalcPageState(PVM pVM, RTGCPHYS GCPhys, boo
         {
             /* This should normally not be necessary. */
             PGM_PAGE_SET_HNDL_PHYS_STATE(pPage, uState);
+            IEMTlbInvalidateAllPhysicalAllCpus(pVM);
             bool fFlushTLBs ;
             rc = pgmPoolTrackUpdateGCPhys(pVM, GCPhys, pPage, false /*fFlushPTEs*/, &fFlushTLBs);
             if (RT_SUCCESS(rc) && fFlushTLBs)
@@ -1611,6 +1616,8 @@ DECLCALLBACK(int) pgmHandlerVirtualResetOne(PAVLROGCPTRNODECORE pNode, void *pvU
         offPage = 0;
     }
 
+    /* IEM may have cached mappings of the pages. */
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
     return 0;
 }
 
@@ -25,6 +25,7 @@
 #include <VBox/vmm/vmm.h>
 #include <VBox/vmm/iom.h>
 #include <VBox/vmm/em.h>
+#include <VBox/vmm/iem.h>
 #ifdef VBOX_WITH_REM
 # include <VBox/vmm/rem.h>
 #endif
@@ -603,6 +604,7 @@ void pgmPhysInvalidatePageMapTLB(PVM pVM)
 
     /** @todo clear the RC TLB whenever we add it. */
 
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
     pgmUnlock(pVM);
 }
 
@@ -635,6 +637,8 @@ void pgmPhysInvalidatePageMapTLBEntry(PVM pVM, RTGCPHYS GCPhys)
 #endif
 
     /** @todo clear the RC TLB whenever we add it. */
+
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
 }
 
 /**
@@ -1491,6 +1495,45 @@ int pgmPhysPageLoadIntoTlbWithPage(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys)
 
 #endif /* !IN_RC && !VBOX_WITH_2X_4GB_ADDR_SPACE_IN_R0 */
 
+/**
+ * Makes sure a page still missing on a post-copy (or lazy restore) target
+ * has arrived before it is mapped without consulting the access handlers.
+ *
+ * This is what keeps the guest paging structure walks from seeing an empty
+ * page table.  Ring-3 fetches the page on the spot, ring-0 and raw-mode call
+ * ring-3 to do it.  The caller checks pgm.s.fPostCopyTrgArmed first.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   GCPhys      The guest physical address.
+ * @remarks The page state may have changed when this returns.
+ */
+void pgmPhysPostCopyFetch(PVM pVM, RTGCPHYS GCPhys)
+{
+    GCPhys &= ~(RTGCPHYS)PAGE_OFFSET_MASK;
+
+    /* Only pages covered by an active post-copy handler are missing, the
+       ones we have are switched off. */
+    pgmLock(pVM);
+    PPGMPAGE        pPage    = pgmPhysGetPage(pVM, GCPhys);
+    PPGMPHYSHANDLER pHandler = pPage && PGM_PAGE_HAS_ACTIVE_ALL_HANDLERS(pPage)
+                             ? pgmHandlerPhysicalLookup(pVM, GCPhys) : NULL;
+    bool const      fMissing = pHandler && pHandler->hType == pVM->pgm.s.hPostCopyPhysHandlerType;
+    pgmUnlock(pVM);
+    if (!fMissing)
+        return;
+
+#ifdef IN_RING3
+    pgmR3PostCopyTrgFetchPage(pVM, GCPhys);
+#else
+    PVMCPU pVCpu = VMMGetCpu(pVM);
+    if (pVCpu && VMMRZCallRing3IsEnabled(pVCpu))
+        VMMRZCallRing3(pVM, pVCpu, VMMCALLRING3_PGM_POSTCOPY_FETCH, GCPhys);
+    else
+        LogRelMax(32, ("PGM: Post-copy: Cannot fetch %RGp with ring-3 calls disabled\n", GCPhys));
+#endif
+}
+
+
 /**
  * Internal version of PGMPhysGCPhys2CCPtr that expects the caller to
  * own the PGM lock and therefore not need to lock the mapped page.
@@ -1515,6 +1558,13 @@ int pgmPhysGCPhys2CCPtrInternalDepr(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys, vo
     PGM_LOCK_ASSERT_OWNER(pVM);
     pVM->pgm.s.cDeprecatedPageLocks++;
 
+    /*
+     * The guest paging structure walks come this way, so make sure we're not
+     * handing out a page still missing on a post-copy target.
+     */
+    if (RT_UNLIKELY(pVM->pgm.s.fPostCopyTrgArmed) && PGM_PAGE_HAS_ACTIVE_ALL_HANDLERS(pPage))
+        pgmPhysPostCopyFetch(pVM, GCPhys);
+
     /*
      * Make sure the page is writable.
      */
@@ -1771,6 +1821,17 @@ int pgmPhysGCPhys2CCPtrInternalReadOnly(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys
  */
 VMM_INT_DECL(int) PGMPhysGCPhys2CCPtr(PVM pVM, RTGCPHYS GCPhys, void **ppv, PPGMPAGEMAPLOCK pLock)
 {
+    /* The mapping bypasses access handlers, so make sure a page still missing
+       after a post-copy teleportation has arrived first.  (Failure means the
+       VM is being suspended, the caller gets whatever is there.) */
+#ifdef IN_RING3
+    if (RT_UNLIKELY(pVM->pgm.s.pPostCopyR3))
+        pgmR3PostCopyTrgFetchPage(pVM, GCPhys);
+#else
+    if (RT_UNLIKELY(pVM->pgm.s.fPostCopyTrgArmed))
+        pgmPhysPostCopyFetch(pVM, GCPhys);
+#endif
+
     int rc = pgmLock(pVM);
     AssertRCReturn(rc, rc);
 
@@ -1874,6 +1935,17 @@ VMM_INT_DECL(int) PGMPhysGCPhys2CCPtr(PVM pVM, RTGCPHYS GCPhys, void **ppv, PPGM
  */
 VMM_INT_DECL(int) PGMPhysGCPhys2CCPtrReadOnly(PVM pVM, RTGCPHYS GCPhys, void const **ppv, PPGMPAGEMAPLOCK pLock)
 {
+    /* The mapping bypasses access handlers, so make sure a page still missing
+       after a post-copy teleportation has arrived first.  (Failure means the
+       VM is being suspended, the caller gets whatever is there.) */
+#ifdef IN_RING3
+    if (RT_UNLIKELY(pVM->pgm.s.pPostCopyR3))
+        pgmR3PostCopyTrgFetchPage(pVM, GCPhys);
+#else
+    if (RT_UNLIKELY(pVM->pgm.s.fPostCopyTrgArmed))
+        pgmPhysPostCopyFetch(pVM, GCPhys);
+#endif
+
     int rc = pgmLock(pVM);
     AssertRCReturn(rc, rc);
 
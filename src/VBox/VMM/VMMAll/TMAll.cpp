@@ -360,7 +360,7 @@ DECLINLINE(bool) tmTimerTryWithLink(PTMTIMER pTimer, TMTIMERSTATE enmStateNew, T
 
 
 /**
- * Links a timer into the active list of a timer queue.
+ * Links a timer into the active heap of a timer queue.
  *
  * @param   pQueue          The queue.
  * @param   pTimer          The timer.
@@ -370,50 +370,15 @@ DECLINLINE(bool) tmTimerTryWithLink(PTMTIMER pTimer, TMTIMERSTATE enmStateNew, T
  */
 DECL_FORCE_INLINE(void) tmTimerQueueLinkActive(PTMTIMERQUEUE pQueue, PTMTIMER pTimer, uint64_t u64Expire)
 {
-    Assert(!pTimer->offNext);
-    Assert(!pTimer->offPrev);
     Assert(pTimer->enmState == TMTIMERSTATE_ACTIVE || pTimer->enmClock != TMCLOCK_VIRTUAL_SYNC); /* (active is not a stable state) */
+    Assert(pTimer->u64Expire == u64Expire);
 
-    PTMTIMER pCur = TMTIMER_GET_HEAD(pQueue);
-    if (pCur)
-    {
-        for (;; pCur = TMTIMER_GET_NEXT(pCur))
-        {
-            if (pCur->u64Expire > u64Expire)
-            {
-                const PTMTIMER pPrev = TMTIMER_GET_PREV(pCur);
-                TMTIMER_SET_NEXT(pTimer, pCur);
-                TMTIMER_SET_PREV(pTimer, pPrev);
-                if (pPrev)
-                    TMTIMER_SET_NEXT(pPrev, pTimer);
-                else
-                {
-                    TMTIMER_SET_HEAD(pQueue, pTimer);
-                    ASMAtomicWriteU64(&pQueue->u64Expire, u64Expire);
-                    DBGFTRACE_U64_TAG2(pTimer->CTX_SUFF(pVM), u64Expire, "tmTimerQueueLinkActive head", R3STRING(pTimer->pszDesc));
-                }
-                TMTIMER_SET_PREV(pCur, pTimer);
-                return;
-            }
-            if (!pCur->offNext)
-            {
-                TMTIMER_SET_NEXT(pCur, pTimer);
-                TMTIMER_SET_PREV(pTimer, pCur);
-                DBGFTRACE_U64_TAG2(pTimer->CTX_SUFF(pVM), u64Expire, "tmTimerQueueLinkActive tail", R3STRING(pTimer->pszDesc));
-                return;
-            }
-        }
-    }
-    else
-    {
-        TMTIMER_SET_HEAD(pQueue, pTimer);
-        ASMAtomicWriteU64(&pQueue->u64Expire, u64Expire);
-        DBGFTRACE_U64_TAG2(pTimer->CTX_SUFF(pVM), u64Expire, "tmTimerQueueLinkActive empty", R3STRING(pTimer->pszDesc));
-    }
+    if (tmTimerQueueHeapInsert(pQueue, pTimer))
+        DBGFTRACE_U64_TAG2(pTimer->CTX_SUFF(pVM), u64Expire, "tmTimerQueueLinkActive head", R3STRING(pTimer->pszDesc));
+    NOREF(u64Expire);
 }
 
 
-
 /**
  * Schedules the given timer on the given queue.
  *
@@ -574,11 +539,19 @@ void tmTimerQueuesSanityChecks(PVM pVM, const char *pszWhere)
                 continue;
             fHaveVirtualSyncLock = true;
         }
-        PTMTIMER pPrev = NULL;
-        for (PTMTIMER pCur = TMTIMER_GET_HEAD(pQueue); pCur; pPrev = pCur, pCur = TMTIMER_GET_NEXT(pCur))
+        uint32_t cActive = 0;
+        PTMTIMER pHead   = TMTIMER_GET_HEAD(pQueue);
+        AssertMsg(!pHead || (!pHead->offPrev && !pHead->offNext), ("%s: %p\n", pszWhere, pHead));
+        for (PTMTIMER pCur = pHead; pCur; pCur = tmTimerQueueHeapWalkNext(pCur))
         {
+            cActive++;
             AssertMsg((int)pCur->enmClock == i, ("%s: %d != %d\n", pszWhere, pCur->enmClock, i));
-            AssertMsg(TMTIMER_GET_PREV(pCur) == pPrev, ("%s: %p != %p\n", pszWhere, TMTIMER_GET_PREV(pCur), pPrev));
+            PTMTIMER pChild = TMTIMER_GET_CHILD(pCur);
+            AssertMsg(!pChild || TMTIMER_GET_PREV(pChild) == pCur, ("%s: %p != %p\n", pszWhere, TMTIMER_GET_PREV(pChild), pCur));
+            AssertMsg(!pChild || pChild->u64ExpireLinked >= pCur->u64ExpireLinked,
+                      ("%s: %'RU64 < %'RU64\n", pszWhere, pChild->u64ExpireLinked, pCur->u64ExpireLinked));
+            PTMTIMER pNext  = TMTIMER_GET_NEXT(pCur);
+            AssertMsg(!pNext || TMTIMER_GET_PREV(pNext) == pCur, ("%s: %p != %p\n", pszWhere, TMTIMER_GET_PREV(pNext), pCur));
             TMTIMERSTATE enmState = pCur->enmState;
             switch (enmState)
             {
@@ -596,6 +569,7 @@ void tmTimerQueuesSanityChecks(PVM pVM, const char *pszWhere)
                     break;
             }
         }
+        AssertMsg(cActive == pQueue->cActive, ("%s: %u != %u\n", pszWhere, cActive, pQueue->cActive));
     }
 
 
@@ -621,7 +595,7 @@ void tmTimerQueuesSanityChecks(PVM pVM, const char *pszWhere)
                     PTMTIMERR3 pCurAct = TMTIMER_GET_HEAD(&pVM->tm.s.CTX_SUFF(paTimerQueues)[pCur->enmClock]);
                     Assert(pCur->offPrev || pCur == pCurAct);
                     while (pCurAct && pCurAct != pCur)
-                        pCurAct = TMTIMER_GET_NEXT(pCurAct);
+                        pCurAct = tmTimerQueueHeapWalkNext(pCurAct);
                     Assert(pCurAct == pCur);
                 }
                 break;
@@ -634,13 +608,15 @@ void tmTimerQueuesSanityChecks(PVM pVM, const char *pszWhere)
                 {
                     Assert(!pCur->offNext);
                     Assert(!pCur->offPrev);
+                    Assert(!pCur->offChild);
                     for (PTMTIMERR3 pCurAct = TMTIMER_GET_HEAD(&pVM->tm.s.CTX_SUFF(paTimerQueues)[pCur->enmClock]);
                           pCurAct;
-                          pCurAct = TMTIMER_GET_NEXT(pCurAct))
+                          pCurAct = tmTimerQueueHeapWalkNext(pCurAct))
                     {
                         Assert(pCurAct != pCur);
                         Assert(TMTIMER_GET_NEXT(pCurAct) != pCur);
                         Assert(TMTIMER_GET_PREV(pCurAct) != pCur);
+                        Assert(TMTIMER_GET_CHILD(pCurAct) != pCur);
                     }
                 }
                 break;
@@ -2479,7 +2455,7 @@ static uint32_t tmGetFrequencyHint(PVM pVM)
             for (int i = 0; i < TMCLOCK_MAX; i++)
             {
                 PTMTIMERQUEUE pQueue = &pVM->tm.s.CTX_SUFF(paTimerQueues)[i];
-                for (PTMTIMER pCur = TMTIMER_GET_HEAD(pQueue); pCur; pCur = TMTIMER_GET_NEXT(pCur))
+                for (PTMTIMER pCur = TMTIMER_GET_HEAD(pQueue); pCur; pCur = tmTimerQueueHeapWalkNext(pCur))
                 {
                     uint32_t uHzHint = ASMAtomicUoReadU32(&pCur->uHzHint);
                     if (uHzHint > uMaxHzHint)
@@ -107,6 +107,16 @@
  * by the VM that locked it. We will make no attempt at implementing
  * page sharing on these systems, just do enough to make it all work.
  *
+ * Large pages can still be had in legacy mode if ring-3 seeds us with chunks
+ * backed by host huge pages (see SUPR3PageAllocHuge).  GMMR0SeedChunk checks
+ * whether the locked pages are physically contiguous and 2MB aligned and tags
+ * the chunk with GMM_CHUNK_FLAGS_CONTIGUOUS if they are, telling ring-3 so by
+ * returning VINF_GMM_SEEDED_CHUNK_CONTIGUOUS.  GMMR0AllocateLargePage
+ * then hands out completely free contiguous chunks of the VM, and returns
+ * VERR_GMM_SEED_ME when there are none so ring-3 can seed another one.  When a
+ * large page is freed again the chunk goes back to the free set instead of
+ * being released, as the memory belongs to ring-3.
+ *
  *
  * @subsection sub_gmm_locking  Serializing
  *
@@ -154,6 +164,7 @@
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/gmm.h>
 #include "GMMR0Internal.h"
+#include "GMMR0Fusion.h"
 #include <VBox/vmm/gvm.h>
 #include <VBox/vmm/pgm.h>
 #include <VBox/log.h>
@@ -399,6 +410,10 @@ typedef struct GMMCHUNK
      * what the host can dish up with.  (Chunk mtx protects mapping accesses
      * and related frees.) */
     RTR0MEMOBJ          hMemObj;
+    /** Ring-0 kernel mapping of the chunk, made when the page fusion scanner
+     * first needs to look at its content and kept until the chunk is freed.
+     * NIL_RTR0MEMOBJ if not mapped.  (Giant mtx.) */
+    RTR0MEMOBJ          hMapObjR0;
     /** Pointer to the next chunk in the free list.  (Giant mtx.) */
     PGMMCHUNK           pFreeNext;
     /** Pointer to the previous chunk in the free list. (Giant mtx.) */
@@ -446,6 +461,10 @@ typedef struct GMMCHUNK
  * @{ */
 /** Indicates that the chunk is a large page (2MB). */
 #define GMM_CHUNK_FLAGS_LARGE_PAGE  UINT16_C(0x0001)
+/** Indicates that the chunk is physically contiguous and 2MB aligned, so it can
+ * be used as a large page when it's completely free.  Only used in legacy mode
+ * for seeded chunks. */
+#define GMM_CHUNK_FLAGS_CONTIGUOUS  UINT16_C(0x0002)
 /** @}  */
 
 
@@ -516,6 +535,11 @@ typedef struct GMM
     PAVLLU32NODECORE    pGlobalSharedModuleTree;
     /** Sharable modules (count of nodes in pGlobalSharedModuleTree). */
     uint32_t            cShareableModules;
+#ifdef VBOX_WITH_PAGE_SHARING
+    /** The content based page fusion table, see @ref pg_gmm_fusion.
+     * The buckets are allocated on first use. */
+    GMMFUSIONTABLE      Fusion;
+#endif
 
     /** The chunk list.  For simplifying the cleanup process. */
     RTLISTANCHOR        ChunkList;
@@ -740,6 +764,7 @@ DECLINLINE(void)            gmmR0SelectSetAndLinkChunk(PGMM pGMM, PGVM pGVM, PGM
 static uint32_t             gmmR0SanityCheck(PGMM pGMM, const char *pszFunction, unsigned uLineNo);
 #endif
 static bool                 gmmR0FreeChunk(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk, bool fRelaxedSem);
+static void                 gmmR0FreePageWorker(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk, uint32_t idPage, PGMMPAGE pPage);
 DECLINLINE(void)            gmmR0FreePrivatePage(PGMM pGMM, PGVM pGVM, uint32_t idPage, PGMMPAGE pPage);
 DECLINLINE(void)            gmmR0FreeSharedPage(PGMM pGMM, PGVM pGVM, uint32_t idPage, PGMMPAGE pPage);
 static int                  gmmR0UnmapChunkLocked(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk);
@@ -896,6 +921,12 @@ GMMR0DECL(void) GMMR0Term(void)
         pGMM->aChunkMtx[iMtx].hMtx = NIL_RTSEMFASTMUTEX;
     }
 
+#ifdef VBOX_WITH_PAGE_SHARING
+    /* The page fusion table. */
+    RTMemFree(pGMM->Fusion.paBuckets);
+    pGMM->Fusion.paBuckets = NULL;
+#endif
+
     /* Finally the instance data itself. */
     RTMemFree(pGMM);
     LogFlow(("GMMTerm: done\n"));
@@ -917,6 +948,7 @@ static DECLCALLBACK(int) gmmR0TermDestroyChunk(PAVLU32NODECORE pNode, void *pvGM
         SUPR0Printf("GMMR0Term: %p/%#x: cFree=%d cPrivate=%d cShared=%d cMappings=%d\n", pChunk,
                     pChunk->Core.Key, pChunk->cFree, pChunk->cPrivate, pChunk->cShared, pChunk->cMappingsX);
 
+    pChunk->hMapObjR0 = NIL_RTR0MEMOBJ; /* freed with the chunk below */
     int rc = RTR0MemObjFree(pChunk->hMemObj, true /* fFreeMappings */);
     if (RT_FAILURE(rc))
     {
@@ -2125,7 +2157,7 @@ static int gmmR0RegisterChunk(PGMM pGMM, PGMMCHUNKFREESET pSet, RTR0MEMOBJ MemOb
 {
     Assert(pGMM->hMtxOwner != RTThreadNativeSelf());
     Assert(hGVM != NIL_GVM_HANDLE || pGMM->fBoundMemoryMode);
-    Assert(fChunkFlags == 0 || fChunkFlags == GMM_CHUNK_FLAGS_LARGE_PAGE);
+    Assert(fChunkFlags == 0 || fChunkFlags == GMM_CHUNK_FLAGS_LARGE_PAGE || fChunkFlags == GMM_CHUNK_FLAGS_CONTIGUOUS);
 
     int rc;
     PGMMCHUNK pChunk = (PGMMCHUNK)RTMemAllocZ(sizeof(*pChunk));
@@ -2135,6 +2167,7 @@ static int gmmR0RegisterChunk(PGMM pGMM, PGMMCHUNKFREESET pSet, RTR0MEMOBJ MemOb
          * Initialize it.
          */
         pChunk->hMemObj     = MemObj;
+        pChunk->hMapObjR0   = NIL_RTR0MEMOBJ;
         pChunk->cFree       = GMM_CHUNK_NUM_PAGES;
         pChunk->hGVM        = hGVM;
         /*pChunk->iFreeHead = 0;*/
@@ -3003,6 +3036,68 @@ GMMR0DECL(int) GMMR0AllocatePagesReq(PVM pVM, VMCPUID idCpu, PGMMALLOCATEPAGESRE
 }
 
 
+/**
+ * Legacy mode worker for GMMR0AllocateLargePage.
+ *
+ * Picks a completely free chunk seeded by the VM that is physically contiguous
+ * and allocates all its pages.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_GMM_SEED_ME if the VM has no suitable chunk.
+ * @param   pGMM        Pointer to the GMM instance data.
+ * @param   pGVM        Pointer to the VM.
+ * @param   pIdPage     Where to return the GMM page ID of the page.
+ * @param   pHCPhys     Where to return the host physical address of the page.
+ *
+ * @remarks Caller owns the giant GMM mutex.
+ */
+static int gmmR0AllocateLargePageLegacy(PGMM pGMM, PGVM pGVM, uint32_t *pIdPage, RTHCPHYS *pHCPhys)
+{
+    PGMMCHUNKFREESET pSet   = &pGVM->gmm.s.Private;
+    PGMMCHUNK        pChunk = pSet->apLists[GMM_CHUNK_FREE_SET_UNUSED_LIST];
+    while (pChunk && !(pChunk->fFlags & GMM_CHUNK_FLAGS_CONTIGUOUS))
+        pChunk = pChunk->pFreeNext;
+    if (!pChunk)
+        return VERR_GMM_SEED_ME;
+    Assert(pChunk->cFree == GMM_CHUNK_NUM_PAGES);
+
+    gmmR0UnlinkChunk(pChunk);
+    pChunk->fFlags |= GMM_CHUNK_FLAGS_LARGE_PAGE;
+
+    /* Put the free list back in page order so the pages are handed out in
+       address order starting with the first one. */
+    for (unsigned iPage = 0; iPage < RT_ELEMENTS(pChunk->aPages); iPage++)
+    {
+        pChunk->aPages[iPage].u = 0;
+        pChunk->aPages[iPage].Free.u2State = GMM_PAGE_STATE_FREE;
+        pChunk->aPages[iPage].Free.iNext   = iPage + 1 < RT_ELEMENTS(pChunk->aPages) ? iPage + 1 : UINT16_MAX;
+    }
+    pChunk->iFreeHead = 0;
+
+    /* Allocate all the pages and return the first one. */
+    const unsigned cPages = GMM_CHUNK_SIZE >> PAGE_SHIFT;
+    for (unsigned i = 0; i < cPages; i++)
+    {
+        GMMPAGEDESC PageDesc;
+        PageDesc.HCPhysGCPhys = NIL_RTHCPHYS;
+        gmmR0AllocatePage(pChunk, pGVM->hSelf, &PageDesc);
+        if (!i)
+        {
+            *pIdPage = PageDesc.idPage;
+            *pHCPhys = PageDesc.HCPhysGCPhys;
+        }
+    }
+
+    /* Update accounting. */
+    pGVM->gmm.s.Stats.Allocated.cBasePages += cPages;
+    pGVM->gmm.s.Stats.cPrivatePages        += cPages;
+    pGMM->cAllocatedPages                  += cPages;
+
+    gmmR0LinkChunk(pChunk, pSet);
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Allocate a large page to represent guest RAM
  *
@@ -3041,10 +3136,6 @@ GMMR0DECL(int)  GMMR0AllocateLargePage(PVM pVM, VMCPUID idCpu, uint32_t cbPage,
     if (RT_FAILURE(rc))
         return rc;
 
-    /* Not supported in legacy mode where we allocate the memory in ring 3 and lock it in ring 0. */
-    if (pGMM->fLegacyAllocationMode)
-        return VERR_NOT_SUPPORTED;
-
     *pHCPhys = NIL_RTHCPHYS;
     *pIdPage = NIL_GMM_PAGEID;
 
@@ -3061,6 +3152,18 @@ GMMR0DECL(int)  GMMR0AllocateLargePage(PVM pVM, VMCPUID idCpu, uint32_t cbPage,
             return VERR_GMM_HIT_VM_ACCOUNT_LIMIT;
         }
 
+        /*
+         * In legacy mode ring-3 supplies the memory, so we can only use a
+         * contiguous chunk it has seeded us with.
+         */
+        if (pGMM->fLegacyAllocationMode)
+        {
+            rc = gmmR0AllocateLargePageLegacy(pGMM, pGVM, pIdPage, pHCPhys);
+            gmmR0MutexRelease(pGMM);
+            LogFlow(("GMMR0AllocateLargePage: returns %Rrc (legacy)\n", rc));
+            return rc;
+        }
+
         /*
          * Allocate a new large page chunk.
          *
@@ -3142,10 +3245,6 @@ GMMR0DECL(int)  GMMR0FreeLargePage(PVM pVM, VMCPUID idCpu, uint32_t idPage)
     if (RT_FAILURE(rc))
         return rc;
 
-    /* Not supported in legacy mode where we allocate the memory in ring 3 and lock it in ring 0. */
-    if (pGMM->fLegacyAllocationMode)
-        return VERR_NOT_SUPPORTED;
-
     gmmR0MutexAcquire(pGMM);
     if (GMM_CHECK_SANITY_UPON_ENTERING(pGMM))
     {
@@ -3167,8 +3266,24 @@ GMMR0DECL(int)  GMMR0FreeLargePage(PVM pVM, VMCPUID idCpu, uint32_t idPage)
             Assert(pChunk->cFree < GMM_CHUNK_NUM_PAGES);
             Assert(pChunk->cPrivate > 0);
 
-            /* Release the memory immediately. */
-            gmmR0FreeChunk(pGMM, NULL, pChunk, false /*fRelaxedSem*/); /** @todo this can be relaxed too! */
+            if (pGMM->fLegacyAllocationMode)
+            {
+                /* The memory belongs to ring-3, so just put the pages back on
+                   the free list where the chunk can be picked up again. */
+                Assert(pChunk->fFlags & GMM_CHUNK_FLAGS_LARGE_PAGE);
+                pChunk->fFlags &= ~GMM_CHUNK_FLAGS_LARGE_PAGE;
+                uint32_t const idFirstPage = pChunk->Core.Key << GMM_CHUNKID_SHIFT;
+                for (unsigned iPage = 0; iPage < cPages; iPage++)
+                {
+                    pChunk->cPrivate--;
+                    gmmR0FreePageWorker(pGMM, pGVM, pChunk, idFirstPage | iPage, &pChunk->aPages[iPage]);
+                }
+            }
+            else
+            {
+                /* Release the memory immediately. */
+                gmmR0FreeChunk(pGMM, NULL, pChunk, false /*fRelaxedSem*/); /** @todo this can be relaxed too! */
+            }
 
             /* Update accounting. */
             pGVM->gmm.s.Stats.Allocated.cBasePages -= cPages;
@@ -3252,10 +3367,12 @@ static bool gmmR0FreeChunk(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk, bool fRelaxed
 
 
     /*
-     * Save and trash the handle.
+     * Save and trash the handles.
      */
-    RTR0MEMOBJ const hMemObj = pChunk->hMemObj;
-    pChunk->hMemObj = NIL_RTR0MEMOBJ;
+    RTR0MEMOBJ const hMemObj   = pChunk->hMemObj;
+    RTR0MEMOBJ const hMapObjR0 = pChunk->hMapObjR0;
+    pChunk->hMemObj   = NIL_RTR0MEMOBJ;
+    pChunk->hMapObjR0 = NIL_RTR0MEMOBJ;
 
     /*
      * Unlink it from everywhere.
@@ -3294,7 +3411,13 @@ static bool gmmR0FreeChunk(PGMM pGMM, PGVM pGVM, PGMMCHUNK pChunk, bool fRelaxed
 
     RTMemFree(pChunk);
 
-    int rc = RTR0MemObjFree(hMemObj, false /* fFreeMappings */);
+    int rc;
+    if (hMapObjR0 != NIL_RTR0MEMOBJ)
+    {
+        rc = RTR0MemObjFree(hMapObjR0, false /* fFreeMappings (NA) */);
+        AssertLogRelRC(rc);
+    }
+    rc = RTR0MemObjFree(hMemObj, false /* fFreeMappings */);
     AssertLogRelRC(rc);
 
     if (fRelaxedSem)
@@ -4235,6 +4358,8 @@ GMMR0DECL(int)  GMMR0MapUnmapChunkReq(PVM pVM, PGMMMAPUNMAPCHUNKREQ pReq)
  * will be locked down and used by the GMM when the GM asks for pages.
  *
  * @returns VBox status code.
+ * @retval  VINF_GMM_SEEDED_CHUNK_CONTIGUOUS if the memory block is physically
+ *          contiguous and aligned and can thus be used for large pages.
  * @param   pVM         The cross context VM structure.
  * @param   idCpu       The VCPU id.
  * @param   pvR3        Pointer to the chunk size memory block to lock down.
@@ -4268,9 +4393,30 @@ GMMR0DECL(int) GMMR0SeedChunk(PVM pVM, VMCPUID idCpu, RTR3PTR pvR3)
     rc = RTR0MemObjLockUser(&MemObj, pvR3, GMM_CHUNK_SIZE, RTMEM_PROT_READ | RTMEM_PROT_WRITE, NIL_RTR0PROCESS);
     if (RT_SUCCESS(rc))
     {
-        rc = gmmR0RegisterChunk(pGMM, &pGVM->gmm.s.Private, MemObj, pGVM->hSelf, 0 /*fChunkFlags*/, NULL);
+        /*
+         * Check if it's backed by a host large page (physically contiguous
+         * and aligned), so GMMR0AllocateLargePage can use it.
+         */
+        uint16_t       fChunkFlags = 0;
+        RTHCPHYS const HCPhys      = RTR0MemObjGetPagePhysAddr(MemObj, 0);
+        if (!(HCPhys & (GMM_CHUNK_SIZE - 1)))
+        {
+            fChunkFlags = GMM_CHUNK_FLAGS_CONTIGUOUS;
+            for (uint32_t iPage = 1; iPage < GMM_CHUNK_NUM_PAGES; iPage++)
+                if (RTR0MemObjGetPagePhysAddr(MemObj, iPage) != HCPhys + ((RTHCPHYS)iPage << PAGE_SHIFT))
+                {
+                    fChunkFlags = 0;
+                    break;
+                }
+        }
+
+        rc = gmmR0RegisterChunk(pGMM, &pGVM->gmm.s.Private, MemObj, pGVM->hSelf, fChunkFlags, NULL);
         if (RT_SUCCESS(rc))
+        {
             gmmR0MutexRelease(pGMM);
+            if (fChunkFlags & GMM_CHUNK_FLAGS_CONTIGUOUS)
+                rc = VINF_GMM_SEEDED_CHUNK_CONTIGUOUS;
+        }
         else
             RTR0MemObjFree(MemObj, false /* fFreeMappings */);
     }
@@ -5233,6 +5379,226 @@ GMMR0DECL(int) GMMR0CheckSharedModules(PVM pVM, PVMCPU pVCpu)
 #endif
 }
 
+#ifdef VBOX_WITH_PAGE_SHARING
+
+/**
+ * Argument packet for gmmR0FusionVerify.
+ */
+typedef struct GMMFUSIONVERIFYARGS
+{
+    PGMM            pGMM;
+    PGVM            pGVM;
+    /** The mapping of the page being checked. */
+    uint8_t const  *pbPage;
+} GMMFUSIONVERIFYARGS;
+
+
+/**
+ * Gets the ring-0 kernel mapping of a chunk, creating it if necessary.
+ *
+ * The page fusion scanner compares pages of other VMs thru this mapping, as
+ * mapping their private chunks into the process of the scanning VM would let
+ * it at memory belonging to other guests.
+ *
+ * @returns VBox status code.
+ * @param   pChunk      The chunk.
+ * @param   ppbChunk    Where to return the address of the mapping.
+ *
+ * @remarks The caller must own the giant GMM mutex.
+ */
+static int gmmR0ChunkMapKernel(PGMMCHUNK pChunk, uint8_t **ppbChunk)
+{
+    if (pChunk->hMapObjR0 == NIL_RTR0MEMOBJ)
+    {
+        RTR0MEMOBJ hMapObj;
+        int rc = RTR0MemObjMapKernel(&hMapObj, pChunk->hMemObj, (void *)-1, 0, RTMEM_PROT_READ);
+        if (RT_FAILURE(rc))
+            return rc;
+        pChunk->hMapObjR0 = hMapObj;
+    }
+    *ppbChunk = (uint8_t *)RTR0MemObjAddress(pChunk->hMapObjR0);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNGMMFUSIONVERIFY}
+ */
+static DECLCALLBACK(GMMFUSIONMATCH) gmmR0FusionVerify(void *pvUser, uint32_t idPage, uint32_t idPageOther, bool fShared)
+{
+    GMMFUSIONVERIFYARGS *pArgs = (GMMFUSIONVERIFYARGS *)pvUser;
+    PGMM                 pGMM  = pArgs->pGMM;
+    PGVM                 pGVM  = pArgs->pGVM;
+    NOREF(idPage);
+
+    PGMMPAGE pPageOther = gmmR0GetPage(pGMM, idPageOther);
+    if (   !pPageOther
+        || (fShared ? !GMM_PAGE_IS_SHARED(pPageOther) : !GMM_PAGE_IS_PRIVATE(pPageOther)))
+        return GMMFUSIONMATCH_STALE;
+
+    PGMMCHUNK pChunk = gmmR0GetChunk(pGMM, idPageOther >> GMM_CHUNKID_SHIFT);
+    AssertReturn(pChunk, GMMFUSIONMATCH_STALE); /* can't fail as gmmR0GetPage succeeded. */
+
+    /*
+     * Get at the other page thru the kernel mapping of its chunk, it may
+     * well belong to another VM.
+     */
+    uint8_t *pbChunk;
+    int rc = gmmR0ChunkMapKernel(pChunk, &pbChunk);
+    if (RT_FAILURE(rc))
+        return GMMFUSIONMATCH_DIFFERENT;
+    NOREF(pGVM);
+
+    /** @todo write ASMMemComparePage. */
+    bool fIdentical = !memcmp(pbChunk + ((idPageOther & GMM_PAGEID_IDX_MASK) << PAGE_SHIFT), pArgs->pbPage, PAGE_SIZE);
+    return fIdentical ? GMMFUSIONMATCH_IDENTICAL : GMMFUSIONMATCH_DIFFERENT;
+}
+
+
+/**
+ * Checks whether a private page can be fused with an identical page
+ * elsewhere, see @ref pg_gmm_fusion.
+ *
+ * Performs the following tasks:
+ *  - If a shared page with the same content exists, the VM page is freed and
+ *    the shared page is returned in the pPageDesc descriptor.
+ *  - If another private page with the same content exists, the VM page is
+ *    converted into a shared page and returned unchanged in the pPageDesc
+ *    descriptor.
+ *  - Otherwise pPageDesc->idPage is set to NIL_GMM_PAGEID.
+ *
+ * @remarks ASSUMES the caller has acquired the GMM semaphore!!
+ *
+ * @returns VBox status code.
+ * @param   pGVM        Pointer to the GVM instance data.
+ * @param   pPageDesc   Page descriptor.
+ */
+GMMR0DECL(int) GMMR0FusionCheckPage(PGVM pGVM, PGMMSHAREDPAGEDESC pPageDesc)
+{
+    PGMM pGMM;
+    GMM_GET_VALID_INSTANCE(pGMM, VERR_GMM_INSTANCE);
+    pPageDesc->u32StrictChecksum = 0;
+
+    PGMMPAGE pPage = gmmR0GetPage(pGMM, pPageDesc->idPage);
+    AssertMsgReturn(pPage, ("idPage=%#x (GCPhys=%RGp)\n", pPageDesc->idPage, pPageDesc->GCPhys), VERR_PGM_PHYS_INVALID_PAGE_ID);
+    AssertMsgReturn(GMM_PAGE_IS_PRIVATE(pPage) && pPage->Private.hGVM == pGVM->hSelf,
+                    ("idPage=%#x (GCPhys=%RGp) u2State=%d\n", pPageDesc->idPage, pPageDesc->GCPhys, pPage->Common.u2State),
+                    VERR_GMM_NOT_PAGE_OWNER);
+
+    /*
+     * The table is allocated on first use.
+     */
+    if (RT_UNLIKELY(!pGMM->Fusion.paBuckets))
+    {
+        PGMMFUSIONBUCKET paBuckets = (PGMMFUSIONBUCKET)RTMemAllocZ(sizeof(GMMFUSIONBUCKET) << GMM_FUSION_TABLE_SHIFT_DEFAULT);
+        AssertReturn(paBuckets, VERR_NO_MEMORY);
+        GMMFusionTableInit(&pGMM->Fusion, paBuckets, GMM_FUSION_TABLE_SHIFT_DEFAULT);
+    }
+
+    /*
+     * Calculate the virtual address of the local page.
+     */
+    PGMMCHUNK pChunk = gmmR0GetChunk(pGMM, pPageDesc->idPage >> GMM_CHUNKID_SHIFT);
+    AssertMsgReturn(pChunk, ("idPage=%#x\n", pPageDesc->idPage), VERR_PGM_PHYS_INVALID_PAGE_ID);
+
+    uint8_t *pbChunk;
+    if (!gmmR0IsChunkMapped(pGMM, pGVM, pChunk, (PRTR3PTR)&pbChunk))
+    {
+        int rc = gmmR0MapChunk(pGMM, pGVM, pChunk, false /*fRelaxedSem*/, (PRTR3PTR)&pbChunk);
+        AssertRCReturn(rc, rc);
+    }
+
+    GMMFUSIONVERIFYARGS Args;
+    Args.pGMM   = pGMM;
+    Args.pGVM   = pGVM;
+    Args.pbPage = pbChunk + ((pPageDesc->idPage & GMM_PAGEID_IDX_MASK) << PAGE_SHIFT);
+
+    /*
+     * Look it up and do as we're told.
+     */
+    uint32_t        idPageShared = NIL_GMM_PAGEID;
+    GMMFUSIONACTION enmAction    = GMMFusionLookup(&pGMM->Fusion, GMMFusionHashPage(Args.pbPage), pPageDesc->idPage,
+                                                   gmmR0FusionVerify, &Args, &idPageShared);
+    switch (enmAction)
+    {
+        case GMMFUSIONACTION_USE_SHARED:
+        {
+            Log(("GMMR0FusionCheckPage: %RGp: replacing %#x with shared page %#x\n", pPageDesc->GCPhys, pPageDesc->idPage, idPageShared));
+            PGMMPAGE pPageShared = gmmR0GetPage(pGMM, idPageShared);
+            Assert(pPageShared && GMM_PAGE_IS_SHARED(pPageShared));
+
+            GMMFREEPAGEDESC PageDesc;
+            PageDesc.idPage = pPageDesc->idPage;
+            int rc = gmmR0FreePages(pGMM, pGVM, 1, &PageDesc, GMMACCOUNT_BASE);
+            AssertRCReturn(rc, rc);
+
+            gmmR0UseSharedPage(pGMM, pGVM, pPageShared);
+
+            pPageDesc->HCPhys = ((uint64_t)pPageShared->Shared.pfn) << PAGE_SHIFT;
+            pPageDesc->idPage = idPageShared;
+#ifdef VBOX_STRICT
+            pPageDesc->u32StrictChecksum = gmmR0StrictPageChecksum(pGMM, pGVM, idPageShared);
+#endif
+            return VINF_SUCCESS;
+        }
+
+        case GMMFUSIONACTION_MAKE_SHARED:
+            Log(("GMMR0FusionCheckPage: %RGp: page %#x is now shared\n", pPageDesc->GCPhys, pPageDesc->idPage));
+            gmmR0ConvertToSharedPage(pGMM, pGVM, pPageDesc->HCPhys, pPageDesc->idPage, pPage, pPageDesc);
+            return VINF_SUCCESS;
+
+        default:
+            Assert(enmAction == GMMFUSIONACTION_NONE);
+            /* Signal to the caller that this one hasn't changed. */
+            pPageDesc->idPage = NIL_GMM_PAGEID;
+            return VINF_SUCCESS;
+    }
+}
+
+#endif /* VBOX_WITH_PAGE_SHARING */
+
+/**
+ * Feeds a batch of the VM's private pages to the page fusion scanner.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ * @param   pVCpu       The cross context virtual CPU structure.
+ * @param   cMaxPages   The max number of pages to scan.
+ */
+GMMR0DECL(int) GMMR0FusionScan(PVM pVM, PVMCPU pVCpu, uint32_t cMaxPages)
+{
+#ifdef VBOX_WITH_PAGE_SHARING
+    /*
+     * Validate input and get the basics.
+     */
+    PGMM pGMM;
+    GMM_GET_VALID_INSTANCE(pGMM, VERR_GMM_INSTANCE);
+    PGVM pGVM;
+    int rc = GVMMR0ByVMAndEMT(pVM, pVCpu->idCpu, &pGVM);
+    if (RT_FAILURE(rc))
+        return rc;
+    AssertReturn(cMaxPages > 0 && cMaxPages <= _1M, VERR_INVALID_PARAMETER);
+
+    /*
+     * Take the semaphore and let PGM walk the RAM ranges.
+     */
+    gmmR0MutexAcquire(pGMM);
+    if (GMM_CHECK_SANITY_UPON_ENTERING(pGMM))
+    {
+        rc = PGMR0PageFusionScan(pVM, pGVM, pVCpu->idCpu, cMaxPages);
+        GMM_CHECK_SANITY_UPON_LEAVING(pGMM);
+    }
+    else
+        rc = VERR_GMM_IS_NOT_SANE;
+    gmmR0MutexRelease(pGMM);
+    return rc;
+#else
+    NOREF(pVM); NOREF(pVCpu); NOREF(cMaxPages);
+    return VERR_NOT_IMPLEMENTED;
+#endif
+}
+
+
 #if defined(VBOX_STRICT) && HC_ARCH_BITS == 64
 
 /**
@@ -0,0 +1,264 @@
+/* $Id$ */
+/** @file
+ * GMM - The Global Memory Manager, Content Based Page Fusion.
+ *
+ * This is the hashing and matching logic of the page fusion scanner.  It is
+ * kept free of GMM internals so that tstGMMFusion can exercise it in ring-3.
+ */
+
+/*
+ * Copyright (C) 2007-2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ___GMMR0Fusion_h
+#define ___GMMR0Fusion_h
+
+#include <iprt/types.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/param.h>
+
+
+/** @page pg_gmm_fusion     GMM - Content Based Page Fusion
+ *
+ * The shared module interface only finds pages the guest additions tell us
+ * about.  The fusion scanner complements it by looking at page content: each
+ * VM periodically feeds a rate limited batch of its private RAM pages to
+ * GMMR0FusionCheckPage, which hashes the page and looks it up in a global
+ * table with two slots per bucket, much like the stable and unstable trees of
+ * Linux KSM:
+ *
+ *  - The stable slot refers to a shared page.  If the content matches, the
+ *    private page is freed and the VM is handed the shared page instead.
+ *
+ *  - The unstable slot refers to a private page somebody scanned earlier.
+ *    If the content matches, the page being scanned is converted into a
+ *    shared page and moved into the stable slot.  The owner of the older
+ *    page will find it there on its next pass.
+ *
+ *  - Otherwise the page is recorded in the unstable slot.
+ *
+ * The table is direct mapped and never holds references, so entries can go
+ * stale at any time.  This is dealt with by having the caller re-validate the
+ * page state and compare the full page content before acting on a match.
+ * The comparison goes thru a ring-0 kernel mapping of the other chunk that
+ * GMM caches; chunks of other VMs are never mapped into the scanning process.
+ * Converting a page to shared makes it read-only in the owning VM, which
+ * gives us copy-on-write through the existing shared page handling in PGM.
+ */
+
+
+/**
+ * Page fusion table bucket.
+ */
+typedef struct GMMFUSIONBUCKET
+{
+    /** The content hash of the page in the stable slot. */
+    uint64_t            uHashStable;
+    /** The content hash of the page in the unstable slot. */
+    uint64_t            uHashUnstable;
+    /** The ID of a shared page, NIL_GMM_PAGEID (0) if empty. */
+    uint32_t            idPageStable;
+    /** The ID of a private page, NIL_GMM_PAGEID (0) if empty. */
+    uint32_t            idPageUnstable;
+} GMMFUSIONBUCKET;
+/** Pointer to a page fusion table bucket. */
+typedef GMMFUSIONBUCKET *PGMMFUSIONBUCKET;
+
+/**
+ * Page fusion hash table.
+ */
+typedef struct GMMFUSIONTABLE
+{
+    /** The bucket array. */
+    PGMMFUSIONBUCKET    paBuckets;
+    /** The bucket index mask (number of buckets - 1). */
+    uint32_t            fBucketMask;
+    /** Padding. */
+    uint32_t            u32Padding;
+    /** The number of pages looked up. */
+    uint64_t            cLookups;
+    /** The number of times a stable page was handed out. */
+    uint64_t            cStableHits;
+    /** The number of pages promoted into the stable slot. */
+    uint64_t            cPromotions;
+    /** The number of matches that were rejected on closer inspection. */
+    uint64_t            cFalseMatches;
+} GMMFUSIONTABLE;
+/** Pointer to a page fusion hash table. */
+typedef GMMFUSIONTABLE *PGMMFUSIONTABLE;
+
+/** The default number of buckets (shift count). */
+#define GMM_FUSION_TABLE_SHIFT_DEFAULT      16
+
+/**
+ * The actions GMMFusionLookup asks the caller to perform.
+ */
+typedef enum GMMFUSIONACTION
+{
+    /** Nothing to do, the page was recorded as a candidate. */
+    GMMFUSIONACTION_NONE = 0,
+    /** Free the page and use the shared page returned instead. */
+    GMMFUSIONACTION_USE_SHARED,
+    /** Convert the page into a shared page. */
+    GMMFUSIONACTION_MAKE_SHARED
+} GMMFUSIONACTION;
+
+/**
+ * The verdicts of a FNGMMFUSIONVERIFY callback.
+ */
+typedef enum GMMFUSIONMATCH
+{
+    /** The other page is valid and has identical content. */
+    GMMFUSIONMATCH_IDENTICAL = 0,
+    /** The other page is valid but the content differs. */
+    GMMFUSIONMATCH_DIFFERENT,
+    /** The other page is gone or isn't in the expected state. */
+    GMMFUSIONMATCH_STALE
+} GMMFUSIONMATCH;
+
+/**
+ * Callback for verifying a table match before it is acted upon.
+ *
+ * @returns The verdict.
+ * @param   pvUser      The user argument.
+ * @param   idPage      The page being looked up.
+ * @param   idPageOther The page found in the table.
+ * @param   fShared     Whether @a idPageOther is expected to be a shared
+ *                      (true) or private (false) page.
+ */
+typedef DECLCALLBACK(GMMFUSIONMATCH) FNGMMFUSIONVERIFY(void *pvUser, uint32_t idPage, uint32_t idPageOther, bool fShared);
+/** Pointer to a FNGMMFUSIONVERIFY callback. */
+typedef FNGMMFUSIONVERIFY *PFNGMMFUSIONVERIFY;
+
+
+/**
+ * Initializes a page fusion table.
+ *
+ * @param   pTable      The table.
+ * @param   paBuckets   Zeroed bucket array with RT_BIT_32(cShift) entries.
+ * @param   cShift      The bucket count shift.
+ */
+DECLINLINE(void) GMMFusionTableInit(PGMMFUSIONTABLE pTable, PGMMFUSIONBUCKET paBuckets, uint32_t cShift)
+{
+    Assert(cShift > 0 && cShift < 28);
+    pTable->paBuckets     = paBuckets;
+    pTable->fBucketMask   = RT_BIT_32(cShift) - 1;
+    pTable->u32Padding    = 0;
+    pTable->cLookups      = 0;
+    pTable->cStableHits   = 0;
+    pTable->cPromotions   = 0;
+    pTable->cFalseMatches = 0;
+}
+
+
+/**
+ * Calculates the content hash of a page.
+ *
+ * This is two interleaved multiply-rotate lanes over the page (for some
+ * instruction level parallelism) and a final avalanche.  It doesn't have to
+ * be cryptographically strong as matches are always confirmed by comparing
+ * the full content, it only has to be fast and spread well.
+ *
+ * @returns 64-bit hash.
+ * @param   pvPage      The page, PAGE_SIZE bytes and 8 byte aligned.
+ */
+DECLINLINE(uint64_t) GMMFusionHashPage(void const *pvPage)
+{
+    uint64_t const *pu64   = (uint64_t const *)pvPage;
+    uint64_t        uHash1 = UINT64_C(0x9e3779b97f4a7c15);
+    uint64_t        uHash2 = UINT64_C(0xc2b2ae3d27d4eb4f);
+    for (uint32_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i += 2)
+    {
+        uHash1 = ASMRotateLeftU64(uHash1 ^ (pu64[i]     * UINT64_C(0x87c37b91114253d5)), 31) * UINT64_C(0x4cf5ad432745937f);
+        uHash2 = ASMRotateLeftU64(uHash2 ^ (pu64[i + 1] * UINT64_C(0x4cf5ad432745937f)), 33) * UINT64_C(0x87c37b91114253d5);
+    }
+
+    uint64_t uHash = uHash1 ^ ASMRotateLeftU64(uHash2, 29);
+    uHash ^= uHash >> 33;
+    uHash *= UINT64_C(0xff51afd7ed558ccd);
+    uHash ^= uHash >> 33;
+    uHash *= UINT64_C(0xc4ceb9fe1a85ec53);
+    uHash ^= uHash >> 33;
+    return uHash;
+}
+
+
+/**
+ * Looks up a private page in the page fusion table and decides what to do
+ * with it.
+ *
+ * The table is updated on the assumption that the caller carries out the
+ * returned action.
+ *
+ * @returns The action the caller should take.
+ * @param   pTable          The table.
+ * @param   uHash           The content hash of the page (GMMFusionHashPage).
+ * @param   idPage          The ID of the private page.
+ * @param   pfnVerify       Callback for verifying matches.
+ * @param   pvUser          User argument for @a pfnVerify.
+ * @param   pidPageShared   Where to return the ID of the shared page for
+ *                          GMMFUSIONACTION_USE_SHARED.
+ */
+DECLINLINE(GMMFUSIONACTION) GMMFusionLookup(PGMMFUSIONTABLE pTable, uint64_t uHash, uint32_t idPage,
+                                            PFNGMMFUSIONVERIFY pfnVerify, void *pvUser, uint32_t *pidPageShared)
+{
+    PGMMFUSIONBUCKET pBucket = &pTable->paBuckets[(uint32_t)uHash & pTable->fBucketMask];
+    pTable->cLookups++;
+
+    /*
+     * Is there a shared page with the same content?
+     */
+    if (   pBucket->idPageStable != 0
+        && pBucket->uHashStable  == uHash
+        && pBucket->idPageStable != idPage)
+    {
+        GMMFUSIONMATCH enmMatch = pfnVerify(pvUser, idPage, pBucket->idPageStable, true /*fShared*/);
+        if (enmMatch == GMMFUSIONMATCH_IDENTICAL)
+        {
+            pTable->cStableHits++;
+            *pidPageShared = pBucket->idPageStable;
+            return GMMFUSIONACTION_USE_SHARED;
+        }
+        pTable->cFalseMatches++;
+        if (enmMatch == GMMFUSIONMATCH_STALE)
+            pBucket->idPageStable = 0;
+    }
+
+    /*
+     * Has somebody else got a private page with the same content?
+     */
+    if (   pBucket->idPageUnstable != 0
+        && pBucket->uHashUnstable  == uHash
+        && pBucket->idPageUnstable != idPage)
+    {
+        GMMFUSIONMATCH enmMatch = pfnVerify(pvUser, idPage, pBucket->idPageUnstable, false /*fShared*/);
+        if (enmMatch == GMMFUSIONMATCH_IDENTICAL)
+        {
+            pTable->cPromotions++;
+            pBucket->uHashStable    = uHash;
+            pBucket->idPageStable   = idPage;
+            pBucket->idPageUnstable = 0;
+            return GMMFUSIONACTION_MAKE_SHARED;
+        }
+        pTable->cFalseMatches++;
+    }
+
+    /*
+     * No, record it as a candidate.
+     */
+    pBucket->uHashUnstable  = uHash;
+    pBucket->idPageUnstable = idPage;
+    return GMMFUSIONACTION_NONE;
+}
+
+
+#endif
@@ -1499,6 +1499,10 @@ VMMR0_INT_DECL(int) HMR0RunGuestCode(PVM pVM, PVMCPU pVCpu)
 
     VBOXSTRICTRC rcStrict = g_HmR0.pfnRunGuestCode(pVM, pVCpu, CPUMQueryGuestCtxPtr(pVCpu));
 
+    /* A VM-exit still pending at this point is being handed to ring-3. */
+    if (pVCpu->hm.s.uExitHistTsc)
+        pVCpu->hm.s.fExitHistRing3 = true;
+
 #ifdef VBOX_WITH_2X_4GB_ADDR_SPACE
     PGMRZDynMapReleaseAutoSet(pVCpu);
 #endif
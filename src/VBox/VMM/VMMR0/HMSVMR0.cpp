@@ -57,6 +57,11 @@
 # define HMSVM_EXITCODE_STAM_COUNTER_INC(u64ExitCode) do { } while (0)
 #endif
 
+/** Notes a \#VMEXIT for the exit latency histograms. */
+#define HMSVM_EXIT_HIST_NOTE_EXIT(u64ExitCode) \
+    HMCPU_EXIT_HIST_NOTE_EXIT(pVCpu, (u64ExitCode) == SVM_EXIT_NPF ? HM_EXIT_HIST_IDX_NPF \
+                                     : (uint32_t)(u64ExitCode) & MASK_EXITREASON_STAT)
+
 /** If we decide to use a function table approach this can be useful to
  *  switch to a "static DECLCALLBACK(int)". */
 #define HMSVM_EXIT_DECL                 static int
@@ -3329,6 +3334,7 @@ static int hmR0SvmRunGuestCodeNormal(PVM pVM, PVMCPU pVCpu, PCPUMCTX pCtx)
          * This also disables flushing of the R0-logger instance (if any).
          */
         hmR0SvmPreRunGuestCommitted(pVM, pVCpu, pCtx, &SvmTransient);
+        HMCPU_EXIT_HIST_NOTE_ENTRY(pVCpu);
         rc = hmR0SvmRunGuest(pVM, pVCpu, pCtx);
 
         /* Restore any residual host-state and save any bits shared between host
@@ -3347,6 +3353,7 @@ static int hmR0SvmRunGuestCodeNormal(PVM pVM, PVMCPU pVCpu, PCPUMCTX pCtx)
 
         /* Handle the #VMEXIT. */
         HMSVM_EXITCODE_STAM_COUNTER_INC(SvmTransient.u64ExitCode);
+        HMSVM_EXIT_HIST_NOTE_EXIT(SvmTransient.u64ExitCode);
         STAM_PROFILE_ADV_STOP_START(&pVCpu->hm.s.StatExit1, &pVCpu->hm.s.StatExit2, x);
         VBOXVMM_R0_HMSVM_VMEXIT(pVCpu, pCtx, SvmTransient.u64ExitCode, (PSVMVMCB)pVCpu->hm.s.svm.pvVmcb);
         rc = hmR0SvmHandleExit(pVCpu, pCtx, &SvmTransient);
@@ -3406,6 +3413,7 @@ static int hmR0SvmRunGuestCodeStep(PVM pVM, PVMCPU pVCpu, PCPUMCTX pCtx)
         VMMRZCallRing3RemoveNotification(pVCpu);
         hmR0SvmPreRunGuestCommitted(pVM, pVCpu, pCtx, &SvmTransient);
 
+        HMCPU_EXIT_HIST_NOTE_ENTRY(pVCpu);
         rc = hmR0SvmRunGuest(pVM, pVCpu, pCtx);
 
         /*
@@ -3425,6 +3433,7 @@ static int hmR0SvmRunGuestCodeStep(PVM pVM, PVMCPU pVCpu, PCPUMCTX pCtx)
 
         /* Handle the #VMEXIT. */
         HMSVM_EXITCODE_STAM_COUNTER_INC(SvmTransient.u64ExitCode);
+        HMSVM_EXIT_HIST_NOTE_EXIT(SvmTransient.u64ExitCode);
         STAM_PROFILE_ADV_STOP_START(&pVCpu->hm.s.StatExit1, &pVCpu->hm.s.StatExit2, x);
         VBOXVMM_R0_HMSVM_VMEXIT(pVCpu, pCtx, SvmTransient.u64ExitCode, (PSVMVMCB)pVCpu->hm.s.svm.pvVmcb);
         rc = hmR0SvmHandleExit(pVCpu, pCtx, &SvmTransient);
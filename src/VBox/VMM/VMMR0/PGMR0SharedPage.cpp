@@ -32,6 +32,61 @@
 
 
 #ifdef VBOX_WITH_PAGE_SHARING
+/**
+ * Updates a guest page after GMM has made it shared or replaced it by an
+ * existing shared page.
+ *
+ * The PGM lock shall be taken prior to calling this method.
+ *
+ * @param   pVM                 The cross context VM structure.
+ * @param   pVCpu               The cross context virtual CPU structure of the
+ *                              calling EMT.
+ * @param   pPage               The guest page.
+ * @param   pPageDesc           The page descriptor returned by GMM.
+ * @param   pfFlushTLBs         Where to indicate that the TLBs must be
+ *                              flushed.  Not touched if not required.
+ */
+static void pgmR0SharedPageUpdate(PVM pVM, PVMCPU pVCpu, PPGMPAGE pPage, GMMSHAREDPAGEDESC const *pPageDesc,
+                                  bool *pfFlushTLBs)
+{
+    Assert(PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_ALLOCATED);
+
+    /* Page was either replaced by an existing shared
+       version of it or converted into a read-only shared
+       page, so, clear all references. */
+    bool fFlush = false;
+    int rc = pgmPoolTrackUpdateGCPhys(pVM, pPageDesc->GCPhys, pPage, true /* clear the entries */, &fFlush);
+    Assert(   rc == VINF_SUCCESS
+           || (   VMCPU_FF_IS_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3)
+               && (pVCpu->pgm.s.fSyncFlags & PGM_SYNC_CLEAR_PGM_POOL)));
+    if (rc == VINF_SUCCESS && fFlush)
+        *pfFlushTLBs = true;
+    NOREF(pVCpu);
+
+    if (pPageDesc->HCPhys != PGM_PAGE_GET_HCPHYS(pPage))
+    {
+        /* Update the physical address and page id now. */
+        PGM_PAGE_SET_HCPHYS(pVM, pPage, pPageDesc->HCPhys);
+        PGM_PAGE_SET_PAGEID(pVM, pPage, pPageDesc->idPage);
+
+        /* Invalidate page map TLB entry for this page too. */
+        pgmPhysInvalidatePageMapTLBEntry(pVM, pPageDesc->GCPhys);
+        pVM->pgm.s.cReusedSharedPages++;
+    }
+    /* else: nothing changed (== this page is now a shared
+       page), so no need to flush anything. */
+
+    pVM->pgm.s.cSharedPages++;
+    pVM->pgm.s.cPrivatePages--;
+    PGM_PAGE_SET_STATE(pVM, pPage, PGM_PAGE_STATE_SHARED);
+
+# ifdef VBOX_STRICT /* check sum hack */
+    pPage->s.u2Unused0 = pPageDesc->u32StrictChecksum        & 3;
+    pPage->s.u2Unused1 = (pPageDesc->u32StrictChecksum >> 8) & 3;
+# endif
+}
+
+
 /**
  * Check a registered module for shared page changes.
  *
@@ -97,44 +152,11 @@ VMMR0DECL(int) PGMR0SharedModuleCheck(PVM pVM, PGVM pGVM, VMCPUID idCpu, PGMMSHA
                      */
                     if (PageDesc.idPage != NIL_GMM_PAGEID)
                     {
-                        Assert(PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_ALLOCATED);
-
                         Log(("PGMR0SharedModuleCheck: shared page gst virt=%RGv phys=%RGp host %RHp->%RHp\n",
                              GCPtrPage, PageDesc.GCPhys, PGM_PAGE_GET_HCPHYS(pPage), PageDesc.HCPhys));
 
-                        /* Page was either replaced by an existing shared
-                           version of it or converted into a read-only shared
-                           page, so, clear all references. */
-                        bool fFlush = false;
-                        rc = pgmPoolTrackUpdateGCPhys(pVM, PageDesc.GCPhys, pPage, true /* clear the entries */, &fFlush);
-                        Assert(   rc == VINF_SUCCESS
-                               || (   VMCPU_FF_IS_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3)
-                                   && (pVCpu->pgm.s.fSyncFlags & PGM_SYNC_CLEAR_PGM_POOL)));
-                        if (rc == VINF_SUCCESS)
-                            fFlushTLBs |= fFlush;
+                        pgmR0SharedPageUpdate(pVM, pVCpu, pPage, &PageDesc, &fFlushTLBs);
                         fFlushRemTLBs = true;
-
-                        if (PageDesc.HCPhys != PGM_PAGE_GET_HCPHYS(pPage))
-                        {
-                            /* Update the physical address and page id now. */
-                            PGM_PAGE_SET_HCPHYS(pVM, pPage, PageDesc.HCPhys);
-                            PGM_PAGE_SET_PAGEID(pVM, pPage, PageDesc.idPage);
-
-                            /* Invalidate page map TLB entry for this page too. */
-                            pgmPhysInvalidatePageMapTLBEntry(pVM, PageDesc.GCPhys);
-                            pVM->pgm.s.cReusedSharedPages++;
-                        }
-                        /* else: nothing changed (== this page is now a shared
-                           page), so no need to flush anything. */
-
-                        pVM->pgm.s.cSharedPages++;
-                        pVM->pgm.s.cPrivatePages--;
-                        PGM_PAGE_SET_STATE(pVM, pPage, PGM_PAGE_STATE_SHARED);
-
-# ifdef VBOX_STRICT /* check sum hack */
-                        pPage->s.u2Unused0 = PageDesc.u32StrictChecksum        & 3;
-                        pPage->s.u2Unused1 = (PageDesc.u32StrictChecksum >> 8) & 3;
-# endif
                     }
                 }
             }
@@ -166,5 +188,132 @@ VMMR0DECL(int) PGMR0SharedModuleCheck(PVM pVM, PGVM pGVM, VMCPUID idCpu, PGMMSHA
 
     return rc;
 }
-#endif /* VBOX_WITH_PAGE_SHARING */
 
+
+/**
+ * Feeds the next batch of private guest RAM pages to the page fusion scanner.
+ *
+ * The scan continues where the previous call left off and wraps around at the
+ * end of RAM, but never covers the RAM more than once per call.  Pages that
+ * are part of a large page are skipped as we don't want to break those up on
+ * speculation.
+ *
+ * The PGM lock shall be taken prior to calling this method and the GMM
+ * semaphore must be owned (GMMR0FusionScan).
+ *
+ * @returns VBox status code.
+ * @param   pVM                 The cross context VM structure.
+ * @param   pGVM                Pointer to the GVM instance data.
+ * @param   idCpu               The ID of the calling virtual CPU.
+ * @param   cMaxPages           The max number of pages to hash.
+ */
+VMMR0DECL(int) PGMR0PageFusionScan(PVM pVM, PGVM pGVM, VMCPUID idCpu, uint32_t cMaxPages)
+{
+    PVMCPU              pVCpu         = &pVM->aCpus[idCpu];
+    int                 rc            = VINF_SUCCESS;
+    bool                fFlushTLBs    = false;
+    bool                fFlushRemTLBs = false;
+    GMMSHAREDPAGEDESC   PageDesc;
+
+    PGM_LOCK_ASSERT_OWNER(pVM);     /* This cannot fail as we grab the lock in pgmR3PageFusionScanRendezvous before calling into ring-0. */
+
+    /* Write monitoring (live save) and page sharing doesn't mix. */
+    if (pVM->pgm.s.fPhysWriteMonitoringEngaged)
+        return VINF_SUCCESS;
+
+    /*
+     * Find the RAM range to continue in.
+     */
+    RTGCPHYS     GCPhys = pVM->pgm.s.FusionScan.GCPhysNext;
+    PPGMRAMRANGE pRam   = pVM->pgm.s.CTX_SUFF(pRamRangesX);
+    while (pRam && pRam->GCPhysLast < GCPhys)
+        pRam = pRam->CTX_SUFF(pNext);
+
+    bool     fWrapped = false;
+    uint32_t cLeft    = cMaxPages;
+    while (cLeft > 0)
+    {
+        if (!pRam)
+        {
+            pVM->pgm.s.FusionScan.cRounds++;
+            if (fWrapped)
+                break;
+            fWrapped = true;
+            pRam     = pVM->pgm.s.CTX_SUFF(pRamRangesX);
+            GCPhys   = 0;
+            continue;
+        }
+
+        uint32_t const cPages = (uint32_t)(pRam->cb >> PAGE_SHIFT);
+        uint32_t       iPage  = GCPhys > pRam->GCPhys ? (uint32_t)((GCPhys - pRam->GCPhys) >> PAGE_SHIFT) : 0;
+        if (!PGM_RAM_RANGE_IS_AD_HOC(pRam))
+        {
+            for (; iPage < cPages && cLeft > 0; iPage++)
+            {
+                PPGMPAGE pPage = &pRam->aPages[iPage];
+                if (    PGM_PAGE_GET_TYPE(pPage)        == PGMPAGETYPE_RAM
+                    &&  PGM_PAGE_GET_STATE(pPage)       == PGM_PAGE_STATE_ALLOCATED
+                    &&  PGM_PAGE_GET_PDE_TYPE(pPage)    != PGM_PAGE_PDE_TYPE_PDE
+                    &&  PGM_PAGE_GET_READ_LOCKS(pPage)  == 0
+                    &&  PGM_PAGE_GET_WRITE_LOCKS(pPage) == 0
+                    && !PGM_PAGE_HAS_ANY_HANDLERS(pPage))
+                {
+                    PageDesc.idPage = PGM_PAGE_GET_PAGEID(pPage);
+                    PageDesc.HCPhys = PGM_PAGE_GET_HCPHYS(pPage);
+                    PageDesc.GCPhys = pRam->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+
+                    rc = GMMR0FusionCheckPage(pGVM, &PageDesc);
+                    if (RT_FAILURE(rc))
+                        break;
+                    STAM_REL_COUNTER_INC(&pVM->pgm.s.StatFusionScanned);
+                    cLeft--;
+
+                    /*
+                     * Any change for this page?
+                     */
+                    if (PageDesc.idPage != NIL_GMM_PAGEID)
+                    {
+                        Log(("PGMR0PageFusionScan: shared page phys=%RGp host %RHp->%RHp\n",
+                             PageDesc.GCPhys, PGM_PAGE_GET_HCPHYS(pPage), PageDesc.HCPhys));
+                        if (PageDesc.HCPhys != PGM_PAGE_GET_HCPHYS(pPage))
+                            STAM_REL_COUNTER_INC(&pVM->pgm.s.StatFusionMerged);
+                        else
+                            STAM_REL_COUNTER_INC(&pVM->pgm.s.StatFusionShared);
+
+                        pgmR0SharedPageUpdate(pVM, pVCpu, pPage, &PageDesc, &fFlushTLBs);
+                        fFlushRemTLBs = true;
+                    }
+                }
+            }
+            if (RT_FAILURE(rc))
+                break;
+        }
+        else
+            iPage = cPages;
+
+        /*
+         * Advance.
+         */
+        if (iPage < cPages)
+            GCPhys = pRam->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+        else
+        {
+            pRam   = pRam->CTX_SUFF(pNext);
+            GCPhys = pRam ? pRam->GCPhys : 0;
+        }
+    }
+    pVM->pgm.s.FusionScan.GCPhysNext = GCPhys;
+
+    /*
+     * Do TLB flushing if necessary.
+     */
+    if (fFlushTLBs)
+        PGM_INVL_ALL_VCPU_TLBS(pVM);
+
+    if (fFlushRemTLBs)
+        for (VMCPUID idCurCpu = 0; idCurCpu < pVM->cCpus; idCurCpu++)
+            CPUMSetChangedFlags(&pVM->aCpus[idCurCpu], CPUM_CHANGED_GLOBAL_TLB_FLUSH);
+
+    return rc;
+}
+#endif /* VBOX_WITH_PAGE_SHARING */
@@ -868,6 +868,9 @@ static void vmmR0RecordRC(PVM pVM, PVMCPU pVCpu, int rc)
                 case VMMCALLRING3_PGM_ALLOCATE_HANDY_PAGES:
                     STAM_COUNTER_INC(&pVM->vmm.s.StatRZCallPGMAllocHandy);
                     break;
+                case VMMCALLRING3_PGM_POSTCOPY_FETCH:
+                    STAM_COUNTER_INC(&pVM->vmm.s.StatRZCallPGMPostCopyFetch);
+                    break;
                 case VMMCALLRING3_REM_REPLAY_HANDLER_NOTIFICATIONS:
                     STAM_COUNTER_INC(&pVM->vmm.s.StatRZCallRemReplay);
                     break;
@@ -1702,6 +1705,16 @@ static int vmmR0EntryExWorker(PVM pVM, VMCPUID idCpu, VMMR0OPERATION enmOperatio
             VMM_CHECK_SMAP_CHECK2(pVM, RT_NOTHING);
             break;
         }
+
+        case VMMR0_DO_GMM_FUSION_SCAN:
+            if (idCpu == NIL_VMCPUID)
+                return VERR_INVALID_CPU_ID;
+            if (    u64Arg > _1M
+                ||  pReqHdr)
+                return VERR_INVALID_PARAMETER;
+            rc = GMMR0FusionScan(pVM, &pVM->aCpus[idCpu], (uint32_t)u64Arg);
+            VMM_CHECK_SMAP_CHECK2(pVM, RT_NOTHING);
+            break;
 #endif
 
 #if defined(VBOX_STRICT) && HC_ARCH_BITS == 64
@@ -164,7 +164,11 @@ VMMR3_INT_DECL(int) DBGFR3Init(PVM pVM)
                             rc = dbgfR3PlugInInit(pUVM);
                             if (RT_SUCCESS(rc))
                             {
-                                return VINF_SUCCESS;
+                                rc = dbgfR3ProfilerInit(pVM);
+                                if (RT_SUCCESS(rc))
+                                    return VINF_SUCCESS;
+                                dbgfR3ProfilerTerm(pUVM);
+                                dbgfR3PlugInTerm(pUVM);
                             }
                             dbgfR3OSTerm(pUVM);
                         }
@@ -191,6 +195,7 @@ VMMR3_INT_DECL(int) DBGFR3Term(PVM pVM)
 {
     PUVM pUVM = pVM->pUVM;
 
+    dbgfR3ProfilerTerm(pUVM);
     dbgfR3PlugInTerm(pUVM);
     dbgfR3OSTerm(pUVM);
     dbgfR3AsTerm(pUVM);
@@ -209,6 +214,10 @@ VMMR3_INT_DECL(int) DBGFR3Term(PVM pVM)
  */
 VMMR3_INT_DECL(void) DBGFR3PowerOff(PVM pVM)
 {
+    /*
+     * Write the profile while the guest memory is still around for the OS digger.
+     */
+    dbgfR3ProfilerPowerOff(pVM);
 
     /*
      * Send a termination event to any attached debugger.
@@ -0,0 +1,1016 @@
+/* $Id$ */
+/** @file
+ * DBGF - Debugger Facility, Guest Sampling Profiler.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/** @page pg_dbgf_profiler  DBGF - The Guest Sampling Profiler
+ *
+ * The sampling profiler gives a rough picture of where the guest spends its
+ * time without requiring anything to be installed in the guest.  A sampler
+ * thread wakes up at a fixed frequency and pokes each running VCPU with a
+ * request.  The EMT then records the guest RIP, CR3 and CPU mode, and for
+ * kernel mode code also walks the frame pointer chain to get the callers.
+ *
+ * Identical stacks are counted in a hash table, so memory usage depends on the
+ * number of distinct stacks and not on the sampling duration.  Addresses are
+ * only resolved when dumping, using the kernel address space that the guest
+ * OS digger plugins (Linux, Windows NT, ...) populate with the kernel modules
+ * and their symbols.  Kernel frames are written as "module!symbol", user mode
+ * samples are only grouped by address space (CR3) since there are no user
+ * mode symbols to go by.
+ *
+ * The output is in the "folded stacks" format, one line per stack with the
+ * frames separated by semicolons, root first, and followed by the sample
+ * count.  It can be fed directly to flamegraph.pl.
+ *
+ * Sampling forces the VCPUs out to ring-3, so the frequency should be kept
+ * moderate (the default is 100 Hz).  The frame pointer walk is best effort,
+ * code compiled without frame pointers yields truncated or bogus callers.
+ *
+ * The profiler is controlled by DBGFR3ProfilerStart, DBGFR3ProfilerStop,
+ * DBGFR3ProfilerReset and DBGFR3ProfilerDumpFolded, or configured to run for
+ * the whole VM lifetime with the /DBGF/ProfilerFile CFGM key.  The 'profiler'
+ * info handler shows the status and the hottest functions.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_DBGF
+#include <VBox/vmm/dbgf.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/cpum.h>
+#include <VBox/vmm/mm.h>
+#include <VBox/vmm/pgm.h>
+#include "DBGFInternal.h"
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/uvm.h>
+
+#include <VBox/err.h>
+#include <VBox/log.h>
+
+#include <iprt/assert.h>
+#include <iprt/critsect.h>
+#include <iprt/dbg.h>
+#include <iprt/mem.h>
+#include <iprt/semaphore.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+#include <iprt/x86.h>
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The default sampling frequency (Hz). */
+#define DBGF_PROF_DEFAULT_HZ            100
+/** The max sampling frequency (Hz). */
+#define DBGF_PROF_MAX_HZ                1000
+/** The default number of frames to record. */
+#define DBGF_PROF_DEFAULT_DEPTH         16
+/** The max number of frames to record. */
+#define DBGF_PROF_MAX_DEPTH             64
+/** The default max number of distinct stacks. */
+#define DBGF_PROF_DEFAULT_MAX_STACKS    _64K
+/** The number of hash table buckets, power of two. */
+#define DBGF_PROF_HASH_SIZE             4096
+/** Frames further apart than this ends the frame pointer walk. */
+#define DBGF_PROF_MAX_FRAME_SIZE        _1M
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/**
+ * The CPU mode of a sample.
+ */
+typedef enum DBGFPROFMODE
+{
+    DBGFPROFMODE_REAL = 0,
+    DBGFPROFMODE_V86,
+    DBGFPROFMODE_KERNEL,
+    DBGFPROFMODE_USER,
+    DBGFPROFMODE_END
+} DBGFPROFMODE;
+
+/**
+ * A distinct sampled stack.
+ */
+typedef struct DBGFPROFSTACK
+{
+    /** The next stack in the hash bucket. */
+    struct DBGFPROFSTACK   *pNext;
+    /** The hash value. */
+    uint32_t                uHash;
+    /** The number of times this stack was sampled. */
+    uint32_t                cSamples;
+    /** The CPU mode (DBGFPROFMODE). */
+    uint8_t                 enmMode;
+    /** The number of frames in auFrames. */
+    uint8_t                 cFrames;
+    /** Alignment padding. */
+    uint8_t                 abAlignment[6];
+    /** The guest CR3 of user mode samples, zero otherwise. */
+    uint64_t                uCr3;
+    /** Flat code addresses, the sampled RIP followed by the return addresses.
+     * Variable size. */
+    uint64_t                auFrames[1];
+} DBGFPROFSTACK;
+/** Pointer to a sampled stack. */
+typedef DBGFPROFSTACK *PDBGFPROFSTACK;
+
+/**
+ * The sampling profiler instance data.
+ */
+typedef struct DBGFPROFILER
+{
+    /** Protects the hash table, the counters and the state. */
+    RTCRITSECT              CritSect;
+    /** Set while sampling. */
+    bool volatile           fRunning;
+    /** Tells the sampler thread to quit. */
+    bool volatile           fShutdown;
+    /** Alignment padding. */
+    bool                    afAlignment[2];
+    /** The sampling frequency (Hz). */
+    uint32_t                uHz;
+    /** The max number of frames to record. */
+    uint32_t                cMaxDepth;
+    /** The max number of distinct stacks. */
+    uint32_t                cMaxStacks;
+    /** The number of distinct stacks. */
+    uint32_t                cStacks;
+    /** The sampler thread. */
+    RTTHREAD                hThread;
+    /** Event semaphore for waking up the sampler thread. */
+    RTSEMEVENT              hEvt;
+    /** The file to dump the profile to at power off (/DBGF/ProfilerFile). */
+    char                   *pszFile;
+    /** The number of samples recorded. */
+    uint64_t                cSamples;
+    /** The number of times a VCPU was found halted. */
+    uint64_t volatile       cIdle;
+    /** The number of samples dropped because cMaxStacks was reached. */
+    uint64_t                cDropped;
+    /** The number of samples skipped because the previous request wasn't
+     * processed yet. */
+    uint64_t volatile       cBusy;
+    /** The RTTimeNanoTS when sampling started. */
+    uint64_t                u64StartNS;
+    /** Nanoseconds spent sampling in previous runs. */
+    uint64_t                cNsPrevRuns;
+    /** Per-VCPU flag indicating that a sample request is queued. */
+    bool volatile           afPending[VMM_MAX_CPU_COUNT];
+    /** The hash table. */
+    PDBGFPROFSTACK          apHash[DBGF_PROF_HASH_SIZE];
+} DBGFPROFILER;
+/** Pointer to the sampling profiler instance data. */
+typedef DBGFPROFILER *PDBGFPROFILER;
+
+/**
+ * A folded stack, as kept in the string space while dumping.
+ */
+typedef struct DBGFPROFFOLDED
+{
+    /** The string space core, the key is szStack. */
+    RTSTRSPACECORE          Core;
+    /** The number of samples. */
+    uint64_t                cSamples;
+    /** The folded stack (variable size). */
+    char                    szStack[1];
+} DBGFPROFFOLDED;
+/** Pointer to a folded stack. */
+typedef DBGFPROFFOLDED *PDBGFPROFFOLDED;
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** The names of the CPU modes, used as root frames. */
+static const char * const g_apszProfModes[DBGFPROFMODE_END] =
+{
+    "real",
+    "v86",
+    "kernel",
+    "user"
+};
+
+
+/*********************************************************************************************************************************
+*   Internal Functions                                                                                                           *
+*********************************************************************************************************************************/
+static DECLCALLBACK(void) dbgfR3ProfilerInfo(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
+
+
+/**
+ * Calculates the hash of a sample.
+ *
+ * @returns Hash value (FNV-1a).
+ * @param   enmMode     The CPU mode.
+ * @param   uCr3        The CR3 value.
+ * @param   pauFrames   The frames.
+ * @param   cFrames     The number of frames.
+ */
+static uint32_t dbgfR3ProfilerHash(DBGFPROFMODE enmMode, uint64_t uCr3, uint64_t const *pauFrames, uint32_t cFrames)
+{
+    uint32_t uHash = UINT32_C(2166136261);
+    uHash = (uHash ^ (uint32_t)enmMode) * UINT32_C(16777619);
+    uHash = (uHash ^ (uint32_t)(uCr3 >> 12)) * UINT32_C(16777619);
+    for (uint32_t i = 0; i < cFrames; i++)
+    {
+        uHash = (uHash ^ (uint32_t)pauFrames[i])         * UINT32_C(16777619);
+        uHash = (uHash ^ (uint32_t)(pauFrames[i] >> 32)) * UINT32_C(16777619);
+    }
+    return uHash;
+}
+
+
+/**
+ * Records a sample.
+ *
+ * @param   pProf       The profiler instance data.
+ * @param   enmMode     The CPU mode.
+ * @param   uCr3        The CR3 value, zero for kernel samples.
+ * @param   pauFrames   The frames.
+ * @param   cFrames     The number of frames.
+ */
+static void dbgfR3ProfilerAdd(PDBGFPROFILER pProf, DBGFPROFMODE enmMode, uint64_t uCr3, uint64_t const *pauFrames,
+                              uint32_t cFrames)
+{
+    uint32_t const uHash = dbgfR3ProfilerHash(enmMode, uCr3, pauFrames, cFrames);
+    RTCritSectEnter(&pProf->CritSect);
+    if (pProf->fRunning)
+    {
+        PDBGFPROFSTACK *ppHead = &pProf->apHash[uHash & (DBGF_PROF_HASH_SIZE - 1)];
+        PDBGFPROFSTACK  pStack = *ppHead;
+        while (   pStack
+               && (   pStack->uHash   != uHash
+                   || pStack->enmMode != enmMode
+                   || pStack->uCr3    != uCr3
+                   || pStack->cFrames != cFrames
+                   || memcmp(pStack->auFrames, pauFrames, cFrames * sizeof(pauFrames[0])) != 0))
+            pStack = pStack->pNext;
+
+        if (!pStack && pProf->cStacks < pProf->cMaxStacks)
+        {
+            pStack = (PDBGFPROFSTACK)RTMemAlloc(RT_OFFSETOF(DBGFPROFSTACK, auFrames) + cFrames * sizeof(pauFrames[0]));
+            if (pStack)
+            {
+                pStack->uHash    = uHash;
+                pStack->cSamples = 0;
+                pStack->enmMode  = (uint8_t)enmMode;
+                pStack->cFrames  = (uint8_t)cFrames;
+                pStack->uCr3     = uCr3;
+                memcpy(pStack->auFrames, pauFrames, cFrames * sizeof(pauFrames[0]));
+                pStack->pNext    = *ppHead;
+                *ppHead          = pStack;
+                pProf->cStacks++;
+            }
+        }
+
+        if (pStack)
+        {
+            pStack->cSamples++;
+            pProf->cSamples++;
+        }
+        else
+            pProf->cDropped++;
+    }
+    RTCritSectLeave(&pProf->CritSect);
+}
+
+
+/**
+ * Takes a sample of a VCPU, EMT worker.
+ *
+ * @param   pUVM        The user mode VM handle.
+ * @param   idCpu       The ID of the calling EMT.
+ */
+static DECLCALLBACK(void) dbgfR3ProfilerSampleOnEmt(PUVM pUVM, VMCPUID idCpu)
+{
+    PDBGFPROFILER pProf = pUVM->dbgf.s.pProfiler;
+    if (!pProf)
+        return;
+    ASMAtomicWriteBool(&pProf->afPending[idCpu], false);
+    if (!ASMAtomicReadBool(&pProf->fRunning))
+        return;
+
+    PVMCPU pVCpu = &pUVM->pVM->aCpus[idCpu];
+    VMCPU_ASSERT_EMT(pVCpu);
+    if (VMCPU_GET_STATE(pVCpu) == VMCPUSTATE_STARTED_HALTED)
+    {
+        ASMAtomicIncU64(&pProf->cIdle);
+        return;
+    }
+
+    /*
+     * The mode and the flat PC.
+     */
+    PCPUMCTX     pCtx = CPUMQueryGuestCtxPtr(pVCpu);
+    DBGFPROFMODE enmMode;
+    if (!(pCtx->cr0 & X86_CR0_PE))
+        enmMode = DBGFPROFMODE_REAL;
+    else if (pCtx->eflags.Bits.u1VM)
+        enmMode = DBGFPROFMODE_V86;
+    else if (CPUMGetGuestCPL(pVCpu) == 0)
+        enmMode = DBGFPROFMODE_KERNEL;
+    else
+        enmMode = DBGFPROFMODE_USER;
+
+    bool const fIs64Bit = CPUMIsGuestIn64BitCode(pVCpu);
+    uint64_t   auFrames[DBGF_PROF_MAX_DEPTH];
+    uint32_t   cFrames  = 0;
+    if (fIs64Bit)
+        auFrames[cFrames++] = pCtx->rip;
+    else
+        auFrames[cFrames++] = (uint32_t)(pCtx->cs.u64Base + pCtx->eip);
+
+    /*
+     * Walk the frame pointer chain of kernel code.  Assumes a flat stack
+     * segment, which is what any OS we've got a digger for uses.
+     */
+    if (enmMode == DBGFPROFMODE_KERNEL)
+    {
+        uint32_t const cbPtr = fIs64Bit ? sizeof(uint64_t) : sizeof(uint32_t);
+        uint64_t       uFp   = fIs64Bit ? pCtx->rbp : pCtx->ebp;
+        while (   cFrames < pProf->cMaxDepth
+               && uFp
+               && !(uFp & (cbPtr - 1)))
+        {
+            uint64_t uSavedFp;
+            uint64_t uRet;
+            if (fIs64Bit)
+            {
+                uint64_t au64[2];
+                if (RT_FAILURE(PGMPhysSimpleReadGCPtr(pVCpu, au64, uFp, sizeof(au64))))
+                    break;
+                uSavedFp = au64[0];
+                uRet     = au64[1];
+            }
+            else
+            {
+                uint32_t au32[2];
+                if (RT_FAILURE(PGMPhysSimpleReadGCPtr(pVCpu, au32, uFp, sizeof(au32))))
+                    break;
+                uSavedFp = au32[0];
+                uRet     = au32[1];
+            }
+            if (!uRet)
+                break;
+            auFrames[cFrames++] = uRet;
+            if (uSavedFp <= uFp || uSavedFp - uFp > DBGF_PROF_MAX_FRAME_SIZE)
+                break;
+            uFp = uSavedFp;
+        }
+    }
+
+    dbgfR3ProfilerAdd(pProf, enmMode, enmMode == DBGFPROFMODE_USER ? pCtx->cr3 & X86_CR3_PAGE_MASK : 0, auFrames, cFrames);
+}
+
+
+/**
+ * @callback_method_impl{FNRTTHREAD, The sampler thread.}
+ */
+static DECLCALLBACK(int) dbgfR3ProfilerThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PUVM          pUVM  = (PUVM)pvUser;
+    PDBGFPROFILER pProf = pUVM->dbgf.s.pProfiler;
+    RTMSINTERVAL  cMillies = RT_MAX(1000 / pProf->uHz, 1);
+    while (!ASMAtomicReadBool(&pProf->fShutdown))
+    {
+        RTSemEventWait(pProf->hEvt, cMillies);
+        if (ASMAtomicReadBool(&pProf->fShutdown))
+            break;
+
+        VMSTATE enmState = VMR3GetStateU(pUVM);
+        if (enmState != VMSTATE_RUNNING && enmState != VMSTATE_RUNNING_LS)
+            continue;
+
+        PVM pVM = pUVM->pVM;
+        for (VMCPUID idCpu = 0; idCpu < pUVM->cCpus; idCpu++)
+        {
+            if (VMCPU_GET_STATE(&pVM->aCpus[idCpu]) == VMCPUSTATE_STARTED_HALTED)
+                ASMAtomicIncU64(&pProf->cIdle);
+            else if (ASMAtomicXchgBool(&pProf->afPending[idCpu], true))
+                ASMAtomicIncU64(&pProf->cBusy);
+            else
+            {
+                int rc = VMR3ReqCallU(pUVM, idCpu, NULL /*ppReq*/, 0 /*cMillies*/,
+                                      VMREQFLAGS_VOID | VMREQFLAGS_NO_WAIT | VMREQFLAGS_POKE,
+                                      (PFNRT)dbgfR3ProfilerSampleOnEmt, 2, pUVM, idCpu);
+                if (RT_FAILURE(rc))
+                    ASMAtomicWriteBool(&pProf->afPending[idCpu], false);
+            }
+        }
+    }
+    NOREF(hThreadSelf);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Frees all the recorded stacks.
+ *
+ * @param   pProf       The profiler instance data.  Caller owns the lock.
+ */
+static void dbgfR3ProfilerFreeStacks(PDBGFPROFILER pProf)
+{
+    for (unsigned i = 0; i < RT_ELEMENTS(pProf->apHash); i++)
+    {
+        PDBGFPROFSTACK pStack = pProf->apHash[i];
+        pProf->apHash[i] = NULL;
+        while (pStack)
+        {
+            PDBGFPROFSTACK pNext = pStack->pNext;
+            RTMemFree(pStack);
+            pStack = pNext;
+        }
+    }
+    pProf->cStacks  = 0;
+    pProf->cSamples = 0;
+    pProf->cDropped = 0;
+    ASMAtomicWriteU64(&pProf->cIdle, 0);
+    ASMAtomicWriteU64(&pProf->cBusy, 0);
+}
+
+
+/**
+ * Converts a frame to a name for the folded output.
+ *
+ * @param   hAsKernel   The kernel address space, NIL_RTDBGAS if not available.
+ * @param   enmMode     The CPU mode of the sample.
+ * @param   uAddr       The flat code address.
+ * @param   pszBuf      The output buffer.
+ * @param   cbBuf       The size of the output buffer.
+ */
+static void dbgfR3ProfilerFrameName(RTDBGAS hAsKernel, DBGFPROFMODE enmMode, uint64_t uAddr, char *pszBuf, size_t cbBuf)
+{
+    if (enmMode == DBGFPROFMODE_KERNEL && hAsKernel != NIL_RTDBGAS)
+    {
+        RTDBGSYMBOL Symbol;
+        RTINTPTR    offDisp;
+        RTDBGMOD    hMod = NIL_RTDBGMOD;
+        int rc = RTDbgAsSymbolByAddr(hAsKernel, uAddr, RTDBGSYMADDR_FLAGS_LESS_OR_EQUAL, &offDisp, &Symbol, &hMod);
+        if (RT_SUCCESS(rc))
+            RTStrPrintf(pszBuf, cbBuf, "%s!%s", hMod != NIL_RTDBGMOD ? RTDbgModName(hMod) : "?", Symbol.szName);
+        else
+        {
+            RTUINTPTR   uModAddr;
+            RTDBGSEGIDX iSeg;
+            rc = RTDbgAsModuleByAddr(hAsKernel, uAddr, &hMod, &uModAddr, &iSeg);
+            if (RT_SUCCESS(rc))
+                RTStrPrintf(pszBuf, cbBuf, "%s!?", RTDbgModName(hMod));
+        }
+        if (hMod != NIL_RTDBGMOD)
+            RTDbgModRelease(hMod);
+        if (RT_SUCCESS(rc))
+        {
+            /* Semicolons separate the frames in the output, spaces the count. */
+            for (char *psz = pszBuf; *psz; psz++)
+                if (*psz == ';' || *psz == ' ')
+                    *psz = '_';
+            return;
+        }
+    }
+    RTStrCopy(pszBuf, cbBuf, "[unknown]");
+}
+
+
+/**
+ * @callback_method_impl{FNRTSTRSPACECALLBACK, Frees a folded stack.}
+ */
+static DECLCALLBACK(int) dbgfR3ProfilerFoldedFree(PRTSTRSPACECORE pStr, void *pvUser)
+{
+    RTMemFree(pStr);
+    NOREF(pvUser);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Folds the recorded stacks, resolving the addresses.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   pProf       The profiler instance data.
+ * @param   fLeafOnly   Only include the mode and the sampled frame.
+ * @param   pStrSpace   The string space to add the folded stacks to.  Free
+ *                      with RTStrSpaceDestroy + dbgfR3ProfilerFoldedFree.
+ * @param   pcSamples   Where to return the total number of samples.
+ */
+static int dbgfR3ProfilerFold(PUVM pUVM, PDBGFPROFILER pProf, bool fLeafOnly, PRTSTRSPACE pStrSpace, uint64_t *pcSamples)
+{
+    /*
+     * Take a copy of the stacks so the EMTs aren't blocked while resolving.
+     */
+    RTCritSectEnter(&pProf->CritSect);
+    uint32_t const  cStacks  = pProf->cStacks;
+    PDBGFPROFSTACK *papStacks = (PDBGFPROFSTACK *)RTMemAllocZ(RT_MAX(cStacks, 1) * sizeof(papStacks[0]));
+    uint32_t        iStack    = 0;
+    if (papStacks)
+        for (unsigned i = 0; i < RT_ELEMENTS(pProf->apHash); i++)
+            for (PDBGFPROFSTACK pStack = pProf->apHash[i]; pStack && iStack < cStacks; pStack = pStack->pNext)
+            {
+                papStacks[iStack] = (PDBGFPROFSTACK)RTMemDup(pStack, RT_OFFSETOF(DBGFPROFSTACK, auFrames)
+                                                                     + pStack->cFrames * sizeof(pStack->auFrames[0]));
+                if (!papStacks[iStack])
+                    break;
+                iStack++;
+            }
+    RTCritSectLeave(&pProf->CritSect);
+
+    int rc = papStacks && iStack == cStacks ? VINF_SUCCESS : VERR_NO_MEMORY;
+    *pcSamples = 0;
+
+    /*
+     * Fold them.
+     */
+    RTDBGAS  hAsKernel = DBGFR3AsResolveAndRetain(pUVM, DBGF_AS_KERNEL);
+    size_t   cbFolded  = _4K;
+    char    *pszFolded = (char *)RTMemAlloc(cbFolded);
+    if (!pszFolded)
+        rc = VERR_NO_MEMORY;
+    for (uint32_t i = 0; i < iStack && RT_SUCCESS(rc); i++)
+    {
+        PDBGFPROFSTACK     pStack  = papStacks[i];
+        DBGFPROFMODE const enmMode = (DBGFPROFMODE)pStack->enmMode;
+        size_t             off     = RTStrPrintf(pszFolded, cbFolded, "%s", g_apszProfModes[enmMode]);
+        if (enmMode == DBGFPROFMODE_USER)
+            off += RTStrPrintf(&pszFolded[off], cbFolded - off, ";cr3=%#RX64", pStack->uCr3);
+
+        for (uint32_t iFrame = fLeafOnly ? 1 : pStack->cFrames; iFrame > 0; iFrame--)
+        {
+            char szFrame[RTDBG_SYMBOL_NAME_LENGTH + 64];
+            dbgfR3ProfilerFrameName(hAsKernel, enmMode, pStack->auFrames[iFrame - 1], szFrame, sizeof(szFrame));
+
+            /* Grow the buffer rather than truncating the stack. */
+            size_t const cchFrame = strlen(szFrame);
+            if (off + 1 + cchFrame + 1 > cbFolded)
+            {
+                size_t const cbNew = RT_MAX(cbFolded * 2, off + 1 + cchFrame + 1);
+                char *pszNew = (char *)RTMemRealloc(pszFolded, cbNew);
+                if (!pszNew)
+                {
+                    rc = VERR_NO_MEMORY;
+                    break;
+                }
+                pszFolded = pszNew;
+                cbFolded  = cbNew;
+            }
+            pszFolded[off++] = ';';
+            memcpy(&pszFolded[off], szFrame, cchFrame + 1);
+            off += cchFrame;
+        }
+        if (RT_FAILURE(rc))
+            break;
+
+        PDBGFPROFFOLDED pFolded = (PDBGFPROFFOLDED)RTStrSpaceGet(pStrSpace, pszFolded);
+        if (!pFolded)
+        {
+            pFolded = (PDBGFPROFFOLDED)RTMemAllocZ(RT_OFFSETOF(DBGFPROFFOLDED, szStack) + off + 1);
+            if (!pFolded)
+            {
+                rc = VERR_NO_MEMORY;
+                break;
+            }
+            memcpy(pFolded->szStack, pszFolded, off + 1);
+            pFolded->Core.pszString = pFolded->szStack;
+            RTStrSpaceInsert(pStrSpace, &pFolded->Core);
+        }
+        pFolded->cSamples += pStack->cSamples;
+        *pcSamples        += pStack->cSamples;
+    }
+    RTMemFree(pszFolded);
+    if (hAsKernel != NIL_RTDBGAS)
+        RTDbgAsRelease(hAsKernel);
+
+    if (papStacks)
+    {
+        for (uint32_t i = 0; i < iStack; i++)
+            RTMemFree(papStacks[i]);
+        RTMemFree(papStacks);
+    }
+    return rc;
+}
+
+
+/**
+ * Makes sure a guest OS digger had a go at the guest so we've got kernel
+ * symbols to resolve the addresses with.
+ *
+ * @param   pUVM        The user mode VM handle.
+ */
+static void dbgfR3ProfilerDetectOS(PUVM pUVM)
+{
+    char szName[64];
+    int rc = DBGFR3OSQueryNameAndVersion(pUVM, szName, sizeof(szName), NULL, 0);
+    if (RT_FAILURE(rc))
+        rc = DBGFR3OSDetect(pUVM, szName, sizeof(szName));
+    if (rc == VINF_SUCCESS)
+        LogRel(("DBGF: Profiler resolving symbols with the '%s' guest OS digger\n", szName));
+}
+
+
+/**
+ * Initializes the sampling profiler.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ */
+int dbgfR3ProfilerInit(PVM pVM)
+{
+    PUVM pUVM = pVM->pUVM;
+    PDBGFPROFILER pProf = (PDBGFPROFILER)RTMemAllocZ(sizeof(*pProf));
+    if (!pProf)
+        return VERR_NO_MEMORY;
+    pProf->hThread = NIL_RTTHREAD;
+    int rc = RTCritSectInit(&pProf->CritSect);
+    if (RT_SUCCESS(rc))
+    {
+        rc = RTSemEventCreate(&pProf->hEvt);
+        if (RT_FAILURE(rc))
+            RTCritSectDelete(&pProf->CritSect);
+    }
+    if (RT_FAILURE(rc))
+    {
+        RTMemFree(pProf);
+        return rc;
+    }
+    pUVM->dbgf.s.pProfiler = pProf;
+
+    rc = DBGFR3InfoRegisterInternal(pVM, "profiler",
+                                    "Display the sampling profiler status and the hottest guest functions. "
+                                    "Optional argument: the number of functions to show (default 20).",
+                                    dbgfR3ProfilerInfo);
+    AssertRCReturn(rc, rc);
+
+    PCFGMNODE pDbgfNode = CFGMR3GetChild(CFGMR3GetRoot(pVM), "DBGF");
+
+    /** @cfgm{/DBGF/ProfilerMaxStacks, uint32_t, 65536}
+     * The max number of distinct stacks the sampling profiler keeps track of.
+     * Samples of new stacks are dropped when reached. */
+    rc = CFGMR3QueryU32Def(pDbgfNode, "ProfilerMaxStacks", &pProf->cMaxStacks, DBGF_PROF_DEFAULT_MAX_STACKS);
+    AssertLogRelRCReturn(rc, rc);
+
+    /** @cfgm{/DBGF/ProfilerFile, string, none}
+     * Start the sampling profiler right away and write the folded stacks to
+     * this file when the VM is powered off. */
+    rc = CFGMR3QueryStringAlloc(pDbgfNode, "ProfilerFile", &pProf->pszFile);
+    if (RT_SUCCESS(rc))
+    {
+        /** @cfgm{/DBGF/ProfilerHz, uint32_t, 100, 1, 1000}
+         * The sampling frequency when started via /DBGF/ProfilerFile. */
+        uint32_t uHz;
+        rc = CFGMR3QueryU32Def(pDbgfNode, "ProfilerHz", &uHz, DBGF_PROF_DEFAULT_HZ);
+        AssertLogRelRCReturn(rc, rc);
+
+        /** @cfgm{/DBGF/ProfilerDepth, uint32_t, 16, 1, 64}
+         * The number of frames to record when started via /DBGF/ProfilerFile,
+         * 1 means just the sampled RIP. */
+        uint32_t cMaxDepth;
+        rc = CFGMR3QueryU32Def(pDbgfNode, "ProfilerDepth", &cMaxDepth, DBGF_PROF_DEFAULT_DEPTH);
+        AssertLogRelRCReturn(rc, rc);
+
+        rc = DBGFR3ProfilerStart(pUVM, uHz, cMaxDepth);
+        if (RT_FAILURE(rc))
+            return VMSetError(pVM, rc, RT_SRC_POS, "Failed to start the sampling profiler (%u Hz, depth %u): %Rrc",
+                              uHz, cMaxDepth, rc);
+    }
+    else if (rc == VERR_CFGM_VALUE_NOT_FOUND || rc == VERR_CFGM_NO_PARENT)
+        rc = VINF_SUCCESS;
+    return rc;
+}
+
+
+/**
+ * Writes the profile to the /DBGF/ProfilerFile file, if configured.
+ *
+ * Called on EMT(0) at power off while the guest memory is still around for the
+ * OS digger.
+ *
+ * @param   pVM         The cross context VM structure.
+ */
+void dbgfR3ProfilerPowerOff(PVM pVM)
+{
+    PUVM          pUVM  = pVM->pUVM;
+    PDBGFPROFILER pProf = pUVM->dbgf.s.pProfiler;
+    if (!pProf || !pProf->pszFile)
+        return;
+
+    DBGFR3ProfilerStop(pUVM);
+    int rc = DBGFR3ProfilerDumpFolded(pUVM, pProf->pszFile);
+    if (RT_SUCCESS(rc))
+        LogRel(("DBGF: Wrote %'llu profiler samples to '%s'\n", pProf->cSamples, pProf->pszFile));
+    else
+        LogRel(("DBGF: Failed to write the profiler samples to '%s': %Rrc\n", pProf->pszFile, rc));
+}
+
+
+/**
+ * Terminates the sampling profiler.
+ *
+ * @param   pUVM        The user mode VM handle.
+ */
+void dbgfR3ProfilerTerm(PUVM pUVM)
+{
+    PDBGFPROFILER pProf = pUVM->dbgf.s.pProfiler;
+    if (!pProf)
+        return;
+
+    DBGFR3ProfilerStop(pUVM);
+    pUVM->dbgf.s.pProfiler = NULL;
+
+    dbgfR3ProfilerFreeStacks(pProf);
+    RTSemEventDestroy(pProf->hEvt);
+    RTCritSectDelete(&pProf->CritSect);
+    MMR3HeapFree(pProf->pszFile);
+    RTMemFree(pProf);
+}
+
+
+/**
+ * Starts the guest sampling profiler.
+ *
+ * Samples are added to the ones already recorded, use DBGFR3ProfilerReset to
+ * start over.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_ALREADY_EXISTS if already running.
+ *
+ * @param   pUVM        The user mode VM handle.
+ * @param   uHz         The sampling frequency, 0 for the default (100 Hz).
+ *                      Max 1000 Hz.
+ * @param   cMaxDepth   The max number of frames to record per sample, 0 for
+ *                      the default (16).  1 means just the sampled RIP.  Max
+ *                      64.
+ * @thread  Any.
+ */
+VMMR3DECL(int) DBGFR3ProfilerStart(PUVM pUVM, uint32_t uHz, uint32_t cMaxDepth)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PDBGFPROFILER pProf = pUVM->dbgf.s.pProfiler;
+    AssertReturn(pProf, VERR_WRONG_ORDER);
+    if (!uHz)
+        uHz = DBGF_PROF_DEFAULT_HZ;
+    AssertMsgReturn(uHz <= DBGF_PROF_MAX_HZ, ("%u\n", uHz), VERR_OUT_OF_RANGE);
+    if (!cMaxDepth)
+        cMaxDepth = DBGF_PROF_DEFAULT_DEPTH;
+    AssertMsgReturn(cMaxDepth <= DBGF_PROF_MAX_DEPTH, ("%u\n", cMaxDepth), VERR_OUT_OF_RANGE);
+
+    RTCritSectEnter(&pProf->CritSect);
+    int rc = VINF_SUCCESS;
+    if (   !pProf->fRunning
+        && pProf->hThread == NIL_RTTHREAD)
+    {
+        pProf->uHz        = uHz;
+        pProf->cMaxDepth  = cMaxDepth;
+        pProf->fShutdown  = false;
+        pProf->fRunning   = true;
+        pProf->u64StartNS = RTTimeNanoTS();
+        rc = RTThreadCreate(&pProf->hThread, dbgfR3ProfilerThread, pUVM, 0, RTTHREADTYPE_DEBUGGER,
+                            RTTHREADFLAGS_WAITABLE, "DbgfProf");
+        if (RT_SUCCESS(rc))
+            LogRel(("DBGF: Sampling profiler started, %u Hz, depth %u\n", uHz, cMaxDepth));
+        else
+        {
+            pProf->hThread  = NIL_RTTHREAD;
+            pProf->fRunning = false;
+        }
+    }
+    else
+        rc = VERR_ALREADY_EXISTS;
+    RTCritSectLeave(&pProf->CritSect);
+    return rc;
+}
+
+
+/**
+ * Stops the guest sampling profiler.
+ *
+ * The recorded samples are kept.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @thread  Any.
+ */
+VMMR3DECL(int) DBGFR3ProfilerStop(PUVM pUVM)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PDBGFPROFILER pProf = pUVM->dbgf.s.pProfiler;
+    AssertReturn(pProf, VERR_WRONG_ORDER);
+
+    RTCritSectEnter(&pProf->CritSect);
+    RTTHREAD hThread = pProf->hThread;
+    pProf->hThread = NIL_RTTHREAD;
+    if (pProf->fRunning)
+    {
+        pProf->fRunning     = false;
+        pProf->cNsPrevRuns += RTTimeNanoTS() - pProf->u64StartNS;
+    }
+    ASMAtomicWriteBool(&pProf->fShutdown, true);
+    RTCritSectLeave(&pProf->CritSect);
+
+    int rc = VINF_SUCCESS;
+    if (hThread != NIL_RTTHREAD)
+    {
+        RTSemEventSignal(pProf->hEvt);
+        rc = RTThreadWait(hThread, 30000, NULL);
+        AssertLogRelRC(rc);
+        LogRel(("DBGF: Sampling profiler stopped, %'llu samples in %u stacks, %'llu dropped\n",
+                pProf->cSamples, pProf->cStacks, pProf->cDropped));
+    }
+    return rc;
+}
+
+
+/**
+ * Discards the samples recorded by the guest sampling profiler.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @thread  Any.
+ */
+VMMR3DECL(int) DBGFR3ProfilerReset(PUVM pUVM)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PDBGFPROFILER pProf = pUVM->dbgf.s.pProfiler;
+    AssertReturn(pProf, VERR_WRONG_ORDER);
+
+    RTCritSectEnter(&pProf->CritSect);
+    dbgfR3ProfilerFreeStacks(pProf);
+    pProf->cNsPrevRuns = 0;
+    pProf->u64StartNS  = RTTimeNanoTS();
+    RTCritSectLeave(&pProf->CritSect);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNRTSTRSPACECALLBACK, Writes a folded stack.}
+ */
+static DECLCALLBACK(int) dbgfR3ProfilerFoldedWrite(PRTSTRSPACECORE pStr, void *pvUser)
+{
+    PDBGFPROFFOLDED pFolded = (PDBGFPROFFOLDED)pStr;
+    return RTStrmPrintf((PRTSTREAM)pvUser, "%s %RU64\n", pFolded->szStack, pFolded->cSamples) >= 0
+         ? VINF_SUCCESS : VERR_WRITE_ERROR;
+}
+
+
+/**
+ * Writes the samples recorded by the guest sampling profiler to a file in the
+ * folded stacks format, suitable for flamegraph.pl.
+ *
+ * Kernel addresses are resolved using the guest OS digger, which is run if
+ * not done already.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   pszFilename The output file.  Replaced if it exists.
+ * @thread  Any, but not while holding locks an EMT might need.
+ */
+VMMR3DECL(int) DBGFR3ProfilerDumpFolded(PUVM pUVM, const char *pszFilename)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pszFilename, VERR_INVALID_POINTER);
+    PDBGFPROFILER pProf = pUVM->dbgf.s.pProfiler;
+    AssertReturn(pProf, VERR_WRONG_ORDER);
+
+    dbgfR3ProfilerDetectOS(pUVM);
+
+    RTSTRSPACE StrSpace = NULL;
+    uint64_t   cSamples;
+    int rc = dbgfR3ProfilerFold(pUVM, pProf, false /*fLeafOnly*/, &StrSpace, &cSamples);
+    if (RT_SUCCESS(rc))
+    {
+        PRTSTREAM pStrm;
+        rc = RTStrmOpen(pszFilename, "w", &pStrm);
+        if (RT_SUCCESS(rc))
+        {
+            rc = RTStrSpaceEnumerate(&StrSpace, dbgfR3ProfilerFoldedWrite, pStrm);
+            int rc2 = RTStrmClose(pStrm);
+            if (RT_SUCCESS(rc))
+                rc = rc2;
+        }
+    }
+    RTStrSpaceDestroy(&StrSpace, dbgfR3ProfilerFoldedFree, NULL);
+    return rc;
+}
+
+
+/**
+ * Argument package for dbgfR3ProfilerInfoCollect.
+ */
+typedef struct DBGFPROFINFOCOLLECT
+{
+    /** The array of folded leaf stacks. */
+    PDBGFPROFFOLDED    *papFolded;
+    /** The number of entries in papFolded. */
+    uint32_t            cFolded;
+    /** The size of papFolded. */
+    uint32_t            cMax;
+} DBGFPROFINFOCOLLECT;
+
+
+/**
+ * @callback_method_impl{FNRTSTRSPACECALLBACK, Collects the folded leaf stacks.}
+ */
+static DECLCALLBACK(int) dbgfR3ProfilerInfoCollect(PRTSTRSPACECORE pStr, void *pvUser)
+{
+    DBGFPROFINFOCOLLECT *pArgs = (DBGFPROFINFOCOLLECT *)pvUser;
+    if (pArgs->cFolded < pArgs->cMax)
+        pArgs->papFolded[pArgs->cFolded++] = (PDBGFPROFFOLDED)pStr;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNDBGFHANDLERINT, The 'profiler' info handler.}
+ */
+static DECLCALLBACK(void) dbgfR3ProfilerInfo(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs)
+{
+    PUVM          pUVM  = pVM->pUVM;
+    PDBGFPROFILER pProf = pUVM->dbgf.s.pProfiler;
+    if (!pProf)
+        return;
+
+    uint32_t cTop = 20;
+    if (pszArgs)
+        pszArgs = RTStrStripL(pszArgs);
+    if (pszArgs && *pszArgs)
+    {
+        int rc = RTStrToUInt32Ex(pszArgs, NULL, 0, &cTop);
+        if (rc != VINF_SUCCESS && rc != VWRN_TRAILING_SPACES)
+        {
+            pHlp->pfnPrintf(pHlp, "Invalid function count '%s'.\n", pszArgs);
+            return;
+        }
+    }
+
+    RTCritSectEnter(&pProf->CritSect);
+    bool const     fRunning = pProf->fRunning;
+    uint64_t const cNsTotal = pProf->cNsPrevRuns + (fRunning ? RTTimeNanoTS() - pProf->u64StartNS : 0);
+    pHlp->pfnPrintf(pHlp,
+                    "Sampling profiler: %s, %u Hz, depth %u, %RU64 ms sampled\n"
+                    "  %'RU64 samples in %u stacks (max %u), %'RU64 dropped, %'RU64 idle, %'RU64 busy\n",
+                    fRunning ? "running" : "stopped", pProf->uHz, pProf->cMaxDepth, cNsTotal / RT_NS_1MS,
+                    pProf->cSamples, pProf->cStacks, pProf->cMaxStacks, pProf->cDropped,
+                    ASMAtomicReadU64(&pProf->cIdle), ASMAtomicReadU64(&pProf->cBusy));
+    uint32_t const cStacks = pProf->cStacks;
+    RTCritSectLeave(&pProf->CritSect);
+    if (!cStacks || !cTop)
+        return;
+
+    /*
+     * Fold the leaf frames and sort them by sample count.
+     */
+    RTSTRSPACE StrSpace = NULL;
+    uint64_t   cSamples = 0;
+    int rc = dbgfR3ProfilerFold(pUVM, pProf, true /*fLeafOnly*/, &StrSpace, &cSamples);
+    DBGFPROFINFOCOLLECT Args;
+    Args.cFolded   = 0;
+    Args.cMax      = cStacks;
+    Args.papFolded = (PDBGFPROFFOLDED *)RTMemAlloc(cStacks * sizeof(Args.papFolded[0]));
+    if (RT_SUCCESS(rc) && Args.papFolded && cSamples)
+    {
+        RTStrSpaceEnumerate(&StrSpace, dbgfR3ProfilerInfoCollect, &Args);
+        for (uint32_t i = 1; i < Args.cFolded; i++)
+        {
+            PDBGFPROFFOLDED pTmp = Args.papFolded[i];
+            uint32_t        j    = i;
+            while (j > 0 && Args.papFolded[j - 1]->cSamples < pTmp->cSamples)
+            {
+                Args.papFolded[j] = Args.papFolded[j - 1];
+                j--;
+            }
+            Args.papFolded[j] = pTmp;
+        }
+
+        pHlp->pfnPrintf(pHlp, "%12s %6s  %s\n", "Samples", "%", "Mode;Function");
+        for (uint32_t i = 0; i < Args.cFolded && i < cTop; i++)
+            pHlp->pfnPrintf(pHlp, "%12RU64 %3RU64.%RU64  %s\n",
+                            Args.papFolded[i]->cSamples,
+                            Args.papFolded[i]->cSamples * 100 / cSamples,
+                            Args.papFolded[i]->cSamples * 1000 / cSamples % 10,
+                            Args.papFolded[i]->szStack);
+    }
+    else if (RT_FAILURE(rc) || !Args.papFolded)
+        pHlp->pfnPrintf(pHlp, "Failed to fold the samples: %Rrc\n", RT_FAILURE(rc) ? rc : VERR_NO_MEMORY);
+    RTMemFree(Args.papFolded);
+    RTStrSpaceDestroy(&StrSpace, dbgfR3ProfilerFoldedFree, NULL);
+}
+
@@ -24,8 +24,11 @@
 #include <VBox/vmm/cfgm.h>
 #include <VBox/vmm/mm.h>
 #include <VBox/vmm/pdmapi.h>
+#include <VBox/sup.h>
 #include "DBGFInternal.h"
+#include "DBGFTraceRing.h"
 #include <VBox/vmm/vm.h>
+#include <VBox/vmm/uvm.h>
 #include "VMMTracing.h"
 
 #include <VBox/err.h>
@@ -34,13 +37,33 @@
 
 #include <iprt/assert.h>
 #include <iprt/ctype.h>
+#include <iprt/file.h>
+#include <iprt/mem.h>
+#include <iprt/semaphore.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
 #include <iprt/trace.h>
 
 
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The default number of records in each binary trace ring. */
+#define DBGF_TRACE_BIN_ENTRIES_DEFAULT      8192
+/** How often the stream writer drains the binary trace rings (ms). */
+#define DBGF_TRACE_BIN_FLUSH_INTERVAL       20
+/** The number of records the binary trace file writers copy at a time. */
+#define DBGF_TRACE_BIN_CHUNK_RECS           512
+
+
 /*********************************************************************************************************************************
 *   Internal Functions                                                                                                           *
 *********************************************************************************************************************************/
 static DECLCALLBACK(void) dbgfR3TraceInfo(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
+static DECLCALLBACK(void) dbgfR3TraceBinInfo(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
+static int                dbgfR3TraceBinInit(PVM pVM, PCFGMNODE pDbgfNode);
+static void               dbgfR3TraceBinTerm(PVM pVM);
 
 
 /*********************************************************************************************************************************
@@ -193,6 +216,12 @@ int dbgfR3TraceInit(PVM pVM)
     if (RT_SUCCESS(rc))
         rc = DBGFR3InfoRegisterInternal(pVM, "tracebuf", "Display the trace buffer content. No arguments.", dbgfR3TraceInfo);
 
+    /*
+     * The binary tracing is configured separately.
+     */
+    if (RT_SUCCESS(rc))
+        rc = dbgfR3TraceBinInit(pVM, pDbgfNode);
+
     return rc;
 }
 
@@ -204,8 +233,7 @@ int dbgfR3TraceInit(PVM pVM)
  */
 void dbgfR3TraceTerm(PVM pVM)
 {
-    /* nothing to do */
-    NOREF(pVM);
+    dbgfR3TraceBinTerm(pVM);
 }
 
 
@@ -218,6 +246,13 @@ void dbgfR3TraceRelocate(PVM pVM)
 {
     if (pVM->hTraceBufR3 != NIL_RTTRACEBUF)
         pVM->hTraceBufRC = MMHyperCCToRC(pVM, pVM->hTraceBufR3);
+
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+    {
+        PVMCPU pVCpu = &pVM->aCpus[idCpu];
+        if (pVCpu->dbgf.s.pTraceRingR3)
+            pVCpu->dbgf.s.pTraceRingRC = MMHyperR3ToRC(pVM, pVCpu->dbgf.s.pTraceRingR3);
+    }
 }
 
 
@@ -447,3 +482,434 @@ static DECLCALLBACK(void) dbgfR3TraceInfo(PVM pVM, PCDBGFINFOHLP pHlp, const cha
     NOREF(pszArgs);
 }
 
+
+
+/*
+ *
+ * Binary tracing.
+ *
+ */
+
+
+/**
+ * Gets a binary trace ring by index.
+ *
+ * @returns Pointer to the ring, NULL if not enabled.
+ * @param   pVM         The cross context VM structure.
+ * @param   iRing       The ring index, the CPU ID or cCpus for the ring used
+ *                      by other threads.
+ */
+static PDBGFTRACERING dbgfR3TraceBinGetRing(PVM pVM, uint32_t iRing)
+{
+    if (iRing < pVM->cCpus)
+        return pVM->aCpus[iRing].dbgf.s.pTraceRingR3;
+    Assert(iRing == pVM->cCpus);
+    return pVM->pUVM->dbgf.s.pTraceRingOther;
+}
+
+
+/**
+ * Writes the header of a binary trace file.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ * @param   hFile       The file.
+ */
+static int dbgfR3TraceBinWriteHdr(PVM pVM, RTFILE hFile)
+{
+    DBGFTRACEFILEHDR Hdr;
+    RT_ZERO(Hdr);
+    memcpy(Hdr.szMagic, DBGFTRACEFILEHDR_MAGIC, sizeof(DBGFTRACEFILEHDR_MAGIC));
+    Hdr.uVersion    = DBGFTRACEFILEHDR_VERSION;
+    Hdr.cbHdr       = sizeof(Hdr);
+    Hdr.cbRecord    = sizeof(DBGFTRACEREC);
+    Hdr.cCpus       = pVM->cCpus;
+    Hdr.u64TscHz    = g_pSUPGlobalInfoPage ? SUPGetCpuHzFromGip(g_pSUPGlobalInfoPage) : 0;
+    Hdr.u64TscStart = ASMReadTSC();
+    RTTIMESPEC Now;
+    Hdr.i64UnixNanoStart = RTTimeSpecGetNano(RTTimeNow(&Now));
+    return RTFileWrite(hFile, &Hdr, sizeof(Hdr), NULL);
+}
+
+
+/**
+ * Writes the records of a binary trace ring to a file.
+ *
+ * @returns VBox status code.
+ * @param   hFile       The file.
+ * @param   idCpu       The CPU ID for the chunk headers.
+ * @param   pRing       The ring.
+ * @param   pidxRead    The read position.  Input and output.
+ * @param   idxEnd      Where to stop, UINT64_MAX for reading all there is.
+ * @param   paRecs      Record buffer, DBGF_TRACE_BIN_CHUNK_RECS entries.
+ * @param   pcLost      Where to add the number of lost records.
+ */
+static int dbgfR3TraceBinWriteRing(RTFILE hFile, VMCPUID idCpu, PDBGFTRACERING pRing, uint64_t *pidxRead, uint64_t idxEnd,
+                                   PDBGFTRACEREC paRecs, uint64_t *pcLost)
+{
+    while (*pidxRead < idxEnd)
+    {
+        uint32_t const cMaxRecs = (uint32_t)RT_MIN(idxEnd - *pidxRead, DBGF_TRACE_BIN_CHUNK_RECS);
+        uint64_t       cLost    = 0;
+        uint32_t const cRecs    = dbgfTraceRingRead(pRing, pidxRead, paRecs, cMaxRecs, &cLost);
+        if (!cRecs && !cLost)
+            break;
+        *pcLost += cLost;
+
+        DBGFTRACEFILECHUNK Chunk;
+        Chunk.idCpu    = idCpu;
+        Chunk.cRecords = cRecs;
+        Chunk.cLost    = cLost;
+        int rc = RTFileWrite(hFile, &Chunk, sizeof(Chunk), NULL);
+        if (RT_SUCCESS(rc) && cRecs)
+            rc = RTFileWrite(hFile, paRecs, cRecs * sizeof(paRecs[0]), NULL);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Drains all the binary trace rings into the stream file.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ */
+static int dbgfR3TraceBinStreamFlush(PVM pVM)
+{
+    PUVM pUVM = pVM->pUVM;
+    for (uint32_t iRing = 0; iRing <= pVM->cCpus; iRing++)
+    {
+        PDBGFTRACERING pRing = dbgfR3TraceBinGetRing(pVM, iRing);
+        int rc = dbgfR3TraceBinWriteRing(pUVM->dbgf.s.hTraceFile, iRing < pVM->cCpus ? iRing : NIL_VMCPUID, pRing,
+                                         &pUVM->dbgf.s.paidxTraceRead[iRing], UINT64_MAX, pUVM->dbgf.s.paTraceRecs,
+                                         &pUVM->dbgf.s.cTraceLost);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNRTTHREAD, The binary trace stream writer.}
+ */
+static DECLCALLBACK(int) dbgfR3TraceBinThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PVM  pVM  = (PVM)pvUser;
+    PUVM pUVM = pVM->pUVM;
+    int  rc   = VINF_SUCCESS;
+    for (;;)
+    {
+        bool const fShutdown = ASMAtomicReadBool(&pUVM->dbgf.s.fTraceShutdown);
+        rc = dbgfR3TraceBinStreamFlush(pVM);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("DBGF: Writing the binary trace stream failed: %Rrc - stopped streaming\n", rc));
+            break;
+        }
+        if (fShutdown)
+            break;
+        RTSemEventWait(pUVM->dbgf.s.hTraceEvt, DBGF_TRACE_BIN_FLUSH_INTERVAL);
+    }
+    NOREF(hThreadSelf);
+    return rc;
+}
+
+
+/**
+ * Starts streaming the binary trace rings to a file.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ * @param   pszFilename The file to write to.
+ */
+static int dbgfR3TraceBinStreamStart(PVM pVM, const char *pszFilename)
+{
+    PUVM pUVM = pVM->pUVM;
+    uint32_t const cRings = pVM->cCpus + 1;
+    pUVM->dbgf.s.paidxTraceRead = (uint64_t *)MMR3HeapAllocZ(pVM, MM_TAG_DBGF, cRings * sizeof(uint64_t));
+    pUVM->dbgf.s.paTraceRecs    = (PDBGFTRACEREC)MMR3HeapAlloc(pVM, MM_TAG_DBGF,
+                                                               DBGF_TRACE_BIN_CHUNK_RECS * sizeof(DBGFTRACEREC));
+    if (!pUVM->dbgf.s.paidxTraceRead || !pUVM->dbgf.s.paTraceRecs)
+        return VERR_NO_MEMORY;
+
+    int rc = RTFileOpen(&pUVM->dbgf.s.hTraceFile, pszFilename, RTFILE_O_WRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_WRITE);
+    if (RT_FAILURE(rc))
+    {
+        pUVM->dbgf.s.hTraceFile = NIL_RTFILE;
+        return VMSetError(pVM, rc, RT_SRC_POS, "Failed to create the binary trace file '%s': %Rrc", pszFilename, rc);
+    }
+    rc = dbgfR3TraceBinWriteHdr(pVM, pUVM->dbgf.s.hTraceFile);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pUVM->dbgf.s.hTraceEvt);
+    if (RT_SUCCESS(rc))
+        rc = RTThreadCreate(&pUVM->dbgf.s.hTraceThread, dbgfR3TraceBinThread, pVM, 0, RTTHREADTYPE_IO,
+                            RTTHREADFLAGS_WAITABLE, "DbgfTrace");
+    if (RT_SUCCESS(rc))
+        LogRel(("DBGF: Streaming binary trace to '%s'\n", pszFilename));
+    return rc;
+}
+
+
+/**
+ * Initializes the binary tracing.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ * @param   pDbgfNode   The DBGF CFGM node, can be NULL.
+ */
+static int dbgfR3TraceBinInit(PVM pVM, PCFGMNODE pDbgfNode)
+{
+    PUVM pUVM = pVM->pUVM;
+    pUVM->dbgf.s.hTraceFile   = NIL_RTFILE;
+    pUVM->dbgf.s.hTraceThread = NIL_RTTHREAD;
+    pUVM->dbgf.s.hTraceEvt    = NIL_RTSEMEVENT;
+
+    int rc = DBGFR3InfoRegisterInternal(pVM, "tracebin",
+                                        "Display the binary trace ring status and the most recent records. "
+                                        "Optional argument: the number of records to show per ring (default 16).",
+                                        dbgfR3TraceBinInfo);
+    AssertRCReturn(rc, rc);
+
+    /** @cfgm{/DBGF/TraceBinEnabled, bool, false}
+     * Whether to allocate the binary trace rings. */
+    bool fEnabled;
+    rc = CFGMR3QueryBoolDef(pDbgfNode, "TraceBinEnabled", &fEnabled, false);
+    AssertRCReturn(rc, rc);
+    if (!fEnabled)
+        return VINF_SUCCESS;
+
+    /** @cfgm{/DBGF/TraceBinEntries, uint32_t, 8192}
+     * The number of records in each binary trace ring, power of two. */
+    uint32_t cEntries;
+    rc = CFGMR3QueryU32Def(pDbgfNode, "TraceBinEntries", &cEntries, DBGF_TRACE_BIN_ENTRIES_DEFAULT);
+    AssertRCReturn(rc, rc);
+    if (cEntries < 64 || cEntries > _1M || !RT_IS_POWER_OF_TWO(cEntries))
+        return VMSetError(pVM, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                          "DBGF/TraceBinEntries=%u must be a power of two between 64 and 1M", cEntries);
+
+    /** @cfgm{/DBGF/TraceBinGroups, uint32_t, DBGFTRACEGRP_ALL}
+     * The initially enabled binary trace groups (DBGFTRACEGRP_XXX). */
+    uint32_t fGroups;
+    rc = CFGMR3QueryU32Def(pDbgfNode, "TraceBinGroups", &fGroups, DBGFTRACEGRP_ALL);
+    AssertRCReturn(rc, rc);
+
+    /*
+     * Allocate the per-VCPU rings from the hyper heap so they can be used
+     * in all contexts, the one for other threads is ring-3 only.
+     */
+    size_t const cbRing = RT_ALIGN_Z(dbgfTraceRingCalcSize(cEntries), PAGE_SIZE);
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+    {
+        void *pvRing;
+        rc = MMR3HyperAllocOnceNoRel(pVM, cbRing, PAGE_SIZE, MM_TAG_DBGF, &pvRing);
+        if (RT_FAILURE(rc))
+            return VMSetError(pVM, rc, RT_SRC_POS, "Failed to allocate %zu bytes for the binary trace ring", cbRing);
+        dbgfTraceRingInit((PDBGFTRACERING)pvRing, cEntries);
+
+        PVMCPU pVCpu = &pVM->aCpus[idCpu];
+        pVCpu->dbgf.s.pTraceRingR3 = (PDBGFTRACERING)pvRing;
+        pVCpu->dbgf.s.pTraceRingR0 = MMHyperR3ToR0(pVM, pvRing);
+        pVCpu->dbgf.s.pTraceRingRC = MMHyperR3ToRC(pVM, pvRing);
+    }
+
+    PDBGFTRACERING pRingOther = (PDBGFTRACERING)MMR3HeapAlloc(pVM, MM_TAG_DBGF, dbgfTraceRingCalcSize(cEntries));
+    if (!pRingOther)
+        return VERR_NO_MEMORY;
+    dbgfTraceRingInit(pRingOther, cEntries);
+    pUVM->dbgf.s.pTraceRingOther = pRingOther;
+
+    /** @cfgm{/DBGF/TraceBinFile, string, none}
+     * File to continuously stream the binary trace rings to.  Decode it with
+     * VBoxTraceDecode. */
+    char *pszFilename;
+    rc = CFGMR3QueryStringAlloc(pDbgfNode, "TraceBinFile", &pszFilename);
+    if (RT_SUCCESS(rc))
+    {
+        rc = dbgfR3TraceBinStreamStart(pVM, pszFilename);
+        MMR3HeapFree(pszFilename);
+        if (RT_FAILURE(rc))
+        {
+            dbgfR3TraceBinTerm(pVM);
+            return rc;
+        }
+    }
+    else if (rc != VERR_CFGM_VALUE_NOT_FOUND && rc != VERR_CFGM_NO_PARENT)
+        AssertRCReturn(rc, rc);
+
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+        pVM->aCpus[idCpu].fTraceBinGroups = fGroups;
+    LogRel(("DBGF: Binary tracing enabled, %u records per ring, groups %#x\n", cEntries, fGroups));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Terminates the binary tracing, flushing the stream if active.
+ *
+ * @param   pVM         The cross context VM structure.
+ */
+static void dbgfR3TraceBinTerm(PVM pVM)
+{
+    PUVM pUVM = pVM->pUVM;
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+        pVM->aCpus[idCpu].fTraceBinGroups = 0;
+
+    if (pUVM->dbgf.s.hTraceThread != NIL_RTTHREAD)
+    {
+        ASMAtomicWriteBool(&pUVM->dbgf.s.fTraceShutdown, true);
+        RTSemEventSignal(pUVM->dbgf.s.hTraceEvt);
+        int rc = RTThreadWait(pUVM->dbgf.s.hTraceThread, 30000, NULL);
+        AssertLogRelRC(rc);
+        pUVM->dbgf.s.hTraceThread = NIL_RTTHREAD;
+        if (pUVM->dbgf.s.cTraceLost)
+            LogRel(("DBGF: The binary trace stream lost %'llu records\n", pUVM->dbgf.s.cTraceLost));
+    }
+    if (pUVM->dbgf.s.hTraceEvt != NIL_RTSEMEVENT)
+    {
+        RTSemEventDestroy(pUVM->dbgf.s.hTraceEvt);
+        pUVM->dbgf.s.hTraceEvt = NIL_RTSEMEVENT;
+    }
+    if (pUVM->dbgf.s.hTraceFile != NIL_RTFILE)
+    {
+        RTFileClose(pUVM->dbgf.s.hTraceFile);
+        pUVM->dbgf.s.hTraceFile = NIL_RTFILE;
+    }
+
+    MMR3HeapFree(pUVM->dbgf.s.paidxTraceRead);
+    pUVM->dbgf.s.paidxTraceRead = NULL;
+    MMR3HeapFree(pUVM->dbgf.s.paTraceRecs);
+    pUVM->dbgf.s.paTraceRecs = NULL;
+    MMR3HeapFree(pUVM->dbgf.s.pTraceRingOther);
+    pUVM->dbgf.s.pTraceRingOther = NULL;
+}
+
+
+/**
+ * Changes the enabled binary trace groups.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_DBGF_NO_TRACE_BUFFER if binary tracing wasn't enabled at VM
+ *          creation time (DBGF/TraceBinEnabled).
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   fGroups     The groups to enable (DBGFTRACEGRP_XXX), all others
+ *                      are disabled.
+ */
+VMMR3DECL(int) DBGFR3TraceBinSetGroups(PVM pVM, uint32_t fGroups)
+{
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertReturn(!(fGroups & ~DBGFTRACEGRP_ALL), VERR_INVALID_FLAGS);
+    if (!pVM->pUVM->dbgf.s.pTraceRingOther)
+        return VERR_DBGF_NO_TRACE_BUFFER;
+
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+        ASMAtomicWriteU32(&pVM->aCpus[idCpu].fTraceBinGroups, fGroups);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Dumps the current content of the binary trace rings to a file.
+ *
+ * The VM can keep on running while this is done, records added while dumping
+ * are not included.  This doesn't disturb any streaming.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_DBGF_NO_TRACE_BUFFER if binary tracing isn't enabled.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pszFilename The file to write, replaced if it exists.  Decode it
+ *                      with VBoxTraceDecode.
+ */
+VMMR3DECL(int) DBGFR3TraceBinDump(PVM pVM, const char *pszFilename)
+{
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pszFilename, VERR_INVALID_POINTER);
+    if (!pVM->pUVM->dbgf.s.pTraceRingOther)
+        return VERR_DBGF_NO_TRACE_BUFFER;
+
+    PDBGFTRACEREC paRecs = (PDBGFTRACEREC)RTMemTmpAlloc(DBGF_TRACE_BIN_CHUNK_RECS * sizeof(DBGFTRACEREC));
+    if (!paRecs)
+        return VERR_NO_TMP_MEMORY;
+
+    RTFILE hFile;
+    int rc = RTFileOpen(&hFile, pszFilename, RTFILE_O_WRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_WRITE);
+    if (RT_SUCCESS(rc))
+    {
+        rc = dbgfR3TraceBinWriteHdr(pVM, hFile);
+        for (uint32_t iRing = 0; iRing <= pVM->cCpus && RT_SUCCESS(rc); iRing++)
+        {
+            PDBGFTRACERING pRing   = dbgfR3TraceBinGetRing(pVM, iRing);
+            uint64_t const idxEnd  = ASMAtomicReadU64(&pRing->idxNext);
+            uint64_t       idxRead = idxEnd > pRing->cEntries ? idxEnd - pRing->cEntries : 0;
+            uint64_t       cLost   = 0;
+            rc = dbgfR3TraceBinWriteRing(hFile, iRing < pVM->cCpus ? iRing : NIL_VMCPUID, pRing, &idxRead, idxEnd,
+                                         paRecs, &cLost);
+        }
+        int rc2 = RTFileClose(hFile);
+        if (RT_SUCCESS(rc))
+            rc = rc2;
+    }
+
+    RTMemTmpFree(paRecs);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNDBGFHANDLERINT, Info handler for displaying the binary trace rings.}
+ */
+static DECLCALLBACK(void) dbgfR3TraceBinInfo(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs)
+{
+    PUVM pUVM = pVM->pUVM;
+    if (!pUVM->dbgf.s.pTraceRingOther)
+    {
+        pHlp->pfnPrintf(pHlp, "Binary tracing is disabled\n");
+        return;
+    }
+
+    uint32_t cShow = 16;
+    if (pszArgs && *pszArgs)
+        RTStrToUInt32Full(RTStrStripL(pszArgs), 0, &cShow);
+
+    pHlp->pfnPrintf(pHlp, "Binary trace groups %#x, %u records per ring\n",
+                    pVM->aCpus[0].fTraceBinGroups, pUVM->dbgf.s.pTraceRingOther->cEntries);
+    if (pUVM->dbgf.s.hTraceFile != NIL_RTFILE)
+        pHlp->pfnPrintf(pHlp, "Streaming to file, %'llu records lost\n", pUVM->dbgf.s.cTraceLost);
+
+    for (uint32_t iRing = 0; iRing <= pVM->cCpus; iRing++)
+    {
+        PDBGFTRACERING pRing  = dbgfR3TraceBinGetRing(pVM, iRing);
+        uint64_t const idxEnd = ASMAtomicReadU64(&pRing->idxNext);
+        if (iRing < pVM->cCpus)
+            pHlp->pfnPrintf(pHlp, "CPU %u: %'llu records\n", iRing, idxEnd);
+        else
+            pHlp->pfnPrintf(pHlp, "Other threads: %'llu records\n", idxEnd);
+
+        uint64_t idxRead = idxEnd > RT_MIN(cShow, pRing->cEntries) ? idxEnd - RT_MIN(cShow, pRing->cEntries) : 0;
+        while (idxRead < idxEnd)
+        {
+            DBGFTRACEREC aRecs[16];
+            uint64_t     cLost = 0;
+            uint32_t     cRecs = dbgfTraceRingRead(pRing, &idxRead, aRecs, (uint32_t)RT_MIN(idxEnd - idxRead, RT_ELEMENTS(aRecs)),
+                                                   &cLost);
+            if (!cRecs && !cLost)
+                break;
+            for (uint32_t i = 0; i < cRecs; i++)
+            {
+                const char *pszEvent = DBGFTraceBinEventName(aRecs[i].uEvent);
+                const char *pszPhase = aRecs[i].bPhase == DBGFTRACEPHASE_BEGIN ? "begin"
+                                     : aRecs[i].bPhase == DBGFTRACEPHASE_END   ? "end" : "instant";
+                if (pszEvent)
+                    pHlp->pfnPrintf(pHlp, "  %'20llu %-12s %-7s %#18llx %#18llx\n", aRecs[i].u64Tsc, pszEvent, pszPhase,
+                                    aRecs[i].au64Args[0], aRecs[i].au64Args[1]);
+                else
+                    pHlp->pfnPrintf(pHlp, "  %'20llu dev-%#06x   %-7s %#18llx %#18llx\n", aRecs[i].u64Tsc, aRecs[i].uEvent,
+                                    pszPhase, aRecs[i].au64Args[0], aRecs[i].au64Args[1]);
+            }
+        }
+    }
+}
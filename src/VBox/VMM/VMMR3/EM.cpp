@@ -441,6 +441,9 @@ VMMR3_INT_DECL(int) EMR3Init(PVM pVM)
         EM_REG_PROFILE_ADV(&pVCpu->em.s.StatTotal,         "/PROF/CPU%d/EM/Total",             "Profiling EMR3ExecuteVM.");
     }
 
+    rc = emR3InitHistory(pVM);
+    AssertRCReturn(rc, rc);
+
     emR3InitDbg(pVM);
     return VINF_SUCCESS;
 }
@@ -475,6 +478,7 @@ VMMR3_INT_DECL(void) EMR3Relocate(PVM pVM)
 VMMR3_INT_DECL(void) EMR3ResetCpu(PVMCPU pVCpu)
 {
     pVCpu->em.s.fForceRAW = false;
+    emR3HistoryResetCpu(pVCpu);
 
     /* VMR3Reset may return VINF_EM_RESET or VINF_EM_SUSPEND, so transition
        out of the HALTED state here so that enmPrevState doesn't end up as
@@ -2461,6 +2465,13 @@ VMMR3_INT_DECL(int) EMR3ExecuteVM(PVM pVM, PVMCPU pVCpu)
                     LogFlow(("EMR3ExecuteVM: Clearing MWAIT\n"));
                     pVCpu->em.s.MWait.fWait &= ~(EMMWAIT_FLAG_ACTIVE | EMMWAIT_FLAG_BREAKIRQIF0);
                 }
+
+                /* The IEM TLBs are only kept up to date while IEM or REM is
+                   running the guest, so flush them when switching to IEM. */
+                if (   (enmNewState == EMSTATE_IEM || enmNewState == EMSTATE_IEM_THEN_REM)
+                    && enmOldState != EMSTATE_IEM
+                    && enmOldState != EMSTATE_IEM_THEN_REM)
+                    IEMTlbInvalidateAll(pVCpu);
             }
             else
                 VBOXVMM_EM_STATE_UNCHANGED(pVCpu, enmNewState, rc);
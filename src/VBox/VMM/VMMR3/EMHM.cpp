@@ -447,7 +447,9 @@ int emR3HmExecute(PVM pVM, PVMCPU pVCpu, bool *pfFFDone)
         if (RT_LIKELY(emR3IsExecutionAllowed(pVM, pVCpu)))
         {
             STAM_PROFILE_START(&pVCpu->em.s.StatHmExec, x);
+            DBGFTRACE_BIN(pVCpu, DBGFTRACEGRP_HM, DBGFTRACEEVT_HM_RUN, DBGFTRACEPHASE_BEGIN, pCtx->rip, 0);
             rc = VMMR3HmRunGC(pVM, pVCpu);
+            DBGFTRACE_BIN(pVCpu, DBGFTRACEGRP_HM, DBGFTRACEEVT_HM_RUN, DBGFTRACEPHASE_END, pCtx->rip, rc);
             STAM_PROFILE_STOP(&pVCpu->em.s.StatHmExec, x);
         }
         else
@@ -474,7 +476,13 @@ int emR3HmExecute(PVM pVM, PVMCPU pVCpu, bool *pfFFDone)
         if (rc >= VINF_EM_FIRST && rc <= VINF_EM_LAST)
             break;
 
+        /* Exits at hot sites are followed up by a run in IEM, see the exit
+           history code in EMR3History.cpp. */
+        PEMEXITREC pExitRec = emR3HistoryAddExit(pVCpu, rc, pCtx);
         rc = emR3HmHandleRC(pVM, pVCpu, pCtx, rc);
+        if (   pExitRec
+            && rc == VINF_SUCCESS)
+            rc = emR3HistoryExec(pVM, pVCpu, pExitRec);
         if (rc != VINF_SUCCESS)
             break;
 
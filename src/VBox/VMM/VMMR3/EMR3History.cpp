@@ -0,0 +1,390 @@
+/* $Id$ */
+/** @file
+ * EM - Execution Monitor / Manager, Exit History.
+ */
+
+/*
+ * Copyright (C) 2006-2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/** @page pg_em_exit_history   EM - Exit History
+ *
+ * Legacy drivers like to poll device registers in tight loops, and with
+ * hardware assisted execution every one of those accesses that the device
+ * has to handle in ring-3 costs us a full world switch plus a trip through
+ * the EM loop.  The exit history keeps track of where (flat PC) these exits
+ * happen in a small direct mapped table per virtual CPU.
+ *
+ * When the same site exits again and again with few other exits in between,
+ * it is considered hot.  After handling an exit at a hot site, EM doesn't go
+ * back to HM right away but keeps executing the guest in IEM
+ * (IEMExecForExits) until it goes a while without doing any I/O port or MMIO
+ * accesses.  The first such run is a probe: if it didn't find any further
+ * accesses to do, and a few more probes in a row don't either, the site is
+ * left alone from then on.
+ *
+ * The 'emexits' info item lists the busiest sites of each virtual CPU along
+ * with what is being done about them.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_EM
+#include <VBox/vmm/em.h>
+#include <VBox/vmm/iem.h>
+#include <VBox/vmm/hm.h>
+#include <VBox/vmm/trpm.h>
+#include <VBox/vmm/dbgf.h>
+#include <VBox/vmm/mm.h>
+#include <VBox/vmm/stam.h>
+#include <VBox/vmm/cfgm.h>
+#include "EMInternal.h"
+#include <VBox/vmm/vm.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+
+#include <iprt/assert.h>
+#include <iprt/string.h>
+
+
+/*********************************************************************************************************************************
+*   Internal Functions                                                                                                           *
+*********************************************************************************************************************************/
+static FNDBGFHANDLERINT emR3InfoExitHistory;
+
+
+/**
+ * Initializes the exit history.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ */
+int emR3InitHistory(PVM pVM)
+{
+    /*
+     * Read the configuration.
+     */
+    /** @cfgm{/EM/ExitOptimizationEnabled, bool, true}
+     * Whether to execute frequently exiting code (I/O port and MMIO polling
+     * loops) in IEM instead of going back and forth between HM and ring-3. */
+    PCFGMNODE pCfgEM = CFGMR3GetChild(CFGMR3GetRoot(pVM), "EM");
+    int rc = CFGMR3QueryBoolDef(pCfgEM, "ExitOptimizationEnabled", &pVM->em.s.fExitOptimizationEnabled, true);
+    AssertLogRelRCReturn(rc, rc);
+    LogRel(("EM: fExitOptimizationEnabled=%RTbool\n", pVM->em.s.fExitOptimizationEnabled));
+
+    /* Only HM does exits. */
+    if (   !pVM->em.s.fExitOptimizationEnabled
+        || !HMIsEnabled(pVM))
+        return VINF_SUCCESS;
+
+    /*
+     * Allocate the tables and register statistics.
+     */
+    for (VMCPUID i = 0; i < pVM->cCpus; i++)
+    {
+        PVMCPU pVCpu = &pVM->aCpus[i];
+
+        PEMEXITREC paExitRecs = (PEMEXITREC)MMR3HeapAllocZ(pVM, MM_TAG_EM, sizeof(EMEXITREC) * EM_EXIT_HISTORY_ENTRIES);
+        AssertReturn(paExitRecs, VERR_NO_MEMORY);
+        pVCpu->em.s.paExitHistoryR3 = paExitRecs;
+        pVCpu->em.s.iNextExit       = 0;
+
+        STAMR3RegisterF(pVM, &pVCpu->em.s.StatExitHistoryHot,           STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                        "Exits at hot exit sites.",                             "/EM/CPU%u/ExitHistory/Hot", i);
+        STAMR3RegisterF(pVM, &pVCpu->em.s.StatExitHistoryEvictions,     STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                        "Exit sites replaced by other sites.",                  "/EM/CPU%u/ExitHistory/Evictions", i);
+        STAMR3RegisterF(pVM, &pVCpu->em.s.StatExitHistoryExec,          STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,
+                        "Profiling IEM runs for hot exit sites.",               "/EM/CPU%u/ExitHistory/Exec", i);
+        STAMR3RegisterF(pVM, &pVCpu->em.s.StatExitHistoryInstructions,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Instructions executed by the IEM runs.",               "/EM/CPU%u/ExitHistory/Instructions", i);
+        STAMR3RegisterF(pVM, &pVCpu->em.s.StatExitHistoryExitsAvoided,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                        "I/O port and MMIO accesses done by the IEM runs.",     "/EM/CPU%u/ExitHistory/ExitsAvoided", i);
+        STAMR3RegisterF(pVM, &pVCpu->em.s.StatExitHistoryProbeFailures, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,
+                        "Exit sites given up on after failed probe runs.",      "/EM/CPU%u/ExitHistory/ProbeFailures", i);
+    }
+
+    DBGFR3InfoRegisterInternal(pVM, "emexits", "Displays the busiest exit sites of each virtual CPU. "
+                               "Pass 'all' to list every site.", emR3InfoExitHistory);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Clears the exit history of a virtual CPU.
+ *
+ * @param   pVCpu       The cross context virtual CPU structure.
+ */
+void emR3HistoryResetCpu(PVMCPU pVCpu)
+{
+    if (pVCpu->em.s.paExitHistoryR3)
+        RT_BZERO(pVCpu->em.s.paExitHistoryR3, sizeof(EMEXITREC) * EM_EXIT_HISTORY_ENTRIES);
+    pVCpu->em.s.iNextExit = 0;
+}
+
+
+/**
+ * Records an exit from hardware assisted execution.
+ *
+ * @returns The exit history entry if EM should follow up the exit with an IEM
+ *          run (emR3HistoryExec), NULL if not.
+ * @param   pVCpu       The cross context virtual CPU structure.
+ * @param   rcExit      The status code HM returned.  Only some are tracked.
+ * @param   pCtx        The guest CPU context, still at the exiting
+ *                      instruction.
+ */
+PEMEXITREC emR3HistoryAddExit(PVMCPU pVCpu, int rcExit, PCCPUMCTX pCtx)
+{
+    EMEXITTYPE enmType;
+    switch (rcExit)
+    {
+        case VINF_IOM_R3_IOPORT_READ:
+        case VINF_IOM_R3_IOPORT_WRITE:
+            enmType = EMEXITTYPE_IO_PORT;
+            break;
+        case VINF_IOM_R3_MMIO_READ:
+        case VINF_IOM_R3_MMIO_WRITE:
+        case VINF_IOM_R3_MMIO_READ_WRITE:
+            enmType = EMEXITTYPE_MMIO;
+            break;
+        case VINF_CPUM_R3_MSR_READ:
+        case VINF_CPUM_R3_MSR_WRITE:
+            enmType = EMEXITTYPE_MSR;
+            break;
+        default:
+            return NULL;
+    }
+
+    PEMEXITREC paExitRecs = pVCpu->em.s.paExitHistoryR3;
+    if (!paExitRecs)
+        return NULL;
+
+    /*
+     * Look up the site, taking over the entry if it belongs to another one.
+     */
+    uint64_t const   uFlatPC   = pCtx->cs.u64Base + pCtx->rip;
+    uint64_t const   iExit     = pVCpu->em.s.iNextExit++;
+    PEMEXITREC const pExitRec  = &paExitRecs[(uint32_t)(uFlatPC ^ (uFlatPC >> 12) ^ enmType) & (EM_EXIT_HISTORY_ENTRIES - 1)];
+    if (   pExitRec->uFlatPC == uFlatPC
+        && pExitRec->enmType == enmType)
+    {
+        pExitRec->cHits++;
+        if (iExit - pExitRec->iLastExit <= EM_EXIT_HISTORY_MAX_DISTANCE)
+        {
+            if (pExitRec->cCloseHits < UINT16_MAX)
+                pExitRec->cCloseHits++;
+        }
+        else
+        {
+            /* Gone cold.  A site we've given up on stays given up on though. */
+            pExitRec->cCloseHits = 1;
+            if (pExitRec->enmAction != EMEXITACTION_NORMAL_PROBED)
+                pExitRec->enmAction = EMEXITACTION_NORMAL;
+        }
+        pExitRec->iLastExit = iExit;
+    }
+    else
+    {
+        if (pExitRec->enmType != EMEXITTYPE_INVALID)
+            STAM_REL_COUNTER_INC(&pVCpu->em.s.StatExitHistoryEvictions);
+        RT_ZERO(*pExitRec);
+        pExitRec->uFlatPC    = uFlatPC;
+        pExitRec->iLastExit  = iExit;
+        pExitRec->cHits      = 1;
+        pExitRec->cCloseHits = 1;
+        pExitRec->enmType    = (uint8_t)enmType;
+        pExitRec->enmAction  = EMEXITACTION_NORMAL;
+        return NULL;
+    }
+
+    /*
+     * Decide what to do.  MSR accesses don't register as potential exits in
+     * IEM, so we only keep statistics on those.
+     */
+    switch (pExitRec->enmAction)
+    {
+        case EMEXITACTION_NORMAL:
+            if (   pExitRec->cCloseHits < EM_EXIT_HISTORY_HOT_THRESHOLD
+                || enmType == EMEXITTYPE_MSR)
+                return NULL;
+            Log(("emR3HistoryAddExit: Site %RX64/%d is hot\n", uFlatPC, enmType));
+            pExitRec->enmAction = EMEXITACTION_EXEC_PROBE;
+            /* fall thru */
+        case EMEXITACTION_EXEC_PROBE:
+        case EMEXITACTION_EXEC:
+            STAM_REL_COUNTER_INC(&pVCpu->em.s.StatExitHistoryHot);
+            return pExitRec;
+
+        default:
+            return NULL;
+    }
+}
+
+
+/**
+ * Follows up an exit at a hot site by executing the guest in IEM for a while.
+ *
+ * This is called after the exit has been handled the normal way.
+ *
+ * @returns VBox status code suitable for EM, VINF_SUCCESS if HM can resume.
+ * @param   pVM         The cross context VM structure.
+ * @param   pVCpu       The cross context virtual CPU structure.
+ * @param   pExitRec    The exit history entry (from emR3HistoryAddExit).
+ */
+int emR3HistoryExec(PVM pVM, PVMCPU pVCpu, PEMEXITREC pExitRec)
+{
+    PCPUMCTX pCtx = pVCpu->em.s.pCtx;
+
+    /*
+     * Leave it to HM if there is anything for EM to take care of first, or
+     * if the debugger might expect breakpoints to work (IEM doesn't do those).
+     */
+    if (   VM_FF_IS_PENDING(pVM, VM_FF_ALL_REM_MASK)
+        || VMCPU_FF_IS_PENDING(pVCpu, VMCPU_FF_ALL_REM_MASK & ~(VMCPU_FF_UNHALT | VMCPU_FF_BLOCK_NMIS))
+        || TRPMHasTrap(pVCpu)
+        || (pCtx->dr[7] & X86_DR7_ENABLED_MASK)
+        || DBGFBpIsHwArmed(pVM)
+        || DBGFIsStepping(pVCpu))
+        return VINF_SUCCESS;
+
+    /*
+     * Do the run.
+     */
+    STAM_REL_PROFILE_START(&pVCpu->em.s.StatExitHistoryExec, a);
+    uint32_t     cInstructions;
+    uint32_t     cPotentialExits;
+    VBOXSTRICTRC rcStrict = IEMExecForExits(pVCpu, EM_EXIT_HISTORY_RUN_MAX_INSTRS, EM_EXIT_HISTORY_RUN_MAX_NO_EXITS,
+                                            &cInstructions, &cPotentialExits);
+    STAM_REL_PROFILE_STOP(&pVCpu->em.s.StatExitHistoryExec, a);
+    STAM_REL_COUNTER_ADD(&pVCpu->em.s.StatExitHistoryInstructions, cInstructions);
+    STAM_REL_COUNTER_ADD(&pVCpu->em.s.StatExitHistoryExitsAvoided, cPotentialExits);
+    pExitRec->cRuns++;
+    pExitRec->cInstructions += cInstructions;
+    pExitRec->cExitsAvoided += cPotentialExits;
+    Log2(("emR3HistoryExec: %RX64: %u instructions, %u exits avoided, rcStrict=%Rrc\n",
+          pExitRec->uFlatPC, cInstructions, cPotentialExits, VBOXSTRICTRC_VAL(rcStrict)));
+
+    /*
+     * Did it pay off?  A run that didn't find any accesses to do is only
+     * conclusive if it ran into the no-exits limit.
+     */
+    if (cPotentialExits > 0)
+    {
+        pExitRec->enmAction      = EMEXITACTION_EXEC;
+        pExitRec->cProbeFailures = 0;
+    }
+    else if (   cInstructions >= EM_EXIT_HISTORY_RUN_MAX_NO_EXITS
+             && ++pExitRec->cProbeFailures >= EM_EXIT_HISTORY_MAX_PROBE_FAILURES)
+    {
+        Log(("emR3HistoryExec: Giving up on site %RX64/%d\n", pExitRec->uFlatPC, pExitRec->enmType));
+        pExitRec->enmAction = EMEXITACTION_NORMAL_PROBED;
+        STAM_REL_COUNTER_INC(&pVCpu->em.s.StatExitHistoryProbeFailures);
+    }
+
+    /* Let HM have a go at what IEM couldn't do. */
+    if (   rcStrict == VERR_IEM_ASPECT_NOT_IMPLEMENTED
+        || rcStrict == VERR_IEM_INSTR_NOT_IMPLEMENTED)
+        return VINF_SUCCESS;
+    if (   rcStrict == VINF_SUCCESS
+        && cInstructions > 0
+        && !HMR3CanExecuteGuest(pVM, pCtx))
+        return VINF_EM_RESCHEDULE;
+    return VBOXSTRICTRC_TODO(rcStrict);
+}
+
+
+/**
+ * Gets the name of an exit type.
+ *
+ * @returns Read-only name string.
+ * @param   enmType     The exit type.
+ */
+static const char *emR3HistoryTypeName(uint8_t enmType)
+{
+    switch (enmType)
+    {
+        case EMEXITTYPE_IO_PORT:    return "ioport";
+        case EMEXITTYPE_MMIO:       return "mmio";
+        case EMEXITTYPE_MSR:        return "msr";
+        default:                    return "??";
+    }
+}
+
+
+/**
+ * Gets the name of an exit action.
+ *
+ * @returns Read-only name string.
+ * @param   enmAction   The exit action.
+ */
+static const char *emR3HistoryActionName(uint8_t enmAction)
+{
+    switch (enmAction)
+    {
+        case EMEXITACTION_NORMAL:           return "normal";
+        case EMEXITACTION_EXEC_PROBE:       return "probe";
+        case EMEXITACTION_EXEC:             return "exec";
+        case EMEXITACTION_NORMAL_PROBED:    return "probed";
+        default:                            return "??";
+    }
+}
+
+
+/**
+ * @callback_method_impl{FNDBGFHANDLERINT, emexits}
+ */
+static DECLCALLBACK(void) emR3InfoExitHistory(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs)
+{
+    bool const fAll = pszArgs && strstr(pszArgs, "all") != NULL;
+
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+    {
+        PVMCPU     pVCpu      = &pVM->aCpus[idCpu];
+        PEMEXITREC paExitRecs = pVCpu->em.s.paExitHistoryR3;
+        if (!paExitRecs)
+        {
+            pHlp->pfnPrintf(pHlp, "CPU%u: exit history not enabled\n", idCpu);
+            continue;
+        }
+
+        /* Sort the used entries by hits, busiest first (insertion sort, the
+           table is small). */
+        uint16_t aidx[EM_EXIT_HISTORY_ENTRIES];
+        uint32_t cUsed = 0;
+        for (uint32_t i = 0; i < EM_EXIT_HISTORY_ENTRIES; i++)
+            if (paExitRecs[i].enmType != EMEXITTYPE_INVALID)
+            {
+                uint32_t j = cUsed++;
+                while (j > 0 && paExitRecs[aidx[j - 1]].cHits < paExitRecs[i].cHits)
+                {
+                    aidx[j] = aidx[j - 1];
+                    j--;
+                }
+                aidx[j] = (uint16_t)i;
+            }
+
+        pHlp->pfnPrintf(pHlp,
+                        "CPU%u: %RU64 exits recorded, %u sites\n"
+                        "%-16s %-6s %-6s %10s %10s %12s %12s\n",
+                        idCpu, pVCpu->em.s.iNextExit, cUsed,
+                        "Flat PC", "Type", "Action", "Hits", "Runs", "Instructions", "ExitsAvoided");
+        uint32_t const cShow = fAll ? cUsed : RT_MIN(cUsed, 32);
+        for (uint32_t i = 0; i < cShow; i++)
+        {
+            PEMEXITREC pExitRec = &paExitRecs[aidx[i]];
+            pHlp->pfnPrintf(pHlp, "%016RX64 %-6s %-6s %10u %10u %12RU64 %12RU64\n",
+                            pExitRec->uFlatPC, emR3HistoryTypeName(pExitRec->enmType),
+                            emR3HistoryActionName(pExitRec->enmAction), pExitRec->cHits, pExitRec->cRuns,
+                            pExitRec->cInstructions, pExitRec->cExitsAvoided);
+        }
+    }
+}
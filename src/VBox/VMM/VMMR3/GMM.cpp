@@ -429,6 +429,15 @@ GMMR3DECL(int)  GMMR3CheckSharedModules(PVM pVM)
 }
 
 
+/**
+ * @see GMMR0FusionScan
+ */
+GMMR3DECL(int)  GMMR3FusionScan(PVM pVM, uint32_t cMaxPages)
+{
+    return VMMR3CallR0(pVM, VMMR0_DO_GMM_FUSION_SCAN, cMaxPages, NULL);
+}
+
+
 #if defined(VBOX_STRICT) && HC_ARCH_BITS == 64
 /**
  * @see GMMR0FindDuplicatePage
@@ -58,19 +58,22 @@
 #include <VBox/vmm/uvm.h>
 #include <VBox/err.h>
 #include <VBox/param.h>
+#include <VBox/sup.h>
 
 #include <iprt/assert.h>
 #include <VBox/log.h>
 #include <iprt/asm.h>
 #include <iprt/asm-amd64-x86.h>
+#include <iprt/asm-math.h>
 #include <iprt/env.h>
+#include <iprt/mem.h>
+#include <iprt/string.h>
 #include <iprt/thread.h>
 
 
 /*********************************************************************************************************************************
 *   Global Variables                                                                                                             *
 *********************************************************************************************************************************/
-#ifdef VBOX_WITH_STATISTICS
 # define EXIT_REASON(def, val, str) #def " - " #val " - " str
 # define EXIT_REASON_NIL() NULL
 /** Exit reason descriptions for VT-x, used to describe statistics. */
@@ -294,7 +297,6 @@ static const char * const g_apszAmdVExitReasons[MAX_EXITREASON_STAT] =
 };
 # undef EXIT_REASON
 # undef EXIT_REASON_NIL
-#endif /* VBOX_WITH_STATISTICS */
 
 #define HMVMX_REPORT_FEATURE(allowed1, disallowed0, featflag) \
     do { \
@@ -334,6 +336,8 @@ static int               hmR3InitFinalizeR0(PVM pVM);
 static int               hmR3InitFinalizeR0Intel(PVM pVM);
 static int               hmR3InitFinalizeR0Amd(PVM pVM);
 static int               hmR3TermCPU(PVM pVM);
+static int               hmR3InitExitHistograms(PVM pVM);
+static DECLCALLBACK(void) hmR3InfoExitLatency(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 
 
 
@@ -396,7 +400,8 @@ VMMR3_INT_DECL(int) HMR3Init(PVM pVM)
                               "|SvmPauseFilterThreshold"
                               "|Exclusive"
                               "|MaxResumeLoops"
-                              "|UseVmxPreemptTimer",
+                              "|UseVmxPreemptTimer"
+                              "|ExitHistograms",
                               "" /* pszValidNodes */, "HM" /* pszWho */, 0 /* uInstance */);
     if (RT_FAILURE(rc))
         return rc;
@@ -435,8 +440,12 @@ VMMR3_INT_DECL(int) HMR3Init(PVM pVM)
 
     /** @cfgm{/HM/EnableLargePages, bool, false}
      * Enables using large pages (2 MB) for guest memory, thus saving on (nested)
-     * page table walking and maybe better TLB hit rate in some cases. */
-    rc = CFGMR3QueryBoolDef(pCfgHm, "EnableLargePages", &pVM->hm.s.fLargePages, false);
+     * page table walking and maybe better TLB hit rate in some cases.  This is
+     * the default when /PGM/HugePages asks for host large page backing. */
+    uint32_t uHugePages;
+    rc = CFGMR3QueryU32Def(CFGMR3GetChild(CFGMR3GetRoot(pVM), "PGM"), "HugePages", &uHugePages, 0);
+    AssertRCReturn(rc, rc);
+    rc = CFGMR3QueryBoolDef(pCfgHm, "EnableLargePages", &pVM->hm.s.fLargePages, uHugePages != 0);
     AssertRCReturn(rc, rc);
 
     /** @cfgm{/HM/EnableVPID, bool, false}
@@ -534,6 +543,20 @@ VMMR3_INT_DECL(int) HMR3Init(PVM pVM)
     rc = CFGMR3QueryBoolDef(pCfgHm, "UseVmxPreemptTimer", &pVM->hm.s.vmx.fUsePreemptTimer, true);
     AssertLogRelRCReturn(rc, rc);
 
+    /** @cfgm{/HM/ExitHistograms, bool, false}
+     * Whether to collect latency histograms per VM-exit reason, i.e. the time
+     * from a VM-exit until the next VM-entry.  Exits handled in ring-0 and exits
+     * going to ring-3 are kept apart.  See 'info hmexitlat' and
+     * /HM/CPUx/ExitLatency/. */
+    rc = CFGMR3QueryBoolDef(pCfgHm, "ExitHistograms", &pVM->hm.s.fExitHistograms, false);
+    AssertLogRelRCReturn(rc, rc);
+
+    rc = DBGFR3InfoRegisterInternal(pVM, "hmexitlat",
+                                    "Displays the VM-exit latency histograms (/HM/ExitHistograms). "
+                                    "Optional argument: the VCPU to show, default is the sum of all.",
+                                    hmR3InfoExitLatency);
+    AssertRCReturn(rc, rc);
+
     /*
      * Check if VT-x or AMD-v support according to the users wishes.
      */
@@ -941,6 +964,15 @@ static int hmR3InitCPU(PVM pVM)
 #endif /* VBOX_WITH_STATISTICS */
     }
 
+    /*
+     * Exit latency histograms.
+     */
+    if (pVM->hm.s.fExitHistograms)
+    {
+        int rc = hmR3InitExitHistograms(pVM);
+        AssertRCReturn(rc, rc);
+    }
+
 #ifdef VBOX_WITH_CRASHDUMP_MAGIC
     /*
      * Magic marker for searching in crash dumps.
@@ -959,6 +991,270 @@ static int hmR3InitCPU(PVM pVM)
 }
 
 
+/**
+ * Allocates and registers the exit latency histograms (/HM/ExitHistograms).
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ */
+static int hmR3InitExitHistograms(PVM pVM)
+{
+    /* STAM keeps the description pointers, so these must be static. */
+    static const char * const s_apszBucketDesc[HM_EXIT_HIST_BUCKETS] =
+    {
+        "Latency below 2^10 ticks.",
+        "Latency 2^10 to 2^11 ticks.",
+        "Latency 2^11 to 2^12 ticks.",
+        "Latency 2^12 to 2^13 ticks.",
+        "Latency 2^13 to 2^14 ticks.",
+        "Latency 2^14 to 2^15 ticks.",
+        "Latency 2^15 to 2^16 ticks.",
+        "Latency 2^16 to 2^17 ticks.",
+        "Latency 2^17 to 2^18 ticks.",
+        "Latency 2^18 to 2^19 ticks.",
+        "Latency 2^19 to 2^20 ticks.",
+        "Latency 2^20 to 2^21 ticks.",
+        "Latency 2^21 to 2^22 ticks.",
+        "Latency 2^22 to 2^23 ticks.",
+        "Latency 2^23 to 2^24 ticks.",
+        "Latency 2^24 ticks or more.",
+    };
+    static const char * const s_apszWhere[2] = { "R0", "R3" };
+    bool const                fIntel         = ASMIsIntelCpu();
+    const char * const       *papszDesc      = fIntel ? &g_apszVTxExitReasons[0] : &g_apszAmdVExitReasons[0];
+
+    for (VMCPUID i = 0; i < pVM->cCpus; i++)
+    {
+        PVMCPU pVCpu = &pVM->aCpus[i];
+        void  *pv;
+        int rc = MMR3HyperAllocOnceNoRel(pVM, 2 * HM_EXIT_HIST_REASONS * sizeof(HMEXITHIST), PAGE_SIZE, MM_TAG_HM, &pv);
+        AssertLogRelRCReturn(rc, rc);
+        pVCpu->hm.s.paExitHistR3 = (PHMEXITHIST)pv;
+        pVCpu->hm.s.paExitHistR0 = MMHyperR3ToR0(pVM, pv);
+        AssertReturn(pVCpu->hm.s.paExitHistR0 != NIL_RTR0PTR, VERR_INTERNAL_ERROR_3);
+
+        for (unsigned iWhere = 0; iWhere < RT_ELEMENTS(s_apszWhere); iWhere++)
+            for (unsigned j = 0; j < HM_EXIT_HIST_REASONS; j++)
+            {
+                const char *pszDesc;
+                char        szName[64];
+                if (j != HM_EXIT_HIST_IDX_NPF)
+                {
+                    pszDesc = papszDesc[j];
+                    RTStrPrintf(szName, sizeof(szName), "/HM/CPU%u/ExitLatency/%s/%02x", i, s_apszWhere[iWhere], j);
+                }
+                else
+                {
+                    pszDesc = fIntel ? NULL : "Nested page fault";
+                    RTStrPrintf(szName, sizeof(szName), "/HM/CPU%u/ExitLatency/%s/#NPF", i, s_apszWhere[iWhere]);
+                }
+                if (!pszDesc)
+                    continue;
+
+                PHMEXITHIST pHist = &pVCpu->hm.s.paExitHistR3[iWhere * HM_EXIT_HIST_REASONS + j];
+                rc = STAMR3RegisterF(pVM, &pHist->Profile, STAMTYPE_PROFILE, STAMVISIBILITY_USED, STAMUNIT_TICKS_PER_OCCURENCE,
+                                     pszDesc, "%s/Profile", szName);
+                AssertRCReturn(rc, rc);
+                for (unsigned iBucket = 0; iBucket < HM_EXIT_HIST_BUCKETS; iBucket++)
+                {
+                    rc = STAMR3RegisterF(pVM, &pHist->aBuckets[iBucket], STAMTYPE_COUNTER, STAMVISIBILITY_USED,
+                                         STAMUNIT_OCCURENCES, s_apszBucketDesc[iBucket], "%s/B%02u", szName, iBucket);
+                    AssertRCReturn(rc, rc);
+                }
+            }
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Gets the name of an exit latency histogram.
+ *
+ * @returns Read-only string, NULL if the histogram isn't used.
+ * @param   idxHist     The histogram index within its category.
+ */
+static const char *hmR3ExitHistGetName(unsigned idxHist)
+{
+    if (idxHist == HM_EXIT_HIST_IDX_NPF)
+        return ASMIsIntelCpu() ? NULL : "Nested page fault";
+    return ASMIsIntelCpu() ? g_apszVTxExitReasons[idxHist] : g_apszAmdVExitReasons[idxHist];
+}
+
+
+/**
+ * Converts TSC ticks to nanoseconds for the exit latency info handler.
+ *
+ * @returns Nanoseconds, or the ticks if the TSC frequency isn't known.
+ * @param   cTicks      The TSC ticks.
+ * @param   u64CpuHz    The TSC frequency, 0 if unknown.
+ */
+static uint64_t hmR3ExitHistTicksToNano(uint64_t cTicks, uint64_t u64CpuHz)
+{
+    if (!u64CpuHz)
+        return cTicks;
+    return ASMMultU64ByU32DivByU32(cTicks, RT_NS_1SEC / 1000, (uint32_t)(u64CpuHz / 1000));
+}
+
+
+/**
+ * Gets the upper bound of the bucket a percentile falls into.
+ *
+ * @returns Upper bucket bound in TSC ticks, UINT64_MAX for the open ended one.
+ * @param   paBuckets   The bucket counts.
+ * @param   cTotal      The sum of @a paBuckets.
+ * @param   uPercent    The percentile.
+ */
+static uint64_t hmR3ExitHistPercentile(uint64_t const *paBuckets, uint64_t cTotal, unsigned uPercent)
+{
+    uint64_t const cTarget = (cTotal * uPercent + 99) / 100;
+    uint64_t       cSum    = 0;
+    for (unsigned iBucket = 0; iBucket < HM_EXIT_HIST_BUCKETS - 1; iBucket++)
+    {
+        cSum += paBuckets[iBucket];
+        if (cSum >= cTarget)
+            return RT_BIT_64(HM_EXIT_HIST_FIRST_SHIFT + iBucket);
+    }
+    return UINT64_MAX;
+}
+
+
+/**
+ * @callback_method_impl{FNDBGFHANDLERINT, Displays the exit latency histograms.}
+ */
+static DECLCALLBACK(void) hmR3InfoExitLatency(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs)
+{
+    if (!pVM->hm.s.fExitHistograms || !HMIsEnabled(pVM))
+    {
+        pHlp->pfnPrintf(pHlp, "Exit latency histograms are not enabled. Set /HM/ExitHistograms to 1 to enable them.\n");
+        return;
+    }
+
+    /*
+     * Parse the optional VCPU argument.
+     */
+    VMCPUID idCpuFirst = 0;
+    VMCPUID idCpuLast  = pVM->cCpus - 1;
+    if (pszArgs)
+        pszArgs = RTStrStripL(pszArgs);
+    if (pszArgs && *pszArgs)
+    {
+        uint32_t idCpu;
+        int rc = RTStrToUInt32Ex(pszArgs, NULL, 0, &idCpu);
+        if (   (rc != VINF_SUCCESS && rc != VWRN_TRAILING_SPACES)
+            || idCpu >= pVM->cCpus)
+        {
+            pHlp->pfnPrintf(pHlp, "Invalid VCPU '%s'.\n", pszArgs);
+            return;
+        }
+        idCpuFirst = idCpuLast = idCpu;
+    }
+
+    /*
+     * Sum up the histograms.
+     */
+    typedef struct HMEXITHISTSUM
+    {
+        uint64_t    cTicks;
+        uint64_t    cPeriods;
+        uint64_t    cTicksMin;
+        uint64_t    cTicksMax;
+        uint64_t    acBuckets[HM_EXIT_HIST_BUCKETS];
+        uint16_t    idxHist;
+    } HMEXITHISTSUM;
+    HMEXITHISTSUM *paSums = (HMEXITHISTSUM *)RTMemAllocZ(2 * HM_EXIT_HIST_REASONS * sizeof(paSums[0]));
+    if (!paSums)
+    {
+        pHlp->pfnPrintf(pHlp, "Out of memory.\n");
+        return;
+    }
+
+    uint64_t cTicksTotal = 0;
+    for (unsigned idx = 0; idx < 2 * HM_EXIT_HIST_REASONS; idx++)
+    {
+        HMEXITHISTSUM *pSum = &paSums[idx];
+        pSum->idxHist   = (uint16_t)idx;
+        pSum->cTicksMin = UINT64_MAX;
+        for (VMCPUID idCpu = idCpuFirst; idCpu <= idCpuLast; idCpu++)
+        {
+            HMEXITHIST const *pHist = &pVM->aCpus[idCpu].hm.s.paExitHistR3[idx];
+            if (!pHist->Profile.cPeriods)
+                continue;
+            pSum->cTicks   += pHist->Profile.cTicks;
+            pSum->cPeriods += pHist->Profile.cPeriods;
+            pSum->cTicksMin = RT_MIN(pSum->cTicksMin, pHist->Profile.cTicksMin);
+            pSum->cTicksMax = RT_MAX(pSum->cTicksMax, pHist->Profile.cTicksMax);
+            for (unsigned iBucket = 0; iBucket < HM_EXIT_HIST_BUCKETS; iBucket++)
+                pSum->acBuckets[iBucket] += pHist->aBuckets[iBucket].c;
+        }
+        cTicksTotal += pSum->cTicks;
+    }
+
+    /* Sort by total time spent, descending (insertion sort, the table is small). */
+    for (unsigned i = 1; i < 2 * HM_EXIT_HIST_REASONS; i++)
+    {
+        HMEXITHISTSUM Tmp = paSums[i];
+        unsigned      j   = i;
+        while (j > 0 && paSums[j - 1].cTicks < Tmp.cTicks)
+        {
+            paSums[j] = paSums[j - 1];
+            j--;
+        }
+        paSums[j] = Tmp;
+    }
+
+    /*
+     * Display them.
+     */
+    uint64_t const u64CpuHz = g_pSUPGlobalInfoPage ? SUPGetCpuHzFromGip(g_pSUPGlobalInfoPage) : 0;
+    const char    *pszUnit  = u64CpuHz ? "ns" : "ticks";
+    if (idCpuFirst == idCpuLast)
+        pHlp->pfnPrintf(pHlp, "VM-exit latencies for VCPU %u", idCpuFirst);
+    else
+        pHlp->pfnPrintf(pHlp, "VM-exit latencies summed up for all %u VCPUs", pVM->cCpus);
+    pHlp->pfnPrintf(pHlp, " (times in %s, percentiles are bucket upper bounds):\n", pszUnit);
+    pHlp->pfnPrintf(pHlp, "%-4s %-3s %12s %6s %10s %10s %10s %10s %10s %10s  %s\n",
+                    "Exit", "At", "Count", "Time%", "Avg", "Min", "Max", "P50", "P90", "P99", "Reason");
+    for (unsigned i = 0; i < 2 * HM_EXIT_HIST_REASONS; i++)
+    {
+        HMEXITHISTSUM const *pSum = &paSums[i];
+        if (!pSum->cPeriods)
+            break;
+
+        unsigned const idxHist = pSum->idxHist % HM_EXIT_HIST_REASONS;
+        const char    *pszName = hmR3ExitHistGetName(idxHist);
+        char           szExit[8];
+        if (idxHist == HM_EXIT_HIST_IDX_NPF)
+            RTStrCopy(szExit, sizeof(szExit), "#NPF");
+        else
+            RTStrPrintf(szExit, sizeof(szExit), "%02x", idxHist);
+
+        static const unsigned s_auPercentiles[3] = { 50, 90, 99 };
+        char aszPct[3][24];
+        for (unsigned iPct = 0; iPct < RT_ELEMENTS(s_auPercentiles); iPct++)
+        {
+            uint64_t const cTicksPct = hmR3ExitHistPercentile(pSum->acBuckets, pSum->cPeriods, s_auPercentiles[iPct]);
+            if (cTicksPct == UINT64_MAX)
+                RTStrPrintf(aszPct[iPct], sizeof(aszPct[iPct]), ">%RU64",
+                            hmR3ExitHistTicksToNano(RT_BIT_64(HM_EXIT_HIST_FIRST_SHIFT + HM_EXIT_HIST_BUCKETS - 2), u64CpuHz));
+            else
+                RTStrPrintf(aszPct[iPct], sizeof(aszPct[iPct]), "%RU64", hmR3ExitHistTicksToNano(cTicksPct, u64CpuHz));
+        }
+
+        pHlp->pfnPrintf(pHlp, "%-4s %-3s %12RU64 %6RU64 %10RU64 %10RU64 %10RU64 %10s %10s %10s  %s\n",
+                        szExit, pSum->idxHist >= HM_EXIT_HIST_REASONS ? "R3" : "R0",
+                        pSum->cPeriods,
+                        cTicksTotal ? pSum->cTicks * 100 / cTicksTotal : 0,
+                        hmR3ExitHistTicksToNano(pSum->cTicks / pSum->cPeriods, u64CpuHz),
+                        hmR3ExitHistTicksToNano(pSum->cTicksMin, u64CpuHz),
+                        hmR3ExitHistTicksToNano(pSum->cTicksMax, u64CpuHz),
+                        aszPct[0], aszPct[1], aszPct[2],
+                        pszName ? pszName : "");
+    }
+
+    RTMemFree(paSums);
+}
+
+
 /**
  * Called when a init phase has completed.
  *
@@ -22,9 +22,11 @@
 #define LOG_GROUP LOG_GROUP_EM
 #include <VBox/vmm/iem.h>
 #include <VBox/vmm/cpum.h>
+#include <VBox/vmm/cfgm.h>
 #include "IEMInternal.h"
 #include <VBox/vmm/vm.h>
 #include <VBox/err.h>
+#include <VBox/log.h>
 
 #include <iprt/asm-amd64-x86.h>
 #include <iprt/assert.h>
@@ -42,6 +44,16 @@
  */
 VMMR3DECL(int)      IEMR3Init(PVM pVM)
 {
+    /** @cfgm{/IEM/TlbEnabled, bool, true}
+     * Whether to use the instruction and data TLBs.  When disabled, the guest
+     * page tables are walked again for every instruction.  This is for testing
+     * and benchmarking only. */
+    bool fTlbEnabled;
+    int rc = CFGMR3QueryBoolDef(CFGMR3GetChild(CFGMR3GetRoot(pVM), "IEM"), "TlbEnabled", &fTlbEnabled, true);
+    AssertLogRelRCReturn(rc, rc);
+    if (!fTlbEnabled)
+        LogRel(("IEM: TLBs disabled\n"));
+
     for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
     {
         PVMCPU pVCpu = &pVM->aCpus[idCpu];
@@ -67,6 +79,22 @@ VMMR3DECL(int)      IEMR3Init(PVM pVM)
                         "Approx bytes written",              "/IEM/CPU%u/cbWritten", idCpu);
         STAMR3RegisterF(pVM, &pVCpu->iem.s.cPendingCommit,            STAMTYPE_U32,       STAMVISIBILITY_ALWAYS, STAMUNIT_BYTES,
                         "Times RC/R0 had to postpone instruction committing to ring-3", "/IEM/CPU%u/cPendingCommit", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.cExecForExitsRuns,         STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "IEMExecForExits runs",              "/IEM/CPU%u/cExecForExitsRuns", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.cExecForExitsFFBreaks,     STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "IEMExecForExits runs cut short by forced actions", "/IEM/CPU%u/cExecForExitsFFBreaks", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.CodeTlb.cTlbHits,          STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Code TLB hits",                     "/IEM/CPU%u/CodeTlb-Hits", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.CodeTlb.cTlbMisses,        STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Code TLB misses",                   "/IEM/CPU%u/CodeTlb-Misses", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.CodeTlb.cTlbMapMisses,     STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Code TLB host mapping lookups",     "/IEM/CPU%u/CodeTlb-MapMisses", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbHits,          STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Data TLB hits",                     "/IEM/CPU%u/DataTlb-Hits", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbMisses,        STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Data TLB misses",                   "/IEM/CPU%u/DataTlb-Misses", idCpu);
+        STAMR3RegisterF(pVM, &pVCpu->iem.s.DataTlb.cTlbMapMisses,     STAMTYPE_U32_RESET, STAMVISIBILITY_ALWAYS, STAMUNIT_COUNT,
+                        "Data TLB host mapping lookups",     "/IEM/CPU%u/DataTlb-MapMisses", idCpu);
 
         /*
          * Host and guest CPU information.
@@ -82,6 +110,16 @@ VMMR3DECL(int)      IEMR3Init(PVM pVM)
             pVCpu->iem.s.enmHostCpuVendor         = pVM->aCpus[0].iem.s.enmHostCpuVendor;
         }
 
+        /*
+         * Initialize the TLBs.  The revisions must never be zero, so that
+         * zeroed entries never match.
+         */
+        pVCpu->iem.s.CodeTlb.uTlbRevision = IEMTLB_REVISION_INCR;
+        pVCpu->iem.s.CodeTlb.uTlbPhysRev  = IEMTLB_PHYS_REV_INCR;
+        pVCpu->iem.s.DataTlb.uTlbRevision = IEMTLB_REVISION_INCR;
+        pVCpu->iem.s.DataTlb.uTlbPhysRev  = IEMTLB_PHYS_REV_INCR;
+        pVCpu->iem.s.fTlbDisabled         = !fTlbEnabled;
+
         /*
          * Mark all buffers free.
          */
@@ -86,6 +86,36 @@
  * mapped into the physical memory address space, it can be accessed in a number
  * of ways thru PGM.
  *
+ *
+ * @section sec_iom_lookup      Range Lookup
+ *
+ * The AVL trees are what registration and deregistration work on, but they
+ * are not used for dispatching accesses.  Instead ring-3 builds a sorted array
+ * of the ranges in each tree (IOMIOPORTLOOKUP, IOMMMIOLOOKUP) whenever a tree
+ * changes and publishes it in IOMTREES.  The tables and the range descriptors
+ * are referenced by offsets relative to IOMTREES, which makes them usable in
+ * all contexts without relocation.  A binary search in such a table touches
+ * far fewer cache lines than a tree walk.  In front of the tables each EMT
+ * has a small cache of recently used ranges per context.
+ *
+ * I/O port dispatching does not take the IOM lock at all.  The EMT publishes
+ * the lookup epoch (IOM::uLookupEpoch) it is reading in, looks up the range,
+ * copies the callback details and clears the epoch again before calling the
+ * device (iomLookupEnter, iomLookupLeave).  Ring-3 publishes new tables first
+ * and then advances the epoch.  Tables and range descriptors that have been
+ * unpublished are put on a list and only freed once no EMT is reading in an
+ * epoch older than the one they were retired in.  Since this is checked when
+ * the next change is made, such blocks may stay around for a while.  The
+ * per-EMT caches are flushed whenever the epoch changes.
+ *
+ * MMIO dispatching uses the same tables and caches, but still does so owning
+ * the IOM lock in shared mode as the range descriptors are reference counted
+ * and the callers need it for other reasons anyway.  Likewise, the per-port
+ * and per-address statistics records of statistics builds are still looked up
+ * under the lock since ring-3 creates them lazily.
+ *
+ * The cost of the lookups can be found under /IOM/Lookup/ in the statistics.
+ *
  */
 
 /** @todo MMIO - simplifying the device end.
@@ -162,6 +192,7 @@ VMMR3_INT_DECL(int) IOMR3Init(PVM pVM)
      * Setup any fixed pointers and offsets.
      */
     pVM->iom.s.offVM = RT_OFFSETOF(VM, iom);
+    pVM->iom.s.uLookupEpoch = 2;
 
     /*
      * Initialize the REM critical section.
@@ -231,6 +262,15 @@ VMMR3_INT_DECL(int) IOMR3Init(PVM pVM)
             STAM_REG(pVM, &pVM->iom.s.StatInstOut,            STAMTYPE_COUNTER, "/IOM/IOWork/Out",                          STAMUNIT_OCCURENCES,     "Counter of any OUT instructions.");
             STAM_REG(pVM, &pVM->iom.s.StatInstIns,            STAMTYPE_COUNTER, "/IOM/IOWork/Ins",                          STAMUNIT_OCCURENCES,     "Counter of any INS instructions.");
             STAM_REG(pVM, &pVM->iom.s.StatInstOuts,           STAMTYPE_COUNTER, "/IOM/IOWork/Outs",                         STAMUNIT_OCCURENCES,     "Counter of any OUTS instructions.");
+            STAM_REG(pVM, &pVM->iom.s.StatIOPortLookupRZ,     STAMTYPE_PROFILE, "/IOM/Lookup/RZ-IOPort",                    STAMUNIT_TICKS_PER_CALL, "Profiling of I/O port range lookups in R0/RC.");
+            STAM_REG(pVM, &pVM->iom.s.StatIOPortLookupR3,     STAMTYPE_PROFILE, "/IOM/Lookup/R3-IOPort",                    STAMUNIT_TICKS_PER_CALL, "Profiling of I/O port range lookups in R3.");
+            STAM_REG(pVM, &pVM->iom.s.StatIOPortLookupCacheHits, STAMTYPE_COUNTER, "/IOM/Lookup/IOPortCacheHits",           STAMUNIT_OCCURENCES,     "I/O port range lookups served by the per-VCPU cache.");
+            STAM_REG(pVM, &pVM->iom.s.StatIOPortLookupMisses, STAMTYPE_COUNTER, "/IOM/Lookup/IOPortMisses",                 STAMUNIT_OCCURENCES,     "I/O port range lookups finding no range.");
+            STAM_REG(pVM, &pVM->iom.s.StatMmioLookupRZ,       STAMTYPE_PROFILE, "/IOM/Lookup/RZ-MMIO",                      STAMUNIT_TICKS_PER_CALL, "Profiling of MMIO range lookups in R0/RC.");
+            STAM_REG(pVM, &pVM->iom.s.StatMmioLookupR3,       STAMTYPE_PROFILE, "/IOM/Lookup/R3-MMIO",                      STAMUNIT_TICKS_PER_CALL, "Profiling of MMIO range lookups in R3.");
+            STAM_REG(pVM, &pVM->iom.s.StatMmioLookupCacheHits, STAMTYPE_COUNTER, "/IOM/Lookup/MMIOCacheHits",               STAMUNIT_OCCURENCES,     "MMIO range lookups served by the per-VCPU cache.");
+            STAM_REG(pVM, &pVM->iom.s.StatMmioLookupMisses,   STAMTYPE_COUNTER, "/IOM/Lookup/MMIOMisses",                   STAMUNIT_OCCURENCES,     "MMIO range lookups finding no range.");
+            STAM_REG(pVM, &pVM->iom.s.StatLookupRebuilds,     STAMTYPE_COUNTER, "/IOM/Lookup/Rebuilds",                     STAMUNIT_OCCURENCES,     "Number of times the lookup tables were rebuilt.");
         }
     }
 
@@ -243,7 +283,9 @@ VMMR3_INT_DECL(int) IOMR3Init(PVM pVM)
 
 
 /**
- * Flushes the IOM port & statistics lookup cache
+ * Flushes the IOM port & MMIO statistics lookup cache.
+ *
+ * The range caches are taken care of by the lookup epoch.
  *
  * @param   pVM     The cross context VM structure.
  */
@@ -261,25 +303,16 @@ static void iomR3FlushCache(PVM pVM)
     while (iCpu-- > 0)
     {
         PVMCPU pVCpu = &pVM->aCpus[iCpu];
-        pVCpu->iom.s.pRangeLastReadR0  = NIL_RTR0PTR;
-        pVCpu->iom.s.pRangeLastWriteR0 = NIL_RTR0PTR;
         pVCpu->iom.s.pStatsLastReadR0  = NIL_RTR0PTR;
         pVCpu->iom.s.pStatsLastWriteR0 = NIL_RTR0PTR;
-        pVCpu->iom.s.pMMIORangeLastR0  = NIL_RTR0PTR;
         pVCpu->iom.s.pMMIOStatsLastR0  = NIL_RTR0PTR;
 
-        pVCpu->iom.s.pRangeLastReadR3  = NULL;
-        pVCpu->iom.s.pRangeLastWriteR3 = NULL;
         pVCpu->iom.s.pStatsLastReadR3  = NULL;
         pVCpu->iom.s.pStatsLastWriteR3 = NULL;
-        pVCpu->iom.s.pMMIORangeLastR3  = NULL;
         pVCpu->iom.s.pMMIOStatsLastR3  = NULL;
 
-        pVCpu->iom.s.pRangeLastReadRC  = NIL_RTRCPTR;
-        pVCpu->iom.s.pRangeLastWriteRC = NIL_RTRCPTR;
         pVCpu->iom.s.pStatsLastReadRC  = NIL_RTRCPTR;
         pVCpu->iom.s.pStatsLastWriteRC = NIL_RTRCPTR;
-        pVCpu->iom.s.pMMIORangeLastRC  = NIL_RTRCPTR;
         pVCpu->iom.s.pMMIOStatsLastRC  = NIL_RTRCPTR;
     }
 
@@ -295,6 +328,10 @@ static void iomR3FlushCache(PVM pVM)
 VMMR3_INT_DECL(void) IOMR3Reset(PVM pVM)
 {
     iomR3FlushCache(pVM);
+
+    IOM_LOCK_EXCL(pVM);
+    iomR3LookupReclaim(pVM);
+    IOM_UNLOCK_EXCL(pVM);
 }
 
 
@@ -320,17 +357,16 @@ VMMR3_INT_DECL(void) IOMR3Relocate(PVM pVM, RTGCINTPTR offDelta)
     RTAvlroGCPhysDoWithAll(&pVM->iom.s.pTreesR3->MMIOTree,     true, iomR3RelocateMMIOCallback,   &offDelta);
 
     /*
-     * Reset the raw-mode cache (don't bother relocating it).
+     * Reset the raw-mode statistics cache (don't bother relocating it).
+     * The lookup tables and range caches are offset based and need no
+     * relocating.
      */
     VMCPUID iCpu = pVM->cCpus;
     while (iCpu-- > 0)
     {
         PVMCPU pVCpu = &pVM->aCpus[iCpu];
-        pVCpu->iom.s.pRangeLastReadRC  = NIL_RTRCPTR;
-        pVCpu->iom.s.pRangeLastWriteRC = NIL_RTRCPTR;
         pVCpu->iom.s.pStatsLastReadRC  = NIL_RTRCPTR;
         pVCpu->iom.s.pStatsLastWriteRC = NIL_RTRCPTR;
-        pVCpu->iom.s.pMMIORangeLastRC  = NIL_RTRCPTR;
         pVCpu->iom.s.pMMIOStatsLastRC  = NIL_RTRCPTR;
     }
 }
@@ -605,6 +641,7 @@ VMMR3_INT_DECL(int) IOMR3IOPortRegisterR3(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
         IOM_LOCK_EXCL(pVM);
         if (RTAvlroIOPortInsert(&pVM->iom.s.pTreesR3->IOPortTreeR3, &pRange->Core))
         {
+            iomR3LookupRebuild(pVM, true /*fIOPorts*/, false /*fMmio*/);
 #ifdef VBOX_WITH_STATISTICS
             for (unsigned iPort = 0; iPort < cPorts; iPort++)
                 iomR3IOPortStatsCreate(pVM, PortStart + iPort, pszDesc);
@@ -726,6 +763,7 @@ VMMR3_INT_DECL(int) IOMR3IOPortRegisterRC(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
          */
         if (RTAvlroIOPortInsert(&pVM->iom.s.CTX_SUFF(pTrees)->IOPortTreeRC, &pRange->Core))
         {
+            iomR3LookupRebuild(pVM, true /*fIOPorts*/, false /*fMmio*/);
             IOM_UNLOCK_EXCL(pVM);
             return VINF_SUCCESS;
         }
@@ -841,6 +879,7 @@ VMMR3_INT_DECL(int) IOMR3IOPortRegisterR0(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
          */
         if (RTAvlroIOPortInsert(&pVM->iom.s.CTX_SUFF(pTrees)->IOPortTreeR0, &pRange->Core))
         {
+            iomR3LookupRebuild(pVM, true /*fIOPorts*/, false /*fMmio*/);
             IOM_UNLOCK_EXCL(pVM);
             return VINF_SUCCESS;
         }
@@ -940,7 +979,7 @@ VMMR3_INT_DECL(int) IOMR3IOPortDeregister(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
                 void *pv = RTAvlroIOPortRemove(&pVM->iom.s.pTreesR3->IOPortTreeRC, Port);
                 Assert(pv == (void *)pRange); NOREF(pv);
                 Port += pRange->cPorts;
-                MMHyperFree(pVM, pRange);
+                iomR3LookupRetire(pVM, pRange);
             }
             else if (pRange->Core.Key == Port)
             {
@@ -973,6 +1012,7 @@ VMMR3_INT_DECL(int) IOMR3IOPortDeregister(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
                 int rc2 = MMHyperAlloc(pVM, sizeof(*pRangeNew), 0, MM_TAG_IOM, (void **)&pRangeNew);
                 if (RT_FAILURE(rc2))
                 {
+                    iomR3LookupRebuild(pVM, true /*fIOPorts*/, false /*fMmio*/);
                     IOM_UNLOCK_EXCL(pVM);
                     return rc2;
                 }
@@ -1023,7 +1063,7 @@ VMMR3_INT_DECL(int) IOMR3IOPortDeregister(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
                 void *pv = RTAvlroIOPortRemove(&pVM->iom.s.pTreesR3->IOPortTreeR0, Port);
                 Assert(pv == (void *)pRange); NOREF(pv);
                 Port += pRange->cPorts;
-                MMHyperFree(pVM, pRange);
+                iomR3LookupRetire(pVM, pRange);
             }
             else if (pRange->Core.Key == Port)
             {
@@ -1056,6 +1096,7 @@ VMMR3_INT_DECL(int) IOMR3IOPortDeregister(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
                 int rc2 = MMHyperAlloc(pVM, sizeof(*pRangeNew), 0, MM_TAG_IOM, (void **)&pRangeNew);
                 if (RT_FAILURE(rc2))
                 {
+                    iomR3LookupRebuild(pVM, true /*fIOPorts*/, false /*fMmio*/);
                     IOM_UNLOCK_EXCL(pVM);
                     return rc2;
                 }
@@ -1105,7 +1146,7 @@ VMMR3_INT_DECL(int) IOMR3IOPortDeregister(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
                 void *pv = RTAvlroIOPortRemove(&pVM->iom.s.pTreesR3->IOPortTreeR3, Port);
                 Assert(pv == (void *)pRange); NOREF(pv);
                 Port += pRange->cPorts;
-                MMHyperFree(pVM, pRange);
+                iomR3LookupRetire(pVM, pRange);
             }
             else if (pRange->Core.Key == Port)
             {
@@ -1138,6 +1179,7 @@ VMMR3_INT_DECL(int) IOMR3IOPortDeregister(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
                 int rc2 = MMHyperAlloc(pVM, sizeof(*pRangeNew), 0, MM_TAG_IOM, (void **)&pRangeNew);
                 if (RT_FAILURE(rc2))
                 {
+                    iomR3LookupRebuild(pVM, true /*fIOPorts*/, false /*fMmio*/);
                     IOM_UNLOCK_EXCL(pVM);
                     return rc2;
                 }
@@ -1167,6 +1209,7 @@ VMMR3_INT_DECL(int) IOMR3IOPortDeregister(PVM pVM, PPDMDEVINS pDevIns, RTIOPORT
     } /* for all ports - ring-3. */
 
     /* done */
+    iomR3LookupRebuild(pVM, true /*fIOPorts*/, false /*fMmio*/);
     IOM_UNLOCK_EXCL(pVM);
     return rc;
 }
@@ -1414,6 +1457,7 @@ IOMR3MmioRegisterR3(PVM pVM, PPDMDEVINS pDevIns, RTGCPHYS GCPhysStart, uint32_t
             IOM_LOCK_EXCL(pVM);
             if (RTAvlroGCPhysInsert(&pVM->iom.s.pTreesR3->MMIOTree, &pRange->Core))
             {
+                iomR3LookupRebuild(pVM, false /*fIOPorts*/, true /*fMmio*/);
                 iomR3FlushCache(pVM);
                 IOM_UNLOCK_EXCL(pVM);
                 return VINF_SUCCESS;
@@ -1621,6 +1665,7 @@ VMMR3_INT_DECL(int) IOMR3MmioDeregister(PVM pVM, PPDMDEVINS pDevIns, RTGCPHYS GC
         PIOMMMIORANGE pRange = (PIOMMMIORANGE)RTAvlroGCPhysRemove(&pVM->iom.s.pTreesR3->MMIOTree, GCPhys);
         Assert(pRange);
         Assert(pRange->Core.Key == GCPhys && pRange->Core.KeyLast <= GCPhysLast);
+        iomR3LookupRebuild(pVM, false /*fIOPorts*/, true /*fMmio*/);
         IOM_UNLOCK_EXCL(pVM); /* Lock order fun. */
 
         /* remove it from PGM */
@@ -0,0 +1,301 @@
+/* $Id$ */
+/** @file
+ * IOM - Input / Output Monitor, Range Lookup Tables.
+ */
+
+/*
+ * Copyright (C) 2006-2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_IOM
+#include <VBox/vmm/iom.h>
+#include <VBox/vmm/mm.h>
+#include <VBox/vmm/stam.h>
+#include "IOMInternal.h"
+#include <VBox/vmm/vm.h>
+
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/string.h>
+#include <VBox/log.h>
+#include <VBox/err.h>
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/**
+ * Argument package for the lookup table building callbacks.
+ */
+typedef struct IOMLOOKUPBUILDARGS
+{
+    /** The IOM trees (ring-3). */
+    PIOMTREES           pTrees;
+    /** The I/O port table being filled, NULL when counting. */
+    IOMIOPORTLOOKUP    *pIOPortTable;
+    /** The MMIO table being filled, NULL when counting. */
+    IOMMMIOLOOKUP      *pMmioTable;
+    /** The number of ranges counted or added. */
+    uint32_t            cEntries;
+    /** The number of entries in the table being filled. */
+    uint32_t            cMaxEntries;
+} IOMLOOKUPBUILDARGS;
+/** Pointer to a lookup table building argument package. */
+typedef IOMLOOKUPBUILDARGS *PIOMLOOKUPBUILDARGS;
+
+
+/**
+ * Adds an I/O port range to the table, RTAvlroIOPortDoWithAll callback.
+ *
+ * @returns VINF_SUCCESS, VERR_BUFFER_OVERFLOW if the table is full.
+ * @param   pNode       The range.
+ * @param   pvUser      The IOMLOOKUPBUILDARGS.
+ */
+static DECLCALLBACK(int) iomR3LookupAddIOPortRange(PAVLROIOPORTNODECORE pNode, void *pvUser)
+{
+    PIOMLOOKUPBUILDARGS pArgs = (PIOMLOOKUPBUILDARGS)pvUser;
+    if (pArgs->pIOPortTable)
+    {
+        AssertReturn(pArgs->cEntries < pArgs->cMaxEntries, VERR_BUFFER_OVERFLOW);
+        PIOMIOPORTLOOKUPENTRY pEntry = &pArgs->pIOPortTable->aEntries[pArgs->cEntries];
+        pEntry->uFirstPort = pNode->Key;
+        pEntry->uLastPort  = pNode->KeyLast;
+        pEntry->offRange   = (int32_t)((uintptr_t)pNode - (uintptr_t)pArgs->pTrees);
+    }
+    pArgs->cEntries++;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Adds a MMIO range to the table, RTAvlroGCPhysDoWithAll callback.
+ *
+ * @returns VINF_SUCCESS, VERR_BUFFER_OVERFLOW if the table is full.
+ * @param   pNode       The range.
+ * @param   pvUser      The IOMLOOKUPBUILDARGS.
+ */
+static DECLCALLBACK(int) iomR3LookupAddMmioRange(PAVLROGCPHYSNODECORE pNode, void *pvUser)
+{
+    PIOMLOOKUPBUILDARGS pArgs = (PIOMLOOKUPBUILDARGS)pvUser;
+    if (pArgs->pMmioTable)
+    {
+        AssertReturn(pArgs->cEntries < pArgs->cMaxEntries, VERR_BUFFER_OVERFLOW);
+        PIOMMMIOLOOKUPENTRY pEntry = &pArgs->pMmioTable->aEntries[pArgs->cEntries];
+        pEntry->GCPhysFirst = pNode->Key;
+        pEntry->GCPhysLast  = pNode->KeyLast;
+        pEntry->offRange    = (int32_t)((uintptr_t)pNode - (uintptr_t)pArgs->pTrees);
+        pEntry->u32Padding  = 0;
+    }
+    pArgs->cEntries++;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Builds and publishes the lookup table for one of the I/O port trees.
+ *
+ * @returns VBox status code.  On failure an empty table is published.
+ * @param   pVM         The cross context VM structure.
+ * @param   pTree       The I/O port tree.
+ * @param   poffTable   Where the table offset is published.
+ */
+static int iomR3LookupBuildIOPortTable(PVM pVM, PAVLROIOPORTTREE pTree, int32_t volatile *poffTable)
+{
+    IOMLOOKUPBUILDARGS Args;
+    RT_ZERO(Args);
+    Args.pTrees = pVM->iom.s.pTreesR3;
+    RTAvlroIOPortDoWithAll(pTree, true /*fFromLeft*/, iomR3LookupAddIOPortRange, &Args);
+
+    int32_t offTable = 0;
+    int     rc       = VINF_SUCCESS;
+    if (Args.cEntries)
+    {
+        IOMIOPORTLOOKUP *pTable;
+        rc = MMHyperAlloc(pVM, RT_OFFSETOF(IOMIOPORTLOOKUP, aEntries[Args.cEntries]), 0, MM_TAG_IOM, (void **)&pTable);
+        if (RT_SUCCESS(rc))
+        {
+            Args.pIOPortTable = pTable;
+            Args.cMaxEntries  = Args.cEntries;
+            Args.cEntries     = 0;
+            rc = RTAvlroIOPortDoWithAll(pTree, true /*fFromLeft*/, iomR3LookupAddIOPortRange, &Args);
+            AssertRC(rc);
+            pTable->cEntries = Args.cEntries;
+            offTable = (int32_t)((uintptr_t)pTable - (uintptr_t)Args.pTrees);
+        }
+    }
+
+    int32_t offOld = ASMAtomicXchgS32(poffTable, offTable);
+    if (offOld)
+        iomR3LookupRetire(pVM, IOM_TREES_OFF2PTR(Args.pTrees, offOld, void *));
+    return rc;
+}
+
+
+/**
+ * Builds and publishes the MMIO lookup table.
+ *
+ * @returns VBox status code.  On failure an empty table is published.
+ * @param   pVM         The cross context VM structure.
+ */
+static int iomR3LookupBuildMmioTable(PVM pVM)
+{
+    IOMLOOKUPBUILDARGS Args;
+    RT_ZERO(Args);
+    Args.pTrees = pVM->iom.s.pTreesR3;
+    RTAvlroGCPhysDoWithAll(&Args.pTrees->MMIOTree, true /*fFromLeft*/, iomR3LookupAddMmioRange, &Args);
+
+    int32_t offTable = 0;
+    int     rc       = VINF_SUCCESS;
+    if (Args.cEntries)
+    {
+        IOMMMIOLOOKUP *pTable;
+        rc = MMHyperAlloc(pVM, RT_OFFSETOF(IOMMMIOLOOKUP, aEntries[Args.cEntries]), 0, MM_TAG_IOM, (void **)&pTable);
+        if (RT_SUCCESS(rc))
+        {
+            Args.pMmioTable  = pTable;
+            Args.cMaxEntries = Args.cEntries;
+            Args.cEntries    = 0;
+            rc = RTAvlroGCPhysDoWithAll(&Args.pTrees->MMIOTree, true /*fFromLeft*/, iomR3LookupAddMmioRange, &Args);
+            AssertRC(rc);
+            pTable->cEntries = Args.cEntries;
+            offTable = (int32_t)((uintptr_t)pTable - (uintptr_t)Args.pTrees);
+        }
+    }
+
+    int32_t offOld = ASMAtomicXchgS32(&Args.pTrees->offMmioLookup, offTable);
+    if (offOld)
+        iomR3LookupRetire(pVM, IOM_TREES_OFF2PTR(Args.pTrees, offOld, void *));
+    return rc;
+}
+
+
+/**
+ * Rebuilds the lookup tables after the range trees have been changed.
+ *
+ * The new tables are published before the lookup epoch is advanced, and the
+ * old ones are retired.  See @ref sec_iom_lookup.
+ *
+ * Should building a table fail, an empty one is published in its place and
+ * accesses to the affected ranges will be treated as unassigned until the
+ * next successful rebuild.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   fIOPorts    Whether to rebuild the I/O port tables.
+ * @param   fMmio       Whether to rebuild the MMIO table.
+ *
+ * @remarks Caller must own the IOM lock exclusively.
+ */
+void iomR3LookupRebuild(PVM pVM, bool fIOPorts, bool fMmio)
+{
+    Assert(IOM_IS_EXCL_LOCK_OWNER(pVM));
+    PIOMTREES pTrees = pVM->iom.s.pTreesR3;
+    int rc = VINF_SUCCESS;
+    if (fIOPorts)
+    {
+        int rc2 = iomR3LookupBuildIOPortTable(pVM, &pTrees->IOPortTreeR3, &pTrees->offIOPortLookupR3);
+        if (RT_FAILURE(rc2))
+            rc = rc2;
+        rc2 = iomR3LookupBuildIOPortTable(pVM, &pTrees->IOPortTreeR0, &pTrees->offIOPortLookupR0);
+        if (RT_FAILURE(rc2))
+            rc = rc2;
+        rc2 = iomR3LookupBuildIOPortTable(pVM, &pTrees->IOPortTreeRC, &pTrees->offIOPortLookupRC);
+        if (RT_FAILURE(rc2))
+            rc = rc2;
+    }
+    if (fMmio)
+    {
+        int rc2 = iomR3LookupBuildMmioTable(pVM);
+        if (RT_FAILURE(rc2))
+            rc = rc2;
+    }
+    AssertLogRelMsgRC(rc, ("IOM: Failed to rebuild the lookup tables: %Rrc\n", rc));
+
+    /*
+     * Advance the epoch so the EMTs flush their caches, skipping zero as that
+     * means not-in-a-lookup to the EMTs.
+     */
+    uint32_t uEpoch = ASMAtomicAddU32(&pVM->iom.s.uLookupEpoch, 2) + 2;
+    if (RT_UNLIKELY(uEpoch == 0))
+        ASMAtomicAddU32(&pVM->iom.s.uLookupEpoch, 2);
+    STAM_COUNTER_INC(&pVM->iom.s.StatLookupRebuilds);
+
+    iomR3LookupReclaim(pVM);
+}
+
+
+/**
+ * Retires a lookup table or range descriptor.
+ *
+ * The block will be freed once no EMT can be looking at it any more.  The
+ * caller must advance the lookup epoch afterwards, i.e. call
+ * iomR3LookupRebuild.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   pvHyper     The hypervisor heap block.
+ *
+ * @remarks Caller must own the IOM lock exclusively.
+ */
+void iomR3LookupRetire(PVM pVM, void *pvHyper)
+{
+    Assert(IOM_IS_EXCL_LOCK_OWNER(pVM));
+    PIOMLOOKUPRETIRED pRetired = (PIOMLOOKUPRETIRED)MMR3HeapAlloc(pVM, MM_TAG_IOM, sizeof(*pRetired));
+    if (pRetired)
+    {
+        pRetired->pvHyper = pvHyper;
+        pRetired->uEpoch  = pVM->iom.s.uLookupEpoch + 2;
+        pRetired->pNext   = pVM->iom.s.pLookupRetiredR3;
+        pVM->iom.s.pLookupRetiredR3 = pRetired;
+    }
+    else
+        LogRel(("IOM: Out of memory, leaking retired lookup block %p\n", pvHyper));
+}
+
+
+/**
+ * Frees the retired lookup blocks no EMT can be looking at any more.
+ *
+ * @param   pVM         The cross context VM structure.
+ *
+ * @remarks Caller must own the IOM lock exclusively.
+ */
+void iomR3LookupReclaim(PVM pVM)
+{
+    Assert(IOM_IS_EXCL_LOCK_OWNER(pVM));
+
+    /* Find the oldest epoch an EMT is reading in. */
+    uint32_t uOldest = ASMAtomicReadU32(&pVM->iom.s.uLookupEpoch);
+    for (VMCPUID iCpu = 0; iCpu < pVM->cCpus; iCpu++)
+    {
+        uint32_t const uEpoch = ASMAtomicReadU32(&pVM->aCpus[iCpu].iom.s.uLookupEpoch);
+        if (uEpoch && (int32_t)(uEpoch - uOldest) < 0)
+            uOldest = uEpoch;
+    }
+
+    /* Free anything retired before or in that epoch. */
+    PIOMLOOKUPRETIRED *ppPrev = &pVM->iom.s.pLookupRetiredR3;
+    PIOMLOOKUPRETIRED  pCur;
+    while ((pCur = *ppPrev) != NULL)
+    {
+        if ((int32_t)(uOldest - pCur->uEpoch) >= 0)
+        {
+            *ppPrev = pCur->pNext;
+            MMHyperFree(pVM, pCur->pvHyper);
+            MMR3HeapFree(pCur);
+        }
+        else
+            ppPrev = &pCur->pNext;
+    }
+}
+
@@ -23,7 +23,10 @@
 #include "PDMInternal.h"
 #include <VBox/vmm/pdmcritsect.h>
 #include <VBox/vmm/pdmcritsectrw.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/dbgf.h>
 #include <VBox/vmm/mm.h>
+#include <VBox/vmm/tm.h>
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
 
@@ -42,6 +45,7 @@
 *********************************************************************************************************************************/
 static int pdmR3CritSectDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTINT pCritSect, PPDMCRITSECTINT pPrev, bool fFinal);
 static int pdmR3CritSectRwDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTRWINT pCritSect, PPDMCRITSECTRWINT pPrev, bool fFinal);
+static FNDBGFHANDLERINT pdmR3CritSectInfoStats;
 
 
 
@@ -55,10 +59,85 @@ int pdmR3CritSectBothInitStats(PVM pVM)
 {
     STAM_REG(pVM, &pVM->pdm.s.StatQueuedCritSectLeaves, STAMTYPE_COUNTER, "/PDM/QueuedCritSectLeaves", STAMUNIT_OCCURENCES,
              "Number of times a critical section leave request needed to be queued for ring-3 execution.");
+    DBGFR3InfoRegisterInternal(pVM, "critsectstats",
+                               "Critical section contention profiles (PDM/CritSectProfiling). Args: [name substring]",
+                               pdmR3CritSectInfoStats);
     return VINF_SUCCESS;
 }
 
 
+/**
+ * Sets up contention profiling for a new critical section if enabled.
+ *
+ * Profiling is enabled by the PDM/CritSectProfiling CFGM key.  The profiles
+ * live in a single hyper heap allocation that is made when the first one is
+ * needed, as several critical sections are created before PDMR3Init.  Profiles
+ * are not recycled when a critical section is deleted.
+ *
+ * @returns The profile index (1-based), 0 if not profiled.
+ * @param   pVM             The cross context VM structure.
+ * @param   pszPrefix       The statistics prefix ("/PDM/CritSects" or
+ *                          "/PDM/CritSectsRw").
+ * @param   pszName         The critical section name.
+ */
+static uint16_t pdmR3CritSectProfileAlloc(PVM pVM, const char *pszPrefix, const char *pszName)
+{
+    bool fEnabled;
+    int rc = CFGMR3QueryBoolDef(CFGMR3GetChild(CFGMR3GetRoot(pVM), "PDM"), "CritSectProfiling", &fEnabled, false);
+    if (RT_FAILURE(rc) || !fEnabled)
+        return 0;
+
+    PUVM pUVM = pVM->pUVM;
+    RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
+
+    if (!pVM->pdm.s.offCritSectProfiles)
+    {
+        uint32_t const cb = RT_ALIGN_32(RT_OFFSETOF(PDMCRITSECTPROFILE, acWaitsByCpu[0])
+                                        + (pVM->cCpus + 1) * sizeof(uint32_t), 64);
+        void *pv;
+        rc = MMHyperAlloc(pVM, cb * PDMCRITSECTPROF_MAX, 64, MM_TAG_PDM, &pv);
+        if (RT_FAILURE(rc))
+        {
+            RTCritSectLeave(&pUVM->pdm.s.ListCritSect);
+            LogRel(("PDM: Failed to allocate critical section profiles: %Rrc\n", rc));
+            return 0;
+        }
+        pVM->pdm.s.cbCritSectProfile    = cb;
+        pVM->pdm.s.cCritSectProfileCpus = pVM->cCpus;
+        pVM->pdm.s.offCritSectProfiles  = MMHyperHeapPtrToOffset(pVM, pv);
+    }
+
+    if (pVM->pdm.s.cCritSectProfiles >= PDMCRITSECTPROF_MAX)
+    {
+        RTCritSectLeave(&pUVM->pdm.s.ListCritSect);
+        LogRel(("PDM: Out of critical section profiles, not profiling '%s'\n", pszName));
+        return 0;
+    }
+    uint16_t const idxProfile = (uint16_t)++pVM->pdm.s.cCritSectProfiles;
+
+    RTCritSectLeave(&pUVM->pdm.s.ListCritSect);
+
+    /*
+     * Register the statistics.
+     */
+    PPDMCRITSECTPROFILE pProf = pdmCritSectProfileGet(pVM, idxProfile);
+    pProf->StatWait.cTicksMin = UINT64_MAX;
+    pProf->StatHold.cTicksMin = UINT64_MAX;
+    STAMR3RegisterF(pVM, &pProf->StatWait, STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,
+                    "Time spent waiting for the section.", "%s/%s/Prof/Wait", pszPrefix, pszName);
+    STAMR3RegisterF(pVM, &pProf->StatHold, STAMTYPE_PROFILE, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_CALL,
+                    "Time the section is held.", "%s/%s/Prof/Hold", pszPrefix, pszName);
+    for (unsigned i = 0; i < PDMCRITSECTPROF_HIST_BUCKETS; i++)
+    {
+        STAMR3RegisterF(pVM, (void *)&pProf->acWaitHist[i], STAMTYPE_U32, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
+                        "Wait time histogram bucket.", "%s/%s/Prof/WaitHist/%02u", pszPrefix, pszName, i);
+        STAMR3RegisterF(pVM, &pProf->acHoldHist[i], STAMTYPE_U32, STAMVISIBILITY_USED, STAMUNIT_OCCURENCES,
+                        "Hold time histogram bucket.", "%s/%s/Prof/HoldHist/%02u", pszPrefix, pszName, i);
+    }
+    return idxProfile;
+}
+
+
 /**
  * Relocates all the critical sections.
  *
@@ -184,12 +263,15 @@ static int pdmR3CritSectInitOne(PVM pVM, PPDMCRITSECTINT pCritSect, void *pvKey,
                 pCritSect->hEventToSignal            = NIL_SUPSEMEVENT;
                 pCritSect->pszName                   = pszName;
 
+                pCritSect->idxProfile                = 0;
+
                 STAMR3RegisterF(pVM, &pCritSect->StatContentionRZLock,  STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,          NULL, "/PDM/CritSects/%s/ContentionRZLock", pCritSect->pszName);
                 STAMR3RegisterF(pVM, &pCritSect->StatContentionRZUnlock,STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,          NULL, "/PDM/CritSects/%s/ContentionRZUnlock", pCritSect->pszName);
                 STAMR3RegisterF(pVM, &pCritSect->StatContentionR3,      STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,          NULL, "/PDM/CritSects/%s/ContentionR3", pCritSect->pszName);
 #ifdef VBOX_WITH_STATISTICS
                 STAMR3RegisterF(pVM, &pCritSect->StatLocked,        STAMTYPE_PROFILE_ADV, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_OCCURENCE, NULL, "/PDM/CritSects/%s/Locked", pCritSect->pszName);
 #endif
+                pCritSect->idxProfile                = pdmR3CritSectProfileAlloc(pVM, "/PDM/CritSects", pCritSect->pszName);
 
                 PUVM pUVM = pVM->pUVM;
                 RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
@@ -276,6 +358,10 @@ static int pdmR3CritSectRwInitOne(PVM pVM, PPDMCRITSECTRWINT pCritSect, void *pv
                     pCritSect->pVMRC                     = pVM->pVMRC;
                     pCritSect->pvKey                     = pvKey;
                     pCritSect->pszName                   = pszName;
+#if HC_ARCH_BITS == 64
+                    pCritSect->idxProfile                = 0;
+                    pCritSect->u16Padding                = 0;
+#endif
 
                     STAMR3RegisterF(pVM, &pCritSect->StatContentionRZEnterExcl,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,          NULL, "/PDM/CritSectsRw/%s/ContentionRZEnterExcl", pCritSect->pszName);
                     STAMR3RegisterF(pVM, &pCritSect->StatContentionRZLeaveExcl,   STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, STAMUNIT_OCCURENCES,          NULL, "/PDM/CritSectsRw/%s/ContentionRZLeaveExcl", pCritSect->pszName);
@@ -290,6 +376,9 @@ static int pdmR3CritSectRwInitOne(PVM pVM, PPDMCRITSECTRWINT pCritSect, void *pv
 #ifdef VBOX_WITH_STATISTICS
                     STAMR3RegisterF(pVM, &pCritSect->StatWriteLocked,         STAMTYPE_PROFILE_ADV, STAMVISIBILITY_ALWAYS, STAMUNIT_TICKS_PER_OCCURENCE, NULL, "/PDM/CritSectsRw/%s/WriteLocked", pCritSect->pszName);
 #endif
+#if HC_ARCH_BITS == 64
+                    pCritSect->idxProfile                = pdmR3CritSectProfileAlloc(pVM, "/PDM/CritSectsRw", pCritSect->pszName);
+#endif
 
                     PUVM pUVM = pVM->pUVM;
                     RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
@@ -529,6 +618,7 @@ static int pdmR3CritSectDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTINT pCritSect,
     pCritSect->pVMR3   = NULL;
     pCritSect->pVMR0   = NIL_RTR0PTR;
     pCritSect->pVMRC   = NIL_RTRCPTR;
+    pCritSect->idxProfile = 0;
     if (!fFinal)
         STAMR3DeregisterF(pVM->pUVM, "/PDM/CritSects/%s/*", pCritSect->pszName);
     RTStrFree((char *)pCritSect->pszName);
@@ -600,6 +690,9 @@ static int pdmR3CritSectRwDeleteOne(PVM pVM, PUVM pUVM, PPDMCRITSECTRWINT pCritS
     pCritSect->pVMR3   = NULL;
     pCritSect->pVMR0   = NIL_RTR0PTR;
     pCritSect->pVMRC   = NIL_RTRCPTR;
+#if HC_ARCH_BITS == 64
+    pCritSect->idxProfile = 0;
+#endif
     if (!fFinal)
         STAMR3DeregisterF(pVM->pUVM, "/PDM/CritSectsRw/%s/*", pCritSect->pszName);
     RTStrFree((char *)pCritSect->pszName);
@@ -1073,3 +1166,153 @@ VMMR3DECL(RCPTRTYPE(PPDMCRITSECT))  PDMR3CritSectGetNopRC(PVM pVM)
     return MMHyperR3ToRC(pVM, &pVM->pdm.s.NopCritSect);
 }
 
+
+
+/**
+ * Converts TSC ticks to nanoseconds for the critsectstats info handler.
+ *
+ * @returns Nanoseconds.
+ * @param   cTicks          The number of ticks.
+ * @param   cTicksPerUs     The number of ticks per microsecond.
+ */
+DECLINLINE(uint64_t) pdmR3CritSectInfoTicksToNs(uint64_t cTicks, uint64_t cTicksPerUs)
+{
+    return cTicks < UINT64_MAX / 1000 ? cTicks * 1000 / cTicksPerUs : cTicks / cTicksPerUs * 1000;
+}
+
+
+/**
+ * Displays one critical section contention profile.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pHlp            The info helpers.
+ * @param   pszType         The critical section type for display.
+ * @param   pszName         The critical section name.
+ * @param   idxProfile      The profile index (1-based).
+ * @param   cTicksPerUs     The number of ticks per microsecond.
+ */
+static void pdmR3CritSectInfoStatsOne(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszType, const char *pszName,
+                                      uint16_t idxProfile, uint64_t cTicksPerUs)
+{
+    PPDMCRITSECTPROFILE pProf = pdmCritSectProfileGet(pVM, idxProfile);
+    uint64_t const      cWaits = pProf->StatWait.cPeriods;
+    uint64_t const      cHolds = pProf->StatHold.cPeriods;
+    pHlp->pfnPrintf(pHlp, "%s '%s':\n", pszType, pszName);
+    pHlp->pfnPrintf(pHlp, "  Waits: %'11RU64  avg %'11RU64 ns  max %'13RU64 ns\n",
+                    cWaits, cWaits ? pdmR3CritSectInfoTicksToNs(pProf->StatWait.cTicks / cWaits, cTicksPerUs) : 0,
+                    pdmR3CritSectInfoTicksToNs(pProf->StatWait.cTicksMax, cTicksPerUs));
+    pHlp->pfnPrintf(pHlp, "  Holds: %'11RU64  avg %'11RU64 ns  max %'13RU64 ns\n",
+                    cHolds, cHolds ? pdmR3CritSectInfoTicksToNs(pProf->StatHold.cTicks / cHolds, cTicksPerUs) : 0,
+                    pdmR3CritSectInfoTicksToNs(pProf->StatHold.cTicksMax, cTicksPerUs));
+
+    /*
+     * The histograms, skipping empty buckets.
+     */
+    for (unsigned i = 0; i < PDMCRITSECTPROF_HIST_BUCKETS; i++)
+        if (pProf->acWaitHist[i] || pProf->acHoldHist[i])
+        {
+            uint64_t const cTicksFirst = i ? RT_BIT_64(8 + 2 * i) : 0;
+            if (i + 1 < PDMCRITSECTPROF_HIST_BUCKETS)
+                pHlp->pfnPrintf(pHlp, "  %'13RU64 - %'13RU64 ns: waits %'10u  holds %'10u\n",
+                                pdmR3CritSectInfoTicksToNs(cTicksFirst, cTicksPerUs),
+                                pdmR3CritSectInfoTicksToNs(RT_BIT_64(10 + 2 * i), cTicksPerUs),
+                                pProf->acWaitHist[i], pProf->acHoldHist[i]);
+            else
+                pHlp->pfnPrintf(pHlp, "  %'13RU64 ns and up      : waits %'10u  holds %'10u\n",
+                                pdmR3CritSectInfoTicksToNs(cTicksFirst, cTicksPerUs),
+                                pProf->acWaitHist[i], pProf->acHoldHist[i]);
+        }
+
+    /*
+     * Waits per virtual CPU.
+     */
+    if (cWaits)
+    {
+        pHlp->pfnPrintf(pHlp, "  Waits by VCPU:");
+        for (uint32_t idCpu = 0; idCpu < pVM->pdm.s.cCritSectProfileCpus; idCpu++)
+            pHlp->pfnPrintf(pHlp, " #%u=%u", idCpu, pProf->acWaitsByCpu[idCpu]);
+        pHlp->pfnPrintf(pHlp, " other=%u\n", pProf->acWaitsByCpu[pVM->pdm.s.cCritSectProfileCpus]);
+    }
+
+    /*
+     * The call sites, sorted by time spent waiting.  We take a copy as the
+     * owner may be updating the table while we're looking at it.
+     */
+    PDMCRITSECTPROFCALLER aCallers[PDMCRITSECTPROF_CALLERS];
+    unsigned              cCallers = 0;
+    for (unsigned i = 0; i < RT_ELEMENTS(aCallers); i++)
+        if (pProf->aCallers[i].uCaller)
+        {
+            PDMCRITSECTPROFCALLER Caller = pProf->aCallers[i];
+            unsigned j = cCallers++;
+            while (j > 0 && aCallers[j - 1].cTicksWaited < Caller.cTicksWaited)
+            {
+                aCallers[j] = aCallers[j - 1];
+                j--;
+            }
+            aCallers[j] = Caller;
+        }
+
+    static const char * const s_apszCtx[] = { "R3", "R0", "RC" };
+    for (unsigned i = 0; i < cCallers; i++)
+    {
+        char        szSym[128];
+        RTDBGSYMBOL Sym;
+        RTGCINTPTR  offDisp = 0;
+        int         rc      = VERR_NOT_SUPPORTED;
+        if (aCallers[i].iCtx != PDMCRITSECTPROF_CTX_R3)
+        {
+            DBGFADDRESS Addr;
+            rc = DBGFR3AsSymbolByAddr(pVM->pUVM,
+                                      aCallers[i].iCtx == PDMCRITSECTPROF_CTX_R0 ? DBGF_AS_R0 : DBGF_AS_RC_AND_GC_GLOBAL,
+                                      DBGFR3AddrFromFlat(pVM->pUVM, &Addr, aCallers[i].uCaller),
+                                      RTDBGSYMADDR_FLAGS_LESS_OR_EQUAL, &offDisp, &Sym, NULL);
+        }
+        if (RT_SUCCESS(rc))
+            RTStrPrintf(szSym, sizeof(szSym), "%s+%#RGv", Sym.szName, offDisp);
+        else
+            szSym[0] = '\0';
+        pHlp->pfnPrintf(pHlp, "  %s %016RX64 %s: waits %'10u  total %'13RU64 ns\n",
+                        s_apszCtx[aCallers[i].iCtx < RT_ELEMENTS(s_apszCtx) ? aCallers[i].iCtx : 0],
+                        aCallers[i].uCaller, szSym, aCallers[i].cWaits,
+                        pdmR3CritSectInfoTicksToNs(aCallers[i].cTicksWaited, cTicksPerUs));
+    }
+}
+
+
+/**
+ * @callback_method_impl{FNDBGFHANDLERINT, critsectstats}
+ */
+static DECLCALLBACK(void) pdmR3CritSectInfoStats(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs)
+{
+    if (!pVM->pdm.s.cCritSectProfiles)
+    {
+        pHlp->pfnPrintf(pHlp, "Critical section profiling is disabled (PDM/CritSectProfiling).\n");
+        return;
+    }
+    if (pszArgs)
+    {
+        pszArgs = RTStrStripL(pszArgs);
+        if (!*pszArgs)
+            pszArgs = NULL;
+    }
+
+    uint64_t cTicksPerUs = TMCpuTicksPerSecond(pVM) / RT_US_1SEC;
+    if (!cTicksPerUs)
+        cTicksPerUs = 1;
+
+    PUVM pUVM = pVM->pUVM;
+    RTCritSectEnter(&pUVM->pdm.s.ListCritSect);
+
+    for (PPDMCRITSECTINT pCur = pUVM->pdm.s.pCritSects; pCur; pCur = pCur->pNext)
+        if (   pCur->idxProfile
+            && (!pszArgs || strstr(pCur->pszName, pszArgs)))
+            pdmR3CritSectInfoStatsOne(pVM, pHlp, "critsect", pCur->pszName, pCur->idxProfile, cTicksPerUs);
+
+    for (PPDMCRITSECTRWINT pCur = pUVM->pdm.s.pRwCritSects; pCur; pCur = pCur->pNext)
+        if (   PDMCRITSECTRWINT_PROFILE_IDX(pCur)
+            && (!pszArgs || strstr(pCur->pszName, pszArgs)))
+            pdmR3CritSectInfoStatsOne(pVM, pHlp, "critsect-rw", pCur->pszName, PDMCRITSECTRWINT_PROFILE_IDX(pCur), cTicksPerUs);
+
+    RTCritSectLeave(&pUVM->pdm.s.ListCritSect);
+}
@@ -36,9 +36,11 @@
 #include <iprt/thread.h>
 #include <iprt/mem.h>
 #include <iprt/critsect.h>
+#include <iprt/semaphore.h>
 #include <iprt/tcp.h>
 #include <iprt/path.h>
 #include <iprt/string.h>
+#include <iprt/time.h>
 
 #include <VBox/vmm/pdmnetshaper.h>
 #include "PDMNetShaperInternal.h"
@@ -59,6 +61,10 @@ typedef struct PDMNETSHAPER
     RTCRITSECT               Lock;
     /** Pending TX thread. */
     PPDMTHREAD               pTxThread;
+    /** Event semaphore the TX thread waits on. */
+    RTSEMEVENT               hEvtTx;
+    /** The time (RTTimeSystemNanoTS) the TX thread intends to sleep until. */
+    volatile uint64_t        tsTxSleepUntil;
     /** Pointer to the first bandwidth group. */
     PPDMNSBWGROUP            pBwGroupsHead;
 } PDMNETSHAPER;
@@ -136,10 +142,9 @@ static void pdmNsBwGroupUnlink(PPDMNSBWGROUP pBwGroup)
 
 static void pdmNsBwGroupSetLimit(PPDMNSBWGROUP pBwGroup, uint64_t cbPerSecMax)
 {
-    pBwGroup->cbPerSecMax = cbPerSecMax;
-    pBwGroup->cbBucket    = RT_MAX(PDM_NETSHAPER_MIN_BUCKET_SIZE, cbPerSecMax * PDM_NETSHAPER_MAX_LATENCY / 1000);
-    LogFlow(("pdmNsBwGroupSetLimit: New rate limit is %llu bytes per second, adjusted bucket size to %u bytes\n",
-             pBwGroup->cbPerSecMax, pBwGroup->cbBucket));
+    pdmNsBwGroupCalcLimits(pBwGroup, cbPerSecMax);
+    LogFlow(("pdmNsBwGroupSetLimit: New rate limit is %llu bytes per second, adjusted bucket size to %u bytes (credit chunk %u bytes)\n",
+             pBwGroup->cbPerSecMax, pBwGroup->cbBucket, pBwGroup->cbCreditChunk));
 }
 
 
@@ -170,8 +175,8 @@ static int pdmNsBwGroupCreate(PPDMNETSHAPER pShaper, const char *pszBwGroup, uin
 
                     pdmNsBwGroupSetLimit(pBwGroup, cbPerSecMax);
 
-                    pBwGroup->cbTokensLast          = pBwGroup->cbBucket;
-                    pBwGroup->tsUpdatedLast         = RTTimeSystemNanoTS();
+                    pBwGroup->tsTat                 = RTTimeSystemNanoTS(); /* full bucket */
+                    pBwGroup->tsNextWakeup          = UINT64_MAX;
 
                     LogFlowFunc(("pszBwGroup={%s} cbBucket=%u\n",
                                  pszBwGroup, pBwGroup->cbBucket));
@@ -214,7 +219,15 @@ DECLINLINE(void) pdmNsBwGroupUnref(PPDMNSBWGROUP pBwGroup)
 }
 
 
-static void pdmNsBwGroupXmitPending(PPDMNSBWGROUP pBwGroup)
+/**
+ * Wakes up the choked filters of a bandwidth group whose deadline has passed.
+ *
+ * @returns The earliest deadline of the filters still waiting, UINT64_MAX if
+ *          none.
+ * @param   pBwGroup    The bandwidth group.
+ * @param   tsNow       The current RTTimeSystemNanoTS.
+ */
+static uint64_t pdmNsBwGroupXmitPending(PPDMNSBWGROUP pBwGroup, uint64_t tsNow)
 {
     /*
      * We don't need to hold the bandwidth group lock to iterate over the list
@@ -224,27 +237,55 @@ static void pdmNsBwGroupXmitPending(PPDMNSBWGROUP pBwGroup)
     AssertPtr(pBwGroup);
     AssertPtr(pBwGroup->pShaperR3);
     Assert(RTCritSectIsOwner(&pBwGroup->pShaperR3->Lock));
-    //LOCK_NETSHAPER(pShaper);
 
-    /* Check if the group is disabled. */
-    if (pBwGroup->cbPerSecMax == 0)
-        return;
+    /* Nothing is due yet? */
+    uint64_t tsNextWakeup = ASMAtomicReadU64(&pBwGroup->tsNextWakeup);
+    if (tsNextWakeup > tsNow)
+        return tsNextWakeup;
+
+    /*
+     * Reset the schedule before looking at the filters.  A filter choking
+     * concurrently sets fChoked before lowering tsNextWakeup, so it is either
+     * seen below or lowers the schedule again afterwards.
+     */
+    ASMAtomicWriteU64(&pBwGroup->tsNextWakeup, UINT64_MAX);
+    tsNextWakeup = UINT64_MAX;
+
+    /* A disabled group never chokes, wake up whoever is left over from before. */
+    bool const fDisabled = pBwGroup->cbPerSecMax == 0;
 
     PPDMNSFILTER pFilter = pBwGroup->pFiltersHeadR3;
     while (pFilter)
     {
-        bool fChoked = ASMAtomicXchgBool(&pFilter->fChoked, false);
-        Log3((LOG_FN_FMT ": pFilter=%#p fChoked=%RTbool\n", __PRETTY_FUNCTION__, pFilter, fChoked));
-        if (fChoked && pFilter->pIDrvNetR3)
+        if (ASMAtomicReadBool(&pFilter->fChoked))
         {
-            LogFlowFunc(("Calling pfnXmitPending for pFilter=%#p\n", pFilter));
-            pFilter->pIDrvNetR3->pfnXmitPending(pFilter->pIDrvNetR3);
+            uint64_t const tsWakeup = ASMAtomicReadU64(&pFilter->tsWakeup);
+            if (tsWakeup <= tsNow || fDisabled)
+            {
+                bool fChoked = ASMAtomicXchgBool(&pFilter->fChoked, false);
+                Log3((LOG_FN_FMT ": pFilter=%#p fChoked=%RTbool\n", __PRETTY_FUNCTION__, pFilter, fChoked));
+                if (fChoked && pFilter->pIDrvNetR3)
+                {
+                    LogFlowFunc(("Calling pfnXmitPending for pFilter=%#p\n", pFilter));
+                    pFilter->pIDrvNetR3->pfnXmitPending(pFilter->pIDrvNetR3);
+                }
+            }
+            else
+                tsNextWakeup = RT_MIN(tsNextWakeup, tsWakeup);
         }
 
         pFilter = pFilter->pNextR3;
     }
 
-    //UNLOCK_NETSHAPER(pShaper);
+    /* Merge the remaining deadlines back into the schedule. */
+    if (tsNextWakeup != UINT64_MAX)
+    {
+        uint64_t tsCur = ASMAtomicReadU64(&pBwGroup->tsNextWakeup);
+        while (   tsNextWakeup < tsCur
+               && !ASMAtomicCmpXchgExU64(&pBwGroup->tsNextWakeup, tsNextWakeup, tsCur, &tsCur))
+        { /* likely */ }
+    }
+    return ASMAtomicReadU64(&pBwGroup->tsNextWakeup);
 }
 
 
@@ -321,6 +362,8 @@ VMMR3_INT_DECL(int) PDMR3NsAttach(PUVM pUVM, PPDMDRVINS pDrvIns, const char *psz
 
     if (RT_SUCCESS(rc))
     {
+        pFilter->cbCredit   = 0;
+        pFilter->uCreditGen = 0;
         PPDMNSBWGROUP pBwGroupOld = ASMAtomicXchgPtrT(&pFilter->pBwGroupR3, pBwGroupNew, PPDMNSBWGROUP);
         ASMAtomicWritePtr(&pFilter->pBwGroupR0, MMHyperR3ToR0(pUVM->pVM, pBwGroupNew));
         if (pBwGroupOld)
@@ -387,9 +430,16 @@ VMMR3DECL(int) PDMR3NsBwGroupSetLimit(PUVM pUVM, const char *pszBwGroup, uint64_
         {
             pdmNsBwGroupSetLimit(pBwGroup, cbPerSecMax);
 
-            /* Drop extra tokens */
-            if (pBwGroup->cbTokensLast > pBwGroup->cbBucket)
-                pBwGroup->cbTokensLast = pBwGroup->cbBucket;
+            /* Don't let the debt accumulated under the old limit exceed an empty bucket. */
+            uint64_t const tsNow = RTTimeSystemNanoTS();
+            uint64_t       tsTat = ASMAtomicReadU64(&pBwGroup->tsTat);
+            while (   tsTat > tsNow + pBwGroup->cNsBucket
+                   && !ASMAtomicCmpXchgExU64(&pBwGroup->tsTat, tsNow + pBwGroup->cNsBucket, tsTat, &tsTat))
+            { /* likely */ }
+
+            /* Let the TX thread re-evaluate the waiting filters under the new limit. */
+            ASMAtomicWriteU64(&pBwGroup->tsNextWakeup, tsNow);
+            RTSemEventSignal(pShaper->hEvtTx);
 
             int rc2 = PDMCritSectLeave(&pBwGroup->Lock); AssertRC(rc2);
         }
@@ -402,9 +452,28 @@ VMMR3DECL(int) PDMR3NsBwGroupSetLimit(PUVM pUVM, const char *pszBwGroup, uint64_
 }
 
 
+/**
+ * Makes sure the TX thread wakes up no later than the given deadline.
+ *
+ * Called in ring-3 when a filter gets choked.
+ *
+ * @param   pShaper         The network shaper.
+ * @param   tsDeadline      The deadline (RTTimeSystemNanoTS).
+ */
+void pdmR3NsTxKick(PPDMNETSHAPER pShaper, uint64_t tsDeadline)
+{
+    if (tsDeadline < ASMAtomicReadU64(&pShaper->tsTxSleepUntil))
+        RTSemEventSignal(pShaper->hEvtTx);
+}
+
+
 /**
  * I/O thread for pending TX.
  *
+ * Sleeps until the earliest deadline of the choked filters, but never longer
+ * than PDM_NETSHAPER_MAX_LATENCY (deadlines recorded in ring-0 cannot kick the
+ * thread).
+ *
  * @returns VINF_SUCCESS (ignored).
  * @param   pVM         The cross context VM structure.
  * @param   pThread     The PDM thread data.
@@ -415,17 +484,28 @@ static DECLCALLBACK(int) pdmR3NsTxThread(PVM pVM, PPDMTHREAD pThread)
     LogFlow(("pdmR3NsTxThread: pShaper=%p\n", pShaper));
     while (pThread->enmState == PDMTHREADSTATE_RUNNING)
     {
-        RTThreadSleep(PDM_NETSHAPER_MAX_LATENCY);
-
-        /* Go over all bandwidth groups/filters calling pfnXmitPending */
+        /* Go over all bandwidth groups whose earliest deadline has passed. */
+        uint64_t tsNow        = RTTimeSystemNanoTS();
+        uint64_t tsNextWakeup = tsNow + PDM_NETSHAPER_MAX_LATENCY * RT_NS_1MS;
         LOCK_NETSHAPER(pShaper);
         PPDMNSBWGROUP pBwGroup = pShaper->pBwGroupsHead;
         while (pBwGroup)
         {
-            pdmNsBwGroupXmitPending(pBwGroup);
+            tsNextWakeup = RT_MIN(tsNextWakeup, pdmNsBwGroupXmitPending(pBwGroup, tsNow));
             pBwGroup = pBwGroup->pNextR3;
         }
         UNLOCK_NETSHAPER(pShaper);
+
+        /* Publish the deadline before checking it, pdmR3NsTxKick relies on it. */
+        ASMAtomicWriteU64(&pShaper->tsTxSleepUntil, tsNextWakeup);
+        tsNow = RTTimeSystemNanoTS();
+        if (tsNextWakeup > tsNow)
+        {
+            RTMSINTERVAL cMillies = (RTMSINTERVAL)((tsNextWakeup - tsNow + RT_NS_1MS - 1) / RT_NS_1MS);
+            int rc = RTSemEventWait(pShaper->hEvtTx, cMillies);
+            AssertLogRelMsgReturn(RT_SUCCESS(rc) || rc == VERR_TIMEOUT, ("%Rrc\n", rc), rc);
+        }
+        ASMAtomicWriteU64(&pShaper->tsTxSleepUntil, 0);
     }
     return VINF_SUCCESS;
 }
@@ -438,8 +518,7 @@ static DECLCALLBACK(int) pdmR3NsTxWakeUp(PVM pVM, PPDMTHREAD pThread)
 {
     PPDMNETSHAPER pShaper = (PPDMNETSHAPER)pThread->pvUser;
     LogFlow(("pdmR3NsTxWakeUp: pShaper=%p\n", pShaper));
-    /* Nothing to do */
-    return VINF_SUCCESS;
+    return RTSemEventSignal(pShaper->hEvtTx);
 }
 
 
@@ -470,6 +549,8 @@ int pdmR3NetShaperTerm(PVM pVM)
     }
 
     RTCritSectDelete(&pShaper->Lock);
+    RTSemEventDestroy(pShaper->hEvtTx);
+    pShaper->hEvtTx = NIL_RTSEMEVENT;
     return VINF_SUCCESS;
 }
 
@@ -494,7 +575,9 @@ int pdmR3NetShaperInit(PVM pVM)
         PCFGMNODE pCfgNetShaper = CFGMR3GetChild(CFGMR3GetChild(CFGMR3GetRoot(pVM), "PDM"), "NetworkShaper");
 
         pShaper->pVM = pVM;
-        rc = RTCritSectInit(&pShaper->Lock);
+        rc = RTSemEventCreate(&pShaper->hEvtTx);
+        if (RT_SUCCESS(rc))
+            rc = RTCritSectInit(&pShaper->Lock);
         if (RT_SUCCESS(rc))
         {
             /* Create all bandwidth groups. */
@@ -541,6 +624,8 @@ int pdmR3NetShaperInit(PVM pVM)
 
             RTCritSectDelete(&pShaper->Lock);
         }
+        if (pShaper->hEvtTx != NIL_RTSEMEVENT)
+            RTSemEventDestroy(pShaper->hEvtTx);
 
         MMR3HeapFree(pShaper);
     }
@@ -622,6 +622,7 @@
 #include <VBox/sup.h>
 #include <VBox/vmm/mm.h>
 #include <VBox/vmm/em.h>
+#include <VBox/vmm/iem.h>
 #include <VBox/vmm/stam.h>
 #ifdef VBOX_WITH_REM
 # include <VBox/vmm/rem.h>
@@ -1364,6 +1365,30 @@ VMMR3DECL(int) PGMR3Init(PVM pVM)
     rc = CFGMR3QueryBoolDef(CFGMR3GetRoot(pVM), "PageFusionAllowed", &pVM->pgm.s.fPageFusionAllowed, false);
     AssertLogRelRCReturn(rc, rc);
 
+    rc = CFGMR3QueryBoolDef(pCfgPGM, "PageFusionScan", &pVM->pgm.s.FusionScan.fEnabled, false);
+    AssertLogRelRCReturn(rc, rc);
+    rc = CFGMR3QueryU32Def(pCfgPGM, "PageFusionScanPages", &pVM->pgm.s.FusionScan.cPagesPerPass, 2048);
+    AssertLogRelRCReturn(rc, rc);
+    AssertLogRelMsgReturn(pVM->pgm.s.FusionScan.cPagesPerPass > 0 && pVM->pgm.s.FusionScan.cPagesPerPass <= _1M,
+                          ("PageFusionScanPages=%u\n", pVM->pgm.s.FusionScan.cPagesPerPass), VERR_OUT_OF_RANGE);
+    rc = CFGMR3QueryU32Def(pCfgPGM, "PageFusionScanInterval", &pVM->pgm.s.FusionScan.cMsInterval, 500);
+    AssertLogRelRCReturn(rc, rc);
+    AssertLogRelMsgReturn(pVM->pgm.s.FusionScan.cMsInterval > 0,
+                          ("PageFusionScanInterval=%u\n", pVM->pgm.s.FusionScan.cMsInterval), VERR_OUT_OF_RANGE);
+
+    rc = CFGMR3QueryU32Def(pCfgPGM, "FreePageReportsPerSec", &pVM->pgm.s.FreeReport.cMaxReportsPerSec, 8);
+    AssertLogRelRCReturn(rc, rc);
+    rc = CFGMR3QueryU32Def(pCfgPGM, "FreePageReportPagesPerSec", &pVM->pgm.s.FreeReport.cMaxPagesPerSec, _1G / PAGE_SIZE);
+    AssertLogRelRCReturn(rc, rc);
+
+    rc = CFGMR3QueryU32Def(pCfgPGM, "HugePages", &pVM->pgm.s.HugePages.uMode, 0);
+    AssertLogRelRCReturn(rc, rc);
+    AssertLogRelMsgReturn(pVM->pgm.s.HugePages.uMode <= 2, ("HugePages=%u\n", pVM->pgm.s.HugePages.uMode), VERR_OUT_OF_RANGE);
+    if (pVM->pgm.s.HugePages.uMode == 2)
+        pVM->pgm.s.HugePages.fMethods = SUP_PAGE_ALLOC_HUGE_F_HUGETLBFS | SUP_PAGE_ALLOC_HUGE_F_THP;
+    else if (pVM->pgm.s.HugePages.uMode == 1)
+        pVM->pgm.s.HugePages.fMethods = SUP_PAGE_ALLOC_HUGE_F_THP;
+
 #ifdef VBOX_WITH_STATISTICS
     /*
      * Allocate memory for the statistics before someone tries to use them.
@@ -1468,6 +1493,13 @@ VMMR3DECL(int) PGMR3Init(PVM pVM)
                                               "ROM write protection",
                                               &pVM->pgm.s.hRomPhysHandlerType);
 
+    /*
+     * Register the physical access handler for pages missing after a
+     * post-copy teleportation.
+     */
+    if (RT_SUCCESS(rc))
+        rc = pgmR3PostCopyInit(pVM);
+
     /*
      * Init the paging.
      */
@@ -1742,9 +1774,20 @@ static int pgmR3InitStats(PVM pVM)
 
     STAM_REL_REG(pVM, &pPGM->StatLargePageReused,                STAMTYPE_COUNTER, "/PGM/LargePage/Reused",              STAMUNIT_OCCURENCES, "The number of times we've reused a large page.");
     STAM_REL_REG(pVM, &pPGM->StatLargePageRefused,               STAMTYPE_COUNTER, "/PGM/LargePage/Refused",             STAMUNIT_OCCURENCES, "The number of times we couldn't use a large page.");
+    STAM_REL_REG(pVM, &pPGM->HugePages.cbHugeBacked,             STAMTYPE_U64,     "/PGM/LargePage/HugeBacked",          STAMUNIT_BYTES,     "Guest RAM seeded with host large page backing.");
+    STAM_REL_REG(pVM, &pPGM->HugePages.cFallbacks,               STAMTYPE_U32,     "/PGM/LargePage/HugeFallbacks",       STAMUNIT_COUNT,     "Chunks seeded that turned out not to be backed by host large pages.");
     STAM_REL_REG(pVM, &pPGM->StatLargePageRecheck,               STAMTYPE_COUNTER, "/PGM/LargePage/Recheck",             STAMUNIT_OCCURENCES, "The number of times we've rechecked a disabled large page.");
 
     STAM_REL_REG(pVM, &pPGM->StatShModCheck,                     STAMTYPE_PROFILE, "/PGM/ShMod/Check",                   STAMUNIT_TICKS_PER_CALL, "Profiles the shared module checking.");
+    STAM_REL_REG(pVM, &pPGM->StatFusionScan,                     STAMTYPE_PROFILE, "/PGM/Fusion/Scan",                   STAMUNIT_TICKS_PER_CALL, "Profiles the page fusion scanner passes (all EMTs are halted meanwhile).");
+    STAM_REL_REG(pVM, &pPGM->StatFusionScanned,                  STAMTYPE_COUNTER, "/PGM/Fusion/Scanned",                STAMUNIT_PAGES,     "Pages hashed by the page fusion scanner.");
+    STAM_REL_REG(pVM, &pPGM->StatFusionShared,                   STAMTYPE_COUNTER, "/PGM/Fusion/Shared",                 STAMUNIT_PAGES,     "Pages the page fusion scanner converted into shared pages.");
+    STAM_REL_REG(pVM, &pPGM->StatFusionMerged,                   STAMTYPE_COUNTER, "/PGM/Fusion/Merged",                 STAMUNIT_PAGES,     "Pages the page fusion scanner replaced by existing shared pages.");
+    STAM_REL_REG(pVM, &pPGM->StatFreePageReport,                 STAMTYPE_PROFILE, "/PGM/FreePage/Report",               STAMUNIT_TICKS_PER_CALL, "Profiles releasing the pages the guest reported free (all EMTs are halted meanwhile).");
+    STAM_REL_REG(pVM, &pPGM->StatFreePageReleased,               STAMTYPE_COUNTER, "/PGM/FreePage/Released",             STAMUNIT_PAGES,     "Pages released after the guest reported them free.");
+    STAM_REL_REG(pVM, &pPGM->StatFreePageSkipped,                STAMTYPE_COUNTER, "/PGM/FreePage/Skipped",              STAMUNIT_PAGES,     "Pages reported free that were kept (handlers, locks, large pages, not RAM).");
+    STAM_REL_REG(pVM, &pPGM->StatFreePageThrottled,              STAMTYPE_COUNTER, "/PGM/FreePage/Throttled",            STAMUNIT_OCCURENCES, "Free page reports refused because of the rate limit.");
+    STAM_REL_REG(pVM, &pPGM->FusionScan.cRounds,                 STAMTYPE_U32,     "/PGM/Fusion/cRounds",                STAMUNIT_COUNT,     "The number of completed page fusion scanner rounds over all of RAM.");
 
     /* Live save */
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.fActive,              STAMTYPE_U8,      "/PGM/LiveSave/fActive",              STAMUNIT_COUNT,     "Active or not.");
@@ -1757,6 +1800,7 @@ static int pgmR3InitStats(PVM pVM)
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.Ram.cDirtyPages,      STAMTYPE_U32,     "/PGM/LiveSave/Ram/cDirtyPages",      STAMUNIT_COUNT,     "RAM: Dirty pages.");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.Ram.cZeroPages,       STAMTYPE_U32,     "/PGM/LiveSave/Ram/cZeroPages",       STAMUNIT_COUNT,     "RAM: Ready zero pages.");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.Ram.cMonitoredPages,  STAMTYPE_U32,     "/PGM/LiveSave/Ram/cMonitoredPages",  STAMUNIT_COUNT,     "RAM: Write monitored pages.");
+    STAM_REL_REG_USED(pVM, &pPGM->LiveSave.cDupPages,            STAMTYPE_U32,     "/PGM/LiveSave/Ram/cDupPages",        STAMUNIT_COUNT,     "RAM: Pages saved as references to identical pages.");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.Rom.cReadyPages,      STAMTYPE_U32,     "/PGM/LiveSave/Rom/cReadPages",       STAMUNIT_COUNT,     "ROM: Ready pages.");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.Rom.cDirtyPages,      STAMTYPE_U32,     "/PGM/LiveSave/Rom/cDirtyPages",      STAMUNIT_COUNT,     "ROM: Dirty pages.");
     STAM_REL_REG_USED(pVM, &pPGM->LiveSave.Rom.cZeroPages,       STAMTYPE_U32,     "/PGM/LiveSave/Rom/cZeroPages",       STAMUNIT_COUNT,     "ROM: Ready zero pages.");
@@ -2264,6 +2308,14 @@ VMMR3DECL(int) PGMR3InitFinalize(PVM pVM)
     if (pVM->pgm.s.fRamPreAlloc)
         rc = pgmR3PhysRamPreAllocate(pVM);
 
+#ifdef VBOX_WITH_PAGE_SHARING
+    /*
+     * Start the page fusion scanner if configured.
+     */
+    if (RT_SUCCESS(rc) && pVM->pgm.s.FusionScan.fEnabled)
+        rc = pgmR3PageFusionScanInit(pVM);
+#endif
+
     LogRel(("PGM: PGMR3InitFinalize: 4 MB PSE mask %RGp\n", pVM->pgm.s.GCPhys4MBPSEMask));
     return rc;
 }
@@ -2574,6 +2626,9 @@ VMMR3_INT_DECL(void) PGMR3Reset(PVM pVM)
     LogFlow(("PGMR3Reset:\n"));
     VM_ASSERT_EMT(pVM);
 
+    /* Forget about any post-copy pages, this takes the PGM lock itself. */
+    pgmR3PostCopyReset(pVM);
+
     pgmLock(pVM);
 
     /*
@@ -2703,6 +2758,13 @@ VMMR3_INT_DECL(void) PGMR3ResetNoMorePhysWritesFlag(PVM pVM)
  */
 VMMR3DECL(int) PGMR3Term(PVM pVM)
 {
+    pgmR3PostCopyTerm(pVM);
+    pgmR3TermSavedState(pVM);
+
+    if (pVM->pgm.s.HugePages.uMode)
+        LogRel(("PGM: %RU64 MB of guest RAM were huge page backed, %u chunks fell back on small pages, %u large pages\n",
+                pVM->pgm.s.HugePages.cbHugeBacked / _1M, pVM->pgm.s.HugePages.cFallbacks, pVM->pgm.s.cLargePages));
+
     /* Must free shared pages here. */
     pgmLock(pVM);
     pgmR3PhysRamTerm(pVM);
@@ -3436,6 +3498,7 @@ VMMR3DECL(int) PGMR3ChangeMode(PVM pVM, PVMCPU pVCpu, PGMMODE enmGuestMode)
 
     Log(("PGMR3ChangeMode: Guest mode: %s -> %s\n", PGMGetModeName(pVCpu->pgm.s.enmGuestMode), PGMGetModeName(enmGuestMode)));
     STAM_REL_COUNTER_INC(&pVCpu->pgm.s.cGuestModeChanges);
+    IEMTlbInvalidateAll(pVCpu);
 
     /*
      * Calc the shadow mode and switcher.
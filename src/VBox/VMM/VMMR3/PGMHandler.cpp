@@ -27,6 +27,7 @@
 #include <VBox/sup.h>
 #include <VBox/vmm/mm.h>
 #include <VBox/vmm/em.h>
+#include <VBox/vmm/iem.h>
 #include <VBox/vmm/stam.h>
 #include <VBox/vmm/csam.h>
 #ifdef VBOX_WITH_REM
@@ -244,6 +245,7 @@ void pgmR3HandlerPhysicalUpdateAll(PVM pVM)
     pgmLock(pVM);
     RTAvlroGCPhysDoWithAll(&pVM->pgm.s.CTX_SUFF(pTrees)->PhysHandlers,  true, pgmR3HandlerPhysicalOneClear, pVM);
     RTAvlroGCPhysDoWithAll(&pVM->pgm.s.CTX_SUFF(pTrees)->PhysHandlers, false, pgmR3HandlerPhysicalOneSet, pVM);
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
     pgmUnlock(pVM);
 }
 
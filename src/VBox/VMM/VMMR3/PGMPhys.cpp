@@ -21,6 +21,7 @@
 *********************************************************************************************************************************/
 #define LOG_GROUP LOG_GROUP_PGM_PHYS
 #include <VBox/vmm/pgm.h>
+#include <VBox/vmm/iem.h>
 #include <VBox/vmm/iom.h>
 #include <VBox/vmm/mm.h>
 #include <VBox/vmm/stam.h>
@@ -45,6 +46,7 @@
 #include <iprt/thread.h>
 #include <iprt/string.h>
 #include <iprt/system.h>
+#include <iprt/time.h>
 
 
 /*********************************************************************************************************************************
@@ -52,6 +54,9 @@
 *********************************************************************************************************************************/
 /** The number of pages to free in one batch. */
 #define PGMPHYS_FREE_PAGE_BATCH_SIZE    128
+/** The max number of pages a PGMR3PhysReportFreePages call may cover (4 GB).
+ * This bounds the time the other EMTs are stalled in the rendezvous. */
+#define PGMPHYS_FREE_REPORT_MAX_PAGES   _1M
 
 
 /*
@@ -1124,6 +1129,256 @@ VMMR3DECL(int) PGMR3PhysChangeMemBalloon(PVM pVM, bool fInflate, unsigned cPages
 }
 
 
+/**
+ * Rendezvous callback used by PGMR3PhysReportFreePages that releases the
+ * memory backing the pages the guest reported free.
+ *
+ * This is only called on one of the EMTs while the other ones are waiting for
+ * it to complete this function.
+ *
+ * @returns VBox strict status code.
+ * @param   pVM         The cross context VM structure.
+ * @param   pVCpu       The cross context virtual CPU structure of the calling EMT. Unused.
+ * @param   pvUser      User parameter, pointer to the range count followed by
+ *                      the range array.
+ */
+static DECLCALLBACK(VBOXSTRICTRC) pgmR3PhysReportFreePagesRendezvous(PVM pVM, PVMCPU pVCpu, void *pvUser)
+{
+    uintptr_t          *paUser      = (uintptr_t *)pvUser;
+    uint32_t const      cRanges     = (uint32_t)paUser[0];
+    PCPGMPHYSFREERANGE  paRanges    = (PCPGMPHYSFREERANGE)paUser[1];
+    uint32_t            cPendingPages = 0;
+    uint32_t            cReleased   = 0;
+    uint32_t            cSkipped    = 0;
+    bool                fFlushTLBs  = false;
+    PGMMFREEPAGESREQ    pReq;
+    NOREF(pVCpu);
+
+    pgmLock(pVM);
+
+    int rc = GMMR3FreePagesPrepare(pVM, &pReq, PGMPHYS_FREE_PAGE_BATCH_SIZE, GMMACCOUNT_BASE);
+    if (RT_FAILURE(rc))
+    {
+        pgmUnlock(pVM);
+        AssertLogRelRC(rc);
+        return rc;
+    }
+
+    /*
+     * Clip each reported range to the RAM ranges, so holes are skipped in
+     * one go.  Both lists are sorted, but the reported ones might overlap,
+     * so we restart the RAM range walk for each of them.
+     */
+    for (uint32_t iRange = 0; iRange < cRanges && RT_SUCCESS(rc); iRange++)
+    {
+        RTGCPHYS const GCPhysFirst = paRanges[iRange].GCPhys;
+        RTGCPHYS const GCPhysLast  = GCPhysFirst + ((RTGCPHYS)paRanges[iRange].cPages << PAGE_SHIFT) - 1;
+        for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3;
+             pRam && pRam->GCPhys <= GCPhysLast && RT_SUCCESS(rc);
+             pRam = pRam->pNextR3)
+        {
+            if (pRam->GCPhysLast < GCPhysFirst)
+                continue;
+            RTGCPHYS const GCPhysStart = RT_MAX(GCPhysFirst, pRam->GCPhys);
+            RTGCPHYS const GCPhysEnd   = RT_MIN(GCPhysLast, pRam->GCPhysLast);
+            uint32_t const cPages      = (uint32_t)((GCPhysEnd - GCPhysStart) >> PAGE_SHIFT) + 1;
+            if (PGM_RAM_RANGE_IS_AD_HOC(pRam))
+            {
+                cSkipped += cPages;
+                continue;
+            }
+
+            uint32_t const iFirstPage = (uint32_t)((GCPhysStart - pRam->GCPhys) >> PAGE_SHIFT);
+            for (uint32_t iPage = iFirstPage; iPage < iFirstPage + cPages; iPage++)
+            {
+                RTGCPHYS const GCPhys = pRam->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+                PPGMPAGE       pPage  = &pRam->aPages[iPage];
+                if (PGM_PAGE_IS_ZERO(pPage) || PGM_PAGE_IS_BALLOONED(pPage))
+                    continue;   /* Nothing backing it. */
+
+                /* Leave pages alone that someone else is interested in, and large pages. */
+                if (   PGM_PAGE_GET_TYPE(pPage) != PGMPAGETYPE_RAM
+                    || PGM_PAGE_HAS_ANY_HANDLERS(pPage)
+                    || PGM_PAGE_GET_READ_LOCKS(pPage)
+                    || PGM_PAGE_GET_WRITE_LOCKS(pPage)
+                    || PGM_PAGE_GET_PDE_TYPE(pPage) == PGM_PAGE_PDE_TYPE_PDE
+                    || PGM_PAGE_GET_PDE_TYPE(pPage) == PGM_PAGE_PDE_TYPE_PDE_DISABLED)
+                {
+                    cSkipped++;
+                    continue;
+                }
+
+                /* Get rid of shadow page tables for it and of all shadow mappings of it. */
+                pgmPoolFlushPageByGCPhys(pVM, GCPhys);
+                pgmPoolTrackUpdateGCPhys(pVM, GCPhys, pPage, true /*fFlushPTEs*/, &fFlushTLBs);
+
+                /* Replace it with the ZERO page, a write will allocate a new zeroed page. */
+                rc = pgmPhysFreePage(pVM, pReq, &cPendingPages, pPage, GCPhys);
+                if (RT_FAILURE(rc))
+                    break;
+                cReleased++;
+            }
+        }
+    }
+
+    /*
+     * Hand the pending pages to GMM, also when we failed above, as PGM has
+     * already let go of them.  A full batch means pgmPhysFreePage failed to
+     * flush it, there is no point in trying again.
+     */
+    if (cPendingPages && cPendingPages < PGMPHYS_FREE_PAGE_BATCH_SIZE)
+    {
+        int rc2 = GMMR3FreePagesPerform(pVM, pReq, cPendingPages);
+        AssertLogRelRC(rc2);
+        if (RT_SUCCESS(rc))
+            rc = rc2;
+    }
+    GMMR3FreePagesCleanup(pReq);
+
+    if (fFlushTLBs)
+        PGM_INVL_ALL_VCPU_TLBS(pVM);
+    pgmPhysInvalidatePageMapTLB(pVM);
+    pgmUnlock(pVM);
+
+    /* Flush the recompiler's TLB as well. */
+    for (VMCPUID i = 0; i < pVM->cCpus; i++)
+        CPUMSetChangedFlags(&pVM->aCpus[i], CPUM_CHANGED_GLOBAL_TLB_FLUSH);
+
+    STAM_REL_COUNTER_ADD(&pVM->pgm.s.StatFreePageReleased, cReleased);
+    STAM_REL_COUNTER_ADD(&pVM->pgm.s.StatFreePageSkipped, cSkipped);
+    Log(("pgmR3PhysReportFreePagesRendezvous: %u ranges, released %u pages, skipped %u, rc=%Rrc\n",
+         cRanges, cReleased, cSkipped, rc));
+    AssertLogRelRC(rc);
+    return rc;
+}
+
+
+/**
+ * Free page reporting helper (called on the way out).
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   cRanges     The number of ranges.
+ * @param   paRanges    The ranges, heap copy that we free here.
+ */
+static DECLCALLBACK(void) pgmR3PhysReportFreePagesHelper(PVM pVM, uint32_t cRanges, PGMPHYSFREERANGE *paRanges)
+{
+    uintptr_t paUser[2];
+    paUser[0] = cRanges;
+    paUser[1] = (uintptr_t)paRanges;
+
+    /* Stall the other VCPUs so we don't have to send IPIs for every page. */
+    STAM_REL_PROFILE_START(&pVM->pgm.s.StatFreePageReport, a);
+    int rc = VMMR3EmtRendezvous(pVM, VMMEMTRENDEZVOUS_FLAGS_TYPE_ONCE, pgmR3PhysReportFreePagesRendezvous, (void *)paUser);
+    AssertRC(rc);
+    STAM_REL_PROFILE_STOP(&pVM->pgm.s.StatFreePageReport, a);
+
+    RTMemFree(paRanges);
+}
+
+
+/**
+ * Releases the memory backing guest pages the guest reported free.
+ *
+ * The pages are replaced by the ZERO page, so they read as zero and get new
+ * memory allocated when written to.  Unlike ballooning, they remain usable by
+ * the guest and nothing changes in the GMM reservation, only the allocation
+ * shrinks.
+ *
+ * Since the caller may own locks that the other EMTs could be waiting on, the
+ * work is queued on the calling EMT and done before it resumes guest execution.
+ * The guest must not touch the pages until then, which is the case as long as
+ * the guest doesn't reuse them before the reporting request has completed.
+ *
+ * The ranges must lie within guest RAM and together cover no more than
+ * PGMPHYS_FREE_REPORT_MAX_PAGES pages.  Pages in MMIO and ROM ranges or
+ * holes between the RAM ranges are ignored.
+ *
+ * Since every report stops all the EMTs, the number of reports and the number
+ * of pages acted upon per second is limited (/PGM/FreePageReportsPerSec and
+ * /PGM/FreePageReportPagesPerSec).  Reports exceeding that are refused, the
+ * pages then simply stay backed.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED if RAM is preallocated or PCI pass-through is
+ *          active.
+ * @retval  VERR_TRY_AGAIN if the rate limit was hit.
+ * @retval  VERR_INVALID_PARAMETER if a range is malformed, extends past the
+ *          end of guest RAM, or there are too many pages.
+ * @param   pVM         The cross context VM structure.
+ * @param   cRanges     The number of ranges.
+ * @param   paRanges    The free page ranges.  This is copied.
+ *
+ * @thread  EMT
+ */
+VMMR3DECL(int) PGMR3PhysReportFreePages(PVM pVM, uint32_t cRanges, PCPGMPHYSFREERANGE paRanges)
+{
+    VM_ASSERT_EMT_RETURN(pVM, VERR_VM_THREAD_NOT_EMT);
+    AssertReturn(cRanges > 0 && cRanges <= _64K, VERR_INVALID_PARAMETER);
+    AssertPtrReturn(paRanges, VERR_INVALID_POINTER);
+
+    /* The end of guest RAM, i.e. the last page of the last range that isn't
+       MMIO or ROM. */
+    RTGCPHYS GCPhysRamLast = 0;
+    pgmLock(pVM);
+    for (PPGMRAMRANGE pRam = pVM->pgm.s.pRamRangesXR3; pRam; pRam = pRam->pNextR3)
+        if (!PGM_RAM_RANGE_IS_AD_HOC(pRam))
+            GCPhysRamLast = pRam->GCPhysLast;
+    pgmUnlock(pVM);
+
+    uint64_t cTotalPages = 0;
+    for (uint32_t i = 0; i < cRanges; i++)
+    {
+        AssertMsgReturn(   !(paRanges[i].GCPhys & PAGE_OFFSET_MASK)
+                        && paRanges[i].cPages > 0
+                        && !paRanges[i].u32Reserved
+                        && paRanges[i].GCPhys + ((RTGCPHYS)paRanges[i].cPages << PAGE_SHIFT) > paRanges[i].GCPhys
+                        && paRanges[i].GCPhys + ((RTGCPHYS)paRanges[i].cPages << PAGE_SHIFT) - 1 <= GCPhysRamLast,
+                        ("#%u: %RGp LB %#x pages (reserved %#x, RAM ends at %RGp)\n", i, paRanges[i].GCPhys,
+                         paRanges[i].cPages, paRanges[i].u32Reserved, GCPhysRamLast),
+                        VERR_INVALID_PARAMETER);
+        cTotalPages += paRanges[i].cPages;
+    }
+    AssertMsgReturn(cTotalPages <= PGMPHYS_FREE_REPORT_MAX_PAGES, ("%#RX64 pages\n", cTotalPages), VERR_INVALID_PARAMETER);
+
+    /* We keep preallocated RAM and RAM that could be DMA'ed to by real devices. */
+    if (   pVM->pgm.s.fRamPreAlloc
+        || pVM->pgm.s.fPciPassthrough)
+        return VERR_NOT_SUPPORTED;
+
+    /* Rate limit. */
+    pgmLock(pVM);
+    uint64_t const msNow = RTTimeMilliTS();
+    if (msNow - pVM->pgm.s.FreeReport.msPeriodStart >= RT_MS_1SEC)
+    {
+        pVM->pgm.s.FreeReport.msPeriodStart = msNow;
+        pVM->pgm.s.FreeReport.cReports      = 0;
+        pVM->pgm.s.FreeReport.cPages        = 0;
+    }
+    if (   pVM->pgm.s.FreeReport.cReports >= pVM->pgm.s.FreeReport.cMaxReportsPerSec
+        || cTotalPages > pVM->pgm.s.FreeReport.cMaxPagesPerSec - RT_MIN(pVM->pgm.s.FreeReport.cPages,
+                                                                         pVM->pgm.s.FreeReport.cMaxPagesPerSec))
+    {
+        pgmUnlock(pVM);
+        STAM_REL_COUNTER_INC(&pVM->pgm.s.StatFreePageThrottled);
+        return VERR_TRY_AGAIN;
+    }
+    pVM->pgm.s.FreeReport.cReports++;
+    pVM->pgm.s.FreeReport.cPages += (uint32_t)cTotalPages;
+    pgmUnlock(pVM);
+
+    PGMPHYSFREERANGE *paCopy = (PGMPHYSFREERANGE *)RTMemDup(paRanges, cRanges * sizeof(paRanges[0]));
+    AssertReturn(paCopy, VERR_NO_MEMORY);
+
+    int rc = VMR3ReqCallNoWait(pVM, VMMGetCpuId(pVM), (PFNRT)pgmR3PhysReportFreePagesHelper, 3, pVM, cRanges, paCopy);
+    if (RT_FAILURE(rc))
+    {
+        AssertLogRelRC(rc);
+        RTMemFree(paCopy);
+    }
+    return rc;
+}
+
+
 /**
  * Rendezvous callback used by PGMR3WriteProtectRAM that write protects all
  * physical RAM.
@@ -1194,6 +1449,7 @@ static DECLCALLBACK(VBOXSTRICTRC) pgmR3PhysWriteProtectRAMRendezvous(PVM pVM, PV
     PGM_INVL_ALL_VCPU_TLBS(pVM);
     for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
         CPUMSetChangedFlags(&pVM->aCpus[idCpu], CPUM_CHANGED_GLOBAL_TLB_FLUSH);
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
 
     pgmUnlock(pVM);
     return rc;
@@ -3969,6 +4225,10 @@ static DECLCALLBACK(VBOXSTRICTRC) pgmR3PhysUnmapChunkRendezvous(PVM pVM, PVMCPU
                     /* Flush REM TLBs. */
                     CPUMSetChangedFlags(&pVM->aCpus[idCpu], CPUM_CHANGED_GLOBAL_TLB_FLUSH);
                 }
+
+                /* The candidate isn't in the page map TLB, but IEM may still
+                   have the chunk's ring-3 mapping cached in its TLBs. */
+                IEMTlbInvalidateAllPhysicalAllCpus(pVM);
 #ifdef VBOX_WITH_REM
                 /* Flush REM translation blocks. */
                 REMFlushTBs(pVM);
@@ -4158,6 +4418,66 @@ VMMR3DECL(void) PGMR3PhysChunkInvalidateTLB(PVM pVM)
 }
 
 
+/**
+ * Allocates a chunk of memory and seeds GMM with it (legacy allocation mode).
+ *
+ * When /PGM/HugePages is set we try to get the chunk backed by host large
+ * pages first, dropping a method for good once it fails, and fall back on
+ * normal pages.  GMM will only use the chunk for large guest pages if it's
+ * really backed by a host large page, which it tells us so we can keep the
+ * statistics honest.
+ *
+ * @returns VBox status code, the status of the seeding if the allocation
+ *          succeeded.  Informational statuses are not passed on.
+ * @param   pVM         The cross context VM structure.
+ * @param   prcAlloc    Where to return the status of the allocation.
+ */
+static int pgmR3PhysSeedChunk(PVM pVM, int *prcAlloc)
+{
+    void *pvChunk = NULL;
+    bool  fHuge   = false;
+    int   rc;
+    while (pVM->pgm.s.HugePages.fMethods)
+    {
+        uint32_t const fMethod = pVM->pgm.s.HugePages.fMethods & SUP_PAGE_ALLOC_HUGE_F_HUGETLBFS
+                               ? SUP_PAGE_ALLOC_HUGE_F_HUGETLBFS : SUP_PAGE_ALLOC_HUGE_F_THP;
+        rc = SUPR3PageAllocHuge(GMM_CHUNK_SIZE >> PAGE_SHIFT, fMethod, &pvChunk);
+        if (RT_SUCCESS(rc))
+        {
+            fHuge = true;
+            break;
+        }
+        LogRel(("PGM: Giving up on %s backed guest RAM (rc=%Rrc); %RU64 MB are huge page backed\n",
+                fMethod == SUP_PAGE_ALLOC_HUGE_F_HUGETLBFS ? "hugetlbfs" : "transparent huge page",
+                rc, pVM->pgm.s.HugePages.cbHugeBacked / _1M));
+        pVM->pgm.s.HugePages.fMethods &= ~fMethod;
+    }
+    if (!fHuge)
+    {
+        *prcAlloc = rc = SUPR3PageAlloc(GMM_CHUNK_SIZE >> PAGE_SHIFT, &pvChunk);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    else
+        *prcAlloc = VINF_SUCCESS;
+
+    rc = VMMR3CallR0(pVM, VMMR0_DO_GMM_SEED_CHUNK, (uintptr_t)pvChunk, NULL);
+    if (RT_SUCCESS(rc))
+    {
+        /* Huge page allocations may still come back as small pages (THP in
+           particular), only GMM knows for sure. */
+        if (rc == VINF_GMM_SEEDED_CHUNK_CONTIGUOUS)
+            pVM->pgm.s.HugePages.cbHugeBacked += GMM_CHUNK_SIZE;
+        else if (pVM->pgm.s.HugePages.uMode)
+            pVM->pgm.s.HugePages.cFallbacks++;
+        rc = VINF_SUCCESS;
+    }
+    else
+        SUPR3PageFree(pvChunk, GMM_CHUNK_SIZE >> PAGE_SHIFT);
+    return rc;
+}
+
+
 /**
  * Response to VMMCALLRING3_PGM_ALLOCATE_LARGE_HANDY_PAGE to allocate a large
  * (2MB) page for use with a nested paging PDE.
@@ -4179,6 +4499,15 @@ VMMR3DECL(int) PGMR3PhysAllocateLargeHandyPage(PVM pVM, RTGCPHYS GCPhys)
     STAM_PROFILE_START(&pVM->pgm.s.CTX_SUFF(pStats)->StatAllocLargePage, a);
     u64TimeStamp1 = RTTimeMilliTS();
     int rc = VMMR3CallR0(pVM, VMMR0_DO_PGM_ALLOCATE_LARGE_HANDY_PAGE, 0, NULL);
+    if (   rc == VERR_GMM_SEED_ME
+        && pVM->pgm.s.HugePages.fMethods)
+    {
+        /* Legacy allocation mode: give GMM a huge page backed chunk and retry once. */
+        int rcAlloc;
+        rc = pgmR3PhysSeedChunk(pVM, &rcAlloc);
+        if (RT_SUCCESS(rc))
+            rc = VMMR3CallR0(pVM, VMMR0_DO_PGM_ALLOCATE_LARGE_HANDY_PAGE, 0, NULL);
+    }
     u64TimeStamp2 = RTTimeMilliTS();
     STAM_PROFILE_STOP(&pVM->pgm.s.CTX_SUFF(pStats)->StatAllocLargePage, a);
     if (RT_SUCCESS(rc))
@@ -4313,14 +4642,9 @@ VMMR3DECL(int) PGMR3PhysAllocateHandyPages(PVM pVM)
     int rc = VMMR3CallR0(pVM, VMMR0_DO_PGM_ALLOCATE_HANDY_PAGES, 0, NULL);
     while (rc == VERR_GMM_SEED_ME)
     {
-        void *pvChunk;
-        rcAlloc = rc = SUPR3PageAlloc(GMM_CHUNK_SIZE >> PAGE_SHIFT, &pvChunk);
-        if (RT_SUCCESS(rc))
-        {
-            rcSeed = rc = VMMR3CallR0(pVM, VMMR0_DO_GMM_SEED_CHUNK, (uintptr_t)pvChunk, NULL);
-            if (RT_FAILURE(rc))
-                SUPR3PageFree(pvChunk, GMM_CHUNK_SIZE >> PAGE_SHIFT);
-        }
+        rc = pgmR3PhysSeedChunk(pVM, &rcAlloc);
+        if (RT_SUCCESS(rcAlloc))
+            rcSeed = rc;
         if (RT_SUCCESS(rc))
             rc = VMMR3CallR0(pVM, VMMR0_DO_PGM_ALLOCATE_HANDY_PAGES, 0, NULL);
     }
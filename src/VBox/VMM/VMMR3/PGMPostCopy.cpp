@@ -0,0 +1,1727 @@
+/* $Id$ */
+/** @file
+ * PGM - Page Manager and Monitor, Post-copy teleportation.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+/** @page pg_pgm_post_copy  PGM Post-copy Teleportation
+ *
+ * A live save normally keeps saving dirty RAM pages until the dirty rate is
+ * low enough for the last pass to fit inside the requested downtime.  A guest
+ * dirtying memory faster than the link can carry it never gets there.  With
+ * post-copy enabled (PGMR3PostCopySrcEnable) the source stops the passes
+ * early, and the final pass only saves the hot pages (those dirtied in more
+ * than one pass) up to a budget, zero and ballooned pages.  The other dirty
+ * pages are recorded as PGM_STATE_REC_RAM_POSTCOPY and remembered in a set of
+ * pending pages.
+ *
+ * The target resumes the VM right after loading the state.  The pages it
+ * lacks are covered by ALL access handlers, one per 32 MB chunk of a RAM
+ * range, with the pages it already has switched off.  An access to a missing
+ * page ends up in pgmR3PostCopyAccessHandler on an EMT, which asks the
+ * source for the page (FNPGMPOSTCOPYREQUEST) and waits for it.  Meanwhile the
+ * source pushes the remaining pages in the background, the caller feeds
+ * whatever arrives to PGMR3PostCopyTrgDeliverPage.  Since only an EMT can
+ * allocate guest pages, received pages are queued and installed by an EMT,
+ * either the one waiting for a page or one picking up an install request.
+ * Once a chunk has no pages missing, its access handler is deregistered.
+ *
+ * PGM's own guest paging structure walks map guest pages without consulting
+ * access handlers, in ring-0 and raw-mode as well.  While handlers are armed
+ * (pgm.s.fPostCopyTrgArmed) the mapping paths call pgmPhysPostCopyFetch,
+ * which fetches a missing page in ring-3 or goes there to do it
+ * (VMMCALLRING3_PGM_POSTCOPY_FETCH).  The EMT then owns the PGM lock and
+ * must install the page itself, hence the lock order (PGM lock first, see
+ * pgmR3PostCopyEnter).  Deregistering a handler would flush shadow paging
+ * structures the walk may be using, so that is left to an install request.
+ *
+ * The transport is the caller's business, see ConsoleImplTeleporter.cpp.
+ *
+ * Limitations:
+ *      - The VM is lost if the connection to the source fails before all
+ *        pages have been received.  The target is suspended with a runtime
+ *        error in that case.
+ *      - The target requires nested paging.  With shadow paging the page
+ *        pool write monitors the guest page tables with access handlers of
+ *        its own, which cannot overlap ours, so the target fetches all the
+ *        missing pages before resuming the VM instead (and says so in the
+ *        release log).  The source cannot tell, it merely avoids deferring
+ *        pages likely to be needed right away, see
+ *        pgmR3SaveRamPageDeferrable.
+ *      - The target cannot be saved or teleported again until all pages have
+ *        been received.
+ *
+ *
+ * @section sec_pgm_lazy_restore    Lazy Restore
+ *
+ * The target side is also used for restoring a saved state without reading
+ * all of the RAM up front (/PGM/LazyRestore).  The final pass then leaves the
+ * RAM pages with content to the "pgmlazy" unit, which stores them as
+ * uncompressed records that can be read straight from the file, and the
+ * "pgmlazyidx" unit records where they are.  The load marks the pages as
+ * missing and skips the extent, see SSMR3SkipToEndOfUnitAt.  Once the state
+ * is loaded, pgmR3PostCopyTrgStartLazy hands the file to a "PGMLazy" thread
+ * that plays the source: it reads the pages the EMTs fault on first and
+ * otherwise works through the file in order.  Saving the VM before it is done
+ * reads the rest synchronously, see pgmR3PostCopyTrgLazyComplete.  The pages
+ * left behind are subject to the same rules as the post-copy ones, so a VM
+ * restored without nested paging reads them all before it runs.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#define LOG_GROUP LOG_GROUP_PGM
+#include <VBox/vmm/pgm.h>
+#include <VBox/vmm/mm.h>
+#include <VBox/vmm/uvm.h>
+#include "PGMInternal.h"
+#include <VBox/vmm/vm.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/critsect.h>
+#include <iprt/file.h>
+#include <iprt/semaphore.h>
+#include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+#include "PGMInline.h"
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The size of a post-copy chunk in bytes. */
+#define PGM_POSTCOPY_CHUNK_SIZE     ((RTGCPHYS)PGM_POSTCOPY_CHUNK_PAGES << PAGE_SHIFT)
+/** The default max number of hot pages saved by the final pass. */
+#define PGM_POSTCOPY_DEF_HOT_PAGES  _8K
+/** The max number of pages the lazy restore thread reads at a time. */
+#define PGM_LAZY_BATCH_PAGES        32
+
+
+/**
+ * Enters the post-copy critsect, taking the PGM lock first.
+ *
+ * An EMT may have to install pages while owning the PGM lock (a guest paging
+ * structure walk hitting a missing page), so anyone who may take the PGM lock
+ * while owning the critsect must take it before the critsect.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.
+ */
+DECLINLINE(void) pgmR3PostCopyEnter(PVM pVM, PPGMPOSTCOPY pPC)
+{
+    pgmLock(pVM);
+    RTCritSectEnter(&pPC->CritSect);
+}
+
+
+/**
+ * Leaves what pgmR3PostCopyEnter entered.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.
+ */
+DECLINLINE(void) pgmR3PostCopyLeave(PVM pVM, PPGMPOSTCOPY pPC)
+{
+    RTCritSectLeave(&pPC->CritSect);
+    pgmUnlock(pVM);
+}
+
+
+/**
+ * Looks up the chunk containing the given page.
+ *
+ * @returns Pointer to the chunk, NULL if not found.
+ * @param   pPC             The post-copy state.
+ * @param   GCPhys          The guest physical address.
+ * @param   piInsert        Where to return the index the chunk would be
+ *                          inserted at if not found.  Optional.
+ */
+static PPGMPOSTCOPYCHUNK pgmR3PostCopyLookupChunk(PPGMPOSTCOPY pPC, RTGCPHYS GCPhys, uint32_t *piInsert)
+{
+    uint32_t iStart = 0;
+    uint32_t iEnd   = pPC->cChunks;
+    while (iStart < iEnd)
+    {
+        uint32_t const          i      = iStart + (iEnd - iStart) / 2;
+        PPGMPOSTCOPYCHUNK const pChunk = pPC->papChunks[i];
+        if (GCPhys < pChunk->GCPhys)
+            iEnd = i;
+        else if (GCPhys - pChunk->GCPhys >= ((RTGCPHYS)pChunk->cPages << PAGE_SHIFT))
+            iStart = i + 1;
+        else
+        {
+            if (piInsert)
+                *piInsert = i;
+            return pChunk;
+        }
+    }
+    if (piInsert)
+        *piInsert = iStart;
+    return NULL;
+}
+
+
+/**
+ * Checks if a page is still pending.
+ *
+ * @returns true if pending, false if not.
+ * @param   pPC             The post-copy state.  Caller owns the critsect.
+ * @param   GCPhys          The page address.
+ */
+static bool pgmR3PostCopyIsPending(PPGMPOSTCOPY pPC, RTGCPHYS GCPhys)
+{
+    PPGMPOSTCOPYCHUNK pChunk = pgmR3PostCopyLookupChunk(pPC, GCPhys, NULL);
+    return pChunk
+        && ASMBitTest(pChunk->bmPending, (int32_t)((GCPhys - pChunk->GCPhys) >> PAGE_SHIFT));
+}
+
+
+/**
+ * Finds the last pending page in a chunk.
+ *
+ * @returns Page index, -1 if none.
+ * @param   pChunk          The chunk.
+ */
+static int32_t pgmR3PostCopyChunkLastPending(PPGMPOSTCOPYCHUNK pChunk)
+{
+    for (int32_t iWord = (int32_t)((pChunk->cPages + 63) / 64) - 1; iWord >= 0; iWord--)
+        if (pChunk->bmPending[iWord])
+            return iWord * 64 + (int32_t)ASMBitLastSetU64(pChunk->bmPending[iWord]) - 1;
+    return -1;
+}
+
+
+/**
+ * Removes a chunk without pending pages from the array and frees it.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.  Caller owns the critsect.
+ * @param   pChunk          The chunk.
+ */
+static void pgmR3PostCopyRemoveChunk(PVM pVM, PPGMPOSTCOPY pPC, PPGMPOSTCOPYCHUNK pChunk)
+{
+    Assert(!pChunk->cPending);
+    Assert(pChunk->GCPhysHandler == NIL_RTGCPHYS);
+    uint32_t i;
+    PPGMPOSTCOPYCHUNK pFound = pgmR3PostCopyLookupChunk(pPC, pChunk->GCPhys, &i);
+    AssertReturnVoid(pFound == pChunk);
+    pPC->cChunks--;
+    if (i < pPC->cChunks)
+        memmove(&pPC->papChunks[i], &pPC->papChunks[i + 1], (pPC->cChunks - i) * sizeof(pPC->papChunks[0]));
+    if (pPC->iNextChunk > i)
+        pPC->iNextChunk--;
+    MMR3HeapFree(pChunk);
+    if (!pPC->cChunks)
+        ASMAtomicWriteBool(&pVM->pgm.s.fPostCopyTrgArmed, false);
+}
+
+
+/**
+ * Deregisters the access handlers and frees all the chunks.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.  Caller has entered it via
+ *                          pgmR3PostCopyEnter.
+ */
+static void pgmR3PostCopyFreeChunks(PVM pVM, PPGMPOSTCOPY pPC)
+{
+    ASMAtomicWriteBool(&pVM->pgm.s.fPostCopyTrgArmed, false);
+    for (uint32_t i = 0; i < pPC->cChunks; i++)
+    {
+        PPGMPOSTCOPYCHUNK pChunk = pPC->papChunks[i];
+        if (pChunk->GCPhysHandler != NIL_RTGCPHYS)
+        {
+            int rc = PGMHandlerPhysicalDeregister(pVM, pChunk->GCPhysHandler);
+            AssertLogRelRC(rc);
+        }
+        MMR3HeapFree(pChunk);
+    }
+    MMR3HeapFree(pPC->papChunks);
+    pPC->papChunks      = NULL;
+    pPC->cChunks        = 0;
+    pPC->cChunksAlloc   = 0;
+    pPC->iNextChunk     = 0;
+    pPC->fRetirePending = false;
+    ASMAtomicWriteU32(&pPC->cPending, 0);
+}
+
+
+/**
+ * Creates the post-copy state.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ * @param   fSource         Set if source, clear if target.
+ * @param   ppPC            Where to return the state.
+ */
+static int pgmR3PostCopyCreate(PVM pVM, bool fSource, PPGMPOSTCOPY *ppPC)
+{
+    PPGMPOSTCOPY pPC = (PPGMPOSTCOPY)MMR3HeapAllocZ(pVM, MM_TAG_PGM, sizeof(*pPC));
+    if (!pPC)
+        return VERR_NO_MEMORY;
+    pPC->fSource    = fSource;
+    pPC->hEvtUpdate = NIL_RTSEMEVENTMULTI;
+    pPC->hEvtSpace  = NIL_RTSEMEVENT;
+
+    int rc = RTCritSectInit(&pPC->CritSect);
+    if (RT_SUCCESS(rc) && !fSource)
+    {
+        rc = RTSemEventMultiCreate(&pPC->hEvtUpdate);
+        if (RT_SUCCESS(rc))
+            rc = RTSemEventCreate(&pPC->hEvtSpace);
+        if (RT_SUCCESS(rc))
+        {
+            pPC->paQueue = (PPGMPOSTCOPYQENTRY)MMR3HeapAlloc(pVM, MM_TAG_PGM, PGM_POSTCOPY_QUEUE_SIZE * sizeof(pPC->paQueue[0]));
+            if (!pPC->paQueue)
+                rc = VERR_NO_MEMORY;
+        }
+    }
+    if (RT_SUCCESS(rc))
+    {
+        pVM->pgm.s.pPostCopyR3 = pPC;
+        *ppPC = pPC;
+        return VINF_SUCCESS;
+    }
+
+    RTSemEventDestroy(pPC->hEvtSpace);
+    RTSemEventMultiDestroy(pPC->hEvtUpdate);
+    if (RTCritSectIsInitialized(&pPC->CritSect))
+        RTCritSectDelete(&pPC->CritSect);
+    MMR3HeapFree(pPC);
+    return rc;
+}
+
+
+/**
+ * Stops the lazy restore thread, if running.
+ *
+ * @param   pLazy           The lazy restore state.
+ */
+static void pgmR3LazyStopThread(PPGMLAZY pLazy)
+{
+    if (pLazy->hThread != NIL_RTTHREAD)
+    {
+        ASMAtomicWriteBool(&pLazy->fStop, true);
+        RTSemEventSignal(pLazy->hEvtDemand);
+        int rc = RTThreadWait(pLazy->hThread, RT_INDEFINITE_WAIT, NULL);
+        AssertLogRelRC(rc);
+        pLazy->hThread = NIL_RTTHREAD;
+    }
+}
+
+
+/**
+ * Frees a lazy restore state, stopping the thread and closing the file.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pLazy           The lazy restore state.  NULL is ignored.
+ */
+void pgmR3LazyFree(PVM pVM, PPGMLAZY pLazy)
+{
+    NOREF(pVM);
+    if (pLazy)
+    {
+        pgmR3LazyStopThread(pLazy);
+        RTSemEventDestroy(pLazy->hEvtDemand);
+        if (pLazy->hFile != NIL_RTFILE)
+            RTFileClose(pLazy->hFile);
+        MMR3HeapFree(pLazy->paRuns);
+        MMR3HeapFree(pLazy);
+    }
+}
+
+
+/**
+ * Destroys the post-copy state.
+ *
+ * The caller must make sure nobody else can be using it.
+ *
+ * @param   pVM             The cross context VM structure.
+ */
+static void pgmR3PostCopyDestroy(PVM pVM)
+{
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (pPC)
+    {
+        if (pPC->pLazy)
+            pgmR3LazyStopThread(pPC->pLazy);
+
+        pgmR3PostCopyEnter(pVM, pPC);
+        pgmR3PostCopyFreeChunks(pVM, pPC);
+        pVM->pgm.s.pPostCopyR3 = NULL;
+        pgmR3PostCopyLeave(pVM, pPC);
+
+        pgmR3LazyFree(pVM, pPC->pLazy);
+        RTSemEventDestroy(pPC->hEvtSpace);
+        RTSemEventMultiDestroy(pPC->hEvtUpdate);
+        RTCritSectDelete(&pPC->CritSect);
+        MMR3HeapFree(pPC->paQueue);
+        MMR3HeapFree(pPC);
+    }
+}
+
+
+/**
+ * Adds a page to the set of pending pages.
+ *
+ * This is called by the final live save pass on the source when deferring a
+ * page, and when loading a PGM_STATE_REC_RAM_POSTCOPY record on the target.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ * @param   pRam            The RAM range containing the page.
+ * @param   GCPhys          The page address.
+ * @param   fSource         Set if source, clear if target.
+ */
+int pgmR3PostCopyAddPage(PVM pVM, PPGMRAMRANGE pRam, RTGCPHYS GCPhys, bool fSource)
+{
+    Assert(!(GCPhys & PAGE_OFFSET_MASK));
+    Assert(GCPhys >= pRam->GCPhys && GCPhys <= pRam->GCPhysLast);
+
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (!pPC)
+    {
+        int rc = pgmR3PostCopyCreate(pVM, fSource, &pPC);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+    AssertLogRelReturn(pPC->fSource == fSource, VERR_WRONG_ORDER);
+
+    /*
+     * Find or create the chunk.
+     */
+    uint32_t          iInsert;
+    PPGMPOSTCOPYCHUNK pChunk = pgmR3PostCopyLookupChunk(pPC, GCPhys, &iInsert);
+    if (!pChunk)
+    {
+        if (pPC->cChunks >= pPC->cChunksAlloc)
+        {
+            uint32_t const cNew = pPC->cChunksAlloc ? pPC->cChunksAlloc * 2 : 16;
+            void *pvNew = MMR3HeapRealloc(pPC->papChunks, cNew * sizeof(pPC->papChunks[0]));
+            if (!pvNew)
+                return VERR_NO_MEMORY;
+            pPC->papChunks    = (PPGMPOSTCOPYCHUNK *)pvNew;
+            pPC->cChunksAlloc = cNew;
+        }
+
+        pChunk = (PPGMPOSTCOPYCHUNK)MMR3HeapAllocZ(pVM, MM_TAG_PGM, sizeof(*pChunk));
+        if (!pChunk)
+            return VERR_NO_MEMORY;
+        RTGCPHYS const GCPhysFirst = RT_MAX(GCPhys & ~(PGM_POSTCOPY_CHUNK_SIZE - 1), pRam->GCPhys);
+        RTGCPHYS const GCPhysLast  = RT_MIN(GCPhys | (PGM_POSTCOPY_CHUNK_SIZE - 1), pRam->GCPhysLast);
+        pChunk->GCPhys            = GCPhysFirst;
+        pChunk->cPages            = (uint32_t)((GCPhysLast - GCPhysFirst + 1) >> PAGE_SHIFT);
+        pChunk->GCPhysHandler     = NIL_RTGCPHYS;
+        pChunk->GCPhysHandlerLast = NIL_RTGCPHYS;
+
+        if (iInsert < pPC->cChunks)
+            memmove(&pPC->papChunks[iInsert + 1], &pPC->papChunks[iInsert], (pPC->cChunks - iInsert) * sizeof(pPC->papChunks[0]));
+        pPC->papChunks[iInsert] = pChunk;
+        pPC->cChunks++;
+    }
+
+    /*
+     * Mark the page.
+     */
+    if (!ASMBitTestAndSet(pChunk->bmPending, (int32_t)((GCPhys - pChunk->GCPhys) >> PAGE_SHIFT)))
+    {
+        pChunk->cPending++;
+        ASMAtomicIncU32(&pPC->cPending);
+        pPC->cPagesTotal++;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Logs the post-copy statistics once the target has got all the pages.
+ *
+ * @param   pPC             The post-copy state.
+ */
+static void pgmR3PostCopyTrgReport(PPGMPOSTCOPY pPC)
+{
+    uint64_t const cDemandFaults = pPC->cDemandFaults;
+    LogRel(("PGM: %s completed %u pages in %'RU64 ms; %'RU64 demand faults waited %'RU64 us on average, %'RU64 us max\n",
+            pPC->pLazy ? "Lazy restore" : "Post-copy", pPC->cPagesTotal, pPC->nsStart ? (RTTimeNanoTS() - pPC->nsStart) / RT_NS_1MS : 0, cDemandFaults,
+            cDemandFaults ? pPC->cNsDemandWait / cDemandFaults / RT_NS_1US : 0, pPC->cNsDemandWaitMax / RT_NS_1US));
+}
+
+
+static DECLCALLBACK(void) pgmR3PostCopyTrgInstallReq(PVM pVM);
+
+
+/**
+ * Makes sure an EMT picks up pgmR3PostCopyTrgInstallReq.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.  Caller owns the critsect.
+ */
+static int pgmR3PostCopyTrgQueueInstallReq(PVM pVM, PPGMPOSTCOPY pPC)
+{
+    int rc = VINF_SUCCESS;
+    if (!pPC->fInstallPending)
+    {
+        rc = VMR3ReqCallVoidNoWait(pVM, VMCPUID_ANY, (PFNRT)pgmR3PostCopyTrgInstallReq, 1, pVM);
+        pPC->fInstallPending = RT_SUCCESS(rc);
+    }
+    return rc;
+}
+
+
+/**
+ * Deregisters the access handlers of the chunks which have got all their
+ * pages since and frees the chunks.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.  Caller has entered it via
+ *                          pgmR3PostCopyEnter.
+ * @thread  EMT, not inside a guest paging structure walk.
+ */
+static void pgmR3PostCopyTrgRetireChunks(PVM pVM, PPGMPOSTCOPY pPC)
+{
+    pPC->fRetirePending = false;
+    for (uint32_t i = pPC->cChunks; i-- > 0;)
+    {
+        PPGMPOSTCOPYCHUNK pChunk = pPC->papChunks[i];
+        if (!pChunk->cPending)
+        {
+            if (pChunk->GCPhysHandler != NIL_RTGCPHYS)
+            {
+                int rc = PGMHandlerPhysicalDeregister(pVM, pChunk->GCPhysHandler);
+                AssertLogRelRC(rc);
+                pChunk->GCPhysHandler     = NIL_RTGCPHYS;
+                pChunk->GCPhysHandlerLast = NIL_RTGCPHYS;
+            }
+            pgmR3PostCopyRemoveChunk(pVM, pPC, pChunk);
+        }
+    }
+}
+
+
+/**
+ * Installs a received page and updates the chunk and access handler.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.  Caller has entered it via
+ *                          pgmR3PostCopyEnter.
+ * @param   pEntry          The received page.
+ * @param   fDeferHandlers  Set when the caller may be inside a guest paging
+ *                          structure walk, where deregistering an access
+ *                          handler would pull the shadow paging structures
+ *                          out from under it.  The page is merely switched
+ *                          off and the handler left to
+ *                          pgmR3PostCopyTrgRetireChunks.
+ * @thread  EMT
+ */
+static void pgmR3PostCopyTrgInstallPage(PVM pVM, PPGMPOSTCOPY pPC, PPGMPOSTCOPYQENTRY pEntry, bool fDeferHandlers)
+{
+    PPGMPOSTCOPYCHUNK pChunk = pgmR3PostCopyLookupChunk(pPC, pEntry->GCPhys, NULL);
+    if (!pChunk)
+        return;
+    int32_t const iPage = (int32_t)((pEntry->GCPhys - pChunk->GCPhys) >> PAGE_SHIFT);
+    if (!ASMBitTest(pChunk->bmPending, iPage))
+        return; /* already got it */
+
+    /*
+     * Copy the content into the page.  Pages which have been remapped or
+     * ballooned by the guest in the meanwhile are left alone.
+     */
+    pgmLock(pVM);
+    PPGMPAGE pPage;
+    int rc = pgmPhysGetPageEx(pVM, pEntry->GCPhys, &pPage);
+    if (   RT_SUCCESS(rc)
+        && PGM_PAGE_GET_TYPE(pPage) == PGMPAGETYPE_RAM
+        && !PGM_PAGE_IS_BALLOONED(pPage)
+        && (!pEntry->fZero || !PGM_PAGE_IS_ZERO(pPage)))
+    {
+        PGMPAGEMAPLOCK PgMpLck;
+        void          *pvDstPage;
+        rc = pgmPhysGCPhys2CCPtrInternal(pVM, pPage, pEntry->GCPhys, &pvDstPage, &PgMpLck);
+        if (RT_SUCCESS(rc))
+        {
+            if (pEntry->fZero)
+                ASMMemZeroPage(pvDstPage);
+            else
+                memcpy(pvDstPage, pEntry->abPage, PAGE_SIZE);
+            pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+        }
+    }
+    pgmUnlock(pVM);
+    AssertLogRelMsgRC(rc, ("GCPhys=%RGp rc=%Rrc\n", pEntry->GCPhys, rc));
+
+    /*
+     * Update the bookkeeping and let the guest at the page.
+     */
+    ASMBitClear(pChunk->bmPending, iPage);
+    pChunk->cPending--;
+    uint32_t const cPending = ASMAtomicDecU32(&pPC->cPending);
+    if (pChunk->GCPhysHandler != NIL_RTGCPHYS)
+    {
+        if (!pChunk->cPending && !fDeferHandlers)
+        {
+            rc = PGMHandlerPhysicalDeregister(pVM, pChunk->GCPhysHandler);
+            AssertLogRelRC(rc);
+            pChunk->GCPhysHandler     = NIL_RTGCPHYS;
+            pChunk->GCPhysHandlerLast = NIL_RTGCPHYS;
+        }
+        else
+        {
+            if (   pEntry->GCPhys >= pChunk->GCPhysHandler
+                && pEntry->GCPhys <= pChunk->GCPhysHandlerLast)
+            {
+                rc = PGMHandlerPhysicalPageTempOff(pVM, pChunk->GCPhysHandler, pEntry->GCPhys);
+                AssertRC(rc);
+            }
+            if (!pChunk->cPending)
+            {
+                pPC->fRetirePending = true;
+                pgmR3PostCopyTrgQueueInstallReq(pVM, pPC);
+            }
+        }
+    }
+    if (!pChunk->cPending && pChunk->GCPhysHandler == NIL_RTGCPHYS)
+        pgmR3PostCopyRemoveChunk(pVM, pPC, pChunk);
+    if (!cPending)
+        pgmR3PostCopyTrgReport(pPC);
+}
+
+
+/**
+ * Installs all the queued pages.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.  Caller has entered it via
+ *                          pgmR3PostCopyEnter.
+ * @param   fDeferHandlers  See pgmR3PostCopyTrgInstallPage.
+ * @thread  EMT
+ */
+static void pgmR3PostCopyTrgInstallQueued(PVM pVM, PPGMPOSTCOPY pPC, bool fDeferHandlers)
+{
+    if (pPC->iTail == pPC->iHead)
+        return;
+    while (pPC->iTail != pPC->iHead)
+    {
+        pgmR3PostCopyTrgInstallPage(pVM, pPC, &pPC->paQueue[pPC->iTail % PGM_POSTCOPY_QUEUE_SIZE], fDeferHandlers);
+        pPC->iTail++;
+    }
+    RTSemEventSignal(pPC->hEvtSpace);
+    RTSemEventMultiSignal(pPC->hEvtUpdate);
+}
+
+
+/**
+ * EMT request for installing the queued pages and retiring the access
+ * handlers of complete chunks.
+ *
+ * @param   pVM             The cross context VM structure.
+ */
+static DECLCALLBACK(void) pgmR3PostCopyTrgInstallReq(PVM pVM)
+{
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (pPC && !pPC->fSource)
+    {
+        pgmR3PostCopyEnter(pVM, pPC);
+        pPC->fInstallPending = false;
+        pgmR3PostCopyTrgInstallQueued(pVM, pPC, false /*fDeferHandlers*/);
+        if (pPC->fRetirePending)
+            pgmR3PostCopyTrgRetireChunks(pVM, pPC);
+        pgmR3PostCopyLeave(pVM, pPC);
+    }
+}
+
+
+/**
+ * Marks the post-copy transfer as failed and suspends the VM.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.
+ * @param   rc              The reason.
+ */
+static void pgmR3PostCopyTrgAbort(PVM pVM, PPGMPOSTCOPY pPC, int rc)
+{
+    RTCritSectEnter(&pPC->CritSect);
+    bool const fFirst = !pPC->fAborted && pPC->cPending > 0;
+    ASMAtomicWriteBool(&pPC->fAborted, true);
+    pPC->pfnRequest = NULL;
+    uint32_t const cPending = pPC->cPending;
+    RTSemEventSignal(pPC->hEvtSpace);
+    RTSemEventMultiSignal(pPC->hEvtUpdate);
+    RTCritSectLeave(&pPC->CritSect);
+
+    if (fFirst)
+    {
+        LogRel(("PGM: Post-copy aborted with %u of %u pages missing: %Rrc\n", cPending, pPC->cPagesTotal, rc));
+        if (pPC->pLazy)
+            VMSetRuntimeError(pVM, VMSETRTERR_FLAGS_SUSPEND | VMSETRTERR_FLAGS_NO_WAIT, "LazyRestoreFailed",
+                              N_("Reading the guest memory from the saved state failed (%Rrc). The VM cannot continue"),
+                              rc);
+        else
+            VMSetRuntimeError(pVM, VMSETRTERR_FLAGS_SUSPEND | VMSETRTERR_FLAGS_NO_WAIT, "PostCopyAborted",
+                              N_("The connection to the teleportation source was lost before all the guest memory had been received (%Rrc). The VM cannot continue"),
+                              rc);
+    }
+}
+
+
+/**
+ * Waits for a missing page to arrive and be installed.
+ *
+ * An EMT installs whatever has arrived itself.  When it owns the PGM lock, it
+ * is the only one who can, the other EMTs are locked out.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_PGM_POST_COPY_ABORTED if the page will never arrive.
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.
+ * @param   GCPhys          The page address.
+ */
+static int pgmR3PostCopyTrgWaitForPage(PVM pVM, PPGMPOSTCOPY pPC, RTGCPHYS GCPhys)
+{
+    bool const  fEmt       = VM_IS_EMT(pVM);
+    bool const  fLocked    = PGMIsLockOwner(pVM);
+    bool        fRequested = false;
+    uint64_t    nsStart    = 0;
+    int         rc         = VINF_SUCCESS;
+    Assert(fEmt || !fLocked);
+    for (;;)
+    {
+        if (fEmt)
+            pgmR3PostCopyEnter(pVM, pPC);
+        else
+            RTCritSectEnter(&pPC->CritSect);
+        if (!pgmR3PostCopyIsPending(pPC, GCPhys))
+            break;
+        if (pPC->fAborted)
+        {
+            rc = VERR_PGM_POST_COPY_ABORTED;
+            break;
+        }
+        if (!nsStart)
+        {
+            nsStart = RTTimeNanoTS();
+            pPC->cDemandFaults++;
+        }
+
+        /* Install whatever has arrived if we can. */
+        bool const fQueued = pPC->iHead != pPC->iTail;
+        if (fQueued && fEmt)
+        {
+            pgmR3PostCopyTrgInstallQueued(pVM, pPC, fLocked /*fDeferHandlers*/);
+            pgmR3PostCopyLeave(pVM, pPC);
+            continue;
+        }
+
+        /* Ask for the page once the transfer has been started.  This is done
+           while owning the critsect so the callback won't be called after
+           PGMR3PostCopyTrgAbort or PGMR3PostCopyEnd has returned. */
+        int rc2 = VINF_SUCCESS;
+        if (!fRequested && pPC->pfnRequest)
+        {
+            fRequested = true;
+            rc2 = pPC->pfnRequest(pVM->pUVM, GCPhys, pPC->pvUser);
+        }
+        if (!fQueued && RT_SUCCESS(rc2))
+            RTSemEventMultiReset(pPC->hEvtUpdate);
+        if (fEmt)
+            pgmR3PostCopyLeave(pVM, pPC);
+        else
+            RTCritSectLeave(&pPC->CritSect);
+        if (RT_FAILURE(rc2))
+        {
+            pgmR3PostCopyTrgAbort(pVM, pPC, rc2);
+            continue;
+        }
+
+        if (fQueued)
+            RTThreadSleep(1); /* An EMT will install it shortly. */
+        else
+            RTSemEventMultiWait(pPC->hEvtUpdate, 100);
+    }
+    if (fEmt)
+        pgmR3PostCopyLeave(pVM, pPC);
+    else
+        RTCritSectLeave(&pPC->CritSect);
+
+    if (nsStart)
+    {
+        uint64_t const cNsWaited = RTTimeNanoTS() - nsStart;
+        RTCritSectEnter(&pPC->CritSect);
+        pPC->cNsDemandWait += cNsWaited;
+        if (cNsWaited > pPC->cNsDemandWaitMax)
+            pPC->cNsDemandWaitMax = cNsWaited;
+        RTCritSectLeave(&pPC->CritSect);
+    }
+    return rc;
+}
+
+
+/**
+ * Makes sure a page isn't missing before it's mapped directly.
+ *
+ * This is called by the page mapping APIs and the guest paging structure
+ * walks (see pgmPhysPostCopyFetch), which don't consult access handlers,
+ * while the post-copy target is still receiving pages.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ * @param   GCPhys          The guest physical address.
+ */
+int pgmR3PostCopyTrgFetchPage(PVM pVM, RTGCPHYS GCPhys)
+{
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (   !pPC
+        || pPC->fSource
+        || !ASMAtomicReadU32(&pPC->cPending))
+        return VINF_SUCCESS;
+
+    /* Only an EMT can install the page, which it cannot do while another
+       thread owns the PGM lock. */
+    if (!VM_IS_EMT(pVM) && PGMIsLockOwner(pVM))
+    {
+        LogRelMax(32, ("PGM: Post-copy: Mapping %RGp on a non-EMT owning the PGM lock\n", GCPhys));
+        return VINF_SUCCESS;
+    }
+    return pgmR3PostCopyTrgWaitForPage(pVM, pPC, GCPhys & ~(RTGCPHYS)PAGE_OFFSET_MASK);
+}
+
+
+/**
+ * Fetches a page still missing on the post-copy target on behalf of ring-0
+ * or raw-mode, see pgmPhysPostCopyFetch.
+ *
+ * For VMMCALLRING3_PGM_POSTCOPY_FETCH, considered internal.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ * @param   GCPhys          The page address.
+ * @thread  EMT
+ */
+VMMR3_INT_DECL(int) PGMR3PostCopyTrgFetchPage(PVM pVM, RTGCPHYS GCPhys)
+{
+    VM_ASSERT_EMT(pVM);
+    return pgmR3PostCopyTrgFetchPage(pVM, GCPhys);
+}
+
+
+/**
+ * @callback_method_impl{FNPGMPHYSHANDLER,
+ *      Access handler for pages which are still missing on the post-copy
+ *      target.}
+ *
+ * Ring-0 and raw-mode use the default handlers, which defer to ring-3.
+ *
+ * @remarks The @a pvUser argument points to the PGMPOSTCOPYCHUNK.
+ */
+static DECLCALLBACK(VBOXSTRICTRC)
+pgmR3PostCopyAccessHandler(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys, void *pvPhys, void *pvBuf, size_t cbBuf,
+                           PGMACCESSTYPE enmAccessType, PGMACCESSORIGIN enmOrigin, void *pvUser)
+{
+    NOREF(pVCpu); NOREF(pvPhys); NOREF(enmOrigin); NOREF(pvUser);
+    Assert(!PGMIsLockOwner(pVM));
+
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    int rc = pPC && !pPC->fSource
+           ? pgmR3PostCopyTrgWaitForPage(pVM, pPC, GCPhys & ~(RTGCPHYS)PAGE_OFFSET_MASK)
+           : VINF_SUCCESS;
+    if (RT_FAILURE(rc))
+    {
+        /* The VM is being suspended, read all ones and drop writes. */
+        if (enmAccessType == PGMACCESSTYPE_READ)
+            memset(pvBuf, 0xff, cbBuf);
+        return VINF_SUCCESS;
+    }
+
+    /*
+     * Writes go to the mapping the caller made before calling us, which is
+     * the page we installed the content in.
+     */
+    if (enmAccessType == PGMACCESSTYPE_WRITE)
+        return VINF_PGM_HANDLER_DO_DEFAULT;
+
+    /*
+     * Reads must be redone as the caller may have mapped the zero page.
+     */
+    pgmLock(pVM);
+    PPGMPAGE pPage;
+    rc = pgmPhysGetPageEx(pVM, GCPhys, &pPage);
+    if (RT_SUCCESS(rc))
+    {
+        PGMPAGEMAPLOCK  PgMpLck;
+        void const     *pvSrc;
+        rc = pgmPhysGCPhys2CCPtrInternalReadOnly(pVM, pPage, GCPhys, &pvSrc, &PgMpLck);
+        if (RT_SUCCESS(rc))
+        {
+            memcpy(pvBuf, pvSrc, cbBuf);
+            pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+        }
+    }
+    pgmUnlock(pVM);
+    AssertLogRelMsgRCReturn(rc, ("GCPhys=%RGp rc=%Rrc\n", GCPhys, rc), rc);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Covers the missing pages with access handlers after loading the state.
+ *
+ * Each chunk gets one handler spanning its first to its last missing page,
+ * the pages in between which we already have are switched off.  Should
+ * registering fail (conflicting handler, out of hyper heap), the pages of
+ * the chunk are fetched synchronously by PGMR3PostCopyTrgStart (or
+ * pgmR3PostCopyTrgStartLazy).
+ *
+ * Nothing is armed without nested paging: the page pool write monitors every
+ * guest page table it shadows with an access handler of its own, which would
+ * collide with ours.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ * @thread  EMT
+ */
+int pgmR3PostCopyTrgArm(PVM pVM)
+{
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (!pPC || pPC->fSource)
+        return VINF_SUCCESS;
+    if (!pVM->pgm.s.fNestedPaging)
+    {
+        LogRel(("PGM: Post-copy: No nested paging, all %u missing pages are fetched before the VM resumes\n", pPC->cPending));
+        return VINF_SUCCESS;
+    }
+
+    pgmR3PostCopyEnter(pVM, pPC);
+    uint32_t cArmed = 0;
+    for (uint32_t i = 0; i < pPC->cChunks; i++)
+    {
+        PPGMPOSTCOPYCHUNK pChunk = pPC->papChunks[i];
+        int32_t const iFirst = ASMBitFirstSet(pChunk->bmPending, pChunk->cPages);
+        int32_t const iLast  = pgmR3PostCopyChunkLastPending(pChunk);
+        AssertStmt(iFirst >= 0 && iLast >= iFirst, continue);
+
+        RTGCPHYS const GCPhysFirst = pChunk->GCPhys + ((RTGCPHYS)iFirst << PAGE_SHIFT);
+        RTGCPHYS const GCPhysLast  = pChunk->GCPhys + ((RTGCPHYS)iLast  << PAGE_SHIFT) + PAGE_OFFSET_MASK;
+        int rc = PGMHandlerPhysicalRegister(pVM, GCPhysFirst, GCPhysLast, pVM->pgm.s.hPostCopyPhysHandlerType,
+                                            pChunk, NIL_RTR0PTR, NIL_RTRCPTR, "Post-copy");
+        if (RT_SUCCESS(rc))
+        {
+            pChunk->GCPhysHandler     = GCPhysFirst;
+            pChunk->GCPhysHandlerLast = GCPhysLast;
+            for (int32_t iPage = iFirst + 1; iPage < iLast; iPage++)
+                if (!ASMBitTest(pChunk->bmPending, iPage))
+                {
+                    rc = PGMHandlerPhysicalPageTempOff(pVM, GCPhysFirst, pChunk->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT));
+                    AssertRC(rc);
+                }
+            cArmed++;
+        }
+        else
+            LogRel(("PGM: Post-copy: Failed to register access handler for %RGp-%RGp: %Rrc\n", GCPhysFirst, GCPhysLast, rc));
+    }
+    if (cArmed)
+        ASMAtomicWriteBool(&pVM->pgm.s.fPostCopyTrgArmed, true);
+    LogRel(("PGM: Post-copy: %u pages missing in %u chunks (%u armed)\n", pPC->cPending, pPC->cChunks, cArmed));
+    pgmR3PostCopyLeave(pVM, pPC);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Registers the access handler type for missing post-copy pages.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ */
+int pgmR3PostCopyInit(PVM pVM)
+{
+    /*
+     * The max number of hot pages the final live save pass saves when the
+     * other dirty pages are left to a post-copy phase.
+     */
+    int rc = CFGMR3QueryU32Def(CFGMR3GetChild(CFGMR3GetRoot(pVM), "/PGM"), "PostCopyHotPages",
+                               &pVM->pgm.s.LiveSave.cPostCopyHotPages, PGM_POSTCOPY_DEF_HOT_PAGES);
+    AssertLogRelRCReturn(rc, rc);
+
+    return PGMR3HandlerPhysicalTypeRegister(pVM, PGMPHYSHANDLERKIND_ALL,
+                                            pgmR3PostCopyAccessHandler,
+                                            NULL, NULL, NULL,
+                                            NULL, NULL, NULL,
+                                            "Post-copy",
+                                            &pVM->pgm.s.hPostCopyPhysHandlerType);
+}
+
+
+/**
+ * Drops the post-copy state on reset, the memory content is history.
+ *
+ * The target keeps the (empty) state around since the thread feeding it may
+ * still be busy, PGMR3PostCopyEnd or PGMR3Term frees it.
+ *
+ * @param   pVM             The cross context VM structure.
+ * @thread  EMT
+ */
+void pgmR3PostCopyReset(PVM pVM)
+{
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (pPC)
+    {
+        if (pPC->fSource)
+            pgmR3PostCopyDestroy(pVM);
+        else
+        {
+            /* A lazy restore is done with, the memory it would read is history. */
+            PPGMLAZY pLazy = pPC->pLazy;
+            if (pLazy)
+                pgmR3LazyStopThread(pLazy);
+
+            pgmR3PostCopyEnter(pVM, pPC);
+            if (pPC->cPending)
+                LogRel(("PGM: Post-copy: Reset with %u pages missing\n", pPC->cPending));
+            if (pLazy)
+            {
+                pPC->pLazy      = NULL;
+                pPC->pfnRequest = NULL;
+            }
+            pgmR3PostCopyFreeChunks(pVM, pPC);
+            pPC->iTail = pPC->iHead;
+            RTSemEventSignal(pPC->hEvtSpace);
+            RTSemEventMultiSignal(pPC->hEvtUpdate);
+            pgmR3PostCopyLeave(pVM, pPC);
+            pgmR3LazyFree(pVM, pLazy);
+        }
+    }
+}
+
+
+/**
+ * Frees the post-copy state at VM termination.
+ *
+ * @param   pVM             The cross context VM structure.
+ */
+void pgmR3PostCopyTerm(PVM pVM)
+{
+    pgmR3PostCopyDestroy(pVM);
+}
+
+
+/**
+ * Enables or disables post-copy for the next live save (source).
+ *
+ * When enabled, the live save finishes after a few passes regardless of the
+ * dirty rate and the final pass leaves most dirty pages to be transferred by
+ * the caller after the target has resumed, see PGMR3PostCopySrcNextPage and
+ * PGMR3PostCopySrcReadPage.  The saved state cannot be loaded by anyone not
+ * prepared to receive the pages, so only enable this when the target has
+ * agreed to it.
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ * @param   fEnable         Whether to enable or disable it.
+ * @thread  Any, but not while a save is in progress.
+ */
+VMMR3DECL(int) PGMR3PostCopySrcEnable(PUVM pUVM, bool fEnable)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertReturn(!pVM->pgm.s.LiveSave.fActive, VERR_WRONG_ORDER);
+
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (pPC && !pPC->fSource && ASMAtomicReadU32(&pPC->cPending))
+        return VERR_WRONG_ORDER;
+
+    /* Drop the leftovers of a previous (failed) attempt or a completed
+       transfer to this VM (or lazy restore of it). */
+    if (pPC)
+        pgmR3PostCopyDestroy(pVM);
+    pVM->pgm.s.LiveSave.fPostCopy = fEnable;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Gets the next page the source has yet to send.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_FOUND if there are no more pages.
+ * @param   pUVM            The user mode VM handle.
+ * @param   pGCPhys         Where to return the page address.
+ * @thread  Any.
+ */
+VMMR3DECL(int) PGMR3PostCopySrcNextPage(PUVM pUVM, PRTGCPHYS pGCPhys)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pGCPhys, VERR_INVALID_POINTER);
+
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (!pPC || !pPC->fSource)
+        return VERR_NOT_FOUND;
+
+    int rc = VERR_NOT_FOUND;
+    RTCritSectEnter(&pPC->CritSect);
+    while (pPC->iNextChunk < pPC->cChunks)
+    {
+        PPGMPOSTCOPYCHUNK pChunk = pPC->papChunks[pPC->iNextChunk];
+        int32_t iPage = ASMBitFirstSet(pChunk->bmPending, pChunk->cPages);
+        if (iPage >= 0)
+        {
+            *pGCPhys = pChunk->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+            rc = VINF_SUCCESS;
+            break;
+        }
+        pPC->iNextChunk++;
+    }
+    RTCritSectLeave(&pPC->CritSect);
+    return rc;
+}
+
+
+/**
+ * Reads a page the source has yet to send and marks it as sent.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_FOUND if the page isn't pending (any more).
+ * @param   pUVM            The user mode VM handle.
+ * @param   GCPhys          The page address.
+ * @param   pvBuf           Where to return the page content (PAGE_SIZE).
+ * @param   pfZero          Where to return whether it's all zeros.
+ * @thread  Any.  The VM must not be running.
+ */
+VMMR3DECL(int) PGMR3PostCopySrcReadPage(PUVM pUVM, RTGCPHYS GCPhys, void *pvBuf, bool *pfZero)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pvBuf, VERR_INVALID_POINTER);
+    AssertPtrReturn(pfZero, VERR_INVALID_POINTER);
+    AssertReturn(!(GCPhys & PAGE_OFFSET_MASK), VERR_INVALID_PARAMETER);
+
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (!pPC || !pPC->fSource)
+        return VERR_NOT_FOUND;
+
+    /*
+     * Claim the page.
+     */
+    RTCritSectEnter(&pPC->CritSect);
+    PPGMPOSTCOPYCHUNK pChunk = pgmR3PostCopyLookupChunk(pPC, GCPhys, NULL);
+    bool const fPending = pChunk
+                       && ASMBitTestAndClear(pChunk->bmPending, (int32_t)((GCPhys - pChunk->GCPhys) >> PAGE_SHIFT));
+    if (fPending)
+    {
+        pChunk->cPending--;
+        ASMAtomicDecU32(&pPC->cPending);
+    }
+    RTCritSectLeave(&pPC->CritSect);
+    if (!fPending)
+        return VERR_NOT_FOUND;
+
+    /*
+     * Read it.  Like the save code, we go straight at the page as it's not
+     * subject to any access handlers.
+     */
+    pgmLock(pVM);
+    PPGMPAGE pPage;
+    int rc = pgmPhysGetPageEx(pVM, GCPhys, &pPage);
+    if (RT_SUCCESS(rc))
+    {
+        if (PGM_PAGE_IS_ZERO(pPage) || PGM_PAGE_IS_BALLOONED(pPage))
+        {
+            RT_BZERO(pvBuf, PAGE_SIZE);
+            *pfZero = true;
+        }
+        else
+        {
+            PGMPAGEMAPLOCK  PgMpLck;
+            void const     *pvPage;
+            rc = pgmPhysGCPhys2CCPtrInternalReadOnly(pVM, pPage, GCPhys, &pvPage, &PgMpLck);
+            if (RT_SUCCESS(rc))
+            {
+                memcpy(pvBuf, pvPage, PAGE_SIZE);
+                pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+                *pfZero = ASMMemIsZeroPage(pvBuf);
+            }
+        }
+    }
+    pgmUnlock(pVM);
+    return rc;
+}
+
+
+/**
+ * Starts the post-copy transfer on the target.
+ *
+ * This must be called after the state has been loaded and before the VM is
+ * resumed.  Missing pages of chunks which could not be covered by access
+ * handlers are fetched before returning.
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ * @param   pfnRequest      Callback for requesting a page from the source.
+ * @param   pvUser          User argument for the callback.
+ * @thread  Any but an EMT.
+ */
+VMMR3DECL(int) PGMR3PostCopyTrgStart(PUVM pUVM, PFNPGMPOSTCOPYREQUEST pfnRequest, void *pvUser)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pfnRequest, VERR_INVALID_POINTER);
+    VM_ASSERT_OTHER_THREAD(pVM);
+
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (!pPC || pPC->fSource)
+        return VINF_SUCCESS;
+
+    /*
+     * Install the callback and collect the pages we must have before
+     * resuming.
+     */
+    RTGCPHYS   *paGCPhys = NULL;
+    uint32_t    cPages   = 0;
+    RTCritSectEnter(&pPC->CritSect);
+    pPC->pfnRequest = pfnRequest;
+    pPC->pvUser     = pvUser;
+    pPC->nsStart    = RTTimeNanoTS();
+    for (uint32_t i = 0; i < pPC->cChunks; i++)
+        if (pPC->papChunks[i]->GCPhysHandler == NIL_RTGCPHYS)
+            cPages += pPC->papChunks[i]->cPending;
+    if (cPages)
+    {
+        paGCPhys = (RTGCPHYS *)MMR3HeapAlloc(pVM, MM_TAG_PGM, cPages * sizeof(RTGCPHYS));
+        if (paGCPhys)
+        {
+            uint32_t iDst = 0;
+            for (uint32_t i = 0; i < pPC->cChunks; i++)
+            {
+                PPGMPOSTCOPYCHUNK pChunk = pPC->papChunks[i];
+                if (pChunk->GCPhysHandler == NIL_RTGCPHYS)
+                    for (int32_t iPage = ASMBitFirstSet(pChunk->bmPending, pChunk->cPages);
+                         iPage >= 0;
+                         iPage = ASMBitNextSet(pChunk->bmPending, pChunk->cPages, iPage))
+                        paGCPhys[iDst++] = pChunk->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+            }
+            Assert(iDst == cPages);
+        }
+    }
+    RTCritSectLeave(&pPC->CritSect);
+    if (cPages && !paGCPhys)
+        return VERR_NO_MEMORY;
+
+    /*
+     * Request them all before waiting for any, so they're streamed.
+     */
+    int rc = VINF_SUCCESS;
+    if (cPages)
+    {
+        LogRel(("PGM: Post-copy: Fetching %u pages not covered by access handlers\n", cPages));
+        for (uint32_t i = 0; i < cPages && RT_SUCCESS(rc); i++)
+        {
+            RTCritSectEnter(&pPC->CritSect);
+            if (pPC->pfnRequest)
+                rc = pPC->pfnRequest(pUVM, paGCPhys[i], pPC->pvUser);
+            RTCritSectLeave(&pPC->CritSect);
+        }
+        if (RT_FAILURE(rc))
+            pgmR3PostCopyTrgAbort(pVM, pPC, rc);
+        for (uint32_t i = 0; i < cPages && RT_SUCCESS(rc); i++)
+        {
+            RTCritSectEnter(&pPC->CritSect);
+            bool const fPending = pgmR3PostCopyIsPending(pPC, paGCPhys[i]);
+            bool const fAborted = pPC->fAborted;
+            if (fPending && !fAborted)
+                RTSemEventMultiReset(pPC->hEvtUpdate);
+            RTCritSectLeave(&pPC->CritSect);
+            if (fAborted)
+                rc = VERR_PGM_POST_COPY_ABORTED;
+            else if (fPending)
+            {
+                RTSemEventMultiWait(pPC->hEvtUpdate, 100);
+                i--;
+            }
+        }
+        MMR3HeapFree(paGCPhys);
+    }
+    return rc;
+}
+
+
+/**
+ * Queues a page for installing by an EMT, worker for
+ * PGMR3PostCopyTrgDeliverPage and the lazy restore thread.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_CANCELLED if the lazy restore thread is told to stop.
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state (target).
+ * @param   GCPhys          The page address.
+ * @param   pvPage          The page content, NULL for a zero page.
+ * @thread  Any but an EMT.
+ */
+static int pgmR3PostCopyTrgQueuePage(PVM pVM, PPGMPOSTCOPY pPC, RTGCPHYS GCPhys, const void *pvPage)
+{
+    RTCritSectEnter(&pPC->CritSect);
+    for (;;)
+    {
+        if (pPC->fAborted)
+        {
+            RTCritSectLeave(&pPC->CritSect);
+            return VERR_PGM_POST_COPY_ABORTED;
+        }
+        if (pPC->pLazy && ASMAtomicReadBool(&pPC->pLazy->fStop))
+        {
+            RTCritSectLeave(&pPC->CritSect);
+            return VERR_CANCELLED;
+        }
+        if (!pgmR3PostCopyIsPending(pPC, GCPhys))
+        {
+            RTCritSectLeave(&pPC->CritSect);
+            return VINF_SUCCESS;
+        }
+        if (pPC->iHead - pPC->iTail < PGM_POSTCOPY_QUEUE_SIZE)
+            break;
+        RTCritSectLeave(&pPC->CritSect);
+        RTSemEventWait(pPC->hEvtSpace, 100);
+        RTCritSectEnter(&pPC->CritSect);
+    }
+
+    PPGMPOSTCOPYQENTRY pEntry = &pPC->paQueue[pPC->iHead % PGM_POSTCOPY_QUEUE_SIZE];
+    pEntry->GCPhys = GCPhys;
+    pEntry->fZero  = pvPage == NULL;
+    if (pvPage)
+        memcpy(pEntry->abPage, pvPage, PAGE_SIZE);
+    pPC->iHead++;
+
+    int rc = VINF_SUCCESS;
+    if (!pPC->fInstallPending)
+    {
+        rc = VMR3ReqCallVoidNoWait(pVM, VMCPUID_ANY, (PFNRT)pgmR3PostCopyTrgInstallReq, 1, pVM);
+        pPC->fInstallPending = RT_SUCCESS(rc);
+    }
+    RTSemEventMultiSignal(pPC->hEvtUpdate);
+    RTCritSectLeave(&pPC->CritSect);
+    return rc;
+}
+
+
+/**
+ * Hands a page received from the source to the target VM.
+ *
+ * Pages which are not missing (any more) are ignored.  This may block for a
+ * while if the EMTs are slow at installing the pages.
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ * @param   GCPhys          The page address.
+ * @param   pvPage          The page content, NULL for a zero page.
+ * @thread  Any but an EMT.
+ */
+VMMR3DECL(int) PGMR3PostCopyTrgDeliverPage(PUVM pUVM, RTGCPHYS GCPhys, const void *pvPage)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertReturn(!(GCPhys & PAGE_OFFSET_MASK), VERR_INVALID_PARAMETER);
+    VM_ASSERT_OTHER_THREAD(pVM);
+
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (!pPC || pPC->fSource)
+        return VINF_SUCCESS;
+    return pgmR3PostCopyTrgQueuePage(pVM, pPC, GCPhys, pvPage);
+}
+
+
+/**
+ * Aborts the post-copy transfer on the target, suspending the VM if pages
+ * are still missing.
+ *
+ * The caller must call this before it stops servicing page requests.
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ * @thread  Any.
+ */
+VMMR3DECL(int) PGMR3PostCopyTrgAbort(PUVM pUVM)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (pPC && !pPC->fSource)
+        pgmR3PostCopyTrgAbort(pVM, pPC, VERR_PGM_POST_COPY_ABORTED);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Gets the number of pages still pending.
+ *
+ * @returns Number of pages to send (source) or receive (target).
+ * @param   pUVM            The user mode VM handle.
+ * @thread  Any.
+ */
+VMMR3DECL(uint32_t) PGMR3PostCopyGetPendingPages(PUVM pUVM)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, 0);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, 0);
+
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    return pPC ? ASMAtomicReadU32(&pPC->cPending) : 0;
+}
+
+
+/**
+ * EMT worker for PGMR3PostCopyEnd.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ */
+static DECLCALLBACK(int) pgmR3PostCopyEndOnEmt(PVM pVM)
+{
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (!pPC)
+        return VINF_SUCCESS;
+    if (pPC->fSource)
+    {
+        pgmR3PostCopyDestroy(pVM);
+        return VINF_SUCCESS;
+    }
+
+    pgmR3PostCopyEnter(pVM, pPC);
+    pgmR3PostCopyTrgInstallQueued(pVM, pPC, false /*fDeferHandlers*/);
+    bool const fComplete = !pPC->cPending;
+    pgmR3PostCopyLeave(pVM, pPC);
+    if (!fComplete)
+        return VERR_PGM_POST_COPY_ABORTED;
+    pgmR3PostCopyDestroy(pVM);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Ends post-copy, freeing the state.
+ *
+ * On the source this also disables post-copy for further live saves.  On the
+ * target this must be called after the last page has been delivered and the
+ * caller has stopped calling PGMR3PostCopyTrgDeliverPage.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_PGM_POST_COPY_ABORTED if the target still lacks pages, the VM
+ *          is suspended with a runtime error.
+ * @param   pUVM            The user mode VM handle.
+ * @thread  Any.
+ */
+VMMR3DECL(int) PGMR3PostCopyEnd(PUVM pUVM)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+
+    pVM->pgm.s.LiveSave.fPostCopy = false;
+    if (!pVM->pgm.s.pPostCopyR3)
+        return VINF_SUCCESS;
+
+    int rc = VMR3ReqCallWaitU(pUVM, VMCPUID_ANY, (PFNRT)pgmR3PostCopyEndOnEmt, 1, pVM);
+    if (rc == VERR_PGM_POST_COPY_ABORTED)
+        pgmR3PostCopyTrgAbort(pVM, pVM->pgm.s.pPostCopyR3, rc);
+    return rc;
+}
+
+
+/**
+ * Looks up the file offset of a lazy restore page.
+ *
+ * @returns true if found, false if not.
+ * @param   pLazy           The lazy restore state.
+ * @param   GCPhys          The page address.
+ * @param   poffFile        Where to return the file offset.
+ */
+static bool pgmR3LazyLookup(PPGMLAZY pLazy, RTGCPHYS GCPhys, uint64_t *poffFile)
+{
+    uint32_t iStart = 0;
+    uint32_t iEnd   = pLazy->cRuns;
+    while (iStart < iEnd)
+    {
+        uint32_t const    i    = iStart + (iEnd - iStart) / 2;
+        PPGMLAZYRUN const pRun = &pLazy->paRuns[i];
+        if (GCPhys < pRun->GCPhys)
+            iEnd = i;
+        else if (GCPhys - pRun->GCPhys >= ((RTGCPHYS)pRun->cPages << PAGE_SHIFT))
+            iStart = i + 1;
+        else
+        {
+            *poffFile = pRun->offFile + ((GCPhys - pRun->GCPhys) >> PAGE_SHIFT) * pLazy->cbStride;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Installs pending pages by reading them from the saved state on the spot.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ * @param   pPC             The post-copy state.  Caller has entered it via
+ *                          pgmR3PostCopyEnter.
+ * @param   fUnarmedOnly    Only do the chunks without an access handler.
+ * @thread  EMT
+ */
+static int pgmR3PostCopyTrgLazyInstallFromFile(PVM pVM, PPGMPOSTCOPY pPC, bool fUnarmedOnly)
+{
+    PPGMLAZY const pLazy = pPC->pLazy;
+    AssertReturn(pLazy->hFile != NIL_RTFILE || !pPC->cPending, VERR_INVALID_HANDLE);
+
+    PPGMPOSTCOPYQENTRY pEntry = (PPGMPOSTCOPYQENTRY)MMR3HeapAlloc(pVM, MM_TAG_PGM, sizeof(*pEntry));
+    if (!pEntry)
+        return VERR_NO_MEMORY;
+    pEntry->fZero = false;
+
+    /* Backwards, as a chunk is removed when its last page is installed. */
+    int rc = VINF_SUCCESS;
+    for (uint32_t i = pPC->cChunks; i-- > 0 && RT_SUCCESS(rc);)
+    {
+        PPGMPOSTCOPYCHUNK pChunk = pPC->papChunks[i];
+        if (fUnarmedOnly && pChunk->GCPhysHandler != NIL_RTGCPHYS)
+            continue;
+        for (uint32_t cLeft = pChunk->cPending; cLeft > 0 && RT_SUCCESS(rc); cLeft--)
+        {
+            int32_t const iPage = ASMBitFirstSet(pChunk->bmPending, pChunk->cPages);
+            AssertBreakStmt(iPage >= 0, rc = VERR_INTERNAL_ERROR_3);
+            pEntry->GCPhys = pChunk->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+
+            uint64_t offFile;
+            if (pgmR3LazyLookup(pLazy, pEntry->GCPhys, &offFile))
+                rc = RTFileReadAt(pLazy->hFile, offFile, pEntry->abPage, PAGE_SIZE, NULL);
+            else
+                rc = VERR_NOT_FOUND;
+            if (RT_SUCCESS(rc))
+                pgmR3PostCopyTrgInstallPage(pVM, pPC, pEntry, false /*fDeferHandlers*/);
+            else
+                LogRel(("PGM: Lazy restore: Failed to read page %RGp: %Rrc\n", pEntry->GCPhys, rc));
+        }
+    }
+
+    MMR3HeapFree(pEntry);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNPGMPOSTCOPYREQUEST,
+ *      Queues a demand request for the lazy restore thread.}
+ *
+ * @remarks The @a pvUser argument points to the PGMPOSTCOPY.
+ */
+static DECLCALLBACK(int) pgmR3PostCopyTrgLazyRequest(PUVM pUVM, RTGCPHYS GCPhys, void *pvUser)
+{
+    PPGMPOSTCOPY pPC   = (PPGMPOSTCOPY)pvUser;
+    PPGMLAZY     pLazy = pPC->pLazy;
+    NOREF(pUVM);
+
+    /* When full, the background reading will get to it eventually. */
+    if (pLazy->iDemandHead - pLazy->iDemandTail < PGM_LAZY_DEMAND_SIZE)
+        pLazy->aDemand[pLazy->iDemandHead++ % PGM_LAZY_DEMAND_SIZE] = GCPhys;
+    RTSemEventSignal(pLazy->hEvtDemand);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNRTTHREAD,
+ *      The lazy restore thread reading the missing pages from the saved state.}
+ */
+static DECLCALLBACK(int) pgmR3PostCopyTrgLazyThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PVM const          pVM      = (PVM)pvUser;
+    PPGMPOSTCOPY const pPC      = pVM->pgm.s.pPostCopyR3;
+    PPGMLAZY const     pLazy    = pPC->pLazy;
+    uint32_t const     cbStride = pLazy->cbStride;
+    NOREF(hThreadSelf);
+
+    uint8_t *pbBuf = (uint8_t *)MMR3HeapAlloc(pVM, MM_TAG_PGM, PGM_LAZY_BATCH_PAGES * cbStride);
+    int      rc    = pbBuf ? VINF_SUCCESS : VERR_NO_MEMORY;
+    while (RT_SUCCESS(rc) && !ASMAtomicReadBool(&pLazy->fStop))
+    {
+        /*
+         * Pick the pages to read: a page an EMT is waiting for, otherwise the
+         * next batch in file order.
+         */
+        RTGCPHYS GCPhys  = NIL_RTGCPHYS;
+        uint64_t offFile = 0;
+        uint32_t cPages  = 0;
+        RTCritSectEnter(&pPC->CritSect);
+        if (!pPC->cPending || pPC->fAborted)
+        {
+            if (!pPC->cPending)
+            {
+                RTFileClose(pLazy->hFile);
+                pLazy->hFile = NIL_RTFILE;
+            }
+            RTCritSectLeave(&pPC->CritSect);
+            break;
+        }
+        while (!cPages && pLazy->iDemandTail != pLazy->iDemandHead)
+        {
+            GCPhys = pLazy->aDemand[pLazy->iDemandTail++ % PGM_LAZY_DEMAND_SIZE];
+            if (   pgmR3PostCopyIsPending(pPC, GCPhys)
+                && pgmR3LazyLookup(pLazy, GCPhys, &offFile))
+                cPages = 1;
+        }
+        while (!cPages && pLazy->iRunNext < pLazy->cRuns)
+        {
+            PPGMLAZYRUN pRun = &pLazy->paRuns[pLazy->iRunNext];
+            if (pLazy->iPageNext >= pRun->cPages)
+            {
+                pLazy->iRunNext++;
+                pLazy->iPageNext = 0;
+                continue;
+            }
+            GCPhys = pRun->GCPhys + ((RTGCPHYS)pLazy->iPageNext << PAGE_SHIFT);
+            if (!pgmR3PostCopyIsPending(pPC, GCPhys))
+            {
+                pLazy->iPageNext++;
+                continue;
+            }
+            offFile = pRun->offFile + (uint64_t)pLazy->iPageNext * cbStride;
+            cPages  = RT_MIN(pRun->cPages - pLazy->iPageNext, PGM_LAZY_BATCH_PAGES);
+            pLazy->iPageNext += cPages;
+        }
+        RTCritSectLeave(&pPC->CritSect);
+
+        /* Everything has been queued, wait for the EMTs to install it. */
+        if (!cPages)
+        {
+            RTSemEventWait(pLazy->hEvtDemand, 100);
+            continue;
+        }
+
+        /*
+         * Read and queue them.  The record headers in between are ignored.
+         */
+        rc = RTFileReadAt(pLazy->hFile, offFile, pbBuf, (size_t)(cPages - 1) * cbStride + PAGE_SIZE, NULL);
+        for (uint32_t i = 0; i < cPages && RT_SUCCESS(rc); i++)
+            rc = pgmR3PostCopyTrgQueuePage(pVM, pPC, GCPhys + ((RTGCPHYS)i << PAGE_SHIFT), &pbBuf[i * cbStride]);
+    }
+
+    if (RT_FAILURE(rc) && !ASMAtomicReadBool(&pLazy->fStop) && rc != VERR_PGM_POST_COPY_ABORTED)
+        pgmR3PostCopyTrgAbort(pVM, pPC, rc);
+    MMR3HeapFree(pbBuf);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Starts reading the pages left by a lazy restore load, called by the
+ * "pgmlazy" load done callback after the chunks have been armed.
+ *
+ * Pages of chunks which could not be covered by access handlers are read
+ * right away.  The rest are read by the "PGMLazy" thread.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ * @param   pLazy           The lazy restore state with the page index and
+ *                          open saved state file.  This is consumed.
+ * @thread  EMT
+ */
+int pgmR3PostCopyTrgStartLazy(PVM pVM, PPGMLAZY pLazy)
+{
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (!pPC || pPC->fSource || !pPC->cPending)
+    {
+        pgmR3LazyFree(pVM, pLazy);
+        return VINF_SUCCESS;
+    }
+    Assert(!pPC->pLazy);
+
+    int rc = RTSemEventCreate(&pLazy->hEvtDemand);
+    if (RT_FAILURE(rc))
+    {
+        pgmR3LazyFree(pVM, pLazy);
+        return rc;
+    }
+
+    pgmR3PostCopyEnter(pVM, pPC);
+    pPC->pLazy = pLazy;
+    rc = pgmR3PostCopyTrgLazyInstallFromFile(pVM, pPC, true /*fUnarmedOnly*/);
+    uint32_t const cPending = pPC->cPending;
+    if (RT_SUCCESS(rc) && cPending)
+    {
+        pPC->pfnRequest = pgmR3PostCopyTrgLazyRequest;
+        pPC->pvUser     = pPC;
+        pPC->nsStart    = RTTimeNanoTS();
+    }
+    pgmR3PostCopyLeave(pVM, pPC);
+
+    if (RT_SUCCESS(rc) && cPending)
+    {
+        LogRel(("PGM: Lazy restore: %u of %u pages left to read from the saved state\n", cPending, pLazy->cPages));
+        rc = RTThreadCreate(&pLazy->hThread, pgmR3PostCopyTrgLazyThread, pVM, 0 /*cbStack*/,
+                            RTTHREADTYPE_IO, RTTHREADFLAGS_WAITABLE, "PGMLazy");
+        if (RT_FAILURE(rc))
+        {
+            /* Do it the slow way. */
+            LogRel(("PGM: Lazy restore: Failed to create the thread (%Rrc), reading the pages now\n", rc));
+            pLazy->hThread = NIL_RTTHREAD;
+            pgmR3PostCopyEnter(pVM, pPC);
+            pPC->pfnRequest = NULL;
+            rc = pgmR3PostCopyTrgLazyInstallFromFile(pVM, pPC, false /*fUnarmedOnly*/);
+            pgmR3PostCopyLeave(pVM, pPC);
+        }
+    }
+    return rc;
+}
+
+
+/**
+ * Reads the rest of the pages of a lazy restore so the VM can be saved.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ * @thread  EMT
+ */
+int pgmR3PostCopyTrgLazyComplete(PVM pVM)
+{
+    PPGMPOSTCOPY pPC = pVM->pgm.s.pPostCopyR3;
+    if (!pPC || pPC->fSource || !pPC->pLazy)
+        return VINF_SUCCESS;
+
+    pgmR3LazyStopThread(pPC->pLazy);
+
+    pgmR3PostCopyEnter(pVM, pPC);
+    uint32_t const cPending = pPC->cPending;
+    pgmR3PostCopyTrgInstallQueued(pVM, pPC, false /*fDeferHandlers*/);
+    int rc = pgmR3PostCopyTrgLazyInstallFromFile(pVM, pPC, false /*fUnarmedOnly*/);
+    pgmR3PostCopyLeave(pVM, pPC);
+    if (cPending)
+        LogRel(("PGM: Lazy restore: Read the remaining %u pages before saving: %Rrc\n", cPending, rc));
+
+    if (RT_FAILURE(rc))
+    {
+        pgmR3PostCopyTrgAbort(pVM, pPC, rc);
+        return rc;
+    }
+    pgmR3PostCopyDestroy(pVM);
+    return VINF_SUCCESS;
+}
@@ -21,10 +21,12 @@
 *********************************************************************************************************************************/
 #define LOG_GROUP LOG_GROUP_PGM
 #include <VBox/vmm/pgm.h>
+#include <VBox/vmm/iem.h>
 #include <VBox/vmm/stam.h>
 #include <VBox/vmm/ssm.h>
 #include <VBox/vmm/pdmdrv.h>
 #include <VBox/vmm/pdmdev.h>
+#include <VBox/vmm/uvm.h>
 #include "PGMInternal.h"
 #include <VBox/vmm/vm.h>
 #include "PGMInline.h"
@@ -36,17 +38,29 @@
 #include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/crc.h>
+#include <iprt/file.h>
 #include <iprt/mem.h>
+#include <iprt/path.h>
 #include <iprt/sha.h>
 #include <iprt/string.h>
 #include <iprt/thread.h>
+#include <iprt/uuid.h>
 
 
 /*********************************************************************************************************************************
 *   Defined Constants And Macros                                                                                                 *
 *********************************************************************************************************************************/
+/** The delta saved state data unit version. */
+#define PGM_DELTA_SAVED_STATE_VERSION           1
+/** The max number of parents a delta saved state can have. */
+#define PGM_DELTA_MAX_CHAIN                     32
+/** The lazy restore data units ("pgmlazy", "pgmlazyidx") version. */
+#define PGM_LAZY_SAVED_STATE_VERSION            1
+
 /** Saved state data unit version.  */
-#define PGM_SAVED_STATE_VERSION                 14
+#define PGM_SAVED_STATE_VERSION                 15
+/** Saved state data unit version before the duplicate RAM page records. */
+#define PGM_SAVED_STATE_VERSION_PRE_RAM_DUP     14
 /** Saved state data unit version before the PAE PDPE registers. */
 #define PGM_SAVED_STATE_VERSION_PRE_PAE         13
 /** Saved state data unit version after this includes ballooned page flags in
@@ -87,8 +101,14 @@
 #define PGM_STATE_REC_ROM_PROT          UINT8_C(0x07)
 /** Ballooned page. No data. */
 #define PGM_STATE_REC_RAM_BALLOONED     UINT8_C(0x08)
+/** RAM page identical to one saved in full earlier in the same pass.  The
+ *  RTGCPHYS of that page is the only payload. */
+#define PGM_STATE_REC_RAM_DUP           UINT8_C(0x09)
+/** RAM page left for the post-copy phase of a teleportation.  No data.
+ *  Only emitted when the target has agreed to post-copy. */
+#define PGM_STATE_REC_RAM_POSTCOPY      UINT8_C(0x0a)
 /** The last record type. */
-#define PGM_STATE_REC_LAST              PGM_STATE_REC_RAM_BALLOONED
+#define PGM_STATE_REC_LAST              PGM_STATE_REC_RAM_POSTCOPY
 /** End marker. */
 #define PGM_STATE_REC_END               UINT8_C(0xff)
 /** Flag indicating that the data is preceded by the page address.
@@ -98,6 +118,10 @@
 #define PGM_STATE_REC_FLAG_ADDR         UINT8_C(0x80)
 /** @} */
 
+/** The number of passes a post-copy live save makes before voting to finish
+ *  regardless of the dirty rate. */
+#define PGM_POSTCOPY_MIN_PASSES         3
+
 /** The CRC-32 for a zero page. */
 #define PGM_STATE_CRC32_ZERO_PAGE       UINT32_C(0xc71c0011)
 /** The CRC-32 for a zero half page. */
@@ -128,6 +152,17 @@
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
 *********************************************************************************************************************************/
+/** State for pgmR3DeltaLoadParentPass. */
+typedef struct PGMDELTALOADSTATE
+{
+    /** The cross context VM structure. */
+    PVM                             pVM;
+    /** Set if the parent was saved live (has a pass 0). */
+    bool                            fLive;
+} PGMDELTALOADSTATE;
+/** Pointer to the pgmR3DeltaLoadParentPass state. */
+typedef PGMDELTALOADSTATE *PPGMDELTALOADSTATE;
+
 /** For loading old saved states. (pre-smp) */
 typedef struct
 {
@@ -1076,9 +1111,17 @@ static int pgmR3PrepRamPages(PVM pVM)
      *
      * Note! pgmR3SaveDone will always be called and it is therefore responsible
      *       for cleaning up.
+     *
+     * Pages still write monitored by the delta tracking are known to be
+     * unchanged since the previous saved state.  When saving a delta against
+     * it they start out clean, otherwise they are simply taken over as
+     * monitored pages.
      */
+    PPGMDELTA const pDelta = pVM->pgm.s.pDeltaR3;
     PPGMRAMRANGE pCur;
     pgmLock(pVM);
+    bool const fTracking    = pDelta && pDelta->fTracking;
+    bool const fSavingDelta = fTracking && pDelta->fSavingDelta;
     do
     {
         for (pCur = pVM->pgm.s.pRamRangesXR3; pCur; pCur = pCur->pNextR3)
@@ -1142,6 +1185,30 @@ static int pgmR3PrepRamPages(PVM pVM)
 #ifdef PGMLIVESAVERAMPAGE_WITH_CRC32
                                 paLSPages[iPage].u32Crc  = UINT32_MAX;
 #endif
+                                if (   fTracking
+                                    && PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_WRITE_MONITORED)
+                                {
+                                    paLSPages[iPage].fWriteMonitored        = 1;
+                                    paLSPages[iPage].fWriteMonitoredJustNow = 1;
+                                    pVM->pgm.s.LiveSave.Ram.cMonitoredPages++;
+                                    if (   fSavingDelta
+                                        && !PGM_PAGE_GET_WRITE_LOCKS(pPage))
+                                    {
+                                        paLSPages[iPage].fDirty = 0;
+                                        paLSPages[iPage].fIgnore = 0;
+                                        pVM->pgm.s.LiveSave.Ram.cReadyPages++;
+                                        pDelta->cSkippedPages++;
+                                        break;
+                                    }
+                                }
+                                else if (   fTracking
+                                         && PGM_PAGE_IS_WRITTEN_TO(pPage))
+                                {
+                                    /* Changed since the parent; the scan re-arms it. */
+                                    PGM_PAGE_CLEAR_WRITTEN_TO(pVM, &pCur->aPages[iPage]);
+                                    Assert(pVM->pgm.s.cWrittenToPages > 0);
+                                    pVM->pgm.s.cWrittenToPages--;
+                                }
                             }
                             paLSPages[iPage].fIgnore     = 0;
                             pVM->pgm.s.LiveSave.Ram.cDirtyPages++;
@@ -1532,10 +1599,190 @@ static void pgmR3ScanRamPages(PVM pVM, bool fFinalPass)
             }
         } /* for each range */
     } while (pCur);
+
+    /* Stop IEM writing to the pages we've just started monitoring. */
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
     pgmUnlock(pVM);
 }
 
 
+/**
+ * Prepares the duplicate page cache for a save operation.
+ *
+ * Failing to allocate it isn't fatal, identical pages will then just be saved
+ * in full like before.
+ *
+ * @param   pVM                 The cross context VM structure.
+ */
+static void pgmR3PrepDupCache(PVM pVM)
+{
+    Assert(!pVM->pgm.s.LiveSave.paDupCache);
+    pVM->pgm.s.LiveSave.paDupCache   = (PPGMSAVEDUPENTRY)MMR3HeapAllocZ(pVM, MM_TAG_PGM,
+                                                                        PGM_SAVE_DUP_CACHE_ENTRIES * sizeof(PGMSAVEDUPENTRY));
+    pVM->pgm.s.LiveSave.uDupCacheGen = 0;
+    pVM->pgm.s.LiveSave.cDupPages    = 0;
+}
+
+
+/**
+ * Checks whether a page is all zeros and calculates a hash of its content.
+ *
+ * This is done in a single sweep over the page that the compiler can
+ * vectorize, so that the zero check comes at no extra cost.
+ *
+ * @returns true if the page is all zeros (*puHash is not set), false if not.
+ * @param   pbPage              The page.
+ * @param   puHash              Where to return the hash.
+ */
+static bool pgmR3StateHashPage(uint8_t const *pbPage, uint64_t *puHash)
+{
+    uint64_t const *pu64   = (uint64_t const *)pbPage;
+    uint64_t        uOr    = 0;
+    uint64_t        uHash0 = UINT64_C(0xcbf29ce484222325);
+    uint64_t        uHash1 = UINT64_C(0x84222325cbf29ce4);
+    for (unsigned i = 0; i < PAGE_SIZE / sizeof(uint64_t); i += 2)
+    {
+        uOr   |= pu64[i] | pu64[i + 1];
+        uHash0 = (uHash0 ^ pu64[i])     * UINT64_C(0x00000100000001b3);
+        uHash1 = (uHash1 ^ pu64[i + 1]) * UINT64_C(0x00000100000001b3);
+    }
+    if (!uOr)
+        return true;
+
+    /* Fold and finalize so the low bits used for indexing depend on everything. */
+    uint64_t uHash = uHash0 ^ ((uHash1 << 31) | (uHash1 >> 33));
+    uHash ^= uHash >> 33;
+    uHash *= UINT64_C(0xff51afd7ed558ccd);
+    uHash ^= uHash >> 33;
+    uHash *= UINT64_C(0xc4ceb9fe1a85ec53);
+    uHash ^= uHash >> 33;
+    *puHash = uHash;
+    return false;
+}
+
+
+/**
+ * Looks for a page identical to the given one which was saved in full earlier
+ * in this pass, and enters the given one into the cache if none was found.
+ *
+ * The loader resolves the reference by copying the page it loaded for the
+ * returned address, so the content of that page must not have changed since
+ * it was saved.  This is the case during the final pass (the VM is
+ * suspended), otherwise the page must still be write monitored (or shared).
+ * The content is compared in full, the hash only selects the candidate.
+ *
+ * @returns The address of the identical page, NIL_RTGCPHYS if none.
+ * @param   pVM                 The cross context VM structure.
+ * @param   uHash               The content hash, see pgmR3StateHashPage.
+ * @param   pbPage              The page content.
+ * @param   GCPhys              The address of the page.
+ * @param   uPass               The pass number.
+ *
+ * @remarks Caller must own the PGM lock.
+ */
+static RTGCPHYS pgmR3StateLookupDupPage(PVM pVM, uint64_t uHash, uint8_t const *pbPage, RTGCPHYS GCPhys, uint32_t uPass)
+{
+    PGM_LOCK_ASSERT_OWNER(pVM);
+    uint32_t const   uGen   = pVM->pgm.s.LiveSave.uDupCacheGen;
+    PPGMSAVEDUPENTRY pEntry = &pVM->pgm.s.LiveSave.paDupCache[uHash & (PGM_SAVE_DUP_CACHE_ENTRIES - 1)];
+    if (   pEntry->uGen  == uGen
+        && pEntry->uHash == uHash)
+    {
+        PPGMPAGE pSrcPage;
+        int rc = pgmPhysGetPageEx(pVM, pEntry->GCPhys, &pSrcPage);
+        if (   RT_SUCCESS(rc)
+            && PGM_PAGE_GET_TYPE(pSrcPage) == PGMPAGETYPE_RAM
+            && (   uPass == SSM_PASS_FINAL
+                || PGM_PAGE_GET_STATE(pSrcPage) == PGM_PAGE_STATE_WRITE_MONITORED
+                || PGM_PAGE_GET_STATE(pSrcPage) == PGM_PAGE_STATE_SHARED))
+        {
+            PGMPAGEMAPLOCK  PgMpLck;
+            void const     *pvSrcPage;
+            rc = pgmPhysGCPhys2CCPtrInternalReadOnly(pVM, pSrcPage, pEntry->GCPhys, &pvSrcPage, &PgMpLck);
+            if (RT_SUCCESS(rc))
+            {
+                bool const fSame = !memcmp(pvSrcPage, pbPage, PAGE_SIZE);
+                pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+                if (fSame)
+                    return pEntry->GCPhys;
+            }
+        }
+    }
+
+    /* Miss, the caller will be saving this page in full. */
+    pEntry->uHash  = uHash;
+    pEntry->GCPhys = GCPhys;
+    pEntry->uGen   = uGen;
+    return NIL_RTGCPHYS;
+}
+
+
+/**
+ * Checks whether the final pass may leave a RAM page for post-copy or lazy
+ * restore.
+ *
+ * The target fetches missing pages on every access, including the guest
+ * paging structure walks (see pgmPhysPostCopyFetch), so this is about demand
+ * faults only.  Pages with physical handlers (write monitored page tables
+ * with shadow paging, device handlers) would also keep the target from
+ * covering their chunk with an access handler.  The root paging structures
+ * of the virtual CPUs are needed right away.
+ *
+ * @returns true if it may be deferred, false if it must be saved.
+ * @param   pVM                 The cross context VM structure.
+ * @param   pPage               The page.
+ * @param   GCPhys              The page address.
+ */
+static bool pgmR3SaveRamPageDeferrable(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys)
+{
+    if (PGM_PAGE_HAS_ANY_PHYSICAL_HANDLERS(pPage))
+        return false;
+    for (VMCPUID idCpu = 0; idCpu < pVM->cCpus; idCpu++)
+        if ((pVM->aCpus[idCpu].pgm.s.GCPhysCR3 & ~(RTGCPHYS)PAGE_OFFSET_MASK) == GCPhys)
+            return false;
+    return true;
+}
+
+
+/**
+ * Adds a RAM page to the ones the final pass leaves to the "pgmlazy" unit.
+ *
+ * @returns VBox status code.
+ * @param   pVM                 The cross context VM structure.
+ * @param   pLazy               The lazy restore state.
+ * @param   GCPhys              The page address.  Must be higher than the
+ *                              previous one.
+ */
+static int pgmR3LazySaveAddPage(PVM pVM, PPGMLAZY pLazy, RTGCPHYS GCPhys)
+{
+    PPGMLAZYRUN pRun = pLazy->cRuns ? &pLazy->paRuns[pLazy->cRuns - 1] : NULL;
+    if (   pRun
+        && GCPhys == pRun->GCPhys + ((RTGCPHYS)pRun->cPages << PAGE_SHIFT))
+        pRun->cPages++;
+    else
+    {
+        Assert(!pRun || GCPhys > pRun->GCPhys);
+        if (pLazy->cRuns >= pLazy->cRunsAlloc)
+        {
+            uint32_t const cNew = pLazy->cRunsAlloc ? pLazy->cRunsAlloc * 2 : 64;
+            void *pvNew = MMR3HeapRealloc(pLazy->paRuns, cNew * sizeof(pLazy->paRuns[0]));
+            if (!pvNew)
+                return VERR_NO_MEMORY;
+            pLazy->paRuns     = (PPGMLAZYRUN)pvNew;
+            pLazy->cRunsAlloc = cNew;
+        }
+        pRun = &pLazy->paRuns[pLazy->cRuns++];
+        pRun->GCPhys     = GCPhys;
+        pRun->offFile    = 0;
+        pRun->cPages     = 1;
+        pRun->u32Padding = 0;
+    }
+    pLazy->cPages++;
+    NOREF(pVM);
+    return VINF_SUCCESS;
+}
+
+
 /**
  * Save quiescent RAM pages.
  *
@@ -1557,7 +1804,31 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
     PPGMRAMRANGE pCur;
     bool fFTMDeltaSaveActive = FTMIsDeltaLoadSaveActive(pVM);
 
+    /*
+     * Duplicate pages are only looked for within a pass and not in FT delta
+     * mode (pages are skipped there).  A pass saves each page at most once,
+     * so the loader will still have what we saved for the page referenced.
+     * That isn't so for the pages left to lazy restore by the final pass.
+     */
+    PPGMLAZY const pLazy = uPass == SSM_PASS_FINAL ? pVM->pgm.s.pLazyR3 : NULL;
+    bool const fDupCheck = pVM->pgm.s.LiveSave.paDupCache != NULL && !fFTMDeltaSaveActive && !pLazy;
+    pVM->pgm.s.LiveSave.uDupCacheGen++;
+
+    /*
+     * With post-copy the final pass only saves a limited number of hot pages,
+     * the rest of the dirty pages are sent after the target has resumed.
+     */
+    bool const fPostCopy = uPass == SSM_PASS_FINAL && pVM->pgm.s.LiveSave.fPostCopy && !fFTMDeltaSaveActive;
+    uint32_t   cHotLeft  = pVM->pgm.s.LiveSave.cPostCopyHotPages;
+
     pgmLock(pVM);
+
+    /*
+     * A non-live delta save leaves out the pages that are still write
+     * monitored since the parent was saved (the live save does this via
+     * the fDirty bits set up by pgmR3PrepRamPages).
+     */
+    bool const fDeltaSkip = pVM->pgm.s.pDeltaR3 && pVM->pgm.s.pDeltaR3->fSavingDelta && !pVM->pgm.s.LiveSave.fActive;
     do
     {
         uint32_t const  idRamRangesGen = pVM->pgm.s.idRamRangesGen;
@@ -1620,6 +1891,14 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
 #endif
                             continue;
                         }
+                        if (   fDeltaSkip
+                            && PGM_PAGE_GET_STATE(pCurPage) == PGM_PAGE_STATE_WRITE_MONITORED
+                            && !PGM_PAGE_GET_WRITE_LOCKS(pCurPage)
+                            && PGM_PAGE_GET_TYPE(pCurPage) == PGMPAGETYPE_RAM)
+                        {
+                            pVM->pgm.s.pDeltaR3->cSkippedPages++;
+                            continue;
+                        }
                         if (PGM_PAGE_GET_TYPE(pCurPage) != PGMPAGETYPE_RAM)
                             continue;
                     }
@@ -1633,7 +1912,35 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                     bool        fBallooned = PGM_PAGE_IS_BALLOONED(pCurPage);
                     bool        fSkipped = false;
 
-                    if (!fZero && !fBallooned)
+                    bool        fDefer   = false;
+                    if (fPostCopy && paLSPages && !fZero && !fBallooned)
+                    {
+                        fDefer = pgmR3SaveRamPageDeferrable(pVM, pCurPage, GCPhys);
+                        if (fDefer && paLSPages[iPage].cDirtied >= 2 && cHotLeft > 0)
+                        {
+                            cHotLeft--;
+                            fDefer = false;
+                        }
+                    }
+
+                    if (fDefer)
+                    {
+                        /*
+                         * Leave it for the post-copy phase.
+                         */
+                        rc = pgmR3PostCopyAddPage(pVM, pCur, GCPhys, true /*fSource*/);
+                        pgmUnlock(pVM);
+                        AssertLogRelMsgRCReturn(rc, ("rc=%Rrc GCPhys=%RGp\n", rc, GCPhys), rc);
+
+                        if (GCPhys == GCPhysLast + PAGE_SIZE)
+                            rc = SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_POSTCOPY);
+                        else
+                        {
+                            SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_POSTCOPY | PGM_STATE_REC_FLAG_ADDR);
+                            rc = SSMR3PutGCPhys(pSSM, GCPhys);
+                        }
+                    }
+                    else if (!fZero && !fBallooned)
                     {
                         /*
                          * Copy the page and then save it outside the lock (since any
@@ -1642,6 +1949,9 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                         uint8_t         abPage[PAGE_SIZE];
                         PGMPAGEMAPLOCK  PgMpLck;
                         void const     *pvPage;
+                        bool            fZeroContent = false;
+                        RTGCPHYS        GCPhysDup    = NIL_RTGCPHYS;
+                        bool const      fLazy        = pLazy && pgmR3SaveRamPageDeferrable(pVM, pCurPage, GCPhys);
                         rc = pgmPhysGCPhys2CCPtrInternalReadOnly(pVM, pCurPage, GCPhys, &pvPage, &PgMpLck);
                         if (RT_SUCCESS(rc))
                         {
@@ -1651,14 +1961,38 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
                                 pgmR3StateVerifyCrc32ForPage(abPage, pCur, paLSPages, iPage, "save#3");
 #endif
                             pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+
+                            /* Try save some memory when restoring and some space in
+                               the stream: zero content and identical pages. */
+                            uint64_t uHash;
+                            fZeroContent = pgmR3StateHashPage(abPage, &uHash);
+                            if (!fZeroContent && fDupCheck)
+                                GCPhysDup = pgmR3StateLookupDupPage(pVM, uHash, abPage, GCPhys, uPass);
                         }
                         pgmUnlock(pVM);
                         AssertLogRelMsgRCReturn(rc, ("rc=%Rrc GCPhys=%RGp\n", rc, GCPhys), rc);
 
-                        /* Try save some memory when restoring. */
-                        if (!ASMMemIsZeroPage(pvPage))
+                        if (!fZeroContent)
                         {
-                            if (fFTMDeltaSaveActive)
+                            if (fLazy)
+                            {
+                                /* Left to the "pgmlazy" unit, the next record needs an address. */
+                                rc = pgmR3LazySaveAddPage(pVM, pLazy, GCPhys);
+                                fSkipped = true;
+                            }
+                            else if (GCPhysDup != NIL_RTGCPHYS)
+                            {
+                                if (GCPhys == GCPhysLast + PAGE_SIZE)
+                                    SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_DUP);
+                                else
+                                {
+                                    SSMR3PutU8(pSSM, PGM_STATE_REC_RAM_DUP | PGM_STATE_REC_FLAG_ADDR);
+                                    SSMR3PutGCPhys(pSSM, GCPhys);
+                                }
+                                rc = SSMR3PutGCPhys(pSSM, GCPhysDup);
+                                pVM->pgm.s.LiveSave.cDupPages++;
+                            }
+                            else if (fFTMDeltaSaveActive)
                             {
                                 if (    PGM_PAGE_IS_WRITTEN_TO(pCurPage)
                                     ||  PGM_PAGE_IS_FT_DIRTY(pCurPage))
@@ -1761,8 +2095,10 @@ static int pgmR3SaveRamPages(PVM pVM, PSSMHANDLE pSSM, bool fLiveSave, uint32_t
  * Cleans up RAM pages after a live save.
  *
  * @param   pVM                 The cross context VM structure.
+ * @param   fKeepMonitoring     Whether to leave the pages write monitored for
+ *                              the delta tracking (pgmR3DeltaArm).
  */
-static void pgmR3DoneRamPages(PVM pVM)
+static void pgmR3DoneRamPages(PVM pVM, bool fKeepMonitoring)
 {
     /*
      * Free the tracking arrays and disable write monitoring.
@@ -1801,7 +2137,8 @@ static void pgmR3DoneRamPages(PVM pVM)
                 {
                     PPGMPAGE pPage = &pCur->aPages[iPage];
                     PGM_PAGE_CLEAR_WRITTEN_TO(pVM, pPage);
-                    if (PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_WRITE_MONITORED)
+                    if (   PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_WRITE_MONITORED
+                        && !fKeepMonitoring)
                     {
                         PGM_PAGE_SET_STATE(pVM, pPage, PGM_PAGE_STATE_ALLOCATED);
                         cMonitoredPages++;
@@ -1824,6 +2161,118 @@ static void pgmR3DoneRamPages(PVM pVM)
 }
 
 
+/**
+ * Starts tracking the RAM changes relative to a saved state.
+ *
+ * All RAM pages are write monitored, so the ones still monitored when the next
+ * save happens are known to be identical to what's in the given saved state.
+ *
+ * @param   pVM                 The cross context VM structure.
+ * @param   pUuidBase           The identity of the saved state the RAM is in
+ *                              sync with.
+ */
+static void pgmR3DeltaArm(PVM pVM, PCRTUUID pUuidBase)
+{
+    PPGMDELTA pDelta = pVM->pgm.s.pDeltaR3;
+    pgmLock(pVM);
+    for (PPGMRAMRANGE pCur = pVM->pgm.s.pRamRangesXR3; pCur; pCur = pCur->pNextR3)
+    {
+        if (PGM_RAM_RANGE_IS_AD_HOC(pCur))
+            continue;
+        uint32_t iPage = pCur->cb >> PAGE_SHIFT;
+        while (iPage-- > 0)
+        {
+            PPGMPAGE pPage = &pCur->aPages[iPage];
+            if (PGM_PAGE_GET_TYPE(pPage) != PGMPAGETYPE_RAM)
+                continue;
+            if (PGM_PAGE_IS_WRITTEN_TO(pPage))
+            {
+                PGM_PAGE_CLEAR_WRITTEN_TO(pVM, pPage);
+                if (pVM->pgm.s.cWrittenToPages > 0)
+                    pVM->pgm.s.cWrittenToPages--;
+            }
+            switch (PGM_PAGE_GET_STATE(pPage))
+            {
+                case PGM_PAGE_STATE_ALLOCATED:
+                    if (!PGM_PAGE_GET_WRITE_LOCKS(pPage))
+                        pgmPhysPageWriteMonitor(pVM, pPage, pCur->GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT));
+                    break;
+
+                case PGM_PAGE_STATE_WRITE_MONITORED:
+                    /* Write locked pages cannot be tracked. */
+                    if (PGM_PAGE_GET_WRITE_LOCKS(pPage))
+                    {
+                        PGM_PAGE_SET_STATE(pVM, pPage, PGM_PAGE_STATE_ALLOCATED);
+                        Assert(pVM->pgm.s.cMonitoredPages > 0);
+                        pVM->pgm.s.cMonitoredPages--;
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+    pDelta->UuidBase  = *pUuidBase;
+    pDelta->fTracking = true;
+    IEMTlbInvalidateAllPhysicalAllCpus(pVM);
+    pgmUnlock(pVM);
+
+    pgmR3PoolClearAll(pVM, true /*fFlushRemTlb*/);
+}
+
+
+/**
+ * Stops tracking the RAM changes and disables the write monitoring.
+ *
+ * @param   pVM                 The cross context VM structure.
+ */
+static void pgmR3DeltaDisarm(PVM pVM)
+{
+    PPGMDELTA pDelta = pVM->pgm.s.pDeltaR3;
+    pgmLock(pVM);
+    if (pDelta->fTracking)
+    {
+        pDelta->fTracking = false;
+        RTUuidClear(&pDelta->UuidBase);
+        for (PPGMRAMRANGE pCur = pVM->pgm.s.pRamRangesXR3; pCur; pCur = pCur->pNextR3)
+        {
+            uint32_t iPage = pCur->cb >> PAGE_SHIFT;
+            while (iPage-- > 0)
+            {
+                PPGMPAGE pPage = &pCur->aPages[iPage];
+                if (   PGM_PAGE_GET_STATE(pPage) == PGM_PAGE_STATE_WRITE_MONITORED
+                    && PGM_PAGE_GET_TYPE(pPage) == PGMPAGETYPE_RAM)
+                {
+                    PGM_PAGE_SET_STATE(pVM, pPage, PGM_PAGE_STATE_ALLOCATED);
+                    Assert(pVM->pgm.s.cMonitoredPages > 0);
+                    pVM->pgm.s.cMonitoredPages--;
+                }
+            }
+        }
+    }
+    pgmUnlock(pVM);
+}
+
+
+/**
+ * Decides whether the save that is starting will be a delta save.
+ *
+ * @param   pVM                 The cross context VM structure.
+ */
+static void pgmR3DeltaSavePrep(PVM pVM)
+{
+    PPGMDELTA pDelta = pVM->pgm.s.pDeltaR3;
+    if (pDelta)
+    {
+        pgmLock(pVM);
+        pDelta->fSavingDelta  = pDelta->fNextIsDelta && pDelta->fTracking && pDelta->pszParent;
+        pDelta->cSkippedPages = 0;
+        pgmUnlock(pVM);
+    }
+}
+
+
 /**
  * @callback_method_impl{FNSSMINTLIVEEXEC}
  */
@@ -1932,8 +2381,15 @@ static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass
     pVM->pgm.s.LiveSave.cPagesPerSecond = cPagesPerSecond;
 
     /*
-     * Try make a decision.
+     * Try make a decision.  With post-copy the dirty pages left over are sent
+     * after the target has resumed, so there is no need to converge.
      */
+    if (   pVM->pgm.s.LiveSave.fPostCopy
+        && uPass + 1 >= PGM_POSTCOPY_MIN_PASSES)
+    {
+        Log(("pgmR3LiveVote: VINF_SUCCESS - pass=%d post-copy cDirtyNow=%u\n", uPass, cDirtyNow));
+        return VINF_SUCCESS;
+    }
     if (    cDirtyPagesShort <= cDirtyPagesLong
         &&  (   cDirtyNow    <= cDirtyPagesShort
              || cDirtyNow - cDirtyPagesShort < RT_MIN(cDirtyPagesShort / 8, 16)
@@ -1995,6 +2451,19 @@ static DECLCALLBACK(int)  pgmR3LiveVote(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass
  */
 static DECLCALLBACK(int) pgmR3LivePrep(PVM pVM, PSSMHANDLE pSSM)
 {
+    /*
+     * The memory isn't complete while post-copy pages are still coming in.
+     * What a lazy restore hasn't read yet is read now.
+     */
+    int rc = pgmR3PostCopyTrgLazyComplete(pVM);
+    if (RT_FAILURE(rc))
+        return rc;
+    if (PGMR3PostCopyGetPendingPages(pVM->pUVM) && !pVM->pgm.s.pPostCopyR3->fSource)
+    {
+        LogRel(("PGM: Cannot save while post-copy pages are still being received\n"));
+        return VERR_WRONG_ORDER;
+    }
+
     /*
      * Indicate that we will be using the write monitoring.
      */
@@ -2025,15 +2494,18 @@ static DECLCALLBACK(int) pgmR3LivePrep(PVM pVM, PSSMHANDLE pSSM)
     pVM->pgm.s.LiveSave.cSavedPages       = 0;
     pVM->pgm.s.LiveSave.uSaveStartNS      = RTTimeNanoTS();
     pVM->pgm.s.LiveSave.cPagesPerSecond   = 8192;
+    pgmR3DeltaSavePrep(pVM);
 
     /*
      * Per page type.
      */
-    int rc = pgmR3PrepRomPages(pVM);
+    rc = pgmR3PrepRomPages(pVM);
     if (RT_SUCCESS(rc))
         rc = pgmR3PrepMmio2Pages(pVM);
     if (RT_SUCCESS(rc))
         rc = pgmR3PrepRamPages(pVM);
+    if (RT_SUCCESS(rc))
+        pgmR3PrepDupCache(pVM);
 
     NOREF(pSSM);
     return rc;
@@ -2048,6 +2520,21 @@ static DECLCALLBACK(int) pgmR3SaveExec(PVM pVM, PSSMHANDLE pSSM)
     int     rc   = VINF_SUCCESS;
     PPGM    pPGM = &pVM->pgm.s;
 
+    /* A live save has the duplicate page cache from pgmR3LivePrep. */
+    if (!pVM->pgm.s.LiveSave.fActive)
+    {
+        rc = pgmR3PostCopyTrgLazyComplete(pVM);
+        if (RT_FAILURE(rc))
+            return rc;
+        if (PGMR3PostCopyGetPendingPages(pVM->pUVM) && !pVM->pgm.s.pPostCopyR3->fSource)
+        {
+            LogRel(("PGM: Cannot save while post-copy pages are still being received\n"));
+            return VERR_WRONG_ORDER;
+        }
+        pgmR3PrepDupCache(pVM);
+        pgmR3DeltaSavePrep(pVM);
+    }
+
     /*
      * Lock PGM and set the no-more-writes indicator.
      */
@@ -2111,6 +2598,14 @@ static DECLCALLBACK(int) pgmR3SaveExec(PVM pVM, PSSMHANDLE pSSM)
  */
 static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
 {
+    /*
+     * A successful save to a file becomes the base of the next delta save.
+     */
+    PPGMDELTA const pDelta = pVM->pgm.s.pDeltaR3;
+    bool const      fArm   = pDelta
+                          && RT_SUCCESS(SSMR3HandleGetStatus(pSSM))
+                          && SSMR3HandleGetFilename(pSSM) != NULL;
+
     /*
      * Do per page type cleanups first.
      */
@@ -2118,7 +2613,25 @@ static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
     {
         pgmR3DoneRomPages(pVM);
         pgmR3DoneMmio2Pages(pVM);
-        pgmR3DoneRamPages(pVM);
+        pgmR3DoneRamPages(pVM, fArm);
+    }
+
+    if (pDelta)
+    {
+        if (pDelta->fSavingDelta)
+            LogRel(("PGM: Delta save against '%s' left out %u unchanged RAM pages\n", pDelta->pszParent, pDelta->cSkippedPages));
+        if (fArm)
+            pgmR3DeltaArm(pVM, &pDelta->UuidSave);
+        else
+            pgmR3DeltaDisarm(pVM);
+
+        pgmLock(pVM);
+        char *pszParent = pDelta->pszParent;
+        pDelta->pszParent    = NULL;
+        pDelta->fNextIsDelta = false;
+        pDelta->fSavingDelta = false;
+        pgmUnlock(pVM);
+        RTStrFree(pszParent);
     }
 
     /*
@@ -2129,8 +2642,12 @@ static DECLCALLBACK(int) pgmR3SaveDone(PVM pVM, PSSMHANDLE pSSM)
     /** @todo this is blindly assuming that we're the only user of write
      *        monitoring. Fix this when more users are added. */
     pVM->pgm.s.fPhysWriteMonitoringEngaged = false;
+    void *pvDupCache = pVM->pgm.s.LiveSave.paDupCache;
+    pVM->pgm.s.LiveSave.paDupCache = NULL;
     pgmUnlock(pVM);
 
+    MMR3HeapFree(pvDupCache);
+
     NOREF(pSSM);
     return VINF_SUCCESS;
 }
@@ -2661,6 +3178,8 @@ static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
             case PGM_STATE_REC_RAM_ZERO:
             case PGM_STATE_REC_RAM_RAW:
             case PGM_STATE_REC_RAM_BALLOONED:
+            case PGM_STATE_REC_RAM_DUP:
+            case PGM_STATE_REC_RAM_POSTCOPY:
             {
                 /*
                  * Get the address and resolve it into a page descriptor.
@@ -2766,6 +3285,46 @@ static int pgmR3LoadMemory(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t
                         break;
                     }
 
+                    case PGM_STATE_REC_RAM_DUP:
+                    {
+                        /* Copy the page loaded earlier in this pass. */
+                        RTGCPHYS GCPhysSrc;
+                        rc = SSMR3GetGCPhys(pSSM, &GCPhysSrc);
+                        if (RT_FAILURE(rc))
+                            return rc;
+                        AssertLogRelMsgReturn(!(GCPhysSrc & PAGE_OFFSET_MASK) && GCPhysSrc != GCPhys,
+                                              ("GCPhysSrc=%RGp GCPhys=%RGp\n", GCPhysSrc, GCPhys), VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+                        PPGMPAGE pSrcPage;
+                        rc = pgmPhysGetPageEx(pVM, GCPhysSrc, &pSrcPage);
+                        AssertLogRelMsgRCReturn(rc, ("rc=%Rrc %RGp\n", rc, GCPhysSrc), rc);
+
+                        PGMPAGEMAPLOCK PgMpLck;
+                        void          *pvDstPage;
+                        rc = pgmPhysGCPhys2CCPtrInternal(pVM, pPage, GCPhys, &pvDstPage, &PgMpLck);
+                        AssertLogRelMsgRCReturn(rc, ("GCPhys=%RGp %R[pgmpage] rc=%Rrc\n", GCPhys, pPage, rc), rc);
+                        PGMPAGEMAPLOCK PgMpLckSrc;
+                        void const    *pvSrcPage;
+                        rc = pgmPhysGCPhys2CCPtrInternalReadOnly(pVM, pSrcPage, GCPhysSrc, &pvSrcPage, &PgMpLckSrc);
+                        if (RT_SUCCESS(rc))
+                        {
+                            memcpy(pvDstPage, pvSrcPage, PAGE_SIZE);
+                            pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLckSrc);
+                        }
+                        pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+                        AssertLogRelMsgRCReturn(rc, ("GCPhysSrc=%RGp %R[pgmpage] rc=%Rrc\n", GCPhysSrc, pSrcPage, rc), rc);
+                        break;
+                    }
+
+                    case PGM_STATE_REC_RAM_POSTCOPY:
+                    {
+                        /* The source sends it after we've resumed, see PGMPostCopy.cpp. */
+                        AssertLogRelMsgReturn(PGM_PAGE_GET_TYPE(pPage) == PGMPAGETYPE_RAM,
+                                              ("GCPhys=%RGp %R[pgmpage]\n", GCPhys, pPage), VERR_PGM_SAVED_REC_TYPE);
+                        rc = pgmR3PostCopyAddPage(pVM, pRamHint, GCPhys, false /*fSource*/);
+                        AssertLogRelMsgRCReturn(rc, ("GCPhys=%RGp rc=%Rrc\n", GCPhys, rc), rc);
+                        break;
+                    }
+
                     default:
                         AssertMsgFailedReturn(("%#x\n", u8), VERR_PGM_SAVED_REC_TYPE);
                 }
@@ -3127,11 +3686,13 @@ static DECLCALLBACK(int) pgmR3Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion,
      */
     if (   (   uPass != SSM_PASS_FINAL
             && uVersion != PGM_SAVED_STATE_VERSION
+            && uVersion != PGM_SAVED_STATE_VERSION_PRE_RAM_DUP
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_PAE
             && uVersion != PGM_SAVED_STATE_VERSION_BALLOON_BROKEN
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_BALLOON
             && uVersion != PGM_SAVED_STATE_VERSION_NO_RAM_CFG)
         || (   uVersion != PGM_SAVED_STATE_VERSION
+            && uVersion != PGM_SAVED_STATE_VERSION_PRE_RAM_DUP
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_PAE
             && uVersion != PGM_SAVED_STATE_VERSION_BALLOON_BROKEN
             && uVersion != PGM_SAVED_STATE_VERSION_PRE_BALLOON
@@ -3302,22 +3863,870 @@ static DECLCALLBACK(int) pgmR3LoadDone(PVM pVM, PSSMHANDLE pSSM)
 {
     pVM->pgm.s.fRestoreRomPagesAtReset = true;
     NOREF(pSSM);
+
+    /* Cover the pages left for post-copy with access handlers. */
+    return pgmR3PostCopyTrgArm(pVM);
+}
+
+
+/**
+ * Reads the delta unit ("pgmdelta") data.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle, positioned at the data.
+ * @param   uVersion        The data unit version.
+ * @param   pUuidSelf       Where to return the identity of the saved state.
+ * @param   pUuidParent     Where to return the identity of the parent, nil
+ *                          if it isn't a delta.
+ * @param   pszParent       Where to return the parent file name.
+ * @param   cbParent        The size of the buffer @a pszParent points to.
+ */
+static int pgmR3DeltaReadUnit(PSSMHANDLE pSSM, uint32_t uVersion, PRTUUID pUuidSelf, PRTUUID pUuidParent,
+                              char *pszParent, size_t cbParent)
+{
+    if (uVersion != PGM_DELTA_SAVED_STATE_VERSION)
+        return VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
+
+    SSMR3GetMem(pSSM, pUuidSelf, sizeof(*pUuidSelf));
+    SSMR3GetMem(pSSM, pUuidParent, sizeof(*pUuidParent));
+    int rc = SSMR3GetStrZ(pSSM, pszParent, cbParent);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    uint32_t u32Sep;
+    rc = SSMR3GetU32(pSSM, &u32Sep);
+    if (RT_FAILURE(rc))
+        return rc;
+    AssertLogRelMsgReturn(u32Sep == UINT32_MAX, ("u32Sep=%#x\n", u32Sep), VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+    AssertLogRelReturn(RTUuidIsNull(pUuidParent) || *pszParent, VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
     return VINF_SUCCESS;
 }
 
 
 /**
- * Registers the saved state callbacks with SSM.
+ * Opens a saved state file and reads its delta unit.
  *
  * @returns VBox status code.
- * @param   pVM     The cross context VM structure.
- * @param   cbRam   The RAM size.
+ * @retval  VERR_SSM_UNIT_NOT_FOUND if the saved state was made without delta
+ *          support.
+ * @param   pszFilename     The saved state file.
+ * @param   ppSSM           Where to return the handle, positioned after the
+ *                          delta unit.  Optional, the file is closed if NULL.
+ * @param   pUuidSelf       Where to return the identity of the saved state.
+ * @param   pUuidParent     Where to return the identity of the parent.
+ * @param   pszParent       Where to return the parent file name.
+ * @param   cbParent        The size of the buffer @a pszParent points to.
  */
-int pgmR3InitSavedState(PVM pVM, uint64_t cbRam)
+static int pgmR3DeltaOpenFile(const char *pszFilename, PSSMHANDLE *ppSSM, PRTUUID pUuidSelf, PRTUUID pUuidParent,
+                              char *pszParent, size_t cbParent)
+{
+    PSSMHANDLE pSSM;
+    int rc = SSMR3Open(pszFilename, 0 /*fFlags*/, &pSSM);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    uint32_t uVersion;
+    rc = SSMR3Seek(pSSM, "pgmdelta", 0 /*iInstance*/, &uVersion);
+    if (RT_SUCCESS(rc))
+        rc = pgmR3DeltaReadUnit(pSSM, uVersion, pUuidSelf, pUuidParent, pszParent, cbParent);
+    if (RT_SUCCESS(rc) && ppSSM)
+        *ppSSM = pSSM;
+    else
+        SSMR3Close(pSSM);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMENUMUNITPASS,
+ *      Loads one pass of the PGM unit of a parent saved state.}
+ */
+static DECLCALLBACK(int) pgmR3DeltaLoadParentPass(PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass, void *pvUser)
 {
-    return SSMR3RegisterInternal(pVM, "pgm", 1, PGM_SAVED_STATE_VERSION, (size_t)cbRam + sizeof(PGM),
-                                 pgmR3LivePrep, pgmR3LiveExec, pgmR3LiveVote,
-                                 NULL,          pgmR3SaveExec, pgmR3SaveDone,
-                                 pgmR3LoadPrep, pgmR3Load,     pgmR3LoadDone);
+    PPGMDELTALOADSTATE pState = (PPGMDELTALOADSTATE)pvUser;
+    PVM                pVM    = pState->pVM;
+
+    /* Delta saves are only made with the current format. */
+    if (uVersion != PGM_SAVED_STATE_VERSION)
+        return VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
+
+    int rc = VINF_SUCCESS;
+    pgmLock(pVM);
+    if (uPass == 0)
+    {
+        pState->fLive = true;
+        pVM->pgm.s.LiveSave.fActive = true;
+    }
+    else if (uPass == SSM_PASS_FINAL)
+    {
+        /* The basic data is reloaded from the child's final pass later. */
+        rc = SSMR3GetStruct(pSSM, &pVM->pgm.s, &s_aPGMFields[0]);
+        for (VMCPUID idCpu = 0; idCpu < pVM->cCpus && RT_SUCCESS(rc); idCpu++)
+            rc = SSMR3GetStruct(pSSM, &pVM->aCpus[idCpu].pgm.s, &s_aPGMCpuFields[0]);
+    }
+
+    if (   RT_SUCCESS(rc)
+        && (uPass == 0 || (uPass == SSM_PASS_FINAL && !pState->fLive)))
+    {
+        rc = pgmR3LoadRamConfig(pVM, pSSM);
+        if (RT_SUCCESS(rc))
+            rc = pgmR3LoadRomRanges(pVM, pSSM);
+        if (RT_SUCCESS(rc))
+            rc = pgmR3LoadMmio2Ranges(pVM, pSSM);
+    }
+    if (RT_SUCCESS(rc))
+        rc = pgmR3LoadMemory(pVM, pSSM, uVersion, uPass);
+
+    if (uPass == SSM_PASS_FINAL)
+        pVM->pgm.s.LiveSave.fActive = false;
+    pgmUnlock(pVM);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTSAVEEXEC}
+ */
+static DECLCALLBACK(int) pgmR3DeltaSaveExec(PVM pVM, PSSMHANDLE pSSM)
+{
+    PPGMDELTA pDelta = pVM->pgm.s.pDeltaR3;
+
+    int rc = RTUuidCreate(&pDelta->UuidSave);
+    AssertRCReturn(rc, rc);
+    SSMR3PutMem(pSSM, &pDelta->UuidSave, sizeof(pDelta->UuidSave));
+    if (pDelta->fSavingDelta)
+    {
+        SSMR3PutMem(pSSM, &pDelta->UuidBase, sizeof(pDelta->UuidBase));
+        SSMR3PutStrZ(pSSM, pDelta->pszParent);
+    }
+    else
+    {
+        RTUUID UuidNil;
+        RTUuidClear(&UuidNil);
+        SSMR3PutMem(pSSM, &UuidNil, sizeof(UuidNil));
+        SSMR3PutStrZ(pSSM, "");
+    }
+    return SSMR3PutU32(pSSM, UINT32_MAX);
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTLOADPREP}
+ *
+ * This runs after pgmR3LoadPrep has reset the memory and composes the RAM of
+ * a delta saved state from its parents, oldest first.  The pages of the delta
+ * itself are then loaded on top of it by pgmR3Load.
+ */
+static DECLCALLBACK(int) pgmR3DeltaLoadPrep(PVM pVM, PSSMHANDLE pSSM)
+{
+    PPGMDELTA pDelta = pVM->pgm.s.pDeltaR3;
+    pgmR3DeltaDisarm(pVM);
+    RTUuidClear(&pDelta->UuidSave);
+    RTUuidClear(&pDelta->UuidComposed);
+    pDelta->cComposedFiles = 0;
+
+    /* Streams (teleportation, FT) are never deltas. */
+    const char *pszFilename = SSMR3HandleGetFilename(pSSM);
+    if (!pszFilename)
+        return VINF_SUCCESS;
+
+    RTUUID  UuidSelf;
+    RTUUID  UuidParent;
+    char    szParent[RTPATH_MAX];
+    int rc = pgmR3DeltaOpenFile(pszFilename, NULL, &UuidSelf, &UuidParent, szParent, sizeof(szParent));
+    if (rc == VERR_SSM_UNIT_NOT_FOUND || (RT_SUCCESS(rc) && RTUuidIsNull(&UuidParent)))
+        return VINF_SUCCESS;
+    if (RT_FAILURE(rc))
+        return SSMR3SetLoadError(pSSM, rc, RT_SRC_POS, N_("Failed to read the delta information (%Rrc)"), rc);
+    RTUUID const UuidFirstParent = UuidParent;
+
+    /*
+     * Open the chain of parents, checking that each is the one the child was
+     * saved against.
+     */
+    struct
+    {
+        PSSMHANDLE  pSSM;
+        char       *pszFilename;
+    }           aChain[PGM_DELTA_MAX_CHAIN];
+    uint32_t    cChain = 0;
+    while (!RTUuidIsNull(&UuidParent))
+    {
+        if (cChain >= RT_ELEMENTS(aChain))
+        {
+            rc = SSMR3SetLoadError(pSSM, VERR_TOO_MANY_OPEN_FILES, RT_SRC_POS,
+                                   N_("The delta saved state has more than %u parents"), RT_ELEMENTS(aChain));
+            break;
+        }
+
+        aChain[cChain].pszFilename = RTStrDup(szParent);
+        if (!aChain[cChain].pszFilename)
+        {
+            rc = VERR_NO_STR_MEMORY;
+            break;
+        }
+        RTUUID const UuidExpected = UuidParent;
+        rc = pgmR3DeltaOpenFile(aChain[cChain].pszFilename, &aChain[cChain].pSSM, &UuidSelf, &UuidParent,
+                                szParent, sizeof(szParent));
+        if (RT_SUCCESS(rc) && RTUuidCompare(&UuidSelf, &UuidExpected))
+        {
+            SSMR3Close(aChain[cChain].pSSM);
+            rc = VERR_SSM_LOAD_CONFIG_MISMATCH;
+        }
+        if (RT_FAILURE(rc))
+        {
+            rc = SSMR3SetLoadError(pSSM, rc, RT_SRC_POS, N_("The parent saved state '%s' is missing or was replaced (%Rrc)"),
+                                   aChain[cChain].pszFilename, rc);
+            RTStrFree(aChain[cChain].pszFilename);
+            break;
+        }
+        cChain++;
+    }
+
+    /*
+     * Load the parents oldest first.  The duplicate page records refer to
+     * pages loaded earlier in the same file, so there is no skipping pages
+     * that a younger state overwrites.
+     */
+    for (uint32_t i = cChain; i-- > 0 && RT_SUCCESS(rc);)
+    {
+        PGMDELTALOADSTATE State;
+        State.pVM   = pVM;
+        State.fLive = false;
+        rc = SSMR3EnumUnitPasses(aChain[i].pSSM, "pgm", 1 /*iInstance*/, pgmR3DeltaLoadParentPass, &State);
+        if (RT_FAILURE(rc))
+            rc = SSMR3SetLoadError(pSSM, rc, RT_SRC_POS, N_("Failed to load the memory of the parent saved state '%s' (%Rrc)"),
+                                   aChain[i].pszFilename, rc);
+    }
+
+    for (uint32_t i = 0; i < cChain; i++)
+    {
+        SSMR3Close(aChain[i].pSSM);
+        RTStrFree(aChain[i].pszFilename);
+    }
+
+    if (RT_SUCCESS(rc))
+    {
+        pDelta->UuidComposed   = UuidFirstParent;
+        pDelta->cComposedFiles = cChain;
+        LogRel(("PGM: Composed the RAM from %u parent saved state(s) of '%s'\n", cChain, pszFilename));
+    }
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTLOADEXEC}
+ */
+static DECLCALLBACK(int) pgmR3DeltaLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    Assert(uPass == SSM_PASS_FINAL); NOREF(uPass);
+    PPGMDELTA pDelta = pVM->pgm.s.pDeltaR3;
+
+    RTUUID  UuidSelf;
+    RTUUID  UuidParent;
+    char    szParent[RTPATH_MAX];
+    int rc = pgmR3DeltaReadUnit(pSSM, uVersion, &UuidSelf, &UuidParent, szParent, sizeof(szParent));
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /* The parents must have been composed by pgmR3DeltaLoadPrep. */
+    if (   !RTUuidIsNull(&UuidParent)
+        && RTUuidCompare(&UuidParent, &pDelta->UuidComposed))
+        return SSMR3SetLoadError(pSSM, VERR_SSM_LOAD_CONFIG_MISMATCH, RT_SRC_POS,
+                                 N_("The saved state is a delta against '%s' which was not loaded"), szParent);
+
+    pDelta->UuidSave = UuidSelf;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTLOADDONE}
+ */
+static DECLCALLBACK(int) pgmR3DeltaLoadDone(PVM pVM, PSSMHANDLE pSSM)
+{
+    /* The RAM is now in sync with the saved state file loaded. */
+    PPGMDELTA pDelta = pVM->pgm.s.pDeltaR3;
+    if (   RT_SUCCESS(SSMR3HandleGetStatus(pSSM))
+        && SSMR3HandleGetFilename(pSSM)
+        && !RTUuidIsNull(&pDelta->UuidSave))
+        pgmR3DeltaArm(pVM, &pDelta->UuidSave);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Makes the next save a delta against the given saved state.
+ *
+ * Only the RAM pages which changed since @a pszParent was saved or loaded are
+ * written, the rest are composed from @a pszParent (and its parents) when the
+ * delta is loaded.  This requires the PGM/DeltaSavedStates config option and
+ * that @a pszParent is the last saved state this VM was saved to or loaded
+ * from.  The file names are recorded as given, so they should be absolute.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_NOT_SUPPORTED if delta saved states aren't enabled.
+ * @retval  VERR_MISMATCH if the RAM isn't in sync with @a pszParent.  The next
+ *          save will be a full one.
+ * @param   pUVM            The user mode VM handle.
+ * @param   pszParent       The saved state file to save a delta against.
+ * @thread  Any, but not while a save is in progress.
+ */
+VMMR3DECL(int) PGMR3DeltaSetParent(PUVM pUVM, const char *pszParent)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PVM pVM = pUVM->pVM;
+    VM_ASSERT_VALID_EXT_RETURN(pVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pszParent, VERR_INVALID_POINTER);
+    PPGMDELTA pDelta = pVM->pgm.s.pDeltaR3;
+    if (!pDelta)
+        return VERR_NOT_SUPPORTED;
+
+    RTUUID  UuidSelf;
+    RTUUID  UuidParent;
+    char    szIgnored[RTPATH_MAX];
+    int rc = pgmR3DeltaOpenFile(pszParent, NULL, &UuidSelf, &UuidParent, szIgnored, sizeof(szIgnored));
+    if (rc == VERR_SSM_UNIT_NOT_FOUND)
+        rc = VERR_MISMATCH;
+    if (RT_FAILURE(rc))
+        return rc;
+
+    char *pszDup = RTStrDup(pszParent);
+    if (!pszDup)
+        return VERR_NO_STR_MEMORY;
+
+    pgmLock(pVM);
+    if (pVM->pgm.s.LiveSave.fActive)
+        rc = VERR_WRONG_ORDER;
+    else if (   !pDelta->fTracking
+             || RTUuidCompare(&UuidSelf, &pDelta->UuidBase))
+        rc = VERR_MISMATCH;
+    else
+    {
+        RTStrFree(pDelta->pszParent);
+        pDelta->pszParent    = pszDup;
+        pDelta->fNextIsDelta = true;
+        pszDup = NULL;
+    }
+    pgmUnlock(pVM);
+
+    RTStrFree(pszDup);
+    return rc;
+}
+
+
+/**
+ * Allocates a lazy restore state.
+ *
+ * @returns Pointer to the state, NULL if out of memory.
+ * @param   pVM             The cross context VM structure.
+ */
+static PPGMLAZY pgmR3LazyCreate(PVM pVM)
+{
+    PPGMLAZY pLazy = (PPGMLAZY)MMR3HeapAllocZ(pVM, MM_TAG_PGM, sizeof(*pLazy));
+    if (pLazy)
+    {
+        pLazy->hFile      = NIL_RTFILE;
+        pLazy->hThread    = NIL_RTTHREAD;
+        pLazy->hEvtDemand = NIL_RTSEMEVENT;
+    }
+    return pLazy;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTSAVEPREP}
+ *
+ * Decides whether the final pass leaves the RAM pages to the "pgmlazy" unit.
+ * Only saved state files qualify, and not the delta ones since the parents
+ * are composed from their "pgm" units alone.
+ */
+static DECLCALLBACK(int) pgmR3LazySavePrep(PVM pVM, PSSMHANDLE pSSM)
+{
+    pgmR3LazyFree(pVM, pVM->pgm.s.pLazyR3);
+    pVM->pgm.s.pLazyR3 = NULL;
+
+    if (   SSMR3HandleGetFilename(pSSM) != NULL
+        && !pVM->pgm.s.pDeltaR3
+        && !pVM->pgm.s.LiveSave.fPostCopy
+        && !FTMIsDeltaLoadSaveActive(pVM))
+    {
+        pVM->pgm.s.pLazyR3 = pgmR3LazyCreate(pVM);
+        if (!pVM->pgm.s.pLazyR3)
+            return VERR_NO_MEMORY;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTSAVEEXEC}
+ *
+ * Saves the RAM pages the final pass of "pgm" left to us, each as a separate
+ * uncompressed record so they can be read from the file on demand, and
+ * builds the index for "pgmlazyidx".  Nothing may follow the pages as the
+ * loader skips to the end of them.
+ */
+static DECLCALLBACK(int) pgmR3LazySaveExec(PVM pVM, PSSMHANDLE pSSM)
+{
+    PPGMLAZY pLazy = pVM->pgm.s.pLazyR3;
+    if (!pLazy || !pLazy->cRuns)
+        return SSMR3PutU32(pSSM, 0);
+
+    /*
+     * The runs.
+     */
+    SSMR3PutU32(pSSM, pLazy->cRuns);
+    for (uint32_t iRun = 0; iRun < pLazy->cRuns; iRun++)
+    {
+        SSMR3PutGCPhys(pSSM, pLazy->paRuns[iRun].GCPhys);
+        SSMR3PutU32(pSSM, pLazy->paRuns[iRun].cPages);
+    }
+
+    /*
+     * The pages.  The index runs are split wherever the page records aren't
+     * evenly spaced in the file (they ought to be).
+     */
+    PPGMLAZYRUN paIdx     = NULL;
+    uint32_t    cIdx      = 0;
+    uint32_t    cIdxAlloc = 0;
+    uint32_t    cbStride  = 0;
+    uint64_t    offPrev   = 0;
+    int         rc        = VINF_SUCCESS;
+    for (uint32_t iRun = 0; iRun < pLazy->cRuns && RT_SUCCESS(rc); iRun++)
+        for (uint32_t iPage = 0; iPage < pLazy->paRuns[iRun].cPages && RT_SUCCESS(rc); iPage++)
+        {
+            RTGCPHYS const  GCPhys = pLazy->paRuns[iRun].GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+            uint8_t         abPage[PAGE_SIZE];
+            pgmLock(pVM);
+            PPGMPAGE pPage;
+            rc = pgmPhysGetPageEx(pVM, GCPhys, &pPage);
+            if (RT_SUCCESS(rc))
+            {
+                PGMPAGEMAPLOCK  PgMpLck;
+                void const     *pvPage;
+                rc = pgmPhysGCPhys2CCPtrInternalReadOnly(pVM, pPage, GCPhys, &pvPage, &PgMpLck);
+                if (RT_SUCCESS(rc))
+                {
+                    memcpy(abPage, pvPage, PAGE_SIZE);
+                    pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+                }
+            }
+            pgmUnlock(pVM);
+            AssertLogRelMsgRCBreak(rc, ("rc=%Rrc GCPhys=%RGp\n", rc, GCPhys));
+
+            uint64_t offPage;
+            rc = SSMR3PutMemUncompressed(pSSM, abPage, PAGE_SIZE, &offPage);
+            if (RT_FAILURE(rc))
+                break;
+            if (!cbStride && cIdx)
+                cbStride = (uint32_t)(offPage - offPrev);
+            offPrev = offPage;
+
+            PPGMLAZYRUN pIdx = cIdx ? &paIdx[cIdx - 1] : NULL;
+            if (   pIdx
+                && GCPhys  == pIdx->GCPhys + ((RTGCPHYS)pIdx->cPages << PAGE_SHIFT)
+                && offPage == pIdx->offFile + (uint64_t)pIdx->cPages * cbStride)
+                pIdx->cPages++;
+            else
+            {
+                if (cIdx >= cIdxAlloc)
+                {
+                    uint32_t const cNew = cIdxAlloc ? cIdxAlloc * 2 : pLazy->cRuns;
+                    void *pvNew = MMR3HeapRealloc(paIdx, cNew * sizeof(paIdx[0]));
+                    if (!pvNew)
+                    {
+                        rc = VERR_NO_MEMORY;
+                        break;
+                    }
+                    paIdx     = (PPGMLAZYRUN)pvNew;
+                    cIdxAlloc = cNew;
+                }
+                pIdx = &paIdx[cIdx++];
+                pIdx->GCPhys     = GCPhys;
+                pIdx->offFile    = offPage;
+                pIdx->cPages     = 1;
+                pIdx->u32Padding = 0;
+            }
+        }
+
+    /*
+     * Replace the runs with the index for "pgmlazyidx".
+     */
+    MMR3HeapFree(pLazy->paRuns);
+    pLazy->paRuns     = paIdx;
+    pLazy->cRuns      = cIdx;
+    pLazy->cRunsAlloc = cIdxAlloc;
+    pLazy->cbStride   = cbStride ? cbStride : PAGE_SIZE;
+    pLazy->offEnd     = offPrev + PAGE_SIZE;
+    if (RT_SUCCESS(rc))
+        LogRel(("PGM: Lazy restore: Saved %u RAM pages in %u runs for reading on demand\n", pLazy->cPages, cIdx));
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTSAVEDONE}
+ */
+static DECLCALLBACK(int) pgmR3LazySaveDone(PVM pVM, PSSMHANDLE pSSM)
+{
+    pgmR3LazyFree(pVM, pVM->pgm.s.pLazyR3);
+    pVM->pgm.s.pLazyR3 = NULL;
+    NOREF(pSSM);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTSAVEEXEC, Saves the lazy restore index.}
+ */
+static DECLCALLBACK(int) pgmR3LazyIdxSaveExec(PVM pVM, PSSMHANDLE pSSM)
+{
+    PPGMLAZY pLazy = pVM->pgm.s.pLazyR3;
+    if (!pLazy || !pLazy->cRuns)
+    {
+        SSMR3PutU32(pSSM, 0); /* cPages */
+        return SSMR3PutU32(pSSM, UINT32_MAX);
+    }
+
+    SSMR3PutU32(pSSM, pLazy->cPages);
+    SSMR3PutU32(pSSM, pLazy->cbStride);
+    SSMR3PutU64(pSSM, pLazy->offEnd);
+    SSMR3PutU32(pSSM, pLazy->cRuns);
+    for (uint32_t iRun = 0; iRun < pLazy->cRuns; iRun++)
+    {
+        SSMR3PutGCPhys(pSSM, pLazy->paRuns[iRun].GCPhys);
+        SSMR3PutU64(pSSM, pLazy->paRuns[iRun].offFile);
+        SSMR3PutU32(pSSM, pLazy->paRuns[iRun].cPages);
+    }
+    return SSMR3PutU32(pSSM, UINT32_MAX);
+}
+
+
+/**
+ * Reads and validates the lazy restore index of a saved state file.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_SSM_UNIT_NOT_FOUND if the file has no index.
+ * @param   pVM             The cross context VM structure.
+ * @param   pszFilename     The saved state file.
+ * @param   ppLazy          Where to return the lazy restore state, NULL if the
+ *                          saved state has no pages for lazy restore.
+ */
+static int pgmR3LazyReadIndex(PVM pVM, const char *pszFilename, PPGMLAZY *ppLazy)
+{
+    *ppLazy = NULL;
+
+    PSSMHANDLE pSSM;
+    int rc = SSMR3Open(pszFilename, 0 /*fFlags*/, &pSSM);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    uint32_t uVersion;
+    rc = SSMR3Seek(pSSM, "pgmlazyidx", 0 /*iInstance*/, &uVersion);
+    if (RT_SUCCESS(rc) && uVersion != PGM_LAZY_SAVED_STATE_VERSION)
+        rc = VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
+    uint32_t cPages = 0;
+    if (RT_SUCCESS(rc))
+        rc = SSMR3GetU32(pSSM, &cPages);
+    PPGMLAZY pLazy = NULL;
+    if (RT_SUCCESS(rc) && cPages)
+    {
+        pLazy = pgmR3LazyCreate(pVM);
+        if (pLazy)
+        {
+            pLazy->cPages = cPages;
+            SSMR3GetU32(pSSM, &pLazy->cbStride);
+            SSMR3GetU64(pSSM, &pLazy->offEnd);
+            rc = SSMR3GetU32(pSSM, &pLazy->cRuns);
+            if (   RT_SUCCESS(rc)
+                && (   !pLazy->cRuns
+                    || pLazy->cRuns > cPages
+                    || pLazy->cbStride < PAGE_SIZE
+                    || pLazy->cbStride > PAGE_SIZE + 64))
+                rc = VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
+            if (RT_SUCCESS(rc))
+            {
+                pLazy->paRuns = (PPGMLAZYRUN)MMR3HeapAllocZ(pVM, MM_TAG_PGM, pLazy->cRuns * sizeof(pLazy->paRuns[0]));
+                if (pLazy->paRuns)
+                    pLazy->cRunsAlloc = pLazy->cRuns;
+                else
+                    rc = VERR_NO_MEMORY;
+            }
+
+            /* The runs must be sorted, not overlap and lie before offEnd. */
+            uint64_t cTotal     = 0;
+            RTGCPHYS GCPhysNext = 0;
+            for (uint32_t iRun = 0; iRun < pLazy->cRuns && RT_SUCCESS(rc); iRun++)
+            {
+                PPGMLAZYRUN pRun = &pLazy->paRuns[iRun];
+                SSMR3GetGCPhys(pSSM, &pRun->GCPhys);
+                SSMR3GetU64(pSSM, &pRun->offFile);
+                rc = SSMR3GetU32(pSSM, &pRun->cPages);
+                if (   RT_SUCCESS(rc)
+                    && (   !pRun->cPages
+                        || pRun->cPages > cPages
+                        || (pRun->GCPhys & PAGE_OFFSET_MASK)
+                        || pRun->GCPhys < GCPhysNext
+                        || pRun->offFile + (uint64_t)(pRun->cPages - 1) * pLazy->cbStride + PAGE_SIZE > pLazy->offEnd))
+                    rc = VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
+                GCPhysNext = pRun->GCPhys + ((RTGCPHYS)pRun->cPages << PAGE_SHIFT);
+                cTotal    += pRun->cPages;
+            }
+            if (RT_SUCCESS(rc) && cTotal != cPages)
+                rc = VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
+        }
+        else
+            rc = VERR_NO_MEMORY;
+    }
+    if (RT_SUCCESS(rc))
+    {
+        uint32_t u32Sep;
+        rc = SSMR3GetU32(pSSM, &u32Sep);
+        if (RT_SUCCESS(rc) && u32Sep != UINT32_MAX)
+            rc = VERR_SSM_DATA_UNIT_FORMAT_CHANGED;
+    }
+    SSMR3Close(pSSM);
+
+    if (RT_SUCCESS(rc))
+        *ppLazy = pLazy;
+    else
+        pgmR3LazyFree(pVM, pLazy);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTLOADPREP}
+ *
+ * Reads the lazy restore index and opens the file for reading the pages
+ * later on.  Any trouble here just means the pages are loaded the normal way.
+ */
+static DECLCALLBACK(int) pgmR3LazyLoadPrep(PVM pVM, PSSMHANDLE pSSM)
+{
+    pgmR3LazyFree(pVM, pVM->pgm.s.pLazyR3);
+    pVM->pgm.s.pLazyR3 = NULL;
+
+    const char *pszFilename = SSMR3HandleGetFilename(pSSM);
+    if (!pVM->pgm.s.fLazyRestore || !pszFilename)
+        return VINF_SUCCESS;
+
+    PPGMLAZY pLazy;
+    int rc = pgmR3LazyReadIndex(pVM, pszFilename, &pLazy);
+    if (RT_SUCCESS(rc) && pLazy)
+    {
+        rc = RTFileOpen(&pLazy->hFile, pszFilename,
+                        RTFILE_O_READ | RTFILE_O_OPEN | RTFILE_O_DENY_NONE | RTFILE_O_DENY_NOT_DELETE);
+        if (RT_SUCCESS(rc))
+            pVM->pgm.s.pLazyR3 = pLazy;
+        else
+        {
+            pLazy->hFile = NIL_RTFILE;
+            pgmR3LazyFree(pVM, pLazy);
+        }
+    }
+    if (RT_FAILURE(rc) && rc != VERR_SSM_UNIT_NOT_FOUND)
+        LogRel(("PGM: Lazy restore: Cannot use '%s' (%Rrc), loading all the RAM now\n", pszFilename, rc));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTLOADEXEC}
+ *
+ * With the index from pgmR3LazyLoadPrep the pages are only marked as missing
+ * and skipped, otherwise they are loaded.
+ */
+static DECLCALLBACK(int) pgmR3LazyLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    Assert(uPass == SSM_PASS_FINAL); NOREF(uPass);
+    if (uVersion != PGM_LAZY_SAVED_STATE_VERSION)
+        return VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
+
+    uint32_t cRuns;
+    int rc = SSMR3GetU32(pSSM, &cRuns);
+    if (RT_FAILURE(rc))
+        return rc;
+    if (!cRuns)
+        return VINF_SUCCESS;
+    AssertLogRelMsgReturn(cRuns <= pVM->pgm.s.cAllPages, ("cRuns=%#x\n", cRuns), VERR_SSM_DATA_UNIT_FORMAT_CHANGED);
+
+    PPGMLAZYRUN paRuns = (PPGMLAZYRUN)MMR3HeapAllocZ(pVM, MM_TAG_PGM, cRuns * sizeof(paRuns[0]));
+    if (!paRuns)
+        return VERR_NO_MEMORY;
+    uint64_t cPages = 0;
+    for (uint32_t iRun = 0; iRun < cRuns && RT_SUCCESS(rc); iRun++)
+    {
+        SSMR3GetGCPhys(pSSM, &paRuns[iRun].GCPhys);
+        rc = SSMR3GetU32(pSSM, &paRuns[iRun].cPages);
+        cPages += paRuns[iRun].cPages;
+    }
+
+    PPGMLAZY pLazy = pVM->pgm.s.pLazyR3;
+    if (RT_SUCCESS(rc) && pLazy && cPages != pLazy->cPages)
+        rc = SSMR3SetLoadError(pSSM, VERR_SSM_LOAD_CONFIG_MISMATCH, RT_SRC_POS,
+                               N_("The lazy restore index doesn't match the pages (%RU64, expected %u)"), cPages, pLazy->cPages);
+
+    /*
+     * Mark the pages as missing or load them.
+     */
+    for (uint32_t iRun = 0; iRun < cRuns && RT_SUCCESS(rc); iRun++)
+        for (uint32_t iPage = 0; iPage < paRuns[iRun].cPages && RT_SUCCESS(rc); iPage++)
+        {
+            RTGCPHYS const GCPhys = paRuns[iRun].GCPhys + ((RTGCPHYS)iPage << PAGE_SHIFT);
+            pgmLock(pVM);
+            PPGMPAGE     pPage;
+            PPGMRAMRANGE pRam;
+            rc = pgmPhysGetPageAndRangeEx(pVM, GCPhys, &pPage, &pRam);
+            if (RT_SUCCESS(rc))
+            {
+                AssertLogRelMsgStmt(PGM_PAGE_GET_TYPE(pPage) == PGMPAGETYPE_RAM,
+                                    ("GCPhys=%RGp %R[pgmpage]\n", GCPhys, pPage), rc = VERR_PGM_SAVED_REC_TYPE);
+                if (RT_SUCCESS(rc) && pLazy)
+                    rc = pgmR3PostCopyAddPage(pVM, pRam, GCPhys, false /*fSource*/);
+                else if (RT_SUCCESS(rc))
+                {
+                    PGMPAGEMAPLOCK PgMpLck;
+                    void          *pvDstPage;
+                    rc = pgmPhysGCPhys2CCPtrInternal(pVM, pPage, GCPhys, &pvDstPage, &PgMpLck);
+                    if (RT_SUCCESS(rc))
+                    {
+                        rc = SSMR3GetMem(pSSM, pvDstPage, PAGE_SIZE);
+                        pgmPhysReleaseInternalPageMappingLock(pVM, &PgMpLck);
+                    }
+                }
+            }
+            pgmUnlock(pVM);
+            AssertLogRelMsgRC(rc, ("GCPhys=%RGp rc=%Rrc\n", GCPhys, rc));
+        }
+    MMR3HeapFree(paRuns);
+
+    /*
+     * Skip the pages, the thread started by pgmR3LazyLoadDone reads them.
+     */
+    if (RT_SUCCESS(rc) && pLazy)
+        rc = SSMR3SkipToEndOfUnitAt(pSSM, pLazy->offEnd);
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTLOADDONE}
+ *
+ * Hands the pages left missing by pgmR3LazyLoadExec to the post-copy target
+ * code once pgmR3LoadDone has covered them with access handlers.
+ */
+static DECLCALLBACK(int) pgmR3LazyLoadDone(PVM pVM, PSSMHANDLE pSSM)
+{
+    PPGMLAZY pLazy = pVM->pgm.s.pLazyR3;
+    pVM->pgm.s.pLazyR3 = NULL;
+    if (!pLazy)
+        return VINF_SUCCESS;
+    if (RT_FAILURE(SSMR3HandleGetStatus(pSSM)))
+    {
+        pgmR3LazyFree(pVM, pLazy);
+        return VINF_SUCCESS;
+    }
+    return pgmR3PostCopyTrgStartLazy(pVM, pLazy);
+}
+
+
+/**
+ * @callback_method_impl{FNSSMINTLOADEXEC, The index was used by pgmR3LazyLoadPrep.}
+ */
+static DECLCALLBACK(int) pgmR3LazyIdxLoadExec(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    NOREF(pVM); NOREF(uPass);
+    if (uVersion != PGM_LAZY_SAVED_STATE_VERSION)
+        return VERR_SSM_UNSUPPORTED_DATA_UNIT_VERSION;
+    return SSMR3SkipToEndOfUnit(pSSM);
+}
+
+
+/**
+ * Frees the delta saved state tracking and lazy restore leftovers at VM
+ * termination.
+ *
+ * @param   pVM     The cross context VM structure.
+ */
+void pgmR3TermSavedState(PVM pVM)
+{
+    pgmR3LazyFree(pVM, pVM->pgm.s.pLazyR3);
+    pVM->pgm.s.pLazyR3 = NULL;
+
+    PPGMDELTA pDelta = pVM->pgm.s.pDeltaR3;
+    if (pDelta)
+    {
+        pVM->pgm.s.pDeltaR3 = NULL;
+        RTStrFree(pDelta->pszParent);
+        MMR3HeapFree(pDelta);
+    }
+}
+
+
+/**
+ * Registers the saved state callbacks with SSM.
+ *
+ * @returns VBox status code.
+ * @param   pVM     The cross context VM structure.
+ * @param   cbRam   The RAM size.
+ */
+int pgmR3InitSavedState(PVM pVM, uint64_t cbRam)
+{
+    int rc = SSMR3RegisterInternal(pVM, "pgm", 1, PGM_SAVED_STATE_VERSION, (size_t)cbRam + sizeof(PGM),
+                                   pgmR3LivePrep, pgmR3LiveExec, pgmR3LiveVote,
+                                   NULL,          pgmR3SaveExec, pgmR3SaveDone,
+                                   pgmR3LoadPrep, pgmR3Load,     pgmR3LoadDone);
+    AssertRCReturn(rc, rc);
+
+    /*
+     * Delta saved states.  The unit must come after "pgm" as its load prep
+     * depends on the memory reset done by pgmR3LoadPrep.
+     */
+    /** @cfgm{/PGM/DeltaSavedStates, boolean, false}
+     * Whether to keep track of the RAM pages changed since the last save or
+     * restore so the next saved state can be a delta, see PGMR3DeltaSetParent.
+     * This keeps the RAM write monitored while the VM runs. */
+    bool fDeltaSavedStates;
+    rc = CFGMR3QueryBoolDef(CFGMR3GetChild(CFGMR3GetRoot(pVM), "/PGM"), "DeltaSavedStates", &fDeltaSavedStates, false);
+    AssertLogRelRCReturn(rc, rc);
+    if (fDeltaSavedStates)
+    {
+        pVM->pgm.s.pDeltaR3 = (PPGMDELTA)MMR3HeapAllocZ(pVM, MM_TAG_PGM, sizeof(PGMDELTA));
+        AssertReturn(pVM->pgm.s.pDeltaR3, VERR_NO_MEMORY);
+        rc = SSMR3RegisterInternal(pVM, "pgmdelta", 0, PGM_DELTA_SAVED_STATE_VERSION, 128,
+                                   NULL,               NULL,               NULL,
+                                   NULL,               pgmR3DeltaSaveExec, NULL,
+                                   pgmR3DeltaLoadPrep, pgmR3DeltaLoadExec, pgmR3DeltaLoadDone);
+        AssertRCReturn(rc, rc);
+        LogRel(("PGM: Delta saved states enabled\n"));
+    }
+
+    /*
+     * Lazy restore.  The units are always registered so any VM can load
+     * such saved states, but only written when enabled.  The index unit must
+     * come after "pgmlazy" as it records where its pages ended up.
+     */
+    /** @cfgm{/PGM/LazyRestore, boolean, false}
+     * Whether to save the RAM in a way that lets the VM resume before all of
+     * it has been read when restoring, and to restore saved states like that.
+     * This doesn't combine with /PGM/DeltaSavedStates. */
+    rc = CFGMR3QueryBoolDef(CFGMR3GetChild(CFGMR3GetRoot(pVM), "/PGM"), "LazyRestore", &pVM->pgm.s.fLazyRestore, false);
+    AssertLogRelRCReturn(rc, rc);
+    bool const fLazy = pVM->pgm.s.fLazyRestore;
+    rc = SSMR3RegisterInternal(pVM, "pgmlazy", 0, PGM_LAZY_SAVED_STATE_VERSION, _64K,
+                               NULL,                             NULL,                             NULL,
+                               fLazy ? pgmR3LazySavePrep : NULL, fLazy ? pgmR3LazySaveExec : NULL, fLazy ? pgmR3LazySaveDone : NULL,
+                               pgmR3LazyLoadPrep,                pgmR3LazyLoadExec,                pgmR3LazyLoadDone);
+    AssertRCReturn(rc, rc);
+    rc = SSMR3RegisterInternal(pVM, "pgmlazyidx", 0, PGM_LAZY_SAVED_STATE_VERSION, 128,
+                               NULL, NULL,                                NULL,
+                               NULL, fLazy ? pgmR3LazyIdxSaveExec : NULL, NULL,
+                               NULL, pgmR3LazyIdxLoadExec,                NULL);
+    AssertRCReturn(rc, rc);
+    if (fLazy)
+        LogRel(("PGM: Lazy restore enabled%s\n", pVM->pgm.s.pDeltaR3 ? " (but not used with delta saved states)" : ""));
+    return VINF_SUCCESS;
 }
 
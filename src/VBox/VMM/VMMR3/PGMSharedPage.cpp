@@ -22,6 +22,7 @@
 #define LOG_GROUP LOG_GROUP_PGM_SHARED
 #include <VBox/vmm/pgm.h>
 #include <VBox/vmm/stam.h>
+#include <VBox/vmm/tm.h>
 #include <VBox/vmm/uvm.h>
 #include "PGMInternal.h"
 #include <VBox/vmm/vm.h>
@@ -272,6 +273,107 @@ VMMR3DECL(int) PGMR3SharedModuleCheckAll(PVM pVM)
 }
 
 
+/**
+ * Rendezvous callback doing one page fusion scanner pass.
+ *
+ * @returns VBox strict status code.
+ * @param   pVM                 The cross context VM structure.
+ * @param   pVCpu               The cross context virtual CPU structure of the calling EMT.
+ * @param   pvUser              Unused.
+ */
+static DECLCALLBACK(VBOXSTRICTRC) pgmR3PageFusionScanRendezvous(PVM pVM, PVMCPU pVCpu, void *pvUser)
+{
+    NOREF(pVCpu); NOREF(pvUser);
+
+    /* Flush all pending handy page operations before changing any shared page assignments. */
+    int rc = PGMR3PhysAllocateHandyPages(pVM);
+    AssertRC(rc);
+
+    /*
+     * Lock it here as we can't deal with busy locks in this ring-0 path.
+     */
+    pgmLock(pVM);
+    pgmR3PhysAssertSharedPageChecksums(pVM);
+    rc = GMMR3FusionScan(pVM, pVM->pgm.s.FusionScan.cPagesPerPass);
+    pgmR3PhysAssertSharedPageChecksums(pVM);
+    pgmUnlock(pVM);
+
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("PGM: Page fusion scanner failed with %Rrc, disabling it.\n", rc));
+        pVM->pgm.s.FusionScan.fEnabled = false;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Page fusion scanner pass helper (called on the way out).
+ *
+ * @param   pVM         The cross context VM structure.
+ */
+static DECLCALLBACK(void) pgmR3PageFusionScanHelper(PVM pVM)
+{
+    /* Like with the shared modules, stall the other VCPUs so we don't have to send IPIs for every change. */
+    STAM_REL_PROFILE_START(&pVM->pgm.s.StatFusionScan, a);
+    int rc = VMMR3EmtRendezvous(pVM, VMMEMTRENDEZVOUS_FLAGS_TYPE_ONCE, pgmR3PageFusionScanRendezvous, NULL);
+    AssertRC(rc);
+    STAM_REL_PROFILE_STOP(&pVM->pgm.s.StatFusionScan, a);
+
+    /* Rearm the timer here rather than in the callback so passes can't pile up. */
+    if (pVM->pgm.s.FusionScan.fEnabled)
+        TMTimerSetMillies(pVM->pgm.s.FusionScan.pTimerR3, pVM->pgm.s.FusionScan.cMsInterval);
+}
+
+
+/**
+ * @callback_method_impl{FNTMTIMERINT, Page fusion scanner pass timer.}
+ */
+static DECLCALLBACK(void) pgmR3PageFusionScanTimer(PVM pVM, PTMTIMER pTimer, void *pvUser)
+{
+    NOREF(pTimer); NOREF(pvUser);
+
+    /* We can't do rendezvous from inside timer callbacks, so queue it. */
+    int rc = VMR3ReqCallNoWait(pVM, VMCPUID_ANY_QUEUE, (PFNRT)pgmR3PageFusionScanHelper, 1, pVM);
+    AssertLogRelRC(rc);
+}
+
+
+/**
+ * Sets up the content based page fusion scanner.
+ *
+ * This hashes a rate limited batch of private RAM pages every so often and
+ * lets GMM fuse identical ones across all VMs copy-on-write, see
+ * @ref pg_gmm_fusion.  Unlike shared modules, this works without any help
+ * from the guest.  It is driven by a TMCLOCK_VIRTUAL timer, so it only runs
+ * while the VM does.
+ *
+ * @returns VBox status code.
+ * @param   pVM         The cross context VM structure.
+ */
+int pgmR3PageFusionScanInit(PVM pVM)
+{
+    if (   !pVM->pgm.s.fPageFusionAllowed
+        || pVM->pgm.s.fPciPassthrough)
+    {
+        LogRel(("PGM: Ignoring /PGM/PageFusionScan (fPageFusionAllowed=%RTbool fPciPassthrough=%RTbool).\n",
+                pVM->pgm.s.fPageFusionAllowed, pVM->pgm.s.fPciPassthrough));
+        pVM->pgm.s.FusionScan.fEnabled = false;
+        return VINF_SUCCESS;
+    }
+
+    int rc = TMR3TimerCreateInternal(pVM, TMCLOCK_VIRTUAL, pgmR3PageFusionScanTimer, NULL, "PGM Page Fusion Scanner",
+                                     &pVM->pgm.s.FusionScan.pTimerR3);
+    AssertRCReturn(rc, rc);
+    rc = TMTimerSetMillies(pVM->pgm.s.FusionScan.pTimerR3, pVM->pgm.s.FusionScan.cMsInterval);
+    AssertRCReturn(rc, rc);
+
+    LogRel(("PGM: Page fusion scanner enabled: %u pages every %u ms.\n",
+            pVM->pgm.s.FusionScan.cPagesPerPass, pVM->pgm.s.FusionScan.cMsInterval));
+    return VINF_SUCCESS;
+}
+
+
 # ifdef DEBUG
 /**
  * Query the state of a page in a shared module
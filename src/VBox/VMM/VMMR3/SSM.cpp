@@ -112,7 +112,9 @@
  *       - type 5: Named data - length prefixed name followed by the data. This
  *                 type is not implemented yet as we're missing the API part, so
  *                 the type assignment is tentative.
- *       - types 6 thru 15 are current undefined.
+ *       - type 6: Raw data compressed by zlib.  Same layout as type 3.  Only
+ *                 written when the zlib codec has been selected.
+ *       - types 7 thru 15 are current undefined.
  *   - bit 4: Important (set), can be skipped (clear).
  *   - bit 5: Undefined flag, must be zero.
  *   - bit 6: Undefined flag, must be zero.
@@ -145,6 +147,7 @@
 *********************************************************************************************************************************/
 #define LOG_GROUP LOG_GROUP_SSM
 #include <VBox/vmm/ssm.h>
+#include <VBox/vmm/cfgm.h>
 #include <VBox/vmm/dbgf.h>
 #include <VBox/vmm/pdmapi.h>
 #include <VBox/vmm/pdmcritsect.h>
@@ -161,10 +164,12 @@
 #include <iprt/crc.h>
 #include <iprt/file.h>
 #include <iprt/mem.h>
+#include <iprt/mp.h>
 #include <iprt/param.h>
 #include <iprt/thread.h>
 #include <iprt/semaphore.h>
 #include <iprt/string.h>
+#include <iprt/time.h>
 #include <iprt/uuid.h>
 #include <iprt/zip.h>
 
@@ -227,10 +232,13 @@
 /** Named data items.
  * A length prefix zero terminated string (i.e. max 255) followed by the data.  */
 #define SSM_REC_TYPE_NAMED                      5
+/** Raw data compressed by zlib.
+ * Same layout as SSM_REC_TYPE_RAW_LZF. */
+#define SSM_REC_TYPE_RAW_ZLIB                   6
 /** Macro for validating the record type.
  * This can be used with the flags+type byte, no need to mask out the type first. */
 #define SSM_REC_TYPE_IS_VALID(u8Type)           (   ((u8Type) & SSM_REC_TYPE_MASK) >  SSM_REC_TYPE_INVALID \
-                                                 && ((u8Type) & SSM_REC_TYPE_MASK) <= SSM_REC_TYPE_NAMED )
+                                                 && ((u8Type) & SSM_REC_TYPE_MASK) <= SSM_REC_TYPE_RAW_ZLIB )
 /** @} */
 
 /** The flag mask. */
@@ -285,6 +293,21 @@
 #define SSM_ZIP_BLOCK_SIZE                      _4K
 AssertCompile(SSM_ZIP_BLOCK_SIZE / _1K * _1K == SSM_ZIP_BLOCK_SIZE);
 
+/** The max number of compression worker threads. */
+#define SSM_ZIP_MAX_THREADS                     16
+/** The number of jobs in the compression pipeline.  Must be a power of two. */
+#define SSM_ZIP_JOBS                            32
+AssertCompile(!(SSM_ZIP_JOBS & (SSM_ZIP_JOBS - 1)));
+/** The input size of a save job. */
+#define SSM_ZIP_SAVE_JOB_SIZE                   _64K
+/** The max number of input segments in a save job. */
+#define SSM_ZIP_SAVE_JOB_MAX_SEGS               32
+/** The output size of a save job.  A compressed segment never grows by more
+ * than the 4 byte record header it is given when stored raw. */
+#define SSM_ZIP_SAVE_JOB_OUT_SIZE               (SSM_ZIP_SAVE_JOB_SIZE + SSM_ZIP_SAVE_JOB_MAX_SEGS * 4)
+/** The input size of a load job (compressed data of one record). */
+#define SSM_ZIP_LOAD_JOB_SIZE                   (SSM_ZIP_BLOCK_SIZE + 2)
+
 
 /**
  * Asserts that the handle is writable and returns with VERR_SSM_INVALID_STATE
@@ -364,6 +387,102 @@ typedef enum SSMSTATE
 } SSMSTATE;
 
 
+/**
+ * An input segment of a save compression job.
+ */
+typedef struct SSMZIPSEG
+{
+    /** Offset into SSMZIPJOB::pbIn. */
+    uint32_t                off;
+    /** The segment size.  SSM_ZIP_BLOCK_SIZE if fCompress is set. */
+    uint32_t                cb;
+    /** Whether to compress the block (set) or copy the bytes verbatim (clear). */
+    bool                    fCompress;
+} SSMZIPSEG;
+
+/**
+ * A compression pipeline job.
+ *
+ * When saving, a job is a run of ready-made record bytes and page sized
+ * blocks that are turned into records by a worker.  When loading, a job is the
+ * compressed payload of a single record found by scanning ahead of the reader.
+ */
+typedef struct SSMZIPJOB
+{
+    /** Set by the worker when the output is ready. */
+    bool volatile           fDone;
+    /** Load: the codec of the record. */
+    RTZIPTYPE               enmType;
+    /** Load: the stream offset of the compressed data (lookup key). */
+    uint64_t                offStream;
+    /** Number of input bytes. */
+    uint32_t                cbIn;
+    /** Save: number of output bytes.  Load: the decompressed size. */
+    uint32_t                cbOut;
+    /** Load: the decompression status. */
+    int32_t                 rc;
+    /** Save: number of input segments. */
+    uint32_t                cSegs;
+    /** Save: the input segments. */
+    SSMZIPSEG               aSegs[SSM_ZIP_SAVE_JOB_MAX_SEGS];
+    /** The input buffer. */
+    uint8_t                *pbIn;
+    /** The output buffer. */
+    uint8_t                *pbOut;
+} SSMZIPJOB;
+/** Pointer to a compression pipeline job. */
+typedef SSMZIPJOB *PSSMZIPJOB;
+
+/**
+ * The compression pipeline of a stream.
+ *
+ * Jobs are handed out in sequence and consumed in the same sequence, so the
+ * records end up in the stream in the order they were produced no matter
+ * which worker finishes first.  cSubmitted, cClaimed and cRetired are free
+ * running sequence numbers, the job index is the sequence number masked by
+ * SSM_ZIP_JOBS - 1.
+ */
+typedef struct SSMZIP
+{
+    /** Compressing (set) or decompressing (clear). */
+    bool                    fWrite;
+    /** Tells the workers to quit. */
+    bool volatile           fTerminate;
+    /** Save: the codec. */
+    RTZIPTYPE               enmType;
+    /** Number of worker threads. */
+    uint32_t                cThreads;
+    /** Sequence number of the next job to submit, written by the producer. */
+    uint32_t volatile       cSubmitted;
+    /** Sequence number of the next job to be claimed by a worker. */
+    uint32_t volatile       cClaimed;
+    /** Sequence number of the next job to consume, producer only. */
+    uint32_t                cRetired;
+    /** Save: the job being filled, NULL if none. */
+    PSSMZIPJOB              pCurJob;
+    /** Load: where the read-ahead scan stopped. */
+    uint64_t                offScan;
+    /** Load: number of records that were decompressed ahead. */
+    uint64_t                cHits;
+    /** Load: number of records decompressed by the reader itself. */
+    uint64_t                cMisses;
+    /** Signalled when jobs are submitted (and passed on by the workers). */
+    RTSEMEVENT              hEvtWork;
+    /** Signalled when a worker has completed a job. */
+    RTSEMEVENT              hEvtDone;
+    /** The worker threads. */
+    RTTHREAD                ahThreads[SSM_ZIP_MAX_THREADS];
+    /** The job buffers (a single allocation). */
+    uint8_t                *pbBuffers;
+    /** The size of the pbBuffers allocation. */
+    size_t                  cbBuffers;
+    /** The jobs. */
+    SSMZIPJOB               aJobs[SSM_ZIP_JOBS];
+} SSMZIP;
+/** Pointer to a compression pipeline. */
+typedef SSMZIP *PSSMZIP;
+
+
 /** Pointer to a SSM stream buffer. */
 typedef struct SSMSTRMBUF *PSSMSTRMBUF;
 /**
@@ -442,6 +561,9 @@ typedef struct SSMSTRM
      * This may lag behind off as it's desirable to checksum as large blocks as
      * possible.  */
     uint32_t                offStreamCRC;
+    /** The compression pipeline, NULL if (de)compressing on the caller's
+     * thread. */
+    PSSMZIP                 pZip;
 } SSMSTRM;
 /** Pointer to a SSM stream. */
 typedef SSMSTRM *PSSMSTRM;
@@ -500,6 +622,8 @@ typedef struct SSMHANDLE
     unsigned                uReportedLivePercent;
     /** The filename, NULL if remote stream. */
     const char             *pszFilename;
+    /** The RTTimeNanoTS when the operation started (throughput). */
+    uint64_t                nsStart;
 
     union
     {
@@ -514,6 +638,8 @@ typedef struct SSMHANDLE
             uint8_t         abDataBuffer[4096];
             /** The maximum downtime given as milliseconds. */
             uint32_t        cMsMaxDowntime;
+            /** The codec for compressing page sized blocks. */
+            RTZIPTYPE       enmZipType;
         } Write;
 
         /** Read data. */
@@ -888,6 +1014,7 @@ static int                  ssmR3LiveControlEmit(PSSMHANDLE pSSM, long double lr
 
 static int                  ssmR3StrmWriteBuffers(PSSMSTRM pStrm);
 static int                  ssmR3StrmReadMore(PSSMSTRM pStrm);
+static void                 ssmR3ZipDestroy(PSSMSTRM pStrm);
 
 #ifndef SSM_STANDALONE
 static int                  ssmR3DataFlushBuffer(PSSMHANDLE pSSM);
@@ -943,6 +1070,51 @@ static int ssmR3LazyInit(PVM pVM)
     if (RT_SUCCESS(rc))
     {
         STAM_REL_REG_USED(pVM, &pVM->ssm.s.uPass, STAMTYPE_U32, "/SSM/uPass", STAMUNIT_COUNT, "Current pass");
+        STAM_REL_REG_USED(pVM, &pVM->ssm.s.cMBPerSecSave, STAMTYPE_U32, "/SSM/Save/MBPerSec", STAMUNIT_MEGABYTES, "Stream throughput of the current or last save, per second.");
+        STAM_REL_REG_USED(pVM, &pVM->ssm.s.cbSaveStream,  STAMTYPE_U64, "/SSM/Save/Bytes",     STAMUNIT_BYTES,     "Stream bytes written by the current or last save.");
+        STAM_REL_REG_USED(pVM, &pVM->ssm.s.cMBPerSecLoad, STAMTYPE_U32, "/SSM/Load/MBPerSec", STAMUNIT_MEGABYTES, "Stream throughput of the current or last load, per second.");
+        STAM_REL_REG_USED(pVM, &pVM->ssm.s.cbLoadStream,  STAMTYPE_U64, "/SSM/Load/Bytes",     STAMUNIT_BYTES,     "Stream bytes read by the current or last load.");
+    }
+
+    /*
+     * Compression configuration.
+     */
+    if (RT_SUCCESS(rc))
+    {
+        PCFGMNODE pCfgSSM = CFGMR3GetChild(CFGMR3GetRoot(pVM), "SSM");
+
+        /** @cfgm{/SSM/ZipCodec, string, "lzf"}
+         * The codec for compressing page sized blocks when saving: "lzf", "zlib"
+         * (denser, slower, cannot be loaded by older VirtualBox versions) or
+         * "none" (fastest, only zero blocks are elided). */
+        char szCodec[16];
+        rc = CFGMR3QueryStringDef(pCfgSSM, "ZipCodec", szCodec, sizeof(szCodec), "lzf");
+        if (RT_SUCCESS(rc))
+        {
+            if (!RTStrICmp(szCodec, "lzf"))
+                pVM->ssm.s.enmZipCodec = SSMZIPCODEC_LZF;
+            else if (!RTStrICmp(szCodec, "zlib"))
+                pVM->ssm.s.enmZipCodec = SSMZIPCODEC_ZLIB;
+            else if (!RTStrICmp(szCodec, "none"))
+                pVM->ssm.s.enmZipCodec = SSMZIPCODEC_NONE;
+            else
+                rc = VMSetError(pVM, VERR_INVALID_PARAMETER, RT_SRC_POS,
+                                N_("Configuration error: Invalid SSM/ZipCodec value \"%s\""), szCodec);
+        }
+
+        /** @cfgm{/SSM/ZipThreads, uint32_t, online CPUs - 1, 0, 16}
+         * The number of worker threads compressing (saving) and decompressing
+         * ahead of the reader (loading).  Zero does all the work on the thread
+         * doing the save or load. */
+        if (RT_SUCCESS(rc))
+        {
+            uint32_t cCpus = RTMpGetOnlineCount();
+            rc = CFGMR3QueryU32Def(pCfgSSM, "ZipThreads", &pVM->ssm.s.cZipThreads,
+                                   RT_MIN(cCpus > 1 ? cCpus - 1 : 0, SSM_ZIP_MAX_THREADS / 2));
+            if (RT_SUCCESS(rc) && pVM->ssm.s.cZipThreads > SSM_ZIP_MAX_THREADS)
+                rc = VMSetError(pVM, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                                N_("Configuration error: SSM/ZipThreads must be between 0 and %u"), SSM_ZIP_MAX_THREADS);
+        }
     }
 
     pVM->ssm.s.fInitialized = RT_SUCCESS(rc);
@@ -1847,6 +2019,7 @@ static int ssmR3StrmInitInternal(PSSMSTRM pStrm, bool fChecksummed, uint32_t cBu
     pStrm->fChecksummed = fChecksummed;
     pStrm->u32StreamCRC = fChecksummed ? RTCrc32Start() : 0;
     pStrm->offStreamCRC = 0;
+    pStrm->pZip         = NULL;
 
     /*
      * Allocate the buffers.  Page align them in case that makes the kernel
@@ -2388,8 +2561,10 @@ static int ssmR3StrmWriteBuffers(PSSMSTRM pStrm)
 static int ssmR3StrmClose(PSSMSTRM pStrm, bool fCancelled)
 {
     /*
-     * Flush, terminate the I/O thread, and close the stream.
+     * Stop the compression workers, flush, terminate the I/O thread, and
+     * close the stream.
      */
+    ssmR3ZipDestroy(pStrm);
     if (pStrm->fWrite)
     {
         ssmR3StrmFlushCurBuf(pStrm);
@@ -3165,8 +3340,414 @@ static void ssmR3StrmStopIoThread(PSSMSTRM pStrm)
     }
 }
 
+
+/**
+ * Compresses a page sized block into a data record.
+ *
+ * Falls back on a raw record if the block does not compress.
+ *
+ * @returns The size of the record.
+ * @param   enmZipType      The codec, RTZIPTYPE_STORE for a raw record.
+ * @param   pvBlock         The SSM_ZIP_BLOCK_SIZE bytes to compress.
+ * @param   pbRec           Where to put the record, 1 + 3 + 1 +
+ *                          SSM_ZIP_BLOCK_SIZE bytes.
+ */
+static uint32_t ssmR3ZipCompressBlock(RTZIPTYPE enmZipType, void const *pvBlock, uint8_t *pbRec)
+{
+    AssertCompile(1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE < 0x00010000);
+    size_t cbRec = SSM_ZIP_BLOCK_SIZE - (SSM_ZIP_BLOCK_SIZE / 16);
+    int rc = VERR_BUFFER_OVERFLOW;
+    if (enmZipType != RTZIPTYPE_STORE)
+        rc = RTZipBlockCompress(enmZipType, enmZipType == RTZIPTYPE_ZLIB ? RTZIPLEVEL_DEFAULT : RTZIPLEVEL_FAST, 0 /*fFlags*/,
+                                pvBlock, SSM_ZIP_BLOCK_SIZE,
+                                pbRec + 1 + 3 + 1, cbRec, &cbRec);
+    if (RT_SUCCESS(rc))
+    {
+        pbRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT
+                 | (enmZipType == RTZIPTYPE_ZLIB ? SSM_REC_TYPE_RAW_ZLIB : SSM_REC_TYPE_RAW_LZF);
+        pbRec[4] = SSM_ZIP_BLOCK_SIZE / _1K;
+        cbRec += 1;
+    }
+    else
+    {
+        pbRec[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW;
+        memcpy(&pbRec[4], pvBlock, SSM_ZIP_BLOCK_SIZE);
+        cbRec = SSM_ZIP_BLOCK_SIZE;
+    }
+    pbRec[1] = (uint8_t)(0xe0 | ( cbRec >> 12));
+    pbRec[2] = (uint8_t)(0x80 | ((cbRec >>  6) & 0x3f));
+    pbRec[3] = (uint8_t)(0x80 | ( cbRec        & 0x3f));
+    return (uint32_t)cbRec + 1 + 3;
+}
+
+
+/**
+ * Compression worker thread.
+ *
+ * Claims submitted jobs in sequence order and flags them done, the producer
+ * (save) or consumer (load) takes care of the ordering.
+ *
+ * @returns VINF_SUCCESS.
+ * @param   hSelf       The thread handle.
+ * @param   pvZip       The compression pipeline.
+ */
+static DECLCALLBACK(int) ssmR3ZipThread(RTTHREAD hSelf, void *pvZip)
+{
+    PSSMZIP pZip = (PSSMZIP)pvZip;
+    NOREF(hSelf);
+
+    for (;;)
+    {
+        uint32_t const iJob = ASMAtomicReadU32(&pZip->cClaimed);
+        if (iJob != ASMAtomicReadU32(&pZip->cSubmitted))
+        {
+            if (!ASMAtomicCmpXchgU32(&pZip->cClaimed, iJob + 1, iJob))
+                continue;
+
+            /* The work event only holds one wakeup, pass it on if there is more to do. */
+            if (iJob + 1 != ASMAtomicReadU32(&pZip->cSubmitted))
+                RTSemEventSignal(pZip->hEvtWork);
+
+            PSSMZIPJOB pJob = &pZip->aJobs[iJob & (SSM_ZIP_JOBS - 1)];
+            if (pZip->fWrite)
+            {
+                uint32_t offOut = 0;
+                for (uint32_t iSeg = 0; iSeg < pJob->cSegs; iSeg++)
+                {
+                    SSMZIPSEG const *pSeg = &pJob->aSegs[iSeg];
+                    if (pSeg->fCompress)
+                        offOut += ssmR3ZipCompressBlock(pZip->enmType, &pJob->pbIn[pSeg->off], &pJob->pbOut[offOut]);
+                    else
+                    {
+                        memcpy(&pJob->pbOut[offOut], &pJob->pbIn[pSeg->off], pSeg->cb);
+                        offOut += pSeg->cb;
+                    }
+                }
+                Assert(offOut <= SSM_ZIP_SAVE_JOB_OUT_SIZE);
+                pJob->cbOut = offOut;
+            }
+            else
+            {
+                size_t cbDstActual = 0;
+                int rc = RTZipBlockDecompress(pJob->enmType, 0 /*fFlags*/,
+                                              pJob->pbIn, pJob->cbIn, NULL /*pcbSrcActual*/,
+                                              pJob->pbOut, pJob->cbOut, &cbDstActual);
+                if (RT_SUCCESS(rc) && cbDstActual != pJob->cbOut)
+                    rc = VERR_SSM_INTEGRITY_DECOMPRESSION;
+                pJob->rc = rc;
+            }
+
+            ASMAtomicWriteBool(&pJob->fDone, true);
+            RTSemEventSignal(pZip->hEvtDone);
+        }
+        else if (ASMAtomicReadBool(&pZip->fTerminate))
+            break;
+        else
+            RTSemEventWait(pZip->hEvtWork, RT_INDEFINITE_WAIT);
+    }
+
+    /* Make sure the other workers notice the termination too. */
+    RTSemEventSignal(pZip->hEvtWork);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Sets up the compression pipeline for a stream.
+ *
+ * Failing is not fatal, the stream will just do all the compression work on
+ * the caller's thread.
+ *
+ * @returns VBox status code.
+ * @param   pStrm           The stream handle.
+ * @param   cThreads        The number of worker threads.
+ * @param   enmType         The codec to use when saving.
+ */
+static int ssmR3ZipCreate(PSSMSTRM pStrm, uint32_t cThreads, RTZIPTYPE enmType)
+{
+    Assert(!pStrm->pZip);
+    AssertReturn(cThreads > 0 && cThreads <= SSM_ZIP_MAX_THREADS, VERR_INVALID_PARAMETER);
+
+    PSSMZIP pZip = (PSSMZIP)RTMemAllocZ(sizeof(*pZip));
+    if (!pZip)
+        return VERR_NO_MEMORY;
+    pZip->fWrite   = pStrm->fWrite;
+    pZip->enmType  = enmType;
+    pZip->hEvtWork = NIL_RTSEMEVENT;
+    pZip->hEvtDone = NIL_RTSEMEVENT;
+    for (uint32_t i = 0; i < RT_ELEMENTS(pZip->ahThreads); i++)
+        pZip->ahThreads[i] = NIL_RTTHREAD;
+
+    size_t const cbIn  = pZip->fWrite ? SSM_ZIP_SAVE_JOB_SIZE     : RT_ALIGN_Z(SSM_ZIP_LOAD_JOB_SIZE, 64);
+    size_t const cbOut = pZip->fWrite ? SSM_ZIP_SAVE_JOB_OUT_SIZE : SSM_ZIP_BLOCK_SIZE;
+    pZip->cbBuffers = RT_ALIGN_Z((cbIn + cbOut) * SSM_ZIP_JOBS, PAGE_SIZE);
+    pZip->pbBuffers = (uint8_t *)RTMemPageAlloc(pZip->cbBuffers);
+    int rc = pZip->pbBuffers ? VINF_SUCCESS : VERR_NO_MEMORY;
+    if (RT_SUCCESS(rc))
+    {
+        for (uint32_t i = 0; i < SSM_ZIP_JOBS; i++)
+        {
+            pZip->aJobs[i].pbIn  = &pZip->pbBuffers[i * (cbIn + cbOut)];
+            pZip->aJobs[i].pbOut = &pZip->pbBuffers[i * (cbIn + cbOut) + cbIn];
+        }
+        rc = RTSemEventCreate(&pZip->hEvtWork);
+        if (RT_SUCCESS(rc))
+            rc = RTSemEventCreate(&pZip->hEvtDone);
+        if (RT_SUCCESS(rc))
+        {
+            pStrm->pZip = pZip;
+            for (uint32_t i = 0; i < cThreads; i++)
+            {
+                rc = RTThreadCreateF(&pZip->ahThreads[i], ssmR3ZipThread, pZip, 0, RTTHREADTYPE_DEFAULT,
+                                     RTTHREADFLAGS_WAITABLE, "SSMZip%u", i);
+                if (RT_FAILURE(rc))
+                    break;
+                pZip->cThreads++;
+            }
+            if (RT_SUCCESS(rc))
+            {
+                Log(("SSM: Compression pipeline with %u threads (%s)\n", cThreads, pZip->fWrite ? "save" : "load"));
+                return VINF_SUCCESS;
+            }
+        }
+    }
+
+    LogRel(("SSM: Failed to set up the compression pipeline: %Rrc\n", rc));
+    pStrm->pZip = pZip;
+    ssmR3ZipDestroy(pStrm);
+    return rc;
+}
+
+#endif /* !SSM_STANDALONE */
+
+
+/**
+ * Stops the compression workers and frees the pipeline, if any.
+ *
+ * Jobs which have not been consumed are discarded.
+ *
+ * @param   pStrm           The stream handle.
+ */
+static void ssmR3ZipDestroy(PSSMSTRM pStrm)
+{
+    PSSMZIP pZip = pStrm->pZip;
+    if (!pZip)
+        return;
+    pStrm->pZip = NULL;
+
+    ASMAtomicWriteBool(&pZip->fTerminate, true);
+    if (pZip->hEvtWork != NIL_RTSEMEVENT)
+        RTSemEventSignal(pZip->hEvtWork);
+    for (uint32_t i = 0; i < pZip->cThreads; i++)
+    {
+        int rc = RTThreadWait(pZip->ahThreads[i], RT_INDEFINITE_WAIT, NULL);
+        AssertLogRelRC(rc);
+    }
+    if (!pZip->fWrite && (pZip->cHits || pZip->cMisses))
+        Log(("SSM: Decompressed %'RU64 records ahead, %'RU64 inline\n", pZip->cHits, pZip->cMisses));
+
+    RTSemEventDestroy(pZip->hEvtWork);
+    RTSemEventDestroy(pZip->hEvtDone);
+    if (pZip->pbBuffers)
+        RTMemPageFree(pZip->pbBuffers, pZip->cbBuffers);
+    RTMemFree(pZip);
+}
+
+
+/**
+ * Submits the next job in sequence to the workers.
+ *
+ * @param   pZip            The compression pipeline.
+ */
+DECLINLINE(void) ssmR3ZipSubmit(PSSMZIP pZip)
+{
+    ASMAtomicIncU32(&pZip->cSubmitted);
+    RTSemEventSignal(pZip->hEvtWork);
+}
+
+
+/**
+ * Waits for a job to be completed.
+ *
+ * @param   pZip            The compression pipeline.
+ * @param   pJob            The job.
+ */
+static void ssmR3ZipWaitForJob(PSSMZIP pZip, PSSMZIPJOB pJob)
+{
+    while (!ASMAtomicReadBool(&pJob->fDone))
+        RTSemEventWait(pZip->hEvtDone, RT_INDEFINITE_WAIT);
+}
+
+
+/**
+ * Looks up the decompressed data for the record at the given stream offset,
+ * throwing away any jobs for records which the reader has moved past.
+ *
+ * @returns Pointer to the completed job, NULL if the record wasn't
+ *          decompressed ahead.  The caller retires the job.
+ * @param   pZip            The compression pipeline.
+ * @param   offStream       The stream offset of the compressed data.
+ * @param   enmType         The codec of the record.
+ * @param   cbCompr         The size of the compressed data.
+ * @param   cbDecompr       The size of the decompressed data.
+ */
+static PSSMZIPJOB ssmR3ZipReadLookup(PSSMZIP pZip, uint64_t offStream, RTZIPTYPE enmType, uint32_t cbCompr, uint32_t cbDecompr)
+{
+    while (pZip->cRetired != pZip->cSubmitted)
+    {
+        PSSMZIPJOB pJob = &pZip->aJobs[pZip->cRetired & (SSM_ZIP_JOBS - 1)];
+        if (   pJob->offStream == offStream
+            && pJob->enmType   == enmType
+            && pJob->cbIn      == cbCompr
+            && pJob->cbOut     == cbDecompr)
+        {
+            ssmR3ZipWaitForJob(pZip, pJob);
+            pZip->cHits++;
+            return pJob;
+        }
+
+        /* Stale or the reader went backwards (seek): retire it. */
+        ssmR3ZipWaitForJob(pZip, pJob);
+        pZip->cRetired++;
+        if (pJob->offStream > offStream)
+            pZip->offScan = 0;
+    }
+    pZip->cMisses++;
+    return NULL;
+}
+
+
+/**
+ * Scans the current stream buffer for compressed records following the read
+ * position and queues them for decompression.
+ *
+ * Must be called on a record boundary.  The scan stops at the end of the
+ * buffer, at the end of the data unit and at anything it does not understand,
+ * leaving it to the reader proper to deal with.
+ *
+ * @param   pStrm           The stream handle.
+ */
+static void ssmR3ZipReadAhead(PSSMSTRM pStrm)
+{
+    PSSMZIP     pZip = pStrm->pZip;
+    PSSMSTRMBUF pBuf = pStrm->pCur;
+    if (!pBuf)
+        return;
+
+    uint64_t const offBuf = pStrm->offCurStream;
+    uint32_t const cbBuf  = pBuf->cb;
+    uint32_t       off    = pStrm->off;
+    if (pZip->offScan > offBuf + off)
+    {
+        if (pZip->offScan >= offBuf + cbBuf)
+            return;
+        off = (uint32_t)(pZip->offScan - offBuf);
+    }
+
+    bool fQueued = false;
+    while (   pZip->cSubmitted - pZip->cRetired < SSM_ZIP_JOBS
+           && off + 2 <= cbBuf)
+    {
+        /*
+         * Decode the record header, only sizes up to 64KB.
+         */
+        uint8_t const *pb = &pBuf->abData[off];
+        uint8_t const  u8TypeAndFlags = pb[0];
+        if (   !SSM_REC_ARE_TYPE_AND_FLAGS_VALID(u8TypeAndFlags)
+            || (u8TypeAndFlags & SSM_REC_TYPE_MASK) == SSM_REC_TYPE_TERM)
+            break;
+        uint32_t cbHdr;
+        uint32_t cbRec;
+        if (!(pb[1] & 0x80))
+        {
+            cbHdr = 2;
+            cbRec = pb[1];
+        }
+        else if ((pb[1] & 0xe0) == 0xc0 && off + 3 <= cbBuf)
+        {
+            cbHdr = 3;
+            cbRec = ((uint32_t)(pb[1] & 0x1f) << 6) | (pb[2] & 0x3f);
+        }
+        else if ((pb[1] & 0xf0) == 0xe0 && off + 4 <= cbBuf)
+        {
+            cbHdr = 4;
+            cbRec = ((uint32_t)(pb[1] & 0x0f) << 12) | ((uint32_t)(pb[2] & 0x3f) << 6) | (pb[3] & 0x3f);
+        }
+        else
+            break;
+        if (off + cbHdr + cbRec > cbBuf)
+            break;
+
+        /*
+         * Queue compressed records, skip the rest.
+         */
+        uint8_t const uType = u8TypeAndFlags & SSM_REC_TYPE_MASK;
+        if (uType == SSM_REC_TYPE_RAW_LZF || uType == SSM_REC_TYPE_RAW_ZLIB)
+        {
+            if (cbRec < 2)
+                break;
+            uint32_t const cbCompr   = cbRec - 1;
+            uint32_t const cbDecompr = (uint32_t)pb[cbHdr] * _1K;
+            if (   cbDecompr > SSM_ZIP_BLOCK_SIZE
+                || cbDecompr < cbCompr
+                || cbCompr > SSM_ZIP_LOAD_JOB_SIZE)
+                break;
+
+            PSSMZIPJOB pJob = &pZip->aJobs[pZip->cSubmitted & (SSM_ZIP_JOBS - 1)];
+            pJob->fDone     = false;
+            pJob->enmType   = uType == SSM_REC_TYPE_RAW_ZLIB ? RTZIPTYPE_ZLIB : RTZIPTYPE_LZF;
+            pJob->offStream = offBuf + off + cbHdr + 1;
+            pJob->cbIn      = cbCompr;
+            pJob->cbOut     = cbDecompr;
+            pJob->rc        = VERR_INTERNAL_ERROR;
+            memcpy(pJob->pbIn, &pb[cbHdr + 1], cbCompr);
+            ASMAtomicIncU32(&pZip->cSubmitted);
+            fQueued = true;
+        }
+
+        off += cbHdr + cbRec;
+        pZip->offScan = offBuf + off;
+    }
+
+    if (fQueued)
+        RTSemEventSignal(pZip->hEvtWork);
+}
+
+
+#ifndef SSM_STANDALONE
+/**
+ * Updates the throughput statistics.
+ *
+ * @param   pSSM            The saved state handle.
+ * @param   fFinal          Set when done, the result will be logged.
+ */
+static void ssmR3UpdateThroughput(PSSMHANDLE pSSM, bool fFinal)
+{
+    PVM pVM = pSSM->pVM;
+    if (!pVM)
+        return;
+
+    uint64_t const cbStream   = ssmR3StrmTell(&pSSM->Strm);
+    uint64_t const cNsElapsed = RT_MAX(RTTimeNanoTS() - pSSM->nsStart, 1);
+    uint32_t const cMBPerSec  = (uint32_t)(cbStream / _1K * RT_NS_1SEC / cNsElapsed / _1K);
+    bool const     fLoad      = pSSM->enmOp >= SSMSTATE_LOAD_PREP;
+    if (fLoad)
+    {
+        pVM->ssm.s.cbLoadStream  = cbStream;
+        pVM->ssm.s.cMBPerSecLoad = cMBPerSec;
+    }
+    else
+    {
+        pVM->ssm.s.cbSaveStream  = cbStream;
+        pVM->ssm.s.cMBPerSecSave = cMBPerSec;
+    }
+    if (fFinal)
+        LogRel(("SSM: %s %'RU64 bytes in %'RU64 ms (%u MB/s, %u compression threads)\n", fLoad ? "Read" : "Wrote",
+                cbStream, cNsElapsed / RT_NS_1MS, cMBPerSec, pSSM->Strm.pZip ? pSSM->Strm.pZip->cThreads : 0));
+}
 #endif /* !SSM_STANDALONE */
 
+
 /**
  * Works the progress calculation for non-live saves and restores.
  *
@@ -3189,7 +3770,12 @@ static void ssmR3ProgressByByte(PSSMHANDLE pSSM, uint64_t cbAdvance)
                && pSSM->uPercent <= 100 - pSSM->uPercentDone)
         {
             if (pSSM->pfnProgress)
+            {
+#ifndef SSM_STANDALONE
+                ssmR3UpdateThroughput(pSSM, false /*fFinal*/);
+#endif
                 pSSM->pfnProgress(pSSM->pVM->pUVM, pSSM->uPercent, pSSM->pvUser);
+            }
             pSSM->uPercent++;
             pSSM->offEstProgress = (pSSM->uPercent - pSSM->uPercentPrepare - pSSM->uPercentLive) * pSSM->cbEstTotal
                                  / (100 - pSSM->uPercentDone - pSSM->uPercentPrepare - pSSM->uPercentLive);
@@ -3267,6 +3853,178 @@ DECLINLINE(bool) ssmR3IsHostMsc32(PSSMHANDLE pSSM)
 
 #ifndef SSM_STANDALONE
 
+/**
+ * Writes completed save jobs to the stream in sequence order.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   cMustRetire     The number of jobs to wait for, the remainder is
+ *                          written only if already completed.
+ */
+static int ssmR3ZipWriteRetire(PSSMHANDLE pSSM, uint32_t cMustRetire)
+{
+    PSSMZIP pZip = pSSM->Strm.pZip;
+    while (pZip->cRetired != pZip->cSubmitted)
+    {
+        PSSMZIPJOB pJob = &pZip->aJobs[pZip->cRetired & (SSM_ZIP_JOBS - 1)];
+        if (!ASMAtomicReadBool(&pJob->fDone))
+        {
+            if (!cMustRetire)
+                break;
+            ssmR3ZipWaitForJob(pZip, pJob);
+        }
+        pZip->cRetired++;
+        if (cMustRetire)
+            cMustRetire--;
+
+        int rc = ssmR3StrmWrite(&pSSM->Strm, pJob->pbOut, pJob->cbOut);
+        if (RT_FAILURE(rc))
+            return rc;
+        pSSM->offUnit += pJob->cbOut;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Gets the save job being filled, submitting it and starting a new one if
+ * there isn't room for the given segment.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   cb              The segment size.
+ * @param   fCompress       Whether it's a block to compress.
+ * @param   ppJob           Where to return the job.
+ */
+static int ssmR3ZipWriteGetJob(PSSMHANDLE pSSM, uint32_t cb, bool fCompress, PSSMZIPJOB *ppJob)
+{
+    PSSMZIP    pZip = pSSM->Strm.pZip;
+    PSSMZIPJOB pJob = pZip->pCurJob;
+    if (pJob)
+    {
+        if (   pJob->cbIn + cb <= SSM_ZIP_SAVE_JOB_SIZE
+            && (   pJob->cSegs < SSM_ZIP_SAVE_JOB_MAX_SEGS
+                || (!fCompress && !pJob->aSegs[pJob->cSegs - 1].fCompress)))
+        {
+            *ppJob = pJob;
+            return VINF_SUCCESS;
+        }
+
+        pZip->pCurJob = NULL;
+        ssmR3ZipSubmit(pZip);
+        int rc = ssmR3ZipWriteRetire(pSSM, 0);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    if (pZip->cSubmitted - pZip->cRetired >= SSM_ZIP_JOBS)
+    {
+        int rc = ssmR3ZipWriteRetire(pSSM, 1);
+        if (RT_FAILURE(rc))
+            return rc;
+    }
+
+    pJob = &pZip->aJobs[pZip->cSubmitted & (SSM_ZIP_JOBS - 1)];
+    pJob->fDone   = false;
+    pJob->cbIn    = 0;
+    pJob->cbOut   = 0;
+    pJob->cSegs   = 0;
+    pZip->pCurJob = pJob;
+    *ppJob = pJob;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Queues ready-made record bytes in the save pipeline.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   pvBuf           The bytes.
+ * @param   cbBuf           The number of bytes.
+ */
+static int ssmR3ZipWriteRaw(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
+{
+    while (cbBuf > 0)
+    {
+        PSSMZIPJOB pJob;
+        int rc = ssmR3ZipWriteGetJob(pSSM, 1, false /*fCompress*/, &pJob);
+        if (RT_FAILURE(rc))
+            return rc;
+
+        uint32_t const cbCopy = (uint32_t)RT_MIN(cbBuf, SSM_ZIP_SAVE_JOB_SIZE - pJob->cbIn);
+        if (!pJob->cSegs || pJob->aSegs[pJob->cSegs - 1].fCompress)
+        {
+            pJob->aSegs[pJob->cSegs].off       = pJob->cbIn;
+            pJob->aSegs[pJob->cSegs].cb        = 0;
+            pJob->aSegs[pJob->cSegs].fCompress = false;
+            pJob->cSegs++;
+        }
+        memcpy(&pJob->pbIn[pJob->cbIn], pvBuf, cbCopy);
+        pJob->aSegs[pJob->cSegs - 1].cb += cbCopy;
+        pJob->cbIn += cbCopy;
+
+        pvBuf  = (uint8_t const *)pvBuf + cbCopy;
+        cbBuf -= cbCopy;
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Queues a page sized block for compression in the save pipeline.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   pvBlock         The SSM_ZIP_BLOCK_SIZE bytes to compress.  Copied.
+ */
+static int ssmR3ZipWriteBlock(PSSMHANDLE pSSM, void const *pvBlock)
+{
+    PSSMZIPJOB pJob;
+    int rc = ssmR3ZipWriteGetJob(pSSM, SSM_ZIP_BLOCK_SIZE, true /*fCompress*/, &pJob);
+    if (RT_SUCCESS(rc))
+    {
+        pJob->aSegs[pJob->cSegs].off       = pJob->cbIn;
+        pJob->aSegs[pJob->cSegs].cb        = SSM_ZIP_BLOCK_SIZE;
+        pJob->aSegs[pJob->cSegs].fCompress = true;
+        pJob->cSegs++;
+        memcpy(&pJob->pbIn[pJob->cbIn], pvBlock, SSM_ZIP_BLOCK_SIZE);
+        pJob->cbIn += SSM_ZIP_BLOCK_SIZE;
+    }
+    return rc;
+}
+
+
+/**
+ * Flushes the data buffer and waits for the save pipeline to write
+ * everything queued so far to the stream.
+ *
+ * This must be done before anything is written directly to the stream or the
+ * stream position, CRC or SSMHANDLE::offUnit is used for anything but
+ * logging.
+ *
+ * @returns VBox status code. Will set pSSM->rc on error.
+ * @param   pSSM            The saved state handle.
+ */
+static int ssmR3DataWriteSync(PSSMHANDLE pSSM)
+{
+    int rc = ssmR3DataFlushBuffer(pSSM);
+    PSSMZIP pZip = pSSM->Strm.pZip;
+    if (pZip && RT_SUCCESS(rc))
+    {
+        if (pZip->pCurJob)
+        {
+            pZip->pCurJob = NULL;
+            ssmR3ZipSubmit(pZip);
+        }
+        rc = ssmR3ZipWriteRetire(pSSM, pZip->cSubmitted - pZip->cRetired);
+        if (RT_FAILURE(rc) && RT_SUCCESS(pSSM->rc))
+            pSSM->rc = rc;
+    }
+    return rc;
+}
+
+
 /**
  * Finishes a data unit.
  * All buffers and compressor instances are flushed and destroyed.
@@ -3277,7 +4035,7 @@ DECLINLINE(bool) ssmR3IsHostMsc32(PSSMHANDLE pSSM)
 static int ssmR3DataWriteFinish(PSSMHANDLE pSSM)
 {
     //Log2(("ssmR3DataWriteFinish: %#010llx start\n", ssmR3StrmTell(&pSSM->Strm)));
-    int rc = ssmR3DataFlushBuffer(pSSM);
+    int rc = ssmR3DataWriteSync(pSSM);
     if (RT_SUCCESS(rc))
     {
         pSSM->offUnit     = UINT64_MAX;
@@ -3325,6 +4083,14 @@ static int ssmR3DataWriteRaw(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
     if (RT_FAILURE(pSSM->rc))
         return pSSM->rc;
 
+    /*
+     * When compressing on worker threads everything goes thru the pipeline
+     * so the records stay in order.  The unit offset is updated as the jobs
+     * are written to the stream.
+     */
+    if (pSSM->Strm.pZip)
+        return ssmR3ZipWriteRaw(pSSM, pvBuf, cbBuf);
+
     /*
      * Write the data item in 1MB chunks for progress indicator reasons.
      */
@@ -3344,17 +4110,16 @@ static int ssmR3DataWriteRaw(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
 
 
 /**
- * Writes a record header for the specified amount of data.
+ * Encodes a record header for the specified amount of data.
  *
- * @returns VBox status code. Sets pSSM->rc on failure.
- * @param   pSSM            The saved state handle
+ * @returns The size of the header, 0 if @a cb is too big.
+ * @param   abHdr           Where to put the header.
  * @param   cb              The amount of data.
  * @param   u8TypeAndFlags  The record type and flags.
  */
-static int ssmR3DataWriteRecHdr(PSSMHANDLE pSSM, size_t cb, uint8_t u8TypeAndFlags)
+static size_t ssmR3DataEncodeRecHdr(uint8_t abHdr[8], size_t cb, uint8_t u8TypeAndFlags)
 {
     size_t  cbHdr;
-    uint8_t abHdr[8];
     abHdr[0] = u8TypeAndFlags;
     if (cb < 0x80)
     {
@@ -3402,7 +4167,24 @@ static int ssmR3DataWriteRecHdr(PSSMHANDLE pSSM, size_t cb, uint8_t u8TypeAndFla
         abHdr[6] = (uint8_t)(0x80 | (cb & 0x3f));
     }
     else
-        AssertLogRelMsgFailedReturn(("cb=%#x\n", cb), pSSM->rc = VERR_SSM_MEM_TOO_BIG);
+        cbHdr = 0;
+    return cbHdr;
+}
+
+
+/**
+ * Writes a record header for the specified amount of data.
+ *
+ * @returns VBox status code. Sets pSSM->rc on failure.
+ * @param   pSSM            The saved state handle
+ * @param   cb              The amount of data.
+ * @param   u8TypeAndFlags  The record type and flags.
+ */
+static int ssmR3DataWriteRecHdr(PSSMHANDLE pSSM, size_t cb, uint8_t u8TypeAndFlags)
+{
+    uint8_t abHdr[8];
+    size_t  cbHdr = ssmR3DataEncodeRecHdr(abHdr, cb, u8TypeAndFlags);
+    AssertLogRelMsgReturn(cbHdr, ("cb=%#x\n", cb), pSSM->rc = VERR_SSM_MEM_TOO_BIG);
 
     Log3(("ssmR3DataWriteRecHdr: %08llx|%08llx/%08x: Type=%02x fImportant=%RTbool cbHdr=%u\n",
           ssmR3StrmTell(&pSSM->Strm) + cbHdr, pSSM->offUnit + cbHdr, cb, u8TypeAndFlags & SSM_REC_TYPE_MASK, !!(u8TypeAndFlags & SSM_REC_FLAGS_IMPORTANT), cbHdr));
@@ -3467,38 +4249,26 @@ static int ssmR3DataWriteBig(PSSMHANDLE pSSM, const void *pvBuf, size_t cbBuf)
                )
             {
                 /*
-                 * Compress it.
+                 * Compress it, either on a worker thread or right here.
                  */
-                AssertCompile(1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE < 0x00010000);
-                uint8_t *pb;
-                rc = ssmR3StrmReserveWriteBufferSpace(&pSSM->Strm, 1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE, &pb);
-                if (RT_FAILURE(rc))
-                    break;
-                size_t cbRec = SSM_ZIP_BLOCK_SIZE - (SSM_ZIP_BLOCK_SIZE / 16);
-                rc = RTZipBlockCompress(RTZIPTYPE_LZF, RTZIPLEVEL_FAST, 0 /*fFlags*/,
-                                        pvBuf, SSM_ZIP_BLOCK_SIZE,
-                                        pb + 1 + 3 + 1, cbRec, &cbRec);
-                if (RT_SUCCESS(rc))
+                if (pSSM->Strm.pZip)
                 {
-                    pb[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW_LZF;
-                    pb[4] = SSM_ZIP_BLOCK_SIZE / _1K;
-                    cbRec += 1;
+                    rc = ssmR3ZipWriteBlock(pSSM, pvBuf);
+                    if (RT_FAILURE(rc))
+                        break;
                 }
                 else
                 {
-                    pb[0] = SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW;
-                    memcpy(&pb[4], pvBuf, SSM_ZIP_BLOCK_SIZE);
-                    cbRec = SSM_ZIP_BLOCK_SIZE;
+                    uint8_t *pb;
+                    rc = ssmR3StrmReserveWriteBufferSpace(&pSSM->Strm, 1 + 3 + 1 + SSM_ZIP_BLOCK_SIZE, &pb);
+                    if (RT_FAILURE(rc))
+                        break;
+                    uint32_t cbRec = ssmR3ZipCompressBlock(pSSM->u.Write.enmZipType, pvBuf, pb);
+                    rc = ssmR3StrmCommitWriteBufferSpace(&pSSM->Strm, cbRec);
+                    if (RT_FAILURE(rc))
+                        break;
+                    pSSM->offUnit += cbRec;
                 }
-                pb[1] = (uint8_t)(0xe0 | ( cbRec >> 12));
-                pb[2] = (uint8_t)(0x80 | ((cbRec >>  6) & 0x3f));
-                pb[3] = (uint8_t)(0x80 | ( cbRec        & 0x3f));
-                cbRec += 1 + 3;
-                rc = ssmR3StrmCommitWriteBufferSpace(&pSSM->Strm, cbRec);
-                if (RT_FAILURE(rc))
-                    break;
-
-                pSSM->offUnit += cbRec;
                 ssmR3ProgressByByte(pSSM, SSM_ZIP_BLOCK_SIZE);
 
                 /* advance */
@@ -4353,6 +5123,56 @@ VMMR3DECL(int) SSMR3PutMem(PSSMHANDLE pSSM, const void *pv, size_t cb)
 }
 
 
+/**
+ * Saves a memory item as a single uncompressed record, so that it can later be
+ * read directly from the saved state file.
+ *
+ * Items saved by consecutive calls end up back to back in the stream with
+ * only the record headers in between.  A unit ending with such items can be
+ * skipped quickly on load, see SSMR3SkipToEndOfUnitAt.
+ *
+ * @returns VBox status code.
+ * @param   pSSM            The saved state handle.
+ * @param   pv              Item to save.
+ * @param   cb              Size of the item, 1 thru 64KB - 1 bytes.
+ * @param   poffStream      Where to return the stream offset of the item.  For
+ *                          a saved state file this is the file offset.
+ */
+VMMR3DECL(int) SSMR3PutMemUncompressed(PSSMHANDLE pSSM, const void *pv, size_t cb, uint64_t *poffStream)
+{
+    SSM_ASSERT_WRITEABLE_RET(pSSM);
+    SSM_CHECK_CANCELLED_RET(pSSM);
+    AssertPtrReturn(poffStream, VERR_INVALID_POINTER);
+    AssertReturn(cb > 0 && cb < _64K, VERR_INVALID_PARAMETER);
+
+    /*
+     * Get everything buffered or queued for compression out of the way, then
+     * write the record directly to the stream.
+     */
+    int rc = ssmR3DataWriteSync(pSSM);
+    if (RT_SUCCESS(rc))
+    {
+        uint8_t abHdr[8];
+        size_t  cbHdr = ssmR3DataEncodeRecHdr(abHdr, cb, SSM_REC_FLAGS_FIXED | SSM_REC_FLAGS_IMPORTANT | SSM_REC_TYPE_RAW);
+        rc = ssmR3StrmWrite(&pSSM->Strm, abHdr, cbHdr);
+        if (RT_SUCCESS(rc))
+        {
+            *poffStream = ssmR3StrmTell(&pSSM->Strm);
+            rc = ssmR3StrmWrite(&pSSM->Strm, pv, cb);
+        }
+        if (RT_SUCCESS(rc))
+        {
+            pSSM->offUnit     += cbHdr + cb;
+            pSSM->offUnitUser += cb;
+            ssmR3ProgressByByte(pSSM, cb);
+        }
+        else
+            pSSM->rc = rc;
+    }
+    return rc;
+}
+
+
 /**
  * Saves a zero terminated string item to the current data unit.
  *
@@ -4429,7 +5249,7 @@ static int ssmR3LiveControlEmit(PSSMHANDLE pSSM, long double lrdPct, uint32_t uP
         AssertMsg(u16PartsPerTenThousand <= 10000, ("%u\n", u16PartsPerTenThousand));
         ssmR3DataWrite(pSSM, &u16PartsPerTenThousand, sizeof(u16PartsPerTenThousand));
 
-        rc = ssmR3DataFlushBuffer(pSSM); /* will return SSMHANDLE::rc if it is set */
+        rc = ssmR3DataWriteSync(pSSM); /* will return SSMHANDLE::rc if it is set */
         if (RT_SUCCESS(rc))
         {
             /*
@@ -4578,6 +5398,8 @@ static int ssmR3SaveDoClose(PVM pVM, PSSMHANDLE pSSM)
      * Make it non-cancellable, close the stream and delete the file on failure.
      */
     ssmR3SetCancellable(pVM, pSSM, false);
+    if (RT_SUCCESS(pSSM->rc))
+        ssmR3UpdateThroughput(pSSM, true /*fFinal*/);
     int rc = ssmR3StrmClose(&pSSM->Strm, pSSM->rc == VERR_SSM_CANCELLED);
     if (RT_SUCCESS(rc))
         rc = pSSM->rc;
@@ -4904,7 +5726,7 @@ static int ssmR3SaveDoExecRun(PVM pVM, PSSMHANDLE pSSM)
         if (RT_FAILURE(rc) && RT_SUCCESS_NP(pSSM->rc))
             pSSM->rc = rc;
         else
-            rc = ssmR3DataFlushBuffer(pSSM); /* will return SSMHANDLE::rc if it is set */
+            rc = ssmR3DataWriteSync(pSSM); /* will return SSMHANDLE::rc if it is set */
         if (RT_FAILURE(rc))
         {
             LogRel(("SSM: Execute save failed with rc=%Rrc for data unit '%s'/#%u.\n", rc, pUnit->szName, pUnit->u32Instance));
@@ -5176,8 +5998,15 @@ static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
     pSSM->uPercentDone              = 0;
     pSSM->uReportedLivePercent      = 0;
     pSSM->pszFilename               = pszFilename;
+    pSSM->nsStart                   = RTTimeNanoTS();
     pSSM->u.Write.offDataBuffer     = 0;
     pSSM->u.Write.cMsMaxDowntime    = UINT32_MAX;
+    switch (pVM->ssm.s.enmZipCodec)
+    {
+        case SSMZIPCODEC_NONE:  pSSM->u.Write.enmZipType = RTZIPTYPE_STORE; break;
+        case SSMZIPCODEC_ZLIB:  pSSM->u.Write.enmZipType = RTZIPTYPE_ZLIB; break;
+        default:                pSSM->u.Write.enmZipType = RTZIPTYPE_LZF; break;
+    }
 
     int rc;
     if (pStreamOps)
@@ -5191,6 +6020,12 @@ static int ssmR3SaveDoCreateFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS
         return rc;
     }
 
+    /* Compress on worker threads if configured to.  Failing that isn't fatal,
+       the blocks will then be compressed by the EMT instead. */
+    if (   pVM->ssm.s.cZipThreads
+        && pSSM->u.Write.enmZipType != RTZIPTYPE_STORE)
+        ssmR3ZipCreate(&pSSM->Strm, pVM->ssm.s.cZipThreads, pSSM->u.Write.enmZipType);
+
     *ppSSM = pSSM;
     return VINF_SUCCESS;
 }
@@ -5488,7 +6323,7 @@ static int ssmR3LiveDoExecRun(PVM pVM, PSSMHANDLE pSSM, uint32_t uPass)
         {
             if (rc == VINF_SSM_DONT_CALL_AGAIN)
                 pUnit->fDoneLive = true;
-            rc = ssmR3DataFlushBuffer(pSSM); /* will return SSMHANDLE::rc if it is set */
+            rc = ssmR3DataWriteSync(pSSM); /* will return SSMHANDLE::rc if it is set */
         }
         if (RT_FAILURE(rc))
         {
@@ -6043,8 +6878,8 @@ DECLINLINE(int) ssmR3DataReadV2RawLzfHdr(PSSMHANDLE pSSM, uint32_t *pcbDecompr)
 
 
 /**
- * Reads an LZF block from the stream and decompresses into the specified
- * buffer.
+ * Reads an LZF or zlib block from the stream and decompresses into the
+ * specified buffer.
  *
  * @returns VBox status code. Sets pSSM->rc on error.
  * @param   pSSM            The saved state handle.
@@ -6056,6 +6891,9 @@ static int ssmR3DataReadV2RawLzf(PSSMHANDLE pSSM, void *pvDst, size_t cbDecompr)
     int         rc;
     uint32_t    cbCompr    = pSSM->u.Read.cbRecLeft;
     pSSM->u.Read.cbRecLeft = 0;
+    RTZIPTYPE const enmType  = (pSSM->u.Read.u8TypeAndFlags & SSM_REC_TYPE_MASK) == SSM_REC_TYPE_RAW_ZLIB
+                             ? RTZIPTYPE_ZLIB : RTZIPTYPE_LZF;
+    uint64_t const offCompr  = ssmR3StrmTell(&pSSM->Strm);
 
     /*
      * Try use the stream buffer directly to avoid copying things around.
@@ -6075,16 +6913,36 @@ static int ssmR3DataReadV2RawLzf(PSSMHANDLE pSSM, void *pvDst, size_t cbDecompr)
     }
 
     /*
-     * Decompress it.
+     * Pick up the result if a worker thread has decompressed it already,
+     * otherwise decompress it here.  Then queue up what follows it.
      */
-    size_t cbDstActual;
-    rc = RTZipBlockDecompress(RTZIPTYPE_LZF, 0 /*fFlags*/,
-                              pb, cbCompr, NULL /*pcbSrcActual*/,
-                              pvDst, cbDecompr, &cbDstActual);
-    if (RT_SUCCESS(rc))
+    PSSMZIP    pZip = pSSM->Strm.pZip;
+    PSSMZIPJOB pJob = pZip ? ssmR3ZipReadLookup(pZip, offCompr, enmType, cbCompr, (uint32_t)cbDecompr) : NULL;
+    if (pJob)
     {
-        AssertLogRelMsgReturn(cbDstActual == cbDecompr, ("%#x %#x\n", cbDstActual, cbDecompr), pSSM->rc = VERR_SSM_INTEGRITY_DECOMPRESSION);
-        return VINF_SUCCESS;
+        rc = pJob->rc;
+        if (RT_SUCCESS(rc))
+            memcpy(pvDst, pJob->pbOut, cbDecompr);
+        pZip->cRetired++;
+        if (RT_SUCCESS(rc))
+        {
+            ssmR3ZipReadAhead(&pSSM->Strm);
+            return VINF_SUCCESS;
+        }
+    }
+    else
+    {
+        size_t cbDstActual;
+        rc = RTZipBlockDecompress(enmType, 0 /*fFlags*/,
+                                  pb, cbCompr, NULL /*pcbSrcActual*/,
+                                  pvDst, cbDecompr, &cbDstActual);
+        if (RT_SUCCESS(rc))
+        {
+            AssertLogRelMsgReturn(cbDstActual == cbDecompr, ("%#x %#x\n", cbDstActual, cbDecompr), pSSM->rc = VERR_SSM_INTEGRITY_DECOMPRESSION);
+            if (pZip)
+                ssmR3ZipReadAhead(&pSSM->Strm);
+            return VINF_SUCCESS;
+        }
     }
 
     AssertLogRelMsgFailed(("cbCompr=%#x cbDecompr=%#x rc=%Rrc\n", cbCompr, cbDecompr, rc));
@@ -6351,6 +7209,7 @@ static int ssmR3DataReadUnbufferedV2(PSSMHANDLE pSSM, void *pvBuf, size_t cbBuf)
             }
 
             case SSM_REC_TYPE_RAW_LZF:
+            case SSM_REC_TYPE_RAW_ZLIB:
             {
                 int rc = ssmR3DataReadV2RawLzfHdr(pSSM, &cbToRead);
                 if (RT_FAILURE(rc))
@@ -6474,6 +7333,7 @@ static int ssmR3DataReadBufferedV2(PSSMHANDLE pSSM, void *pvBuf, size_t cbBuf)
             }
 
             case SSM_REC_TYPE_RAW_LZF:
+            case SSM_REC_TYPE_RAW_ZLIB:
             {
                 int rc = ssmR3DataReadV2RawLzfHdr(pSSM, &cbToRead);
                 if (RT_FAILURE(rc))
@@ -7546,6 +8406,63 @@ VMMR3DECL(int) SSMR3SkipToEndOfUnit(PSSMHANDLE pSSM)
 }
 
 
+#ifndef SSM_STANDALONE
+/**
+ * Skips to the end of the current data unit by seeking rather than reading.
+ *
+ * This is for units ending with a large amount of data saved by
+ * SSMR3PutMemUncompressed, which the caller gets at some other way.  The unit
+ * must not contain anything but the items from @a offStream and up.  Since the
+ * skipped bytes are not checksummed, the stream CRC is not checked for the
+ * remainder of the load.
+ *
+ * @returns VBox status code.
+ * @param   pSSM                The saved state handle.
+ * @param   offStream           The stream offset following the last item of
+ *                              the unit, i.e. where its termination record
+ *                              starts.
+ */
+VMMR3DECL(int) SSMR3SkipToEndOfUnitAt(PSSMHANDLE pSSM, uint64_t offStream)
+{
+    SSM_ASSERT_READABLE_RET(pSSM);
+    SSM_CHECK_CANCELLED_RET(pSSM);
+    AssertReturn(pSSM->enmOp == SSMSTATE_LOAD_EXEC, VERR_SSM_INVALID_STATE);
+    AssertReturn(pSSM->u.Read.uFmtVerMajor >= 2, VERR_NOT_SUPPORTED);
+    AssertReturn(ssmR3StrmIsFile(&pSSM->Strm), VERR_NOT_SUPPORTED);
+    AssertReturn(!pSSM->u.Read.fEndOfData, VERR_SSM_LOADED_TOO_MUCH);
+    AssertReturn(   pSSM->u.Read.cbRecLeft == 0
+                 && pSSM->u.Read.offDataBuffer == pSSM->u.Read.cbDataBuffer, VERR_WRONG_ORDER);
+
+    uint64_t const offCur = ssmR3StrmTell(&pSSM->Strm);
+    AssertLogRelMsgReturn(offStream >= offCur && offStream <= pSSM->u.Read.cbLoadFile - sizeof(SSMFILEFTR),
+                          ("offStream=%#llx offCur=%#llx cbLoadFile=%#llx\n", offStream, offCur, pSSM->u.Read.cbLoadFile),
+                          pSSM->rc = VERR_SSM_SKIP_BACKWARDS);
+    if (offStream == offCur)
+        return VINF_SUCCESS;
+
+    /*
+     * The read-ahead thread has to be stopped for the seek.
+     */
+    LogRel(("SSM: Skipping %#llx bytes of unit '%s' (stream CRC not checked for the rest of the load)\n",
+            offStream - offCur, pSSM->u.Read.pCurUnit ? pSSM->u.Read.pCurUnit->szName : "?"));
+    bool const fIoThread = pSSM->Strm.hIoThread != NIL_RTTHREAD;
+    ssmR3StrmStopIoThread(&pSSM->Strm);
+    ssmR3StrmDisableChecksumming(&pSSM->Strm);
+    int rc = ssmR3StrmSeek(&pSSM->Strm, offStream, RTFILE_SEEK_BEGIN, 0 /*u32CurCRC*/);
+    if (fIoThread)
+        ssmR3StrmStartIoThread(&pSSM->Strm);
+    if (RT_FAILURE(rc))
+        return pSSM->rc = rc;
+
+    pSSM->u.Read.cbDataBuffer  = 0;
+    pSSM->u.Read.offDataBuffer = 0;
+    pSSM->offUnit             += offStream - offCur;
+    ssmR3ProgressByByte(pSSM, offStream - offCur);
+    return VINF_SUCCESS;
+}
+#endif /* !SSM_STANDALONE */
+
+
 /**
  * Calculate the checksum of a file portion.
  *
@@ -8038,6 +8955,7 @@ static int ssmR3OpenFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
     pSSM->uPercentDone          = 2;
     pSSM->uReportedLivePercent  = 0;
     pSSM->pszFilename           = pszFilename;
+    pSSM->nsStart               = RTTimeNanoTS();
 
     pSSM->u.Read.pZipDecompV1   = NULL;
     pSSM->u.Read.uFmtVerMajor   = UINT32_MAX;
@@ -8078,7 +8996,16 @@ static int ssmR3OpenFile(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
     {
         rc = ssmR3HeaderAndValidate(pSSM, fChecksumIt, fChecksumOnRead);
         if (RT_SUCCESS(rc))
+        {
+#ifndef SSM_STANDALONE
+            /* Decompress ahead on worker threads if configured to (optional). */
+            if (   pVM
+                && pVM->ssm.s.cZipThreads
+                && pSSM->u.Read.uFmtVerMajor >= 2)
+                ssmR3ZipCreate(&pSSM->Strm, pVM->ssm.s.cZipThreads, RTZIPTYPE_INVALID);
+#endif
             return rc;
+        }
 
         /* failure path */
         ssmR3StrmClose(&pSSM->Strm, pSSM->rc == VERR_SSM_CANCELLED);
@@ -8554,6 +9481,9 @@ static int ssmR3LoadDirectoryAndFooter(PSSMHANDLE pSSM)
     rc = ssmR3StrmRead(&pSSM->Strm, &Footer, sizeof(Footer));
     if (RT_FAILURE(rc))
         return rc;
+    if (    pSSM->u.Read.fStreamCrc32
+        &&  !pSSM->Strm.fChecksummed)
+        u32StreamCRC = Footer.u32StreamCRC; /* SSMR3SkipToEndOfUnitAt */
     return ssmR3ValidateFooter(&Footer, off, DirHdr.cEntries, pSSM->u.Read.fStreamCrc32, u32StreamCRC);
 }
 
@@ -8954,6 +9884,8 @@ VMMR3DECL(int) SSMR3Load(PVM pVM, const char *pszFilename, PCSSMSTRMOPS pStreamO
             pfnProgress(pVM->pUVM, 99, pvProgressUser);
 
         ssmR3SetCancellable(pVM, &Handle, false);
+        if (RT_SUCCESS(Handle.rc))
+            ssmR3UpdateThroughput(&Handle, true /*fFinal*/);
         ssmR3StrmClose(&Handle.Strm, Handle.rc == VERR_SSM_CANCELLED);
         rc = Handle.rc;
     }
@@ -9042,9 +9974,11 @@ VMMR3DECL(int) SSMR3SetLoadErrorV(PSSMHANDLE pSSM, int rc, RT_SRC_POS_DECL, cons
     else if (pSSM->enmOp == SSMSTATE_LOAD_DONE)
         rc = VMSetError(pSSM->pVM, rc, RT_SRC_POS_ARGS, N_("%s#%u: %s [done]"),
                         pszName, uInstance, pszMsg);
-    else if (pSSM->enmOp == SSMSTATE_OPEN_READ)
+    else if (pSSM->enmOp == SSMSTATE_OPEN_READ && pSSM->pVM)
         rc = VMSetError(pSSM->pVM, rc, RT_SRC_POS_ARGS, N_("%s#%u: %s [read]"),
                         pszName, uInstance, pszMsg);
+    else if (pSSM->enmOp == SSMSTATE_OPEN_READ)
+        LogRel(("SSM: %s: %s#%u: %s [read] rc=%Rrc\n", pSSM->pszFilename, pszName, uInstance, pszMsg, rc)); /* SSMR3Open, no VM. */
     else
         AssertFailed();
     pSSM->u.Read.fHaveSetError = true;
@@ -9432,6 +10366,122 @@ VMMR3DECL(int) SSMR3Seek(PSSMHANDLE pSSM, const char *pszUnit, uint32_t iInstanc
 }
 
 
+#ifndef SSM_STANDALONE
+/**
+ * Enumerates all the passes of a data unit.
+ *
+ * Unlike SSMR3Seek, which only finds the final pass via the directory, this
+ * walks the whole stream so the data of the live passes can be read as well.
+ * The callback is invoked once for each pass of the unit, in stream order,
+ * and it doesn't have to consume all the data.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_SSM_UNIT_NOT_FOUND if the unit+instance wasn't found.
+ * @retval  VERR_NOT_SUPPORTED for version 1 saved state files.
+ *
+ * @param   pSSM            The SSM handle returned by SSMR3Open().
+ * @param   pszUnit         The name of the data unit.
+ * @param   iInstance       The instance number.
+ * @param   pfnCallback     The callback.
+ * @param   pvUser          The user argument for the callback.
+ *
+ * @thread  Any, but the caller is responsible for serializing calls per handle.
+ */
+VMMR3DECL(int) SSMR3EnumUnitPasses(PSSMHANDLE pSSM, const char *pszUnit, uint32_t iInstance,
+                                   PFNSSMENUMUNITPASS pfnCallback, void *pvUser)
+{
+    LogFlow(("SSMR3EnumUnitPasses: pSSM=%p pszUnit=%p:{%s} iInstance=%RU32 pfnCallback=%p pvUser=%p\n",
+             pSSM, pszUnit, pszUnit, iInstance, pfnCallback, pvUser));
+
+    /*
+     * Validate input.
+     */
+    AssertPtrReturn(pSSM, VERR_INVALID_PARAMETER);
+    AssertMsgReturn(pSSM->enmAfter == SSMAFTER_OPENED, ("%d\n", pSSM->enmAfter),VERR_INVALID_PARAMETER);
+    AssertMsgReturn(pSSM->enmOp == SSMSTATE_OPEN_READ, ("%d\n", pSSM->enmOp), VERR_INVALID_PARAMETER);
+    AssertPtrReturn(pszUnit, VERR_INVALID_POINTER);
+    AssertPtrReturn(pfnCallback, VERR_INVALID_POINTER);
+    if (pSSM->u.Read.uFmtVerMajor < 2)
+        return VERR_NOT_SUPPORTED;
+
+    /*
+     * Reset the state and walk the units from the start of the stream.
+     */
+    pSSM->offUnit     = UINT64_MAX;
+    pSSM->offUnitUser = UINT64_MAX;
+    pSSM->rc          = VINF_SUCCESS;
+
+    size_t const    cbUnitNm = strlen(pszUnit) + 1;
+    bool            fFound   = false;
+    uint64_t        offUnit  = pSSM->u.Read.cbFileHdr;
+    int             rc;
+    for (;;)
+    {
+        /*
+         * Read and validate the unit header, then position the stream after it.
+         */
+        SSMFILEUNITHDRV2 UnitHdr;
+        rc = ssmR3StrmPeekAt(&pSSM->Strm, offUnit, &UnitHdr, RT_OFFSETOF(SSMFILEUNITHDRV2, szName), NULL);
+        if (RT_FAILURE(rc))
+            break;
+        if (!memcmp(&UnitHdr.szMagic[0], SSMFILEUNITHDR_END, sizeof(UnitHdr.szMagic)))
+            break;
+        AssertLogRelMsgBreakStmt(   !memcmp(&UnitHdr.szMagic[0], SSMFILEUNITHDR_MAGIC, sizeof(UnitHdr.szMagic))
+                                 && UnitHdr.cbName > 1
+                                 && UnitHdr.cbName <= sizeof(UnitHdr.szName)
+                                 && UnitHdr.offStream == offUnit,
+                                 ("Unit at %#llx (%lld): Bad unit header\n", offUnit, offUnit),
+                                 rc = VERR_SSM_INTEGRITY_UNIT);
+        uint32_t const cbUnitHdr = RT_UOFFSETOF(SSMFILEUNITHDRV2, szName[UnitHdr.cbName]);
+        rc = ssmR3StrmPeekAt(&pSSM->Strm, offUnit, &UnitHdr, cbUnitHdr, NULL);
+        if (RT_FAILURE(rc))
+            break;
+        SSM_CHECK_CRC32_RET(&UnitHdr, cbUnitHdr,
+                            ("Unit at %#llx (%lld): CRC mismatch: %08x, correct is %08x\n", offUnit, offUnit, u32CRC, u32ActualCRC));
+
+        rc = ssmR3StrmSeek(&pSSM->Strm, offUnit + cbUnitHdr, RTFILE_SEEK_BEGIN,
+                           RTCrc32Process(UnitHdr.u32CurStreamCRC, &UnitHdr, cbUnitHdr));
+        AssertLogRelRCBreak(rc);
+        ssmR3DataReadBeginV2(pSSM);
+
+        /*
+         * Give matching units to the callback and skip past the rest.
+         */
+        if (   UnitHdr.u32Instance == iInstance
+            && UnitHdr.cbName == cbUnitNm
+            && !memcmp(UnitHdr.szName, pszUnit, cbUnitNm))
+        {
+            fFound = true;
+            pSSM->u.Read.uCurUnitVer  = UnitHdr.u32Version;
+            pSSM->u.Read.uCurUnitPass = UnitHdr.u32Pass;
+            rc = pfnCallback(pSSM, UnitHdr.u32Version, UnitHdr.u32Pass, pvUser);
+            if (RT_FAILURE(rc))
+                break;
+            rc = pSSM->rc;
+            if (RT_FAILURE(rc))
+                break;
+        }
+        rc = SSMR3SkipToEndOfUnit(pSSM);
+        if (RT_SUCCESS(rc))
+            rc = ssmR3DataReadFinishV2(pSSM);
+        if (RT_FAILURE(rc))
+            break;
+        offUnit = ssmR3StrmTell(&pSSM->Strm);
+    }
+
+    pSSM->offUnit     = UINT64_MAX;
+    pSSM->offUnitUser = UINT64_MAX;
+    pSSM->u.Read.uCurUnitVer  = UINT32_MAX;
+    pSSM->u.Read.uCurUnitPass = 0;
+    if (RT_FAILURE(rc))
+        pSSM->rc = rc;
+    else if (!fFound)
+        rc = VERR_SSM_UNIT_NOT_FOUND;
+    return rc;
+}
+#endif /* !SSM_STANDALONE */
+
+
 
 /* ... Misc APIs ... */
 /* ... Misc APIs ... */
@@ -9623,6 +10673,20 @@ VMMR3DECL(const char *) SSMR3HandleHostOSAndArch(PSSMHANDLE pSSM)
 }
 
 
+/**
+ * Gets the name of the saved state file.
+ *
+ * @returns Pointer to a read only string, NULL if a stream is being used
+ *          instead of a file (teleportation).
+ * @param   pSSM            The saved state handle.
+ */
+VMMR3DECL(const char *) SSMR3HandleGetFilename(PSSMHANDLE pSSM)
+{
+    SSM_ASSERT_VALID_HANDLE(pSSM);
+    return pSSM->pszFilename;
+}
+
+
 #ifndef SSM_STANDALONE
 /**
  * Asynchronously cancels the current SSM operation ASAP.
@@ -23,6 +23,12 @@
  * STAMR3DumpU, STAMR3DumpToReleaseLogU and the debugger.  Main is exposing the
  * XML based one, STAMR3SnapshotU.
  *
+ * For frequent polling there is a binary snapshot API (STAMR3SnapshotBinCreate
+ * and friends) which resolves the pattern once, hands out a name table and
+ * then only value vectors, optionally just the values that changed.  The same
+ * data can be exported to a file (STAMR3ExportStart, /STAM/ExportFile) that
+ * monitor processes can read without involving the VM process.
+ *
  * The rest of the VMM together with the devices and drivers registers their
  * statistics with STAM giving them a name.  The name is hierarchical, the
  * components separated by slashes ('/') and must start with a slash.
@@ -51,6 +57,8 @@
 #define LOG_GROUP LOG_GROUP_STAM
 #include <VBox/vmm/stam.h>
 #include "STAMInternal.h"
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/mm.h>
 #include <VBox/vmm/vm.h>
 #include <VBox/vmm/uvm.h>
 #include <VBox/err.h>
@@ -59,9 +67,14 @@
 
 #include <iprt/assert.h>
 #include <iprt/asm.h>
+#include <iprt/file.h>
 #include <iprt/mem.h>
+#include <iprt/process.h>
+#include <iprt/semaphore.h>
 #include <iprt/stream.h>
 #include <iprt/string.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
 
 
 /*********************************************************************************************************************************
@@ -70,6 +83,11 @@
 /** The maximum name length excluding the terminator. */
 #define STAM_MAX_NAME_LEN   239
 
+/** STAMBINSNAP::u32Magic value (Grace Brewster Murray Hopper). */
+#define STAMBINSNAP_MAGIC   UINT32_C(0x19061209)
+/** The default export update interval in milliseconds. */
+#define STAM_EXPORT_DEFAULT_INTERVAL    1000
+
 
 /*********************************************************************************************************************************
 *   Structures and Typedefs                                                                                                      *
@@ -119,6 +137,82 @@ typedef struct STAMR3SNAPSHOTONE
 } STAMR3SNAPSHOTONE, *PSTAMR3SNAPSHOTONE;
 
 
+/**
+ * Binary snapshot instance data (the handle).
+ *
+ * The handle must only be used by one thread at the time.
+ */
+typedef struct STAMBINSNAP
+{
+    /** Magic value (STAMBINSNAP_MAGIC). */
+    uint32_t            u32Magic;
+    /** The STAM registration generation the sample table was resolved for. */
+    uint32_t            uGeneration;
+    /** Pointer to the user mode VM structure. */
+    PUVM                pUVM;
+    /** The split pattern, NULL if all samples are selected. */
+    char              **papszExpressions;
+    /** The pattern copy papszExpressions points into. */
+    char               *pszPatCopy;
+    /** The number of expressions in papszExpressions. */
+    unsigned            cExpressions;
+    /** Whether we need to update the GVMM statistics copy before collecting. */
+    bool                fGVMM;
+    /** Whether we need to update the GMM statistics copy before collecting. */
+    bool                fGMM;
+    /** Whether pau64Prev holds the values of the previous collection. */
+    bool                fHavePrev;
+    /** The number of selected samples. */
+    uint32_t            cSamples;
+    /** The number of values in a full value vector. */
+    uint32_t            cValues;
+    /** The selected samples (cSamples). */
+    PSTAMDESC          *papDescs;
+    /** The allocation backing pau64Cur and pau64Prev. */
+    uint64_t           *pau64Values;
+    /** The values of the current collection (cValues). */
+    uint64_t           *pau64Cur;
+    /** The values of the previous collection (cValues). */
+    uint64_t           *pau64Prev;
+    /** The name table (STAMBINNAMES). */
+    PSTAMBINNAMES       pNames;
+    /** The value vector returned by STAMR3SnapshotBinCollect (STAMBINVALUES). */
+    PSTAMBINVALUES      pValues;
+    /** The size of the pValues allocation. */
+    size_t              cbValuesMax;
+    /** The collection sequence number. */
+    uint64_t            uSeqNo;
+} STAMBINSNAP;
+
+
+/**
+ * The export file state.
+ */
+typedef struct STAMEXPORT
+{
+    /** The binary snapshot we export. */
+    PSTAMBINSNAP        hSnap;
+    /** The export file. */
+    RTFILE              hFile;
+    /** The export thread. */
+    RTTHREAD            hThread;
+    /** Event semaphore for waking up the export thread. */
+    RTSEMEVENT          hEvt;
+    /** Set when the export thread should stop. */
+    bool volatile       fShutdown;
+    /** The update interval in milliseconds. */
+    uint32_t            cMsInterval;
+    /** The name table generation written to the file, UINT32_MAX if none. */
+    uint32_t            uGenerationWritten;
+    /** The file header copy. */
+    STAMEXPORTHDR       Hdr;
+    /** The export file name. */
+    char                szFilename[1];
+} STAMEXPORT;
+/** Pointer to the export file state. */
+typedef STAMEXPORT *PSTAMEXPORT;
+
+
 /**
  * Init record for a ring-0 statistic sample.
  */
@@ -159,6 +253,7 @@ static int                  stamR3EnumU(PUVM pUVM, const char *pszPat, bool fUpd
 static void                 stamR3Ring0StatsRegisterU(PUVM pUVM);
 static void                 stamR3Ring0StatsUpdateU(PUVM pUVM, const char *pszPat);
 static void                 stamR3Ring0StatsUpdateMultiU(PUVM pUVM, const char * const *papszExpressions, unsigned cExpressions);
+static void                 stamR3Ring0StatsUpdateEx(PUVM pUVM, bool fGVMM, bool fGMM);
 
 #ifdef VBOX_WITH_DEBUGGER
 static FNDBGCCMD            stamR3CmdStats;
@@ -1431,6 +1526,7 @@ static int stamR3RegisterU(PUVM pUVM, void *pvSample, PFNSTAMR3CALLBACKRESET pfn
 #endif
 
         stamR3ResetOne(pNew, pUVM->pVM);
+        ASMAtomicIncU32(&pUVM->stam.s.uGeneration);
         rc = VINF_SUCCESS;
     }
     else
@@ -1457,6 +1553,7 @@ static int stamR3DestroyDesc(PUVM pUVM, PSTAMDESC pCur)
     stamR3LookupMaybeFree(pCur->pLookup);
 #endif
     RTMemFree(pCur);
+    ASMAtomicIncU32(&pUVM->stam.s.uGeneration);
 
     return VINF_SUCCESS;
 }
@@ -2653,21 +2750,47 @@ static void stamR3Ring0StatsUpdateMultiU(PUVM pUVM, const char * const *papszExp
     if (!pVM || !pVM->pSession)
         return;
 
-    /*
-     * GVMM
-     */
-    bool fUpdate = false;
+    bool fGVMM = false;
     for (unsigned i = 0; i < RT_ELEMENTS(g_aGVMMStats); i++)
         if (stamR3MultiMatch(papszExpressions, cExpressions, NULL, g_aGVMMStats[i].pszName))
         {
-            fUpdate = true;
+            fGVMM = true;
             break;
         }
-    if (!fUpdate)
+    if (!fGVMM)
     {
         /** @todo check the cpu leaves - rainy day. */
     }
-    if (fUpdate)
+
+    bool fGMM = false;
+    for (unsigned i = 0; i < RT_ELEMENTS(g_aGMMStats); i++)
+        if (stamR3MultiMatch(papszExpressions, cExpressions, NULL, g_aGMMStats[i].pszName))
+        {
+            fGMM = true;
+            break;
+        }
+
+    stamR3Ring0StatsUpdateEx(pUVM, fGVMM, fGMM);
+}
+
+
+/**
+ * Updates the selected ring-0 statistics.
+ *
+ * @param   pUVM        Pointer to the user mode VM structure.
+ * @param   fGVMM       Whether to update the GVMM statistics.
+ * @param   fGMM        Whether to update the GMM statistics.
+ */
+static void stamR3Ring0StatsUpdateEx(PUVM pUVM, bool fGVMM, bool fGMM)
+{
+    PVM pVM = pUVM->pVM;
+    if (!pVM || !pVM->pSession)
+        return;
+
+    /*
+     * GVMM
+     */
+    if (fGVMM)
     {
         GVMMQUERYSTATISTICSSREQ Req;
         Req.Hdr.cbReq = sizeof(Req);
@@ -2720,14 +2843,7 @@ static void stamR3Ring0StatsUpdateMultiU(PUVM pUVM, const char * const *papszExp
     /*
      * GMM
      */
-    fUpdate = false;
-    for (unsigned i = 0; i < RT_ELEMENTS(g_aGMMStats); i++)
-        if (stamR3MultiMatch(papszExpressions, cExpressions, NULL, g_aGMMStats[i].pszName))
-        {
-            fUpdate = true;
-            break;
-        }
-    if (fUpdate)
+    if (fGMM)
     {
         GMMQUERYSTATISTICSSREQ Req;
         Req.Hdr.cbReq    = sizeof(Req);
@@ -2740,6 +2856,699 @@ static void stamR3Ring0StatsUpdateMultiU(PUVM pUVM, const char * const *papszExp
 }
 
 
+/**
+ * Gets the number of binary snapshot values a sample contributes.
+ *
+ * @returns Number of values.
+ * @param   enmType     The sample type.
+ */
+static uint8_t stamR3SnapBinValueCount(STAMTYPE enmType)
+{
+    switch (enmType)
+    {
+        case STAMTYPE_PROFILE:
+        case STAMTYPE_PROFILE_ADV:
+            return 4;
+        case STAMTYPE_RATIO_U32:
+        case STAMTYPE_RATIO_U32_RESET:
+            return 2;
+        case STAMTYPE_CALLBACK:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+
+/**
+ * Reads the values of a sample into a binary snapshot value vector.
+ *
+ * @returns Number of values stored.
+ * @param   pDesc       The sample.
+ * @param   pau64       Where to store the values.
+ */
+static uint8_t stamR3SnapBinReadSample(PSTAMDESC pDesc, uint64_t *pau64)
+{
+    switch (pDesc->enmType)
+    {
+        case STAMTYPE_COUNTER:
+            pau64[0] = pDesc->u.pCounter->c;
+            return 1;
+
+        case STAMTYPE_PROFILE:
+        case STAMTYPE_PROFILE_ADV:
+            pau64[0] = pDesc->u.pProfile->cPeriods;
+            pau64[1] = pDesc->u.pProfile->cTicks;
+            pau64[2] = pDesc->u.pProfile->cTicksMin;
+            pau64[3] = pDesc->u.pProfile->cTicksMax;
+            return 4;
+
+        case STAMTYPE_RATIO_U32:
+        case STAMTYPE_RATIO_U32_RESET:
+            pau64[0] = pDesc->u.pRatioU32->u32A;
+            pau64[1] = pDesc->u.pRatioU32->u32B;
+            return 2;
+
+        case STAMTYPE_CALLBACK:
+            return 0;
+
+        case STAMTYPE_U8:
+        case STAMTYPE_U8_RESET:
+        case STAMTYPE_X8:
+        case STAMTYPE_X8_RESET:
+            pau64[0] = *pDesc->u.pu8;
+            return 1;
+
+        case STAMTYPE_U16:
+        case STAMTYPE_U16_RESET:
+        case STAMTYPE_X16:
+        case STAMTYPE_X16_RESET:
+            pau64[0] = *pDesc->u.pu16;
+            return 1;
+
+        case STAMTYPE_U32:
+        case STAMTYPE_U32_RESET:
+        case STAMTYPE_X32:
+        case STAMTYPE_X32_RESET:
+            pau64[0] = *pDesc->u.pu32;
+            return 1;
+
+        case STAMTYPE_U64:
+        case STAMTYPE_U64_RESET:
+        case STAMTYPE_X64:
+        case STAMTYPE_X64_RESET:
+            pau64[0] = *pDesc->u.pu64;
+            return 1;
+
+        case STAMTYPE_BOOL:
+        case STAMTYPE_BOOL_RESET:
+            pau64[0] = *pDesc->u.pf;
+            return 1;
+
+        default:
+            AssertMsgFailed(("%d\n", pDesc->enmType));
+            pau64[0] = 0;
+            return 1;
+    }
+}
+
+
+/**
+ * Checks whether a sample is selected by a binary snapshot.
+ *
+ * @returns true if selected, false if not.
+ * @param   pSnap       The binary snapshot.
+ * @param   pDesc       The sample.
+ */
+DECLINLINE(bool) stamR3SnapBinIsSelected(PSTAMBINSNAP pSnap, PSTAMDESC pDesc)
+{
+    return !pSnap->papszExpressions
+        || stamR3MultiMatch(pSnap->papszExpressions, pSnap->cExpressions, NULL, pDesc->pszName);
+}
+
+
+/**
+ * Resolves the pattern of a binary snapshot into a sample table and builds the
+ * name table.
+ *
+ * This is where all the pattern matching happens, the collecting only does it
+ * again when samples have been registered or deregistered.
+ *
+ * @returns VBox status code.
+ * @param   pSnap       The binary snapshot.
+ *
+ * @remarks Caller must own the STAM read lock.
+ */
+static int stamR3SnapBinResolve(PSTAMBINSNAP pSnap)
+{
+    PUVM        pUVM = pSnap->pUVM;
+    PSTAMDESC   pCur;
+
+    /*
+     * Size it up.
+     */
+    uint32_t const uGeneration = ASMAtomicReadU32(&pUVM->stam.s.uGeneration);
+    uint32_t cSamples  = 0;
+    uint32_t cValues   = 0;
+    size_t   cbStrings = 0;
+    RTListForEach(&pUVM->stam.s.List, pCur, STAMDESC, ListEntry)
+    {
+        if (stamR3SnapBinIsSelected(pSnap, pCur))
+        {
+            cSamples++;
+            cValues   += stamR3SnapBinValueCount(pCur->enmType);
+            cbStrings += strlen(pCur->pszName) + 1;
+        }
+    }
+
+    /*
+     * Allocate the new tables.
+     */
+    uint32_t const offStrings  = sizeof(STAMBINNAMES) + cSamples * sizeof(STAMBINNAME);
+    size_t const   cbNames     = offStrings + cbStrings;
+    size_t const   cbValuesMax = sizeof(STAMBINVALUES) + RT_ALIGN_32(cValues, 64) / 8 + cValues * sizeof(uint64_t);
+    AssertReturn(cbNames < _256M, VERR_OUT_OF_RANGE);
+
+    PSTAMDESC     *papDescs = (PSTAMDESC *)RTMemAlloc(RT_MAX(cSamples, 1) * sizeof(PSTAMDESC));
+    uint64_t      *pau64    = (uint64_t *)RTMemAllocZ(RT_MAX(cValues, 1) * 2 * sizeof(uint64_t));
+    PSTAMBINNAMES  pNames   = (PSTAMBINNAMES)RTMemAlloc(cbNames);
+    PSTAMBINVALUES pValues  = (PSTAMBINVALUES)RTMemAlloc(cbValuesMax);
+    if (!papDescs || !pau64 || !pNames || !pValues)
+    {
+        RTMemFree(papDescs);
+        RTMemFree(pau64);
+        RTMemFree(pNames);
+        RTMemFree(pValues);
+        return VERR_NO_MEMORY;
+    }
+
+    /*
+     * Fill them in.
+     */
+    pNames->u32Magic    = STAMBINNAMES_MAGIC;
+    pNames->uGeneration = uGeneration;
+    pNames->cSamples    = cSamples;
+    pNames->cValues     = cValues;
+    pNames->offStrings  = offStrings;
+    pNames->cbTotal     = (uint32_t)cbNames;
+
+    PSTAMBINNAME pEntry   = (PSTAMBINNAME)(pNames + 1);
+    char        *pszDst   = (char *)pNames + offStrings;
+    uint32_t     iSample  = 0;
+    uint32_t     idxValue = 0;
+    bool         fGVMM    = false;
+    bool         fGMM     = false;
+    RTListForEach(&pUVM->stam.s.List, pCur, STAMDESC, ListEntry)
+    {
+        if (stamR3SnapBinIsSelected(pSnap, pCur))
+        {
+            size_t const cbName = strlen(pCur->pszName) + 1;
+            pEntry->offName       = (uint32_t)(pszDst - ((char *)pNames + offStrings));
+            pEntry->idxValue      = idxValue;
+            pEntry->enmType       = (uint8_t)pCur->enmType;
+            pEntry->enmUnit       = (uint8_t)pCur->enmUnit;
+            pEntry->enmVisibility = (uint8_t)pCur->enmVisibility;
+            pEntry->cValues       = stamR3SnapBinValueCount(pCur->enmType);
+            memcpy(pszDst, pCur->pszName, cbName);
+            pszDst   += cbName;
+            idxValue += pEntry->cValues;
+            pEntry++;
+            papDescs[iSample++] = pCur;
+
+            /* The ring-0 statistics copies needs refreshing before we read them. */
+            uintptr_t const uSample = (uintptr_t)pCur->u.pv;
+            if (uSample - (uintptr_t)&pUVM->stam.s.GVMMStats < sizeof(pUVM->stam.s.GVMMStats))
+                fGVMM = true;
+            else if (uSample - (uintptr_t)&pUVM->stam.s.GMMStats < sizeof(pUVM->stam.s.GMMStats))
+                fGMM = true;
+        }
+    }
+    Assert(iSample == cSamples); Assert(idxValue == cValues);
+
+    /* The host CPU statistics are only registered after the first GVMM update. */
+    if (!fGVMM)
+        for (unsigned i = 0; i < RT_ELEMENTS(g_aGVMMStats) && !fGVMM; i++)
+            fGVMM = !pSnap->papszExpressions
+                 || stamR3MultiMatch(pSnap->papszExpressions, pSnap->cExpressions, NULL, g_aGVMMStats[i].pszName);
+
+    /*
+     * Replace the old tables.
+     */
+    RTMemFree(pSnap->papDescs);
+    RTMemFree(pSnap->pau64Values);
+    RTMemFree(pSnap->pNames);
+    RTMemFree(pSnap->pValues);
+    pSnap->uGeneration = uGeneration;
+    pSnap->cSamples    = cSamples;
+    pSnap->cValues     = cValues;
+    pSnap->papDescs    = papDescs;
+    pSnap->pau64Values = pau64;
+    pSnap->pau64Cur    = pau64;
+    pSnap->pau64Prev   = pau64 + RT_MAX(cValues, 1);
+    pSnap->fHavePrev   = false;
+    pSnap->pNames      = pNames;
+    pSnap->pValues     = pValues;
+    pSnap->cbValuesMax = cbValuesMax;
+    pSnap->fGVMM       = fGVMM;
+    pSnap->fGMM        = fGMM;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Creates a binary snapshot handle.
+ *
+ * The pattern is resolved here and only again when samples are registered or
+ * deregistered, so collecting is cheap.  Note that STAMR3SnapshotBinCollect
+ * does not skip unused samples (STAMVISIBILITY_USED) like STAMR3Snapshot does,
+ * the sample set must be stable for the value vectors to make sense.
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ * @param   pszPat          The name matching pattern, NULL or "*" for all.
+ *                          Multiple expressions are separated by '|'.
+ * @param   phSnap          Where to return the handle.  Destroy it using
+ *                          STAMR3SnapshotBinDestroy().
+ */
+VMMR3DECL(int) STAMR3SnapshotBinCreate(PUVM pUVM, const char *pszPat, PSTAMBINSNAP *phSnap)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(phSnap, VERR_INVALID_POINTER);
+    *phSnap = NULL;
+
+    PSTAMBINSNAP pSnap = (PSTAMBINSNAP)RTMemAllocZ(sizeof(*pSnap));
+    if (!pSnap)
+        return VERR_NO_MEMORY;
+    pSnap->u32Magic = STAMBINSNAP_MAGIC;
+    pSnap->pUVM     = pUVM;
+    if (pszPat && *pszPat && strcmp(pszPat, "*"))
+    {
+        pSnap->papszExpressions = stamR3SplitPattern(pszPat, &pSnap->cExpressions, &pSnap->pszPatCopy);
+        if (!pSnap->papszExpressions)
+        {
+            RTMemFree(pSnap);
+            return VERR_NO_MEMORY;
+        }
+    }
+
+    STAM_LOCK_RD(pUVM);
+    int rc = stamR3SnapBinResolve(pSnap);
+    STAM_UNLOCK_RD(pUVM);
+    if (RT_SUCCESS(rc))
+        *phSnap = pSnap;
+    else
+        STAMR3SnapshotBinDestroy(pSnap);
+    return rc;
+}
+
+
+/**
+ * Destroys a binary snapshot handle.
+ *
+ * @returns VBox status code.
+ * @param   hSnap           The handle.  NULL is ignored.
+ */
+VMMR3DECL(int) STAMR3SnapshotBinDestroy(PSTAMBINSNAP hSnap)
+{
+    PSTAMBINSNAP pSnap = hSnap;
+    if (!pSnap)
+        return VINF_SUCCESS;
+    AssertPtrReturn(pSnap, VERR_INVALID_HANDLE);
+    AssertReturn(pSnap->u32Magic == STAMBINSNAP_MAGIC, VERR_INVALID_HANDLE);
+
+    pSnap->u32Magic = ~STAMBINSNAP_MAGIC;
+    if (pSnap->papszExpressions)
+    {
+        RTMemTmpFree(pSnap->papszExpressions);
+        RTStrFree(pSnap->pszPatCopy);
+    }
+    RTMemFree(pSnap->papDescs);
+    RTMemFree(pSnap->pau64Values);
+    RTMemFree(pSnap->pNames);
+    RTMemFree(pSnap->pValues);
+    RTMemFree(pSnap);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Gets the name table of a binary snapshot.
+ *
+ * The name table changes when samples are registered or deregistered.  Check
+ * STAMBINVALUES::uGeneration against STAMBINNAMES::uGeneration after each
+ * collection and get the name table again when they differ.
+ *
+ * @returns VBox status code.
+ * @param   hSnap           The handle.
+ * @param   ppvNames        Where to return the name table (STAMBINNAMES).  This
+ *                          is valid until the next call on the handle.
+ * @param   pcbNames        Where to return the size of the name table.
+ */
+VMMR3DECL(int) STAMR3SnapshotBinGetNames(PSTAMBINSNAP hSnap, void const **ppvNames, size_t *pcbNames)
+{
+    PSTAMBINSNAP pSnap = hSnap;
+    AssertPtrReturn(pSnap, VERR_INVALID_HANDLE);
+    AssertReturn(pSnap->u32Magic == STAMBINSNAP_MAGIC, VERR_INVALID_HANDLE);
+    AssertPtrReturn(ppvNames, VERR_INVALID_POINTER);
+    AssertPtrReturn(pcbNames, VERR_INVALID_POINTER);
+    PUVM pUVM = pSnap->pUVM;
+
+    int rc = VINF_SUCCESS;
+    STAM_LOCK_RD(pUVM);
+    if (pSnap->uGeneration != ASMAtomicReadU32(&pUVM->stam.s.uGeneration))
+        rc = stamR3SnapBinResolve(pSnap);
+    STAM_UNLOCK_RD(pUVM);
+
+    *ppvNames = pSnap->pNames;
+    *pcbNames = pSnap->pNames->cbTotal;
+    return rc;
+}
+
+
+/**
+ * Collects the values of the samples selected by a binary snapshot.
+ *
+ * @returns VBox status code.
+ * @param   hSnap           The handle.
+ * @param   fDelta          Whether to only include the values that changed
+ *                          since the previous collection.  This is ignored for
+ *                          the first collection and the first one after the
+ *                          name table changed, check for STAMBINVALUES_F_DELTA.
+ * @param   ppvValues       Where to return the value vector (STAMBINVALUES).
+ *                          This is valid until the next call on the handle.
+ * @param   pcbValues       Where to return the size of the value vector.
+ */
+VMMR3DECL(int) STAMR3SnapshotBinCollect(PSTAMBINSNAP hSnap, bool fDelta, void const **ppvValues, size_t *pcbValues)
+{
+    PSTAMBINSNAP pSnap = hSnap;
+    AssertPtrReturn(pSnap, VERR_INVALID_HANDLE);
+    AssertReturn(pSnap->u32Magic == STAMBINSNAP_MAGIC, VERR_INVALID_HANDLE);
+    AssertPtrReturn(ppvValues, VERR_INVALID_POINTER);
+    AssertPtrReturn(pcbValues, VERR_INVALID_POINTER);
+    PUVM pUVM = pSnap->pUVM;
+
+    /*
+     * Refresh the ring-0 statistics copies first as this may register samples.
+     */
+    if (pSnap->fGVMM || pSnap->fGMM)
+        stamR3Ring0StatsUpdateEx(pUVM, pSnap->fGVMM, pSnap->fGMM);
+
+    /*
+     * Read the sample values, re-resolving the pattern if necessary.
+     */
+    STAM_LOCK_RD(pUVM);
+    if (pSnap->uGeneration != ASMAtomicReadU32(&pUVM->stam.s.uGeneration))
+    {
+        int rc = stamR3SnapBinResolve(pSnap);
+        if (RT_FAILURE(rc))
+        {
+            STAM_UNLOCK_RD(pUVM);
+            return rc;
+        }
+    }
+
+    uint64_t *pau64Cur = pSnap->pau64Cur;
+    for (uint32_t i = 0; i < pSnap->cSamples; i++)
+        pau64Cur += stamR3SnapBinReadSample(pSnap->papDescs[i], pau64Cur);
+    Assert(pau64Cur == pSnap->pau64Cur + pSnap->cValues);
+    STAM_UNLOCK_RD(pUVM);
+
+    /*
+     * Produce the value vector.
+     */
+    uint32_t const  cValues = pSnap->cValues;
+    PSTAMBINVALUES  pValues = pSnap->pValues;
+    pValues->u32Magic    = STAMBINVALUES_MAGIC;
+    pValues->uGeneration = pSnap->uGeneration;
+    pValues->cValues     = cValues;
+    pValues->uSeqNo      = ++pSnap->uSeqNo;
+    pValues->u64NanoTS   = RTTimeNanoTS();
+
+    pau64Cur = pSnap->pau64Cur;
+    if (fDelta && pSnap->fHavePrev)
+    {
+        uint64_t const *pau64Prev = pSnap->pau64Prev;
+        uint64_t       *pbmDirty  = (uint64_t *)(pValues + 1);
+        uint64_t       *pau64Dst  = pbmDirty + RT_ALIGN_32(cValues, 64) / 64;
+        RT_BZERO(pbmDirty, RT_ALIGN_32(cValues, 64) / 8);
+        for (uint32_t i = 0; i < cValues; i++)
+            if (pau64Cur[i] != pau64Prev[i])
+            {
+                ASMBitSet(pbmDirty, i);
+                *pau64Dst++ = pau64Cur[i];
+            }
+        pValues->fFlags = STAMBINVALUES_F_DELTA;
+        *pcbValues = (uintptr_t)pau64Dst - (uintptr_t)pValues;
+    }
+    else
+    {
+        pValues->fFlags = 0;
+        memcpy(pValues + 1, pau64Cur, cValues * sizeof(uint64_t));
+        *pcbValues = sizeof(*pValues) + cValues * sizeof(uint64_t);
+    }
+    *ppvValues = pValues;
+
+    /* The current values becomes the previous ones. */
+    pSnap->pau64Cur  = pSnap->pau64Prev;
+    pSnap->pau64Prev = pau64Cur;
+    pSnap->fHavePrev = true;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Writes the name table to the export file, making room for the value vector
+ * in front of it.
+ *
+ * @returns VBox status code.
+ * @param   pExport     The export state.
+ *
+ * @remarks The caller has marked the header as being updated.
+ */
+static int stamR3ExportWriteNames(PSTAMEXPORT pExport)
+{
+    void const *pvNames;
+    size_t      cbNames;
+    int rc = STAMR3SnapshotBinGetNames(pExport->hSnap, &pvNames, &cbNames);
+    if (RT_SUCCESS(rc))
+    {
+        PCSTAMBINNAMES pNames = (PCSTAMBINNAMES)pvNames;
+        pExport->Hdr.offValues = RT_ALIGN_32(sizeof(STAMEXPORTHDR), 64);
+        pExport->Hdr.cbValues  = sizeof(STAMBINVALUES) + pNames->cValues * sizeof(uint64_t);
+        pExport->Hdr.offNames  = RT_ALIGN_32(pExport->Hdr.offValues + pExport->Hdr.cbValues, 64);
+        pExport->Hdr.cbNames   = (uint32_t)cbNames;
+        rc = RTFileWriteAt(pExport->hFile, pExport->Hdr.offNames, pvNames, cbNames, NULL);
+        if (RT_SUCCESS(rc))
+            rc = RTFileSetSize(pExport->hFile, pExport->Hdr.offNames + cbNames);
+        if (RT_SUCCESS(rc))
+            pExport->uGenerationWritten = pNames->uGeneration;
+    }
+    return rc;
+}
+
+
+/**
+ * Updates the export file.
+ *
+ * @returns VBox status code.
+ * @param   pExport     The export state.
+ */
+static int stamR3ExportUpdate(PSTAMEXPORT pExport)
+{
+    void const *pvValues;
+    size_t      cbValues;
+    int rc = STAMR3SnapshotBinCollect(pExport->hSnap, false /*fDelta*/, &pvValues, &cbValues);
+    if (RT_FAILURE(rc))
+        return rc;
+    PCSTAMBINVALUES pValues = (PCSTAMBINVALUES)pvValues;
+
+    /* Mark the header as being updated. */
+    pExport->Hdr.uSeq++;
+    Assert(pExport->Hdr.uSeq & 1);
+    rc = RTFileWriteAt(pExport->hFile, 0, &pExport->Hdr, sizeof(pExport->Hdr), NULL);
+
+    if (RT_SUCCESS(rc) && pValues->uGeneration != pExport->uGenerationWritten)
+        rc = stamR3ExportWriteNames(pExport);
+    if (RT_SUCCESS(rc))
+    {
+        Assert(cbValues == pExport->Hdr.cbValues);
+        rc = RTFileWriteAt(pExport->hFile, pExport->Hdr.offValues, pvValues, cbValues, NULL);
+    }
+
+    /* Complete the update. */
+    if (RT_SUCCESS(rc))
+    {
+        RTTIMESPEC Now;
+        pExport->Hdr.i64UnixNano = RTTimeSpecGetNano(RTTimeNow(&Now));
+        pExport->Hdr.uSeq++;
+        rc = RTFileWriteAt(pExport->hFile, 0, &pExport->Hdr, sizeof(pExport->Hdr), NULL);
+    }
+    return rc;
+}
+
+
+/**
+ * @callback_method_impl{FNRTTHREAD, The statistics export thread.}
+ */
+static DECLCALLBACK(int) stamR3ExportThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PSTAMEXPORT pExport = (PSTAMEXPORT)pvUser;
+    int         rc      = VINF_SUCCESS;
+    for (;;)
+    {
+        RTSemEventWait(pExport->hEvt, pExport->cMsInterval);
+        if (ASMAtomicReadBool(&pExport->fShutdown))
+            break;
+        rc = stamR3ExportUpdate(pExport);
+        if (RT_FAILURE(rc))
+        {
+            LogRel(("STAM: Updating the export file '%s' failed: %Rrc - stopped exporting\n", pExport->szFilename, rc));
+            break;
+        }
+    }
+    NOREF(hThreadSelf);
+    return rc;
+}
+
+
+/**
+ * Destroys the export state, the thread must not be running.
+ *
+ * @param   pExport     The export state.
+ */
+static void stamR3ExportDestroy(PSTAMEXPORT pExport)
+{
+    if (pExport->hFile != NIL_RTFILE)
+    {
+        RTFileClose(pExport->hFile);
+        RTFileDelete(pExport->szFilename);
+    }
+    if (pExport->hEvt != NIL_RTSEMEVENT)
+        RTSemEventDestroy(pExport->hEvt);
+    STAMR3SnapshotBinDestroy(pExport->hSnap);
+    RTMemFree(pExport);
+}
+
+
+/**
+ * Starts exporting statistics to a file other processes can read.
+ *
+ * A thread updates the file with a full value vector every @a cMsInterval
+ * milliseconds, see STAMEXPORTHDR for the file format.  The file is deleted
+ * when the export is stopped.
+ *
+ * @returns VBox status code.
+ * @retval  VERR_ALREADY_EXISTS if already exporting.
+ * @param   pUVM            The user mode VM handle.
+ * @param   pszFilename     The export file.  It is replaced if it exists.
+ * @param   pszPat          The name matching pattern, NULL or "*" for all.
+ * @param   cMsInterval     The update interval in milliseconds, 0 for the
+ *                          default (1 second).
+ */
+VMMR3DECL(int) STAMR3ExportStart(PUVM pUVM, const char *pszFilename, const char *pszPat, uint32_t cMsInterval)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    AssertPtrReturn(pszFilename, VERR_INVALID_POINTER);
+    AssertReturn(*pszFilename, VERR_INVALID_PARAMETER);
+    if (!cMsInterval)
+        cMsInterval = STAM_EXPORT_DEFAULT_INTERVAL;
+    AssertReturn(cMsInterval >= 10, VERR_OUT_OF_RANGE);
+    if (pUVM->stam.s.pExport)
+        return VERR_ALREADY_EXISTS;
+
+    size_t const cchFilename = strlen(pszFilename);
+    PSTAMEXPORT  pExport     = (PSTAMEXPORT)RTMemAllocZ(RT_OFFSETOF(STAMEXPORT, szFilename[cchFilename + 1]));
+    if (!pExport)
+        return VERR_NO_MEMORY;
+    pExport->hFile              = NIL_RTFILE;
+    pExport->hThread            = NIL_RTTHREAD;
+    pExport->hEvt               = NIL_RTSEMEVENT;
+    pExport->cMsInterval        = cMsInterval;
+    pExport->uGenerationWritten = UINT32_MAX;
+    memcpy(pExport->szFilename, pszFilename, cchFilename + 1);
+
+    memcpy(pExport->Hdr.szMagic, STAMEXPORTHDR_MAGIC, sizeof(STAMEXPORTHDR_MAGIC));
+    pExport->Hdr.uVersion    = STAMEXPORTHDR_VERSION;
+    pExport->Hdr.cbHdr       = sizeof(pExport->Hdr);
+    pExport->Hdr.cMsInterval = cMsInterval;
+    pExport->Hdr.uPid        = RTProcSelf();
+
+    int rc = STAMR3SnapshotBinCreate(pUVM, pszPat, &pExport->hSnap);
+    if (RT_SUCCESS(rc))
+        rc = RTFileOpen(&pExport->hFile, pszFilename,
+                        RTFILE_O_READWRITE | RTFILE_O_CREATE_REPLACE | RTFILE_O_DENY_NONE
+                        | (0644 << RTFILE_O_CREATE_MODE_SHIFT));
+    if (RT_FAILURE(rc))
+        pExport->hFile = NIL_RTFILE;
+    if (RT_SUCCESS(rc))
+        rc = stamR3ExportUpdate(pExport);
+    if (RT_SUCCESS(rc))
+        rc = RTSemEventCreate(&pExport->hEvt);
+    if (RT_SUCCESS(rc))
+        rc = RTThreadCreate(&pExport->hThread, stamR3ExportThread, pExport, 0, RTTHREADTYPE_INFREQUENT_POLLER,
+                            RTTHREADFLAGS_WAITABLE, "StamExport");
+    if (RT_FAILURE(rc))
+    {
+        LogRel(("STAM: Failed to start exporting statistics to '%s': %Rrc\n", pszFilename, rc));
+        stamR3ExportDestroy(pExport);
+        return rc;
+    }
+
+    pUVM->stam.s.pExport = pExport;
+    LogRel(("STAM: Exporting statistics matching '%s' to '%s' every %u ms\n", pszPat ? pszPat : "*", pszFilename, cMsInterval));
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Stops exporting statistics, deleting the export file.
+ *
+ * @returns VBox status code.
+ * @param   pUVM            The user mode VM handle.
+ */
+VMMR3DECL(int) STAMR3ExportStop(PUVM pUVM)
+{
+    UVM_ASSERT_VALID_EXT_RETURN(pUVM, VERR_INVALID_VM_HANDLE);
+    PSTAMEXPORT pExport = pUVM->stam.s.pExport;
+    if (!pExport)
+        return VINF_SUCCESS;
+    pUVM->stam.s.pExport = NULL;
+
+    ASMAtomicWriteBool(&pExport->fShutdown, true);
+    RTSemEventSignal(pExport->hEvt);
+    int rc = RTThreadWait(pExport->hThread, 30000, NULL);
+    AssertLogRelRCReturn(rc, rc);   /* Leak it rather than pull the rug from under the thread. */
+    stamR3ExportDestroy(pExport);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Called when the VM has been initialized, starts the export configured in
+ * CFGM.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM structure.
+ */
+VMMR3_INT_DECL(int) STAMR3InitCompleted(PVM pVM)
+{
+    PCFGMNODE pStamNode = CFGMR3GetChild(CFGMR3GetRoot(pVM), "STAM");
+
+    /** @cfgm{/STAM/ExportFile, string, none}
+     * Export the statistics to this file, see STAMEXPORTHDR.  Put it on a
+     * memory file system such as /dev/shm. */
+    char *pszFilename;
+    int rc = CFGMR3QueryStringAllocDef(pStamNode, "ExportFile", &pszFilename, NULL);
+    AssertLogRelRCReturn(rc, rc);
+    if (!pszFilename)
+        return VINF_SUCCESS;
+
+    /** @cfgm{/STAM/ExportPattern, string, "*"}
+     * The statistics to export, multiple patterns are separated by '|'. */
+    char *pszPat;
+    rc = CFGMR3QueryStringAllocDef(pStamNode, "ExportPattern", &pszPat, "*");
+    if (RT_SUCCESS(rc))
+    {
+        /** @cfgm{/STAM/ExportInterval, uint32_t, 1000, 10, 3600000, ms}
+         * How often to update the export file. */
+        uint32_t cMsInterval;
+        rc = CFGMR3QueryU32Def(pStamNode, "ExportInterval", &cMsInterval, STAM_EXPORT_DEFAULT_INTERVAL);
+        if (RT_SUCCESS(rc) && (cMsInterval < 10 || cMsInterval > RT_MS_1HOUR))
+            rc = VMSetError(pVM, VERR_OUT_OF_RANGE, RT_SRC_POS,
+                            "/STAM/ExportInterval is out of range: %u ms, expected 10 to 3600000", cMsInterval);
+        else if (RT_SUCCESS(rc))
+        {
+            rc = STAMR3ExportStart(pVM->pUVM, pszFilename, pszPat, cMsInterval);
+            if (RT_FAILURE(rc))
+                rc = VMSetError(pVM, rc, RT_SRC_POS, "Failed to start exporting statistics to '%s': %Rrc", pszFilename, rc);
+        }
+        MMR3HeapFree(pszPat);
+    }
+    MMR3HeapFree(pszFilename);
+    return rc;
+}
+
+
 /**
  * Get the unit string.
  *
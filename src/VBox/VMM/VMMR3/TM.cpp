@@ -1438,6 +1438,7 @@ static int tmr3TimerCreate(PVM pVM, TMCLOCK enmClock, const char *pszDesc, PPTMT
     pTimer->offScheduleNext = 0;
     pTimer->offNext         = 0;
     pTimer->offPrev         = 0;
+    pTimer->offChild        = 0;
     pTimer->pvUser          = NULL;
     pTimer->pCritSect       = NULL;
     pTimer->pszDesc         = pszDesc;
@@ -1747,24 +1748,10 @@ VMMR3DECL(int) TMR3TimerDestroy(PTMTIMER pTimer)
     }
 
     /*
-     * Unlink from the active list.
+     * Unlink from the active heap.
      */
     if (fActive)
-    {
-        const PTMTIMER pPrev = TMTIMER_GET_PREV(pTimer);
-        const PTMTIMER pNext = TMTIMER_GET_NEXT(pTimer);
-        if (pPrev)
-            TMTIMER_SET_NEXT(pPrev, pNext);
-        else
-        {
-            TMTIMER_SET_HEAD(pQueue, pNext);
-            pQueue->u64Expire = pNext ? pNext->u64Expire : INT64_MAX;
-        }
-        if (pNext)
-            TMTIMER_SET_PREV(pNext, pPrev);
-        pTimer->offNext = 0;
-        pTimer->offPrev = 0;
-    }
+        tmTimerQueueHeapRemove(pQueue, pTimer);
 
     /*
      * Unlink from the schedule list by running it.
@@ -1781,7 +1768,7 @@ VMMR3DECL(int) TMR3TimerDestroy(PTMTIMER pTimer)
     /*
      * Read to move the timer from the created list and onto the free list.
      */
-    Assert(!pTimer->offNext); Assert(!pTimer->offPrev); Assert(!pTimer->offScheduleNext);
+    Assert(!pTimer->offNext); Assert(!pTimer->offPrev); Assert(!pTimer->offChild); Assert(!pTimer->offScheduleNext);
 
     /* unlink from created list */
     if (pTimer->pBigPrev)
@@ -2128,39 +2115,37 @@ static void tmR3TimerQueueRun(PVM pVM, PTMTIMERQUEUE pQueue)
      *      However, we only allow EMT to handle EXPIRED_PENDING
      *      timers, thus enabling the timer handler function to
      *      arm the timer again.
-     */
-    PTMTIMER pNext = TMTIMER_GET_HEAD(pQueue);
-    if (!pNext)
+     *
+     * N.B. We always take the current head of the heap since the
+     *      handlers may arm and stop timers.  To make sure a handler
+     *      re-arming its timer in the past can't keep us here forever,
+     *      we don't run more timers than there were to start with.
+     *      If the head is in some pending state it will be dealt with
+     *      by the next scheduling pass, which the thread changing the
+     *      state will have requested, so we leave the rest for then.
+     */
+    PTMTIMER pTimer = TMTIMER_GET_HEAD(pQueue);
+    if (!pTimer)
         return;
     const uint64_t u64Now = tmClock(pVM, pQueue->enmClock);
-    while (pNext && pNext->u64Expire <= u64Now)
+    uint32_t cLeft = pQueue->cActive;
+    while (   pTimer
+           && pTimer->u64Expire <= u64Now
+           && cLeft-- > 0)
     {
-        PTMTIMER        pTimer    = pNext;
-        pNext = TMTIMER_GET_NEXT(pTimer);
         PPDMCRITSECT    pCritSect = pTimer->pCritSect;
         if (pCritSect)
             PDMCritSectEnter(pCritSect, VERR_IGNORED);
         Log2(("tmR3TimerQueueRun: %p:{.enmState=%s, .enmClock=%d, .enmType=%d, u64Expire=%llx (now=%llx) .pszDesc=%s}\n",
               pTimer, tmTimerState(pTimer->enmState), pTimer->enmClock, pTimer->enmType, pTimer->u64Expire, u64Now, pTimer->pszDesc));
-        bool fRc;
-        TM_TRY_SET_STATE(pTimer, TMTIMERSTATE_EXPIRED_GET_UNLINK, TMTIMERSTATE_ACTIVE, fRc);
-        if (fRc)
+        bool fActive;
+        TM_TRY_SET_STATE(pTimer, TMTIMERSTATE_EXPIRED_GET_UNLINK, TMTIMERSTATE_ACTIVE, fActive);
+        if (fActive)
         {
             Assert(!pTimer->offScheduleNext); /* this can trigger falsely */
 
             /* unlink */
-            const PTMTIMER pPrev = TMTIMER_GET_PREV(pTimer);
-            if (pPrev)
-                TMTIMER_SET_NEXT(pPrev, pNext);
-            else
-            {
-                TMTIMER_SET_HEAD(pQueue, pNext);
-                pQueue->u64Expire = pNext ? pNext->u64Expire : INT64_MAX;
-            }
-            if (pNext)
-                TMTIMER_SET_PREV(pNext, pPrev);
-            pTimer->offNext = 0;
-            pTimer->offPrev = 0;
+            tmTimerQueueHeapRemove(pQueue, pTimer);
 
             /* fire */
             TM_SET_STATE(pTimer, TMTIMERSTATE_EXPIRED_DELIVER);
@@ -2177,11 +2162,15 @@ static void tmR3TimerQueueRun(PVM pVM, PTMTIMERQUEUE pQueue)
             }
 
             /* change the state if it wasn't changed already in the handler. */
-            TM_TRY_SET_STATE(pTimer, TMTIMERSTATE_STOPPED, TMTIMERSTATE_EXPIRED_DELIVER, fRc);
+            bool fRc;
+            TM_TRY_SET_STATE(pTimer, TMTIMERSTATE_STOPPED, TMTIMERSTATE_EXPIRED_DELIVER, fRc); NOREF(fRc);
             Log2(("tmR3TimerQueueRun: new state %s\n", tmTimerState(pTimer->enmState)));
         }
         if (pCritSect)
             PDMCritSectLeave(pCritSect);
+        if (!fActive)
+            break;
+        pTimer = TMTIMER_GET_HEAD(pQueue);
     } /* run loop */
 }
 
@@ -2313,15 +2302,20 @@ static void tmR3TimerQueueRunVirtualSync(PVM pVM)
 
     /*
      * Process the expired timers moving the clock along as we progress.
+     *
+     * Like in tmR3TimerQueueRun we take the head of the heap each time and
+     * don't run more timers than there were to start with.
      */
 #ifdef VBOX_STRICT
     uint64_t u64Prev = u64Now; NOREF(u64Prev);
 #endif
-    while (pNext && pNext->u64Expire <= u64Max)
+    uint32_t cLeft = pQueue->cActive;
+    while (   pNext
+           && pNext->u64Expire <= u64Max
+           && cLeft-- > 0)
     {
         /* Advance */
         PTMTIMER pTimer = pNext;
-        pNext = TMTIMER_GET_NEXT(pTimer);
 
         /* Take the associated lock. */
         PPDMCRITSECT pCritSect = pTimer->pCritSect;
@@ -2370,6 +2364,7 @@ static void tmR3TimerQueueRunVirtualSync(PVM pVM)
         /* Leave the associated lock. */
         if (pCritSect)
             PDMCritSectLeave(pCritSect);
+        pNext = TMTIMER_GET_HEAD(pQueue);
     } /* run loop */
 
 
@@ -3313,6 +3308,9 @@ static DECLCALLBACK(void) tmR3TimerInfo(PVM pVM, PCDBGFINFOHLP pHlp, const char
 /**
  * Display all active timers.
  *
+ * The timers of each queue are listed in heap order, the first one is the
+ * next to expire but the rest are not sorted.
+ *
  * @param   pVM         The cross context VM structure.
  * @param   pHlp        The info helpers.
  * @param   pszArgs     Arguments, ignored.
@@ -3337,7 +3335,7 @@ static DECLCALLBACK(void) tmR3TimerInfoActive(PVM pVM, PCDBGFINFOHLP pHlp, const
         TM_LOCK_TIMERS(pVM);
         for (PTMTIMERR3 pTimer = TMTIMER_GET_HEAD(&pVM->tm.s.paTimerQueuesR3[iQueue]);
              pTimer;
-             pTimer = TMTIMER_GET_NEXT(pTimer))
+             pTimer = tmTimerQueueHeapWalkNext(pTimer))
         {
             pHlp->pfnPrintf(pHlp,
                             "%p %08RX32 %08RX32 %08RX32 %s %18RU64 %18RU64 %6RU32 %-25s %s\n",
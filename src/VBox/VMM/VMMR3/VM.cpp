@@ -492,6 +492,7 @@ static int vmR3CreateUVM(uint32_t cCpus, PCVMM2USERMETHODS pVmm2UserMethods, PUV
     {
         pUVM->aCpus[i].pUVM   = pUVM;
         pUVM->aCpus[i].idCpu  = i;
+        vmR3ReqCpuQueueInit(&pUVM->aCpus[i]);
     }
 
     /* Allocate a TLS entry to store the VMINTUSERPERVMCPU pointer. */
@@ -927,6 +928,7 @@ static int vmR3InitRing3(PVM pVM, PUVM pUVM)
     STAM_REG(pVM, &pUVM->vm.s.StatReqProcessed,  STAMTYPE_COUNTER,     "/VM/Req/Processed",      STAMUNIT_OCCURENCES,        "Number of processed requests (any queue).");
     STAM_REG(pVM, &pUVM->vm.s.StatReqMoreThan1,  STAMTYPE_COUNTER,     "/VM/Req/MoreThan1",      STAMUNIT_OCCURENCES,        "Number of times there are more than one request on the queue when processing it.");
     STAM_REG(pVM, &pUVM->vm.s.StatReqPushBackRaces, STAMTYPE_COUNTER,  "/VM/Req/PushBackRaces",  STAMUNIT_OCCURENCES,        "Number of push back races.");
+    STAM_REG(pVM, &pUVM->vm.s.StatReqCpuQueueRaces, STAMTYPE_COUNTER,  "/VM/Req/CpuQueueRaces",  STAMUNIT_OCCURENCES,        "Number of times a VCPU queue was found with a request half way queued.");
 
     /*
      * Init all R3 components, the order here might be important.
@@ -1175,6 +1177,8 @@ static int vmR3InitDoCompleted(PVM pVM, VMINITCOMPLETED enmWhat)
         rc = HMR3InitCompleted(pVM, enmWhat);
     if (RT_SUCCESS(rc))
         rc = PGMR3InitCompleted(pVM, enmWhat);  /** @todo Why is this not inside VMMR3InitCompleted()? */
+    if (RT_SUCCESS(rc) && enmWhat == VMINITCOMPLETED_RING3)
+        rc = STAMR3InitCompleted(pVM);
 #ifndef VBOX_WITH_RAW_MODE
     if (enmWhat == VMINITCOMPLETED_RING3)
     {
@@ -2498,7 +2502,9 @@ DECLCALLBACK(int) vmR3Destroy(PVM pVM)
         /*
          * Destroy the VM components.
          */
-        int rc = TMR3Term(pVM);
+        int rc = STAMR3ExportStop(pUVM);
+        AssertRC(rc);
+        rc = TMR3Term(pVM);
         AssertRC(rc);
 #ifdef VBOX_WITH_DEBUGGER
         rc = DBGCTcpTerminate(pUVM, pUVM->vm.s.pvDBGC);
@@ -2669,7 +2675,7 @@ static void vmR3DestroyUVM(PUVM pUVM, uint32_t cMilliesEMTWait)
             PVMREQ pReqHead = ASMAtomicXchgPtrT(&pUVCpu->vm.s.pPriorityReqs, NULL, PVMREQ);
             if (!pReqHead)
             {
-                pReqHead = ASMAtomicXchgPtrT(&pUVCpu->vm.s.pNormalReqs, NULL, PVMREQ);
+                pReqHead = vmR3ReqCpuQueuePop(pUVCpu);
                 if (!pReqHead)
                     break;
             }
@@ -43,6 +43,110 @@
 static int  vmR3ReqProcessOneU(PUVM pUVM, PVMREQ pReq);
 
 
+/*
+ * The per-VCPU normal request queues.
+ *
+ * These are intrusive multiple producer, single consumer FIFOs threaded thru
+ * VMREQ::pNext (D. Vyukov's algorithm).  Producers swap themselves in as the
+ * new tail and then link the previous tail to them, so queueing a request is
+ * a single XCHG regardless of how many threads are at it.  The EMT owning the
+ * queue is the only consumer and takes requests off the head in order without
+ * any atomic read-modify-write operations.  The request packets themselves
+ * serve as the preallocated queue nodes, so there is no capacity limit and no
+ * overflow handling.
+ *
+ * The queue always contains at least one node, using a stub node embedded in
+ * VMINTUSERPERVMCPU when it is empty.  The stub is re-queued whenever the
+ * consumer is about to take the last real request.
+ *
+ * The catch is that a producer preempted between the XCHG and the linking
+ * write hides all requests queued after it until it resumes.  The consumer
+ * treats this as an empty queue; the producer sets VMCPU_FF_REQUEST and wakes
+ * up the EMT after completing the linking, so nothing is lost.
+ */
+AssertCompileMemberOffset(VMREQ, pNext, 0);
+
+
+/**
+ * Initializes the normal request queue of a virtual CPU.
+ *
+ * @param   pUVCpu          Pointer to the user mode VMCPU structure.
+ */
+void vmR3ReqCpuQueueInit(PUVMCPU pUVCpu)
+{
+    PVMREQ pStub = VMINTUSERPERVMCPU_REQ_STUB(&pUVCpu->vm.s);
+    pUVCpu->vm.s.pNormalReqsStubNext = NULL;
+    pUVCpu->vm.s.pNormalReqsHead     = pStub;
+    pUVCpu->vm.s.pNormalReqsTail     = pStub;
+}
+
+
+/**
+ * Adds a request to the tail of a normal request queue of a virtual CPU.
+ *
+ * Any thread may call this.
+ *
+ * @param   pUVCpu          Pointer to the user mode VMCPU structure.
+ * @param   pReq            The request (or the stub).
+ */
+DECLINLINE(void) vmR3ReqCpuQueuePush(PUVMCPU pUVCpu, PVMREQ pReq)
+{
+    ASMAtomicWriteNullPtr(&pReq->pNext);
+    PVMREQ pPrev = ASMAtomicXchgPtrT(&pUVCpu->vm.s.pNormalReqsTail, pReq, PVMREQ);
+    ASMAtomicWritePtr(&pPrev->pNext, pReq);
+}
+
+
+/**
+ * Takes the oldest request off the normal request queue of a virtual CPU.
+ *
+ * Only the EMT of the virtual CPU may call this, except during VM destruction.
+ *
+ * @returns Pointer to the request, NULL if the queue is empty or a producer
+ *          is half way thru queueing one.
+ * @param   pUVCpu          Pointer to the user mode VMCPU structure.
+ */
+PVMREQ vmR3ReqCpuQueuePop(PUVMCPU pUVCpu)
+{
+    PVMREQ const pStub = VMINTUSERPERVMCPU_REQ_STUB(&pUVCpu->vm.s);
+    PVMREQ       pHead = pUVCpu->vm.s.pNormalReqsHead;
+    PVMREQ       pNext = ASMAtomicReadPtrT(&pHead->pNext, PVMREQ);
+
+    /* Skip the stub. */
+    if (pHead == pStub)
+    {
+        if (!pNext)
+            return NULL;
+        pUVCpu->vm.s.pNormalReqsHead = pHead = pNext;
+        pNext = ASMAtomicReadPtrT(&pHead->pNext, PVMREQ);
+    }
+
+    /* Unless there are more requests behind this one, we have to check whether
+       it is the last one or whether someone is still queueing one. */
+    if (!pNext)
+    {
+        if (pHead != ASMAtomicReadPtrT(&pUVCpu->vm.s.pNormalReqsTail, PVMREQ))
+        {
+            STAM_COUNTER_INC(&pUVCpu->pUVM->vm.s.StatReqCpuQueueRaces);
+            return NULL;
+        }
+
+        /* Last one, put the stub behind it so we can take it. */
+        vmR3ReqCpuQueuePush(pUVCpu, pStub);
+        pNext = ASMAtomicReadPtrT(&pHead->pNext, PVMREQ);
+        if (!pNext)
+        {
+            STAM_COUNTER_INC(&pUVCpu->pUVM->vm.s.StatReqCpuQueueRaces);
+            return NULL;
+        }
+    }
+
+    pUVCpu->vm.s.pNormalReqsHead = pNext;
+    ASMAtomicWriteNullPtr(&pHead->pNext);
+    return pHead;
+}
+
+
 /**
  * Convenience wrapper for VMR3ReqCallU.
  *
@@ -873,15 +977,20 @@ VMMR3DECL(int) VMR3ReqQueue(PVMREQ pReq, RTMSINTERVAL cMillies)
         /*
          * Insert it.
          */
-        volatile PVMREQ *ppQueueHead = pReq->fFlags & VMREQFLAGS_PRIORITY ? &pUVCpu->vm.s.pPriorityReqs : &pUVCpu->vm.s.pNormalReqs;
         pReq->enmState = VMREQSTATE_QUEUED;
-        PVMREQ pNext;
-        do
+        if (!(fFlags & VMREQFLAGS_PRIORITY))
+            vmR3ReqCpuQueuePush(pUVCpu, pReq);
+        else
         {
-            pNext = ASMAtomicUoReadPtrT(ppQueueHead, PVMREQ);
-            ASMAtomicWritePtr(&pReq->pNext, pNext);
-            ASMCompilerBarrier();
-        } while (!ASMAtomicCmpXchgPtr(ppQueueHead, pReq, pNext));
+            volatile PVMREQ *ppQueueHead = &pUVCpu->vm.s.pPriorityReqs;
+            PVMREQ pNext;
+            do
+            {
+                pNext = ASMAtomicUoReadPtrT(ppQueueHead, PVMREQ);
+                ASMAtomicWritePtr(&pReq->pNext, pNext);
+                ASMCompilerBarrier();
+            } while (!ASMAtomicCmpXchgPtr(ppQueueHead, pReq, pNext));
+        }
 
         /*
          * Notify EMT.
@@ -1110,17 +1219,20 @@ VMMR3_INT_DECL(int) VMR3ReqProcessU(PUVM pUVM, VMCPUID idDstCpu, bool fPriorityO
      */
     PVMREQ volatile *ppNormalReqs;
     PVMREQ volatile *ppPriorityReqs;
+    PUVMCPU          pUVCpu;
     if (idDstCpu == VMCPUID_ANY)
     {
+        pUVCpu         = NULL;
         ppPriorityReqs = &pUVM->vm.s.pPriorityReqs;
-        ppNormalReqs   = !fPriorityOnly ? &pUVM->vm.s.pNormalReqs                 : ppPriorityReqs;
+        ppNormalReqs   = !fPriorityOnly ? &pUVM->vm.s.pNormalReqs : ppPriorityReqs;
     }
     else
     {
         Assert(idDstCpu < pUVM->cCpus);
         Assert(pUVM->aCpus[idDstCpu].vm.s.NativeThreadEMT == RTThreadNativeSelf());
+        pUVCpu         = !fPriorityOnly ? &pUVM->aCpus[idDstCpu] : NULL; /* Normal requests are on the MPSC queue. */
         ppPriorityReqs = &pUVM->aCpus[idDstCpu].vm.s.pPriorityReqs;
-        ppNormalReqs   = !fPriorityOnly ? &pUVM->aCpus[idDstCpu].vm.s.pNormalReqs : ppPriorityReqs;
+        ppNormalReqs   = ppPriorityReqs;
     }
 
     /*
@@ -1151,9 +1263,23 @@ VMMR3_INT_DECL(int) VMR3ReqProcessU(PUVM pUVM, VMCPUID idDstCpu, bool fPriorityO
         {
             if (RT_UNLIKELY(pReq->pNext))
                 pReq = vmR3ReqProcessUTooManyHelper(pUVM, idDstCpu, pReq, ppPriorityReqs);
-            else if (ASMAtomicReadPtrT(ppNormalReqs, PVMREQ))
+            else if (  pUVCpu
+                     ? VMINTUSERPERVMCPU_HAS_NORMAL_REQS(&pUVCpu->vm.s)
+                     : ASMAtomicReadPtrT(ppNormalReqs, PVMREQ) != NULL)
                 vmR3ReqSetFF(pUVM, idDstCpu);
         }
+        else if (pUVCpu)
+        {
+            /* No push back needed here, just take the oldest one off the queue. */
+            pReq = vmR3ReqCpuQueuePop(pUVCpu);
+            if (!pReq)
+                break;
+            if (VMINTUSERPERVMCPU_HAS_NORMAL_REQS(&pUVCpu->vm.s))
+            {
+                STAM_COUNTER_INC(&pUVM->vm.s.StatReqMoreThan1);
+                vmR3ReqSetFF(pUVM, idDstCpu);
+            }
+        }
         else
         {
             pReq = ASMAtomicXchgPtrT(ppNormalReqs, NULL, PVMREQ);
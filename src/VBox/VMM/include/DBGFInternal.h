@@ -26,6 +26,7 @@
 #include <iprt/avl.h>
 #include <iprt/dbg.h>
 #include <VBox/vmm/dbgf.h>
+#include <VBox/vmm/dbgftrace.h>
 
 
 
@@ -356,6 +357,18 @@ typedef struct DBGFCPU
         /** Alignment padding. */
         uint32_t            u32Alignment;
     } aEvents[3];
+
+    /** @name Binary tracing, see DBGFR3Trace.cpp.
+     * @{ */
+    /** The binary trace ring of this CPU, NULL if not enabled. */
+    R3PTRTYPE(struct DBGFTRACERING *) pTraceRingR3;
+    /** The binary trace ring of this CPU, NIL_RTR0PTR if not enabled. */
+    R0PTRTYPE(struct DBGFTRACERING *) pTraceRingR0;
+    /** The binary trace ring of this CPU, NIL_RTRCPTR if not enabled. */
+    RCPTRTYPE(struct DBGFTRACERING *) pTraceRingRC;
+    /** Alignment padding. */
+    uint32_t                u32Alignment2;
+    /** @} */
 } DBGFCPU;
 AssertCompileMemberAlignment(DBGFCPU, aEvents, 8);
 AssertCompileMemberSizeAlignment(DBGFCPU, aEvents[0], 8);
@@ -413,6 +426,31 @@ typedef struct DBGFUSERPERVM
     /** List of registered info handlers. */
     R3PTRTYPE(PDBGFINFO)        pInfoFirst;
 
+    /** @name Binary tracing, see DBGFR3Trace.cpp.
+     * @{ */
+    /** The binary trace ring for events raised by non-EMT threads. */
+    R3PTRTYPE(struct DBGFTRACERING *) pTraceRingOther;
+    /** Read positions of the stream writer, one for each CPU followed by one
+     * for pTraceRingOther. */
+    R3PTRTYPE(uint64_t *)       paidxTraceRead;
+    /** Record buffer used by the stream writer. */
+    R3PTRTYPE(PDBGFTRACEREC)    paTraceRecs;
+    /** The stream file, NIL_RTFILE if not streaming. */
+    RTFILE                      hTraceFile;
+    /** The stream writer thread. */
+    RTTHREAD                    hTraceThread;
+    /** Event semaphore for waking up the stream writer. */
+    RTSEMEVENT                  hTraceEvt;
+    /** Set when the stream writer should terminate. */
+    bool volatile               fTraceShutdown;
+    /** Alignment padding. */
+    bool                        afAlignment3[7];
+    /** The number of records the stream writer lost. */
+    uint64_t                    cTraceLost;
+    /** @} */
+
+    /** The guest sampling profiler, see DBGFR3Profiler.cpp. */
+    R3PTRTYPE(struct DBGFPROFILER *) pProfiler;
 } DBGFUSERPERVM;
 typedef DBGFUSERPERVM *PDBGFUSERPERVM;
 typedef DBGFUSERPERVM const *PCDBGFUSERPERVM;
@@ -437,6 +475,9 @@ int  dbgfR3InfoInit(PUVM pUVM);
 int  dbgfR3InfoTerm(PUVM pUVM);
 int  dbgfR3OSInit(PUVM pUVM);
 void dbgfR3OSTerm(PUVM pUVM);
+int  dbgfR3ProfilerInit(PVM pVM);
+void dbgfR3ProfilerPowerOff(PVM pVM);
+void dbgfR3ProfilerTerm(PUVM pUVM);
 int  dbgfR3RegInit(PUVM pUVM);
 void dbgfR3RegTerm(PUVM pUVM);
 int  dbgfR3TraceInit(PVM pVM);
@@ -0,0 +1,174 @@
+/* $Id$ */
+/** @file
+ * DBGF - Binary Trace Rings.
+ *
+ * The ring logic is kept free of VM internals so that tstDBGFTraceRing can
+ * exercise it in ring-3.
+ */
+
+/*
+ * Copyright (C) 2011-2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+#ifndef ___DBGFTraceRing_h
+#define ___DBGFTraceRing_h
+
+#include <VBox/vmm/dbgftrace.h>
+#include <iprt/asm.h>
+#include <iprt/asm-amd64-x86.h>
+#include <iprt/assert.h>
+#include <iprt/string.h>
+
+
+/**
+ * Binary trace ring.
+ *
+ * Writers reserve a slot by atomically incrementing idxNext and then fill in
+ * the record, setting DBGFTRACEREC::u32Seq last.  There is no flow control,
+ * a slow reader simply loses the oldest records and gets told how many.
+ *
+ * The per-VCPU rings only have one writer, the EMT, so a record can only be
+ * torn if the reader is preempted while copying it, which the sequence number
+ * check catches.  The ring for other threads can in theory also get a torn
+ * record if a writer is preempted for a whole ring wrap-around while filling
+ * in a record.  We accept this.
+ */
+typedef struct DBGFTRACERING
+{
+    /** Magic value (DBGFTRACERING_MAGIC). */
+    uint32_t            u32Magic;
+    /** The number of records, power of two. */
+    uint32_t            cEntries;
+    /** The index of the next record to write.  This is not wrapped. */
+    uint64_t volatile   idxNext;
+    /** Padding the header to a cache line. */
+    uint8_t             abPadding[48];
+    /** The records (variable size). */
+    DBGFTRACEREC        aRecs[1];
+} DBGFTRACERING;
+AssertCompileMemberOffset(DBGFTRACERING, aRecs, 64);
+/** Pointer to a binary trace ring. */
+typedef DBGFTRACERING *PDBGFTRACERING;
+
+/** DBGFTRACERING::u32Magic value (Alan Mathison Turing). */
+#define DBGFTRACERING_MAGIC     UINT32_C(0x19120623)
+
+
+/**
+ * Calculates the size of a trace ring.
+ *
+ * @returns Size in bytes.
+ * @param   cEntries    The number of records, power of two.
+ */
+DECLINLINE(size_t) dbgfTraceRingCalcSize(uint32_t cEntries)
+{
+    return RT_OFFSETOF(DBGFTRACERING, aRecs) + (size_t)cEntries * sizeof(DBGFTRACEREC);
+}
+
+
+/**
+ * Initializes a trace ring.
+ *
+ * @param   pRing       The ring, dbgfTraceRingCalcSize(cEntries) bytes.
+ * @param   cEntries    The number of records, power of two.
+ */
+DECLINLINE(void) dbgfTraceRingInit(PDBGFTRACERING pRing, uint32_t cEntries)
+{
+    Assert(cEntries >= 2 && RT_IS_POWER_OF_TWO(cEntries));
+    RT_BZERO(pRing, dbgfTraceRingCalcSize(cEntries));
+    pRing->cEntries = cEntries;
+    pRing->u32Magic = DBGFTRACERING_MAGIC;
+}
+
+
+/**
+ * Adds a record to a trace ring.
+ *
+ * @param   pRing       The ring.
+ * @param   uEvent      The event type (DBGFTRACEEVT).
+ * @param   bPhase      The event phase (DBGFTRACEPHASE_XXX).
+ * @param   uArg0       The first argument.
+ * @param   uArg1       The second argument.
+ */
+DECLINLINE(void) dbgfTraceRingAdd(PDBGFTRACERING pRing, uint16_t uEvent, uint8_t bPhase, uint64_t uArg0, uint64_t uArg1)
+{
+    uint64_t const idx  = ASMAtomicIncU64(&pRing->idxNext) - 1;
+    PDBGFTRACEREC  pRec = &pRing->aRecs[idx & (pRing->cEntries - 1)];
+
+    /* Invalidate the record while we update it.  Stores are not reordered on
+       x86, so compiler barriers are all we need here. */
+    ASMAtomicUoWriteU32(&pRec->u32Seq, 0);
+    ASMCompilerBarrier();
+    pRec->u64Tsc      = ASMReadTSC();
+    pRec->uEvent      = uEvent;
+    pRec->bPhase      = bPhase;
+    pRec->bReserved   = 0;
+    pRec->au64Args[0] = uArg0;
+    pRec->au64Args[1] = uArg1;
+    ASMCompilerBarrier();
+    ASMAtomicUoWriteU32(&pRec->u32Seq, (uint32_t)idx + 1);
+}
+
+
+/**
+ * Reads records from a trace ring.
+ *
+ * Reading stops at the first record that is still being written, it will be
+ * picked up by the next call.
+ *
+ * @returns The number of records copied to @a paRecs.
+ * @param   pRing       The ring.
+ * @param   pidxRead    The read position.  Input and output.
+ * @param   paRecs      Where to copy the records.
+ * @param   cMaxRecs    The maximum number of records to copy.
+ * @param   pcLost      Where to add the number of records that were overwritten
+ *                      before they could be read.
+ */
+DECLINLINE(uint32_t) dbgfTraceRingRead(PDBGFTRACERING pRing, uint64_t *pidxRead, PDBGFTRACEREC paRecs, uint32_t cMaxRecs,
+                                       uint64_t *pcLost)
+{
+    uint32_t const cEntries = pRing->cEntries;
+    uint64_t const idxNext  = ASMAtomicReadU64(&pRing->idxNext);
+    uint64_t       idx      = *pidxRead;
+    uint64_t       cLost    = 0;
+    if (idxNext - idx > cEntries)
+    {
+        cLost = idxNext - idx - cEntries;
+        idx   = idxNext - cEntries;
+    }
+
+    uint32_t cRecs = 0;
+    while (idx < idxNext && cRecs < cMaxRecs)
+    {
+        PDBGFTRACEREC  pSrc   = &pRing->aRecs[idx & (cEntries - 1)];
+        uint32_t const u32Seq = ASMAtomicReadU32(&pSrc->u32Seq);
+        if (u32Seq == (uint32_t)idx + 1)
+        {
+            ASMCompilerBarrier();
+            paRecs[cRecs] = *pSrc;
+            if (ASMAtomicReadU32(&pSrc->u32Seq) == u32Seq)
+                cRecs++;
+            else
+                cLost++;
+        }
+        else if (ASMAtomicReadU64(&pRing->idxNext) - idx > cEntries)
+            cLost++;        /* Overwritten. */
+        else
+            break;          /* Still being written. */
+        idx++;
+    }
+
+    *pidxRead = idx;
+    *pcLost  += cLost;
+    return cRecs;
+}
+
+#endif
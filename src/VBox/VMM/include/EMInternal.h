@@ -290,6 +290,89 @@ typedef struct EMSTATS
 typedef EMSTATS *PEMSTATS;
 
 
+/** @name Exit history
+ * @{ */
+/** The number of entries in the per-vCPU exit history table (power of two). */
+#define EM_EXIT_HISTORY_ENTRIES             UINT32_C(256)
+/** Exits at the same site which are more than this many recorded exits apart
+ * don't count towards the site being hot. */
+#define EM_EXIT_HISTORY_MAX_DISTANCE        UINT32_C(16)
+/** The number of close exits in a row that make a site hot. */
+#define EM_EXIT_HISTORY_HOT_THRESHOLD       UINT32_C(32)
+/** The max number of instructions to execute in IEM for a hot exit site. */
+#define EM_EXIT_HISTORY_RUN_MAX_INSTRS      UINT32_C(4096)
+/** Stop the IEM run after this many instructions in a row without any I/O
+ * port or MMIO accesses. */
+#define EM_EXIT_HISTORY_RUN_MAX_NO_EXITS    UINT32_C(32)
+/** The number of probe runs in a row that have to fail before we give up on a
+ * site. */
+#define EM_EXIT_HISTORY_MAX_PROBE_FAILURES  UINT32_C(4)
+/** @} */
+
+/**
+ * The exit types tracked by the exit history.
+ */
+typedef enum EMEXITTYPE
+{
+    /** Unused entry. */
+    EMEXITTYPE_INVALID = 0,
+    /** I/O port access (VINF_IOM_R3_IOPORT_XXX). */
+    EMEXITTYPE_IO_PORT,
+    /** MMIO access (VINF_IOM_R3_MMIO_XXX). */
+    EMEXITTYPE_MMIO,
+    /** MSR access (VINF_CPUM_R3_MSR_XXX).  Only tracked, never optimized. */
+    EMEXITTYPE_MSR,
+    /** End of valid types. */
+    EMEXITTYPE_END
+} EMEXITTYPE;
+
+/**
+ * What EM does about the exits at a site.
+ */
+typedef enum EMEXITACTION
+{
+    /** Handle the exits the normal way, the site isn't hot. */
+    EMEXITACTION_NORMAL = 0,
+    /** The site is hot, follow the exits by a probe run in IEM. */
+    EMEXITACTION_EXEC_PROBE,
+    /** The site is hot and the IEM runs are paying off. */
+    EMEXITACTION_EXEC,
+    /** The probe runs didn't pay off, handle the exits the normal way. */
+    EMEXITACTION_NORMAL_PROBED
+} EMEXITACTION;
+
+/**
+ * Exit history table entry.
+ */
+typedef struct EMEXITREC
+{
+    /** The flat PC (CS base + RIP) of the exiting instruction. */
+    uint64_t                uFlatPC;
+    /** The exit number (EMCPU::iNextExit) of the last exit at this site. */
+    uint64_t                iLastExit;
+    /** The total number of exits at this site. */
+    uint32_t                cHits;
+    /** The number of exits in a row which were close to the previous one. */
+    uint16_t                cCloseHits;
+    /** The exit type (EMEXITTYPE), EMEXITTYPE_INVALID if unused. */
+    uint8_t                 enmType;
+    /** What to do about the exits (EMEXITACTION). */
+    uint8_t                 enmAction;
+    /** The number of IEM runs done on behalf of this site. */
+    uint32_t                cRuns;
+    /** The number of probe runs in a row that didn't pay off. */
+    uint32_t                cProbeFailures;
+    /** The number of I/O port and MMIO accesses done by the runs, i.e. the
+     * number of exits they saved us. */
+    uint64_t                cExitsAvoided;
+    /** The number of instructions executed by the runs. */
+    uint64_t                cInstructions;
+} EMEXITREC;
+AssertCompileSize(EMEXITREC, 48);
+/** Pointer to an exit history table entry. */
+typedef EMEXITREC *PEMEXITREC;
+
+
 /**
  * Converts a EM pointer into a VM pointer.
  * @returns Pointer to the VM structure the EM is part of.
@@ -311,8 +394,10 @@ typedef struct EM
     bool                    fIemExecutesAll;
     /** Whether a triple fault triggers a guru. */
     bool                    fGuruOnTripleFault;
+    /** Whether hot exit sites are executed in IEM (the exit history). */
+    bool                    fExitOptimizationEnabled;
     /** Alignment padding. */
-    bool                    afPadding[6];
+    bool                    afPadding[5];
 
     /** Id of the VCPU that last executed code in the recompiler. */
     VMCPUID                 idLastRemCpu;
@@ -428,6 +513,30 @@ typedef struct EMCPU
     /** R3: Number of time emR3HmExecute is called. */
     STAMCOUNTER             StatHmExecuteEntry;
 
+    /** @name Exit history.
+     * @{ */
+    /** The exit history table, EM_EXIT_HISTORY_ENTRIES entries (R3 heap).
+     * NULL if not enabled. */
+    R3PTRTYPE(PEMEXITREC)   paExitHistoryR3;
+#if HC_ARCH_BITS == 32
+    uint32_t                u32ExitHistoryPadding;
+#endif
+    /** The number of exits recorded in the history. */
+    uint64_t                iNextExit;
+    /** Exits at hot sites. */
+    STAMCOUNTER             StatExitHistoryHot;
+    /** Entries replaced by other exit sites. */
+    STAMCOUNTER             StatExitHistoryEvictions;
+    /** Profiling the IEM runs. */
+    STAMPROFILE             StatExitHistoryExec;
+    /** Instructions executed by the IEM runs. */
+    STAMCOUNTER             StatExitHistoryInstructions;
+    /** Exits avoided by the IEM runs. */
+    STAMCOUNTER             StatExitHistoryExitsAvoided;
+    /** Sites given up on after failed probe runs. */
+    STAMCOUNTER             StatExitHistoryProbeFailures;
+    /** @} */
+
     /** More statistics (R3). */
     R3PTRTYPE(PEMSTATS)     pStatsR3;
     /** More statistics (R0). */
@@ -452,6 +561,10 @@ typedef EMCPU *PEMCPU;
 /** @} */
 
 int     emR3InitDbg(PVM pVM);
+int     emR3InitHistory(PVM pVM);
+void    emR3HistoryResetCpu(PVMCPU pVCpu);
+PEMEXITREC emR3HistoryAddExit(PVMCPU pVCpu, int rcExit, PCCPUMCTX pCtx);
+int     emR3HistoryExec(PVM pVM, PVMCPU pVCpu, PEMEXITREC pExitRec);
 
 int     emR3HmExecute(PVM pVM, PVMCPU pVCpu, bool *pfFFDone);
 int     emR3RawExecute(PVM pVM, PVMCPU pVCpu, bool *pfFFDone);
@@ -144,6 +144,55 @@ RT_C_DECLS_BEGIN
 #define MASK_EXITREASON_STAT       0xff
 #define MASK_INJECT_IRQ_STAT       0xff
 
+/** @name Exit latency histograms (/HM/ExitHistograms).
+ * @{ */
+/** The number of buckets in an exit latency histogram. */
+#define HM_EXIT_HIST_BUCKETS        16
+/** Bucket 0 takes everything below 2^HM_EXIT_HIST_FIRST_SHIFT TSC ticks, bucket
+ * N (N > 0) takes [2^(HM_EXIT_HIST_FIRST_SHIFT+N-1), 2^(HM_EXIT_HIST_FIRST_SHIFT+N)),
+ * and the last bucket is open ended. */
+#define HM_EXIT_HIST_FIRST_SHIFT    10
+/** The number of histograms per category: the exit reasons and AMD-V \#NPF. */
+#define HM_EXIT_HIST_REASONS        (MAX_EXITREASON_STAT + 1)
+/** The histogram index of AMD-V nested page faults. */
+#define HM_EXIT_HIST_IDX_NPF        MAX_EXITREASON_STAT
+
+/** Notes a VM-exit for the exit latency histograms. */
+#define HMCPU_EXIT_HIST_NOTE_EXIT(pVCpu, a_idxHist) \
+    do { \
+        if (RT_LIKELY(!(pVCpu)->hm.s.paExitHistR0)) \
+        { /* likely */ } \
+        else \
+        { \
+            Assert((a_idxHist) < HM_EXIT_HIST_REASONS); \
+            (pVCpu)->hm.s.uExitHistTsc       = ASMReadTSC(); \
+            (pVCpu)->hm.s.idxExitHistPending = (uint16_t)(a_idxHist); \
+            (pVCpu)->hm.s.fExitHistRing3     = false; \
+        } \
+    } while (0)
+
+/** Completes the pending exit latency histogram entry, if any.  Use this
+ * right before VM-entry. */
+#define HMCPU_EXIT_HIST_NOTE_ENTRY(pVCpu) \
+    do { \
+        uint64_t const uTscExitHist = (pVCpu)->hm.s.uExitHistTsc; \
+        if (RT_LIKELY(!uTscExitHist)) \
+        { /* likely */ } \
+        else \
+        { \
+            uint64_t const cTicksExitHist = ASMReadTSC() - uTscExitHist; \
+            unsigned       iBucketExitHist = ASMBitLastSetU64(cTicksExitHist >> HM_EXIT_HIST_FIRST_SHIFT); \
+            if (iBucketExitHist >= HM_EXIT_HIST_BUCKETS) \
+                iBucketExitHist = HM_EXIT_HIST_BUCKETS - 1; \
+            PHMEXITHIST pExitHist = &(pVCpu)->hm.s.paExitHistR0[  (pVCpu)->hm.s.idxExitHistPending \
+                                                                + ((pVCpu)->hm.s.fExitHistRing3 ? HM_EXIT_HIST_REASONS : 0)]; \
+            pExitHist->aBuckets[iBucketExitHist].c++; \
+            STAM_REL_PROFILE_ADD_PERIOD(&pExitHist->Profile, cTicksExitHist); \
+            (pVCpu)->hm.s.uExitHistTsc = 0; \
+        } \
+    } while (0)
+/** @} */
+
 /** @name HM changed flags.
  * These flags are used to keep track of which important registers that
  * have been changed since last they were reset.
@@ -374,7 +423,9 @@ typedef struct HM
     /** Set when the debug facility has breakpoints/events enabled that requires
      *  us to use the debug execution loop in ring-0. */
     bool                        fUseDebugLoop;
-    bool                        u8Alignment[2];
+    /** Set when collecting exit latency histograms (/HM/ExitHistograms). */
+    bool                        fExitHistograms;
+    bool                        u8Alignment[1];
 
     /** Host kernel flags that HM might need to know (SUPKERNELFEATURES_XXX). */
     uint32_t                    fHostKernelFeatures;
@@ -618,6 +669,22 @@ typedef DECLCALLBACK(int) FNHMSVMVMRUN(RTHCPHYS pVmcbHostPhys, RTHCPHYS pVmcbPhy
 /** Pointer to a SVM VMRun function. */
 typedef R0PTRTYPE(FNHMSVMVMRUN *) PFNHMSVMVMRUN;
 
+/**
+ * Exit latency histogram for one exit reason.
+ *
+ * The latency is the time from a VM-exit until the next VM-entry, in host TSC
+ * ticks.
+ */
+typedef struct HMEXITHIST
+{
+    /** The latency profile (count, total, min and max). */
+    STAMPROFILE             Profile;
+    /** The log2 latency buckets, see HM_EXIT_HIST_FIRST_SHIFT. */
+    STAMCOUNTER             aBuckets[HM_EXIT_HIST_BUCKETS];
+} HMEXITHIST;
+/** Pointer to an exit latency histogram. */
+typedef HMEXITHIST *PHMEXITHIST;
+
 /**
  * HM VMCPU Instance data.
  *
@@ -902,6 +969,22 @@ typedef struct HMCPU
     /** The index of the next free slot in the history array. */
     uint16_t                idxExitHistoryFree;
 
+    /** @name Exit latency histograms (/HM/ExitHistograms).
+     * @{ */
+    /** The histogram index of the VM-exit waiting for the next VM-entry. */
+    uint16_t                idxExitHistPending;
+    /** Whether the pending VM-exit went to ring-3. */
+    bool                    fExitHistRing3;
+    uint8_t                 abExitHistAlignment[5];
+    /** The TSC of the pending VM-exit, 0 if none. */
+    uint64_t                uExitHistTsc;
+    /** The histograms, HM_EXIT_HIST_REASONS handled in ring-0 followed by
+     * HM_EXIT_HIST_REASONS that went to ring-3.  NULL if not enabled. */
+    R0PTRTYPE(PHMEXITHIST)  paExitHistR0;
+    /** The ring-3 mapping of paExitHistR0. */
+    R3PTRTYPE(PHMEXITHIST)  paExitHistR3;
+    /** @} */
+
     /** For saving stack space, the disassembler state is allocated here instead of
      * on the stack. */
     DISCPUSTATE             DisState;
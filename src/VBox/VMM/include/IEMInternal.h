@@ -230,6 +230,128 @@ typedef IEMVERIFYEVTREC *PIEMVERIFYEVTREC;
 #endif /* IEM_VERIFICATION_MODE_FULL */
 
 
+/**
+ * IEM TLB entry.
+ *
+ * The entries are keyed by guest virtual page and cache the result of the
+ * guest page table walk, plus the ring-3 host mapping of the physical page.
+ */
+typedef struct IEMTLBENTRY
+{
+    /** The TLB entry tag.
+     * Bits 35 thru 0 are made up of the virtual address shifted right 12 bits.
+     * Bits 63 thru 36 are made up of the TLB revision (zero means invalid).
+     *
+     * The TLB lookup code uses the current TLB revision, which won't ever be zero,
+     * enabling an extremely cheap TLB invalidation most of the time.  When the TLB
+     * revision wraps around though, the tags needs to be zeroed. */
+    uint64_t                uTag;
+    /** Access flags and physical TLB revision (IEMTLBE_F_XXX).
+     * The access flags are inverted so that a zero bit means the access is
+     * allowed, which makes the checks cheaper. */
+    uint64_t                fFlagsAndPhysRev;
+    /** The guest physical page address. */
+    RTGCPHYS                GCPhys;
+    /** Ring-3 pointer to the page mapping (valid if the physical revision
+     * matches, only used in ring-3). */
+    R3PTRTYPE(uint8_t *)    pbMappingR3;
+#if HC_ARCH_BITS == 32
+    uint32_t                u32Padding1;
+#endif
+} IEMTLBENTRY;
+AssertCompileSize(IEMTLBENTRY, 32);
+/** Pointer to an IEM TLB entry. */
+typedef IEMTLBENTRY *PIEMTLBENTRY;
+
+/** @name IEMTLBE_F_XXX - TLB entry flags (IEMTLBENTRY::fFlagsAndPhysRev)
+ * @{  */
+#define IEMTLBE_F_PT_NO_EXEC        RT_BIT_64(0)  /**< Page tables: Not executable. */
+#define IEMTLBE_F_PT_NO_WRITE       RT_BIT_64(1)  /**< Page tables: Not writable. */
+#define IEMTLBE_F_PT_NO_USER        RT_BIT_64(2)  /**< Page tables: Not user accessible (supervisor only). */
+#define IEMTLBE_F_PG_NO_WRITE       RT_BIT_64(3)  /**< Phys page:   Not known to be writable (pbMappingR3 is read-only). */
+#define IEMTLBE_F_PT_NO_ACCESSED    RT_BIT_64(5)  /**< Page tables: Not accessed (need to be marked accessed). */
+#define IEMTLBE_F_PT_NO_DIRTY       RT_BIT_64(6)  /**< Page tables: Not dirty (needs to be made dirty on write). */
+#define IEMTLBE_F_PHYS_REV          UINT64_C(0xffffffffffffff00) /**< Physical revision mask. */
+/** @} */
+
+/** The number of entries in each TLB.
+ * This is limited by the space available in VMCPU. */
+#define IEMTLB_ENTRY_COUNT                  64
+
+/**
+ * An IEM TLB.
+ *
+ * We've got two of these, one for instruction fetches and one for data
+ * accesses.  They are direct mapped and kept small because of the space
+ * available in VMCPU.
+ */
+typedef struct IEMTLB
+{
+    /** The TLB entries. */
+    IEMTLBENTRY             aEntries[IEMTLB_ENTRY_COUNT];
+    /** The TLB revision.
+     * This is actually only 28 bits wide (see IEMTLBENTRY::uTag) and is
+     * incremented by adding IEMTLB_REVISION_INCR. */
+    uint64_t                uTlbRevision;
+    /** The TLB physical address revision.
+     * This is actually only 56 bits wide (see IEMTLBENTRY::fFlagsAndPhysRev) and
+     * is incremented by adding IEMTLB_PHYS_REV_INCR.  Other threads bump it when
+     * changing the physical memory setup, so it must be updated atomically. */
+    uint64_t volatile       uTlbPhysRev;
+    /** TLB hits. */
+    uint32_t                cTlbHits;
+    /** TLB misses. */
+    uint32_t                cTlbMisses;
+    /** Ring-3 host mapping lookups (physical revision mismatches). */
+    uint32_t                cTlbMapMisses;
+    /** Alignment padding. */
+    uint32_t                u32Padding;
+} IEMTLB;
+AssertCompileSizeAlignment(IEMTLB, 32);
+/** Pointer to an IEM TLB. */
+typedef IEMTLB *PIEMTLB;
+
+/** IEMTLB::uTlbRevision increment.  */
+#define IEMTLB_REVISION_INCR        RT_BIT_64(36)
+/** IEMTLB::uTlbPhysRev increment.  */
+#define IEMTLB_PHYS_REV_INCR        RT_BIT_64(8)
+/**
+ * Calculates the TLB tag for a virtual address.
+ * @returns Tag value for indexing and comparing with IEMTLB::uTag.
+ * @param   a_pTlb      The TLB.
+ * @param   a_GCPtr     The virtual address.
+ */
+#define IEMTLB_CALC_TAG(a_pTlb, a_GCPtr)    ( IEMTLB_CALC_TAG_NO_REV(a_GCPtr) | (a_pTlb)->uTlbRevision )
+/**
+ * Calculates the TLB tag for a virtual address but without TLB revision.
+ * @returns Tag value for indexing and comparing with IEMTLB::uTag.
+ * @param   a_GCPtr     The virtual address.
+ */
+#define IEMTLB_CALC_TAG_NO_REV(a_GCPtr)     ( (((a_GCPtr) << 16) >> (PAGE_SHIFT + 16)) )
+/**
+ * Converts a TLB tag value into a TLB index.
+ * @returns Index into IEMTLB::aEntries.
+ * @param   a_uTag      Value returned by IEMTLB_CALC_TAG.
+ */
+#define IEMTLB_TAG_TO_INDEX(a_uTag)         ( (uint8_t)(a_uTag) & (IEMTLB_ENTRY_COUNT - 1) )
+/**
+ * Converts a TLB tag value into a TLB entry pointer.
+ * @returns Pointer into IEMTLB::aEntries corresponding to @a a_uTag.
+ * @param   a_pTlb      The TLB.
+ * @param   a_uTag      Value returned by IEMTLB_CALC_TAG.
+ */
+#define IEMTLB_TAG_TO_ENTRY(a_pTlb, a_uTag) ( &(a_pTlb)->aEntries[IEMTLB_TAG_TO_INDEX(a_uTag)] )
+
+/** @def IEM_WITH_TLB_MAPPING
+ * Cache the ring-3 host mapping of guest pages in the TLB entries and access
+ * them without taking the PGM page mapping lock.  Not used with the
+ * verification and write logging modes, as those need to see every access. */
+#if defined(IN_RING3) && !defined(IEM_VERIFICATION_MODE_FULL) && !defined(IEM_VERIFICATION_MODE_MINIMAL) \
+ && !defined(IEM_LOG_MEMORY_WRITES)
+# define IEM_WITH_TLB_MAPPING
+#endif
+
+
 /**
  * The per-CPU IEM state.
  */
@@ -251,8 +373,12 @@ typedef struct IEMCPU
     bool                    fBypassHandlers;
     /** Indicates that we're interpreting patch code - RC only! */
     bool                    fInPatchCode;
-    /** Explicit alignment padding. */
-    bool                    afAlignment0[2];
+    /** Set by iemExecForExitsWorker after the first instruction to skip the TLB
+     * trust checks for the rest of the run. */
+    bool                    fTlbTrusted;
+    /** Set if the TLBs are disabled (/IEM/TlbEnabled), in which case they're
+     * flushed before every instruction. */
+    bool                    fTlbDisabled;
 
     /** The flags of the current exception / interrupt. */
     uint32_t                fCurXcpt;
@@ -294,6 +420,11 @@ typedef struct IEMCPU
     uint32_t                cRetPassUpStatus;
     /** Number of times RZ left with instruction commit pending for ring-3. */
     uint32_t                cPendingCommit;
+    /** Number of IEMExecForExits runs. */
+    uint32_t                cExecForExitsRuns;
+    /** Number of IEMExecForExits runs cut short by pending forced actions or
+     *  expired timers. */
+    uint32_t                cExecForExitsFFBreaks;
 #ifdef IEM_VERIFICATION_MODE_FULL
     /** The Number of I/O port reads that has been performed. */
     uint32_t                cIOReads;
@@ -440,6 +571,14 @@ typedef struct IEMCPU
     CPUMCPUVENDOR           enmHostCpuVendor;
     /** @} */
 
+    /** @name Translation lookaside buffers.
+     * @{ */
+    /** The code TLB (instruction fetches). */
+    IEMTLB                  CodeTlb;
+    /** The data TLB. */
+    IEMTLB                  DataTlb;
+    /** @} */
+
 #ifdef IEM_VERIFICATION_MODE_FULL
     /** The event verification records for what IEM did (LIFO). */
     R3PTRTYPE(PIEMVERIFYEVTREC)     pIemEvtRecHead;
@@ -470,6 +609,11 @@ typedef IEMCPU const *PCIEMCPU;
  */
 #define IEMCPU_TO_VM(a_pIemCpu)     ((PVM)( (uintptr_t)(a_pIemCpu) + a_pIemCpu->offVM ))
 
+/** How often IEMExecForExits polls the timers, expressed as a mask applied to
+ * the number of instructions left.  Polling reads the clock, so we don't want
+ * to do it for every instruction. */
+#define IEM_EXEC_FOR_EXITS_TIMER_POLL_MASK  UINT32_C(0x7f)
+
 /** @name IEM_ACCESS_XXX - Access details.
  * @{ */
 #define IEM_ACCESS_INVALID              UINT32_C(0x000000ff)
@@ -487,6 +631,9 @@ typedef IEMCPU const *PCIEMCPU;
 #define IEM_ACCESS_PARTIAL_WRITE        UINT32_C(0x00000100)
 /** Used in aMemMappings to indicate that the entry is bounce buffered. */
 #define IEM_ACCESS_BOUNCE_BUFFERED      UINT32_C(0x00000200)
+/** Used in aMemMappings to indicate that the entry is a cached TLB mapping
+ * without a PGM page mapping lock (IEM_WITH_TLB_MAPPING). */
+#define IEM_ACCESS_NOT_LOCKED           UINT32_C(0x00000400)
 /** Read+write data alias. */
 #define IEM_ACCESS_DATA_RW              (IEM_ACCESS_TYPE_READ  | IEM_ACCESS_TYPE_WRITE | IEM_ACCESS_WHAT_DATA)
 /** Write data alias. */
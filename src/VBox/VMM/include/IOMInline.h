@@ -23,6 +23,110 @@
  * @{
  */
 
+/**
+ * Flushes the range lookup caches of the calling EMT.
+ *
+ * @param   pVCpu   The cross context virtual CPU structure of the calling EMT.
+ * @param   uEpoch  The lookup epoch the caches are going to be filled in.
+ */
+DECLINLINE(void) iomLookupFlushCaches(PVMCPU pVCpu, uint32_t uEpoch)
+{
+    for (unsigned i = 0; i < IOM_LOOKUP_CACHE_ENTRIES; i++)
+    {
+        /* First > last never matches. */
+        pVCpu->iom.s.aIOPortCacheR3[i].uFirstPort = 1;
+        pVCpu->iom.s.aIOPortCacheR3[i].uLastPort  = 0;
+        pVCpu->iom.s.aIOPortCacheR0[i].uFirstPort = 1;
+        pVCpu->iom.s.aIOPortCacheR0[i].uLastPort  = 0;
+        pVCpu->iom.s.aIOPortCacheRC[i].uFirstPort = 1;
+        pVCpu->iom.s.aIOPortCacheRC[i].uLastPort  = 0;
+        pVCpu->iom.s.aMmioCache[i].GCPhysFirst    = 1;
+        pVCpu->iom.s.aMmioCache[i].GCPhysLast     = 0;
+    }
+    pVCpu->iom.s.uCacheEpoch = uEpoch;
+}
+
+
+/**
+ * Enters a lock-free lookup section.
+ *
+ * This publishes the lookup epoch the calling EMT is reading the tables in,
+ * which prevents ring-3 from freeing anything the EMT might get hold of until
+ * iomLookupLeave is called.  See @ref sec_iom_lookup for details.
+ *
+ * @param   pVM     The cross context VM structure.
+ * @param   pVCpu   The cross context virtual CPU structure of the calling EMT.
+ */
+DECLINLINE(void) iomLookupEnter(PVM pVM, PVMCPU pVCpu)
+{
+    Assert(pVCpu->iom.s.uLookupEpoch == 0);
+    uint32_t uEpoch = ASMAtomicReadU32(&pVM->iom.s.uLookupEpoch);
+    for (;;)
+    {
+        /* The exchange is a full barrier, so if the epoch didn't change
+           meanwhile, ring-3 will see our epoch before freeing anything
+           unpublished after it. */
+        ASMAtomicXchgU32(&pVCpu->iom.s.uLookupEpoch, uEpoch);
+        uint32_t const uEpochNow = ASMAtomicReadU32(&pVM->iom.s.uLookupEpoch);
+        if (RT_LIKELY(uEpochNow == uEpoch))
+            break;
+        uEpoch = uEpochNow;
+    }
+
+    if (pVCpu->iom.s.uCacheEpoch == uEpoch)
+    { /* likely */ }
+    else
+        iomLookupFlushCaches(pVCpu, uEpoch);
+}
+
+
+/**
+ * Leaves a lock-free lookup section.
+ *
+ * Range descriptors obtained in the section must not be accessed after this.
+ *
+ * @param   pVCpu   The cross context virtual CPU structure of the calling EMT.
+ */
+DECLINLINE(void) iomLookupLeave(PVMCPU pVCpu)
+{
+    Assert(pVCpu->iom.s.uLookupEpoch != 0);
+    ASMAtomicWriteU32(&pVCpu->iom.s.uLookupEpoch, 0);
+}
+
+
+/**
+ * Searches an I/O port lookup table.
+ *
+ * @returns Pointer to the table entry covering the port.
+ * @returns NULL if no range covers the port.
+ *
+ * @param   pTrees      The IOM trees (current context).
+ * @param   offTable    The offset of the lookup table, 0 if none.
+ * @param   Port        The I/O port to lookup.
+ */
+DECLINLINE(PCIOMIOPORTLOOKUPENTRY) iomIOPortLookupSearch(PIOMTREES pTrees, int32_t offTable, RTIOPORT Port)
+{
+    if (offTable)
+    {
+        PCIOMIOPORTLOOKUP pTable = IOM_TREES_OFF2PTR(pTrees, offTable, PCIOMIOPORTLOOKUP);
+        uint32_t iStart = 0;
+        uint32_t iEnd   = pTable->cEntries;
+        while (iStart < iEnd)
+        {
+            uint32_t const          i      = iStart + (iEnd - iStart) / 2;
+            PCIOMIOPORTLOOKUPENTRY  pEntry = &pTable->aEntries[i];
+            if (Port < pEntry->uFirstPort)
+                iEnd = i;
+            else if (Port > pEntry->uLastPort)
+                iStart = i + 1;
+            else
+                return pEntry;
+        }
+    }
+    return NULL;
+}
+
+
 /**
  * Gets the I/O port range for the specified I/O port in the current context.
  *
@@ -30,28 +134,178 @@
  * @returns NULL if no port registered.
  *
  * @param   pVM     The cross context VM structure.
+ * @param   pVCpu   The cross context virtual CPU structure of the calling EMT.
  * @param   Port    The I/O port lookup.
+ *
+ * @remarks The caller must be in a lookup section (iomLookupEnter) and the
+ *          range only stays valid until it leaves it.
  */
-DECLINLINE(CTX_SUFF(PIOMIOPORTRANGE)) iomIOPortGetRange(PVM pVM, RTIOPORT Port)
+DECLINLINE(CTX_SUFF(PIOMIOPORTRANGE)) iomIOPortGetRange(PVM pVM, PVMCPU pVCpu, RTIOPORT Port)
 {
-    Assert(IOM_IS_SHARED_LOCK_OWNER(pVM));
-    return (CTX_SUFF(PIOMIOPORTRANGE))RTAvlroIOPortRangeGet(&pVM->iom.s.CTX_SUFF(pTrees)->CTX_SUFF(IOPortTree), Port);
+    Assert(pVCpu->iom.s.uLookupEpoch != 0);
+    PIOMTREES pTrees = pVM->iom.s.CTX_SUFF(pTrees);
+    STAM_PROFILE_START(&pVM->iom.s.CTX_SUFF_Z(StatIOPortLookup), a);
+
+    /*
+     * Try the per-VCPU cache first.
+     */
+    PIOMIOPORTLOOKUPENTRY paCache = pVCpu->iom.s.CTX_SUFF(aIOPortCache);
+    for (unsigned i = 0; i < IOM_LOOKUP_CACHE_ENTRIES; i++)
+        if (   Port >= paCache[i].uFirstPort
+            && Port <= paCache[i].uLastPort)
+        {
+            STAM_COUNTER_INC(&pVM->iom.s.StatIOPortLookupCacheHits);
+            STAM_PROFILE_STOP(&pVM->iom.s.CTX_SUFF_Z(StatIOPortLookup), a);
+            return IOM_TREES_OFF2PTR(pTrees, paCache[i].offRange, CTX_SUFF(PIOMIOPORTRANGE));
+        }
+
+    /*
+     * Search the lookup table and cache the result.
+     */
+    PCIOMIOPORTLOOKUPENTRY pEntry = iomIOPortLookupSearch(pTrees, ASMAtomicReadS32(&pTrees->CTX_SUFF(offIOPortLookup)), Port);
+    if (pEntry)
+    {
+        paCache[pVCpu->iom.s.CTX_SUFF(iIOPortCacheNext)++ % IOM_LOOKUP_CACHE_ENTRIES] = *pEntry;
+        STAM_PROFILE_STOP(&pVM->iom.s.CTX_SUFF_Z(StatIOPortLookup), a);
+        return IOM_TREES_OFF2PTR(pTrees, pEntry->offRange, CTX_SUFF(PIOMIOPORTRANGE));
+    }
+    STAM_COUNTER_INC(&pVM->iom.s.StatIOPortLookupMisses);
+    STAM_PROFILE_STOP(&pVM->iom.s.CTX_SUFF_Z(StatIOPortLookup), a);
+    return NULL;
 }
 
 
 /**
- * Gets the I/O port range for the specified I/O port in the HC.
+ * Checks whether there is a ring-3 I/O port range for the specified I/O port.
  *
- * @returns Pointer to I/O port range.
- * @returns NULL if no port registered.
+ * @returns true if there is, false if not.
  *
  * @param   pVM     The cross context VM structure.
+ * @param   pVCpu   The cross context virtual CPU structure of the calling EMT.
  * @param   Port    The I/O port to lookup.
+ *
+ * @remarks The caller must be in a lookup section (iomLookupEnter).
  */
-DECLINLINE(PIOMIOPORTRANGER3) iomIOPortGetRangeR3(PVM pVM, RTIOPORT Port)
+DECLINLINE(bool) iomIOPortHasRangeR3(PVM pVM, PVMCPU pVCpu, RTIOPORT Port)
 {
-    Assert(IOM_IS_SHARED_LOCK_OWNER(pVM));
-    return (PIOMIOPORTRANGER3)RTAvlroIOPortRangeGet(&pVM->iom.s.CTX_SUFF(pTrees)->IOPortTreeR3, Port);
+    Assert(pVCpu->iom.s.uLookupEpoch != 0); NOREF(pVCpu);
+    PIOMTREES pTrees = pVM->iom.s.CTX_SUFF(pTrees);
+    return iomIOPortLookupSearch(pTrees, ASMAtomicReadS32(&pTrees->offIOPortLookupR3), Port) != NULL;
+}
+
+
+#ifdef VBOX_WITH_STATISTICS
+/**
+ * Gets the I/O port statistics record.
+ *
+ * Unlike the range lookup this requires the IOM lock as ring-3 creates the
+ * records lazily.  If the lock is busy the access simply goes uncounted.
+ *
+ * @returns Pointer to I/O port stats.
+ * @returns NULL if not found or the lock is busy.
+ *
+ * @param   pVM         The cross context VM structure.
+ * @param   ppStatsLast The per-VCPU statistics record cache to use.
+ * @param   Port        The I/O port.
+ */
+DECLINLINE(PIOMIOPORTSTATS) iomIOPortGetStats(PVM pVM, PIOMIOPORTSTATS *ppStatsLast, RTIOPORT Port)
+{
+    PIOMIOPORTSTATS pStats = *ppStatsLast;
+    if (!pStats || pStats->Core.Key != Port)
+    {
+        int rc = IOM_LOCK_SHARED_EX(pVM, VERR_SEM_BUSY);
+        if (RT_FAILURE(rc))
+            return NULL;
+        pStats = (PIOMIOPORTSTATS)RTAvloIOPortGet(&pVM->iom.s.CTX_SUFF(pTrees)->IOPortStatTree, Port);
+        if (pStats)
+            *ppStatsLast = pStats;
+        IOM_UNLOCK_SHARED(pVM);
+    }
+    return pStats;
+}
+#endif /* VBOX_WITH_STATISTICS */
+
+
+/**
+ * Searches the MMIO lookup table.
+ *
+ * @returns Pointer to the table entry covering the address.
+ * @returns NULL if no range covers the address.
+ *
+ * @param   pTrees      The IOM trees (current context).
+ * @param   offTable    The offset of the lookup table, 0 if none.
+ * @param   GCPhys      The physical address to lookup.
+ */
+DECLINLINE(PCIOMMMIOLOOKUPENTRY) iomMmioLookupSearch(PIOMTREES pTrees, int32_t offTable, RTGCPHYS GCPhys)
+{
+    if (offTable)
+    {
+        PCIOMMMIOLOOKUP pTable = IOM_TREES_OFF2PTR(pTrees, offTable, PCIOMMMIOLOOKUP);
+        uint32_t iStart = 0;
+        uint32_t iEnd   = pTable->cEntries;
+        while (iStart < iEnd)
+        {
+            uint32_t const          i      = iStart + (iEnd - iStart) / 2;
+            PCIOMMMIOLOOKUPENTRY    pEntry = &pTable->aEntries[i];
+            if (GCPhys < pEntry->GCPhysFirst)
+                iEnd = i;
+            else if (GCPhys > pEntry->GCPhysLast)
+                iStart = i + 1;
+            else
+                return pEntry;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Worker for iomMmioGetRange and friends.
+ *
+ * @returns Pointer to MMIO range.
+ * @returns NULL if address not in a MMIO range.
+ *
+ * @param   pVM     The cross context VM structure.
+ * @param   pVCpu   The cross context virtual CPU structure of the calling EMT.
+ * @param   GCPhys  Physical address to lookup.
+ */
+DECLINLINE(PIOMMMIORANGE) iomMmioGetRangeWorker(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys)
+{
+    PIOMTREES pTrees = pVM->iom.s.CTX_SUFF(pTrees);
+    STAM_PROFILE_START(&pVM->iom.s.CTX_SUFF_Z(StatMmioLookup), a);
+
+    uint32_t const uEpoch = ASMAtomicReadU32(&pVM->iom.s.uLookupEpoch);
+    if (pVCpu->iom.s.uCacheEpoch == uEpoch)
+    { /* likely */ }
+    else
+        iomLookupFlushCaches(pVCpu, uEpoch);
+
+    /*
+     * Try the per-VCPU cache first.
+     */
+    PIOMMMIOLOOKUPENTRY paCache = pVCpu->iom.s.aMmioCache;
+    for (unsigned i = 0; i < IOM_LOOKUP_CACHE_ENTRIES; i++)
+        if (   GCPhys >= paCache[i].GCPhysFirst
+            && GCPhys <= paCache[i].GCPhysLast)
+        {
+            STAM_COUNTER_INC(&pVM->iom.s.StatMmioLookupCacheHits);
+            STAM_PROFILE_STOP(&pVM->iom.s.CTX_SUFF_Z(StatMmioLookup), a);
+            return IOM_TREES_OFF2PTR(pTrees, paCache[i].offRange, PIOMMMIORANGE);
+        }
+
+    /*
+     * Search the lookup table and cache the result.
+     */
+    PCIOMMMIOLOOKUPENTRY pEntry = iomMmioLookupSearch(pTrees, ASMAtomicReadS32(&pTrees->offMmioLookup), GCPhys);
+    if (pEntry)
+    {
+        paCache[pVCpu->iom.s.iMmioCacheNext++ % IOM_LOOKUP_CACHE_ENTRIES] = *pEntry;
+        STAM_PROFILE_STOP(&pVM->iom.s.CTX_SUFF_Z(StatMmioLookup), a);
+        return IOM_TREES_OFF2PTR(pTrees, pEntry->offRange, PIOMMMIORANGE);
+    }
+    STAM_COUNTER_INC(&pVM->iom.s.StatMmioLookupMisses);
+    STAM_PROFILE_STOP(&pVM->iom.s.CTX_SUFF_Z(StatMmioLookup), a);
+    return NULL;
 }
 
 
@@ -68,12 +322,7 @@ DECLINLINE(PIOMIOPORTRANGER3) iomIOPortGetRangeR3(PVM pVM, RTIOPORT Port)
 DECLINLINE(PIOMMMIORANGE) iomMmioGetRange(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys)
 {
     Assert(IOM_IS_SHARED_LOCK_OWNER(pVM));
-    PIOMMMIORANGE pRange = pVCpu->iom.s.CTX_SUFF(pMMIORangeLast);
-    if (    !pRange
-        ||  GCPhys - pRange->GCPhys >= pRange->cb)
-        pVCpu->iom.s.CTX_SUFF(pMMIORangeLast) = pRange
-            = (PIOMMMIORANGE)RTAvlroGCPhysRangeGet(&pVM->iom.s.CTX_SUFF(pTrees)->MMIOTree, GCPhys);
-    return pRange;
+    return iomMmioGetRangeWorker(pVM, pVCpu, GCPhys);
 }
 
 /**
@@ -106,11 +355,7 @@ DECLINLINE(PIOMMMIORANGE) iomMmioGetRangeWithRef(PVM pVM, PVMCPU pVCpu, RTGCPHYS
     int rc = IOM_LOCK_SHARED_EX(pVM, VINF_SUCCESS);
     AssertRCReturn(rc, NULL);
 
-    PIOMMMIORANGE pRange = pVCpu->iom.s.CTX_SUFF(pMMIORangeLast);
-    if (   !pRange
-        || GCPhys - pRange->GCPhys >= pRange->cb)
-        pVCpu->iom.s.CTX_SUFF(pMMIORangeLast) = pRange
-            = (PIOMMMIORANGE)RTAvlroGCPhysRangeGet(&pVM->iom.s.CTX_SUFF(pTrees)->MMIOTree, GCPhys);
+    PIOMMMIORANGE pRange = iomMmioGetRangeWorker(pVM, pVCpu, GCPhys);
     if (pRange)
         iomMmioRetainRange(pRange);
 
@@ -143,14 +388,16 @@ DECLINLINE(void) iomMmioReleaseRange(PVM pVM, PIOMMMIORANGE pRange)
  * @param   pVM     The cross context VM structure.
  * @param   pVCpu   The cross context virtual CPU structure of the calling EMT.
  * @param   GCPhys  Physical address to lookup.
+ *
+ * @remarks Without the IOM lock the range may be freed at any time after
+ *          this returns, so this is only for assertions.  The lookup table
+ *          itself is protected by a lookup section.
  */
 DECLINLINE(PIOMMMIORANGE) iomMMIOGetRangeUnsafe(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys)
 {
-    PIOMMMIORANGE pRange = pVCpu->iom.s.CTX_SUFF(pMMIORangeLast);
-    if (    !pRange
-        ||  GCPhys - pRange->GCPhys >= pRange->cb)
-        pVCpu->iom.s.CTX_SUFF(pMMIORangeLast) = pRange
-            = (PIOMMMIORANGE)RTAvlroGCPhysRangeGet(&pVM->iom.s.CTX_SUFF(pTrees)->MMIOTree, GCPhys);
+    iomLookupEnter(pVM, pVCpu);
+    PIOMMMIORANGE pRange = iomMmioGetRangeWorker(pVM, pVCpu, GCPhys);
+    iomLookupLeave(pVCpu);
     return pRange;
 }
 #endif /* VBOX_STRICT */
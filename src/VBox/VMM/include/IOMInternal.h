@@ -270,6 +270,103 @@ AssertCompileMemberAlignment(IOMIOPORTSTATS, InR3, 8);
 typedef IOMIOPORTSTATS *PIOMIOPORTSTATS;
 
 
+/**
+ * I/O port lookup table entry.
+ */
+typedef struct IOMIOPORTLOOKUPENTRY
+{
+    /** The first port in the range. */
+    RTIOPORT                    uFirstPort;
+    /** The last port in the range (inclusive). */
+    RTIOPORT                    uLastPort;
+    /** Offset of the range descriptor relative to the IOMTREES structure. */
+    int32_t                     offRange;
+} IOMIOPORTLOOKUPENTRY;
+/** Pointer to an I/O port lookup table entry. */
+typedef IOMIOPORTLOOKUPENTRY *PIOMIOPORTLOOKUPENTRY;
+/** Pointer to a const I/O port lookup table entry. */
+typedef IOMIOPORTLOOKUPENTRY const *PCIOMIOPORTLOOKUPENTRY;
+
+/**
+ * I/O port lookup table.
+ *
+ * Sorted array of the ranges in one of the I/O port trees, see
+ * @ref sec_iom_lookup.
+ */
+typedef struct IOMIOPORTLOOKUP
+{
+    /** Number of entries. */
+    uint32_t                    cEntries;
+    /** Explicit padding. */
+    uint32_t                    u32Padding;
+    /** The entries, sorted by port (variable size). */
+    IOMIOPORTLOOKUPENTRY        aEntries[1];
+} IOMIOPORTLOOKUP;
+/** Pointer to a const I/O port lookup table. */
+typedef IOMIOPORTLOOKUP const *PCIOMIOPORTLOOKUP;
+
+/**
+ * MMIO lookup table entry.
+ */
+typedef struct IOMMMIOLOOKUPENTRY
+{
+    /** The first address in the range. */
+    RTGCPHYS                    GCPhysFirst;
+    /** The last address in the range (inclusive). */
+    RTGCPHYS                    GCPhysLast;
+    /** Offset of the range descriptor relative to the IOMTREES structure. */
+    int32_t                     offRange;
+    /** Explicit padding. */
+    uint32_t                    u32Padding;
+} IOMMMIOLOOKUPENTRY;
+/** Pointer to a MMIO lookup table entry. */
+typedef IOMMMIOLOOKUPENTRY *PIOMMMIOLOOKUPENTRY;
+/** Pointer to a const MMIO lookup table entry. */
+typedef IOMMMIOLOOKUPENTRY const *PCIOMMMIOLOOKUPENTRY;
+
+/**
+ * MMIO lookup table.
+ *
+ * Sorted array of the ranges in the MMIO tree, see @ref sec_iom_lookup.
+ */
+typedef struct IOMMMIOLOOKUP
+{
+    /** Number of entries. */
+    uint32_t                    cEntries;
+    /** Explicit padding. */
+    uint32_t                    u32Padding;
+    /** The entries, sorted by address (variable size). */
+    IOMMMIOLOOKUPENTRY          aEntries[1];
+} IOMMMIOLOOKUP;
+/** Pointer to a const MMIO lookup table. */
+typedef IOMMMIOLOOKUP const *PCIOMMMIOLOOKUP;
+
+/** The number of entries in each of the per-VCPU range lookup caches. */
+#define IOM_LOOKUP_CACHE_ENTRIES    4
+
+/** Converts an offset relative to the IOMTREES structure into a pointer.
+ * The range descriptors and lookup tables all live on the hypervisor heap
+ * together with IOMTREES, so such offsets are valid in all contexts. */
+#define IOM_TREES_OFF2PTR(a_pTrees, a_off, a_Type) ( (a_Type)((uintptr_t)(a_pTrees) + (intptr_t)(a_off)) )
+
+/**
+ * Lookup table or range descriptor waiting to be freed (ring-3 only).
+ *
+ * See @ref sec_iom_lookup.
+ */
+typedef struct IOMLOOKUPRETIRED
+{
+    /** Pointer to the next retired block. */
+    struct IOMLOOKUPRETIRED    *pNext;
+    /** The hypervisor heap block. */
+    void                       *pvHyper;
+    /** The first lookup epoch in which the block is unreachable. */
+    uint32_t                    uEpoch;
+} IOMLOOKUPRETIRED;
+/** Pointer to a retired lookup block. */
+typedef IOMLOOKUPRETIRED *PIOMLOOKUPRETIRED;
+
+
 /**
  * The IOM trees.
  * These are offset based the nodes and root must be in the same
@@ -292,6 +389,19 @@ typedef struct IOMTREES
     AVLOIOPORTTREE          IOPortStatTree;
     /** Tree containing MMIO statistics (IOMMMIOSTATS). */
     AVLOGCPHYSTREE          MmioStatTree;
+
+    /** @name Lookup tables, see @ref sec_iom_lookup.
+     * These are offsets relative to this structure, 0 if there are no ranges.
+     * @{ */
+    /** The ring-3 I/O port lookup table (IOMIOPORTLOOKUP). */
+    int32_t volatile        offIOPortLookupR3;
+    /** The ring-0 I/O port lookup table (IOMIOPORTLOOKUP). */
+    int32_t volatile        offIOPortLookupR0;
+    /** The raw-mode I/O port lookup table (IOMIOPORTLOOKUP). */
+    int32_t volatile        offIOPortLookupRC;
+    /** The MMIO lookup table (IOMMMIOLOOKUP). */
+    int32_t volatile        offMmioLookup;
+    /** @} */
 } IOMTREES;
 /** Pointer to the IOM trees. */
 typedef IOMTREES *PIOMTREES;
@@ -321,7 +431,12 @@ typedef struct IOM
 
     /** MMIO physical access handler type.   */
     PGMPHYSHANDLERTYPE              hMmioHandlerType;
-    uint32_t                        u32Padding;
+    /** The current lookup epoch, see @ref sec_iom_lookup.
+     * This is always even and non-zero and advanced by two whenever new lookup
+     * tables are published. */
+    uint32_t volatile               uLookupEpoch;
+    /** List of lookup tables and range descriptors waiting to be freed. */
+    R3PTRTYPE(PIOMLOOKUPRETIRED)    pLookupRetiredR3;
 
     /** Lock serializing EMT access to IOM. */
 #ifdef IOM_WITH_CRIT_SECT_RW
@@ -367,7 +482,23 @@ typedef struct IOM
     STAMCOUNTER                     StatRZMMIO8Bytes;
 
     STAMCOUNTER                     StatR3MMIOHandler;
+    /** @} */
 
+    /** @name Lookup statistics.
+     * @{ */
+    STAMPROFILE                     StatIOPortLookupRZ;
+    STAMPROFILE                     StatIOPortLookupR3;
+    STAMPROFILE                     StatMmioLookupRZ;
+    STAMPROFILE                     StatMmioLookupR3;
+    STAMCOUNTER                     StatIOPortLookupCacheHits;
+    STAMCOUNTER                     StatIOPortLookupMisses;
+    STAMCOUNTER                     StatMmioLookupCacheHits;
+    STAMCOUNTER                     StatMmioLookupMisses;
+    STAMCOUNTER                     StatLookupRebuilds;
+    /** @} */
+
+    /** @name MMIO instruction emulation limits.
+     * @{ */
     RTUINT                          cMovsMaxBytes;
     RTUINT                          cStosMaxBytes;
     /** @} */
@@ -385,30 +516,48 @@ typedef struct IOMCPU
      * on the stack. */
     DISCPUSTATE                     DisState;
 
-    /** @name Caching of I/O Port and MMIO ranges and statistics.
+    /** @name Caching of I/O Port and MMIO statistics.
      * (Saves quite some time in rep outs/ins instruction emulation.)
      * @{ */
-    R3PTRTYPE(PIOMIOPORTRANGER3)    pRangeLastReadR3;
-    R3PTRTYPE(PIOMIOPORTRANGER3)    pRangeLastWriteR3;
     R3PTRTYPE(PIOMIOPORTSTATS)      pStatsLastReadR3;
     R3PTRTYPE(PIOMIOPORTSTATS)      pStatsLastWriteR3;
-    R3PTRTYPE(PIOMMMIORANGE)        pMMIORangeLastR3;
     R3PTRTYPE(PIOMMMIOSTATS)        pMMIOStatsLastR3;
 
-    R0PTRTYPE(PIOMIOPORTRANGER0)    pRangeLastReadR0;
-    R0PTRTYPE(PIOMIOPORTRANGER0)    pRangeLastWriteR0;
     R0PTRTYPE(PIOMIOPORTSTATS)      pStatsLastReadR0;
     R0PTRTYPE(PIOMIOPORTSTATS)      pStatsLastWriteR0;
-    R0PTRTYPE(PIOMMMIORANGE)        pMMIORangeLastR0;
     R0PTRTYPE(PIOMMMIOSTATS)        pMMIOStatsLastR0;
 
-    RCPTRTYPE(PIOMIOPORTRANGERC)    pRangeLastReadRC;
-    RCPTRTYPE(PIOMIOPORTRANGERC)    pRangeLastWriteRC;
     RCPTRTYPE(PIOMIOPORTSTATS)      pStatsLastReadRC;
     RCPTRTYPE(PIOMIOPORTSTATS)      pStatsLastWriteRC;
-    RCPTRTYPE(PIOMMMIORANGE)        pMMIORangeLastRC;
     RCPTRTYPE(PIOMMMIOSTATS)        pMMIOStatsLastRC;
     /** @} */
+
+    /** @name Range lookup, see @ref sec_iom_lookup.
+     * @{ */
+    /** The lookup epoch this EMT is currently reading the I/O port tables in,
+     * 0 if it isn't. */
+    uint32_t volatile               uLookupEpoch;
+    /** The lookup epoch the range caches below were filled in. */
+    uint32_t                        uCacheEpoch;
+    /** Next ring-3 I/O port cache entry to replace. */
+    uint8_t                         iIOPortCacheNextR3;
+    /** Next ring-0 I/O port cache entry to replace. */
+    uint8_t                         iIOPortCacheNextR0;
+    /** Next raw-mode I/O port cache entry to replace. */
+    uint8_t                         iIOPortCacheNextRC;
+    /** Next MMIO cache entry to replace. */
+    uint8_t                         iMmioCacheNext;
+    /** Explicit padding. */
+    uint32_t                        u32Padding;
+    /** Recently used ring-3 I/O port ranges. */
+    IOMIOPORTLOOKUPENTRY            aIOPortCacheR3[IOM_LOOKUP_CACHE_ENTRIES];
+    /** Recently used ring-0 I/O port ranges. */
+    IOMIOPORTLOOKUPENTRY            aIOPortCacheR0[IOM_LOOKUP_CACHE_ENTRIES];
+    /** Recently used raw-mode I/O port ranges. */
+    IOMIOPORTLOOKUPENTRY            aIOPortCacheRC[IOM_LOOKUP_CACHE_ENTRIES];
+    /** Recently used MMIO ranges. */
+    IOMMMIOLOOKUPENTRY              aMmioCache[IOM_LOOKUP_CACHE_ENTRIES];
+    /** @} */
 } IOMCPU;
 /** Pointer to IOM per virtual CPU instance data. */
 typedef IOMCPU *PIOMCPU;
@@ -419,6 +568,9 @@ RT_C_DECLS_BEGIN
 void                iomMmioFreeRange(PVM pVM, PIOMMMIORANGE pRange);
 #ifdef IN_RING3
 PIOMMMIOSTATS       iomR3MMIOStatsCreate(PVM pVM, RTGCPHYS GCPhys, const char *pszDesc);
+void                iomR3LookupRebuild(PVM pVM, bool fIOPorts, bool fMmio);
+void                iomR3LookupRetire(PVM pVM, void *pvHyper);
+void                iomR3LookupReclaim(PVM pVM);
 #endif /* IN_RING3 */
 
 #ifndef IN_RING3
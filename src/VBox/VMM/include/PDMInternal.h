@@ -271,6 +271,70 @@ typedef struct PDMDRVINSINT
 } PDMDRVINSINT;
 
 
+/** Number of buckets in the critical section contention histograms.
+ * Bucket 0 covers waits and holds shorter than 2^10 ticks, bucket i (i > 0)
+ * covers [2^(8+2i), 2^(10+2i)) ticks, and the last one everything longer. */
+#define PDMCRITSECTPROF_HIST_BUCKETS    16
+/** Number of call sites tracked per critical section. */
+#define PDMCRITSECTPROF_CALLERS         8
+/** Max number of critical sections that can be profiled. */
+#define PDMCRITSECTPROF_MAX             128
+/** @name PDMCRITSECTPROF_CTX_XXX - Call site contexts.
+ * @{ */
+#define PDMCRITSECTPROF_CTX_R3          0
+#define PDMCRITSECTPROF_CTX_R0          1
+#define PDMCRITSECTPROF_CTX_RC          2
+/** @} */
+
+/**
+ * A call site tracked by the critical section contention profiler.
+ */
+typedef struct PDMCRITSECTPROFCALLER
+{
+    /** The return address of the caller, 0 if the entry is unused. */
+    uint64_t                        uCaller;
+    /** Total number of ticks spent waiting. */
+    uint64_t                        cTicksWaited;
+    /** Number of waits. */
+    uint32_t                        cWaits;
+    /** The context the caller executed in, PDMCRITSECTPROF_CTX_XXX. */
+    uint32_t                        iCtx;
+} PDMCRITSECTPROFCALLER;
+/** Pointer to a tracked call site. */
+typedef PDMCRITSECTPROFCALLER *PPDMCRITSECTPROFCALLER;
+
+/**
+ * Critical section contention profile.
+ *
+ * These are allocated from the hyper heap (see PDM::offCritSectProfiles) when
+ * the PDM/CritSectProfiling CFGM key is set, and are only updated when the
+ * critical section is contended and while it is owned.  Since the owner (or
+ * the exclusive owner for read/write sections) is the only one updating them,
+ * most members don't need atomic updates.
+ */
+typedef struct PDMCRITSECTPROFILE
+{
+    /** TSC when the current owner got the section, 0 if not timing. */
+    uint64_t                        uHoldStartTsc;
+    /** Profiling the time spent waiting for the section (ticks). */
+    STAMPROFILE                     StatWait;
+    /** Profiling the time the section is held (ticks). */
+    STAMPROFILE                     StatHold;
+    /** Wait time histogram.  Atomic (shared waiters). */
+    uint32_t volatile               acWaitHist[PDMCRITSECTPROF_HIST_BUCKETS];
+    /** Hold time histogram. */
+    uint32_t                        acHoldHist[PDMCRITSECTPROF_HIST_BUCKETS];
+    /** The top call sites by time spent waiting (approximate). */
+    PDMCRITSECTPROFCALLER           aCallers[PDMCRITSECTPROF_CALLERS];
+    /** Waits per virtual CPU.  The entry at PDM::cCritSectProfileCpus is for
+     * non-EMT threads.  Atomic. */
+    uint32_t volatile               acWaitsByCpu[1];
+} PDMCRITSECTPROFILE;
+AssertCompileMemberAlignment(PDMCRITSECTPROFILE, StatWait, 8);
+/** Pointer to a critical section contention profile. */
+typedef PDMCRITSECTPROFILE *PPDMCRITSECTPROFILE;
+
+
 /**
  * Private critical section data.
  */
@@ -298,8 +362,9 @@ typedef struct PDMCRITSECTINT
     /** Set if the critical section is used by a timer or similar.
      * See PDMR3DevGetCritSect.  */
     bool                            fUsedByTimerOrSimilar;
-    /** Alignment padding. */
-    bool                            afPadding[2];
+    /** The contention profile index (1-based), 0 if not profiled.
+     * See PDMCRITSECTPROFILE. */
+    uint16_t                        idxProfile;
     /** Support driver event semaphore that is scheduled to be signaled upon leaving
      * the critical section. This is only for Ring-3 and Ring-0. */
     SUPSEMEVENT                     hEventToSignal;
@@ -346,8 +411,13 @@ typedef struct PDMCRITSECTRWINT
     /** Pointer to the VM - GCPtr. */
     PVMRC                               pVMRC;
 #if HC_ARCH_BITS == 64
+    /** The contention profile index (1-based), 0 if not profiled.
+     * See PDMCRITSECTPROFILE.  This lives in what used to be alignment
+     * padding.  There is no room for it on 32-bit hosts, so read/write
+     * critical sections are not profiled there. */
+    uint16_t                            idxProfile;
     /** Alignment padding. */
-    RTRCPTR                             RCPtrPadding;
+    uint16_t                            u16Padding;
 #endif
     /** The lock name. */
     R3PTRTYPE(const char *)             pszName;
@@ -379,6 +449,16 @@ AssertCompileMemberAlignment(PDMCRITSECTRWINT, Core.u64State, 8);
 /** Pointer to private critical section data. */
 typedef PDMCRITSECTRWINT *PPDMCRITSECTRWINT;
 
+/** @def PDMCRITSECTRWINT_PROFILE_IDX
+ * Gets the contention profile index of a read/write critical section, this
+ * is always 0 on 32-bit hosts (see PDMCRITSECTRWINT::idxProfile).
+ * @param   a_pCritSect     Pointer to the PDMCRITSECTRWINT. */
+#if HC_ARCH_BITS == 64
+# define PDMCRITSECTRWINT_PROFILE_IDX(a_pCritSect)  ((a_pCritSect)->idxProfile)
+#else
+# define PDMCRITSECTRWINT_PROFILE_IDX(a_pCritSect)  ((uint16_t)0)
+#endif
+
 
 
 /**
@@ -1139,6 +1219,19 @@ typedef struct PDM
     RTGCPHYS                        GCPhysVMMDevHeap;
     /** @} */
 
+    /** @name   Critical section contention profiling
+     * @{ */
+    /** Hyper heap offset of the PDMCRITSECTPROF_MAX contention profiles, 0 if
+     * profiling is disabled. */
+    uint32_t                        offCritSectProfiles;
+    /** The size of each contention profile. */
+    uint32_t                        cbCritSectProfile;
+    /** Number of contention profiles handed out. */
+    uint32_t                        cCritSectProfiles;
+    /** The number of virtual CPUs the profiles cover (PDMCRITSECTPROFILE::acWaitsByCpu). */
+    uint32_t                        cCritSectProfileCpus;
+    /** @} */
+
     /** Number of times a critical section leave request needed to be queued for ring-3 execution. */
     STAMCOUNTER                     StatQueuedCritSectLeaves;
 } PDM;
@@ -1341,6 +1434,10 @@ void        pdmUnlock(PVM pVM);
 void        pdmCritSectRwLeaveSharedQueued(PPDMCRITSECTRW pThis);
 void        pdmCritSectRwLeaveExclQueued(PPDMCRITSECTRW pThis);
 #endif
+PPDMCRITSECTPROFILE pdmCritSectProfileGet(PVM pVM, uint16_t idxProfile);
+void        pdmCritSectProfileWaitDone(PVM pVM, uint16_t idxProfile, uint64_t uWaitStartTsc, RTHCUINTPTR uCaller, bool fOwner);
+void        pdmCritSectProfileHoldStart(PVM pVM, uint16_t idxProfile);
+void        pdmCritSectProfileHoldDone(PVM pVM, uint16_t idxProfile);
 
 /** @} */
 
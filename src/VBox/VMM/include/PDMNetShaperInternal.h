@@ -15,8 +15,18 @@
  * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
  */
 
+/** The upper limit for the credit a filter takes from its bandwidth group
+ * in one go and then consumes without touching the group (bytes). */
+#define PDM_NETSHAPER_MAX_CREDIT_CHUNK  UINT32_C(16384)
+
 /**
  * Bandwidth group instance data
+ *
+ * The token bucket is implemented as a virtual scheduling clock (GCRA): tsTat
+ * is the time at which all bandwidth handed out so far has been paid for.  The
+ * bucket is full when tsTat lies in the past and empty when it is cNsBucket
+ * ahead of the current time.  This allows allocating bandwidth with a single
+ * compare-and-exchange, no lock required.
  */
 typedef struct PDMNSBWGROUP
 {
@@ -24,7 +34,8 @@ typedef struct PDMNSBWGROUP
     R3PTRTYPE(struct PDMNSBWGROUP *)            pNextR3;
     /** Pointer to the shared UVM structure. */
     R3PTRTYPE(struct PDMNETSHAPER *)            pShaperR3;
-    /** Critical section protecting all members below. */
+    /** Critical section protecting the filter list and limit changes.
+     * Not taken when allocating bandwidth. */
     PDMCRITSECT                                 Lock;
     /** Pointer to the first filter attached to this group. */
     R3PTRTYPE(struct PDMNSFILTER *)             pFiltersHeadR3;
@@ -34,13 +45,45 @@ typedef struct PDMNSBWGROUP
     volatile uint64_t                           cbPerSecMax;
     /** Number of bytes we are allowed to transfer in one burst. */
     volatile uint32_t                           cbBucket;
-    /** Number of bytes we were allowed to transfer at the last update. */
-    volatile uint32_t                           cbTokensLast;
-    /** Timestamp of the last update */
-    volatile uint64_t                           tsUpdatedLast;
+    /** Number of bytes a filter takes from the group in advance. */
+    volatile uint32_t                           cbCreditChunk;
+    /** The time it takes to fill an empty bucket, in nanoseconds. */
+    volatile uint64_t                           cNsBucket;
+    /** The limit generation, incremented when the limit changes so that the
+     * filters drop the credit they cached. */
+    volatile uint32_t                           uGeneration;
     /** Reference counter - How many filters are associated with this group. */
     volatile uint32_t                           cRefs;
+    /** Earliest time (RTTimeSystemNanoTS) at which a choked filter of this group
+     * can be satisfied, UINT64_MAX if no filter is waiting. */
+    volatile uint64_t                           tsNextWakeup;
+    /** Alignment padding, keeps the frequently updated tsTat on its own cache line. */
+    uint8_t                                     abPadding[64];
+    /** The theoretical arrival time (RTTimeSystemNanoTS) of the bucket. */
+    volatile uint64_t                           tsTat;
 } PDMNSBWGROUP;
 /** Pointer to a bandwidth group. */
 typedef PDMNSBWGROUP *PPDMNSBWGROUP;
 
+
+/**
+ * Calculates the derived bucket parameters for a new rate limit.
+ *
+ * @param   pBwGroup        The bandwidth group.
+ * @param   cbPerSecMax     The new rate limit in bytes per second, 0 to disable.
+ */
+DECLINLINE(void) pdmNsBwGroupCalcLimits(PPDMNSBWGROUP pBwGroup, uint64_t cbPerSecMax)
+{
+    uint32_t const cbBucket = (uint32_t)RT_MIN(RT_MAX(PDM_NETSHAPER_MIN_BUCKET_SIZE, cbPerSecMax * PDM_NETSHAPER_MAX_LATENCY / 1000),
+                                               UINT32_MAX);
+    pBwGroup->cbBucket      = cbBucket;
+    pBwGroup->cbCreditChunk = RT_MIN(cbBucket / 16, PDM_NETSHAPER_MAX_CREDIT_CHUNK);
+    pBwGroup->cNsBucket     = cbPerSecMax ? (uint64_t)cbBucket * RT_NS_1SEC / cbPerSecMax : 0;
+    ASMAtomicWriteU64(&pBwGroup->cbPerSecMax, cbPerSecMax);
+    ASMAtomicIncU32(&pBwGroup->uGeneration);
+}
+
+#ifdef IN_RING3
+void pdmR3NsTxKick(struct PDMNETSHAPER *pShaper, uint64_t tsDeadline);
+#endif
+
@@ -278,6 +278,7 @@ DECLINLINE(int) pgmRZDynMapGCPageV2Inlined(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhy
     RTGCPHYS off;
     if (   !pRam
         || (off = GCPhys - pRam->GCPhys) >= pRam->cb
+        || RT_UNLIKELY(pVM->pgm.s.fPostCopyTrgArmed) /* the common code fetches missing pages */
         /** @todo   || page state stuff */
        )
     {
@@ -356,6 +357,7 @@ DECLINLINE(int) pgmRZDynMapGCPageOffInlined(PVMCPU pVCpu, RTGCPHYS GCPhys, void
     RTGCPHYS        off;
     if (   !pRam
         || (off = GCPhys - pRam->GCPhys) >= pRam->cb
+        || RT_UNLIKELY(pVM->pgm.s.fPostCopyTrgArmed) /* the common code fetches missing pages */
         /** @todo   || page state stuff */
        )
     {
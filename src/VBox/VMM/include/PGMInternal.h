@@ -1471,6 +1471,251 @@ typedef PGMLIVESAVERAMPAGE *PPGMLIVESAVERAMPAGE;
 #define PGMLIVSAVEPAGE_MAX_DIRTIED 0x00fffff0
 
 
+/**
+ * Duplicate page cache entry used when saving RAM pages.
+ *
+ * The cache is direct mapped on the content hash and only remembers pages
+ * saved in full earlier in the current pass, see pgmR3SaveRamPages.
+ */
+typedef struct PGMSAVEDUPENTRY
+{
+    /** The hash of the page content. */
+    uint64_t    uHash;
+    /** The guest physical address of the page. */
+    RTGCPHYS    GCPhys;
+    /** The pass (cache generation) this entry belongs to, 0 if unused. */
+    uint32_t    uGen;
+    /** Explicit alignment padding. */
+    uint32_t    u32Alignment;
+} PGMSAVEDUPENTRY;
+AssertCompileSize(PGMSAVEDUPENTRY, 24);
+/** Pointer to a duplicate page cache entry. */
+typedef PGMSAVEDUPENTRY *PPGMSAVEDUPENTRY;
+
+/** The number of entries in the duplicate page cache (power of two). */
+#define PGM_SAVE_DUP_CACHE_ENTRIES  _32K
+
+
+/** The number of pages covered by a post-copy chunk (32 MB). */
+#define PGM_POSTCOPY_CHUNK_PAGES    _8K
+/** The number of received pages the post-copy target can have waiting to be
+ *  installed by an EMT. */
+#define PGM_POSTCOPY_QUEUE_SIZE     32
+
+/**
+ * Post-copy chunk.
+ *
+ * Tracks the pages which are yet to be transferred in a naturally aligned
+ * 32 MB window of guest physical memory.  A chunk never crosses a RAM range,
+ * so on the target it can be covered by a single access handler.
+ */
+typedef struct PGMPOSTCOPYCHUNK
+{
+    /** The address of the first page in the chunk. */
+    RTGCPHYS                GCPhys;
+    /** The number of pages covered by the chunk. */
+    uint32_t                cPages;
+    /** The number of bits set in bmPending. */
+    uint32_t                cPending;
+    /** The start of the access handler range, NIL_RTGCPHYS if the chunk
+     *  isn't armed (source, or target registration failure). */
+    RTGCPHYS                GCPhysHandler;
+    /** The end of the access handler range (inclusive). */
+    RTGCPHYS                GCPhysHandlerLast;
+    /** Bitmap of the pending pages. */
+    uint64_t                bmPending[PGM_POSTCOPY_CHUNK_PAGES / 64];
+} PGMPOSTCOPYCHUNK;
+/** Pointer to a post-copy chunk. */
+typedef PGMPOSTCOPYCHUNK *PPGMPOSTCOPYCHUNK;
+
+/**
+ * A received page waiting to be installed by an EMT (post-copy target).
+ */
+typedef struct PGMPOSTCOPYQENTRY
+{
+    /** The guest physical address of the page. */
+    RTGCPHYS                GCPhys;
+    /** Set if it's a zero page, abPage is then not used. */
+    bool                    fZero;
+    /** Explicit alignment padding. */
+    bool                    afAlignment[7];
+    /** The page content. */
+    uint8_t                 abPage[PAGE_SIZE];
+} PGMPOSTCOPYQENTRY;
+/** Pointer to a queued post-copy page. */
+typedef PGMPOSTCOPYQENTRY *PPGMPOSTCOPYQENTRY;
+
+/** The number of page requests the lazy restore thread can have waiting. */
+#define PGM_LAZY_DEMAND_SIZE        64
+
+/**
+ * A run of consecutive RAM pages in the lazy restore extent of a saved state.
+ */
+typedef struct PGMLAZYRUN
+{
+    /** The address of the first page. */
+    RTGCPHYS                GCPhys;
+    /** The file offset of the first page, the others follow at
+     *  PGMLAZY::cbStride intervals. */
+    uint64_t                offFile;
+    /** The number of pages. */
+    uint32_t                cPages;
+    /** Explicit alignment padding. */
+    uint32_t                u32Padding;
+} PGMLAZYRUN;
+/** Pointer to a lazy restore run. */
+typedef PGMLAZYRUN *PPGMLAZYRUN;
+
+/**
+ * Lazy restore state, see PGMSavedState.cpp and PGMPostCopy.cpp.
+ *
+ * When saving, this collects the RAM pages the final pass left to the
+ * "pgmlazy" unit.  When loading, it holds the index of the pages in the
+ * saved state file, which the post-copy target machinery then reads the pages
+ * from on demand and in the background.
+ */
+typedef struct PGMLAZY
+{
+    /** The runs of pages, sorted by address. */
+    PPGMLAZYRUN             paRuns;
+    /** The number of runs. */
+    uint32_t                cRuns;
+    /** The number of entries allocated for paRuns. */
+    uint32_t                cRunsAlloc;
+    /** The total number of pages. */
+    uint32_t                cPages;
+    /** The distance between two pages in the file (record header + page). */
+    uint32_t                cbStride;
+    /** The file offset following the last page. */
+    uint64_t                offEnd;
+    /** The saved state file (load), NIL_RTFILE if not open. */
+    RTFILE                  hFile;
+    /** The background reader thread. */
+    RTTHREAD                hThread;
+    /** Signalled when a page is requested or the thread should stop. */
+    RTSEMEVENT              hEvtDemand;
+    /** Tells the thread to stop. */
+    bool volatile           fStop;
+    /** Explicit alignment padding. */
+    bool                    afAlignment[3];
+    /** The run the background reading continues at. */
+    uint32_t                iRunNext;
+    /** The page within iRunNext the background reading continues at. */
+    uint32_t                iPageNext;
+    /** The demand queue producer index (free running).  Protected by the
+     *  post-copy critsect. */
+    uint32_t                iDemandHead;
+    /** The demand queue consumer index (free running). */
+    uint32_t                iDemandTail;
+    /** The pages requested by the EMTs. */
+    RTGCPHYS                aDemand[PGM_LAZY_DEMAND_SIZE];
+} PGMLAZY;
+/** Pointer to the lazy restore state. */
+typedef PGMLAZY *PPGMLAZY;
+
+/**
+ * Post-copy teleportation state, see PGMPostCopy.cpp.
+ *
+ * On the source this lists the RAM pages the final live save pass deferred,
+ * on the target the pages which the loaded state lacks.
+ */
+typedef struct PGMPOSTCOPY
+{
+    /** Protects the members below against the EMTs and the thread feeding
+     *  us.  Lock order: the PGM lock, then this.  EMTs may have to wait for a
+     *  page while owning the PGM lock (guest paging structure walks), so they
+     *  enter it via pgmR3PostCopyEnter.  Other threads must not take the PGM
+     *  lock while owning it. */
+    RTCRITSECT              CritSect;
+    /** Set on the source, clear on the target. */
+    bool                    fSource;
+    /** Set when the transfer was aborted (target). */
+    bool volatile           fAborted;
+    /** Set when an install request has been queued for an EMT (target). */
+    bool                    fInstallPending;
+    /** Set when there are complete chunks whose access handler has yet to be
+     *  deregistered, see pgmR3PostCopyTrgRetireChunks (target). */
+    bool                    fRetirePending;
+    /** The total number of pending pages. */
+    uint32_t volatile       cPending;
+    /** The number of chunks. */
+    uint32_t                cChunks;
+    /** The number of entries allocated for papChunks. */
+    uint32_t                cChunksAlloc;
+    /** The chunks, sorted by address. */
+    PPGMPOSTCOPYCHUNK      *papChunks;
+    /** Where to resume looking for pages to push (source). */
+    uint32_t                iNextChunk;
+    /** The number of pages initially pending. */
+    uint32_t                cPagesTotal;
+    /** Requests a page from the source (target), NULL until the transfer
+     *  has been started. */
+    PFNPGMPOSTCOPYREQUEST   pfnRequest;
+    /** User argument for pfnRequest. */
+    void                   *pvUser;
+    /** Signalled when a page is queued or installed and when aborting. */
+    RTSEMEVENTMULTI         hEvtUpdate;
+    /** Signalled when there is room in the queue again. */
+    RTSEMEVENT              hEvtSpace;
+    /** The queue producer index (free running). */
+    uint32_t                iHead;
+    /** The queue consumer index (free running). */
+    uint32_t                iTail;
+    /** The queue of received pages (target). */
+    PPGMPOSTCOPYQENTRY      paQueue;
+    /** RTTimeNanoTS when the transfer was started (target). */
+    uint64_t                nsStart;
+    /** The number of times the guest or a device had to wait for a page. */
+    uint64_t                cDemandFaults;
+    /** The total time spent waiting for pages. */
+    uint64_t                cNsDemandWait;
+    /** The longest wait for a page. */
+    uint64_t                cNsDemandWaitMax;
+    /** The lazy restore feeding us instead of a teleportation source, NULL
+     *  if none (target). */
+    PPGMLAZY                pLazy;
+} PGMPOSTCOPY;
+/** Pointer to the post-copy state. */
+typedef PGMPOSTCOPY *PPGMPOSTCOPY;
+
+
+/**
+ * Delta saved state tracking, see PGMSavedState.cpp.
+ *
+ * When enabled, RAM pages are kept write monitored after a state has been
+ * saved to or loaded from a file, so that the next save can leave out the RAM
+ * pages which haven't changed since and refer to that file (the parent)
+ * instead.
+ */
+typedef struct PGMDELTA
+{
+    /** Set while the write monitoring tracks the changes relative to
+     *  UuidBase.  Protected by the PGM lock. */
+    bool                    fTracking;
+    /** Set if the next save is a delta against pszParent. */
+    bool                    fNextIsDelta;
+    /** Set if the save in progress is a delta, i.e. leaves out unchanged pages. */
+    bool                    fSavingDelta;
+    /** Explicit alignment padding. */
+    bool                    afAlignment[5];
+    /** The identity of the saved state the RAM was last in sync with. */
+    RTUUID                  UuidBase;
+    /** The identity of the saved state being written or loaded. */
+    RTUUID                  UuidSave;
+    /** The identity of the parent states composed by the load prep, nil if
+     *  none. */
+    RTUUID                  UuidComposed;
+    /** The parent for the next save (RTStrDup), NULL if none. */
+    char                   *pszParent;
+    /** The number of parent files composed by the last load. */
+    uint32_t                cComposedFiles;
+    /** The number of RAM pages left out by the last delta save. */
+    uint32_t                cSkippedPages;
+} PGMDELTA;
+/** Pointer to the delta saved state tracking. */
+typedef PGMDELTA *PPGMDELTA;
+
+
 /**
  * RAM range for GC Phys to HC Phys conversion.
  *
@@ -3273,8 +3518,9 @@ typedef struct PGM
 
     /** Physical access handler type for ROM protection. */
     PGMPHYSHANDLERTYPE              hRomPhysHandlerType;
-    /** Alignment padding.   */
-    uint32_t                        u32Padding;
+    /** Physical access handler type for pages still missing on a post-copy
+     *  teleportation target. */
+    PGMPHYSHANDLERTYPE              hPostCopyPhysHandlerType;
 
     /** 4 MB page mask; 32 or 36 bits depending on PSE-36 (identical for all VCPUs) */
     RTGCPHYS                        GCPhys4MBPSEMask;
@@ -3549,8 +3795,102 @@ typedef struct PGM
         /** Pages per second (for statistics). */
         uint32_t                    cPagesPerSecond;
         uint32_t                    cAlignment;
+        /** The duplicate page cache, NULL if not allocated.  This is used by
+         * both live and regular saves and freed by pgmR3SaveDone. */
+        R3PTRTYPE(PPGMSAVEDUPENTRY) paDupCache;
+        /** The current duplicate page cache generation, incremented every pass. */
+        uint32_t                    uDupCacheGen;
+        /** The number of RAM pages saved as references to identical pages. */
+        uint32_t                    cDupPages;
+        /** Whether the final pass may defer RAM pages to a post-copy phase,
+         *  see PGMR3PostCopySrcEnable. */
+        bool                        fPostCopy;
+        /** Explicit alignment padding. */
+        bool                        afAlignment[3];
+        /** The max number of hot pages the final pass saves when deferring the
+         *  rest to post-copy. */
+        uint32_t                    cPostCopyHotPages;
     } LiveSave;
 
+    /** The post-copy teleportation state, NULL if none.  Ring-3 only. */
+    R3PTRTYPE(PPGMPOSTCOPY)         pPostCopyR3;
+    /** The delta saved state tracking, NULL if not enabled.  Ring-3 only. */
+    R3PTRTYPE(PPGMDELTA)            pDeltaR3;
+    /** The lazy restore state of the save or load in progress, NULL if none.
+     *  Ring-3 only. */
+    R3PTRTYPE(PPGMLAZY)             pLazyR3;
+    /** Whether saved states are written and loaded for lazy restore
+     *  (/PGM/LazyRestore). */
+    bool                            fLazyRestore;
+    /** Set while post-copy access handlers are registered on the target.
+     *  Makes the guest page mapping paths call pgmPhysPostCopyFetch. */
+    bool volatile                   fPostCopyTrgArmed;
+    /** Explicit alignment padding. */
+    bool                            afAlignmentLazy[6];
+
+    /** The content based page fusion scanner, see pgmR3PageFusionScanInit. */
+    struct
+    {
+        /** The pass timer (TMCLOCK_VIRTUAL), NULL if the scanner is disabled.
+         *  Ring-3 only. */
+        R3PTRTYPE(PTMTIMER)         pTimerR3;
+        /** Where the next pass continues. */
+        RTGCPHYS                    GCPhysNext;
+        /** @cfgm{/PGM/PageFusionScanPages, uint32_t, 2048}
+         * The max number of pages hashed per pass. */
+        uint32_t                    cPagesPerPass;
+        /** @cfgm{/PGM/PageFusionScanInterval, uint32_t, 500}
+         * The number of milliseconds between passes. */
+        uint32_t                    cMsInterval;
+        /** The number of completed rounds over all of RAM. */
+        uint32_t                    cRounds;
+        /** @cfgm{/PGM/PageFusionScan, boolean, false}
+         * Whether to scan RAM for pages to share (requires /PageFusionAllowed). */
+        bool                        fEnabled;
+        /** Explicit alignment padding. */
+        bool                        afAlignment[3];
+    } FusionScan;
+
+    /** Free page reporting rate limit, see PGMR3PhysReportFreePages.
+     * Protected by the PGM lock. */
+    struct
+    {
+        /** Start of the current one second period (RTTimeMilliTS). */
+        uint64_t                    msPeriodStart;
+        /** Number of reports accepted in the current period. */
+        uint32_t                    cReports;
+        /** Number of pages covered by the reports accepted in the current period. */
+        uint32_t                    cPages;
+        /** @cfgm{/PGM/FreePageReportsPerSec, uint32_t, 8}
+         * The max number of free page reports acted upon per second.  Each
+         * of them stops all the EMTs for a rendezvous. */
+        uint32_t                    cMaxReportsPerSec;
+        /** @cfgm{/PGM/FreePageReportPagesPerSec, uint32_t, 262144}
+         * The max number of pages the reports may cover per second. */
+        uint32_t                    cMaxPagesPerSec;
+    } FreeReport;
+
+    /** Host large page backing of the chunks we seed GMM with in legacy
+     * allocation mode, see pgmR3PhysSeedChunk. */
+    struct
+    {
+        /** @cfgm{/PGM/HugePages, uint32_t, 0}
+         * How to back guest RAM with host large pages: 0 = not at all,
+         * 1 = transparent huge pages, 2 = hugetlbfs falling back on transparent
+         * huge pages. */
+        uint32_t                    uMode;
+        /** The SUP_PAGE_ALLOC_HUGE_F_XXX methods still worth trying. */
+        uint32_t                    fMethods;
+        /** The number of bytes seeded with host large page backing, as
+         * confirmed by GMMR0SeedChunk. */
+        uint64_t                    cbHugeBacked;
+        /** The number of chunks seeded that GMM found not to be backed by host
+         * large pages. */
+        uint32_t                    cFallbacks;
+        /** Explicit alignment padding. */
+        uint32_t                    u32Alignment;
+    } HugePages;
+
     /** @name   Error injection.
      * @{ */
     /** Inject handy page allocation errors pretending we're completely out of
@@ -3587,6 +3927,14 @@ typedef struct PGM
     STAMCOUNTER                     StatLargePageRecheck;   /**< The number of times we rechecked a disabled large page.*/
 
     STAMPROFILE                     StatShModCheck;         /**< Profiles shared module checks. */
+    STAMPROFILE                     StatFusionScan;         /**< Profiles page fusion scanner passes. */
+    STAMCOUNTER                     StatFusionScanned;      /**< Pages hashed by the page fusion scanner. */
+    STAMCOUNTER                     StatFusionShared;       /**< Pages the page fusion scanner converted to shared pages. */
+    STAMCOUNTER                     StatFusionMerged;       /**< Pages the page fusion scanner replaced by shared pages. */
+    STAMPROFILE                     StatFreePageReport;     /**< Profiles releasing pages the guest reported free. */
+    STAMCOUNTER                     StatFreePageReleased;   /**< Pages released after the guest reported them free. */
+    STAMCOUNTER                     StatFreePageSkipped;    /**< Pages reported free that we had to keep. */
+    STAMCOUNTER                     StatFreePageThrottled;  /**< Free page reports refused by the rate limit. */
     /** @} */
 
 #ifdef VBOX_WITH_STATISTICS
@@ -4149,6 +4497,16 @@ void            pgmHandlerVirtualDumpPhysPages(PVM pVM);
 #endif /* VBOX_WITH_RAW_MODE */
 DECLCALLBACK(void) pgmR3InfoHandlers(PVM pVM, PCDBGFINFOHLP pHlp, const char *pszArgs);
 int             pgmR3InitSavedState(PVM pVM, uint64_t cbRam);
+void            pgmR3TermSavedState(PVM pVM);
+int             pgmR3PostCopyInit(PVM pVM);
+void            pgmR3PostCopyReset(PVM pVM);
+void            pgmR3PostCopyTerm(PVM pVM);
+int             pgmR3PostCopyAddPage(PVM pVM, PPGMRAMRANGE pRam, RTGCPHYS GCPhys, bool fSource);
+int             pgmR3PostCopyTrgArm(PVM pVM);
+int             pgmR3PostCopyTrgFetchPage(PVM pVM, RTGCPHYS GCPhys);
+int             pgmR3PostCopyTrgStartLazy(PVM pVM, PPGMLAZY pLazy);
+int             pgmR3PostCopyTrgLazyComplete(PVM pVM);
+void            pgmR3LazyFree(PVM pVM, PPGMLAZY pLazy);
 
 int             pgmPhysAllocPage(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys);
 int             pgmPhysAllocLargePage(PVM pVM, RTGCPHYS GCPhys);
@@ -4164,6 +4522,7 @@ int             pgmPhysPageMapByPageID(PVM pVM, uint32_t idPage, RTHCPHYS HCPhys
 int             pgmPhysGCPhys2R3Ptr(PVM pVM, RTGCPHYS GCPhys, PRTR3PTR pR3Ptr);
 int             pgmPhysCr3ToHCPtr(PVM pVM, RTGCPHYS GCPhys, PRTR3PTR pR3Ptr);
 int             pgmPhysGCPhys2CCPtrInternalDepr(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys, void **ppv);
+void            pgmPhysPostCopyFetch(PVM pVM, RTGCPHYS GCPhys);
 int             pgmPhysGCPhys2CCPtrInternal(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys, void **ppv, PPGMPAGEMAPLOCK pLock);
 int             pgmPhysGCPhys2CCPtrInternalReadOnly(PVM pVM, PPGMPAGE pPage, RTGCPHYS GCPhys, const void **ppv, PPGMPAGEMAPLOCK pLock);
 void            pgmPhysReleaseInternalPageMappingLock(PVM pVM, PPGMPAGEMAPLOCK pLock);
@@ -4193,6 +4552,7 @@ int             pgmR3PhysChunkMap(PVM pVM, uint32_t idChunk, PPPGMCHUNKR3MAP ppC
 int             pgmR3PhysRamTerm(PVM pVM);
 void            pgmR3PhysRomTerm(PVM pVM);
 void            pgmR3PhysAssertSharedPageChecksums(PVM pVM);
+int             pgmR3PageFusionScanInit(PVM pVM);
 
 int             pgmR3PoolInit(PVM pVM);
 void            pgmR3PoolRelocate(PVM pVM);
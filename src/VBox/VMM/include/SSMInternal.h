@@ -49,6 +49,22 @@ typedef enum SSMUNITTYPE
     SSMUNITTYPE_EXTERNAL
 } SSMUNITTYPE;
 
+
+/**
+ * The codec used for compressing page sized blocks when saving.
+ */
+typedef enum SSMZIPCODEC
+{
+    /** Invalid zero value. */
+    SSMZIPCODEC_INVALID = 0,
+    /** No compression, only zero blocks are elided. */
+    SSMZIPCODEC_NONE,
+    /** LZF, fast and understood by all v2.0 readers (default). */
+    SSMZIPCODEC_LZF,
+    /** zlib, denser and slower.  Produces records older readers cannot load. */
+    SSMZIPCODEC_ZLIB
+} SSMZIPCODEC;
+
 /** Pointer to a data unit descriptor. */
 typedef struct SSMUNIT *PSSMUNIT;
 
@@ -313,7 +329,20 @@ typedef struct SSM
     bool                    fInitialized;
     /** Current pass (for STAM). */
     uint32_t                uPass;
+    /** The block compression codec for saving (SSMZIPCODEC). */
+    uint32_t                enmZipCodec;
+    /** Number of compression worker threads, 0 if compressing on the caller's
+     * thread. */
+    uint32_t                cZipThreads;
+    /** Save throughput of the current or last save operation (MB/s, for STAM). */
+    uint32_t                cMBPerSecSave;
+    /** Load throughput of the current or last load operation (MB/s, for STAM). */
+    uint32_t                cMBPerSecLoad;
     uint32_t                u32Alignment;
+    /** Stream bytes written by the current or last save operation (for STAM). */
+    uint64_t                cbSaveStream;
+    /** Stream bytes read by the current or last load operation (for STAM). */
+    uint64_t                cbLoadStream;
 } SSM;
 /** Pointer to SSM VM instance data. */
 typedef SSM *PSSM;
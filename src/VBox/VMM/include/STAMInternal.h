@@ -146,10 +146,14 @@ typedef struct STAMUSERPERVM
     /** The number of registered host CPU leaves. */
     uint32_t                cRegisteredHostCpus;
 
-    /** Explicit alignment padding. */
-    uint32_t                uAlignment;
+    /** The registration generation, incremented whenever a sample is registered
+     * or deregistered.  Used by the binary snapshots to notice changes. */
+    uint32_t volatile       uGeneration;
     /** The copy of the GMM statistics. */
     GMMSTATS                GMMStats;
+
+    /** The export file state, NULL if not exporting. */
+    struct STAMEXPORT      *pExport;
 } STAMUSERPERVM;
 #ifdef IN_RING3
 AssertCompileMemberAlignment(STAMUSERPERVM, GMMStats, 8);
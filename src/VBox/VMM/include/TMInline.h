@@ -19,8 +19,238 @@
 #define ___TMInline_h
 
 
+/** @page pg_tm_heap     TM - Active Timer Heap
+ *
+ * The active timers of each clock are kept in a pairing heap rather than a
+ * sorted list, so arming a timer is O(1) and removing one is O(log n)
+ * amortized instead of both being O(n).  The root is the timer which expires
+ * first and is what TMTIMER_GET_HEAD returns, so code only interested in the
+ * next timer to expire doesn't need to care.
+ *
+ * The heap is threaded through three self relative offsets in the timer:
+ * offChild points to the leftmost child, offNext to the next sibling, and
+ * offPrev to the previous sibling or, for the leftmost child, to the parent.
+ * The root has neither siblings nor a parent.  A timer that isn't in the
+ * heap has all three zero.
+ *
+ * Threads other than EMT may change u64Expire of a linked timer in the
+ * TMTIMERSTATE_PENDING_RESCHEDULE_SET_EXPIRE state without owning the queue
+ * lock.  So the heap isn't ordered by u64Expire but by u64ExpireLinked, a
+ * copy taken when the timer is inserted and left alone until it's removed
+ * again.  The next scheduling pass re-keys such a timer by taking it out and
+ * putting it back in.  Until then the queue's u64Expire may be a little
+ * early, which only means we check the queue once more than needed.
+ */
+
+
+/**
+ * Melds two heaps.
+ *
+ * @returns The root of the resulting heap.
+ * @param   pRoot1      The root of the first heap.  Wins ties.
+ * @param   pRoot2      The root of the second heap.
+ */
+DECL_FORCE_INLINE(PTMTIMER) tmTimerHeapMeld(PTMTIMER pRoot1, PTMTIMER pRoot2)
+{
+    Assert(!pRoot1->offNext && !pRoot1->offPrev);
+    Assert(!pRoot2->offNext && !pRoot2->offPrev);
+    if (pRoot2->u64ExpireLinked < pRoot1->u64ExpireLinked)
+    {
+        PTMTIMER pTmp = pRoot1;
+        pRoot1 = pRoot2;
+        pRoot2 = pTmp;
+    }
+
+    PTMTIMER pChild = TMTIMER_GET_CHILD(pRoot1);
+    if (pChild)
+    {
+        TMTIMER_SET_NEXT(pRoot2, pChild);
+        TMTIMER_SET_PREV(pChild, pRoot2);
+    }
+    TMTIMER_SET_PREV(pRoot2, pRoot1);
+    TMTIMER_SET_CHILD(pRoot1, pRoot2);
+    return pRoot1;
+}
+
+
+/**
+ * Combines a list of sibling heaps into one using the standard two-pass
+ * pairing.
+ *
+ * @returns The root of the resulting heap, NULL if the list is empty.
+ * @param   pFirst      The first (leftmost) sibling.  The caller has already
+ *                      detached it from its parent.
+ */
+DECLINLINE(PTMTIMER) tmTimerHeapCombine(PTMTIMER pFirst)
+{
+    if (!pFirst)
+        return NULL;
+
+    /*
+     * Pass one: meld pairs left to right, pushing the results onto a stack
+     * linked thru offNext.
+     */
+    PTMTIMER pStack = NULL;
+    while (pFirst)
+    {
+        PTMTIMER pFirst2 = pFirst;
+        PTMTIMER pSecond = TMTIMER_GET_NEXT(pFirst2);
+        pFirst2->offNext = 0;
+        pFirst2->offPrev = 0;
+        if (pSecond)
+        {
+            pFirst = TMTIMER_GET_NEXT(pSecond);
+            pSecond->offNext = 0;
+            pSecond->offPrev = 0;
+            pFirst2 = tmTimerHeapMeld(pFirst2, pSecond);
+        }
+        else
+            pFirst = NULL;
+        TMTIMER_SET_NEXT(pFirst2, pStack);
+        pStack = pFirst2;
+    }
+
+    /*
+     * Pass two: meld the pairs right to left.
+     */
+    PTMTIMER pRoot = pStack;
+    pStack = TMTIMER_GET_NEXT(pRoot);
+    pRoot->offNext = 0;
+    while (pStack)
+    {
+        PTMTIMER pCur = pStack;
+        pStack = TMTIMER_GET_NEXT(pCur);
+        pCur->offNext = 0;
+        pRoot = tmTimerHeapMeld(pRoot, pCur);
+    }
+    return pRoot;
+}
+
+
+/**
+ * Inserts a timer into the active heap of a timer queue.
+ *
+ * This updates the cached expire time of the queue if the timer becomes the
+ * new head.
+ *
+ * @returns true if the timer is the new head, false if not.
+ * @param   pQueue      The timer queue.
+ * @param   pTimer      The timer, u64Expire set.  This is what it's keyed on
+ *                      until it's removed again.
+ */
+DECL_FORCE_INLINE(bool) tmTimerQueueHeapInsert(PTMTIMERQUEUE pQueue, PTMTIMER pTimer)
+{
+    Assert(!pTimer->offNext);
+    Assert(!pTimer->offPrev);
+    Assert(!pTimer->offChild);
+
+    pTimer->u64ExpireLinked = ASMAtomicReadU64(&pTimer->u64Expire);
+    pQueue->cActive++;
+    PTMTIMER pHead = TMTIMER_GET_HEAD(pQueue);
+    if (pHead)
+    {
+        pHead = tmTimerHeapMeld(pHead, pTimer);
+        if (pHead != pTimer)
+            return false;
+    }
+    TMTIMER_SET_HEAD(pQueue, pTimer);
+    ASMAtomicWriteU64(&pQueue->u64Expire, pTimer->u64ExpireLinked);
+    return true;
+}
+
+
 /**
- * Used to unlink a timer from the active list.
+ * Removes a timer from the active heap of a timer queue.
+ *
+ * This updates the cached expire time of the queue if the head changes.
+ *
+ * @returns true if the head changed, i.e. the timer was the head, false if
+ *          not.
+ * @param   pQueue      The timer queue.
+ * @param   pTimer      The timer.  Must be in the heap.
+ */
+DECLINLINE(bool) tmTimerQueueHeapRemove(PTMTIMERQUEUE pQueue, PTMTIMER pTimer)
+{
+    Assert(pQueue->cActive > 0);
+    pQueue->cActive--;
+
+    PTMTIMER pSubHeap = tmTimerHeapCombine(TMTIMER_GET_CHILD(pTimer));
+    pTimer->offChild = 0;
+
+    PTMTIMER pPrev = TMTIMER_GET_PREV(pTimer);
+    if (!pPrev)
+    {
+        Assert(TMTIMER_GET_HEAD(pQueue) == pTimer);
+        Assert(!pTimer->offNext);
+        TMTIMER_SET_HEAD(pQueue, pSubHeap);
+        ASMAtomicWriteU64(&pQueue->u64Expire, pSubHeap ? pSubHeap->u64ExpireLinked : INT64_MAX);
+        return true;
+    }
+
+    /* Detach it from its parent or previous sibling and meld its children
+       back in.  The root stays the root as long as the heap is in order
+       since it wins ties, but we don't bet the queue on that. */
+    PTMTIMER pNext = TMTIMER_GET_NEXT(pTimer);
+    if (TMTIMER_GET_CHILD(pPrev) == pTimer)
+        TMTIMER_SET_CHILD(pPrev, pNext);
+    else
+        TMTIMER_SET_NEXT(pPrev, pNext);
+    if (pNext)
+        TMTIMER_SET_PREV(pNext, pPrev);
+    pTimer->offNext = 0;
+    pTimer->offPrev = 0;
+
+    if (pSubHeap)
+    {
+        PTMTIMER pHead = TMTIMER_GET_HEAD(pQueue);
+        Assert(pHead && pHead != pTimer);
+        PTMTIMER pNewHead = tmTimerHeapMeld(pHead, pSubHeap);
+        Assert(pNewHead == pHead);
+        TMTIMER_SET_HEAD(pQueue, pNewHead);
+        ASMAtomicWriteU64(&pQueue->u64Expire, pNewHead->u64ExpireLinked);
+        return pNewHead != pHead;
+    }
+    return false;
+}
+
+
+/**
+ * Gets the next timer when walking all the timers in an active heap.
+ *
+ * The walk is a pre-order one starting at TMTIMER_GET_HEAD, which means the
+ * timers are NOT visited in expire time order.  The heap must not be
+ * modified during the walk.
+ *
+ * @returns The next timer, NULL when done.
+ * @param   pCur        The current timer.
+ */
+DECLINLINE(PTMTIMER) tmTimerQueueHeapWalkNext(PTMTIMER pCur)
+{
+    PTMTIMER pRet = TMTIMER_GET_CHILD(pCur);
+    if (pRet)
+        return pRet;
+    for (;;)
+    {
+        pRet = TMTIMER_GET_NEXT(pCur);
+        if (pRet)
+            return pRet;
+
+        /* Go back to the leftmost sibling and on up to the parent. */
+        PTMTIMER pPrev = TMTIMER_GET_PREV(pCur);
+        while (pPrev && TMTIMER_GET_CHILD(pPrev) != pCur)
+        {
+            pCur  = pPrev;
+            pPrev = TMTIMER_GET_PREV(pCur);
+        }
+        if (!pPrev)
+            return NULL;
+        pCur = pPrev;
+    }
+}
+
+
+/**
+ * Used to unlink a timer from the active heap.
  *
  * @param   pQueue      The timer queue.
  * @param   pTimer      The timer that needs linking.
@@ -36,21 +266,8 @@ DECL_FORCE_INLINE(void) tmTimerQueueUnlinkActive(PTMTIMERQUEUE pQueue, PTMTIMER
            : enmState == TMTIMERSTATE_PENDING_SCHEDULE || enmState == TMTIMERSTATE_PENDING_STOP_SCHEDULE);
 #endif
 
-    const PTMTIMER pPrev = TMTIMER_GET_PREV(pTimer);
-    const PTMTIMER pNext = TMTIMER_GET_NEXT(pTimer);
-    if (pPrev)
-        TMTIMER_SET_NEXT(pPrev, pNext);
-    else
-    {
-        TMTIMER_SET_HEAD(pQueue, pNext);
-        pQueue->u64Expire = pNext ? pNext->u64Expire : INT64_MAX;
+    if (tmTimerQueueHeapRemove(pQueue, pTimer))
         DBGFTRACE_U64_TAG(pTimer->CTX_SUFF(pVM), pQueue->u64Expire, "tmTimerQueueUnlinkActive");
-    }
-    if (pNext)
-        TMTIMER_SET_PREV(pNext, pPrev);
-    pTimer->offNext = 0;
-    pTimer->offPrev = 0;
 }
 
 #endif
-
@@ -113,6 +113,8 @@ typedef enum TMTIMERSTATE
  *        are changeable. Everything else is out of bounds.
  *      - Updating of u64Expire timer can only happen in the TMTIMERSTATE_STOPPED
  *        and TMTIMERSTATE_PENDING_RESCHEDULING_SET_EXPIRE states.
+ *      - The active timer heap is ordered by u64ExpireLinked, which only the
+ *        queue lock owner changes, and only while the timer isn't linked.
  *      - Timers in the TMTIMERSTATE_EXPIRED state are only accessible from EMT.
  *      - Actual destruction of a timer can only be done at scheduling time.
  */
@@ -120,6 +122,11 @@ typedef struct TMTIMER
 {
     /** Expire time. */
     volatile uint64_t       u64Expire;
+    /** The expire time the timer was linked into the active heap with.  This is
+     * the heap key; u64Expire may be changed by other threads while the timer
+     * is linked and the new value only takes effect when the next scheduling
+     * pass takes the timer out and puts it back in. */
+    uint64_t                u64ExpireLinked;
     /** Clock to apply to u64Expire. */
     TMCLOCK                 enmClock;
     /** Timer callback type. */
@@ -174,10 +181,16 @@ typedef struct TMTIMER
     /** Timer relative offset to the next timer in the schedule list. */
     int32_t volatile        offScheduleNext;
 
-    /** Timer relative offset to the next timer in the chain. */
+    /** Timer relative offset to the next sibling in the active timer heap. */
     int32_t                 offNext;
-    /** Timer relative offset to the previous timer in the chain. */
+    /** Timer relative offset to the previous sibling in the active timer heap,
+     * or to the parent if this is the leftmost child.  Zero for the root. */
     int32_t                 offPrev;
+    /** Timer relative offset to the leftmost child in the active timer heap. */
+    int32_t                 offChild;
+#if HC_ARCH_BITS == 64
+    uint32_t                u32Alignment; /**< Explicit alignment padding. */
+#endif
 
     /** Pointer to the VM the timer belongs to - R3 Ptr. */
     PVMR3                   pVMR3;
@@ -199,11 +212,9 @@ typedef struct TMTIMER
     PTMTIMERR3              pBigPrev;
     /** Pointer to the timer description. */
     R3PTRTYPE(const char *) pszDesc;
-#if HC_ARCH_BITS == 32
-    uint32_t                padding0; /**< pad structure to multiple of 8 bytes. */
-#endif
 } TMTIMER;
 AssertCompileMemberSize(TMTIMER, enmState, sizeof(uint32_t));
+AssertCompileSizeAlignment(TMTIMER, 8);
 
 
 /**
@@ -235,14 +246,18 @@ AssertCompileMemberSize(TMTIMER, enmState, sizeof(uint32_t));
     } while (0)
 #endif
 
-/** Get the previous timer. */
+/** Get the previous sibling or the parent timer. */
 #define TMTIMER_GET_PREV(pTimer) ((PTMTIMER)((pTimer)->offPrev ? (intptr_t)(pTimer) + (pTimer)->offPrev : 0))
-/** Get the next timer. */
+/** Get the next sibling timer. */
 #define TMTIMER_GET_NEXT(pTimer) ((PTMTIMER)((pTimer)->offNext ? (intptr_t)(pTimer) + (pTimer)->offNext : 0))
-/** Set the previous timer link. */
+/** Get the leftmost child timer. */
+#define TMTIMER_GET_CHILD(pTimer) ((PTMTIMER)((pTimer)->offChild ? (intptr_t)(pTimer) + (pTimer)->offChild : 0))
+/** Set the previous sibling or parent timer link. */
 #define TMTIMER_SET_PREV(pTimer, pPrev) ((pTimer)->offPrev = (pPrev) ? (intptr_t)(pPrev) - (intptr_t)(pTimer) : 0)
-/** Set the next timer link. */
+/** Set the next sibling timer link. */
 #define TMTIMER_SET_NEXT(pTimer, pNext) ((pTimer)->offNext = (pNext) ? (intptr_t)(pNext) - (intptr_t)(pTimer) : 0)
+/** Set the leftmost child timer link. */
+#define TMTIMER_SET_CHILD(pTimer, pChild) ((pTimer)->offChild = (pChild) ? (intptr_t)(pChild) - (intptr_t)(pTimer) : 0)
 
 
 /**
@@ -256,10 +271,11 @@ typedef struct TMTIMERQUEUE
      * Updated by EMT when scheduling the queue or modifying the head timer.
      * Assigned UINT64_MAX when there is no head timer. */
     uint64_t                u64Expire;
-    /** Doubly linked list of active timers.
+    /** The root of the pairing heap of active timers.
      *
-     * When no scheduling is pending, this list is will be ordered by expire time (ascending).
-     * Access is serialized by only letting the emulation thread (EMT) do changes.
+     * The root is the timer with the lowest expire time, the rest is only
+     * partially ordered (see tmTimerQueueHeapInsert).  Access is serialized by
+     * only letting the emulation thread (EMT) do changes.
      *
      * The offset is relative to the queue structure.
      */
@@ -275,16 +291,18 @@ typedef struct TMTIMERQUEUE
     int32_t volatile        offSchedule;
     /** The clock for this queue. */
     TMCLOCK                 enmClock;
+    /** The number of timers in the active heap. */
+    uint32_t                cActive;
     /** Pad the structure up to 32 bytes. */
-    uint32_t                au32Padding[3];
+    uint32_t                au32Padding[2];
 } TMTIMERQUEUE;
 
 /** Pointer to a timer queue. */
 typedef TMTIMERQUEUE *PTMTIMERQUEUE;
 
-/** Get the head of the active timer list. */
+/** Get the head of the active timer heap. */
 #define TMTIMER_GET_HEAD(pQueue)        ((PTMTIMER)((pQueue)->offActive ? (intptr_t)(pQueue) + (pQueue)->offActive : 0))
-/** Set the head of the active timer list. */
+/** Set the head of the active timer heap. */
 #define TMTIMER_SET_HEAD(pQueue, pHead) ((pQueue)->offActive = pHead ? (intptr_t)pHead - (intptr_t)(pQueue) : 0)
 
 
@@ -210,6 +210,9 @@ typedef struct VMINTUSERPERVM
     /** Number of times we've raced someone when pushing the other requests back
      * onto the list. */
     STAMCOUNTER                     StatReqPushBackRaces;
+    /** Number of times the EMT caught a producer half way thru queueing a request
+     * on a per-VCPU normal queue. */
+    STAMCOUNTER                     StatReqCpuQueueRaces;
 # endif
 
     /** Pointer to the support library session.
@@ -328,10 +331,17 @@ typedef VMINTUSERPERVM *PVMINTUSERPERVM;
  */
 typedef struct VMINTUSERPERVMCPU
 {
-    /** Head of the normal request queue. Atomic. */
-    volatile PVMREQ                 pNormalReqs;
+    /** Tail of the normal request queue, i.e. the most recently queued request
+     * or the stub.  Producers only, atomic.  See VMReq.cpp for details. */
+    volatile PVMREQ                 pNormalReqsTail;
     /** Head of the priority request queue. Atomic. */
     volatile PVMREQ                 pPriorityReqs;
+    /** Head of the normal request queue, i.e. the oldest request or the stub.
+     * Only accessed by the EMT. */
+    PVMREQ                          pNormalReqsHead;
+    /** The stub node of the normal request queue.  This is used as a VMREQ
+     * with only the pNext member present, see VMINTUSERPERVMCPU_REQ_STUB. */
+    PVMREQ volatile                 pNormalReqsStubNext;
 
     /** The handle to the EMT thread. */
     RTTHREAD                        ThreadEMT;
@@ -444,6 +454,16 @@ AssertCompileMemberAlignment(VMINTUSERPERVMCPU, StatHaltYield, 8);
 /** Pointer to the VM internal data kept in the UVM. */
 typedef VMINTUSERPERVMCPU *PVMINTUSERPERVMCPU;
 
+/** Gets the stub node of the per-VCPU normal request queue.
+ * @param   a_pVMInt    Pointer to the VMINTUSERPERVMCPU structure. */
+#define VMINTUSERPERVMCPU_REQ_STUB(a_pVMInt)         ((PVMREQ)&(a_pVMInt)->pNormalReqsStubNext)
+/** Checks if there are any requests pending on the per-VCPU normal queue.
+ * This may only be used by the EMT owning the queue.
+ * @param   a_pVMInt    Pointer to the VMINTUSERPERVMCPU structure. */
+#define VMINTUSERPERVMCPU_HAS_NORMAL_REQS(a_pVMInt) \
+    (   (a_pVMInt)->pNormalReqsHead != VMINTUSERPERVMCPU_REQ_STUB(a_pVMInt) \
+     || ASMAtomicReadPtrT(&(a_pVMInt)->pNormalReqsStubNext, PVMREQ) != NULL)
+
 #endif /* IN_RING3 */
 
 RT_C_DECLS_BEGIN
@@ -458,6 +478,10 @@ DECLCALLBACK(int)   vmR3SetRuntimeErrorV(PVM pVM, uint32_t fFlags, const char *p
 void                vmSetRuntimeErrorCopy(PVM pVM, uint32_t fFlags, const char *pszErrorId, const char *pszFormat, va_list va);
 void                vmR3SetGuruMeditation(PVM pVM);
 void                vmR3SetTerminated(PVM pVM);
+#ifdef IN_RING3
+void                vmR3ReqCpuQueueInit(PUVMCPU pUVCpu);
+PVMREQ              vmR3ReqCpuQueuePop(PUVMCPU pUVCpu);
+#endif
 
 RT_C_DECLS_END
 
@@ -0,0 +1,234 @@
+/* $Id$ */
+/** @file
+ * DBGF Binary Trace Ring Testcase - Exercises the lock-free ring logic.
+ */
+
+/*
+ * Copyright (C) 2011-2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <VBox/err.h>
+#include <iprt/asm.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/test.h>
+#include <iprt/thread.h>
+
+#include "../include/DBGFTraceRing.h"
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The number of records in the test rings. */
+#define TST_RING_ENTRIES    256
+/** The number of records each writer thread adds. */
+#define TST_RECS_PER_WRITER _1M
+/** The maximum number of writer threads. */
+#define TST_MAX_WRITERS     4
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** The test handle. */
+static RTTEST               g_hTest;
+/** The ring the threads are working on. */
+static PDBGFTRACERING       g_pRing;
+/** The number of writers still running. */
+static uint32_t volatile    g_cWritersRunning;
+
+
+/**
+ * Allocates and initializes a ring.
+ */
+static PDBGFTRACERING tstAllocRing(uint32_t cEntries)
+{
+    PDBGFTRACERING pRing = (PDBGFTRACERING)RTMemAlloc(dbgfTraceRingCalcSize(cEntries));
+    RTTESTI_CHECK_RET(pRing != NULL, NULL);
+    dbgfTraceRingInit(pRing, cEntries);
+    return pRing;
+}
+
+
+/**
+ * Adding and reading back without wrapping around.
+ */
+static void tstBasics(void)
+{
+    RTTestSub(g_hTest, "Basics");
+    PDBGFTRACERING pRing = tstAllocRing(TST_RING_ENTRIES);
+    if (!pRing)
+        return;
+
+    static DBGFTRACEREC s_aRecs[TST_RING_ENTRIES];
+    uint64_t idxRead = 0;
+    uint64_t cLost   = 0;
+    RTTESTI_CHECK(dbgfTraceRingRead(pRing, &idxRead, s_aRecs, RT_ELEMENTS(s_aRecs), &cLost) == 0);
+    RTTESTI_CHECK(idxRead == 0 && cLost == 0);
+
+    for (uint32_t i = 0; i < 100; i++)
+        dbgfTraceRingAdd(pRing, DBGFTRACEEVT_IOPORT_READ, DBGFTRACEPHASE_BEGIN, i, UINT64_C(0x8000000000000000) | i);
+
+    /* Read in two goes. */
+    uint32_t cRecs = dbgfTraceRingRead(pRing, &idxRead, s_aRecs, 60, &cLost);
+    RTTESTI_CHECK_MSG(cRecs == 60, ("cRecs=%u\n", cRecs));
+    cRecs += dbgfTraceRingRead(pRing, &idxRead, &s_aRecs[60], RT_ELEMENTS(s_aRecs) - 60, &cLost);
+    RTTESTI_CHECK_MSG(cRecs == 100, ("cRecs=%u\n", cRecs));
+    RTTESTI_CHECK(idxRead == 100 && cLost == 0);
+
+    for (uint32_t i = 0; i < cRecs; i++)
+    {
+        RTTESTI_CHECK(s_aRecs[i].uEvent == DBGFTRACEEVT_IOPORT_READ);
+        RTTESTI_CHECK(s_aRecs[i].bPhase == DBGFTRACEPHASE_BEGIN);
+        RTTESTI_CHECK(s_aRecs[i].au64Args[0] == i);
+        RTTESTI_CHECK(s_aRecs[i].au64Args[1] == (UINT64_C(0x8000000000000000) | i));
+        RTTESTI_CHECK(i == 0 || s_aRecs[i].u64Tsc >= s_aRecs[i - 1].u64Tsc);
+    }
+
+    RTMemFree(pRing);
+}
+
+
+/**
+ * The reader falling behind.
+ */
+static void tstOverrun(void)
+{
+    RTTestSub(g_hTest, "Overrun");
+    PDBGFTRACERING pRing = tstAllocRing(TST_RING_ENTRIES);
+    if (!pRing)
+        return;
+
+    for (uint32_t i = 0; i < TST_RING_ENTRIES * 3 + 10; i++)
+        dbgfTraceRingAdd(pRing, DBGFTRACEEVT_MMIO_WRITE, DBGFTRACEPHASE_END, i, 0);
+
+    static DBGFTRACEREC s_aRecs[TST_RING_ENTRIES];
+    uint64_t idxRead = 0;
+    uint64_t cLost   = 0;
+    uint32_t cRecs   = dbgfTraceRingRead(pRing, &idxRead, s_aRecs, RT_ELEMENTS(s_aRecs), &cLost);
+    RTTESTI_CHECK_MSG(cRecs == TST_RING_ENTRIES, ("cRecs=%u\n", cRecs));
+    RTTESTI_CHECK_MSG(cLost == TST_RING_ENTRIES * 2 + 10, ("cLost=%llu\n", cLost));
+    RTTESTI_CHECK(idxRead == TST_RING_ENTRIES * 3 + 10);
+    for (uint32_t i = 0; i < cRecs; i++)
+        RTTESTI_CHECK(s_aRecs[i].au64Args[0] == TST_RING_ENTRIES * 2 + 10 + i);
+
+    RTMemFree(pRing);
+}
+
+
+/**
+ * @callback_method_impl{FNRTTHREAD, Writer thread.}
+ */
+static DECLCALLBACK(int) tstWriterThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    uint64_t const uWriter = (uintptr_t)pvUser;
+    for (uint64_t i = 0; i < TST_RECS_PER_WRITER; i++)
+    {
+        uint64_t const uArg0 = (uWriter << 48) | i;
+        dbgfTraceRingAdd(g_pRing, (uint16_t)(DBGFTRACEEVT_DEV_FIRST + uWriter), DBGFTRACEPHASE_INSTANT, uArg0, ~uArg0);
+    }
+    ASMAtomicDecU32(&g_cWritersRunning);
+    NOREF(hThreadSelf);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Concurrent writers and a reader, checking that the reader never sees a torn
+ * or out of order record and that everything is accounted for.
+ *
+ * With more than one writer a record can legitimately be torn when a writer
+ * is preempted for a whole ring wrap-around (see DBGFTRACERING), so those
+ * are only reported.
+ */
+static void tstConcurrent(uint32_t cWriters)
+{
+    RTTestSubF(g_hTest, "Concurrent, %u writer(s)", cWriters);
+    g_pRing = tstAllocRing(TST_RING_ENTRIES);
+    if (!g_pRing)
+        return;
+
+    RTTHREAD ahThreads[TST_MAX_WRITERS];
+    g_cWritersRunning = cWriters;
+    for (uint32_t i = 0; i < cWriters; i++)
+        RTTESTI_CHECK_RC_RETV(RTThreadCreate(&ahThreads[i], tstWriterThread, (void *)(uintptr_t)i, 0, RTTHREADTYPE_DEFAULT,
+                                             RTTHREADFLAGS_WAITABLE, "writer"), VINF_SUCCESS);
+
+    uint64_t     auNext[TST_MAX_WRITERS] = { 0 };
+    uint64_t     cRead   = 0;
+    uint64_t     cLost   = 0;
+    uint64_t     cErrors = 0;
+    uint64_t     cTorn   = 0;
+    uint64_t     idxRead = 0;
+    DBGFTRACEREC aRecs[64];
+    for (;;)
+    {
+        bool const     fDone = ASMAtomicReadU32(&g_cWritersRunning) == 0;
+        uint32_t const cRecs = dbgfTraceRingRead(g_pRing, &idxRead, aRecs, RT_ELEMENTS(aRecs), &cLost);
+        for (uint32_t i = 0; i < cRecs; i++)
+        {
+            uint64_t const uArg0   = aRecs[i].au64Args[0];
+            uint32_t const uWriter = (uint32_t)(uArg0 >> 48);
+            if (   cWriters > 1
+                && (   aRecs[i].au64Args[1] != ~uArg0
+                    || aRecs[i].uEvent != DBGFTRACEEVT_DEV_FIRST + uWriter))
+                cTorn++;
+            else if (   aRecs[i].au64Args[1] != ~uArg0
+                     || uWriter >= cWriters
+                     || aRecs[i].uEvent != DBGFTRACEEVT_DEV_FIRST + uWriter
+                     || (uArg0 & UINT64_C(0xffffffffffff)) < auNext[uWriter])
+            {
+                if (cErrors++ < 8)
+                    RTTestFailed(g_hTest, "Bad record: uEvent=%#x arg0=%#llx arg1=%#llx\n",
+                                 aRecs[i].uEvent, uArg0, aRecs[i].au64Args[1]);
+            }
+            else
+                auNext[uWriter] = (uArg0 & UINT64_C(0xffffffffffff)) + 1;
+        }
+        cRead += cRecs;
+        if (fDone && !cRecs)
+            break;
+        if (!cRecs)
+            RTThreadYield();
+    }
+
+    for (uint32_t i = 0; i < cWriters; i++)
+        RTTESTI_CHECK_RC(RTThreadWait(ahThreads[i], RT_INDEFINITE_WAIT, NULL), VINF_SUCCESS);
+
+    RTTESTI_CHECK_MSG(cRead + cLost == (uint64_t)cWriters * TST_RECS_PER_WRITER,
+                      ("cRead=%llu cLost=%llu\n", cRead, cLost));
+    RTTESTI_CHECK(idxRead == (uint64_t)cWriters * TST_RECS_PER_WRITER);
+    RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "%llu records read, %llu lost, %llu torn\n", cRead, cLost, cTorn);
+
+    RTMemFree(g_pRing);
+    g_pRing = NULL;
+}
+
+
+int main()
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstDBGFTraceRing", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    tstBasics();
+    tstOverrun();
+    tstConcurrent(1);
+    tstConcurrent(TST_MAX_WRITERS);
+
+    return RTTestSummaryAndDestroy(g_hTest);
+}
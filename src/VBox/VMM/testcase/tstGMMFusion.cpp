@@ -0,0 +1,399 @@
+/* $Id$ */
+/** @file
+ * GMM Page Fusion Testcase - Exercises the content hashing and matching logic.
+ */
+
+/*
+ * Copyright (C) 2007-2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <VBox/err.h>
+#include <iprt/asm.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/time.h>
+
+#include "../VMMR0/GMMR0Fusion.h"
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The number of simulated VMs. */
+#define TST_VMS             3
+/** The number of guest pages per VM. */
+#define TST_GUEST_PAGES     256
+/** The number of host pages (page IDs), ID 0 is NIL. */
+#define TST_HOST_PAGES      (TST_VMS * TST_GUEST_PAGES * 2)
+/** The number of content classes the VMs have in common. */
+#define TST_COMMON_CLASSES  32
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/** Simulated host page states. */
+typedef enum TSTPAGESTATE
+{
+    TSTPAGESTATE_FREE = 0,
+    TSTPAGESTATE_PRIVATE,
+    TSTPAGESTATE_SHARED
+} TSTPAGESTATE;
+
+/**
+ * A simulated host page (what GMMPAGE + the chunk mapping give GMM).
+ */
+typedef struct TSTPAGE
+{
+    TSTPAGESTATE        enmState;
+    /** The number of VMs referencing a shared page. */
+    uint32_t            cRefs;
+    /** The page content. */
+    uint8_t            *pb;
+} TSTPAGE;
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** The test handle. */
+static RTTEST           g_hTest;
+/** The simulated host pages, indexed by page ID. */
+static TSTPAGE          g_aPages[TST_HOST_PAGES];
+/** Stack of free page IDs, reused LIFO to make stale table entries likely. */
+static uint32_t         g_aidFree[TST_HOST_PAGES];
+/** Number of entries in g_aidFree. */
+static uint32_t         g_cFree;
+/** The guest page to host page ID mappings. */
+static uint32_t         g_aaidGuest[TST_VMS][TST_GUEST_PAGES];
+/** What each guest page is supposed to contain. */
+static uint8_t         *g_pabExpected;
+/** The fusion table. */
+static GMMFUSIONTABLE   g_Table;
+
+
+static uint32_t tstAllocPage(void)
+{
+    RTTEST_CHECK_RET(g_hTest, g_cFree > 0, 0);
+    uint32_t idPage = g_aidFree[--g_cFree];
+    g_aPages[idPage].enmState = TSTPAGESTATE_PRIVATE;
+    g_aPages[idPage].cRefs    = 0;
+    return idPage;
+}
+
+
+static void tstFreePage(uint32_t idPage)
+{
+    /* Scribble on it so stale table entries can't match by accident. */
+    memset(g_aPages[idPage].pb, 0xf6, PAGE_SIZE);
+    g_aPages[idPage].enmState = TSTPAGESTATE_FREE;
+    g_aidFree[g_cFree++] = idPage;
+}
+
+
+static uint8_t *tstExpected(uint32_t iVM, uint32_t iGuest)
+{
+    return &g_pabExpected[((size_t)iVM * TST_GUEST_PAGES + iGuest) << PAGE_SHIFT];
+}
+
+
+/**
+ * Fills a page with the content of the given class, 0 being all zeros.
+ */
+static void tstFillClass(uint8_t *pb, uint32_t uClass)
+{
+    uint64_t *pu64 = (uint64_t *)pb;
+    for (uint32_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++)
+        pu64[i] = uClass ? (uint64_t)uClass * UINT64_C(0x9e3779b97f4a7c15) + i : 0;
+}
+
+
+/**
+ * Sets up all the VMs with a mix of zero, common and unique pages.
+ *
+ * @returns The number of distinct page contents.
+ */
+static uint32_t tstSetupVMs(void)
+{
+    g_cFree = 0;
+    for (uint32_t idPage = TST_HOST_PAGES - 1; idPage > 0; idPage--)
+    {
+        g_aPages[idPage].enmState = TSTPAGESTATE_FREE;
+        g_aidFree[g_cFree++] = idPage;
+    }
+
+    uint32_t uUniqueClass = TST_COMMON_CLASSES + 1;
+    for (uint32_t iVM = 0; iVM < TST_VMS; iVM++)
+        for (uint32_t iGuest = 0; iGuest < TST_GUEST_PAGES; iGuest++)
+        {
+            uint32_t uClass;
+            switch (iGuest % 4)
+            {
+                case 0:  uClass = 0; break;
+                case 1:
+                case 2:  uClass = 1 + (iGuest * 7 + iVM) % TST_COMMON_CLASSES; break;
+                default: uClass = uUniqueClass++; break;
+            }
+            tstFillClass(tstExpected(iVM, iGuest), uClass);
+
+            uint32_t idPage = tstAllocPage();
+            memcpy(g_aPages[idPage].pb, tstExpected(iVM, iGuest), PAGE_SIZE);
+            g_aaidGuest[iVM][iGuest] = idPage;
+        }
+    return uUniqueClass;
+}
+
+
+/**
+ * @callback_method_impl{FNGMMFUSIONVERIFY, Mirrors gmmR0FusionVerify.}
+ */
+static DECLCALLBACK(GMMFUSIONMATCH) tstVerify(void *pvUser, uint32_t idPage, uint32_t idPageOther, bool fShared)
+{
+    NOREF(pvUser);
+    RTTEST_CHECK(g_hTest, idPage != idPageOther);
+    if (   idPageOther >= TST_HOST_PAGES
+        || g_aPages[idPageOther].enmState != (fShared ? TSTPAGESTATE_SHARED : TSTPAGESTATE_PRIVATE))
+        return GMMFUSIONMATCH_STALE;
+    return memcmp(g_aPages[idPage].pb, g_aPages[idPageOther].pb, PAGE_SIZE) ? GMMFUSIONMATCH_DIFFERENT : GMMFUSIONMATCH_IDENTICAL;
+}
+
+
+/**
+ * Scans all private pages of a VM, mirroring GMMR0FusionCheckPage.
+ */
+static void tstScanVM(uint32_t iVM)
+{
+    for (uint32_t iGuest = 0; iGuest < TST_GUEST_PAGES; iGuest++)
+    {
+        uint32_t idPage = g_aaidGuest[iVM][iGuest];
+        if (g_aPages[idPage].enmState != TSTPAGESTATE_PRIVATE)
+            continue;
+
+        uint32_t idPageShared = 0;
+        switch (GMMFusionLookup(&g_Table, GMMFusionHashPage(g_aPages[idPage].pb), idPage, tstVerify, NULL, &idPageShared))
+        {
+            case GMMFUSIONACTION_USE_SHARED:
+                RTTEST_CHECK(g_hTest, g_aPages[idPageShared].enmState == TSTPAGESTATE_SHARED);
+                tstFreePage(idPage);
+                g_aPages[idPageShared].cRefs++;
+                g_aaidGuest[iVM][iGuest] = idPageShared;
+                break;
+
+            case GMMFUSIONACTION_MAKE_SHARED:
+                g_aPages[idPage].enmState = TSTPAGESTATE_SHARED;
+                g_aPages[idPage].cRefs    = 1;
+                break;
+
+            case GMMFUSIONACTION_NONE:
+                break;
+
+            default:
+                RTTestFailed(g_hTest, "Unexpected action");
+                break;
+        }
+    }
+}
+
+
+/**
+ * Guest write to a page, breaking sharing like PGM does.
+ */
+static void tstWriteGuestPage(uint32_t iVM, uint32_t iGuest, uint32_t uClass)
+{
+    uint32_t idPage = g_aaidGuest[iVM][iGuest];
+    if (g_aPages[idPage].enmState == TSTPAGESTATE_SHARED)
+    {
+        uint32_t idPageNew = tstAllocPage();
+        memcpy(g_aPages[idPageNew].pb, g_aPages[idPage].pb, PAGE_SIZE);
+        if (--g_aPages[idPage].cRefs == 0)
+            tstFreePage(idPage);
+        g_aaidGuest[iVM][iGuest] = idPage = idPageNew;
+    }
+    tstFillClass(g_aPages[idPage].pb, uClass);
+    tstFillClass(tstExpected(iVM, iGuest), uClass);
+}
+
+
+/**
+ * Checks that every guest page has the expected content and that the page
+ * reference counts add up.
+ *
+ * @returns The number of host pages in use.
+ */
+static uint32_t tstCheckState(void)
+{
+    static uint32_t s_acRefs[TST_HOST_PAGES];
+    RT_ZERO(s_acRefs);
+
+    for (uint32_t iVM = 0; iVM < TST_VMS; iVM++)
+        for (uint32_t iGuest = 0; iGuest < TST_GUEST_PAGES; iGuest++)
+        {
+            uint32_t idPage = g_aaidGuest[iVM][iGuest];
+            if (g_aPages[idPage].enmState == TSTPAGESTATE_FREE)
+                RTTestFailed(g_hTest, "VM %u page %u uses free page %#x", iVM, iGuest, idPage);
+            else if (memcmp(g_aPages[idPage].pb, tstExpected(iVM, iGuest), PAGE_SIZE))
+                RTTestFailed(g_hTest, "VM %u page %u (%#x) has the wrong content", iVM, iGuest, idPage);
+            s_acRefs[idPage]++;
+        }
+
+    uint32_t cInUse = 0;
+    for (uint32_t idPage = 1; idPage < TST_HOST_PAGES; idPage++)
+        if (g_aPages[idPage].enmState != TSTPAGESTATE_FREE)
+        {
+            cInUse++;
+            if (g_aPages[idPage].enmState == TSTPAGESTATE_SHARED)
+                RTTEST_CHECK_MSG(g_hTest, s_acRefs[idPage] == g_aPages[idPage].cRefs,
+                                 (g_hTest, "page %#x: cRefs=%u, %u users\n", idPage, g_aPages[idPage].cRefs, s_acRefs[idPage]));
+            else
+                RTTEST_CHECK_MSG(g_hTest, s_acRefs[idPage] == 1, (g_hTest, "page %#x: %u users\n", idPage, s_acRefs[idPage]));
+        }
+    return cInUse;
+}
+
+
+static void tstHash(void)
+{
+    RTTestSub(g_hTest, "Hashing");
+    uint8_t *pb1 = g_aPages[1].pb;
+    uint8_t *pb2 = g_aPages[2].pb;
+
+    /* Identical content, identical hash. */
+    tstFillClass(pb1, 42);
+    tstFillClass(pb2, 42);
+    uint64_t const uHash = GMMFusionHashPage(pb1);
+    RTTEST_CHECK(g_hTest, uHash == GMMFusionHashPage(pb2));
+
+    /* Flipping any single bit must change it, and the bucket index bits should
+       look random: about 0.2% of random 16-bit values have less than 3 bits set. */
+    uint32_t cWeak = 0;
+    for (uint32_t iBit = 0; iBit < PAGE_SIZE * 8; iBit += 7)
+    {
+        ASMBitToggle(pb2, iBit);
+        uint64_t uHash2 = GMMFusionHashPage(pb2);
+        RTTEST_CHECK_MSG(g_hTest, uHash2 != uHash, (g_hTest, "iBit=%u\n", iBit));
+        uint32_t fDiff = (uint32_t)(uHash2 ^ uHash) & 0xffff;
+        uint32_t cBits = 0;
+        for (; fDiff; fDiff &= fDiff - 1)
+            cBits++;
+        if (cBits < 3)
+            cWeak++;
+        ASMBitToggle(pb2, iBit);
+    }
+    RTTEST_CHECK_MSG(g_hTest, cWeak < 32, (g_hTest, "cWeak=%u\n", cWeak));
+
+    /* Word order must matter, also between the two lanes. */
+    uint64_t *pu64 = (uint64_t *)pb2;
+    uint64_t  uTmp = pu64[0]; pu64[0] = pu64[1]; pu64[1] = uTmp;
+    RTTEST_CHECK(g_hTest, GMMFusionHashPage(pb2) != uHash);
+    uTmp = pu64[0]; pu64[0] = pu64[1]; pu64[1] = uTmp;
+    uTmp = pu64[10]; pu64[10] = pu64[12]; pu64[12] = uTmp;
+    RTTEST_CHECK(g_hTest, GMMFusionHashPage(pb2) != uHash);
+
+    /* Throughput. */
+    uint64_t const cIterations = 16384;
+    uint64_t       uSum        = 0;
+    uint64_t const nsStart     = RTTimeNanoTS();
+    for (uint64_t i = 0; i < cIterations; i++)
+        uSum += GMMFusionHashPage(g_aPages[1 + (i & 255)].pb);
+    uint64_t const cNs = RTTimeNanoTS() - nsStart;
+    RTTestValue(g_hTest, "Hash", cNs / cIterations, RTTESTUNIT_NS_PER_CALL);
+    if (cNs)
+        RTTestValue(g_hTest, "Hash throughput", cIterations * PAGE_SIZE * RT_NS_1SEC / cNs / _1M, RTTESTUNIT_MEGABYTES_PER_SEC);
+    NOREF(uSum);
+}
+
+
+/**
+ * Runs the scanner over the VMs and checks the outcome.
+ *
+ * @param   cShift      The table size shift.
+ * @param   fExact      Whether all duplicates must have been found.
+ */
+static void tstMerge(uint32_t cShift, bool fExact)
+{
+    RTTestSubF(g_hTest, "Merging, %u buckets", RT_BIT_32(cShift));
+    PGMMFUSIONBUCKET paBuckets = (PGMMFUSIONBUCKET)RTMemAllocZ(sizeof(GMMFUSIONBUCKET) << cShift);
+    RTTEST_CHECK_RETV(g_hTest, paBuckets);
+    GMMFusionTableInit(&g_Table, paBuckets, cShift);
+
+    uint32_t const cDistinct = tstSetupVMs();
+    RTTEST_CHECK(g_hTest, tstCheckState() == TST_VMS * TST_GUEST_PAGES);
+
+    /*
+     * The first round finds the candidates, the second round completes the
+     * merging (older private copies pick up the shared page).
+     */
+    for (uint32_t iRound = 0; iRound < 2; iRound++)
+        for (uint32_t iVM = 0; iVM < TST_VMS; iVM++)
+            tstScanVM(iVM);
+    uint32_t cInUse = tstCheckState();
+    RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "%u pages in use for %u distinct contents (%u lookups, %u false matches)\n",
+                 cInUse, cDistinct, (uint32_t)g_Table.cLookups, (uint32_t)g_Table.cFalseMatches);
+    if (fExact)
+        RTTEST_CHECK_MSG(g_hTest, cInUse == cDistinct, (g_hTest, "cInUse=%u cDistinct=%u\n", cInUse, cDistinct));
+    else
+        RTTEST_CHECK_MSG(g_hTest, cInUse < TST_VMS * TST_GUEST_PAGES, (g_hTest, "cInUse=%u\n", cInUse));
+
+    /*
+     * Have the guests write to shared and private pages, recycling page IDs
+     * so the table is full of stale entries, then make sure rescanning
+     * doesn't merge anything it shouldn't.
+     */
+    for (uint32_t iVM = 0; iVM < TST_VMS; iVM++)
+        for (uint32_t iGuest = iVM; iGuest < TST_GUEST_PAGES; iGuest += 3)
+            tstWriteGuestPage(iVM, iGuest, 0x10000 + (iGuest % 5));
+    tstCheckState();
+
+    for (uint32_t iRound = 0; iRound < 2; iRound++)
+        for (uint32_t iVM = 0; iVM < TST_VMS; iVM++)
+        {
+            tstScanVM(iVM);
+            tstCheckState();
+        }
+    RTTEST_CHECK(g_hTest, g_Table.cStableHits > 0);
+    RTTEST_CHECK(g_hTest, g_Table.cPromotions > 0);
+
+    RTMemFree(paBuckets);
+}
+
+
+int main()
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstGMMFusion", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    g_pabExpected = (uint8_t *)RTMemPageAllocZ((size_t)TST_VMS * TST_GUEST_PAGES * PAGE_SIZE);
+    uint8_t *pbPages = (uint8_t *)RTMemPageAllocZ((size_t)TST_HOST_PAGES * PAGE_SIZE);
+    if (g_pabExpected && pbPages)
+    {
+        for (uint32_t idPage = 0; idPage < TST_HOST_PAGES; idPage++)
+            g_aPages[idPage].pb = &pbPages[(size_t)idPage << PAGE_SHIFT];
+
+        tstHash();
+        tstMerge(GMM_FUSION_TABLE_SHIFT_DEFAULT, true /*fExact*/);
+        tstMerge(4, false /*fExact*/);
+    }
+    else
+        RTTestFailed(g_hTest, "Out of memory");
+
+    RTMemPageFree(pbPages, (size_t)TST_HOST_PAGES * PAGE_SIZE);
+    RTMemPageFree(g_pabExpected, (size_t)TST_VMS * TST_GUEST_PAGES * PAGE_SIZE);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
+
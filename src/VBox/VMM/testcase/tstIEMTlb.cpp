@@ -0,0 +1,680 @@
+/* $Id$ */
+/** @file
+ * IEM Testcase - Instruction and data TLB invalidation and throughput.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/vmm.h>
+#include <VBox/vmm/cpum.h>
+#include <VBox/vmm/pgm.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/vmm/stam.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/initterm.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+#include <iprt/x86.h>
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+#define TESTCASE                    "tstIEMTlb"
+/** The guest RAM size. */
+#define TST_RAM_SIZE                (64 * _1M)
+/** The number of chunks the ring-3 mapping cache may hold (/PGM/MaxRing3Chunks),
+ *  a lot less than the guest RAM size so chunks get unmapped. */
+#define TST_MAX_RING3_CHUNKS        8
+
+/** Where the guest code goes. */
+#define TST_GCPHYS_CODE             UINT32_C(0x00001000)
+/** The command variables (TSTVARS). */
+#define TST_GCPHYS_VARS             UINT32_C(0x00002000)
+/** The two page directories.  Both identity map everything with 4MB pages,
+ *  except for TST_GCPTR_PAGE, which is mapped by a page table of its own. */
+#define TST_GCPHYS_PD_A             UINT32_C(0x00100000)
+#define TST_GCPHYS_PD_B             UINT32_C(0x00101000)
+/** The page tables for TST_GCPTR_PAGE in each of the page directories. */
+#define TST_GCPHYS_PT_A             UINT32_C(0x00102000)
+#define TST_GCPHYS_PT_B             UINT32_C(0x00103000)
+/** The pages TST_GCPTR_PAGE is mapped to. */
+#define TST_GCPHYS_DATA_A           UINT32_C(0x00110000)
+#define TST_GCPHYS_DATA_B           UINT32_C(0x00111000)
+#define TST_GCPHYS_DATA_C           UINT32_C(0x00112000)
+/** The linear address used for the CR3, INVLPG and handler checks. */
+#define TST_GCPTR_PAGE              UINT32_C(0x00400000)
+/** The page used for the chunk unmap check (identity mapped). */
+#define TST_GCPHYS_CHUNK_PAGE       UINT32_C(0x00800000)
+/** Touched before TST_GCPHYS_CHUNK_PAGE, so it doesn't share a chunk with the
+ *  code and page tables. */
+#define TST_GCPHYS_PREFILL          UINT32_C(0x00a00000)
+#define TST_PREFILL_PAGES           512
+/** Touched to cycle thru the ring-3 chunk mapping cache. */
+#define TST_GCPHYS_SPREAD           UINT32_C(0x01000000)
+#define TST_SPREAD_PAGES            ((TST_RAM_SIZE - TST_GCPHYS_SPREAD) >> PAGE_SHIFT)
+/** The benchmark pages (identity mapped), TST_BENCH_PAGES of them. */
+#define TST_GCPHYS_BENCH            UINT32_C(0x00c00000)
+#define TST_BENCH_PAGES             32
+/** The number of instructions per benchmark iteration (see g_abGuestCode). */
+#define TST_BENCH_INSTRS_PER_ITER   (2 + TST_BENCH_PAGES * 3 + 2)
+
+/** @name Guest commands (TSTVARS::uCmd).
+ * @{ */
+#define TST_CMD_READ                1   /**< uResult = [uArg] */
+#define TST_CMD_WRITE               2   /**< [uArg] = uValue */
+#define TST_CMD_LOAD_CR3            3   /**< CR3 = uArg */
+#define TST_CMD_INVLPG              4   /**< INVLPG [uArg] */
+#define TST_CMD_TOUCH               5   /**< Writes uValue pages from uArg on (skipping TLB slot 0). */
+#define TST_CMD_BENCH               6   /**< Adds to TST_BENCH_PAGES pages from uArg on, uValue times. */
+/** @} */
+
+/** The values the first dwords of the data pages are initialized to. */
+#define TST_MAGIC_A                 UINT32_C(0xa0a0a0a0)
+#define TST_MAGIC_B                 UINT32_C(0xb0b0b0b0)
+#define TST_MAGIC_C                 UINT32_C(0xc0c0c0c0)
+#define TST_MAGIC_CHUNK             UINT32_C(0xd0d0d0d0)
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/**
+ * The variables shared with the guest code at TST_GCPHYS_VARS.
+ */
+typedef struct TSTVARS
+{
+    /** The sequence number of the last command posted. */
+    uint32_t    uSeq;
+    /** The sequence number of the last command completed by the guest. */
+    uint32_t    uDone;
+    /** The command (TST_CMD_XXX). */
+    uint32_t    uCmd;
+    /** The address argument. */
+    uint32_t    uArg;
+    /** The value argument. */
+    uint32_t    uValue;
+    /** The result of TST_CMD_READ. */
+    uint32_t    uResult;
+} TSTVARS;
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/**
+ * The guest code (32-bit, flat, paged).  Spins until a command is posted and
+ * executes it.
+ *
+ * @code
+ *  wait:   mov     eax, [TSTVARS.uSeq]
+ *          cmp     eax, [TSTVARS.uDone]
+ *          jne     cmd
+ *          pause
+ *          jmp     wait
+ *  cmd:    mov     ebx, [TSTVARS.uCmd]
+ *          mov     esi, [TSTVARS.uArg]
+ *          mov     edx, [TSTVARS.uValue]
+ *          cmp     ebx, 1
+ *          je      read
+ *          ...
+ *          cmp     ebx, 6
+ *          je      bench
+ *  done:   mov     eax, [TSTVARS.uSeq]
+ *          mov     [TSTVARS.uDone], eax
+ *          jmp     wait
+ *  read:   mov     eax, [esi]
+ *          mov     [TSTVARS.uResult], eax
+ *          jmp     done
+ *  write:  mov     [esi], edx
+ *          jmp     done
+ *  cr3:    mov     cr3, esi
+ *          jmp     done
+ *  invlpg: invlpg  [esi]
+ *          jmp     done
+ *  touch:  test    esi, 3f000h
+ *          jz      .skip
+ *          mov     [esi], esi
+ *  .skip:  add     esi, 1000h
+ *          dec     edx
+ *          jnz     touch
+ *          jmp     done
+ *  bench:  mov     edi, esi
+ *          mov     ecx, TST_BENCH_PAGES
+ *  .next:  add     [edi], ecx
+ *          add     edi, 1000h
+ *          loop    .next
+ *          dec     edx
+ *          jnz     bench
+ *          jmp     done
+ * @endcode
+ */
+static const uint8_t g_abGuestCode[] =
+{
+    0xa1, 0x00, 0x20, 0x00, 0x00,
+    0x3b, 0x05, 0x04, 0x20, 0x00, 0x00,
+    0x75, 0x04,
+    0xf3, 0x90,
+    0xeb, 0xef,
+    0x8b, 0x1d, 0x08, 0x20, 0x00, 0x00,
+    0x8b, 0x35, 0x0c, 0x20, 0x00, 0x00,
+    0x8b, 0x15, 0x10, 0x20, 0x00, 0x00,
+    0x83, 0xfb, 0x01,
+    0x74, 0x25,
+    0x83, 0xfb, 0x02,
+    0x74, 0x29,
+    0x83, 0xfb, 0x03,
+    0x74, 0x28,
+    0x83, 0xfb, 0x04,
+    0x74, 0x28,
+    0x83, 0xfb, 0x05,
+    0x74, 0x28,
+    0x83, 0xfb, 0x06,
+    0x74, 0x38,
+    0xa1, 0x00, 0x20, 0x00, 0x00,
+    0xa3, 0x04, 0x20, 0x00, 0x00,
+    0xeb, 0xb3,
+    0x8b, 0x06,
+    0xa3, 0x14, 0x20, 0x00, 0x00,
+    0xeb, 0xeb,
+    0x89, 0x16,
+    0xeb, 0xe7,
+    0x0f, 0x22, 0xde,
+    0xeb, 0xe2,
+    0x0f, 0x01, 0x3e,
+    0xeb, 0xdd,
+    0xf7, 0xc6, 0x00, 0xf0, 0x03, 0x00,
+    0x74, 0x02,
+    0x89, 0x36,
+    0x81, 0xc6, 0x00, 0x10, 0x00, 0x00,
+    0x4a,
+    0x75, 0xed,
+    0xeb, 0xc8,
+    0x89, 0xf7,
+    0xb9, 0x20, 0x00, 0x00, 0x00,
+    0x01, 0x0f,
+    0x81, 0xc7, 0x00, 0x10, 0x00, 0x00,
+    0xe2, 0xf6,
+    0x4a,
+    0x75, 0xec,
+    0xeb, 0xb2,
+};
+
+/** The test handle. */
+static RTTEST               g_hTest;
+/** The sequence number of the last command posted. */
+static uint32_t             g_uSeq;
+/** The number of times tstWriteHandler was called. */
+static uint32_t volatile    g_cHandlerCalls;
+
+
+static DECLCALLBACK(int) tstConfigConstructor(PUVM pUVM, PVM pVM, void *pvUser)
+{
+    NOREF(pUVM);
+    PCFGMNODE pRoot = CFGMR3GetRoot(pVM);
+    int rc = CFGMR3InsertInteger(pRoot, "RamSize", TST_RAM_SIZE);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+
+    PCFGMNODE pEM;
+    rc = CFGMR3InsertNode(pRoot, "EM", &pEM);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+    rc = CFGMR3InsertInteger(pEM, "IemExecutesAll", true);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+
+    PCFGMNODE pIEM;
+    rc = CFGMR3InsertNode(pRoot, "IEM", &pIEM);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+    rc = CFGMR3InsertInteger(pIEM, "TlbEnabled", *(bool *)pvUser);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+
+    PCFGMNODE pPGM;
+    rc = CFGMR3InsertNode(pRoot, "PGM", &pPGM);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+    rc = CFGMR3InsertInteger(pPGM, "MaxRing3Chunks", TST_MAX_RING3_CHUNKS);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Physical write handler for the handler registration check.
+ */
+static DECLCALLBACK(VBOXSTRICTRC) tstWriteHandler(PVM pVM, PVMCPU pVCpu, RTGCPHYS GCPhys, void *pvPhys, void *pvBuf, size_t cbBuf,
+                                                  PGMACCESSTYPE enmAccessType, PGMACCESSORIGIN enmOrigin, void *pvUser)
+{
+    NOREF(pVM); NOREF(pVCpu); NOREF(GCPhys); NOREF(pvPhys); NOREF(pvBuf); NOREF(cbBuf); NOREF(enmOrigin); NOREF(pvUser);
+    Assert(enmAccessType == PGMACCESSTYPE_WRITE); NOREF(enmAccessType);
+    ASMAtomicIncU32(&g_cHandlerCalls);
+    return VINF_PGM_HANDLER_DO_DEFAULT;
+}
+
+
+/**
+ * Writes a guest dword (EMT).
+ */
+static DECLCALLBACK(int) tstWriteU32(PVM pVM, RTGCPHYS GCPhys, uint32_t u32)
+{
+    return PGMPhysSimpleWriteGCPhys(pVM, GCPhys, &u32, sizeof(u32));
+}
+
+
+/**
+ * Reads a guest dword (EMT).
+ */
+static DECLCALLBACK(int) tstReadU32(PVM pVM, RTGCPHYS GCPhys, uint32_t *pu32)
+{
+    return PGMPhysSimpleReadGCPhys(pVM, pu32, GCPhys, sizeof(*pu32));
+}
+
+
+/**
+ * Sets up the guest memory and a flat 32-bit paged CPU state (EMT).
+ */
+static DECLCALLBACK(int) tstSetupGuest(PVM pVM)
+{
+    PVMCPU pVCpu = VMMGetCpu(pVM);
+    static uint32_t s_au32[X86_PG_ENTRIES];
+
+    int rc = PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_CODE, g_abGuestCode, sizeof(g_abGuestCode));
+    AssertRCReturn(rc, rc);
+    TSTVARS Vars;
+    RT_ZERO(Vars);
+    rc = PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_VARS, &Vars, sizeof(Vars));
+    AssertRCReturn(rc, rc);
+
+    /* The page directories. */
+    for (uint32_t i = 0; i < X86_PG_ENTRIES; i++)
+        s_au32[i] = ((uint32_t)i << X86_PD_SHIFT) < TST_RAM_SIZE
+                  ? ((uint32_t)i << X86_PD_SHIFT) | X86_PDE4M_P | X86_PDE4M_RW | X86_PDE4M_PS
+                  : 0;
+    s_au32[TST_GCPTR_PAGE >> X86_PD_SHIFT] = TST_GCPHYS_PT_A | X86_PDE_P | X86_PDE_RW;
+    rc = PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_PD_A, s_au32, sizeof(s_au32));
+    AssertRCReturn(rc, rc);
+    s_au32[TST_GCPTR_PAGE >> X86_PD_SHIFT] = TST_GCPHYS_PT_B | X86_PDE_P | X86_PDE_RW;
+    rc = PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_PD_B, s_au32, sizeof(s_au32));
+    AssertRCReturn(rc, rc);
+
+    /* The page tables, only the first entry is used. */
+    RT_ZERO(s_au32);
+    s_au32[0] = TST_GCPHYS_DATA_A | X86_PTE_P | X86_PTE_RW;
+    rc = PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_PT_A, s_au32, sizeof(s_au32));
+    AssertRCReturn(rc, rc);
+    s_au32[0] = TST_GCPHYS_DATA_B | X86_PTE_P | X86_PTE_RW;
+    rc = PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_PT_B, s_au32, sizeof(s_au32));
+    AssertRCReturn(rc, rc);
+
+    rc = tstWriteU32(pVM, TST_GCPHYS_DATA_A, TST_MAGIC_A);
+    AssertRCReturn(rc, rc);
+    rc = tstWriteU32(pVM, TST_GCPHYS_DATA_B, TST_MAGIC_B);
+    AssertRCReturn(rc, rc);
+    rc = tstWriteU32(pVM, TST_GCPHYS_DATA_C, TST_MAGIC_C);
+    AssertRCReturn(rc, rc);
+
+    PCPUMCTX pCtx = CPUMQueryGuestCtxPtr(pVCpu);
+    pCtx->cs.Sel      = pCtx->cs.ValidSel = 0x08;
+    pCtx->cs.fFlags   = CPUMSELREG_FLAGS_VALID;
+    pCtx->cs.u64Base  = 0;
+    pCtx->cs.u32Limit = UINT32_MAX;
+    pCtx->cs.Attr.u   = X86_SEL_TYPE_ER_ACC | X86DESCATTR_DT | X86DESCATTR_P | X86DESCATTR_D | X86DESCATTR_G;
+    pCtx->ss.Sel      = pCtx->ss.ValidSel = 0x10;
+    pCtx->ss.fFlags   = CPUMSELREG_FLAGS_VALID;
+    pCtx->ss.u64Base  = 0;
+    pCtx->ss.u32Limit = UINT32_MAX;
+    pCtx->ss.Attr.u   = X86_SEL_TYPE_RW_ACC | X86DESCATTR_DT | X86DESCATTR_P | X86DESCATTR_D | X86DESCATTR_G;
+    pCtx->ds = pCtx->es = pCtx->fs = pCtx->gs = pCtx->ss;
+    pCtx->tr.Sel      = pCtx->tr.ValidSel = 0x18;
+    pCtx->tr.fFlags   = CPUMSELREG_FLAGS_VALID;
+    pCtx->tr.u64Base  = 0;
+    pCtx->tr.u32Limit = 0x67;
+    pCtx->tr.Attr.u   = X86_SEL_TYPE_SYS_386_TSS_BUSY | X86DESCATTR_P;
+    pCtx->ldtr.Sel    = pCtx->ldtr.ValidSel = 0;
+    pCtx->ldtr.fFlags = CPUMSELREG_FLAGS_VALID;
+    pCtx->ldtr.Attr.u = X86DESCATTR_UNUSABLE;
+    pCtx->gdtr.cbGdt  = 0x1f;
+    pCtx->gdtr.pGdt   = 0;
+    pCtx->idtr.cbIdt  = 0;
+    pCtx->idtr.pIdt   = 0;
+    pCtx->rip         = TST_GCPHYS_CODE;
+    pCtx->rsp         = TST_GCPHYS_CODE;
+    pCtx->rflags.u    = X86_EFL_1;
+    pCtx->cr0         = X86_CR0_PE | X86_CR0_ET | X86_CR0_NE | X86_CR0_PG;
+    pCtx->cr3         = TST_GCPHYS_PD_A;
+    pCtx->cr4         = X86_CR4_PSE;
+    pCtx->msrEFER     = 0;
+    VMCPU_FF_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3);
+    return PGMChangeMode(pVCpu, pCtx->cr0, pCtx->cr4, pCtx->msrEFER);
+}
+
+
+/**
+ * Posts a command to the guest (EMT).
+ */
+static DECLCALLBACK(int) tstPostCmd(PVM pVM, uint32_t uSeq, uint32_t uCmd, uint32_t uArg, uint32_t uValue)
+{
+    TSTVARS Vars;
+    int rc = PGMPhysSimpleReadGCPhys(pVM, &Vars, TST_GCPHYS_VARS, sizeof(Vars));
+    AssertRCReturn(rc, rc);
+    Vars.uCmd   = uCmd;
+    Vars.uArg   = uArg;
+    Vars.uValue = uValue;
+    Vars.uSeq   = uSeq;
+    return PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_VARS, &Vars, sizeof(Vars));
+}
+
+
+/**
+ * Has the guest execute a command and waits for it to complete.
+ *
+ * @returns VBox status code.
+ * @param   pUVM        The user mode VM handle.
+ * @param   pVM         The cross context VM structure.
+ * @param   uCmd        The command (TST_CMD_XXX).
+ * @param   uArg        The address argument.
+ * @param   uValue      The value argument.
+ * @param   puResult    Where to return TSTVARS::uResult, optional.
+ */
+static int tstGuestCmd(PUVM pUVM, PVM pVM, uint32_t uCmd, uint32_t uArg, uint32_t uValue, uint32_t *puResult)
+{
+    uint32_t const uSeq = ++g_uSeq;
+    int rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstPostCmd, 5, pVM, uSeq, uCmd, uArg, uValue);
+    AssertRCReturn(rc, rc);
+
+    uint64_t const msStart = RTTimeMilliTS();
+    for (;;)
+    {
+        TSTVARS Vars;
+        rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)PGMPhysSimpleReadGCPhys, 4,
+                              pVM, &Vars, (RTGCPHYS)TST_GCPHYS_VARS, sizeof(Vars));
+        AssertRCReturn(rc, rc);
+        if (Vars.uDone == uSeq)
+        {
+            if (puResult)
+                *puResult = Vars.uResult;
+            return VINF_SUCCESS;
+        }
+        if (RTTimeMilliTS() - msStart > 120000)
+        {
+            RTTestIFailed("command %u (%#x, %#x) not done after 120 seconds\n", uCmd, uArg, uValue);
+            return VERR_TIMEOUT;
+        }
+        RTThreadSleep(1);
+    }
+}
+
+
+/**
+ * Has the guest read a dword and checks the value.
+ */
+static void tstCheckGuestRead(PUVM pUVM, PVM pVM, uint32_t GCPtr, uint32_t uExpect, const char *pszWhat)
+{
+    uint32_t uValue = 0;
+    int rc = tstGuestCmd(pUVM, pVM, TST_CMD_READ, GCPtr, 0, &uValue);
+    if (RT_SUCCESS(rc) && uValue != uExpect)
+        RTTestIFailed("%s: read %#x at %#x, expected %#x\n", pszWhat, uValue, GCPtr, uExpect);
+}
+
+
+/**
+ * Checks a guest physical dword.
+ */
+static void tstCheckPhys(PUVM pUVM, PVM pVM, RTGCPHYS GCPhys, uint32_t uExpect, const char *pszWhat)
+{
+    uint32_t uValue = 0;
+    int rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstReadU32, 3, pVM, GCPhys, &uValue);
+    if (RT_FAILURE(rc) || uValue != uExpect)
+        RTTestIFailed("%s: rc=%Rrc value=%#x at %RGp, expected %#x\n", pszWhat, rc, uValue, GCPhys, uExpect);
+}
+
+
+/**
+ * Registers the write handler on TST_GCPHYS_DATA_C (EMT).
+ */
+static DECLCALLBACK(int) tstRegisterHandler(PVM pVM)
+{
+    PGMPHYSHANDLERTYPE hType;
+    int rc = PGMR3HandlerPhysicalTypeRegister(pVM, PGMPHYSHANDLERKIND_WRITE, tstWriteHandler,
+                                              NULL, NULL, NULL, NULL, NULL, NULL, "tstIEMTlb", &hType);
+    AssertRCReturn(rc, rc);
+    rc = PGMHandlerPhysicalRegister(pVM, TST_GCPHYS_DATA_C, TST_GCPHYS_DATA_C + PAGE_OFFSET_MASK, hType,
+                                    NULL, NIL_RTR0PTR, NIL_RTRCPTR, "tstIEMTlb");
+    PGMHandlerPhysicalTypeRelease(pVM, hType);
+    return rc;
+}
+
+
+/**
+ * Removes the write handler again (EMT).
+ */
+static DECLCALLBACK(int) tstDeregisterHandler(PVM pVM)
+{
+    return PGMHandlerPhysicalDeregister(pVM, TST_GCPHYS_DATA_C);
+}
+
+
+/**
+ * STAMR3Enum callback getting a 32-bit counter.
+ */
+static DECLCALLBACK(int) tstStamU32Callback(const char *pszName, STAMTYPE enmType, void *pvSample, STAMUNIT enmUnit,
+                                            STAMVISIBILITY enmVisibility, const char *pszDesc, void *pvUser)
+{
+    NOREF(pszName); NOREF(enmUnit); NOREF(enmVisibility); NOREF(pszDesc);
+    if (enmType == STAMTYPE_U32 || enmType == STAMTYPE_U32_RESET)
+        *(uint32_t *)pvUser = *(uint32_t *)pvSample;
+    return 0;
+}
+
+
+/**
+ * Gets a 32-bit statistics counter.
+ */
+static uint32_t tstGetStatU32(PUVM pUVM, const char *pszName)
+{
+    uint32_t u32 = 0;
+    STAMR3Enum(pUVM, pszName, tstStamU32Callback, &u32);
+    return u32;
+}
+
+
+/**
+ * Checks that the TLBs are invalidated when they should be.
+ */
+static void tstInvalidation(PUVM pUVM, PVM pVM)
+{
+    /*
+     * CR3 loads.  Both page directories map TST_GCPTR_PAGE, to different pages.
+     */
+    RTTestSub(g_hTest, "CR3 load");
+    tstCheckGuestRead(pUVM, pVM, TST_GCPTR_PAGE, TST_MAGIC_A, "PD A");
+    tstCheckGuestRead(pUVM, pVM, TST_GCPTR_PAGE, TST_MAGIC_A, "PD A again");
+    tstGuestCmd(pUVM, pVM, TST_CMD_LOAD_CR3, TST_GCPHYS_PD_B, 0, NULL);
+    tstCheckGuestRead(pUVM, pVM, TST_GCPTR_PAGE, TST_MAGIC_B, "PD B");
+    tstGuestCmd(pUVM, pVM, TST_CMD_LOAD_CR3, TST_GCPHYS_PD_A, 0, NULL);
+    tstCheckGuestRead(pUVM, pVM, TST_GCPTR_PAGE, TST_MAGIC_A, "back to PD A");
+
+    /*
+     * INVLPG after changing the page table entry behind the guest's back.
+     */
+    RTTestSub(g_hTest, "INVLPG");
+    int rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstWriteU32, 3, pVM, (RTGCPHYS)TST_GCPHYS_PT_A,
+                              TST_GCPHYS_DATA_C | X86_PTE_P | X86_PTE_RW);
+    RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    tstGuestCmd(pUVM, pVM, TST_CMD_INVLPG, TST_GCPTR_PAGE, 0, NULL);
+    tstCheckGuestRead(pUVM, pVM, TST_GCPTR_PAGE, TST_MAGIC_C, "after INVLPG");
+
+    /*
+     * Handler registration and removal.  The guest has written to the page
+     * before, so the TLB caches a writable mapping of it.
+     */
+    RTTestSub(g_hTest, "Handlers");
+    tstGuestCmd(pUVM, pVM, TST_CMD_WRITE, TST_GCPTR_PAGE, 1, NULL);
+    tstGuestCmd(pUVM, pVM, TST_CMD_WRITE, TST_GCPTR_PAGE, 2, NULL);
+    tstCheckPhys(pUVM, pVM, TST_GCPHYS_DATA_C, 2, "before registering");
+
+    ASMAtomicWriteU32(&g_cHandlerCalls, 0);
+    rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstRegisterHandler, 1, pVM);
+    RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    tstGuestCmd(pUVM, pVM, TST_CMD_WRITE, TST_GCPTR_PAGE, 3, NULL);
+    RTTESTI_CHECK_MSG(g_cHandlerCalls == 1, ("handler called %u times after registering, expected 1\n", g_cHandlerCalls));
+    tstCheckPhys(pUVM, pVM, TST_GCPHYS_DATA_C, 3, "with handler");
+    tstGuestCmd(pUVM, pVM, TST_CMD_WRITE, TST_GCPTR_PAGE, 4, NULL);
+    RTTESTI_CHECK_MSG(g_cHandlerCalls == 2, ("handler called %u times, expected 2\n", g_cHandlerCalls));
+
+    rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstDeregisterHandler, 1, pVM);
+    RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    tstGuestCmd(pUVM, pVM, TST_CMD_WRITE, TST_GCPTR_PAGE, 5, NULL);
+    tstGuestCmd(pUVM, pVM, TST_CMD_WRITE, TST_GCPTR_PAGE, 6, NULL);
+    RTTESTI_CHECK_MSG(g_cHandlerCalls == 2, ("handler called %u times after removal, expected 2\n", g_cHandlerCalls));
+    tstCheckPhys(pUVM, pVM, TST_GCPHYS_DATA_C, 6, "after removal");
+    tstCheckGuestRead(pUVM, pVM, TST_GCPTR_PAGE, 6, "after removal");
+
+    /*
+     * Chunk unmapping.  Get TST_GCPHYS_CHUNK_PAGE into a chunk of its own (more
+     * or less), allocate the rest of the RAM, have the TLB cache a mapping of the
+     * page and then cycle thru all of the RAM without allocating anything, so
+     * the chunk is unmapped without the physical revision changing otherwise.
+     * The TLB slot of the page is skipped while doing so.
+     */
+    RTTestSub(g_hTest, "Chunk unmap");
+    tstGuestCmd(pUVM, pVM, TST_CMD_TOUCH, TST_GCPHYS_PREFILL, TST_PREFILL_PAGES, NULL);
+    tstGuestCmd(pUVM, pVM, TST_CMD_WRITE, TST_GCPHYS_CHUNK_PAGE, TST_MAGIC_CHUNK, NULL);
+    tstGuestCmd(pUVM, pVM, TST_CMD_TOUCH, TST_GCPHYS_SPREAD, TST_SPREAD_PAGES, NULL);
+    tstCheckGuestRead(pUVM, pVM, TST_GCPHYS_CHUNK_PAGE, TST_MAGIC_CHUNK, "before unmapping");
+
+    uint32_t const cUnmappedBefore = tstGetStatU32(pUVM, "/PGM/ChunkR3Map/Unmapped");
+    tstGuestCmd(pUVM, pVM, TST_CMD_TOUCH, TST_GCPHYS_SPREAD, TST_SPREAD_PAGES, NULL);
+    uint32_t const cUnmapped = tstGetStatU32(pUVM, "/PGM/ChunkR3Map/Unmapped") - cUnmappedBefore;
+    RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "%u chunks unmapped\n", cUnmapped);
+    if (!cUnmapped)
+        RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "No chunks were unmapped, so the chunk unmap check proves nothing\n");
+    tstCheckGuestRead(pUVM, pVM, TST_GCPHYS_CHUNK_PAGE, TST_MAGIC_CHUNK, "after unmapping");
+    tstCheckPhys(pUVM, pVM, TST_GCPHYS_CHUNK_PAGE, TST_MAGIC_CHUNK, "after unmapping");
+}
+
+
+/**
+ * Measures the interpreter throughput with a loop touching TST_BENCH_PAGES
+ * pages, which fit into the data TLB.
+ *
+ * @returns Instructions per second, 0 on failure.
+ */
+static uint64_t tstBenchmark(PUVM pUVM, PVM pVM, bool fTlbEnabled)
+{
+    uint32_t const cWarmUp = 1000;
+    uint32_t const cIters  = 100000;
+    tstGuestCmd(pUVM, pVM, TST_CMD_BENCH, TST_GCPHYS_BENCH, cWarmUp, NULL);
+
+    uint32_t const cHitsBefore   = tstGetStatU32(pUVM, "/IEM/CPU0/DataTlb-Hits");
+    uint32_t const cMissesBefore = tstGetStatU32(pUVM, "/IEM/CPU0/DataTlb-Misses");
+    uint64_t const nsStart       = RTTimeNanoTS();
+    int rc = tstGuestCmd(pUVM, pVM, TST_CMD_BENCH, TST_GCPHYS_BENCH, cIters, NULL);
+    uint64_t const cNsElapsed    = RTTimeNanoTS() - nsStart;
+    if (RT_FAILURE(rc))
+        return 0;
+    uint32_t const cHits         = tstGetStatU32(pUVM, "/IEM/CPU0/DataTlb-Hits") - cHitsBefore;
+    uint32_t const cMisses       = tstGetStatU32(pUVM, "/IEM/CPU0/DataTlb-Misses") - cMissesBefore;
+
+    /* Page N got TST_BENCH_PAGES - N added each iteration. */
+    tstCheckPhys(pUVM, pVM, TST_GCPHYS_BENCH, TST_BENCH_PAGES * (cWarmUp + cIters), "benchmark page 0");
+    tstCheckPhys(pUVM, pVM, TST_GCPHYS_BENCH + (TST_BENCH_PAGES - 1) * PAGE_SIZE, cWarmUp + cIters, "benchmark last page");
+
+    uint64_t const cInstrs        = (uint64_t)cIters * TST_BENCH_INSTRS_PER_ITER;
+    uint64_t const cInstrsPerSec  = cInstrs * RT_NS_1SEC / RT_MAX(cNsElapsed, 1);
+    RTTestValueF(g_hTest, cInstrsPerSec, RTTESTUNIT_INSTRS_PER_SEC, "TLBs %s", fTlbEnabled ? "enabled" : "disabled");
+    RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "TLBs %s: %RU64 instructions in %RU64 ns, %u data TLB hits, %u misses\n",
+                 fTlbEnabled ? "enabled" : "disabled", cInstrs, cNsElapsed, cHits, cMisses);
+    return cInstrsPerSec;
+}
+
+
+/**
+ * Creates a VM, runs the checks and the benchmark in it and destroys it.
+ *
+ * @returns Instructions per second from the benchmark, 0 on failure.
+ * @param   fTlbEnabled     Whether to enable the IEM TLBs.
+ */
+static uint64_t tstRun(bool fTlbEnabled)
+{
+    RTTestSubF(g_hTest, "TLBs %s", fTlbEnabled ? "enabled" : "disabled");
+    g_uSeq = 0;
+
+    PVM  pVM;
+    PUVM pUVM;
+    int rc = VMR3Create(1, NULL, NULL, NULL, tstConfigConstructor, &fTlbEnabled, &pVM, &pUVM);
+    if (RT_FAILURE(rc))
+    {
+        RTTestSkipped(g_hTest, "VMR3Create failed: %Rrc", rc);
+        return 0;
+    }
+
+    uint64_t cInstrsPerSec = 0;
+    rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstSetupGuest, 1, pVM);
+    RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    if (RT_SUCCESS(rc))
+    {
+        rc = VMR3PowerOn(pUVM);
+        RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+        if (RT_SUCCESS(rc))
+        {
+            tstInvalidation(pUVM, pVM);
+            RTTestSubF(g_hTest, "Benchmark, TLBs %s", fTlbEnabled ? "enabled" : "disabled");
+            cInstrsPerSec = tstBenchmark(pUVM, pVM, fTlbEnabled);
+        }
+    }
+
+    VMR3PowerOff(pUVM);
+    VMR3Destroy(pUVM);
+    VMR3ReleaseUVM(pUVM);
+    return cInstrsPerSec;
+}
+
+
+/**
+ * Entry point.
+ */
+extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
+{
+    NOREF(argc); NOREF(argv); NOREF(envp);
+    RTEXITCODE rcExit = RTTestInitExAndCreate(argc, &argv, RTR3INIT_FLAGS_SUPLIB, TESTCASE, &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    uint64_t const cWithTlbs    = tstRun(true /*fTlbEnabled*/);
+    uint64_t const cWithoutTlbs = tstRun(false /*fTlbEnabled*/);
+    if (cWithTlbs && cWithoutTlbs)
+        RTTestValue(g_hTest, "Speedup", cWithTlbs * 100 / cWithoutTlbs, RTTESTUNIT_PCT);
+
+    return RTTestSummaryAndDestroy(g_hTest);
+}
+
+
+#if !defined(VBOX_WITH_HARDENING) || !defined(RT_OS_WINDOWS)
+/**
+ * Main entry point.
+ */
+int main(int argc, char **argv, char **envp)
+{
+    return TrustedMain(argc, argv, envp);
+}
+#endif
@@ -0,0 +1,478 @@
+/* $Id$ */
+/** @file
+ * IOM Lookup Testcase - Checks the lock-free I/O port range lookup and the
+ * epoch based freeing of retired lookup tables and ranges.
+ */
+
+/*
+ * Copyright (C) 2006-2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <VBox/vmm/iom.h>
+#include <VBox/vmm/mm.h>
+#include <VBox/vmm/pdmcritsectrw.h>
+#include "IOMInternal.h"
+#include <VBox/vmm/vm.h>
+#include <VBox/err.h>
+#include <iprt/asm.h>
+#include <iprt/mem.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+#include "IOMInline.h"
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The number of reader threads (EMTs) in the stress test. */
+#define TST_READERS             4
+/** The number of virtual CPUs in the fake VM, one extra for the basic tests. */
+#define TST_CPUS                (TST_READERS + 1)
+/** The size of a block in the fake hypervisor heap. */
+#define TST_BLOCK_SIZE          _4K
+/** The number of blocks in the fake hypervisor heap, block 0 is the trees. */
+#define TST_BLOCKS              1024
+/** The first I/O port the stress test registers ranges at. */
+#define TST_PORT_FIRST          0x1000
+/** The number of range slots in the stress test. */
+#define TST_SLOTS               64
+/** The number of ports covered by a stress test slot. */
+#define TST_PORTS_PER_SLOT      32
+/** How long to run the stress test for. */
+#define TST_STRESS_MS           3000
+/** The poison freed blocks are filled with, same as the strict hyper heap. */
+#define TST_FREE_POISON         0xcb
+/** Calculates the pvUser value of a test range. */
+#define TST_RANGE_USER(a_Port)  ( (RTR3PTR)(UINT64_C(0x10a1e5cafe000000) | (a_Port)) )
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/**
+ * A reader thread, playing an EMT doing I/O port lookups.
+ */
+typedef struct TSTREADER
+{
+    /** The virtual CPU the reader uses. */
+    PVMCPU              pVCpu;
+    /** The thread handle. */
+    RTTHREAD            hThread;
+    /** The range the reader is currently looking at, NULL if none.  The fake
+     * MMHyperFree fails the test if it's asked to free this. */
+    void * volatile     pvInUse;
+    /** The xorshift state of the reader. */
+    uint32_t            uRand;
+    /** The number of lookups done. */
+    uint64_t            cLookups;
+    /** The number of lookups that found a range. */
+    uint64_t            cHits;
+    /** Padding to keep the readers in separate cache lines. */
+    uint8_t             abPadding[64];
+} TSTREADER;
+/** Pointer to a reader thread. */
+typedef TSTREADER *PTSTREADER;
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** The test handle. */
+static RTTEST           g_hTest;
+/** The fake VM. */
+static PVM              g_pVM;
+/** The fake hypervisor heap.  Like in the real thing the trees live in it
+ * too, so the lookup table offsets stay within 32 bits. */
+static uint8_t         *g_pbHeap;
+/** Which heap blocks are allocated. */
+static bool             g_afBlockUsed[TST_BLOCKS];
+/** The free block FIFO.  Reusing the blocks in FIFO order keeps the poison
+ * around as long as possible, so use-after-free is easier to spot. */
+static uint32_t         g_aiFree[TST_BLOCKS];
+/** The FIFO head (next block to allocate). */
+static uint32_t         g_iFreeHead;
+/** The number of blocks in the FIFO. */
+static uint32_t         g_cFree;
+/** The number of blocks in use, excluding the trees. */
+static uint32_t         g_cBlocksUsed;
+/** The readers. */
+static TSTREADER        g_aReaders[TST_READERS];
+/** Set when the readers should stop. */
+static bool volatile    g_fStop;
+/** The ranges registered in each stress test slot. */
+static PIOMIOPORTRANGER3 g_apSlots[TST_SLOTS];
+/** Simple xorshift state for the writer. */
+static uint32_t         g_uRand = 0x2545f491;
+
+
+static uint32_t tstRand(uint32_t *puState)
+{
+    uint32_t u = *puState;
+    u ^= u << 13;
+    u ^= u >> 17;
+    u ^= u << 5;
+    return *puState = u;
+}
+
+
+/*
+ * Stubs for the few VMM functions the lookup code calls.
+ */
+
+VMMDECL(int) MMHyperAlloc(PVM pVM, size_t cb, uint32_t uAlignment, MMTAG enmTag, void **ppv)
+{
+    NOREF(pVM); NOREF(enmTag);
+    *ppv = NULL;
+    if (cb > TST_BLOCK_SIZE || uAlignment > TST_BLOCK_SIZE || !g_cFree)
+        return VERR_NO_MEMORY;
+    uint32_t const iBlock = g_aiFree[g_iFreeHead];
+    g_iFreeHead = (g_iFreeHead + 1) % TST_BLOCKS;
+    g_cFree--;
+    g_cBlocksUsed++;
+    g_afBlockUsed[iBlock] = true;
+    *ppv = memset(&g_pbHeap[iBlock * TST_BLOCK_SIZE], 0, TST_BLOCK_SIZE);
+    return VINF_SUCCESS;
+}
+
+
+VMMDECL(int) MMHyperFree(PVM pVM, void *pv)
+{
+    NOREF(pVM);
+    uintptr_t const off    = (uintptr_t)pv - (uintptr_t)g_pbHeap;
+    uint32_t  const iBlock = (uint32_t)(off / TST_BLOCK_SIZE);
+    if (   off >= TST_BLOCKS * TST_BLOCK_SIZE
+        || (off % TST_BLOCK_SIZE)
+        || iBlock == 0
+        || !g_afBlockUsed[iBlock])
+    {
+        RTTestFailed(g_hTest, "MMHyperFree: bad or double free of %p", pv);
+        return VERR_INVALID_POINTER;
+    }
+
+    /* The whole point: nobody may be looking at what we're freeing. */
+    for (unsigned i = 0; i < TST_READERS; i++)
+        if (ASMAtomicReadPtr(&g_aReaders[i].pvInUse) == pv)
+            RTTestFailed(g_hTest, "MMHyperFree: freeing %p while reader #%u is using it", pv, i);
+
+    memset(pv, TST_FREE_POISON, TST_BLOCK_SIZE);
+    g_afBlockUsed[iBlock] = false;
+    g_aiFree[(g_iFreeHead + g_cFree) % TST_BLOCKS] = iBlock;
+    g_cFree++;
+    g_cBlocksUsed--;
+    return VINF_SUCCESS;
+}
+
+
+VMMR3DECL(void *) MMR3HeapAlloc(PVM pVM, MMTAG enmTag, size_t cbSize)
+{
+    NOREF(pVM); NOREF(enmTag);
+    return RTMemAlloc(cbSize);
+}
+
+
+VMMR3DECL(void) MMR3HeapFree(void *pv)
+{
+    RTMemFree(pv);
+}
+
+
+VMMDECL(bool) PDMCritSectRwIsWriteOwner(PPDMCRITSECTRW pCritSect)
+{
+    /* The test only has one writer. */
+    NOREF(pCritSect);
+    return true;
+}
+
+
+/**
+ * Registers a ring-3 I/O port range, without rebuilding the lookup tables.
+ */
+static PIOMIOPORTRANGER3 tstAddRange(RTIOPORT Port, uint16_t cPorts)
+{
+    PIOMIOPORTRANGER3 pRange;
+    int rc = MMHyperAlloc(g_pVM, sizeof(*pRange), 0, MM_TAG_IOM, (void **)&pRange);
+    if (RT_FAILURE(rc))
+    {
+        RTTestFailed(g_hTest, "MMHyperAlloc -> %Rrc", rc);
+        return NULL;
+    }
+    pRange->Core.Key     = Port;
+    pRange->Core.KeyLast = Port + cPorts - 1;
+    pRange->Port         = Port;
+    pRange->cPorts       = cPorts;
+    pRange->pvUser       = TST_RANGE_USER(Port);
+    pRange->pszDesc      = "tstIOMLookup";
+    if (!RTAvlroIOPortInsert(&g_pVM->iom.s.pTreesR3->IOPortTreeR3, &pRange->Core))
+    {
+        RTTestFailed(g_hTest, "RTAvlroIOPortInsert failed for %#x LB %#x", Port, cPorts);
+        MMHyperFree(g_pVM, pRange);
+        return NULL;
+    }
+    return pRange;
+}
+
+
+/**
+ * Deregisters a ring-3 I/O port range the way IOMR3IOPortDeregister does,
+ * without rebuilding the lookup tables.
+ */
+static void tstRemoveRange(PIOMIOPORTRANGER3 pRange)
+{
+    PAVLROIOPORTNODECORE pNode = RTAvlroIOPortRemove(&g_pVM->iom.s.pTreesR3->IOPortTreeR3, pRange->Core.Key);
+    RTTESTI_CHECK_RETV(pNode == &pRange->Core);
+    iomR3LookupRetire(g_pVM, pRange);
+}
+
+
+/**
+ * Checks that a range looked up for a port is intact.
+ */
+static bool tstIsRangeIntact(PIOMIOPORTRANGER3 pRange, RTIOPORT Port)
+{
+    if ((uintptr_t)pRange - (uintptr_t)g_pbHeap >= TST_BLOCKS * TST_BLOCK_SIZE)
+        return false;
+    RTIOPORT const Key     = *(RTIOPORT volatile *)&pRange->Core.Key;
+    RTIOPORT const KeyLast = *(RTIOPORT volatile *)&pRange->Core.KeyLast;
+    RTR3PTR  const pvUser  = *(RTR3PTR volatile *)&pRange->pvUser;
+    return Key <= Port
+        && Port <= KeyLast
+        && pvUser == TST_RANGE_USER(Key);
+}
+
+
+static void tstBasics(void)
+{
+    RTTestSub(g_hTest, "Basics");
+    PVM    pVM    = g_pVM;
+    PVMCPU pVCpu0 = &pVM->aCpus[0];
+    PVMCPU pVCpu1 = &pVM->aCpus[1];
+
+    PIOMIOPORTRANGER3 pRange = tstAddRange(0x60, 4);
+    PIOMIOPORTRANGER3 pOther = tstAddRange(0x70, 2);
+    RTTESTI_CHECK_RETV(pRange && pOther);
+    iomR3LookupRebuild(pVM, true, false);
+    RTTESTI_CHECK(pVM->iom.s.pTreesR3->offIOPortLookupR3 != 0);
+    RTTESTI_CHECK(pVM->iom.s.pTreesR3->offIOPortLookupR0 == 0);
+
+    iomLookupEnter(pVM, pVCpu0);
+    RTTESTI_CHECK(iomIOPortGetRange(pVM, pVCpu0, 0x5f) == NULL);
+    RTTESTI_CHECK(iomIOPortGetRange(pVM, pVCpu0, 0x60) == pRange);
+    RTTESTI_CHECK(iomIOPortGetRange(pVM, pVCpu0, 0x63) == pRange);
+    RTTESTI_CHECK(iomIOPortGetRange(pVM, pVCpu0, 0x64) == NULL);
+    RTTESTI_CHECK(iomIOPortGetRange(pVM, pVCpu0, 0x71) == pOther);
+
+    /*
+     * Deregister the range while VCPU 0 is still in its lookup section.  It
+     * and the old tables must survive any number of rebuilds until it leaves.
+     */
+    tstRemoveRange(pRange);
+    iomR3LookupRebuild(pVM, true, false);
+    iomR3LookupRebuild(pVM, true, false);
+    RTTESTI_CHECK(pVM->iom.s.pLookupRetiredR3 != NULL);
+    RTTESTI_CHECK(tstIsRangeIntact(pRange, 0x62));
+    RTTESTI_CHECK(iomIOPortGetRange(pVM, pVCpu0, 0x62) == pRange);
+
+    /* An EMT entering now must not see it. */
+    iomLookupEnter(pVM, pVCpu1);
+    RTTESTI_CHECK(iomIOPortGetRange(pVM, pVCpu1, 0x62) == NULL);
+    RTTESTI_CHECK(iomIOPortGetRange(pVM, pVCpu1, 0x70) == pOther);
+    iomLookupLeave(pVCpu1);
+    iomR3LookupReclaim(pVM);
+    RTTESTI_CHECK(tstIsRangeIntact(pRange, 0x62));
+
+    /* Once VCPU 0 leaves everything retired can go, and its cache must be
+       flushed the next time it enters. */
+    uint32_t const cBlocksUsed = g_cBlocksUsed;
+    iomLookupLeave(pVCpu0);
+    iomR3LookupReclaim(pVM);
+    RTTESTI_CHECK(pVM->iom.s.pLookupRetiredR3 == NULL);
+    RTTESTI_CHECK_MSG(g_cBlocksUsed == 2, ("%u blocks in use, %u before reclaiming\n", g_cBlocksUsed, cBlocksUsed));
+
+    iomLookupEnter(pVM, pVCpu0);
+    RTTESTI_CHECK(iomIOPortGetRange(pVM, pVCpu0, 0x62) == NULL);
+    RTTESTI_CHECK(iomIOPortGetRange(pVM, pVCpu0, 0x70) == pOther);
+    iomLookupLeave(pVCpu0);
+
+    /* Removing the last range must publish an empty table. */
+    tstRemoveRange(pOther);
+    iomR3LookupRebuild(pVM, true, false);
+    RTTESTI_CHECK(pVM->iom.s.pTreesR3->offIOPortLookupR3 == 0);
+    RTTESTI_CHECK(pVM->iom.s.pLookupRetiredR3 == NULL);
+    RTTESTI_CHECK_MSG(g_cBlocksUsed == 0, ("%u blocks in use\n", g_cBlocksUsed));
+}
+
+
+static DECLCALLBACK(int) tstReaderThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PTSTREADER pReader = (PTSTREADER)pvUser;
+    PVM        pVM     = g_pVM;
+    PVMCPU     pVCpu   = pReader->pVCpu;
+    NOREF(hThreadSelf);
+
+    while (!ASMAtomicUoReadBool(&g_fStop))
+    {
+        uint32_t const uRand = tstRand(&pReader->uRand);
+        RTIOPORT const Port  = TST_PORT_FIRST + uRand % (TST_SLOTS * TST_PORTS_PER_SLOT);
+
+        iomLookupEnter(pVM, pVCpu);
+        PIOMIOPORTRANGER3 pRange = iomIOPortGetRange(pVM, pVCpu, Port);
+        pReader->cLookups++;
+        if (pRange)
+        {
+            pReader->cHits++;
+            ASMAtomicWritePtr(&pReader->pvInUse, pRange);
+            if (tstIsRangeIntact(pRange, Port))
+            {
+                /* Hang on to it for a while, every now and then for long enough
+                   for the writer to get a few rebuilds done. */
+                uint32_t cSpins = (uRand >> 24) < 8 ? _64K : 64;
+                while (cSpins-- > 0)
+                    ASMNopPause();
+                if (!tstIsRangeIntact(pRange, Port))
+                    RTTestFailed(g_hTest, "reader #%u: range %p for port %#x changed while in use",
+                                 (unsigned)(pReader - &g_aReaders[0]), pRange, Port);
+            }
+            else
+                RTTestFailed(g_hTest, "reader #%u: bad range %p for port %#x",
+                             (unsigned)(pReader - &g_aReaders[0]), pRange, Port);
+            ASMAtomicWriteNullPtr(&pReader->pvInUse);
+        }
+        iomLookupLeave(pVCpu);
+    }
+    return VINF_SUCCESS;
+}
+
+
+static void tstStress(void)
+{
+    RTTestSub(g_hTest, "Concurrent lookups");
+    PVM pVM = g_pVM;
+
+    g_fStop = false;
+    unsigned cThreads = 0;
+    for (unsigned i = 0; i < TST_READERS; i++)
+    {
+        g_aReaders[i].pVCpu = &pVM->aCpus[i + 1];
+        g_aReaders[i].uRand = 0x9e3779b9 * (i + 1);
+        int rc = RTThreadCreateF(&g_aReaders[i].hThread, tstReaderThread, &g_aReaders[i], 0,
+                                 RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "tstRead%u", i);
+        if (RT_FAILURE(rc))
+        {
+            RTTestFailed(g_hTest, "RTThreadCreateF -> %Rrc", rc);
+            break;
+        }
+        cThreads++;
+    }
+
+    /*
+     * Keep registering and deregistering ranges, sometimes several before
+     * rebuilding the tables like IOMR3Reset does.
+     */
+    uint32_t       cRebuilds = 0;
+    uint32_t       cDeferred = 0;
+    uint64_t const msStart   = RTTimeMilliTS();
+    while (   RTTimeMilliTS() - msStart < TST_STRESS_MS
+           && !RTTestErrorCount(g_hTest))
+    {
+        unsigned cChanges = (tstRand(&g_uRand) & 7) == 0 ? 8 : 1;
+        while (cChanges-- > 0)
+        {
+            uint32_t const uRand = tstRand(&g_uRand);
+            unsigned const iSlot = uRand % TST_SLOTS;
+            if (g_apSlots[iSlot])
+            {
+                tstRemoveRange(g_apSlots[iSlot]);
+                g_apSlots[iSlot] = NULL;
+            }
+            else
+            {
+                uint16_t const cPorts = 1 + (uRand >> 8) % TST_PORTS_PER_SLOT;
+                uint16_t const offPort = (uRand >> 16) % (TST_PORTS_PER_SLOT - cPorts + 1);
+                g_apSlots[iSlot] = tstAddRange(TST_PORT_FIRST + iSlot * TST_PORTS_PER_SLOT + offPort, cPorts);
+            }
+        }
+        iomR3LookupRebuild(pVM, true, false);
+        cRebuilds++;
+        if (pVM->iom.s.pLookupRetiredR3)
+            cDeferred++;
+    }
+
+    ASMAtomicWriteBool(&g_fStop, true);
+    for (unsigned i = 0; i < cThreads; i++)
+        RTThreadWait(g_aReaders[i].hThread, RT_INDEFINITE_WAIT, NULL);
+
+    uint64_t cLookups = 0;
+    uint64_t cHits    = 0;
+    for (unsigned i = 0; i < cThreads; i++)
+    {
+        cLookups += g_aReaders[i].cLookups;
+        cHits    += g_aReaders[i].cHits;
+    }
+    RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "%'RU64 lookups (%'RU64 hits), %u rebuilds, %u with frees deferred\n",
+                 cLookups, cHits, cRebuilds, cDeferred);
+
+    /*
+     * With the readers gone, deregistering everything must free all of it.
+     */
+    for (unsigned iSlot = 0; iSlot < TST_SLOTS; iSlot++)
+        if (g_apSlots[iSlot])
+        {
+            tstRemoveRange(g_apSlots[iSlot]);
+            g_apSlots[iSlot] = NULL;
+        }
+    iomR3LookupRebuild(pVM, true, false);
+    RTTESTI_CHECK(pVM->iom.s.pTreesR3->offIOPortLookupR3 == 0);
+    RTTESTI_CHECK(pVM->iom.s.pLookupRetiredR3 == NULL);
+    RTTESTI_CHECK_MSG(g_cBlocksUsed == 0, ("%u blocks in use\n", g_cBlocksUsed));
+}
+
+
+int main()
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstIOMLookup", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    size_t const cbVM = RT_ALIGN_Z(RT_OFFSETOF(VM, aCpus[TST_CPUS]), PAGE_SIZE);
+    g_pVM    = (PVM)RTMemPageAllocZ(cbVM);
+    g_pbHeap = (uint8_t *)RTMemPageAllocZ(TST_BLOCKS * TST_BLOCK_SIZE);
+    if (g_pVM && g_pbHeap)
+    {
+        /* Block 0 holds the trees, the rest goes into the free FIFO. */
+        for (uint32_t iBlock = 1; iBlock < TST_BLOCKS; iBlock++)
+            g_aiFree[g_cFree++] = iBlock;
+        g_afBlockUsed[0] = true;
+
+        g_pVM->cCpus              = TST_CPUS;
+        g_pVM->iom.s.pTreesR3     = (PIOMTREES)g_pbHeap;
+        g_pVM->iom.s.uLookupEpoch = 2;
+
+        tstBasics();
+        if (!RTTestErrorCount(g_hTest))
+            tstStress();
+    }
+    else
+        RTTestFailed(g_hTest, "out of memory");
+    if (g_pbHeap)
+        RTMemPageFree(g_pbHeap, TST_BLOCKS * TST_BLOCK_SIZE);
+    if (g_pVM)
+        RTMemPageFree(g_pVM, cbVM);
+
+    return RTTestSummaryAndDestroy(g_hTest);
+}
@@ -0,0 +1,257 @@
+/* $Id$ */
+/** @file
+ * PDM Network Shaper Testcase - Benchmarks the bandwidth allocation and checks its accuracy.
+ */
+
+/*
+ * Copyright (C) 2011-2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <VBox/vmm/pdmcritsect.h>
+#include <VBox/vmm/pdmnetshaper.h>
+#include <VBox/err.h>
+#include <iprt/asm.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/semaphore.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+#include "PDMNetShaperInternal.h"
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The maximum number of concurrent filters (threads). */
+#define TST_MAX_THREADS     8
+/** The frame size used for the benchmark (a full ethernet frame). */
+#define TST_FRAME_SIZE      1514
+
+
+/*********************************************************************************************************************************
+*   Structures and Typedefs                                                                                                      *
+*********************************************************************************************************************************/
+/**
+ * Per thread (filter) state.
+ */
+typedef struct TSTNSTHREAD
+{
+    /** The filter, as a driver would embed it. */
+    PDMNSFILTER         Filter;
+    /** The thread handle. */
+    RTTHREAD            hThread;
+    /** Number of allocation attempts to make, 0 if running for a set time. */
+    uint32_t            cAllocs;
+    /** Number of allocations granted. */
+    uint64_t            cGranted;
+    /** Number of allocations denied. */
+    uint64_t            cDenied;
+    /** Bytes granted. */
+    uint64_t            cbGranted;
+    /** Nanoseconds spent in the allocation loop. */
+    uint64_t            cNsElapsed;
+} TSTNSTHREAD;
+/** Pointer to the per thread state. */
+typedef TSTNSTHREAD *PTSTNSTHREAD;
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** The bandwidth group shared by all filters. */
+static PPDMNSBWGROUP        g_pBwGroup;
+/** Released when all threads should start. */
+static RTSEMEVENTMULTI      g_hEvtGo;
+/** When running for a set time: the RTTimeSystemNanoTS to stop at. */
+static uint64_t volatile    g_tsStop;
+/** The threads. */
+static TSTNSTHREAD          g_aThreads[TST_MAX_THREADS];
+
+
+/**
+ * Resets the bandwidth group to a full bucket with the given limit.
+ */
+static void tstNsResetGroup(uint64_t cbPerSecMax)
+{
+    RT_BZERO(g_pBwGroup, sizeof(*g_pBwGroup));
+    pdmNsBwGroupCalcLimits(g_pBwGroup, cbPerSecMax);
+    g_pBwGroup->pszNameR3    = (char *)"tstPDMNetShaper";
+    g_pBwGroup->tsTat        = RTTimeSystemNanoTS();
+    g_pBwGroup->tsNextWakeup = UINT64_MAX;
+}
+
+
+/**
+ * Allocation thread.
+ */
+static DECLCALLBACK(int) tstNsThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PTSTNSTHREAD pThis = (PTSTNSTHREAD)pvUser;
+    NOREF(hThreadSelf);
+    RTSemEventMultiWait(g_hEvtGo, RT_INDEFINITE_WAIT);
+
+    uint64_t const tsStart = RTTimeNanoTS();
+    if (pThis->cAllocs)
+    {
+        for (uint32_t i = 0; i < pThis->cAllocs; i++)
+        {
+            if (PDMNsAllocateBandwidth(&pThis->Filter, TST_FRAME_SIZE))
+                pThis->cGranted++;
+            else
+                pThis->cDenied++;
+        }
+    }
+    else
+    {
+        while (RTTimeSystemNanoTS() < g_tsStop)
+        {
+            if (PDMNsAllocateBandwidth(&pThis->Filter, TST_FRAME_SIZE))
+                pThis->cGranted++;
+            else
+            {
+                pThis->cDenied++;
+                RTThreadYield();
+            }
+        }
+    }
+    pThis->cNsElapsed = RTTimeNanoTS() - tsStart;
+    pThis->cbGranted  = pThis->cGranted * TST_FRAME_SIZE;
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Runs cThreads filters against the group and waits for them to finish.
+ *
+ * @returns true on success, false if something went wrong (already reported).
+ */
+static bool tstNsRun(unsigned cThreads, uint32_t cAllocs, uint32_t cMsRuntime)
+{
+    RTTESTI_CHECK_RC_RET(RTSemEventMultiReset(g_hEvtGo), VINF_SUCCESS, false);
+    for (unsigned i = 0; i < cThreads; i++)
+    {
+        RT_ZERO(g_aThreads[i]);
+        g_aThreads[i].Filter.pBwGroupR3 = g_pBwGroup;
+        g_aThreads[i].cAllocs           = cAllocs;
+        RTTESTI_CHECK_RC_RET(RTThreadCreateF(&g_aThreads[i].hThread, tstNsThread, &g_aThreads[i], 0,
+                                             RTTHREADTYPE_DEFAULT, RTTHREADFLAGS_WAITABLE, "tstNs%u", i),
+                             VINF_SUCCESS, false);
+    }
+
+    g_tsStop = RTTimeSystemNanoTS() + cMsRuntime * RT_NS_1MS_64;
+    RTSemEventMultiSignal(g_hEvtGo);
+
+    for (unsigned i = 0; i < cThreads; i++)
+        RTTESTI_CHECK_RC(RTThreadWait(g_aThreads[i].hThread, RT_INDEFINITE_WAIT, NULL), VINF_SUCCESS);
+    return RTTestIErrorCount() == 0;
+}
+
+
+/**
+ * Measures the cost of one allocation with a varying number of filters
+ * sharing the bandwidth group.
+ */
+static void tstNsBenchmark(void)
+{
+    static const uint32_t s_cAllocs = _1M;
+    static const struct
+    {
+        const char *pszName;
+        uint64_t    cbPerSecMax;
+    } s_aLimits[] =
+    {
+        { "disabled",   0 },
+        { "unlimited",  UINT64_C(1000000000000) /* never chokes within the test */ },
+    };
+
+    for (unsigned iLimit = 0; iLimit < RT_ELEMENTS(s_aLimits); iLimit++)
+        for (unsigned cThreads = 1; cThreads <= TST_MAX_THREADS; cThreads *= 2)
+        {
+            RTTestISubF("Overhead, %s, %u filter(s)", s_aLimits[iLimit].pszName, cThreads);
+            tstNsResetGroup(s_aLimits[iLimit].cbPerSecMax);
+            if (!tstNsRun(cThreads, s_cAllocs, 0))
+                return;
+
+            uint64_t cNsTotal  = 0;
+            uint64_t cDenied   = 0;
+            for (unsigned i = 0; i < cThreads; i++)
+            {
+                cNsTotal += g_aThreads[i].cNsElapsed;
+                cDenied  += g_aThreads[i].cDenied;
+            }
+            RTTESTI_CHECK_MSG(cDenied == 0, ("cDenied=%llu\n", cDenied));
+            RTTestIValue("Per frame", cNsTotal / ((uint64_t)s_cAllocs * cThreads), RTTESTUNIT_NS_PER_CALL);
+        }
+}
+
+
+/**
+ * Checks that a group of greedy filters stays within the rate limit.
+ */
+static void tstNsAccuracy(void)
+{
+    static const uint64_t s_cbPerSecMax = 20 * _1M;
+    static const uint32_t s_cMsRuntime  = 500;
+
+    for (unsigned cThreads = 1; cThreads <= TST_MAX_THREADS; cThreads *= 2)
+    {
+        RTTestISubF("Accuracy, %u filter(s)", cThreads);
+        tstNsResetGroup(s_cbPerSecMax);
+        uint64_t const tsStart = RTTimeSystemNanoTS();
+        if (!tstNsRun(cThreads, 0, s_cMsRuntime))
+            return;
+        uint64_t const cNsElapsed = RTTimeSystemNanoTS() - tsStart;
+
+        uint64_t cbGranted = 0;
+        for (unsigned i = 0; i < cThreads; i++)
+            cbGranted += g_aThreads[i].cbGranted;
+
+        /* Everything granted must be paid for, except the initial full bucket
+           and the credit the filters may still be sitting on. */
+        uint64_t const cbExpected = s_cbPerSecMax * cNsElapsed / RT_NS_1SEC;
+        uint64_t const cbMax      = cbExpected + g_pBwGroup->cbBucket + cThreads * (g_pBwGroup->cbCreditChunk + TST_FRAME_SIZE);
+        uint64_t const cbMin      = cbExpected / 10 * 9;
+        RTTESTI_CHECK_MSG(cbGranted <= cbMax, ("cbGranted=%llu cbMax=%llu\n", cbGranted, cbMax));
+        RTTESTI_CHECK_MSG(cbGranted >= cbMin, ("cbGranted=%llu cbMin=%llu\n", cbGranted, cbMin));
+        RTTestIValue("Rate", cbGranted * RT_NS_1SEC / cNsElapsed, RTTESTUNIT_BYTES_PER_SEC);
+    }
+}
+
+
+int main()
+{
+    RTTEST hTest;
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstPDMNetShaper", &hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(hTest);
+
+    g_pBwGroup = (PPDMNSBWGROUP)RTMemPageAllocZ(sizeof(*g_pBwGroup));
+    RTTESTI_CHECK(g_pBwGroup != NULL);
+    RTTESTI_CHECK_RC(RTSemEventMultiCreate(&g_hEvtGo), VINF_SUCCESS);
+    if (!RTTestErrorCount(hTest))
+    {
+        tstNsBenchmark();
+        tstNsAccuracy();
+    }
+
+    RTSemEventMultiDestroy(g_hEvtGo);
+    RTMemPageFree(g_pBwGroup, sizeof(*g_pBwGroup));
+    return RTTestSummaryAndDestroy(hTest);
+}
+
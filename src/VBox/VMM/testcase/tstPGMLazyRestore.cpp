@@ -0,0 +1,384 @@
+/* $Id$ */
+/** @file
+ * PGM Testcase - Lazy restore with unfetched guest page tables.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/vmm.h>
+#include <VBox/vmm/cpum.h>
+#include <VBox/vmm/pgm.h>
+#include <VBox/vmm/hm.h>
+#include <VBox/vmm/cfgm.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/assert.h>
+#include <iprt/file.h>
+#include <iprt/initterm.h>
+#include <iprt/path.h>
+#include <iprt/stream.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+#include <iprt/x86.h>
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+#define TESTCASE                    "tstPGMLazyRestore"
+/** The guest RAM size. */
+#define TST_RAM_SIZE                (64 * _1M)
+/** Where the guest code goes (identity mapped). */
+#define TST_GCPHYS_CODE             UINT32_C(0x00001000)
+/** The pass counters: the number of passes done and wanted (identity mapped). */
+#define TST_GCPHYS_VARS             UINT32_C(0x00002000)
+/** The page directory (CR3).  The final pass always saves this one. */
+#define TST_GCPHYS_PD               UINT32_C(0x00100000)
+/** The data pages the guest increments each pass, mapped in reverse order at
+ *  TST_GCPTR_DATA by the second page table. */
+#define TST_GCPHYS_DATA             UINT32_C(0x01400000)
+/** The number of data pages, one page table worth. */
+#define TST_DATA_PAGES              1024
+/** The two page tables, at the very end of RAM so the lazy restore thread,
+ *  which reads in address order, gets to them last. */
+#define TST_GCPHYS_PT0              (TST_RAM_SIZE - 2 * PAGE_SIZE)
+#define TST_GCPHYS_PT1              (TST_RAM_SIZE - 1 * PAGE_SIZE)
+/** Where the data pages are mapped. */
+#define TST_GCPTR_DATA              UINT32_C(0x00400000)
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/**
+ * The guest code (32-bit, flat).  Spins until the wanted pass count is raised,
+ * then increments the first dword of every data page thru the page tables.
+ *
+ * @code
+ *  loop:   mov     eax, [TST_GCPHYS_VARS]
+ *          cmp     eax, [TST_GCPHYS_VARS + 4]
+ *          jne     pass
+ *          pause
+ *          jmp     loop
+ *  pass:   mov     esi, TST_GCPTR_DATA
+ *          mov     ecx, TST_DATA_PAGES
+ *  next:   inc     dword [esi]
+ *          add     esi, 1000h
+ *          loop    next
+ *          inc     dword [TST_GCPHYS_VARS]
+ *          jmp     loop
+ * @endcode
+ */
+static const uint8_t g_abGuestCode[] =
+{
+    0xa1, 0x00, 0x20, 0x00, 0x00,
+    0x3b, 0x05, 0x04, 0x20, 0x00, 0x00,
+    0x75, 0x04,
+    0xf3, 0x90,
+    0xeb, 0xef,
+    0xbe, 0x00, 0x00, 0x40, 0x00,
+    0xb9, 0x00, 0x04, 0x00, 0x00,
+    0xff, 0x06,
+    0x81, 0xc6, 0x00, 0x10, 0x00, 0x00,
+    0xe2, 0xf6,
+    0xff, 0x05, 0x00, 0x20, 0x00, 0x00,
+    0xeb, 0xd3,
+};
+
+/** The test handle. */
+static RTTEST   g_hTest;
+
+
+static DECLCALLBACK(int) tstConfigConstructor(PUVM pUVM, PVM pVM, void *pvUser)
+{
+    NOREF(pUVM); NOREF(pvUser);
+    PCFGMNODE pRoot = CFGMR3GetRoot(pVM);
+    int rc = CFGMR3InsertInteger(pRoot, "RamSize", TST_RAM_SIZE);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+    rc = CFGMR3InsertInteger(pRoot, "HMEnabled", true);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+
+    PCFGMNODE pHM;
+    rc = CFGMR3InsertNode(pRoot, "HM", &pHM);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+    rc = CFGMR3InsertInteger(pHM, "EnableNestedPaging", true);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+
+    PCFGMNODE pPGM;
+    rc = CFGMR3InsertNode(pRoot, "PGM", &pPGM);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+    rc = CFGMR3InsertInteger(pPGM, "LazyRestore", true);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, rc);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Sets up the guest memory and a flat 32-bit paged CPU state (EMT).
+ */
+static DECLCALLBACK(int) tstSetupGuest(PVM pVM)
+{
+    PVMCPU pVCpu = VMMGetCpu(pVM);
+    static uint32_t s_au32[X86_PG_ENTRIES];
+
+    int rc = PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_CODE, g_abGuestCode, sizeof(g_abGuestCode));
+    AssertRCReturn(rc, rc);
+
+    RT_ZERO(s_au32);
+    s_au32[0] = TST_GCPHYS_PT0 | X86_PDE_P | X86_PDE_RW;
+    s_au32[TST_GCPTR_DATA >> X86_PD_SHIFT] = TST_GCPHYS_PT1 | X86_PDE_P | X86_PDE_RW;
+    rc = PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_PD, s_au32, sizeof(s_au32));
+    AssertRCReturn(rc, rc);
+
+    for (uint32_t i = 0; i < X86_PG_ENTRIES; i++)
+        s_au32[i] = (i << PAGE_SHIFT) | X86_PTE_P | X86_PTE_RW;
+    rc = PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_PT0, s_au32, sizeof(s_au32));
+    AssertRCReturn(rc, rc);
+
+    for (uint32_t i = 0; i < TST_DATA_PAGES; i++)
+        s_au32[i] = (TST_GCPHYS_DATA + ((TST_DATA_PAGES - 1 - i) << PAGE_SHIFT)) | X86_PTE_P | X86_PTE_RW;
+    rc = PGMPhysSimpleWriteGCPhys(pVM, TST_GCPHYS_PT1, s_au32, sizeof(s_au32));
+    AssertRCReturn(rc, rc);
+
+    PCPUMCTX pCtx = CPUMQueryGuestCtxPtr(pVCpu);
+    pCtx->cs.Sel      = pCtx->cs.ValidSel = 0x08;
+    pCtx->cs.fFlags   = CPUMSELREG_FLAGS_VALID;
+    pCtx->cs.u64Base  = 0;
+    pCtx->cs.u32Limit = UINT32_MAX;
+    pCtx->cs.Attr.u   = X86_SEL_TYPE_ER_ACC | X86DESCATTR_DT | X86DESCATTR_P | X86DESCATTR_D | X86DESCATTR_G;
+    pCtx->ss.Sel      = pCtx->ss.ValidSel = 0x10;
+    pCtx->ss.fFlags   = CPUMSELREG_FLAGS_VALID;
+    pCtx->ss.u64Base  = 0;
+    pCtx->ss.u32Limit = UINT32_MAX;
+    pCtx->ss.Attr.u   = X86_SEL_TYPE_RW_ACC | X86DESCATTR_DT | X86DESCATTR_P | X86DESCATTR_D | X86DESCATTR_G;
+    pCtx->ds = pCtx->es = pCtx->fs = pCtx->gs = pCtx->ss;
+    pCtx->tr.Sel      = pCtx->tr.ValidSel = 0x18;
+    pCtx->tr.fFlags   = CPUMSELREG_FLAGS_VALID;
+    pCtx->tr.u64Base  = 0;
+    pCtx->tr.u32Limit = 0x67;
+    pCtx->tr.Attr.u   = X86_SEL_TYPE_SYS_386_TSS_BUSY | X86DESCATTR_P;
+    pCtx->ldtr.Sel    = pCtx->ldtr.ValidSel = 0;
+    pCtx->ldtr.fFlags = CPUMSELREG_FLAGS_VALID;
+    pCtx->ldtr.Attr.u = X86DESCATTR_UNUSABLE;
+    pCtx->gdtr.cbGdt  = 0x1f;
+    pCtx->gdtr.pGdt   = 0;
+    pCtx->idtr.cbIdt  = 0;
+    pCtx->idtr.pIdt   = 0;
+    pCtx->rip         = TST_GCPHYS_CODE;
+    pCtx->rsp         = TST_GCPHYS_CODE;
+    pCtx->rflags.u    = X86_EFL_1;
+    pCtx->cr0         = X86_CR0_PE | X86_CR0_ET | X86_CR0_NE | X86_CR0_PG;
+    pCtx->cr3         = TST_GCPHYS_PD;
+    pCtx->cr4         = 0;
+    pCtx->msrEFER     = 0;
+    VMCPU_FF_SET(pVCpu, VMCPU_FF_PGM_SYNC_CR3);
+    return PGMChangeMode(pVCpu, pCtx->cr0, pCtx->cr4, pCtx->msrEFER);
+}
+
+
+/**
+ * Walks the guest page tables the way the instruction emulation does and
+ * checks where the data pages are mapped (EMT).
+ */
+static DECLCALLBACK(int) tstCheckWalk(PVM pVM)
+{
+    PVMCPU pVCpu = VMMGetCpu(pVM);
+    static const uint32_t s_aiPages[] = { 0, 1, TST_DATA_PAGES / 2, TST_DATA_PAGES - 1 };
+    for (unsigned i = 0; i < RT_ELEMENTS(s_aiPages); i++)
+    {
+        uint64_t fFlags = 0;
+        RTGCPHYS GCPhys = NIL_RTGCPHYS;
+        int rc = PGMGstGetPage(pVCpu, TST_GCPTR_DATA + (s_aiPages[i] << PAGE_SHIFT), &fFlags, &GCPhys);
+        RTGCPHYS const GCPhysExpect = TST_GCPHYS_DATA + ((TST_DATA_PAGES - 1 - s_aiPages[i]) << PAGE_SHIFT);
+        RTTESTI_CHECK_MSG(RT_SUCCESS(rc) && GCPhys == GCPhysExpect,
+                          ("page %u: rc=%Rrc GCPhys=%RGp, expected %RGp\n", s_aiPages[i], rc, GCPhys, GCPhysExpect));
+    }
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Reads a guest dword (EMT).
+ */
+static DECLCALLBACK(int) tstReadU32(PVM pVM, RTGCPHYS GCPhys, uint32_t *pu32)
+{
+    return PGMPhysSimpleReadGCPhys(pVM, pu32, GCPhys, sizeof(*pu32));
+}
+
+
+/**
+ * Writes a guest dword (EMT).
+ */
+static DECLCALLBACK(int) tstWriteU32(PVM pVM, RTGCPHYS GCPhys, uint32_t u32)
+{
+    return PGMPhysSimpleWriteGCPhys(pVM, GCPhys, &u32, sizeof(u32));
+}
+
+
+/**
+ * Lets the guest do one more pass and waits for it to finish.
+ */
+static void tstRunPass(PUVM pUVM, PVM pVM, uint32_t iPass)
+{
+    int rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstWriteU32, 3, pVM, (RTGCPHYS)TST_GCPHYS_VARS + 4, iPass);
+    RTTESTI_CHECK_RC_RETV(rc, VINF_SUCCESS);
+
+    uint64_t const msStart = RTTimeMilliTS();
+    uint32_t       cDone   = 0;
+    while (RTTimeMilliTS() - msStart < 30000)
+    {
+        rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstReadU32, 3, pVM, (RTGCPHYS)TST_GCPHYS_VARS, &cDone);
+        RTTESTI_CHECK_RC_RETV(rc, VINF_SUCCESS);
+        if (cDone == iPass)
+            return;
+        RTThreadSleep(10);
+    }
+    RTTestIFailed("pass %u not done after 30 seconds (%u done)\n", iPass, cDone);
+}
+
+
+/**
+ * Checks that every data page has been incremented @a cPasses times.
+ */
+static void tstCheckData(PUVM pUVM, PVM pVM, uint32_t cPasses)
+{
+    unsigned cErrors = 0;
+    for (uint32_t iPage = 0; iPage < TST_DATA_PAGES && cErrors < 8; iPage++)
+    {
+        uint32_t u32 = UINT32_MAX;
+        int rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstReadU32, 3, pVM,
+                                  (RTGCPHYS)TST_GCPHYS_DATA + ((RTGCPHYS)iPage << PAGE_SHIFT), &u32);
+        if (RT_FAILURE(rc) || u32 != cPasses)
+        {
+            RTTestIFailed("data page %u: rc=%Rrc value=%#x, expected %#x\n", iPage, rc, u32, cPasses);
+            cErrors++;
+        }
+    }
+}
+
+
+/**
+ * Entry point.
+ */
+extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
+{
+    NOREF(argc); NOREF(argv); NOREF(envp);
+    RTEXITCODE rcExit = RTTestInitExAndCreate(argc, &argv, RTR3INIT_FLAGS_SUPLIB, TESTCASE, &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    char szFile[RTPATH_MAX];
+    int rc = RTPathTemp(szFile, sizeof(szFile));
+    if (RT_SUCCESS(rc))
+        rc = RTPathAppend(szFile, sizeof(szFile), TESTCASE "-XXXXXX.sav");
+    if (RT_SUCCESS(rc))
+        rc = RTFileCreateTemp(szFile, 0600);
+    if (RT_FAILURE(rc))
+        return RTTestFailed(g_hTest, "Failed to create a temporary file: %Rrc\n", rc), RTTestSummaryAndDestroy(g_hTest);
+
+    /*
+     * Run the guest for one pass and save it with lazy restore enabled.  The
+     * page tables, the code and the data pages all end up in the "pgmlazy"
+     * unit, only the page directory is saved with the rest of the state.
+     */
+    RTTestSub(g_hTest, "Save");
+    PVM  pVM;
+    PUVM pUVM;
+    rc = VMR3Create(1, NULL, NULL, NULL, tstConfigConstructor, NULL, &pVM, &pUVM);
+    if (RT_FAILURE(rc))
+    {
+        RTFileDelete(szFile);
+        return RTTestSkipAndDestroy(g_hTest, "VMR3Create failed: %Rrc (no hardware virtualization?)", rc);
+    }
+    if (!HMR3IsNestedPagingActive(pUVM))
+        RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "Nested paging is not active, the missing pages are all read before running\n");
+
+    rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstSetupGuest, 1, pVM);
+    RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    if (RT_SUCCESS(rc))
+    {
+        rc = VMR3PowerOn(pUVM);
+        RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+        tstRunPass(pUVM, pVM, 1);
+        rc = VMR3Suspend(pUVM, VMSUSPENDREASON_USER);
+        RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+        bool fSuspended = false;
+        rc = VMR3Save(pUVM, szFile, false /*fContinueAfterwards*/, NULL, NULL, &fSuspended);
+        RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    }
+    VMR3PowerOff(pUVM);
+    VMR3Destroy(pUVM);
+    VMR3ReleaseUVM(pUVM);
+
+    /*
+     * Restore it.  The page tables are missing now, so walk them right away
+     * (ring-3 paging structure walk while owning the PGM lock), then let the
+     * guest do another pass, which has the CPU walk them.
+     */
+    if (RTTestErrorCount(g_hTest) == 0)
+    {
+        RTTestSub(g_hTest, "Restore");
+        rc = VMR3Create(1, NULL, NULL, NULL, tstConfigConstructor, NULL, &pVM, &pUVM);
+        RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+        if (RT_SUCCESS(rc))
+        {
+            rc = VMR3LoadFromFile(pUVM, szFile, NULL, NULL);
+            RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+            if (RT_SUCCESS(rc))
+            {
+                uint32_t const cPending = PGMR3PostCopyGetPendingPages(pUVM);
+                RTTestPrintf(g_hTest, RTTESTLVL_ALWAYS, "%u pages missing after loading\n", cPending);
+                rc = VMR3ReqCallWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)tstCheckWalk, 1, pVM);
+                RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+
+                rc = VMR3Resume(pUVM, VMRESUMEREASON_STATE_RESTORED);
+                RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+                tstRunPass(pUVM, pVM, 2);
+                rc = VMR3Suspend(pUVM, VMSUSPENDREASON_USER);
+                RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+                tstCheckData(pUVM, pVM, 2);
+
+                uint64_t const msStart = RTTimeMilliTS();
+                while (PGMR3PostCopyGetPendingPages(pUVM) && RTTimeMilliTS() - msStart < 30000)
+                    RTThreadSleep(10);
+                RTTESTI_CHECK_MSG(PGMR3PostCopyGetPendingPages(pUVM) == 0,
+                                  ("%u pages still missing\n", PGMR3PostCopyGetPendingPages(pUVM)));
+            }
+            VMR3PowerOff(pUVM);
+            VMR3Destroy(pUVM);
+            VMR3ReleaseUVM(pUVM);
+        }
+    }
+
+    RTFileDelete(szFile);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
+
+
+#if !defined(VBOX_WITH_HARDENING) || !defined(RT_OS_WINDOWS)
+/**
+ * Main entry point.
+ */
+int main(int argc, char **argv, char **envp)
+{
+    return TrustedMain(argc, argv, envp);
+}
+#endif
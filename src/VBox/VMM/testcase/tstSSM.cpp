@@ -63,6 +63,10 @@ uint8_t         gabBigMem[_1M];
 #else
 uint8_t         gabBigMem[8*_1M];
 #endif
+/** Number of pages Item05 saves uncompressed. */
+#define TSTSSM_ITEM05_PAGES 64
+/** The stream offsets of the Item05 pages (recorded on save). */
+uint64_t        gaoffItem05Pages[TSTSSM_ITEM05_PAGES];
 
 
 /** initializes gabBigMem with some non zero stuff. */
@@ -619,6 +623,123 @@ DECLCALLBACK(int) Item04Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32
 }
 
 
+/**
+ * Execute state save operation.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM handle.
+ * @param   pSSM            SSM operation handle.
+ */
+DECLCALLBACK(int) Item05Save(PVM pVM, PSSMHANDLE pSSM)
+{
+    NOREF(pVM);
+
+    /*
+     * Put the page count, then the pages as uncompressed records so
+     * the load can find them in the file.
+     */
+    int rc = SSMR3PutU32(pSSM, TSTSSM_ITEM05_PAGES);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("Item05: PutU32 -> %Rrc\n", rc);
+        return rc;
+    }
+
+    for (uint32_t iPage = 0; iPage < TSTSSM_ITEM05_PAGES; iPage++)
+    {
+        rc = SSMR3PutMemUncompressed(pSSM, &gabBigMem[iPage * PAGE_SIZE], PAGE_SIZE, &gaoffItem05Pages[iPage]);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf("Item05: PutMemUncompressed(,%p,%#x,) -> %Rrc\n", &gabBigMem[iPage * PAGE_SIZE], PAGE_SIZE, rc);
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Prepare state load operation.
+ *
+ * @returns VBox status code.
+ * @param   pVM             The cross context VM handle.
+ * @param   pSSM            SSM operation handle.
+ * @param   uVersion        The data layout version.
+ * @param   uPass           The data pass.
+ */
+DECLCALLBACK(int) Item05Load(PVM pVM, PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass)
+{
+    NOREF(pVM); NOREF(uPass);
+    if (uVersion != 5)
+    {
+        RTPrintf("Item05: uVersion=%#x, expected 5\n", uVersion);
+        return VERR_GENERAL_FAILURE;
+    }
+
+    uint32_t cPages;
+    int rc = SSMR3GetU32(pSSM, &cPages);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("Item05: SSMR3GetU32 -> %Rrc\n", rc);
+        return rc;
+    }
+    if (cPages != TSTSSM_ITEM05_PAGES)
+    {
+        RTPrintf("Item05: loaded page count doesn't match the real thing. %#x != %#x\n", cPages, TSTSSM_ITEM05_PAGES);
+        return VERR_GENERAL_FAILURE;
+    }
+
+    /*
+     * Read the pages straight from the file at the recorded offsets.
+     */
+    RTFILE hFile;
+    rc = RTFileOpen(&hFile, SSMR3HandleGetFilename(pSSM), RTFILE_O_READ | RTFILE_O_OPEN | RTFILE_O_DENY_NONE);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("Item05: RTFileOpen -> %Rrc\n", rc);
+        return rc;
+    }
+    for (uint32_t iPage = 0; iPage < cPages && RT_SUCCESS(rc); iPage++)
+    {
+        uint8_t abPage[PAGE_SIZE];
+        rc = RTFileReadAt(hFile, gaoffItem05Pages[iPage], abPage, PAGE_SIZE, NULL);
+        if (RT_FAILURE(rc))
+            RTPrintf("Item05: RTFileReadAt(,%#llx,,%#x) -> %Rrc\n", gaoffItem05Pages[iPage], PAGE_SIZE, rc);
+        else if (memcmp(abPage, &gabBigMem[iPage * PAGE_SIZE], PAGE_SIZE))
+        {
+            RTPrintf("Item05: compare failed. page=%#x offset=%#llx\n", iPage, gaoffItem05Pages[iPage]);
+            rc = VERR_GENERAL_FAILURE;
+        }
+    }
+    RTFileClose(hFile);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    /*
+     * Skip the page records without reading them.
+     */
+    rc = SSMR3SkipToEndOfUnitAt(pSSM, gaoffItem05Pages[cPages - 1] + PAGE_SIZE);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("Item05: SSMR3SkipToEndOfUnitAt -> %Rrc\n", rc);
+        return rc;
+    }
+    return 0;
+}
+
+
+/**
+ * @callback_method_impl{FNSSMENUMUNITPASS, Loads the 1st item and counts the passes.}
+ */
+static DECLCALLBACK(int) tstSSMEnumUnitPass(PSSMHANDLE pSSM, uint32_t uVersion, uint32_t uPass, void *pvUser)
+{
+    if (uPass != SSM_PASS_FINAL)
+        return VERR_SSM_UNEXPECTED_PASS;
+    *(uint32_t *)pvUser += 1;
+    return Item01Load(NULL, pSSM, uVersion, uPass);
+}
+
+
 /**
  * Creates a mockup VM structure for testing SSM.
  *
@@ -752,6 +873,16 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
         return 1;
     }
 
+    rc = SSMR3RegisterInternal(pVM, "SSM Testcase Data Item no.5 (uncompressed mem)", 0, 5, TSTSSM_ITEM05_PAGES * PAGE_SIZE,
+                               NULL, NULL, NULL,
+                               NULL, Item05Save, NULL,
+                               NULL, Item05Load, NULL);
+    if (RT_FAILURE(rc))
+    {
+        RTPrintf("SSMR3Register #5 -> %Rrc\n", rc);
+        return 1;
+    }
+
     /*
      * Attempt a save.
      */
@@ -904,6 +1035,22 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
     u64Elapsed = RTTimeNanoTS() - u64Start;
     RTPrintf("tstSSM: Loaded 3rd item in %'RI64 ns\n", u64Elapsed);
 
+    /* enumerate the passes of the 1st unit */
+    rc = SSMR3EnumUnitPasses(pSSM, "some unit that doesn't exist", 0, tstSSMEnumUnitPass, NULL);
+    if (rc != VERR_SSM_UNIT_NOT_FOUND)
+    {
+        RTPrintf("SSMR3EnumUnitPasses #1 negative -> %Rrc\n", rc);
+        return 1;
+    }
+    uint32_t cPasses = 0;
+    rc = SSMR3EnumUnitPasses(pSSM, "SSM Testcase Data Item no.1 (all types)", 1, tstSSMEnumUnitPass, &cPasses);
+    if (RT_FAILURE(rc) || cPasses != 1)
+    {
+        RTPrintf("SSMR3EnumUnitPasses #1 unit 1 -> %Rrc cPasses=%u\n", rc, cPasses);
+        return 1;
+    }
+    RTPrintf("tstSSM: Enumerated the passes of the 1st item\n");
+
     /* close */
     rc = SSMR3Close(pSSM);
     if (RT_FAILURE(rc))
@@ -0,0 +1,633 @@
+/* $Id$ */
+/** @file
+ * STAM Testcase - Binary snapshots and the statistics export file.
+ */
+
+/*
+ * Copyright (C) 2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <VBox/vmm/vm.h>
+#include <VBox/vmm/stam.h>
+#include <VBox/err.h>
+#include <VBox/log.h>
+#include <iprt/asm.h>
+#include <iprt/assert.h>
+#include <iprt/file.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/path.h>
+#include <iprt/process.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/thread.h>
+#include <iprt/time.h>
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+#define TESTCASE                    "tstSTAMSnapshotBin"
+/** The pattern selecting the test samples. */
+#define TST_PATTERN                 "/TstSTAM/*"
+/** The max number of values the test samples contribute. */
+#define TST_MAX_VALUES              16
+/** The export update interval. */
+#define TST_EXPORT_INTERVAL         10
+/** How long to wait for the export thread to pick up a change. */
+#define TST_EXPORT_TIMEOUT_MS       10000
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** The test handle. */
+static RTTEST           g_hTest;
+/** @name The test samples.
+ * @{ */
+static STAMCOUNTER      g_Counter1;
+static STAMCOUNTER      g_Counter2;
+static uint32_t         g_u32;
+static STAMPROFILE      g_Profile;
+static STAMRATIOU32     g_Ratio;
+/** Only registered while g_fExtraRegistered is set. */
+static STAMCOUNTER      g_Extra;
+static bool             g_fExtraRegistered;
+/** Not selected by TST_PATTERN. */
+static STAMCOUNTER      g_Unselected;
+/** @} */
+
+/** The samples selected by TST_PATTERN. */
+static struct
+{
+    const char     *pszName;
+    STAMTYPE        enmType;
+    uint8_t         cValues;
+    void           *pvSample;
+} const g_aSamples[] =
+{
+    { "/TstSTAM/Counter1",  STAMTYPE_COUNTER,   1, &g_Counter1 },
+    { "/TstSTAM/Counter2",  STAMTYPE_COUNTER,   1, &g_Counter2 },
+    { "/TstSTAM/U32",       STAMTYPE_U32,       1, &g_u32 },
+    { "/TstSTAM/Profile",   STAMTYPE_PROFILE,   4, &g_Profile },
+    { "/TstSTAM/Ratio",     STAMTYPE_RATIO_U32, 2, &g_Ratio },
+    { "/TstSTAM/Extra",     STAMTYPE_COUNTER,   1, &g_Extra },  /* must be last */
+};
+
+
+static int tstRegisterSamples(PUVM pUVM)
+{
+    g_Counter1.c         = 10;
+    g_Counter2.c         = 20;
+    g_u32                = 30;
+    g_Profile.cPeriods   = 3;
+    g_Profile.cTicks     = 300;
+    g_Profile.cTicksMin  = 50;
+    g_Profile.cTicksMax  = 150;
+    g_Ratio.u32A         = 7;
+    g_Ratio.u32B         = 8;
+    g_Extra.c            = 42;
+
+    int rc = VINF_SUCCESS;
+    for (unsigned i = 0; i < RT_ELEMENTS(g_aSamples) - 1 && RT_SUCCESS(rc); i++)
+        rc = STAMR3RegisterU(pUVM, g_aSamples[i].pvSample, g_aSamples[i].enmType, STAMVISIBILITY_ALWAYS,
+                             g_aSamples[i].pszName, STAMUNIT_OCCURENCES, "");
+    if (RT_SUCCESS(rc))
+        rc = STAMR3RegisterU(pUVM, &g_Unselected, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, "/TstSTAMNot/Counter",
+                             STAMUNIT_OCCURENCES, "");
+    return rc;
+}
+
+
+static void tstRegisterExtra(PUVM pUVM)
+{
+    RTTESTI_CHECK_RC_RETV(STAMR3RegisterU(pUVM, &g_Extra, STAMTYPE_COUNTER, STAMVISIBILITY_ALWAYS, "/TstSTAM/Extra",
+                                          STAMUNIT_OCCURENCES, ""), VINF_SUCCESS);
+    g_fExtraRegistered = true;
+}
+
+
+static void tstDeregisterExtra(PUVM pUVM)
+{
+    RTTESTI_CHECK_RC_RETV(STAMR3Deregister(pUVM, "/TstSTAM/Extra"), VINF_SUCCESS);
+    g_fExtraRegistered = false;
+}
+
+
+/** The number of currently registered samples selected by TST_PATTERN. */
+static uint32_t tstSampleCount(void)
+{
+    return RT_ELEMENTS(g_aSamples) - !g_fExtraRegistered;
+}
+
+
+/**
+ * Looks up a sample in a name table.
+ *
+ * @returns The name table entry, NULL if not found.
+ */
+static PCSTAMBINNAME tstFindName(PCSTAMBINNAMES pNames, const char *pszName)
+{
+    PCSTAMBINNAME paEntries  = (PCSTAMBINNAME)(pNames + 1);
+    const char   *pszStrings = (const char *)pNames + pNames->offStrings;
+    for (uint32_t i = 0; i < pNames->cSamples; i++)
+        if (!strcmp(&pszStrings[paEntries[i].offName], pszName))
+            return &paEntries[i];
+    return NULL;
+}
+
+
+/**
+ * Checks a name table against the registered test samples.
+ *
+ * @returns true if it matches, false if not.
+ * @param   pNames      The name table.
+ * @param   cbNames     The size of the name table.
+ * @param   pszWhat     What to call it in failure messages, NULL to just
+ *                      return false without failing the test.
+ */
+static bool tstCheckNames(PCSTAMBINNAMES pNames, size_t cbNames, const char *pszWhat)
+{
+    uint32_t const cSamples = tstSampleCount();
+    uint32_t       cValues  = 0;
+    for (uint32_t i = 0; i < cSamples; i++)
+        cValues += g_aSamples[i].cValues;
+
+#define CHECK_NAMES(a_Expr) \
+    do { \
+        if (!(a_Expr)) \
+        { \
+            if (pszWhat) \
+                RTTestFailed(g_hTest, "%s: %s", pszWhat, #a_Expr); \
+            return false; \
+        } \
+    } while (0)
+    CHECK_NAMES(pNames->u32Magic == STAMBINNAMES_MAGIC);
+    CHECK_NAMES(pNames->cbTotal == cbNames);
+    CHECK_NAMES(pNames->cSamples == cSamples);
+    CHECK_NAMES(pNames->cValues == cValues);
+    CHECK_NAMES(pNames->offStrings == sizeof(*pNames) + cSamples * sizeof(STAMBINNAME));
+    for (uint32_t i = 0; i < cSamples; i++)
+    {
+        PCSTAMBINNAME pEntry = tstFindName(pNames, g_aSamples[i].pszName);
+        CHECK_NAMES(pEntry != NULL);
+        CHECK_NAMES(pEntry->enmType == g_aSamples[i].enmType);
+        CHECK_NAMES(pEntry->cValues == g_aSamples[i].cValues);
+        CHECK_NAMES(pEntry->idxValue + pEntry->cValues <= cValues);
+    }
+    CHECK_NAMES(tstFindName(pNames, "/TstSTAMNot/Counter") == NULL);
+#undef CHECK_NAMES
+    return true;
+}
+
+
+/**
+ * Reads the current test sample values into a full value vector laid out
+ * according to a (valid) name table.
+ */
+static void tstGetExpected(PCSTAMBINNAMES pNames, uint64_t *pau64)
+{
+    for (uint32_t i = 0; i < tstSampleCount(); i++)
+    {
+        uint64_t *pau64Dst = &pau64[tstFindName(pNames, g_aSamples[i].pszName)->idxValue];
+        switch (g_aSamples[i].enmType)
+        {
+            case STAMTYPE_COUNTER:
+                pau64Dst[0] = ((PSTAMCOUNTER)g_aSamples[i].pvSample)->c;
+                break;
+            case STAMTYPE_U32:
+                pau64Dst[0] = *(uint32_t *)g_aSamples[i].pvSample;
+                break;
+            case STAMTYPE_PROFILE:
+                pau64Dst[0] = ((PSTAMPROFILE)g_aSamples[i].pvSample)->cPeriods;
+                pau64Dst[1] = ((PSTAMPROFILE)g_aSamples[i].pvSample)->cTicks;
+                pau64Dst[2] = ((PSTAMPROFILE)g_aSamples[i].pvSample)->cTicksMin;
+                pau64Dst[3] = ((PSTAMPROFILE)g_aSamples[i].pvSample)->cTicksMax;
+                break;
+            case STAMTYPE_RATIO_U32:
+                pau64Dst[0] = ((PSTAMRATIOU32)g_aSamples[i].pvSample)->u32A;
+                pau64Dst[1] = ((PSTAMRATIOU32)g_aSamples[i].pvSample)->u32B;
+                break;
+            default:
+                AssertFailed();
+        }
+    }
+}
+
+
+/**
+ * Checks a full value vector against the test samples.
+ *
+ * @returns true if it matches, false if not.
+ * @param   pNames      The (valid) name table.
+ * @param   pau64       The full value vector.
+ * @param   pszWhat     What to call it in failure messages, NULL to just
+ *                      return false without failing the test.
+ */
+static bool tstCheckValues(PCSTAMBINNAMES pNames, uint64_t const *pau64, const char *pszWhat)
+{
+    uint64_t au64Expect[TST_MAX_VALUES];
+    tstGetExpected(pNames, au64Expect);
+    bool fMatch = true;
+    for (uint32_t i = 0; i < pNames->cValues; i++)
+        if (pau64[i] != au64Expect[i])
+        {
+            if (pszWhat)
+                RTTestFailed(g_hTest, "%s: value #%u is %RU64, expected %RU64", pszWhat, i, pau64[i], au64Expect[i]);
+            fMatch = false;
+        }
+    return fMatch;
+}
+
+
+/**
+ * Collects values and checks the header.
+ *
+ * @returns The value vector, NULL on failure.
+ */
+static PCSTAMBINVALUES tstCollect(PSTAMBINSNAP hSnap, bool fDelta, size_t *pcbValues, uint64_t uSeqNo, bool fExpectDelta)
+{
+    void const *pvValues = NULL;
+    int rc = STAMR3SnapshotBinCollect(hSnap, fDelta, &pvValues, pcbValues);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, NULL);
+
+    PCSTAMBINVALUES pValues = (PCSTAMBINVALUES)pvValues;
+    RTTESTI_CHECK_RET(pValues->u32Magic == STAMBINVALUES_MAGIC, NULL);
+    RTTESTI_CHECK_MSG(pValues->uSeqNo == uSeqNo, ("uSeqNo=%RU64, expected %RU64\n", pValues->uSeqNo, uSeqNo));
+    RTTESTI_CHECK_MSG_RET(!(pValues->fFlags & STAMBINVALUES_F_DELTA) == !fExpectDelta,
+                          ("fFlags=%#x, expected delta=%RTbool\n", pValues->fFlags, fExpectDelta), NULL);
+    if (!fExpectDelta)
+        RTTESTI_CHECK_MSG(*pcbValues == sizeof(*pValues) + pValues->cValues * sizeof(uint64_t),
+                          ("cbValues=%#zx cValues=%u\n", *pcbValues, pValues->cValues));
+    return pValues;
+}
+
+
+/**
+ * Checks a delta value vector.
+ *
+ * The values marked dirty must be exactly the ones that differ between the
+ * previous full vector and the current sample values, and be in index order.
+ *
+ * @param   pNames          The name table.
+ * @param   pValues         The delta value vector.
+ * @param   cbValues        Its size.
+ * @param   pau64Prev       The previous full vector, updated.
+ * @param   cChanges        The number of values the caller changed.
+ */
+static void tstCheckDelta(PCSTAMBINNAMES pNames, PCSTAMBINVALUES pValues, size_t cbValues, uint64_t *pau64Prev, uint32_t cChanges)
+{
+    uint64_t au64Expect[TST_MAX_VALUES];
+    tstGetExpected(pNames, au64Expect);
+
+    uint32_t const  cValues  = pValues->cValues;
+    uint64_t const *pbmDirty = (uint64_t const *)(pValues + 1);
+    uint64_t const *pau64Src = pbmDirty + RT_ALIGN_32(cValues, 64) / 64;
+    RTTESTI_CHECK_RETV(cValues == pNames->cValues);
+    RTTESTI_CHECK_MSG_RETV(cbValues == (uintptr_t)(pau64Src + cChanges) - (uintptr_t)pValues,
+                           ("cbValues=%#zx, expected %u changed values\n", cbValues, cChanges));
+
+    uint32_t cDirty = 0;
+    for (uint32_t i = 0; i < RT_ALIGN_32(cValues, 64); i++)
+    {
+        bool const fDirty   = ASMBitTest(pbmDirty, i);
+        bool const fChanged = i < cValues && au64Expect[i] != pau64Prev[i];
+        RTTESTI_CHECK_MSG_RETV(fDirty == fChanged, ("value #%u: dirty=%RTbool changed=%RTbool\n", i, fDirty, fChanged));
+        if (fDirty)
+        {
+            RTTESTI_CHECK_MSG(*pau64Src == au64Expect[i], ("value #%u is %RU64, expected %RU64\n", i, *pau64Src, au64Expect[i]));
+            pau64Src++;
+            cDirty++;
+        }
+    }
+    RTTESTI_CHECK_MSG(cDirty == cChanges, ("%u values dirty, expected %u\n", cDirty, cChanges));
+    memcpy(pau64Prev, au64Expect, cValues * sizeof(uint64_t));
+}
+
+
+static void tstSnapshot(PUVM pUVM)
+{
+    RTTestSub(g_hTest, "Full and delta collections");
+
+    PSTAMBINSNAP hSnap;
+    RTTESTI_CHECK_RC_RETV(STAMR3SnapshotBinCreate(pUVM, TST_PATTERN, &hSnap), VINF_SUCCESS);
+
+    void const *pvNames;
+    size_t      cbNames;
+    RTTESTI_CHECK_RC(STAMR3SnapshotBinGetNames(hSnap, &pvNames, &cbNames), VINF_SUCCESS);
+    PCSTAMBINNAMES pNames = (PCSTAMBINNAMES)pvNames;
+    if (!tstCheckNames(pNames, cbNames, "initial names"))
+    {
+        STAMR3SnapshotBinDestroy(hSnap);
+        return;
+    }
+    uint32_t uGeneration = pNames->uGeneration;
+
+    /*
+     * The first collection is always a full one, even if a delta is asked for.
+     */
+    uint64_t        au64Prev[TST_MAX_VALUES];
+    size_t          cbValues;
+    PCSTAMBINVALUES pValues = tstCollect(hSnap, true /*fDelta*/, &cbValues, 1, false /*fExpectDelta*/);
+    if (pValues)
+    {
+        RTTESTI_CHECK(pValues->uGeneration == uGeneration);
+        RTTESTI_CHECK(pValues->cValues == pNames->cValues);
+        tstCheckValues(pNames, (uint64_t const *)(pValues + 1), "first collection");
+        memcpy(au64Prev, pValues + 1, pNames->cValues * sizeof(uint64_t));
+    }
+
+    /* Nothing changed: an empty bitmap and no values. */
+    pValues = tstCollect(hSnap, true /*fDelta*/, &cbValues, 2, true /*fExpectDelta*/);
+    if (pValues)
+        tstCheckDelta(pNames, pValues, cbValues, au64Prev, 0);
+
+    /* Some values changed, spread over the vector. */
+    g_Counter2.c       += 5;
+    g_Profile.cPeriods += 1;
+    g_Profile.cTicks   += 100;
+    g_Ratio.u32B        = 9;
+    pValues = tstCollect(hSnap, true /*fDelta*/, &cbValues, 3, true /*fExpectDelta*/);
+    if (pValues)
+        tstCheckDelta(pNames, pValues, cbValues, au64Prev, 4);
+
+    /* A single change. */
+    g_Counter1.c++;
+    pValues = tstCollect(hSnap, true /*fDelta*/, &cbValues, 4, true /*fExpectDelta*/);
+    if (pValues)
+        tstCheckDelta(pNames, pValues, cbValues, au64Prev, 1);
+
+    /* A full collection must agree. */
+    pValues = tstCollect(hSnap, false /*fDelta*/, &cbValues, 5, false /*fExpectDelta*/);
+    if (pValues)
+        tstCheckValues(pNames, (uint64_t const *)(pValues + 1), "full collection");
+
+    /*
+     * Registering a selected sample makes the next collection a full one with
+     * a new generation, and the name table has to be fetched again.
+     */
+    tstRegisterExtra(pUVM);
+    pValues = tstCollect(hSnap, true /*fDelta*/, &cbValues, 6, false /*fExpectDelta*/);
+    if (pValues)
+    {
+        RTTESTI_CHECK(pValues->uGeneration != uGeneration);
+        RTTESTI_CHECK_RC(STAMR3SnapshotBinGetNames(hSnap, &pvNames, &cbNames), VINF_SUCCESS);
+        pNames = (PCSTAMBINNAMES)pvNames;
+        if (tstCheckNames(pNames, cbNames, "names after registering"))
+        {
+            RTTESTI_CHECK(pNames->uGeneration == pValues->uGeneration);
+            RTTESTI_CHECK(pValues->cValues == pNames->cValues);
+            tstCheckValues(pNames, (uint64_t const *)(pValues + 1), "after registering");
+            memcpy(au64Prev, pValues + 1, pNames->cValues * sizeof(uint64_t));
+            uGeneration = pNames->uGeneration;
+
+            g_Extra.c++;
+            pValues = tstCollect(hSnap, true /*fDelta*/, &cbValues, 7, true /*fExpectDelta*/);
+            if (pValues)
+                tstCheckDelta(pNames, pValues, cbValues, au64Prev, 1);
+        }
+    }
+
+    /* Deregistering works the same way. */
+    tstDeregisterExtra(pUVM);
+    pValues = tstCollect(hSnap, true /*fDelta*/, &cbValues, 8, false /*fExpectDelta*/);
+    if (pValues)
+    {
+        RTTESTI_CHECK(pValues->uGeneration != uGeneration);
+        RTTESTI_CHECK_RC(STAMR3SnapshotBinGetNames(hSnap, &pvNames, &cbNames), VINF_SUCCESS);
+        pNames = (PCSTAMBINNAMES)pvNames;
+        if (tstCheckNames(pNames, cbNames, "names after deregistering"))
+            tstCheckValues(pNames, (uint64_t const *)(pValues + 1), "after deregistering");
+    }
+
+    RTTESTI_CHECK_RC(STAMR3SnapshotBinDestroy(hSnap), VINF_SUCCESS);
+}
+
+
+/**
+ * Reads the export file the way a monitor process would.
+ *
+ * @returns VBox status code.
+ * @param   pszFile     The export file.
+ * @param   pHdr        Where to return the header.
+ * @param   ppValues    Where to return the value vector, RTMemFree.
+ * @param   ppNames     Where to return the name table, RTMemFree.
+ */
+static int tstReadExport(const char *pszFile, PSTAMEXPORTHDR pHdr, PSTAMBINVALUES *ppValues, PSTAMBINNAMES *ppNames)
+{
+    *ppValues = NULL;
+    *ppNames  = NULL;
+    RTFILE hFile;
+    int rc = RTFileOpen(&hFile, pszFile, RTFILE_O_READ | RTFILE_O_OPEN | RTFILE_O_DENY_NONE);
+    if (RT_FAILURE(rc))
+        return rc;
+
+    for (unsigned cTries = 0; cTries < 1000; cTries++)
+    {
+        RTMemFree(*ppValues);
+        RTMemFree(*ppNames);
+        *ppValues = NULL;
+        *ppNames  = NULL;
+
+        rc = RTFileReadAt(hFile, 0, pHdr, sizeof(*pHdr), NULL);
+        if (RT_FAILURE(rc))
+            break;
+        if (pHdr->uSeq & 1)
+        {
+            /* Update in progress. */
+            rc = VERR_TRY_AGAIN;
+            RTThreadSleep(1);
+            continue;
+        }
+        if (pHdr->cbValues > _1M || pHdr->cbNames > _1M)
+        {
+            rc = VERR_OUT_OF_RANGE;
+            break;
+        }
+
+        *ppValues = (PSTAMBINVALUES)RTMemAlloc(pHdr->cbValues);
+        *ppNames  = (PSTAMBINNAMES)RTMemAlloc(pHdr->cbNames);
+        if (!*ppValues || !*ppNames)
+        {
+            rc = VERR_NO_MEMORY;
+            break;
+        }
+        rc = RTFileReadAt(hFile, pHdr->offValues, *ppValues, pHdr->cbValues, NULL);
+        if (RT_SUCCESS(rc))
+            rc = RTFileReadAt(hFile, pHdr->offNames, *ppNames, pHdr->cbNames, NULL);
+
+        /* Consistent if the sequence number didn't change meanwhile. */
+        uint64_t uSeq = UINT64_MAX;
+        int rc2 = RTFileReadAt(hFile, RT_OFFSETOF(STAMEXPORTHDR, uSeq), &uSeq, sizeof(uSeq), NULL);
+        if (RT_SUCCESS(rc2) && uSeq == pHdr->uSeq)
+            break;
+        rc = VERR_TRY_AGAIN;
+    }
+
+    RTFileClose(hFile);
+    if (RT_FAILURE(rc))
+    {
+        RTMemFree(*ppValues);
+        RTMemFree(*ppNames);
+        *ppValues = NULL;
+        *ppNames  = NULL;
+    }
+    return rc;
+}
+
+
+/**
+ * Checks the export file content against the test samples.
+ *
+ * @returns true if the values match, false if not.
+ * @param   pszFile     The export file.
+ * @param   fFailIfStale Whether to fail the test if the values don't match.
+ * @param   puSeq       Where to return the sequence number.
+ */
+static bool tstCheckExport(const char *pszFile, bool fFailIfStale, uint64_t *puSeq)
+{
+    STAMEXPORTHDR  Hdr;
+    PSTAMBINVALUES pValues;
+    PSTAMBINNAMES  pNames;
+    int rc = tstReadExport(pszFile, &Hdr, &pValues, &pNames);
+    RTTESTI_CHECK_RC_RET(rc, VINF_SUCCESS, false);
+    *puSeq = Hdr.uSeq;
+
+    RTTESTI_CHECK(!memcmp(Hdr.szMagic, STAMEXPORTHDR_MAGIC, sizeof(STAMEXPORTHDR_MAGIC)));
+    RTTESTI_CHECK(Hdr.uVersion == STAMEXPORTHDR_VERSION);
+    RTTESTI_CHECK(Hdr.cbHdr == sizeof(Hdr));
+    RTTESTI_CHECK(Hdr.cMsInterval == TST_EXPORT_INTERVAL);
+    RTTESTI_CHECK(Hdr.uPid == RTProcSelf());
+    RTTESTI_CHECK_MSG(Hdr.uSeq >= 2 && !(Hdr.uSeq & 1), ("uSeq=%RU64\n", Hdr.uSeq));
+    RTTESTI_CHECK(Hdr.offValues >= Hdr.cbHdr);
+    RTTESTI_CHECK(Hdr.offNames >= Hdr.offValues + Hdr.cbValues);
+    RTTESTI_CHECK(pValues->u32Magic == STAMBINVALUES_MAGIC);
+    RTTESTI_CHECK(!(pValues->fFlags & STAMBINVALUES_F_DELTA));
+    RTTESTI_CHECK(Hdr.cbValues == sizeof(*pValues) + pValues->cValues * sizeof(uint64_t));
+
+    bool fMatch = false;
+    if (   pNames->u32Magic == STAMBINNAMES_MAGIC
+        && pNames->uGeneration == pValues->uGeneration
+        && pNames->cValues == pValues->cValues)
+    {
+        /* When waiting for the export thread to catch up, mismatches are quietly ignored. */
+        fMatch = tstCheckNames(pNames, Hdr.cbNames, fFailIfStale ? "exported names" : NULL)
+              && tstCheckValues(pNames, (uint64_t const *)(pValues + 1), fFailIfStale ? "exported values" : NULL);
+    }
+    else
+        RTTestFailed(g_hTest, "Inconsistent export: names magic %#x generation %u/%u, %u/%u values",
+                     pNames->u32Magic, pNames->uGeneration, pValues->uGeneration, pNames->cValues, pValues->cValues);
+
+    RTMemFree(pValues);
+    RTMemFree(pNames);
+    return fMatch;
+}
+
+
+/**
+ * Waits for the export file to reflect the current sample values.
+ */
+static void tstWaitForExport(const char *pszFile, uint64_t uSeqPrev, const char *pszWhat)
+{
+    uint64_t const msStart = RTTimeMilliTS();
+    uint64_t       uSeq    = uSeqPrev;
+    while (   !tstCheckExport(pszFile, false /*fFailIfStale*/, &uSeq)
+           && !RTTestErrorCount(g_hTest)
+           && RTTimeMilliTS() - msStart < TST_EXPORT_TIMEOUT_MS)
+        RTThreadSleep(TST_EXPORT_INTERVAL);
+    RTTESTI_CHECK_MSG(tstCheckExport(pszFile, true /*fFailIfStale*/, &uSeq), ("%s\n", pszWhat));
+    RTTESTI_CHECK_MSG(uSeq > uSeqPrev, ("%s: uSeq=%RU64 uSeqPrev=%RU64\n", pszWhat, uSeq, uSeqPrev));
+}
+
+
+static void tstExport(PUVM pUVM)
+{
+    RTTestSub(g_hTest, "Export file");
+
+    char szFile[RTPATH_MAX];
+    int rc = RTPathTemp(szFile, sizeof(szFile));
+    if (RT_SUCCESS(rc))
+        rc = RTPathAppend(szFile, sizeof(szFile), TESTCASE "-XXXXXX.stam");
+    if (RT_SUCCESS(rc))
+        rc = RTFileCreateTemp(szFile, 0600);
+    RTTESTI_CHECK_RC_RETV(rc, VINF_SUCCESS);
+
+    /* The first update is done before returning. */
+    rc = STAMR3ExportStart(pUVM, szFile, TST_PATTERN, TST_EXPORT_INTERVAL);
+    RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    if (RT_SUCCESS(rc))
+    {
+        RTTESTI_CHECK_RC(STAMR3ExportStart(pUVM, szFile, TST_PATTERN, TST_EXPORT_INTERVAL), VERR_ALREADY_EXISTS);
+
+        uint64_t uSeq = 0;
+        tstCheckExport(szFile, true /*fFailIfStale*/, &uSeq);
+
+        g_Counter1.c = 1000;
+        tstWaitForExport(szFile, uSeq, "counter change");
+
+        /* The name table is rewritten when the samples change. */
+        tstCheckExport(szFile, true /*fFailIfStale*/, &uSeq);
+        tstRegisterExtra(pUVM);
+        tstWaitForExport(szFile, uSeq, "registration");
+
+        tstCheckExport(szFile, true /*fFailIfStale*/, &uSeq);
+        tstDeregisterExtra(pUVM);
+        tstWaitForExport(szFile, uSeq, "deregistration");
+
+        RTTESTI_CHECK_RC(STAMR3ExportStop(pUVM), VINF_SUCCESS);
+        RTTESTI_CHECK_MSG(!RTFileExists(szFile), ("%s was not deleted\n", szFile));
+    }
+    RTFileDelete(szFile);
+}
+
+
+extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
+{
+    NOREF(argc); NOREF(argv); NOREF(envp);
+    RTEXITCODE rcExit = RTTestInitExAndCreate(argc, &argv, RTR3INIT_FLAGS_SUPLIB, TESTCASE, &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    PVM  pVM;
+    PUVM pUVM;
+    int rc = VMR3Create(1, NULL, NULL, NULL, NULL, NULL, &pVM, &pUVM);
+    if (RT_FAILURE(rc))
+        return RTTestSkipAndDestroy(g_hTest, "VMR3Create failed: %Rrc", rc);
+
+    rc = tstRegisterSamples(pUVM);
+    RTTESTI_CHECK_RC(rc, VINF_SUCCESS);
+    if (RT_SUCCESS(rc))
+    {
+        tstSnapshot(pUVM);
+        tstExport(pUVM);
+    }
+    STAMR3Deregister(pUVM, "/TstSTAM*");
+
+    VMR3Destroy(pUVM);
+    VMR3ReleaseUVM(pUVM);
+    return RTTestSummaryAndDestroy(g_hTest);
+}
+
+
+#if !defined(VBOX_WITH_HARDENING) || !defined(RT_OS_WINDOWS)
+/**
+ * Main entry point.
+ */
+int main(int argc, char **argv, char **envp)
+{
+    return TrustedMain(argc, argv, envp);
+}
+#endif
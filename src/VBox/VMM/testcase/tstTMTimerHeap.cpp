@@ -0,0 +1,403 @@
+/* $Id$ */
+/** @file
+ * TM Timer Heap Testcase - Checks and benchmarks the active timer heap.
+ */
+
+/*
+ * Copyright (C) 2006-2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*********************************************************************************************************************************
+*   Header Files                                                                                                                 *
+*********************************************************************************************************************************/
+#include <VBox/vmm/tm.h>
+#include <VBox/vmm/dbgftrace.h>
+#include "TMInternal.h"
+#include <VBox/err.h>
+#include <iprt/asm.h>
+#include <iprt/initterm.h>
+#include <iprt/mem.h>
+#include <iprt/string.h>
+#include <iprt/test.h>
+#include <iprt/time.h>
+
+#include "TMInline.h"
+
+
+/*********************************************************************************************************************************
+*   Defined Constants And Macros                                                                                                 *
+*********************************************************************************************************************************/
+/** The max number of timers we test with. */
+#define TST_MAX_TIMERS          _64K
+/** The largest number of timers the sorted list reference is benchmarked with. */
+#define TST_MAX_LIST_TIMERS     _4K
+
+
+/*********************************************************************************************************************************
+*   Global Variables                                                                                                             *
+*********************************************************************************************************************************/
+/** The test handle. */
+static RTTEST           g_hTest;
+/** The timer queue.  Like in the real thing it's in the same allocation as
+ * the timers to keep the offsets within 32 bits. */
+static PTMTIMERQUEUE    g_pQueue;
+/** The timers. */
+static PTMTIMER         g_paTimers;
+/** Simple xorshift state, we don't need RTRand quality or overhead here. */
+static uint64_t         g_uRand = UINT64_C(0x2545f4914f6cdd1d);
+
+
+static uint64_t tstRand(void)
+{
+    g_uRand ^= g_uRand << 13;
+    g_uRand ^= g_uRand >> 7;
+    g_uRand ^= g_uRand << 17;
+    return g_uRand;
+}
+
+
+static void tstQueueInit(PTMTIMERQUEUE pQueue)
+{
+    RT_BZERO(pQueue, sizeof(*pQueue));
+    pQueue->u64Expire = INT64_MAX;
+    pQueue->enmClock  = TMCLOCK_VIRTUAL;
+}
+
+
+/**
+ * The sorted list insert TM used before the heap, for comparison.
+ */
+static void tstListInsert(PTMTIMERQUEUE pQueue, PTMTIMER pTimer)
+{
+    uint64_t const u64Expire = pTimer->u64Expire;
+    PTMTIMER pCur = TMTIMER_GET_HEAD(pQueue);
+    if (pCur)
+    {
+        for (;; pCur = TMTIMER_GET_NEXT(pCur))
+        {
+            if (pCur->u64Expire > u64Expire)
+            {
+                const PTMTIMER pPrev = TMTIMER_GET_PREV(pCur);
+                TMTIMER_SET_NEXT(pTimer, pCur);
+                TMTIMER_SET_PREV(pTimer, pPrev);
+                if (pPrev)
+                    TMTIMER_SET_NEXT(pPrev, pTimer);
+                else
+                {
+                    TMTIMER_SET_HEAD(pQueue, pTimer);
+                    ASMAtomicWriteU64(&pQueue->u64Expire, u64Expire);
+                }
+                TMTIMER_SET_PREV(pCur, pTimer);
+                return;
+            }
+            if (!pCur->offNext)
+            {
+                TMTIMER_SET_NEXT(pCur, pTimer);
+                TMTIMER_SET_PREV(pTimer, pCur);
+                return;
+            }
+        }
+    }
+    TMTIMER_SET_HEAD(pQueue, pTimer);
+    ASMAtomicWriteU64(&pQueue->u64Expire, u64Expire);
+}
+
+
+/**
+ * The sorted list removal TM used before the heap, for comparison.
+ */
+static void tstListRemove(PTMTIMERQUEUE pQueue, PTMTIMER pTimer)
+{
+    const PTMTIMER pPrev = TMTIMER_GET_PREV(pTimer);
+    const PTMTIMER pNext = TMTIMER_GET_NEXT(pTimer);
+    if (pPrev)
+        TMTIMER_SET_NEXT(pPrev, pNext);
+    else
+    {
+        TMTIMER_SET_HEAD(pQueue, pNext);
+        pQueue->u64Expire = pNext ? pNext->u64Expire : INT64_MAX;
+    }
+    if (pNext)
+        TMTIMER_SET_PREV(pNext, pPrev);
+    pTimer->offNext = 0;
+    pTimer->offPrev = 0;
+}
+
+
+/**
+ * Checks the heap structure and that all timers flagged as linked are in it.
+ */
+static void tstHeapCheck(PTMTIMERQUEUE pQueue, bool const *pafLinked, uint32_t cTimers)
+{
+    uint32_t cFound = 0;
+    PTMTIMER pHead  = TMTIMER_GET_HEAD(pQueue);
+    if (pHead)
+    {
+        RTTEST_CHECK(g_hTest, !pHead->offPrev && !pHead->offNext);
+        RTTEST_CHECK(g_hTest, pQueue->u64Expire == pHead->u64ExpireLinked);
+    }
+    else
+        RTTEST_CHECK(g_hTest, pQueue->u64Expire == INT64_MAX);
+
+    for (PTMTIMER pCur = pHead; pCur; pCur = tmTimerQueueHeapWalkNext(pCur))
+    {
+        cFound++;
+        uint32_t const iTimer = (uint32_t)(pCur - g_paTimers);
+        RTTEST_CHECK_RETV(g_hTest, iTimer < cTimers);
+        RTTEST_CHECK_MSG(g_hTest, pafLinked[iTimer], (g_hTest, "timer #%u in the heap but not linked\n", iTimer));
+
+        PTMTIMER pChild = TMTIMER_GET_CHILD(pCur);
+        if (pChild)
+        {
+            RTTEST_CHECK(g_hTest, TMTIMER_GET_PREV(pChild) == pCur);
+            for (PTMTIMER pSib = pChild; pSib; pSib = TMTIMER_GET_NEXT(pSib))
+                RTTEST_CHECK_MSG_RETV(g_hTest, pSib->u64ExpireLinked >= pCur->u64ExpireLinked,
+                                      (g_hTest, "heap order: %RU64 < %RU64\n", pSib->u64ExpireLinked, pCur->u64ExpireLinked));
+        }
+        PTMTIMER pNext = TMTIMER_GET_NEXT(pCur);
+        if (pNext)
+            RTTEST_CHECK(g_hTest, TMTIMER_GET_PREV(pNext) == pCur);
+        RTTEST_CHECK_RETV(g_hTest, cFound <= cTimers);
+    }
+
+    uint32_t cLinked = 0;
+    for (uint32_t i = 0; i < cTimers; i++)
+        cLinked += pafLinked[i];
+    RTTEST_CHECK_MSG(g_hTest, cFound == cLinked, (g_hTest, "cFound=%u cLinked=%u\n", cFound, cLinked));
+    RTTEST_CHECK_MSG(g_hTest, pQueue->cActive == cLinked, (g_hTest, "cActive=%u cLinked=%u\n", pQueue->cActive, cLinked));
+}
+
+
+/**
+ * Random inserts, removals and reschedules with full structure checks.
+ *
+ * Some linked timers get their u64Expire changed in place like TMTimerSet
+ * does from other threads, these must not upset the heap and are re-keyed
+ * before the final drain like the scheduling pass would.
+ */
+static void tstCorrectness(void)
+{
+    RTTestSub(g_hTest, "Correctness");
+
+    uint32_t const  cTimers   = 512;
+    bool           *pafLinked = (bool *)RTMemAllocZ(cTimers * sizeof(bool) * 2);
+    RTTEST_CHECK_RETV(g_hTest, pafLinked);
+    bool           *pafStale  = &pafLinked[cTimers];
+    RT_BZERO(g_paTimers, cTimers * sizeof(TMTIMER));
+
+    TMTIMERQUEUE &Queue = *g_pQueue;
+    tstQueueInit(&Queue);
+
+    for (uint32_t iRound = 0; iRound < 20000 && !RTTestErrorCount(g_hTest); iRound++)
+    {
+        uint32_t const iTimer = (uint32_t)(tstRand() % cTimers);
+        PTMTIMER const pTimer = &g_paTimers[iTimer];
+        if (!pafLinked[iTimer])
+        {
+            /* Small value range so we get plenty of ties. */
+            pTimer->u64Expire = tstRand() % 1024;
+            uint64_t const u64Old = Queue.u64Expire;
+            bool const fHead = tmTimerQueueHeapInsert(&Queue, pTimer);
+            RTTEST_CHECK(g_hTest, fHead == (pTimer->u64Expire < u64Old || u64Old == INT64_MAX));
+            pafLinked[iTimer] = true;
+        }
+        else if ((tstRand() & 3) == 0)
+        {
+            /* Change it in place, TMTimerSet on an active timer from another thread. */
+            pTimer->u64Expire = tstRand() % 1024;
+            pafStale[iTimer]  = true;
+        }
+        else
+        {
+            bool const fWasHead = TMTIMER_GET_HEAD(&Queue) == pTimer;
+            RTTEST_CHECK(g_hTest, tmTimerQueueHeapRemove(&Queue, pTimer) == fWasHead);
+            RTTEST_CHECK(g_hTest, !pTimer->offNext && !pTimer->offPrev && !pTimer->offChild);
+            pafLinked[iTimer] = false;
+            pafStale[iTimer]  = false;
+
+            /* Reschedule half of them right away like TMTimerSet on an active timer. */
+            if (tstRand() & 1)
+            {
+                pTimer->u64Expire = tstRand() % 1024;
+                tmTimerQueueHeapInsert(&Queue, pTimer);
+                pafLinked[iTimer] = true;
+            }
+        }
+        if ((iRound & 63) == 0)
+            tstHeapCheck(&Queue, pafLinked, cTimers);
+    }
+    tstHeapCheck(&Queue, pafLinked, cTimers);
+
+    /*
+     * Re-key the stale ones like the scheduling pass does.
+     */
+    for (uint32_t iTimer = 0; iTimer < cTimers; iTimer++)
+        if (pafStale[iTimer])
+        {
+            RTTEST_CHECK(g_hTest, pafLinked[iTimer]);
+            tmTimerQueueHeapRemove(&Queue, &g_paTimers[iTimer]);
+            tmTimerQueueHeapInsert(&Queue, &g_paTimers[iTimer]);
+            RTTEST_CHECK(g_hTest, g_paTimers[iTimer].u64ExpireLinked == g_paTimers[iTimer].u64Expire);
+            pafStale[iTimer] = false;
+        }
+    tstHeapCheck(&Queue, pafLinked, cTimers);
+
+    /*
+     * Drain it the way the run loops do and check the ordering.
+     */
+    uint64_t u64Prev = 0;
+    uint32_t cPopped = 0;
+    PTMTIMER pTimer;
+    while ((pTimer = TMTIMER_GET_HEAD(&Queue)) != NULL)
+    {
+        if (pTimer->u64Expire < u64Prev)
+        {
+            RTTestFailed(g_hTest, "out of order: %RU64 < %RU64\n", pTimer->u64Expire, u64Prev);
+            break;
+        }
+        u64Prev = pTimer->u64Expire;
+        RTTEST_CHECK(g_hTest, tmTimerQueueHeapRemove(&Queue, pTimer));
+        pafLinked[pTimer - g_paTimers] = false;
+        cPopped++;
+    }
+    RTTEST_CHECK(g_hTest, Queue.cActive == 0);
+    RTTEST_CHECK(g_hTest, Queue.u64Expire == INT64_MAX);
+    RTTEST_CHECK(g_hTest, cPopped > 0);
+    RTMemFree(pafLinked);
+}
+
+
+/**
+ * Benchmarks arming, re-arming, cancelling and expiring timers.
+ *
+ * The pattern is loosely modelled on a busy VM: most timers are periodic and
+ * get re-armed shortly after the current time, some get cancelled and armed
+ * again, and the run loop keeps popping the expired ones.
+ *
+ * @returns Nanoseconds per operation.
+ * @param   cTimers     The number of timers.
+ * @param   fList       Use the sorted list reference instead of the heap.
+ */
+static uint64_t tstBenchmarkOne(uint32_t cTimers, bool fList)
+{
+    RT_BZERO(g_paTimers, cTimers * sizeof(TMTIMER));
+    g_uRand = UINT64_C(0x2545f4914f6cdd1d);
+
+    TMTIMERQUEUE &Queue = *g_pQueue;
+    tstQueueInit(&Queue);
+
+    /* Arm them all. */
+    uint64_t const  cNsPeriodMax = _1M;
+    uint64_t        u64Now       = 0;
+    uint64_t        cOps         = 0;
+    uint64_t const  nsStart      = RTTimeNanoTS();
+    for (uint32_t i = 0; i < cTimers; i++)
+    {
+        g_paTimers[i].u64Expire = u64Now + 1 + tstRand() % cNsPeriodMax;
+        if (fList)
+            tstListInsert(&Queue, &g_paTimers[i]);
+        else
+            tmTimerQueueHeapInsert(&Queue, &g_paTimers[i]);
+        cOps++;
+    }
+
+    /* Run for a while. */
+    uint32_t const cRounds = 200000;
+    for (uint32_t iRound = 0; iRound < cRounds; iRound++)
+    {
+        /* Re-arm a random timer, the TMTimerSet on an active timer case. */
+        PTMTIMER pTimer = &g_paTimers[tstRand() % cTimers];
+        if (pTimer->offNext || pTimer->offPrev || TMTIMER_GET_HEAD(&Queue) == pTimer)
+        {
+            if (fList)
+                tstListRemove(&Queue, pTimer);
+            else
+                tmTimerQueueHeapRemove(&Queue, pTimer);
+            cOps++;
+            if (iRound & 7) /* every 8th gets cancelled only */
+            {
+                pTimer->u64Expire = u64Now + 1 + tstRand() % cNsPeriodMax;
+                if (fList)
+                    tstListInsert(&Queue, pTimer);
+                else
+                    tmTimerQueueHeapInsert(&Queue, pTimer);
+                cOps++;
+            }
+        }
+        else
+        {
+            pTimer->u64Expire = u64Now + 1 + tstRand() % cNsPeriodMax;
+            if (fList)
+                tstListInsert(&Queue, pTimer);
+            else
+                tmTimerQueueHeapInsert(&Queue, pTimer);
+            cOps++;
+        }
+
+        /* Advance the clock and expire + re-arm, the run loop and periodic timer case. */
+        u64Now += cNsPeriodMax / cTimers + 1;
+        while ((pTimer = TMTIMER_GET_HEAD(&Queue)) != NULL && pTimer->u64Expire <= u64Now)
+        {
+            if (fList)
+                tstListRemove(&Queue, pTimer);
+            else
+                tmTimerQueueHeapRemove(&Queue, pTimer);
+            pTimer->u64Expire = u64Now + 1 + tstRand() % cNsPeriodMax;
+            if (fList)
+                tstListInsert(&Queue, pTimer);
+            else
+                tmTimerQueueHeapInsert(&Queue, pTimer);
+            cOps += 2;
+        }
+    }
+    uint64_t const cNsElapsed = RTTimeNanoTS() - nsStart;
+    return cNsElapsed / cOps;
+}
+
+
+static void tstBenchmark(void)
+{
+    RTTestSub(g_hTest, "Benchmark");
+
+    static const uint32_t s_acTimers[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+    for (unsigned i = 0; i < RT_ELEMENTS(s_acTimers); i++)
+    {
+        uint32_t const cTimers = s_acTimers[i];
+        RTTestValueF(g_hTest, tstBenchmarkOne(cTimers, false /*fList*/), RTTESTUNIT_NS_PER_CALL, "heap %u timers", cTimers);
+        if (cTimers <= TST_MAX_LIST_TIMERS)
+            RTTestValueF(g_hTest, tstBenchmarkOne(cTimers, true /*fList*/), RTTESTUNIT_NS_PER_CALL, "list %u timers", cTimers);
+    }
+}
+
+
+int main()
+{
+    RTEXITCODE rcExit = RTTestInitAndCreate("tstTMTimerHeap", &g_hTest);
+    if (rcExit != RTEXITCODE_SUCCESS)
+        return rcExit;
+    RTTestBanner(g_hTest);
+
+    g_pQueue = (PTMTIMERQUEUE)RTMemAllocZ(RT_ALIGN_Z(sizeof(TMTIMERQUEUE), 64) + TST_MAX_TIMERS * sizeof(TMTIMER));
+    if (g_pQueue)
+    {
+        g_paTimers = (PTMTIMER)((uint8_t *)g_pQueue + RT_ALIGN_Z(sizeof(TMTIMERQUEUE), 64));
+        tstCorrectness();
+        if (!RTTestErrorCount(g_hTest))
+            tstBenchmark();
+        RTMemFree(g_pQueue);
+    }
+    else
+        RTTestFailed(g_hTest, "out of memory");
+
+    return RTTestSummaryAndDestroy(g_hTest);
+}
+
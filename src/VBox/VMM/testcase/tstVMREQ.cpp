@@ -24,6 +24,7 @@
 #include <VBox/vmm/cpum.h>
 #include <VBox/err.h>
 #include <VBox/log.h>
+#include <iprt/asm.h>
 #include <iprt/assert.h>
 #include <iprt/initterm.h>
 #include <iprt/semaphore.h>
@@ -37,6 +38,12 @@
 *   Defined Constants And Macros                                                                                                 *
 *********************************************************************************************************************************/
 #define TESTCASE    "tstVMREQ"
+/** Number of threads hammering the VCPU queue in the contention test. */
+#define TST_CONTENTION_THREADS          4
+/** Number of calls each contention test thread makes. */
+#define TST_CONTENTION_CALLS            100000
+/** How often a contention test thread waits for the EMT to catch up. */
+#define TST_CONTENTION_SYNC_INTERVAL    256
 
 
 /*********************************************************************************************************************************
@@ -44,6 +51,12 @@
 *********************************************************************************************************************************/
 /** the error count. */
 static int g_cErrors = 0;
+/** Number of calls executed by the EMT in the contention test. */
+static uint32_t volatile g_cContentionCalls = 0;
+/** The next sequence number expected from each contention test thread. */
+static uint32_t g_aiContentionNextSeq[TST_CONTENTION_THREADS];
+/** The contention test thread arguments, the index is the thread number. */
+static PUVM g_apContentionUVM[TST_CONTENTION_THREADS];
 
 
 /**
@@ -208,6 +221,106 @@ static DECLCALLBACK(int) Thread(RTTHREAD hThreadSelf, void *pvUser)
     return VINF_SUCCESS;
 }
 
+
+/**
+ * The function the contention test threads call on VCPU 0.
+ *
+ * Checks that the calls from each thread are executed in the order they were
+ * made.
+ */
+static DECLCALLBACK(void) ContentionCallback(uint32_t iThread, uint32_t iSeq)
+{
+    if (g_aiContentionNextSeq[iThread] != iSeq)
+    {
+        RTPrintf(TESTCASE ": contention thread #%u: iSeq=%u, expected %u!\n", iThread, iSeq, g_aiContentionNextSeq[iThread]);
+        g_cErrors++;
+    }
+    g_aiContentionNextSeq[iThread] = iSeq + 1;
+    ASMAtomicIncU32(&g_cContentionCalls);
+}
+
+
+/**
+ * Thread function which queues calls to VCPU 0 as fast as it can.
+ */
+static DECLCALLBACK(int) ContentionThread(RTTHREAD hThreadSelf, void *pvUser)
+{
+    PUVM            pUVM    = *(PUVM *)pvUser;
+    uint32_t const  iThread = (uint32_t)((PUVM *)pvUser - &g_apContentionUVM[0]);
+    NOREF(hThreadSelf);
+
+    for (uint32_t iSeq = 0; iSeq < TST_CONTENTION_CALLS; iSeq++)
+    {
+        /* Wait for the EMT every so often so the queue doesn't grow without bounds. */
+        int rc;
+        if ((iSeq + 1) % TST_CONTENTION_SYNC_INTERVAL && iSeq + 1 < TST_CONTENTION_CALLS)
+            rc = VMR3ReqCallNoWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)ContentionCallback, 2, iThread, iSeq);
+        else
+            rc = VMR3ReqCallVoidWaitU(pUVM, 0 /*idDstCpu*/, (PFNRT)ContentionCallback, 2, iThread, iSeq);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf(TESTCASE ": contention thread #%u: iSeq=%u rc=%Rrc\n", iThread, iSeq, rc);
+            return rc;
+        }
+    }
+
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Measures the rate at which calls can be queued to a single VCPU from
+ * several threads at once.
+ */
+static void ContentionTest(PUVM pUVM)
+{
+    RTPrintf(TESTCASE ": contention test, %u threads making %u calls each to VCPU 0...\n",
+             TST_CONTENTION_THREADS, TST_CONTENTION_CALLS);
+    RTStrmFlush(g_pStdOut);
+
+    RTTHREAD ahThreads[TST_CONTENTION_THREADS];
+    uint64_t u64StartTS = RTTimeNanoTS();
+    for (unsigned i = 0; i < TST_CONTENTION_THREADS; i++)
+    {
+        g_apContentionUVM[i] = pUVM;
+        int rc = RTThreadCreateF(&ahThreads[i], ContentionThread, &g_apContentionUVM[i], 0, RTTHREADTYPE_DEFAULT,
+                                 RTTHREADFLAGS_WAITABLE, "CONT%u", i);
+        if (RT_FAILURE(rc))
+        {
+            RTPrintf(TESTCASE ": RTThreadCreate(&ahThreads[%u],,,,) failed, rc=%Rrc\n", i, rc);
+            g_cErrors++;
+            ahThreads[i] = NIL_RTTHREAD;
+        }
+    }
+
+    for (unsigned i = 0; i < TST_CONTENTION_THREADS; i++)
+        if (ahThreads[i] != NIL_RTTHREAD)
+        {
+            int rcThread;
+            int rc = RTThreadWait(ahThreads[i], RT_INDEFINITE_WAIT, &rcThread);
+            if (RT_FAILURE(rc))
+            {
+                RTPrintf(TESTCASE ": RTThreadWait(ahThreads[%u],,) failed, rc=%Rrc\n", i, rc);
+                g_cErrors++;
+            }
+            else if (RT_FAILURE(rcThread))
+                g_cErrors++;
+        }
+    uint64_t u64ElapsedTS = RTTimeNanoTS() - u64StartTS;
+
+    /* Each thread waited for its last call, and the calls are executed in order. */
+    uint32_t const cCalls = ASMAtomicReadU32(&g_cContentionCalls);
+    if (cCalls != TST_CONTENTION_THREADS * TST_CONTENTION_CALLS)
+    {
+        RTPrintf(TESTCASE ": contention test: %u calls executed, expected %u!\n", cCalls, TST_CONTENTION_THREADS * TST_CONTENTION_CALLS);
+        g_cErrors++;
+    }
+    RTPrintf(TESTCASE ": contention test: %u calls in %llu ns, %llu calls/s\n",
+             cCalls, u64ElapsedTS, u64ElapsedTS ? (uint64_t)cCalls * RT_NS_1SEC / u64ElapsedTS : 0);
+    RTStrmFlush(g_pStdOut);
+}
+
+
 static DECLCALLBACK(int)
 tstVMREQConfigConstructor(PUVM pUVM, PVM pVM, void *pvUser)
 {
@@ -278,6 +391,11 @@ extern "C" DECLEXPORT(int) TrustedMain(int argc, char **argv, char **envp)
         RTPrintf(TESTCASE  ": %llu ns elapsed\n", u64ElapsedTS);
         RTStrmFlush(g_pStdOut);
 
+        /*
+         * Contention on a VCPU queue.
+         */
+        ContentionTest(pUVM);
+
         /*
          * Print stats.
          */
@@ -247,6 +247,9 @@
     GEN_CHECK_OFF(DBGFCPU, aEvents[1].Event.u.Bp.iBp);
     GEN_CHECK_OFF(DBGFCPU, aEvents[1].rip);
     GEN_CHECK_OFF(DBGFCPU, aEvents[1].enmState);
+    GEN_CHECK_OFF(DBGFCPU, pTraceRingR3);
+    GEN_CHECK_OFF(DBGFCPU, pTraceRingR0);
+    GEN_CHECK_OFF(DBGFCPU, pTraceRingRC);
     //GEN_CHECK_OFF(DBGFCPU, pGuestRegSet);
     //GEN_CHECK_OFF(DBGFCPU, pHyperRegSet);
 
@@ -281,22 +284,31 @@
     GEN_CHECK_OFF(IEMCPU, aBounceBuffers[1]);
     GEN_CHECK_OFF(IEMCPU, aMemBbMappings);
     GEN_CHECK_OFF(IEMCPU, aMemBbMappings[1]);
+    GEN_CHECK_OFF(IEMCPU, CodeTlb);
+    GEN_CHECK_OFF(IEMCPU, DataTlb);
+    GEN_CHECK_SIZE(IEMTLB);
+    GEN_CHECK_OFF(IEMTLB, aEntries);
+    GEN_CHECK_OFF(IEMTLB, uTlbRevision);
+    GEN_CHECK_OFF(IEMTLB, uTlbPhysRev);
+    GEN_CHECK_SIZE(IEMTLBENTRY);
+    GEN_CHECK_OFF(IEMTLBENTRY, pbMappingR3);
 
     GEN_CHECK_SIZE(IOM);
     GEN_CHECK_OFF(IOM, pTreesRC);
     GEN_CHECK_OFF(IOM, pTreesR3);
     GEN_CHECK_OFF(IOM, pTreesR0);
+    GEN_CHECK_OFF(IOM, uLookupEpoch);
 
     GEN_CHECK_SIZE(IOMCPU);
     GEN_CHECK_OFF(IOMCPU, DisState);
-    GEN_CHECK_OFF(IOMCPU, pMMIORangeLastR3);
     GEN_CHECK_OFF(IOMCPU, pMMIOStatsLastR3);
-    GEN_CHECK_OFF(IOMCPU, pMMIORangeLastR0);
     GEN_CHECK_OFF(IOMCPU, pMMIOStatsLastR0);
-    GEN_CHECK_OFF(IOMCPU, pMMIORangeLastRC);
     GEN_CHECK_OFF(IOMCPU, pMMIOStatsLastRC);
-    GEN_CHECK_OFF(IOMCPU, pRangeLastReadR0);
-    GEN_CHECK_OFF(IOMCPU, pRangeLastReadRC);
+    GEN_CHECK_OFF(IOMCPU, uLookupEpoch);
+    GEN_CHECK_OFF(IOMCPU, aIOPortCacheR3);
+    GEN_CHECK_OFF(IOMCPU, aIOPortCacheR0);
+    GEN_CHECK_OFF(IOMCPU, aIOPortCacheRC);
+    GEN_CHECK_OFF(IOMCPU, aMmioCache);
 
     GEN_CHECK_SIZE(IOMMMIORANGE);
     GEN_CHECK_OFF(IOMMMIORANGE, GCPhys);
@@ -1124,6 +1136,7 @@
     GEN_CHECK_OFF(TM, StatTimerCallbackSetFF);
     GEN_CHECK_SIZE(TMTIMER);
     GEN_CHECK_OFF(TMTIMER, u64Expire);
+    GEN_CHECK_OFF(TMTIMER, u64ExpireLinked);
     GEN_CHECK_OFF(TMTIMER, enmClock);
     GEN_CHECK_OFF(TMTIMER, enmType);
     GEN_CHECK_OFF_DOT(TMTIMER, u.Dev.pfnTimer);
@@ -1136,6 +1149,7 @@
     GEN_CHECK_OFF(TMTIMER, offScheduleNext);
     GEN_CHECK_OFF(TMTIMER, offNext);
     GEN_CHECK_OFF(TMTIMER, offPrev);
+    GEN_CHECK_OFF(TMTIMER, offChild);
     GEN_CHECK_OFF(TMTIMER, pVMR0);
     GEN_CHECK_OFF(TMTIMER, pVMR3);
     GEN_CHECK_OFF(TMTIMER, pVMRC);
@@ -1149,6 +1163,7 @@
     GEN_CHECK_OFF(TMTIMERQUEUE, offActive);
     GEN_CHECK_OFF(TMTIMERQUEUE, offSchedule);
     GEN_CHECK_OFF(TMTIMERQUEUE, enmClock);
+    GEN_CHECK_OFF(TMTIMERQUEUE, cActive);
 
     GEN_CHECK_SIZE(TRPM); // has .mac
     GEN_CHECK_SIZE(TRPMCPU); // has .mac
@@ -1440,6 +1455,7 @@
     GEN_CHECK_OFF(VMCPU, hNativeThreadR0);
     GEN_CHECK_OFF(VMCPU, idHostCpu);
     GEN_CHECK_OFF(VMCPU, fTraceGroups);
+    GEN_CHECK_OFF(VMCPU, fTraceBinGroups);
     GEN_CHECK_OFF(VMCPU, uAdHoc);
     GEN_CHECK_OFF(VMCPU, aStatAdHoc);
     GEN_CHECK_OFF(VMCPU, cpum);
@@ -0,0 +1,318 @@
+/* $Id$ */
+/** @file
+ * VBoxTraceDecode - Converts DBGF binary trace files to the Chrome trace event format.
+ */
+
+/*
+ * Copyright (C) 2011-2015 Oracle Corporation
+ *
+ * This file is part of VirtualBox Open Source Edition (OSE), as
+ * available from http://www.virtualbox.org. This file is free software;
+ * you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License (GPL) as published by the Free Software
+ * Foundation, in version 2 as it comes in the "COPYING" file of the
+ * VirtualBox OSE distribution. VirtualBox OSE is distributed in the
+ * hope that it will be useful, but WITHOUT ANY WARRANTY of any kind.
+ */
+
+
+/*******************************************************************************
+*   Header Files                                                               *
+*******************************************************************************/
+#include <VBox/vmm/dbgftrace.h>
+#include <VBox/err.h>
+
+#include <iprt/buildconfig.h>
+#include <iprt/file.h>
+#include <iprt/getopt.h>
+#include <iprt/initterm.h>
+#include <iprt/message.h>
+#include <iprt/string.h>
+#include <iprt/stream.h>
+
+
+/*******************************************************************************
+*   Defined Constants And Macros                                               *
+*******************************************************************************/
+/** The thread ID used for events raised by non-EMT threads. */
+#define TRACE_DECODE_TID_OTHER  0xffff
+
+
+/*******************************************************************************
+*   Global Variables                                                           *
+*******************************************************************************/
+/**
+ * Argument names of the VMM event types.
+ */
+static const struct
+{
+    /** The event type. */
+    uint16_t    uEvent;
+    /** The argument names for the begin and instant phases. */
+    const char *apszBegin[2];
+    /** The argument names for the end phase. */
+    const char *apszEnd[2];
+} g_aEventArgs[] =
+{
+    { DBGFTRACEEVT_IOPORT_READ,  { "port",    "size" }, { "value", "rc" } },
+    { DBGFTRACEEVT_IOPORT_WRITE, { "port",    "size" }, { "value", "rc" } },
+    { DBGFTRACEEVT_MMIO_READ,    { "address", "size" }, { "value", "rc" } },
+    { DBGFTRACEEVT_MMIO_WRITE,   { "address", "size" }, { "value", "rc" } },
+    { DBGFTRACEEVT_HM_RUN,       { "rip",     NULL   }, { "rip",   "rc" } },
+};
+
+
+/**
+ * Converts a TSC value to nanoseconds relative to a base.
+ *
+ * @returns Nanoseconds since @a u64TscBase.
+ * @param   u64Tsc      The TSC value.
+ * @param   u64TscBase  The TSC value corresponding to zero.
+ * @param   u64TscHz    The TSC frequency.
+ */
+static uint64_t traceDecodeTscToNano(uint64_t u64Tsc, uint64_t u64TscBase, uint64_t u64TscHz)
+{
+    uint64_t const cTicks = u64Tsc - u64TscBase;
+    return cTicks / u64TscHz * RT_NS_1SEC + cTicks % u64TscHz * RT_NS_1SEC / u64TscHz;
+}
+
+
+/**
+ * Writes the argument object of an event.
+ *
+ * @param   pOut        The output stream.
+ * @param   pRec        The record.
+ */
+static void traceDecodeWriteArgs(PRTSTREAM pOut, PCDBGFTRACEREC pRec)
+{
+    const char *apszNames[2] = { "arg0", "arg1" };
+    for (unsigned i = 0; i < RT_ELEMENTS(g_aEventArgs); i++)
+        if (g_aEventArgs[i].uEvent == pRec->uEvent)
+        {
+            apszNames[0] = pRec->bPhase == DBGFTRACEPHASE_END ? g_aEventArgs[i].apszEnd[0] : g_aEventArgs[i].apszBegin[0];
+            apszNames[1] = pRec->bPhase == DBGFTRACEPHASE_END ? g_aEventArgs[i].apszEnd[1] : g_aEventArgs[i].apszBegin[1];
+            break;
+        }
+
+    RTStrmPrintf(pOut, "\"args\":{");
+    bool fFirst = true;
+    for (unsigned i = 0; i < 2; i++)
+        if (apszNames[i])
+        {
+            if (!strcmp(apszNames[i], "rc"))
+                RTStrmPrintf(pOut, "%s\"%s\":%d", fFirst ? "" : ",", apszNames[i], (int32_t)pRec->au64Args[i]);
+            else
+                RTStrmPrintf(pOut, "%s\"%s\":\"%#llx\"", fFirst ? "" : ",", apszNames[i], pRec->au64Args[i]);
+            fFirst = false;
+        }
+    RTStrmPrintf(pOut, "}");
+}
+
+
+/**
+ * Walks the chunks of a trace file.
+ *
+ * @returns VBox status code.
+ * @param   pbFile      The file content.
+ * @param   cbFile      The file size.
+ * @param   pOut        The output stream, NULL for just validating and
+ *                      finding the lowest TSC value.
+ * @param   pu64TscMin  The lowest TSC value.  Output when @a pOut is NULL,
+ *                      input otherwise.
+ * @param   u64TscHz    The TSC frequency.
+ * @param   pcEvents    Where to return the number of events.
+ */
+static int traceDecodeChunks(uint8_t const *pbFile, size_t cbFile, PRTSTREAM pOut, uint64_t *pu64TscMin, uint64_t u64TscHz,
+                             uint64_t *pcEvents)
+{
+    PCDBGFTRACEFILEHDR pHdr  = (PCDBGFTRACEFILEHDR)pbFile;
+    size_t             off   = pHdr->cbHdr;
+    uint64_t           cLost = 0;
+    *pcEvents = 0;
+    while (off < cbFile)
+    {
+        if (cbFile - off < sizeof(DBGFTRACEFILECHUNK))
+            return RTMsgErrorRc(VERR_EOF, "Truncated chunk header at offset %#zx", off);
+        PCDBGFTRACEFILECHUNK pChunk = (PCDBGFTRACEFILECHUNK)&pbFile[off];
+        off += sizeof(*pChunk);
+        if ((cbFile - off) / pHdr->cbRecord < pChunk->cRecords)
+            return RTMsgErrorRc(VERR_EOF, "Truncated chunk at offset %#zx (%u records)", off, pChunk->cRecords);
+
+        uint32_t const tid = pChunk->idCpu == NIL_VMCPUID ? TRACE_DECODE_TID_OTHER : pChunk->idCpu;
+        if (pOut)
+            cLost += pChunk->cLost;
+        for (uint32_t iRec = 0; iRec < pChunk->cRecords; iRec++, off += pHdr->cbRecord)
+        {
+            PCDBGFTRACEREC pRec = (PCDBGFTRACEREC)&pbFile[off];
+            if (!pOut)
+            {
+                if (pRec->u64Tsc < *pu64TscMin)
+                    *pu64TscMin = pRec->u64Tsc;
+                continue;
+            }
+
+            uint64_t const uNanoTS = traceDecodeTscToNano(pRec->u64Tsc, *pu64TscMin, u64TscHz);
+            if (iRec == 0 && pChunk->cLost)
+                RTStrmPrintf(pOut, ",\n{\"name\":\"records-lost\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,"
+                             "\"ts\":%llu.%03u,\"args\":{\"count\":%llu}}",
+                             tid, uNanoTS / 1000, (unsigned)(uNanoTS % 1000), pChunk->cLost);
+
+            char        szName[32];
+            const char *pszName = DBGFTraceBinEventName(pRec->uEvent);
+            if (!pszName)
+            {
+                RTStrPrintf(szName, sizeof(szName), "dev-%#06x", pRec->uEvent);
+                pszName = szName;
+            }
+            const char *pszPhase = pRec->bPhase == DBGFTRACEPHASE_BEGIN ? "B"
+                                 : pRec->bPhase == DBGFTRACEPHASE_END   ? "E" : "i";
+            RTStrmPrintf(pOut, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\",%s\"pid\":1,\"tid\":%u,\"ts\":%llu.%03u,",
+                         pszName, pRec->uEvent >= DBGFTRACEEVT_DEV_FIRST ? "dev" : "vmm", pszPhase,
+                         pRec->bPhase == DBGFTRACEPHASE_INSTANT ? "\"s\":\"t\"," : "",
+                         tid, uNanoTS / 1000, (unsigned)(uNanoTS % 1000));
+            traceDecodeWriteArgs(pOut, pRec);
+            RTStrmPrintf(pOut, "}");
+            *pcEvents += 1;
+        }
+    }
+
+    if (cLost)
+        RTMsgWarning("%llu records were lost while tracing", cLost);
+    return VINF_SUCCESS;
+}
+
+
+/**
+ * Converts a binary trace file.
+ *
+ * @returns Exit code.
+ * @param   pszInput    The binary trace file.
+ * @param   pOut        The output stream.
+ */
+static RTEXITCODE traceDecodeFile(const char *pszInput, PRTSTREAM pOut)
+{
+    void  *pvFile;
+    size_t cbFile;
+    int rc = RTFileReadAll(pszInput, &pvFile, &cbFile);
+    if (RT_FAILURE(rc))
+        return RTMsgErrorExit(RTEXITCODE_FAILURE, "Error reading '%s': %Rrc", pszInput, rc);
+
+    RTEXITCODE         rcExit = RTEXITCODE_FAILURE;
+    PCDBGFTRACEFILEHDR pHdr   = (PCDBGFTRACEFILEHDR)pvFile;
+    if (   cbFile < sizeof(*pHdr)
+        || memcmp(pHdr->szMagic, DBGFTRACEFILEHDR_MAGIC, sizeof(DBGFTRACEFILEHDR_MAGIC)))
+        RTMsgError("'%s' is not a binary trace file", pszInput);
+    else if (   RT_HIWORD(pHdr->uVersion) != RT_HIWORD(DBGFTRACEFILEHDR_VERSION)
+             || pHdr->cbHdr < sizeof(*pHdr)
+             || pHdr->cbHdr > cbFile
+             || pHdr->cbRecord < sizeof(DBGFTRACEREC))
+        RTMsgError("Unsupported trace file version %#x (cbHdr=%#x cbRecord=%#x)", pHdr->uVersion, pHdr->cbHdr, pHdr->cbRecord);
+    else
+    {
+        uint64_t u64TscHz = pHdr->u64TscHz;
+        if (!u64TscHz || u64TscHz == UINT64_MAX)
+        {
+            RTMsgWarning("The TSC frequency is unknown, assuming 1 GHz");
+            u64TscHz = UINT64_C(1000000000);
+        }
+
+        /*
+         * Find the earliest record first, a dump may contain records older
+         * than the header, then convert the records.
+         */
+        uint64_t u64TscMin = pHdr->u64TscStart;
+        uint64_t cEvents;
+        rc = traceDecodeChunks((uint8_t const *)pvFile, cbFile, NULL, &u64TscMin, u64TscHz, &cEvents);
+        if (RT_SUCCESS(rc))
+        {
+            RTStrmPrintf(pOut,
+                         "{\"displayTimeUnit\":\"ns\",\n"
+                         "\"otherData\":{\"cpus\":%u,\"tscHz\":%llu,\"startUnixNano\":%lld},\n"
+                         "\"traceEvents\":[\n"
+                         "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"VM\"}}",
+                         pHdr->cCpus, u64TscHz, pHdr->i64UnixNanoStart);
+            for (uint32_t idCpu = 0; idCpu < pHdr->cCpus; idCpu++)
+                RTStrmPrintf(pOut, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"EMT-%u\"}}",
+                             idCpu, idCpu);
+            RTStrmPrintf(pOut, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Other\"}}",
+                         TRACE_DECODE_TID_OTHER);
+
+            rc = traceDecodeChunks((uint8_t const *)pvFile, cbFile, pOut, &u64TscMin, u64TscHz, &cEvents);
+            RTStrmPrintf(pOut, "\n]}\n");
+            if (RT_SUCCESS(rc))
+            {
+                RTMsgInfo("Converted %llu events", cEvents);
+                rcExit = RTEXITCODE_SUCCESS;
+            }
+        }
+    }
+
+    RTFileReadAllFree(pvFile, cbFile);
+    return rcExit;
+}
+
+
+int main(int argc, char **argv)
+{
+    int rc = RTR3InitExe(argc, &argv, 0 /*fFlags*/);
+    if (RT_FAILURE(rc))
+        return RTMsgInitFailure(rc);
+
+    static const RTGETOPTDEF s_aOptions[] =
+    {
+        { "--output",    'o', RTGETOPT_REQ_STRING  },
+    };
+    RTGETOPTSTATE State;
+    RTGetOptInit(&State, argc, argv, &s_aOptions[0], RT_ELEMENTS(s_aOptions), 1, RTGETOPTINIT_FLAGS_OPTS_FIRST);
+
+    const char *pszOutput = NULL;
+    const char *pszInput  = NULL;
+    int iOpt;
+    RTGETOPTUNION ValueUnion;
+    while ((iOpt = RTGetOpt(&State, &ValueUnion)) != 0)
+    {
+        switch (iOpt)
+        {
+            case 'o':
+                pszOutput = ValueUnion.psz;
+                break;
+
+            case VINF_GETOPT_NOT_OPTION:
+                if (pszInput)
+                    return RTMsgErrorExit(RTEXITCODE_SYNTAX, "Only one input file, please");
+                pszInput = ValueUnion.psz;
+                break;
+
+            case 'h':
+                RTPrintf("Usage: VBoxTraceDecode [-o|--output trace.json] [-h|--help] [-V|--version] <trace-file>\n"
+                         "Converts a DBGF binary trace file (DBGF/TraceBinFile or DBGFR3TraceBinDump) into\n"
+                         "the Chrome trace event format, which chrome://tracing and Perfetto can load.\n");
+                return RTEXITCODE_SUCCESS;
+            case 'V':
+                RTPrintf("%sr%s\n", RTBldCfgVersion(), RTBldCfgRevisionStr());
+                return RTEXITCODE_SUCCESS;
+            default:
+                return RTGetOptPrintError(iOpt, &ValueUnion);
+        }
+    }
+    if (!pszInput)
+        return RTMsgErrorExit(RTEXITCODE_SYNTAX, "No input file specified");
+
+    PRTSTREAM pOut = g_pStdOut;
+    if (pszOutput)
+    {
+        rc = RTStrmOpen(pszOutput, "w", &pOut);
+        if (RT_FAILURE(rc))
+            return RTMsgErrorExit(RTEXITCODE_FAILURE, "Error creating '%s': %Rrc", pszOutput, rc);
+    }
+
+    RTEXITCODE rcExit = traceDecodeFile(pszInput, pOut);
+
+    if (pszOutput)
+    {
+        rc = RTStrmClose(pOut);
+        if (RT_FAILURE(rc) && rcExit == RTEXITCODE_SUCCESS)
+            rcExit = RTMsgErrorExit(RTEXITCODE_FAILURE, "Error closing '%s': %Rrc", pszOutput, rc);
+    }
+    return rcExit;
+}
@@ -536,6 +536,65 @@ class tdTeleportLocal1(vbox.TestDriver):
             fRc = False;
         return fRc;
 
+    def test1Sub8(self, oVmSrc, oVmDst):
+        """
+        Test teleporting with the stream striped over several connections and
+        the stronger compression enabled.
+        """
+        reporter.testStart('Multi-stream teleportation');
+        for cStreams in (2, 4, 16):
+            reporter.testStart('%u streams' % (cStreams,));
+            if    self.test1ResetVmConfig(oVmSrc, fTeleporterEnabled = False) \
+              and self.test1ResetVmConfig(oVmDst, fTeleporterEnabled = True):
+                # Configure the source.
+                oSession = self.openSession(oVmSrc);
+                if oSession is not None:
+                    fRc = oSession.setExtraData('VBoxInternal2/TeleporterStreams', str(cStreams));
+                    fRc = oSession.setExtraData('VBoxInternal/SSM/ZipCodec', 'zlib') and fRc;
+                    fRc = oSession.saveSettings() and fRc;
+                    if not oSession.close(): fRc = False;
+                    oSession = None;
+                else:
+                    fRc = False;
+                if fRc:
+                    # Start the target VM.
+                    oSessionDst, oProgressDst = self.startVmEx(oVmDst, fWait = False);
+                    if oSessionDst is not None:
+                        if oProgressDst.waitForOperation(iOperation = -3) == 0:
+                            # Start the source VM.
+                            oSessionSrc = self.startVm(oVmSrc);
+                            if oSessionSrc is not None:
+                                self.sleep(1);
+                                # Try teleport.
+                                oProgressSrc = oSessionSrc.teleport('localhost', 6502, 'password');
+                                if oProgressSrc:
+                                    oProgressSrc.wait();
+                                    oProgressDst.wait();
+                                    reporter.log('src: %s' % oProgressSrc.stringifyResult());
+                                    reporter.log('dst: %s' % oProgressDst.stringifyResult());
+                                    if not oProgressSrc.isSuccess() or not oProgressDst.isSuccess():
+                                        reporter.testFailure('Teleporting over %u streams failed' % (cStreams,));
+                                else:
+                                    reporter.testFailure('IConsole::teleport failed');
+                                self.terminateVmBySession(oSessionSrc, oProgressSrc);
+                        self.terminateVmBySession(oSessionDst, oProgressDst);
+                else:
+                    reporter.testFailure('reconfig #2 failed');
+
+                # Restore the source config.
+                oSession = self.openSession(oVmSrc);
+                if oSession is not None:
+                    oSession.setExtraData('VBoxInternal2/TeleporterStreams', '');
+                    oSession.setExtraData('VBoxInternal/SSM/ZipCodec', '');
+                    oSession.saveSettings();
+                    oSession.close();
+                    oSession = None;
+            else:
+                reporter.testFailure('reconfig #1 failed');
+            if reporter.testDone()[1] != 0:
+                break;
+        return reporter.testDone()[1] == 0;
+
     def test1Sub7(self, oVmSrc, oVmDst):
         """
         Test the password check.
@@ -945,6 +1004,7 @@ class tdTeleportLocal1(vbox.TestDriver):
             self.test1Sub5(oVmRaw1, oVmRaw2);
             self.test1Sub6(oVmRaw1, oVmRaw2);
             self.test1Sub7(oVmRaw1, oVmRaw2);
+            self.test1Sub8(oVmRaw1, oVmRaw2);
         else:
             reporter.testFailure('Failed to reset the VM configs')
         return reporter.testDone()[1] == 0;